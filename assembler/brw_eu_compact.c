@@ -328,13 +328,74 @@ static const uint32_t *datatype_table;
 static const uint32_t *subreg_table;
 static const uint32_t *src_index_table;
 
+/*
+ * Open addressing hashes of the tables above, mapping an uncompacted value
+ * back to its index so that compacting doesn't search the tables. Slots hold
+ * index + 1, with 0 for empty slots.
+ */
+#define COMPACT_HASH_BITS 6
+#define COMPACT_HASH_SIZE (1 << COMPACT_HASH_BITS)
+
+struct compact_table_hash {
+   uint32_t value[COMPACT_HASH_SIZE];
+   uint8_t index[COMPACT_HASH_SIZE];
+};
+
+static struct compact_table_hash control_index_hash;
+static struct compact_table_hash datatype_hash;
+static struct compact_table_hash subreg_hash;
+static struct compact_table_hash src_index_hash;
+
+static unsigned
+compact_hash(uint32_t value)
+{
+   return (value * 0x9e3779b1u) >> (32 - COMPACT_HASH_BITS);
+}
+
+static void
+compact_table_hash_init(struct compact_table_hash *hash,
+                        const uint32_t *table)
+{
+   memset(hash, 0, sizeof(*hash));
+
+   for (int i = 0; i < 32; i++) {
+      unsigned slot = compact_hash(table[i]);
+
+      while (hash->index[slot] && hash->value[slot] != table[i])
+         slot = (slot + 1) % COMPACT_HASH_SIZE;
+
+      /* Keep the first index of duplicated values, as a search would */
+      if (!hash->index[slot]) {
+         hash->value[slot] = table[i];
+         hash->index[slot] = i + 1;
+      }
+   }
+}
+
+static bool
+compact_table_lookup(const struct compact_table_hash *hash,
+                     uint32_t uncompacted, uint32_t *compacted)
+{
+   unsigned slot = compact_hash(uncompacted);
+
+   while (hash->index[slot]) {
+      if (hash->value[slot] == uncompacted) {
+         *compacted = hash->index[slot] - 1;
+         return true;
+      }
+      slot = (slot + 1) % COMPACT_HASH_SIZE;
+   }
+
+   return false;
+}
+
 static bool
 set_control_index(struct intel_context *intel,
                   struct brw_compact_instruction *dst,
                   struct brw_instruction *src)
 {
    uint32_t *src_u32 = (uint32_t *)src;
-   uint32_t uncompacted = 0;
+   uint32_t compacted, uncompacted = 0;
 
    uncompacted |= ((src_u32[0] >> 8) & 0xffff) << 0;
    uncompacted |= ((src_u32[0] >> 31) & 0x1) << 16;
@@ -344,67 +405,51 @@ set_control_index(struct intel_context *intel,
    if (intel->gen >= 7)
       uncompacted |= ((src_u32[2] >> 25) & 0x3) << 17;
 
-   for (int i = 0; i < 32; i++) {
-      if (control_index_table[i] == uncompacted) {
-	 dst->dw0.control_index = i;
-	 return true;
-      }
-   }
+   if (!compact_table_lookup(&control_index_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.control_index = compacted;
+   return true;
 }
 
 static bool
 set_datatype_index(struct brw_compact_instruction *dst,
                    struct brw_instruction *src)
 {
-   uint32_t uncompacted = 0;
+   uint32_t compacted, uncompacted = 0;
 
    uncompacted |= src->bits1.ud & 0x7fff;
    uncompacted |= (src->bits1.ud >> 29) << 15;
 
-   for (int i = 0; i < 32; i++) {
-      if (datatype_table[i] == uncompacted) {
-	 dst->dw0.data_type_index = i;
-	 return true;
-      }
-   }
+   if (!compact_table_lookup(&datatype_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.data_type_index = compacted;
+   return true;
 }
 
 static bool
 set_subreg_index(struct brw_compact_instruction *dst,
                  struct brw_instruction *src)
 {
-   uint32_t uncompacted = 0;
+   uint32_t compacted, uncompacted = 0;
 
    uncompacted |= src->bits1.da1.dest_subreg_nr << 0;
    uncompacted |= src->bits2.da1.src0_subreg_nr << 5;
    uncompacted |= src->bits3.da1.src1_subreg_nr << 10;
 
-   for (int i = 0; i < 32; i++) {
-      if (subreg_table[i] == uncompacted) {
-	 dst->dw0.sub_reg_index = i;
-	 return true;
-      }
-   }
+   if (!compact_table_lookup(&subreg_hash, uncompacted, &compacted))
+      return false;
 
-   return false;
+   dst->dw0.sub_reg_index = compacted;
+   return true;
 }
 
 static bool
 get_src_index(uint32_t uncompacted,
               uint32_t *compacted)
 {
-   for (int i = 0; i < 32; i++) {
-      if (src_index_table[i] == uncompacted) {
-	 *compacted = i;
-	 return true;
-      }
-   }
-
-   return false;
+   return compact_table_lookup(&src_index_hash, uncompacted, compacted);
 }
 
 static bool
@@ -662,6 +707,11 @@ brw_init_compaction_tables(struct intel_context *intel)
    default:
       return;
    }
+
+   compact_table_hash_init(&control_index_hash, control_index_table);
+   compact_table_hash_init(&datatype_hash, datatype_table);
+   compact_table_hash_init(&subreg_hash, subreg_table);
+   compact_table_hash_init(&src_index_hash, src_index_table);
 }
 
 void
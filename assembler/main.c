@@ -71,12 +71,23 @@ typedef struct hash_item *hash_table[HASH_SIZE];
 
 static hash_table declared_register_table;
 
+/*
+ * Labels are hashed by name. Some assembly code has duplicated labels, so
+ * each name keeps the addresses of all its definitions, in program order.
+ */
 struct label_item {
 	char *name;
-	int addr;
+	int *addrs;
+	int count;
+	int size;
 	struct label_item *next;
 };
-static struct label_item *label_table;
+
+static struct {
+	struct label_item **buckets;
+	unsigned int size;
+	unsigned int count;
+} label_table;
 
 static const struct option longopts[] = {
 	{"advanced", no_argument, 0, 'a'},
@@ -153,47 +164,124 @@ void insert_register(struct declared_register *reg)
     insert_hash_item(declared_register_table, reg->name, reg);
 }
 
+static unsigned int label_hash(const char *name)
+{
+	unsigned int ret = 2166136261u;
+
+	while (*name) {
+		ret ^= (unsigned char)*name++;
+		ret *= 16777619u;
+	}
+
+	return ret;
+}
+
+static struct label_item *find_label(const char *name)
+{
+	struct label_item *p;
+
+	if (!label_table.size)
+		return NULL;
+
+	p = label_table.buckets[label_hash(name) & (label_table.size - 1)];
+	for (; p; p = p->next)
+		if (strcmp(p->name, name) == 0)
+			return p;
+
+	return NULL;
+}
+
+static void grow_label_table(void)
+{
+	unsigned int size = label_table.size ? 2 * label_table.size : 64;
+	struct label_item **buckets = calloc(size, sizeof(*buckets));
+	struct label_item *p, *next;
+	unsigned int i, index;
+
+	for (i = 0; i < label_table.size; i++) {
+		for (p = label_table.buckets[i]; p; p = next) {
+			next = p->next;
+			index = label_hash(p->name) & (size - 1);
+			p->next = buckets[index];
+			buckets[index] = p;
+		}
+	}
+
+	free(label_table.buckets);
+	label_table.buckets = buckets;
+	label_table.size = size;
+}
+
 static void add_label(struct brw_program_instruction *i)
 {
-    struct label_item **p = &label_table;
+	struct label_item *p;
+	unsigned int index;
+
+	assert(is_label(i));
+
+	p = find_label(label_name(i));
+	if (!p) {
+		if (label_table.count >= label_table.size)
+			grow_label_table();
+
+		p = calloc(1, sizeof(*p));
+		p->name = label_name(i);
+		index = label_hash(p->name) & (label_table.size - 1);
+		p->next = label_table.buckets[index];
+		label_table.buckets[index] = p;
+		label_table.count++;
+	}
 
-    assert(is_label(i));
+	if (p->count == p->size) {
+		p->size = p->size ? 2 * p->size : 1;
+		p->addrs = realloc(p->addrs, p->size * sizeof(*p->addrs));
+	}
 
-    while(*p)
-        p = &((*p)->next);
-    *p = calloc(1, sizeof(**p));
-    (*p)->name = label_name(i);
-    (*p)->addr = i->inst_offset;
+	/* Labels are added in program order, keeping the addresses sorted */
+	assert(!p->count || p->addrs[p->count - 1] <= i->inst_offset);
+	p->addrs[p->count++] = i->inst_offset;
 }
 
 /* Some assembly code have duplicated labels.
    Start from start_addr. Search as a loop. Return the first label found. */
 static int label_to_addr(char *name, int start_addr)
 {
-    /* return the first label just after start_addr, or the first label from the head */
-    struct label_item *p;
-    int r = -1;
-    for(p = label_table; p; p = p->next) {
-        if(strcmp(p->name, name) == 0) {
-            if(p->addr >= start_addr) // the first label just after start_addr
-                return p->addr;
-            else if(r == -1) // the first label from the head
-                r = p->addr;
-        }
-    }
-    if(r == -1) {
-        fprintf(stderr, "Can't find label %s\n", name);
-        exit(1);
-    }
-    return r;
+	/* return the first label just after start_addr, or the first label from the head */
+	struct label_item *p = find_label(name);
+	int lo = 0, hi, mid;
+
+	if (!p) {
+		fprintf(stderr, "Can't find label %s\n", name);
+		exit(1);
+	}
+
+	hi = p->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (p->addrs[mid] < start_addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo < p->count ? p->addrs[lo] : p->addrs[0];
 }
 
-static void free_label_table(struct label_item *p)
+static void free_label_table(void)
 {
-    if(p) {
-        free_label_table(p->next);
-        free(p);
-    }
+	struct label_item *p, *next;
+	unsigned int i;
+
+	for (i = 0; i < label_table.size; i++) {
+		for (p = label_table.buckets[i]; p; p = next) {
+			next = p->next;
+			free(p->addrs);
+			free(p);
+		}
+	}
+
+	free(label_table.buckets);
+	memset(&label_table, 0, sizeof(label_table));
 }
 
 struct entry_point_item {
@@ -465,7 +553,7 @@ int main(int argc, char **argv)
 
 	free_entry_point_table(entry_point_table);
 	free_hash_table(declared_register_table);
-	free_label_table(label_table);
+	free_label_table();
 
 	fflush (output);
 	if (ferror (output)) {
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Assembles a large kernel built from the test corpus, with a label and a
+# branch to another label per block, to measure label resolution.
+#
+# usage: bench-labels.sh [blocks]
+
+SRCDIR="${srcdir-`pwd`}"
+BUILDDIR="${top_builddir-`pwd`}"
+
+blocks="${1-20000}"
+tests="mov frc regtype rndd rndu rnde rndz lzd not immediate"
+
+test -d "${BUILDDIR}/test" || mkdir "${BUILDDIR}/test/"
+kernel="${BUILDDIR}/test/bench-labels.g4a"
+
+i=0
+while [ $i -lt $blocks ]; do
+	echo "block_$i:"
+	for t in $tests; do
+		cat "${SRCDIR}/test/$t.g4a"
+	done
+	echo "jmpi block_$(( (i * 7919) % blocks ));"
+	i=$((i + 1))
+done > "$kernel"
+
+start=`date +%s.%N`
+"${BUILDDIR}/intel-gen4asm" -o /dev/null "$kernel" || exit 1
+end=`date +%s.%N`
+
+echo "$start $end" | awk -v n=$blocks '{ printf "%d blocks: %.3f s\n", n, $2 - $1 }'
@@ -0,0 +1,274 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures igt_devices_scan() latency.
+ *
+ * Without arguments the real udev scan is compared against a scan served
+ * from the scan cache (IGT_DEVICE_SCAN_CACHE). With -s DIR a fake sysfs
+ * tree with -n pci devices is created in DIR. A seed cache describing it
+ * is loaded once and written back by igt_devices_save_cache(), so the cache
+ * load and lazy sysattr paths are measured on a file from the real save
+ * path, on machines without any gpu.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_device_scan.h"
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void write_file(const char *dir, const char *name, const char *value)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	igt_assert_f(f, "Cannot create %s\n", path);
+	fprintf(f, "%s\n", value);
+	fclose(f);
+}
+
+static void make_dir(const char *path)
+{
+	igt_assert_f(mkdir(path, 0755) == 0 || errno == EEXIST,
+		     "Cannot create %s\n", path);
+}
+
+static void write_stamp(FILE *f, const char *path)
+{
+	struct stat st;
+
+	igt_assert(stat(path, &st) == 0);
+	fprintf(f, "stamp %ld %ld %s\n",
+		(long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec, path);
+}
+
+/*
+ * Build <dir>/devices/pci0000:00/0000:00:XX.0/drm/cardX for each device,
+ * each with @nattrs dummy sysattrs, and a seed <dir>/cache in the format
+ * understood by igt_devices_scan().
+ */
+static void build_fake_sysfs(const char *dir, int ndev, int nattrs,
+			     char *cache, size_t cachesz)
+{
+	char path[PATH_MAX], pci[PATH_MAX], drm[PATH_MAX], name[32];
+	FILE *f;
+	int i, j;
+
+	make_dir(dir);
+	snprintf(path, sizeof(path), "%s/dri", dir);
+	make_dir(path);
+	snprintf(path, sizeof(path), "%s/drivers", dir);
+	make_dir(path);
+	snprintf(path, sizeof(path), "%s/drivers/i915", dir);
+	make_dir(path);
+	snprintf(path, sizeof(path), "%s/devices", dir);
+	make_dir(path);
+	snprintf(path, sizeof(path), "%s/devices/pci0000:00", dir);
+	make_dir(path);
+
+	for (i = 0; i < ndev; i++) {
+		snprintf(pci, sizeof(pci), "%s/devices/pci0000:00/0000:00:%02x.0",
+			 dir, i);
+		make_dir(pci);
+		snprintf(path, sizeof(path), "%s/driver", pci);
+		unlink(path);
+		snprintf(drm, sizeof(drm), "%s/drivers/i915", dir);
+		igt_assert(symlink(drm, path) == 0);
+		write_file(pci, "vendor", "0x8086");
+		write_file(pci, "device", "0x5916");
+		for (j = 0; j < nattrs; j++) {
+			snprintf(name, sizeof(name), "attr%d", j);
+			write_file(pci, name, name);
+		}
+
+		snprintf(drm, sizeof(drm), "%s/drm", pci);
+		make_dir(drm);
+		snprintf(drm, sizeof(drm), "%s/drm/card%d", pci, i);
+		make_dir(drm);
+		write_file(drm, "dev", "226:0");
+	}
+
+	snprintf(cache, cachesz, "%s/cache", dir);
+	f = fopen(cache, "w");
+	igt_assert(f);
+	fprintf(f, "igt-device-scan-cache 1\n");
+	snprintf(path, sizeof(path), "%s/dri", dir);
+	write_stamp(f, path);
+
+	for (i = 0; i < ndev; i++) {
+		snprintf(pci, sizeof(pci), "%s/devices/pci0000:00/0000:00:%02x.0",
+			 dir, i);
+		snprintf(drm, sizeof(drm), "%s/drm/card%d", pci, i);
+		write_stamp(f, pci);
+		write_stamp(f, drm);
+	}
+
+	for (i = 0; i < ndev; i++) {
+		snprintf(pci, sizeof(pci), "%s/devices/pci0000:00/0000:00:%02x.0",
+			 dir, i);
+		fprintf(f, "device -1 pci %s\n", pci);
+		fprintf(f, "prop SUBSYSTEM=pci\n");
+		fprintf(f, "prop PCI_ID=8086:5916\n");
+		fprintf(f, "prop PCI_SLOT_NAME=0000:00:%02x.0\n", i);
+		fprintf(f, "attr driver\nattr vendor\nattr device\n");
+		for (j = 0; j < nattrs; j++)
+			fprintf(f, "attr attr%d\n", j);
+
+		fprintf(f, "device %d drm %s/drm/card%d\n", 2 * i, pci, i);
+		fprintf(f, "devnode /dev/dri/card%d\n", i);
+		fprintf(f, "prop SUBSYSTEM=drm\n");
+		fprintf(f, "prop DEVNAME=/dev/dri/card%d\n", i);
+		fprintf(f, "attr dev\n");
+	}
+	fclose(f);
+}
+
+/* Fails unless the scan is served from the cache of the fake sysfs tree */
+static void check_fake_scan(int ndev)
+{
+	struct igt_device_card card;
+	char filter[64], slot[PCI_SLOT_NAME_SIZE + 1];
+
+	igt_devices_scan(false);
+
+	snprintf(filter, sizeof(filter), "pci:vendor=8086,card=%d", ndev - 1);
+	snprintf(slot, sizeof(slot), "0000:00:%02x.0", ndev - 1);
+	igt_assert_f(igt_device_card_match(filter, &card) &&
+		     !strcmp(card.pci_slot_name, slot),
+		     "Scan cache of the fake sysfs tree was not used\n");
+
+	igt_devices_free();
+}
+
+static double measure(int reps, bool match)
+{
+	struct igt_device_card card;
+	struct timespec start, end;
+	int n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < reps; n++) {
+		igt_devices_scan(false);
+		if (match)
+			igt_device_card_match("sriov:vendor=8086,card=0", &card);
+		igt_devices_free();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return 1e6 * elapsed(&start, &end) / reps;
+}
+
+int main(int argc, char **argv)
+{
+	char cache[PATH_MAX] = "/tmp/igt_device_scan_cache.XXXXXX";
+	const char *fake = NULL;
+	bool match = false;
+	int nattrs = 64;
+	int ndev = 4;
+	int reps = 100;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "s:n:a:r:m")) != -1) {
+		switch (c) {
+		case 's':
+			fake = optarg;
+			break;
+
+		case 'n':
+			ndev = atoi(optarg);
+			if (ndev < 1)
+				ndev = 1;
+			if (ndev > 256)
+				ndev = 256;
+			break;
+
+		case 'a':
+			nattrs = atoi(optarg);
+			if (nattrs < 0)
+				nattrs = 0;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		case 'm':
+			match = true;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (fake) {
+		build_fake_sysfs(fake, ndev, nattrs, cache, sizeof(cache));
+		setenv("IGT_DEVICE_SCAN_CACHE", cache, 1);
+
+		/* Replace the seed with what the library writes itself */
+		check_fake_scan(ndev);
+		igt_devices_scan(false);
+		igt_devices_save_cache();
+		igt_devices_free();
+		check_fake_scan(ndev);
+
+		printf("cached: %.3f us\n", measure(reps, match));
+		return 0;
+	}
+
+	unsetenv("IGT_DEVICE_SCAN_CACHE");
+	printf("udev: %.3f us\n", measure(reps, match));
+
+	fd = mkstemp(cache);
+	igt_assert(fd >= 0);
+	close(fd);
+	unlink(cache);
+
+	/* First scan goes through udev and populates the cache */
+	setenv("IGT_DEVICE_SCAN_CACHE", cache, 1);
+	igt_devices_scan(false);
+	igt_devices_free();
+	printf("cached: %.3f us\n", measure(reps, match));
+	unlink(cache);
+
+	return 0;
+}
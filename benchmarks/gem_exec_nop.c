@@ -25,6 +25,7 @@
  *
  */
 
+#include <getopt.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -41,6 +42,7 @@
 #include "drm.h"
 #include "drmtest.h"
 #include "i915/gem_create.h"
+#include "igt_bench.h"
 #include "igt_stats.h"
 #include "intel_io.h"
 #include "intel_reg.h"
@@ -52,11 +54,19 @@
 #define WRITE 0x2
 #define READ_ALL 0x4
 
-static double elapsed(const struct timespec *start,
-		      const struct timespec *end)
-{
-	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
-}
+struct nop_bench {
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct drm_i915_gem_exec_object2 obj[2];
+	unsigned all_engines[16];
+	unsigned all_nengine;
+	unsigned engines[16];
+	unsigned nengine;
+	unsigned ring;
+	unsigned flags;
+	int ncpus;
+	double *shared;
+	int fd;
+};
 
 static uint32_t batch(int fd)
 {
@@ -66,169 +76,193 @@ static uint32_t batch(int fd)
 	return handle;
 }
 
-static int loop(unsigned ring, int reps, int ncpus, unsigned flags)
+static int setup(struct nop_bench *b)
 {
-	struct drm_i915_gem_execbuffer2 execbuf;
-	struct drm_i915_gem_exec_object2 obj[2];
-	unsigned all_engines[16];
-	unsigned all_nengine;
-	unsigned engines[16];
-	unsigned nengine;
-	double *shared;
+	struct drm_i915_gem_execbuffer2 *execbuf = &b->execbuf;
+	struct drm_i915_gem_exec_object2 *obj = b->obj;
 	int fd;
 
-	shared = mmap(0, 4096, PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	b->shared = mmap(0, 4096, PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
-	fd = drm_open_driver(DRIVER_INTEL);
+	fd = b->fd = drm_open_driver(DRIVER_INTEL);
 
-	memset(obj, 0, sizeof(obj));
+	memset(obj, 0, sizeof(b->obj));
 	obj[0].handle = gem_create(fd, 4096);
-	if (flags & WRITE)
+	if (b->flags & WRITE)
 		obj[0].flags = EXEC_OBJECT_WRITE;
 	obj[1].handle = batch(fd);
 
-	memset(&execbuf, 0, sizeof(execbuf));
-	execbuf.buffers_ptr = (uintptr_t)obj;
-	execbuf.buffer_count = 2;
-	execbuf.flags |= I915_EXEC_HANDLE_LUT;
-	execbuf.flags |= I915_EXEC_NO_RELOC;
-	if (__gem_execbuf(fd, &execbuf)) {
-		execbuf.flags = 0;
-		if (__gem_execbuf(fd, &execbuf))
+	memset(execbuf, 0, sizeof(*execbuf));
+	execbuf->buffers_ptr = (uintptr_t)obj;
+	execbuf->buffer_count = 2;
+	execbuf->flags |= I915_EXEC_HANDLE_LUT;
+	execbuf->flags |= I915_EXEC_NO_RELOC;
+	if (__gem_execbuf(fd, execbuf)) {
+		execbuf->flags = 0;
+		if (__gem_execbuf(fd, execbuf))
 			return 77;
 	}
 
-	if (flags & WRITE && !(execbuf.flags & I915_EXEC_HANDLE_LUT))
+	if (b->flags & WRITE && !(execbuf->flags & I915_EXEC_HANDLE_LUT))
 		return 77;
 
-	all_nengine = 0;
+	b->all_nengine = 0;
 	for (unsigned r = 1; r < 16; r++) {
-		execbuf.flags &= ~ENGINE_FLAGS;
-		execbuf.flags |= r;
-		if (__gem_execbuf(fd, &execbuf) == 0)
-			all_engines[all_nengine++] = r;
+		execbuf->flags &= ~ENGINE_FLAGS;
+		execbuf->flags |= r;
+		if (__gem_execbuf(fd, execbuf) == 0)
+			b->all_engines[b->all_nengine++] = r;
 	}
 
-	if (ring == -1) {
-		nengine = all_nengine;
-		memcpy(engines, all_engines, all_nengine*sizeof(engines[0]));
+	if (b->ring == -1) {
+		b->nengine = b->all_nengine;
+		memcpy(b->engines, b->all_engines,
+		       b->all_nengine*sizeof(b->engines[0]));
 	} else {
-		nengine = 1;
-		engines[0] = ring;
+		b->nengine = 1;
+		b->engines[0] = b->ring;
 	}
 
-	while (reps--) {
-		memset(shared, 0, 4096);
-
-		gem_set_domain(fd, obj[1].handle, I915_GEM_DOMAIN_GTT, 0);
-		sleep(1); /* wait for the hw to go back to sleep */
-
-		igt_fork(child, ncpus) {
-			struct timespec start, end;
-			unsigned count = 0;
-
-			obj[0].handle = gem_create(fd, 4096);
-			obj[1].handle = batch(fd);
-
-			clock_gettime(CLOCK_MONOTONIC, &start);
-			do {
-				for (int inner = 0; inner < 1024; inner++) {
-					if (flags & READ_ALL) {
-						obj[0].flags = 0;
-						for (int n = 0; n < all_nengine; n++) {
-							execbuf.flags &= ~ENGINE_FLAGS;
-							execbuf.flags |= all_engines[n];
-							gem_execbuf(fd, &execbuf);
-						}
-						if (flags & WRITE)
-							obj[0].flags = EXEC_OBJECT_WRITE;
+	return 0;
+}
+
+static double sample(void *data)
+{
+	struct nop_bench *b = data;
+	struct drm_i915_gem_execbuffer2 *execbuf = &b->execbuf;
+	struct drm_i915_gem_exec_object2 *obj = b->obj;
+	unsigned flags = b->flags;
+	double *shared = b->shared;
+	int ncpus = b->ncpus;
+	int fd = b->fd;
+
+	memset(shared, 0, 4096);
+
+	gem_set_domain(fd, obj[1].handle, I915_GEM_DOMAIN_GTT, 0);
+	sleep(1); /* wait for the hw to go back to sleep */
+
+	igt_fork(child, ncpus) {
+		struct timespec start = {};
+		unsigned count = 0;
+
+		obj[0].handle = gem_create(fd, 4096);
+		obj[1].handle = batch(fd);
+
+		igt_nsec_elapsed(&start);
+		do {
+			for (int inner = 0; inner < 1024; inner++) {
+				if (flags & READ_ALL) {
+					obj[0].flags = 0;
+					for (int n = 0; n < b->all_nengine; n++) {
+						execbuf->flags &= ~ENGINE_FLAGS;
+						execbuf->flags |= b->all_engines[n];
+						gem_execbuf(fd, execbuf);
 					}
-					execbuf.flags &= ~ENGINE_FLAGS;
-					execbuf.flags |= engines[count++ % nengine];
-					gem_execbuf(fd, &execbuf);
-					if (flags & SYNC)
-						gem_sync(fd, obj[1].handle);
+					if (flags & WRITE)
+						obj[0].flags = EXEC_OBJECT_WRITE;
 				}
+				execbuf->flags &= ~ENGINE_FLAGS;
+				execbuf->flags |= b->engines[count++ % b->nengine];
+				gem_execbuf(fd, execbuf);
+				if (flags & SYNC)
+					gem_sync(fd, obj[1].handle);
+			}
+		} while (igt_nsec_elapsed(&start) < igt_bench_sample_time() * 1e9);
+
+		gem_sync(fd, obj[1].handle);
+		shared[child] = 1e-3*igt_nsec_elapsed(&start) / count;
+
+		gem_close(fd, obj[1].handle);
+		gem_close(fd, obj[0].handle);
+	}
+	igt_waitchildren();
+
+	for (int child = 0; child < ncpus; child++)
+		shared[ncpus] += shared[child];
 
-				clock_gettime(CLOCK_MONOTONIC, &end);
-			} while (elapsed(&start, &end) < 2.);
-
-			gem_sync(fd, obj[1].handle);
-			clock_gettime(CLOCK_MONOTONIC, &end);
-			shared[child] = 1e6*elapsed(&start, &end) / count;
-
-			gem_close(fd, obj[1].handle);
-			gem_close(fd, obj[0].handle);
-		}
-		igt_waitchildren();
-
-		for (int child = 0; child < ncpus; child++)
-			shared[ncpus] += shared[child];
-		printf("%7.3f\n", shared[ncpus] / ncpus);
-
-		obj[0].flags = 0;
-		for (int n = 0; n < nengine; n++) {
-			execbuf.flags &= ~ENGINE_FLAGS;
-			execbuf.flags |= engines[n];
-			gem_execbuf(fd, &execbuf);
-		}
-		if (flags & WRITE)
-			obj[0].flags = EXEC_OBJECT_WRITE;
+	obj[0].flags = 0;
+	for (int n = 0; n < b->nengine; n++) {
+		execbuf->flags &= ~ENGINE_FLAGS;
+		execbuf->flags |= b->engines[n];
+		gem_execbuf(fd, execbuf);
 	}
-	return 0;
+	if (flags & WRITE)
+		obj[0].flags = EXEC_OBJECT_WRITE;
+
+	return shared[ncpus] / ncpus;
 }
 
-int main(int argc, char **argv)
+static int opt_handler(int opt, int opt_index, void *data)
 {
-	unsigned ring = I915_EXEC_RENDER;
-	unsigned flags = 0;
-	int reps = 1;
-	int ncpus = 1;
-	int c;
-
-	while ((c = getopt (argc, argv, "e:r:sf")) != -1) {
-		switch (c) {
-		case 'e':
-			if (strcmp(optarg, "rcs") == 0)
-				ring = I915_EXEC_RENDER;
-			else if (strcmp(optarg, "vcs") == 0)
-				ring = I915_EXEC_BSD;
-			else if (strcmp(optarg, "bcs") == 0)
-				ring = I915_EXEC_BLT;
-			else if (strcmp(optarg, "vecs") == 0)
-				ring = I915_EXEC_VEBOX;
-			else if (strcmp(optarg, "all") == 0)
-				ring = -1;
-			else
-				ring = atoi(optarg);
-			break;
-
-		case 'r':
-			reps = atoi(optarg);
-			if (reps < 1)
-				reps = 1;
-			break;
-
-		case 'f':
-			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
-			break;
-
-		case 's':
-			flags |= SYNC;
-			break;
-
-		case 'W':
-			flags |= WRITE;
-			break;
-
-		case 'A':
-			flags |= READ_ALL;
-			break;
-
-		default:
-			break;
-		}
+	struct nop_bench *b = data;
+
+	switch (opt) {
+	case 'e':
+		if (strcmp(optarg, "rcs") == 0)
+			b->ring = I915_EXEC_RENDER;
+		else if (strcmp(optarg, "vcs") == 0)
+			b->ring = I915_EXEC_BSD;
+		else if (strcmp(optarg, "bcs") == 0)
+			b->ring = I915_EXEC_BLT;
+		else if (strcmp(optarg, "vecs") == 0)
+			b->ring = I915_EXEC_VEBOX;
+		else if (strcmp(optarg, "all") == 0)
+			b->ring = -1;
+		else
+			b->ring = atoi(optarg);
+		break;
+
+	case 'f':
+		b->ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		break;
+
+	case 's':
+		b->flags |= SYNC;
+		break;
+
+	case 'W':
+		b->flags |= WRITE;
+		break;
+
+	case 'A':
+		b->flags |= READ_ALL;
+		break;
+
+	default:
+		return IGT_OPT_HANDLER_ERROR;
 	}
 
-	return loop(ring, reps, ncpus, flags);
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -e ENGINE\t\trcs, vcs, bcs, vecs, all or an engine number (default rcs)\n"
+	"  -f\t\t\tSubmit from a child process per CPU\n"
+	"  -s\t\t\tWait for each batch before submitting the next\n"
+	"  -W\t\t\tMark the target object as written\n"
+	"  -A\t\t\tRead the target object from all engines before each batch\n";
+
+int main(int argc, char **argv)
+{
+	struct nop_bench b = {
+		.ring = I915_EXEC_RENDER,
+		.ncpus = 1,
+	};
+	int ret;
+
+	/* A single 2s sample without warm-up, as before the common harness */
+	igt_bench_set_defaults(0, 2, 1);
+	igt_bench_init(argc, argv, "e:sfWA", NULL, help_str, opt_handler, &b);
+
+	igt_bench_param("engine", "%d", (int)b.ring);
+	igt_bench_param("children", "%d", b.ncpus);
+	igt_bench_param("sync", "%d", !!(b.flags & SYNC));
+	igt_bench_param("write", "%d", !!(b.flags & WRITE));
+	igt_bench_param("read-all", "%d", !!(b.flags & READ_ALL));
+
+	ret = setup(&b);
+	if (ret)
+		return ret;
+
+	return igt_bench_run("nop", "us", IGT_BENCH_LOWER_IS_BETTER, sample, &b);
 }
@@ -42,267 +42,62 @@
 #include "drm.h"
 #include "drmtest.h"
 #include "i915/gem_create.h"
+#include "i915/gem_exec_trace_replay.h"
 #include "igt_stats.h"
 #include "intel_io.h"
 #include "ioctl_wrappers.h"
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
-};
-
-struct trace_add_bo {
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-
-struct trace_del_bo {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_add_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_del_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_exec {
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint32_t handle;
-} __attribute__((packed));
-
-static uint32_t hars_petruska_f54_1_random(void)
-{
-	static uint32_t state = 0x12345678;
-
-#define rol(x,k) ((x << k) | (x >> (32-k)))
-	return state = (state ^ rol (state, 5) ^ rol (state, 24)) + 0x37798849;
-#undef rol
-}
-
 static double elapsed(const struct timespec *start, const struct timespec *end)
 {
 	return 1e3*(end->tv_sec - start->tv_sec) + 1e-6*(end->tv_nsec - start->tv_nsec);
 }
 
-static uint32_t __gem_context_create_local(int fd)
-{
-	struct drm_i915_gem_context_create arg = {};
-	drmIoctl(fd, DRM_IOCTL_I915_GEM_CONTEXT_CREATE, &arg);
-	return arg.ctx_id;
-}
+struct summary {
+	double elapsed;
+	uint64_t execs;
+	uint64_t latency[3];
+	double depth_mean;
+	uint64_t depth_max;
+	uint64_t lag[2];
+};
 
-static double replay(const char *filename, long nop, long range)
+static void replay(const char *filename,
+		   const struct gem_exec_trace_replay_params *params,
+		   struct summary *s)
 {
-	struct timespec t_start, t_end;
-	struct drm_i915_gem_execbuffer2 eb = {};
-	const struct trace_version {
-		uint32_t magic;
-		uint32_t version;
-	} *tv;
-	const uint32_t bbe = 0xa << 23;
-	struct drm_i915_gem_exec_object2 *exec_objects = NULL;
-	uint32_t *bo, *ctx;
-	int num_bo, num_ctx;
-	int max_objects = 0;
-	struct stat st;
-	uint8_t *ptr, *end;
-	int fd;
-
-	fd = open(filename, O_RDONLY);
-	if (fd < 0)
-		return -1;
-
-	if (fstat(fd, &st) < 0) {
-		close(fd);
-		return -1;
-	}
-
-	ptr = mmap(0, st.st_size, PROT_WRITE, MAP_PRIVATE, fd, 0);
-	close(fd);
-
-	if (ptr == MAP_FAILED)
-		return -1;
-
-	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
-	end = ptr + st.st_size;
-
-	tv = (struct trace_version *)ptr;
-	if (tv->magic != 0xdeadbeef) {
-		fprintf(stderr, "%s: invalid magic\n", filename);
-		return -1;
-	}
-	if (tv->version != 1) {
-		fprintf(stderr, "%s: unhandled version %d\n",
-			filename, tv->version);
-		return -1;
+	struct gem_exec_trace_replay_results results;
+	struct gem_exec_trace_reader reader;
+	struct gem_exec_trace_sink sink;
+	int fd, err;
+
+	s->elapsed = -1;
+	if (!gem_exec_trace_reader_open(&reader, filename)) {
+		fprintf(stderr, "%s: %s\n", filename, reader.error_msg);
+		return;
 	}
-	ptr = (void *)(tv + 1);
-
-	ctx = calloc(1024, sizeof(*ctx));
-	num_ctx = 1024;
-
-	bo = calloc(4096, sizeof(*bo));
-	num_bo = 4096;
 
 	fd = drm_open_driver(DRIVER_INTEL);
-	if (nop > 0) {
-		bo[0] = gem_create(fd, nop + range);
-		gem_write(fd, bo[0], nop + range - sizeof(bbe),
-			  &bbe, sizeof(bbe));
-		range *= 2;
-		range -= 64;
+	gem_exec_trace_sink_init_i915(&sink, fd);
+
+	err = gem_exec_trace_replay(&reader, params, &sink, &results);
+	if (err) {
+		fprintf(stderr, "%s: replay failed: %s\n",
+			filename, strerror(-err));
 	} else {
-		bo[0] = gem_create(fd, 4096);
-		gem_write(fd, bo[0], 0, &bbe, sizeof(bbe));
+		s->elapsed = 1e-6 * results.elapsed;
+		s->execs = results.execs;
+		s->latency[0] = igt_histogram_get_percentile(&results.latency, 50);
+		s->latency[1] = igt_histogram_get_percentile(&results.latency, 99);
+		s->latency[2] = igt_histogram_get_max(&results.latency);
+		s->depth_mean = igt_histogram_get_mean(&results.queue_depth);
+		s->depth_max = igt_histogram_get_max(&results.queue_depth);
+		s->lag[0] = igt_histogram_get_percentile(&results.lag, 99);
+		s->lag[1] = igt_histogram_get_max(&results.lag);
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &t_start);
-	do switch (*ptr++) {
-	case ADD_BO:
-		{
-			struct trace_add_bo *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			if (t->handle >= num_bo) {
-				int new_bo = ALIGN(t->handle, 4096);
-				bo = realloc(bo, sizeof(*bo)*new_bo);
-				memset(bo + num_bo, 0, sizeof(*bo)*(new_bo - num_bo));
-				num_bo = new_bo;
-			}
-
-			bo[t->handle] = gem_create(fd, t->size);
-			break;
-		}
-	case DEL_BO:
-		{
-			struct trace_del_bo *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle && t->handle < num_bo && bo[t->handle]);
-			gem_close(fd, bo[t->handle]);
-			bo[t->handle] = 0;
-			break;
-		}
-	case ADD_CTX:
-		{
-			struct trace_add_ctx *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			if (t->handle >= num_ctx) {
-				int new_ctx = ALIGN(t->handle, 1024);
-				ctx = realloc(ctx, sizeof(*ctx)*new_ctx);
-				memset(ctx + num_ctx, 0, sizeof(*ctx)*(new_ctx - num_ctx));
-				num_ctx = new_ctx;
-			}
-
-			ctx[t->handle] = __gem_context_create_local(fd);
-			break;
-		}
-	case DEL_CTX:
-		{
-			struct trace_del_ctx *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle < num_ctx && ctx[t->handle]);
-			gem_context_destroy(fd, ctx[t->handle]);
-			ctx[t->handle] = 0;
-			break;
-		}
-	case EXEC:
-		{
-			struct trace_exec *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			eb.buffer_count = t->object_count;
-			eb.flags = t->flags;
-			eb.rsvd1 = ctx[t->context];
-
-			if (eb.buffer_count >= max_objects) {
-				free(exec_objects);
-
-				max_objects = ALIGN(eb.buffer_count + 1, 4096);
-
-				exec_objects = malloc(max_objects*sizeof(*exec_objects));
-				eb.buffers_ptr = (uintptr_t)exec_objects;
-			}
-
-			for (uint32_t i = 0; i < eb.buffer_count; i++) {
-				struct trace_exec_object *to = (void *)ptr;
-				ptr = (void *)(to + 1);
-
-				exec_objects[i].handle = bo[to->handle];
-				exec_objects[i].alignment = to->alignment;
-				exec_objects[i].offset = to->offset;
-				exec_objects[i].flags = to->flags;
-				exec_objects[i].rsvd1 = to->rsvd1;
-				exec_objects[i].rsvd2 = to->rsvd2;
-
-				exec_objects[i].relocation_count = to->relocation_count;
-				exec_objects[i].relocs_ptr = (uintptr_t)ptr;
-
-				if (!(eb.flags & I915_EXEC_HANDLE_LUT)) {
-					struct drm_i915_gem_relocation_entry *relocs =
-						(struct drm_i915_gem_relocation_entry *)ptr;
-					for (uint32_t j = 0; j < to->relocation_count; j++)
-						relocs[j].target_handle = bo[relocs[j].target_handle];
-				}
-
-				ptr += sizeof(struct drm_i915_gem_relocation_entry) * to->relocation_count;
-			}
-
-			((struct drm_i915_gem_exec_object2 *)
-			 memset(&exec_objects[eb.buffer_count++], 0,
-				sizeof(*exec_objects)))->handle = bo[0];
-
-			if (nop > 0) {
-				eb.batch_start_offset = hars_petruska_f54_1_random();
-				eb.batch_start_offset =
-					((uint64_t)eb.batch_start_offset * range) >> 32;
-				eb.batch_start_offset = ALIGN(eb.batch_start_offset, 64);
-			}
-			gem_execbuf(fd, &eb);
-			break;
-		}
-
-	case WAIT:
-		{
-			struct trace_wait *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle && t->handle < num_bo && bo[t->handle]);
-			gem_wait(fd, bo[t->handle], NULL);
-			break;
-		}
-
-	default:
-		fprintf(stderr, "Unknown cmd: %x\n", *ptr);
-		return -1;
-	} while (ptr < end);
-	clock_gettime(CLOCK_MONOTONIC, &t_end);
-
-	return elapsed(&t_start, &t_end);
+	gem_exec_trace_replay_results_fini(&results);
+	close(fd);
+	gem_exec_trace_reader_fini(&reader);
 }
 
 static long calibrate_nop(int usecs)
@@ -364,18 +159,29 @@ static int measure_nop(long nop)
 	return 1e3*elapsed(&t_start, &t_end) / 9;
 }
 
+static const char *mode_names[] = {
+	[GEM_EXEC_TRACE_REPLAY_AFAP] = "afap",
+	[GEM_EXEC_TRACE_REPLAY_TIMELINE] = "timeline",
+	[GEM_EXEC_TRACE_REPLAY_OPEN_LOOP] = "open-loop",
+};
+
 int main(int argc, char **argv)
 {
+	struct gem_exec_trace_replay_params params = {
+		.mode = GEM_EXEC_TRACE_REPLAY_AFAP,
+		.scale = 1,
+		.track_queue = true,
+	};
+	struct summary *results;
 	int delay = 1000;
-	double *results;
 	long nop = 0;
 	long range = 0;
 	int i, c;
 
-	results = mmap(NULL, ALIGN(argc*sizeof(double), 4096),
+	results = mmap(NULL, ALIGN(argc*sizeof(*results), 4096),
 		       PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
-	while ((c = getopt(argc, argv, "d:n:r:")) != -1) {
+	while ((c = getopt(argc, argv, "d:n:r:m:s:1q")) != -1) {
 		switch (c) {
 		case 'd':
 			delay = atoi(optarg);
@@ -390,11 +196,37 @@ int main(int argc, char **argv)
 			if (range > 0)
 				range = ALIGN(range, 4096);
 			break;
+		case 'm':
+			for (i = 0; i < ARRAY_SIZE(mode_names); i++)
+				if (!strcmp(optarg, mode_names[i]))
+					break;
+			if (i == ARRAY_SIZE(mode_names)) {
+				fprintf(stderr, "Unknown mode '%s', expected afap, timeline or open-loop\n",
+					optarg);
+				return 1;
+			}
+			params.mode = i;
+			break;
+		case 's':
+			params.scale = atof(optarg);
+			break;
+		case '1':
+			params.single_thread = true;
+			break;
+		case 'q':
+			params.track_queue = false;
+			break;
 		default:
 			break;
 		}
 	}
 
+	/*
+	 * Padding every request with a calibrated nop batch only makes sense
+	 * when measuring throughput, the timed modes keep the traced gaps.
+	 */
+	if (!nop && params.mode != GEM_EXEC_TRACE_REPLAY_AFAP)
+		nop = -1;
 	if (!nop)
 		nop = calibrate_nop(delay);
 	if (!range)
@@ -404,18 +236,32 @@ int main(int argc, char **argv)
 		printf("Using %lu nop batch for ~%dus delay, range %lu [%dus]\n",
 		       nop, delay,
 		       range, (int)(delay * range / nop));
+		params.nop = nop;
+		params.range = range;
 	}
 
 	igt_fork(child, argc-optind)
-		results[child] = replay(argv[child + optind], nop, range);
+		replay(argv[child + optind], &params, &results[child]);
 	igt_waitchildren();
 
 	for (i = 0; i < argc - optind; i++) {
-		double t = results[i];
-		if (t < 0)
+		const struct summary *s = &results[i];
+
+		if (s->elapsed < 0) {
 			printf("%s: failed\n", argv[optind + i]);
-		else
-			printf("%s: %.3f\n", argv[optind + i], t);
+			continue;
+		}
+
+		printf("%s: %.3f\n", argv[optind + i], s->elapsed);
+		printf("  %"PRIu64" execs, latency median %.1fus, 99%% %.1fus, max %.1fus\n",
+		       s->execs, 1e-3 * s->latency[0],
+		       1e-3 * s->latency[1], 1e-3 * s->latency[2]);
+		if (params.track_queue)
+			printf("  queue depth mean %.1f, max %"PRIu64"\n",
+			       s->depth_mean, s->depth_max);
+		if (params.mode != GEM_EXEC_TRACE_REPLAY_AFAP)
+			printf("  lag 99%% %.1fus, max %.1fus\n",
+			       1e-3 * s->lag[0], 1e-3 * s->lag[1]);
 	}
 
 	return 0;
@@ -27,19 +27,24 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/mman.h>
 #include <dlfcn.h>
 #include <i915_drm.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
 #include "intel_aub.h"
 #include "intel_chipset.h"
+#include "i915/gem_exec_trace_data.h"
 
 #ifdef __FreeBSD__
 #include "igt_freebsd.h"
@@ -48,82 +53,67 @@
 static int (*libc_close)(int fd);
 static int (*libc_ioctl)(int fd, unsigned long request, void *argp);
 
+/*
+ * Records are written by the traced threads into their own ring, without
+ * taking any lock, and a background thread moves them to the trace files.
+ * The rings and traces are never freed, only recycled, so they can be
+ * walked without locking.
+ *
+ * mutex serialises opening traces, writer_mutex serialises draining the
+ * rings and writing the files.
+ */
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct trace {
-	int fd;
+	/* -1 once closed, the node is then reused for the next fd */
+	_Atomic int fd;
+	/* NULL if fd is not an i915 device */
 	FILE *file;
+	bool dirty;
 	struct trace *next;
-} *traces;
+};
+static struct trace *_Atomic traces;
 
-#define DRM_MAJOR 226
+#define RING_SIZE (1 << 20)
+#define FRAME_ALIGN 16
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
+/* Every record in a ring is prefixed by a frame, padding has no trace */
+struct frame {
+	struct trace *trace;
+	uint32_t len;
+	uint32_t pad;
 };
 
-static struct trace_verion {
-	uint32_t magic;
-	uint32_t version;
-} version = {
-	.magic = 0xdeadbeef,
-	.version = 1
+struct ring {
+	/* free running byte counters, head is advanced by the owner */
+	_Atomic uint32_t head;
+	/* and tail by whoever holds writer_mutex */
+	_Atomic uint32_t tail;
+	_Atomic bool owned;
+	struct ring *next;
+	uint8_t data[RING_SIZE];
 };
+static struct ring *_Atomic rings;
+
+static __thread struct ring *local_ring;
+static __thread uint32_t local_tid;
+static pthread_key_t ring_key;
+
+static pthread_t writer;
+static bool writer_running;
+static atomic_bool writer_stop;
+
+#define DRM_MAJOR 226
+
+#ifndef ALIGN
+#define ALIGN(x, y) (((x) + (y) - 1) & -(y))
+#endif
 
-struct trace_add_bo {
-	uint8_t cmd;
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-struct trace_del_bo {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_add_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
-struct trace_del_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_exec {
-	uint8_t cmd;
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_exec_relocation {
-	uint32_t target_handle;
-	uint32_t delta;
-	uint64_t offset;
-	uint64_t presumed_offset;
-	uint32_t read_domains;
-	uint32_t write_domain;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
+static const struct trace_version version = {
+	.magic = TRACE_MAGIC,
+	.version = TRACE_VERSION,
+};
 
 static void __attribute__ ((format(__printf__, 2, 3)))
 fail_if(int cond, const char *format, ...)
@@ -140,103 +130,400 @@ fail_if(int cond, const char *format, ...)
 	abort();
 }
 
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t gettid_cached(void)
+{
+	if (!local_tid)
+		local_tid = syscall(SYS_gettid);
+
+	return local_tid;
+}
+
+static void release_ring(void *data)
+{
+	struct ring *ring = data;
+
+	/* Left for the writer to drain, and for the next thread to reuse */
+	atomic_store_explicit(&ring->owned, false, memory_order_release);
+}
+
+static struct ring *get_ring(void)
+{
+	struct ring *ring;
+
+	if (local_ring)
+		return local_ring;
+
+	for (ring = atomic_load(&rings); ring; ring = ring->next) {
+		bool expected = false;
+
+		if (atomic_compare_exchange_strong(&ring->owned,
+						   &expected, true))
+			break;
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(*ring));
+		fail_if(!ring, "failed to allocate trace buffer\n");
+
+		atomic_init(&ring->owned, true);
+		ring->next = atomic_load(&rings);
+		while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+			;
+	}
+
+	pthread_setspecific(ring_key, ring);
+	return local_ring = ring;
+}
+
+/* Called with writer_mutex held */
+static bool drain_ring(struct ring *ring)
+{
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (head == tail)
+		return false;
+
+	while (tail != head) {
+		const struct frame *f =
+			(const void *)&ring->data[tail & (RING_SIZE - 1)];
+
+		if (f->trace && f->trace->file) {
+			fwrite(f + 1, f->len, 1, f->trace->file);
+			f->trace->dirty = true;
+		}
+
+		tail += ALIGN(sizeof(*f) + f->len, FRAME_ALIGN);
+	}
+
+	atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	return true;
+}
+
+/* Called with writer_mutex held */
+static bool drain_rings(void)
+{
+	bool busy = false;
+
+	for (struct ring *ring = atomic_load(&rings); ring; ring = ring->next)
+		busy |= drain_ring(ring);
+
+	return busy;
+}
+
+/* Called with writer_mutex held */
+static void flush_traces(void)
+{
+	for (struct trace *t = atomic_load(&traces); t; t = t->next) {
+		if (t->dirty) {
+			fflush(t->file);
+			t->dirty = false;
+		}
+	}
+}
+
+static void *writer_thread(void *arg)
+{
+	const struct timespec idle = { .tv_nsec = 1000 * 1000 };
+
+	while (!atomic_load(&writer_stop)) {
+		bool busy;
+
+		pthread_mutex_lock(&writer_mutex);
+		busy = drain_rings();
+		if (!busy)
+			flush_traces();
+		pthread_mutex_unlock(&writer_mutex);
+
+		if (!busy)
+			nanosleep(&idle, NULL);
+	}
+
+	return NULL;
+}
+
+struct record {
+	struct trace *trace;
+	/* NULL if the record is too large for the ring */
+	struct ring *ring;
+	uint8_t *data;
+	uint32_t len;
+};
+
+static void *
+record_begin(struct record *r, struct trace *trace,
+	     uint8_t cmd, uint64_t timestamp, size_t payload)
+{
+	struct trace_header *header;
+	struct ring *ring = get_ring();
+	uint32_t head, need, offset;
+
+	r->trace = trace;
+	r->len = sizeof(*header) + payload;
+	need = ALIGN(sizeof(struct frame) + r->len, FRAME_ALIGN);
+
+	if (need > RING_SIZE / 4) {
+		r->ring = NULL;
+		r->data = malloc(r->len);
+		fail_if(!r->data, "failed to allocate trace record\n");
+	} else {
+		r->ring = ring;
+
+		head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		offset = head & (RING_SIZE - 1);
+		if (RING_SIZE - offset < need)
+			need += RING_SIZE - offset;
+
+		/* Wait for the writer, or drain the ring ourselves */
+		while (head + need - atomic_load_explicit(&ring->tail, memory_order_acquire) > RING_SIZE) {
+			if (pthread_mutex_trylock(&writer_mutex) == 0) {
+				drain_ring(ring);
+				pthread_mutex_unlock(&writer_mutex);
+			} else {
+				sched_yield();
+			}
+		}
+
+		if (RING_SIZE - offset < ALIGN(sizeof(struct frame) + r->len, FRAME_ALIGN)) {
+			struct frame *pad = (void *)&ring->data[offset];
+
+			pad->trace = NULL;
+			pad->len = RING_SIZE - offset - sizeof(*pad);
+			head += RING_SIZE - offset;
+			atomic_store_explicit(&ring->head, head, memory_order_release);
+			offset = 0;
+		}
+
+		r->data = ring->data + offset + sizeof(struct frame);
+	}
+
+	header = (void *)r->data;
+	header->cmd = cmd;
+	header->tid = gettid_cached();
+	header->timestamp = timestamp;
+
+	return header + 1;
+}
+
+static void record_end(struct record *r)
+{
+	struct ring *ring = r->ring;
+
+	if (ring) {
+		struct frame *f = (void *)(r->data - sizeof(*f));
+		uint32_t head;
+
+		f->trace = r->trace;
+		f->len = r->len;
+
+		head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		atomic_store_explicit(&ring->head,
+				      head + ALIGN(sizeof(*f) + r->len, FRAME_ALIGN),
+				      memory_order_release);
+	} else {
+		/* Keep it behind whatever this thread has recorded before */
+		pthread_mutex_lock(&writer_mutex);
+		drain_rings();
+		fwrite(r->data, r->len, 1, r->trace->file);
+		r->trace->dirty = true;
+		pthread_mutex_unlock(&writer_mutex);
+
+		free(r->data);
+	}
+}
+
+static void record_cancel(struct record *r)
+{
+	if (!r->ring)
+		free(r->data);
+}
+
 static void
-trace_exec(struct trace *trace,
-	   const struct drm_i915_gem_execbuffer2 *execbuffer2)
+trace_simple(struct trace *trace, uint8_t cmd, uint64_t timestamp,
+	     const void *payload, size_t len)
 {
+	struct record r;
+
+	memcpy(record_begin(&r, trace, cmd, timestamp, len), payload, len);
+	record_end(&r);
+}
+
 #define to_ptr(T, x) ((T *)(uintptr_t)(x))
+
+/*
+ * The exec is copied before the ioctl, so that it captures what was
+ * submitted rather than what the kernel wrote back, but only committed
+ * once the ioctl returns with its out-fence.
+ */
+static struct trace_exec_fences *
+trace_exec_begin(struct record *r, struct trace *trace, uint64_t timestamp,
+		 const struct drm_i915_gem_execbuffer2 *execbuffer2)
+{
 	const struct drm_i915_gem_exec_object2 *exec_objects =
 		to_ptr(typeof(*exec_objects), execbuffer2->buffers_ptr);
-
-	fail_if(execbuffer2->flags & (I915_EXEC_FENCE_IN | I915_EXEC_FENCE_OUT),
-		"fences not supported yet\n");
-
-	flockfile(trace->file);
-	{
-		struct trace_exec t = {
-			EXEC,
-			execbuffer2->buffer_count,
-			execbuffer2->flags,
-			execbuffer2->rsvd1,
-		};
-		fwrite(&t, sizeof(t), 1, trace->file);
-	}
+	const struct drm_i915_gem_exec_fence *fence_array =
+		to_ptr(typeof(*fence_array), execbuffer2->cliprects_ptr);
+	uint32_t fence_count = 0;
+	struct trace_exec_fences *fences;
+	struct trace_exec *t;
+	size_t len;
+	uint8_t *ptr;
+
+	fail_if(execbuffer2->flags & I915_EXEC_USE_EXTENSIONS,
+		"execbuf extensions not supported yet\n");
+
+	if (execbuffer2->flags & I915_EXEC_FENCE_ARRAY)
+		fence_count = execbuffer2->num_cliprects;
+
+	len = sizeof(*t) + sizeof(*fences);
+	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++)
+		len += sizeof(struct trace_exec_object) +
+			exec_objects[i].relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
+	len += fence_count * sizeof(*fence_array);
+
+	ptr = record_begin(r, trace, TRACE_EXEC, timestamp, len);
+
+	t = (void *)ptr;
+	t->object_count = execbuffer2->buffer_count;
+	t->flags = execbuffer2->flags;
+	t->context = execbuffer2->rsvd1;
+	ptr += sizeof(*t);
+
+	fences = (void *)ptr;
+	fences->fence_in = -1;
+	if (execbuffer2->flags & I915_EXEC_FENCE_IN)
+		fences->fence_in = (uint32_t)execbuffer2->rsvd2;
+	fences->fence_out = -1;
+	fences->fence_count = fence_count;
+	fences->duration = 0;
+	ptr += sizeof(*fences);
 
 	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++) {
 		const struct drm_i915_gem_exec_object2 *obj = &exec_objects[i];
-		const struct drm_i915_gem_relocation_entry *relocs =
-			to_ptr(typeof(*relocs), obj->relocs_ptr);
-		{
-			struct trace_exec_object t = {
-				obj->handle,
-				obj->relocation_count,
-				obj->alignment,
-				obj->offset,
-				obj->flags,
-				obj->rsvd1,
-				obj->rsvd2
-			};
-			fwrite(&t, sizeof(t), 1, trace->file);
-		}
-		fwrite(relocs, sizeof(*relocs), obj->relocation_count,
-		       trace->file);
+		struct trace_exec_object to = {
+			obj->handle,
+			obj->relocation_count,
+			obj->alignment,
+			obj->offset,
+			obj->flags,
+			obj->rsvd1,
+			obj->rsvd2
+		};
+		size_t sz = obj->relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
+
+		memcpy(ptr, &to, sizeof(to));
+		ptr += sizeof(to);
+
+		memcpy(ptr, to_ptr(void, obj->relocs_ptr), sz);
+		ptr += sz;
 	}
 
-	fflush(trace->file);
-	funlockfile(trace->file);
-#undef to_ptr
+	memcpy(ptr, fence_array, fence_count * sizeof(*fence_array));
+
+	return fences;
+}
+
+static void
+trace_exec_end(struct record *r, struct trace_exec_fences *fences,
+	       const struct drm_i915_gem_execbuffer2 *execbuffer2,
+	       uint64_t duration)
+{
+	if (execbuffer2->flags & I915_EXEC_FENCE_OUT)
+		fences->fence_out = execbuffer2->rsvd2 >> 32;
+	fences->duration = duration;
+
+	record_end(r);
+}
+
+static void
+trace_wait(struct trace *trace, uint64_t timestamp, uint32_t handle)
+{
+	struct trace_wait t = { handle };
+	trace_simple(trace, TRACE_WAIT, timestamp, &t, sizeof(t));
+}
+
+static void
+trace_add(struct trace *trace, uint64_t timestamp,
+	  uint32_t handle, uint64_t size)
+{
+	struct trace_add_bo t = { handle, size };
+	trace_simple(trace, TRACE_ADD_BO, timestamp, &t, sizeof(t));
 }
 
 static void
-trace_wait(struct trace *trace, uint32_t handle)
+trace_del(struct trace *trace, uint64_t timestamp, uint32_t handle)
 {
-	struct trace_wait t = { WAIT, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_del_bo t = { handle };
+	trace_simple(trace, TRACE_DEL_BO, timestamp, &t, sizeof(t));
 }
 
 static void
-trace_add(struct trace *trace, uint32_t handle, uint64_t size)
+trace_add_context(struct trace *trace, uint64_t timestamp, uint32_t handle)
 {
-	struct trace_add_bo t = { ADD_BO, handle, size };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_add_ctx t = { handle };
+	trace_simple(trace, TRACE_ADD_CTX, timestamp, &t, sizeof(t));
 }
 
 static void
-trace_del(struct trace *trace, uint32_t handle)
+trace_del_context(struct trace *trace, uint64_t timestamp, uint32_t handle)
 {
-	struct trace_del_bo t = { DEL_BO, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_del_ctx t = { handle };
+	trace_simple(trace, TRACE_DEL_CTX, timestamp, &t, sizeof(t));
 }
 
 static void
-trace_add_context(struct trace *trace, uint32_t handle)
+trace_add_syncobj(struct trace *trace, uint64_t timestamp, uint32_t handle)
 {
-	struct trace_add_ctx t = { ADD_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_add_syncobj t = { handle };
+	trace_simple(trace, TRACE_ADD_SYNCOBJ, timestamp, &t, sizeof(t));
 }
 
 static void
-trace_del_context(struct trace *trace, uint32_t handle)
+trace_del_syncobj(struct trace *trace, uint64_t timestamp, uint32_t handle)
+{
+	struct trace_del_syncobj t = { handle };
+	trace_simple(trace, TRACE_DEL_SYNCOBJ, timestamp, &t, sizeof(t));
+}
+
+static struct trace *find_trace(int fd)
 {
-	struct trace_del_ctx t = { DEL_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace *t;
+
+	for (t = atomic_load(&traces); t; t = t->next)
+		if (atomic_load_explicit(&t->fd, memory_order_acquire) == fd)
+			break;
+
+	return t;
 }
 
 int
 close(int fd)
 {
-	struct trace *t, **p;
+	struct trace *t = fd >= 0 ? find_trace(fd) : NULL;
 
-	pthread_mutex_lock(&mutex);
-	for (p = &traces; (t = *p); p = &t->next) {
-		if (t->fd == fd) {
-			*p = t->next;
+	if (t) {
+		pthread_mutex_lock(&mutex);
+		pthread_mutex_lock(&writer_mutex);
+		if (t->file) {
+			drain_rings();
 			fclose(t->file);
-			free(t);
-			break;
+			t->file = NULL;
+			t->dirty = false;
 		}
+		atomic_store_explicit(&t->fd, -1, memory_order_release);
+		pthread_mutex_unlock(&writer_mutex);
+		pthread_mutex_unlock(&mutex);
 	}
-	pthread_mutex_unlock(&mutex);
 
 	return libc_close(fd);
 }
@@ -246,10 +533,6 @@ size_for_fb(const struct drm_mode_fb_cmd *cmd)
 {
 	unsigned long size;
 
-#ifndef ALIGN
-#define ALIGN(x, y) (((x) + (y) - 1) & -(y))
-#endif
-
 	size = ALIGN(cmd->width * cmd->bpp, 64);
 	size *= cmd->height;
 	return ALIGN(size, 4096);
@@ -270,10 +553,63 @@ static int is_i915(int fd)
 	return strcmp(name, "i915") == 0;
 }
 
+static struct trace *open_trace(int fd)
+{
+	struct trace *t;
+
+	pthread_mutex_lock(&mutex);
+
+	t = find_trace(fd);
+	if (t)
+		goto out;
+
+	for (t = atomic_load(&traces); t; t = t->next)
+		if (atomic_load(&t->fd) == -1)
+			break;
+	if (!t) {
+		t = calloc(1, sizeof(*t));
+		if (!t)
+			goto out;
+
+		atomic_init(&t->fd, -1);
+		t->next = atomic_load(&traces);
+		atomic_store(&traces, t);
+	}
+
+	t->file = NULL;
+	if (is_i915(fd)) {
+		char filename[80];
+
+		sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
+		t->file = fopen(filename, "w+");
+		if (!t->file || !fwrite(&version, sizeof(version), 1, t->file)) {
+			if (t->file)
+				fclose(t->file);
+			t = NULL;
+			goto out;
+		}
+
+		if (!writer_running) {
+			atomic_store(&writer_stop, false);
+			fail_if(pthread_create(&writer, NULL, writer_thread, NULL),
+				"failed to start the trace writer\n");
+			writer_running = true;
+		}
+	}
+
+	atomic_store_explicit(&t->fd, fd, memory_order_release);
+out:
+	pthread_mutex_unlock(&mutex);
+	return t;
+}
+
 int
 ioctl(int fd, unsigned long request, ...)
 {
-	struct trace *t, **p;
+	struct trace_exec_fences *fences = NULL;
+	struct record exec;
+	uint64_t timestamp;
+	struct trace *t;
 	va_list args;
 	void *argp;
 	int ret;
@@ -285,98 +621,82 @@ ioctl(int fd, unsigned long request, ...)
 	if (_IOC_TYPE(request) != DRM_IOCTL_BASE)
 		goto untraced;
 
-	pthread_mutex_lock(&mutex);
-	for (p = &traces; (t = *p); p = &t->next) {
-		if (fd == t->fd) {
-			if (traces != t) {
-				*p = t->next;
-				t->next = traces;
-				traces = t;
-			}
-			break;
-		}
-	}
+	t = find_trace(fd);
 	if (!t) {
-		char filename[80];
-
-		if (!is_i915(fd)) {
-			pthread_mutex_unlock(&mutex);
-			goto untraced;
-		}
-
-		t = malloc(sizeof(*t));
-		if (!t) {
-			pthread_mutex_unlock(&mutex);
+		t = open_trace(fd);
+		if (!t)
 			return -ENOMEM;
-		}
-
-		sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
-		t->file = fopen(filename, "w+");
-		t->fd = fd;
-
-		if (!fwrite(&version, sizeof(version), 1, t->file)) {
-			pthread_mutex_unlock(&mutex);
-			fclose(t->file);
-			free(t);
-			return -ENOMEM;
-		}
-
-		t->next = traces;
-		traces = t;
 	}
-	pthread_mutex_unlock(&mutex);
+	if (!t->file)
+		goto untraced;
+
+	timestamp = now();
 
 	switch (request) {
 	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
 	case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR:
-		trace_exec(t, argp);
+		fences = trace_exec_begin(&exec, t, timestamp, argp);
 		break;
 
 	case DRM_IOCTL_GEM_CLOSE: {
 		struct drm_gem_close *close = argp;
-		trace_del(t, close->handle);
+		trace_del(t, timestamp, close->handle);
 		break;
 	}
 
 	case DRM_IOCTL_I915_GEM_CONTEXT_DESTROY: {
 		struct drm_i915_gem_context_destroy *close = argp;
-		trace_del_context(t, close->ctx_id);
+		trace_del_context(t, timestamp, close->ctx_id);
+		break;
+	}
+
+	case DRM_IOCTL_SYNCOBJ_DESTROY: {
+		struct drm_syncobj_destroy *destroy = argp;
+		trace_del_syncobj(t, timestamp, destroy->handle);
 		break;
 	}
 
 	case DRM_IOCTL_I915_GEM_WAIT: {
 		struct drm_i915_gem_wait *w = argp;
-		trace_wait(t, w->bo_handle);
+		trace_wait(t, timestamp, w->bo_handle);
 		break;
 	}
 
 	case DRM_IOCTL_I915_GEM_SET_DOMAIN: {
 		struct drm_i915_gem_set_domain *w = argp;
-		trace_wait(t, w->handle);
+		trace_wait(t, timestamp, w->handle);
 		break;
 	}
 	}
 
 	ret = libc_ioctl(fd, request, argp);
-	if (ret)
+	if (ret) {
+		if (fences)
+			record_cancel(&exec);
 		return ret;
+	}
 
 	switch (request) {
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR:
+		trace_exec_end(&exec, fences, argp, now() - timestamp);
+		break;
+
 	case DRM_IOCTL_I915_GEM_CREATE: {
 		struct drm_i915_gem_create *create = argp;
-		trace_add(t, create->handle, create->size);
+		trace_add(t, timestamp, create->handle, create->size);
 		break;
 	}
 
 	case DRM_IOCTL_I915_GEM_USERPTR: {
 		struct drm_i915_gem_userptr *userptr = argp;
-		trace_add(t, userptr->handle, userptr->user_size);
+		trace_add(t, timestamp, userptr->handle, userptr->user_size);
 		break;
 	}
 
 	case DRM_IOCTL_GEM_OPEN: {
 		struct drm_gem_open *open = argp;
-		trace_add(t, open->handle, open->size);
+		trace_add(t, timestamp, open->handle, open->size);
 		break;
 	}
 
@@ -384,19 +704,25 @@ ioctl(int fd, unsigned long request, ...)
 		struct drm_prime_handle *prime = argp;
 		off_t size = lseek(prime->fd, 0, SEEK_END);
 		fail_if(size == -1, "failed to get prime bo size\n");
-		trace_add(t, prime->handle, size);
+		trace_add(t, timestamp, prime->handle, size);
 		break;
 	}
 
 	case DRM_IOCTL_MODE_GETFB: {
 		struct drm_mode_fb_cmd *cmd = argp;
-		trace_add(t, cmd->handle, size_for_fb(cmd));
+		trace_add(t, timestamp, cmd->handle, size_for_fb(cmd));
 		break;
 	}
 
 	case DRM_IOCTL_I915_GEM_CONTEXT_CREATE: {
 		struct drm_i915_gem_context_create *create = argp;
-		trace_add_context(t, create->ctx_id);
+		trace_add_context(t, timestamp, create->ctx_id);
+		break;
+	}
+
+	case DRM_IOCTL_SYNCOBJ_CREATE: {
+		struct drm_syncobj_create *create = argp;
+		trace_add_syncobj(t, timestamp, create->handle);
 		break;
 	}
 	}
@@ -407,6 +733,34 @@ untraced:
 	return libc_ioctl(fd, request, argp);
 }
 
+static void fork_prepare(void)
+{
+	pthread_mutex_lock(&mutex);
+	pthread_mutex_lock(&writer_mutex);
+	drain_rings();
+	flush_traces();
+}
+
+static void fork_parent(void)
+{
+	pthread_mutex_unlock(&writer_mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+static void fork_child(void)
+{
+	/* Only the forking thread survives, the writer must be restarted */
+	for (struct ring *ring = atomic_load(&rings); ring; ring = ring->next) {
+		atomic_store(&ring->tail, atomic_load(&ring->head));
+		if (ring != local_ring)
+			atomic_store(&ring->owned, false);
+	}
+	writer_running = false;
+
+	pthread_mutex_unlock(&writer_mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
 static void __attribute__ ((constructor))
 init(void)
 {
@@ -414,4 +768,23 @@ init(void)
 	libc_ioctl = dlsym(RTLD_NEXT, "ioctl");
 	fail_if(libc_close == NULL || libc_ioctl == NULL,
 		"failed to get libc ioctl or close\n");
+
+	fail_if(pthread_key_create(&ring_key, release_ring),
+		"failed to create the trace buffer key\n");
+	pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+static void __attribute__ ((destructor))
+fini(void)
+{
+	if (writer_running) {
+		atomic_store(&writer_stop, true);
+		pthread_join(writer, NULL);
+		writer_running = false;
+	}
+
+	pthread_mutex_lock(&writer_mutex);
+	drain_rings();
+	flush_traces();
+	pthread_mutex_unlock(&writer_mutex);
 }
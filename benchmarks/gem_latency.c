@@ -107,6 +107,7 @@ struct consumer {
 	int go;
 
 	struct igt_mean latency;
+	struct igt_histogram hist;
 	struct producer *producer;
 };
 
@@ -134,6 +135,7 @@ struct producer {
 	int complete;
 	int done;
 	struct igt_mean latency, dispatch;
+	struct igt_histogram hist;
 
 	int nop;
 	int nconsumers;
@@ -309,13 +311,19 @@ static void fence_wait(int fence)
 	poll(&pfd, 1, -1);
 }
 
-static void measure_latency(struct producer *p, struct igt_mean *mean)
+static void measure_latency(struct producer *p, struct igt_mean *mean,
+			    struct igt_histogram *hist)
 {
+	uint32_t cycles;
+
 	if (!(p->latency_dispatch.execbuf.flags & I915_EXEC_FENCE_OUT))
 		gem_sync(fd, p->latency_dispatch.exec[0].handle);
 	else
 		fence_wait(p->latency_dispatch.execbuf.rsvd2 >> 32);
-	igt_mean_add(mean, read_timestamp() - *p->last_timestamp);
+
+	cycles = read_timestamp() - *p->last_timestamp;
+	igt_mean_add(mean, cycles);
+	igt_histogram_push(hist, cycles);
 }
 
 static void *producer(void *arg)
@@ -362,7 +370,7 @@ static void *producer(void *arg)
 		 * and how long it took for the batch to be submitted
 		 * (including the nop delays).
 		 */
-		measure_latency(p, &p->latency);
+		measure_latency(p, &p->latency, &p->hist);
 		igt_mean_add(&p->dispatch, *p->last_timestamp - start);
 
 		/* Tidy up all the extra threads before we submit again. */
@@ -408,7 +416,7 @@ static void *consumer(void *arg)
 		if (p->done)
 			return NULL;
 
-		measure_latency(p, &c->latency);
+		measure_latency(p, &c->latency, &c->hist);
 	} while (1);
 }
 
@@ -438,6 +446,7 @@ static int run(int seconds,
 	pthread_attr_t attr;
 	struct producer *p;
 	igt_stats_t platency, latency, dispatch;
+	struct igt_histogram hist;
 	struct rusage rused;
 	uint32_t nop_batch;
 	uint32_t workload_batch;
@@ -491,6 +500,7 @@ static int run(int seconds,
 
 		igt_mean_init(&p[n].latency);
 		igt_mean_init(&p[n].dispatch);
+		igt_histogram_init(&p[n].hist);
 		p[n].wait = nconsumers;
 		p[n].nop = nop;
 		p[n].nconsumers = nconsumers;
@@ -498,6 +508,7 @@ static int run(int seconds,
 		for (m = 0; m < nconsumers; m++) {
 			p[n].consumers[m].producer = &p[n];
 			igt_mean_init(&p[n].consumers[m].latency);
+			igt_histogram_init(&p[n].consumers[m].hist);
 			pthread_create(&p[n].consumers[m].thread, NULL,
 				       consumer, &p[n].consumers[m]);
 		}
@@ -528,22 +539,33 @@ static int run(int seconds,
 	igt_stats_init_with_size(&dispatch, nproducers);
 	igt_stats_init_with_size(&platency, nproducers);
 	igt_stats_init_with_size(&latency, nconsumers*nproducers);
+	igt_histogram_init(&hist);
 	for (n = 0; n < nproducers; n++) {
 		pthread_join(p[n].thread, NULL);
 
-		if (!p[n].complete)
+		if (!p[n].complete) {
+			igt_histogram_fini(&p[n].hist);
+			for (m = 0; m < nconsumers; m++) {
+				pthread_join(p[n].consumers[m].thread, NULL);
+				igt_histogram_fini(&p[n].consumers[m].hist);
+			}
 			continue;
+		}
 
 		nrun++;
 		complete += p[n].complete;
 		igt_stats_push_float(&latency, p[n].latency.mean);
 		igt_stats_push_float(&platency, p[n].latency.mean);
 		igt_stats_push_float(&dispatch, p[n].dispatch.mean);
+		igt_histogram_merge(&hist, &p[n].hist);
+		igt_histogram_fini(&p[n].hist);
 
 		for (m = 0; m < nconsumers; m++) {
 			pthread_join(p[n].consumers[m].thread, NULL);
 			igt_stats_push_float(&latency,
 					     p[n].consumers[m].latency.mean);
+			igt_histogram_merge(&hist, &p[n].consumers[m].hist);
+			igt_histogram_fini(&p[n].consumers[m].hist);
 		}
 	}
 
@@ -574,7 +596,20 @@ static int run(int seconds,
 	case 5:
 		printf("%d\n", complete);
 		break;
+	case 6:
+		printf("%f\n", CYCLES_TO_US(igt_histogram_get_percentile(&hist, 50)));
+		break;
+	case 7:
+		printf("%f\n", CYCLES_TO_US(igt_histogram_get_percentile(&hist, 99)));
+		break;
+	case 8:
+		printf("%f\n", CYCLES_TO_US(igt_histogram_get_percentile(&hist, 99.9)));
+		break;
+	case 9:
+		printf("%f\n", CYCLES_TO_US(igt_histogram_get_max(&hist)));
+		break;
 	}
+	igt_histogram_fini(&hist);
 
 	return 0;
 }
@@ -67,8 +67,15 @@ struct gem_busyspin {
 struct sys_wait {
 	pthread_t thread;
 	struct igt_mean mean;
+	struct igt_histogram hist;
 };
 
+static void sys_wait_add(struct sys_wait *w, double ns)
+{
+	igt_mean_add(&w->mean, ns);
+	igt_histogram_push(&w->hist, ns > 0 ? ns : 0);
+}
+
 static void force_low_latency(void)
 {
 	int32_t target = 0;
@@ -184,7 +191,7 @@ static void *sys_wait(void *arg)
 
 		sigwait(&mask, &sigs);
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		igt_mean_add(&w->mean, elapsed(&its.it_value, &now));
+		sys_wait_add(w, elapsed(&its.it_value, &now));
 	}
 
 	sigprocmask(SIG_UNBLOCK, &mask, NULL);
@@ -215,7 +222,7 @@ static void *sys_thp_alloc(void *arg)
 		munmap(ptr, sz);
 
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		igt_mean_add(&w->mean, elapsed(&start, &now));
+		sys_wait_add(w, elapsed(&start, &now));
 	}
 
 	return NULL;
@@ -256,6 +263,11 @@ static double l_estimate(igt_stats_t *stats)
 		return igt_stats_get_mean(stats);
 }
 
+static double percentile_us(struct igt_histogram *hist, double p, double min)
+{
+	return (igt_histogram_get_percentile(hist, p) - min) / 1000;
+}
+
 static double min_measurement_error(void)
 {
 	struct timespec start, end;
@@ -349,6 +361,7 @@ int main(int argc, char **argv)
 	pthread_t bg_fs = 0;
 	int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
 	igt_stats_t cycles, mean, max;
+	struct igt_histogram hist;
 	double min;
 	int time = 10;
 	int field = -1;
@@ -424,6 +437,7 @@ int main(int argc, char **argv)
 	rtprio(&attr, 99);
 	for (n = 0; n < ncpus; n++) {
 		igt_mean_init(&wait[n].mean);
+		igt_histogram_init(&wait[n].hist);
 		bind_cpu(&attr, n);
 		pthread_create(&wait[n].thread, &attr, sys_fn, &wait[n]);
 	}
@@ -441,10 +455,13 @@ int main(int argc, char **argv)
 
 	igt_stats_init_with_size(&mean, ncpus);
 	igt_stats_init_with_size(&max, ncpus);
+	igt_histogram_init(&hist);
 	for (n = 0; n < ncpus; n++) {
 		pthread_join(wait[n].thread, NULL);
 		igt_stats_push_float(&mean, wait[n].mean.mean);
 		igt_stats_push_float(&max, wait[n].mean.max);
+		igt_histogram_merge(&hist, &wait[n].hist);
+		igt_histogram_fini(&wait[n].hist);
 	}
 	if (bg_fs) {
 		pthread_cancel(bg_fs);
@@ -453,10 +470,13 @@ int main(int argc, char **argv)
 
 	switch (field) {
 	default:
-		printf("gem_syslatency: cycles=%.0f, latency mean=%.3fus max=%.0fus\n",
+		printf("gem_syslatency: cycles=%.0f, latency mean=%.3fus max=%.0fus p50=%.3fus p99=%.3fus p99.9=%.3fus\n",
 		       igt_stats_get_mean(&cycles),
 		       (igt_stats_get_mean(&mean) - min)/ 1000,
-		       (l_estimate(&max) - min) / 1000);
+		       (l_estimate(&max) - min) / 1000,
+		       percentile_us(&hist, 50, min),
+		       percentile_us(&hist, 99, min),
+		       percentile_us(&hist, 99.9, min));
 		break;
 	case 0:
 		printf("%.0f\n", igt_stats_get_mean(&cycles));
@@ -467,7 +487,17 @@ int main(int argc, char **argv)
 	case 2:
 		printf("%.0f\n", (l_estimate(&max) - min) / 1000);
 		break;
+	case 3:
+		printf("%.3f\n", percentile_us(&hist, 50, min));
+		break;
+	case 4:
+		printf("%.3f\n", percentile_us(&hist, 99, min));
+		break;
+	case 5:
+		printf("%.3f\n", percentile_us(&hist, 99.9, min));
+		break;
 	}
+	igt_histogram_fini(&hist);
 
 	return 0;
 
@@ -0,0 +1,267 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures KTAP parser throughput on a synthetic KUnit report.
+ *
+ * The report has -s suites of -c test cases each, every -p'th case being
+ * a parametrized one with 4 parameters. By default the lines are fed to
+ * igt_ktap_parse() directly; with -t the report is formatted as /dev/kmsg
+ * records and replayed through the parser thread over a pipe, which also
+ * accounts for line splitting and handing results over to the consumer.
+ * Each sample parses the whole report once and is reported in lines per
+ * second.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_bench.h"
+#include "igt_core.h"
+#include "igt_ktap.h"
+#include "igt_list.h"
+
+struct ktap_bench {
+	int suites, cases, params;
+	bool thread;
+	char *log;
+	int nlines, nresults;
+};
+
+static char *build_report(int suites, int cases, int params, bool kmsg,
+			  int *nlines, int *nresults)
+{
+	size_t size = 128 * (suites * (cases * 7 + 4) + 2);
+	char *log = malloc(size), *p = log;
+	const char *prefix = kmsg ? "6,1,0,-;" : "";
+
+	igt_assert(log);
+	*nlines = *nresults = 0;
+
+#define LINE(...) do { \
+	p += sprintf(p, "%s", prefix); \
+	p += sprintf(p, __VA_ARGS__); \
+	(*nlines)++; \
+} while (0)
+
+	LINE("KTAP version 1\n");
+	LINE("1..%d\n", suites);
+	for (int s = 1; s <= suites; s++) {
+		LINE("    KTAP version 1\n");
+		LINE("    # Subtest: suite_%d\n", s);
+		LINE("    1..%d\n", cases);
+		for (int c = 1; c <= cases; c++) {
+			if (params && c % params == 0) {
+				LINE("        KTAP version 1\n");
+				LINE("        # Subtest: case_%d\n", c);
+				for (int i = 1; i <= 4; i++)
+					LINE("        ok %d param %d\n", i, i);
+			}
+
+			if (c % 5 == 0)
+				LINE("    ok %d case_%d # SKIP not supported\n", c, c);
+			else if (c % 7 == 0)
+				LINE("    not ok %d case_%d # failed\n", c, c);
+			else
+				LINE("    ok %d case_%d\n", c, c);
+			(*nresults)++;
+		}
+		LINE("ok %d suite_%d\n", s, s);
+	}
+
+#undef LINE
+
+	igt_assert(p < log + size);
+	return log;
+}
+
+static void free_results(struct igt_list_head *list)
+{
+	struct igt_ktap_result *r, *rn;
+	char *suite_name = NULL;
+
+	igt_list_for_each_entry_safe(r, rn, list, link) {
+		igt_list_del(&r->link);
+		if (r->suite_name != suite_name) {
+			free(suite_name);
+			suite_name = r->suite_name;
+		}
+		free(r->case_name);
+		free(r->msg);
+		free(r);
+	}
+	free(suite_name);
+}
+
+static double measure_parse(void *data)
+{
+	struct ktap_bench *b = data;
+	struct igt_ktap_results *ktap;
+	struct timespec start = {};
+	IGT_LIST_HEAD(list);
+	char *line, *next;
+	int err = -EINPROGRESS;
+	double t;
+
+	ktap = igt_ktap_alloc(&list);
+	igt_assert(ktap);
+
+	igt_nsec_elapsed(&start);
+	for (line = b->log; err == -EINPROGRESS && *line; line = next) {
+		char saved;
+
+		next = strchr(line, '\n') + 1;
+		saved = *next;
+		*next = '\0';
+		err = igt_ktap_parse(line, ktap);
+		*next = saved;
+	}
+	t = igt_nsec_elapsed(&start) / 1e9;
+	igt_assert_eq(err, 0);
+
+	igt_ktap_free(ktap);
+	free_results(&list);
+
+	return b->nlines / t;
+}
+
+struct writer {
+	int fd;
+	const char *log;
+};
+
+static void *writer_thread(void *data)
+{
+	struct writer *w = data;
+	size_t len = strlen(w->log);
+
+	for (size_t pos = 0; pos < len; ) {
+		ssize_t ret = write(w->fd, w->log + pos, len - pos);
+
+		igt_assert(ret > 0);
+		pos += ret;
+	}
+	close(w->fd);
+
+	return NULL;
+}
+
+static double measure_thread(void *data)
+{
+	struct ktap_bench *b = data;
+	struct ktap_test_results_element *r;
+	struct ktap_test_results *results;
+	struct writer w = { .log = b->log };
+	struct timespec start = {};
+	pthread_t writer;
+	int fds[2], count = 0;
+	double t;
+
+	igt_assert_eq(pipe(fds), 0);
+	w.fd = fds[1];
+
+	igt_nsec_elapsed(&start);
+	igt_assert_eq(pthread_create(&writer, NULL, writer_thread, &w), 0);
+	results = ktap_parser_start(fds[0], false);
+	while (!ktap_results_done(results)) {
+		r = ktap_results_pop(results);
+		if (!r)
+			continue;
+
+		count++;
+		free(r);
+	}
+	igt_assert_eq(ktap_parser_stop(), IGT_EXIT_SUCCESS);
+	t = igt_nsec_elapsed(&start) / 1e9;
+
+	pthread_join(writer, NULL);
+	close(fds[0]);
+	igt_assert_eq(count, b->nresults);
+
+	return b->nlines / t;
+}
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	struct ktap_bench *b = data;
+
+	switch (opt) {
+	case 's':
+		b->suites = max(atoi(optarg), 1);
+		break;
+	case 'c':
+		b->cases = max(atoi(optarg), 1);
+		break;
+	case 'p':
+		b->params = max(atoi(optarg), 0);
+		break;
+	case 't':
+		b->thread = true;
+		break;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+
+	return IGT_OPT_HANDLER_SUCCESS;
+}
+
+static const char *help_str =
+	"  -s N			Number of suites (default 100)\n"
+	"  -c N			Number of cases per suite (default 100)\n"
+	"  -p N			Make every N'th case parametrized, 0 for none (default 10)\n"
+	"  -t			Replay /dev/kmsg records through the parser thread\n";
+
+int main(int argc, char **argv)
+{
+	struct ktap_bench b = {
+		.suites = 100,
+		.cases = 100,
+		.params = 10,
+	};
+	int ret;
+
+	igt_bench_init(argc, argv, "s:c:p:t", NULL, help_str, opt_handler, &b);
+
+	b.log = build_report(b.suites, b.cases, b.params, b.thread,
+			     &b.nlines, &b.nresults);
+
+	igt_bench_param("suites", "%d", b.suites);
+	igt_bench_param("cases", "%d", b.cases);
+	igt_bench_param("params", "%d", b.params);
+	igt_bench_param("lines", "%d", b.nlines);
+	igt_bench_param("results", "%d", b.nresults);
+
+	ret = igt_bench_run(b.thread ? "thread" : "parse", "lines/s", 0,
+			    b.thread ? measure_thread : measure_parse, &b);
+
+	free(b.log);
+	return ret;
+}
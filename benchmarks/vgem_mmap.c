@@ -22,6 +22,7 @@
  *
  */
 
+#include <getopt.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -36,108 +37,112 @@
 #include <time.h>
 
 #include "igt.h"
+#include "igt_bench.h"
 #include "igt_vgem.h"
 
-static double elapsed(const struct timespec *start,
-		      const struct timespec *end)
-{
-	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
-}
+enum dir { READ, WRITE, CLEAR, FAULT };
 
-int main(int argc, char **argv)
-{
-	enum dir {READ, WRITE, CLEAR, FAULT} dir = READ;
-	struct timespec start, end;
+static const char *dir_names[] = {
+	[READ] = "read",
+	[WRITE] = "write",
+	[CLEAR] = "clear",
+	[FAULT] = "fault",
+};
+
+struct mmap_bench {
+	enum dir dir;
+	int vgem;
 	struct vgem_bo bo;
-	void *buf;
 	void *ptr, *src, *dst;
-	int reps = 1;
-	int loops;
-	int vgem;
-	int c;
-
-	while ((c = getopt (argc, argv, "d:r:")) != -1) {
-		switch (c) {
-		case 'd':
-			if (strcmp(optarg, "read") == 0)
-				dir = READ;
-			else if (strcmp(optarg, "write") == 0)
-				dir = WRITE;
-			else if (strcmp(optarg, "clear") == 0)
-				dir = CLEAR;
-			else if (strcmp(optarg, "fault") == 0)
-				dir = FAULT;
-			else
-				abort();
-			break;
-
-		case 'r':
-			reps = atoi(optarg);
-			if (reps < 1)
-				reps = 1;
-			break;
-
-		default:
-			break;
-		}
-	}
-
-	vgem = drm_open_driver(DRIVER_VGEM);
+	unsigned long loops;
+};
 
-	bo.width = 2024;
-	bo.height = 2024;
-	bo.bpp = 4;
-	vgem_create(vgem, &bo);
-	ptr = vgem_mmap(vgem, &bo, PROT_WRITE);
-	buf = malloc(bo.size);
-
-	if (dir == READ) {
-		src = ptr;
-		dst = buf;
-	} else {
-		src = buf;
-		dst = ptr;
-	}
+static void once(struct mmap_bench *b)
+{
+	int page;
 
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	switch (dir) {
+	switch (b->dir) {
 	case CLEAR:
+		memset(b->dst, 0, b->bo.size);
+		break;
 	case FAULT:
-		memset(dst, 0, bo.size);
+		munmap(b->ptr, b->bo.size);
+		b->ptr = vgem_mmap(b->vgem, &b->bo, PROT_WRITE);
+		for (page = 0; page < b->bo.size; page += 4096) {
+			uint32_t *x = (uint32_t *)b->ptr + page/4;
+			__asm__ __volatile__("": : :"memory");
+			page += *x; /* should be zero! */
+		}
 		break;
 	default:
-		memcpy(dst, src, bo.size);
+		memcpy(b->dst, b->src, b->bo.size);
 		break;
 	}
-	clock_gettime(CLOCK_MONOTONIC, &end);
-
-	loops = 2 / elapsed(&start, &end);
-	while (reps--) {
-		clock_gettime(CLOCK_MONOTONIC, &start);
-		for (c = 0; c < loops; c++) {
-			int page;
-
-			switch (dir) {
-			case CLEAR:
-				memset(dst, 0, bo.size);
-				break;
-			case FAULT:
-				munmap(ptr, bo.size);
-				ptr = vgem_mmap(vgem, &bo, PROT_WRITE);
-				for (page = 0; page < bo.size; page += 4096) {
-					uint32_t *x = (uint32_t *)ptr + page/4;
-					__asm__ __volatile__("": : :"memory");
-					page += *x; /* should be zero! */
-				}
-				break;
-			default:
-				memcpy(dst, src, bo.size);
-				break;
-			}
-		}
-		clock_gettime(CLOCK_MONOTONIC, &end);
-		printf("%7.3f\n", bo.size / elapsed(&start, &end) * loops / (1024*1024));
+}
+
+static double sample(void *data)
+{
+	struct mmap_bench *b = data;
+	struct timespec start = {};
+
+	igt_nsec_elapsed(&start);
+	for (unsigned long n = 0; n < b->loops; n++)
+		once(b);
+
+	return b->bo.size * b->loops / (igt_nsec_elapsed(&start) / 1e9) /
+		(1024*1024);
+}
+
+static int opt_handler(int opt, int opt_index, void *data)
+{
+	struct mmap_bench *b = data;
+
+	switch (opt) {
+	case 'd':
+		for (b->dir = 0; b->dir < ARRAY_SIZE(dir_names); b->dir++)
+			if (strcmp(optarg, dir_names[b->dir]) == 0)
+				return IGT_OPT_HANDLER_SUCCESS;
+		return IGT_OPT_HANDLER_ERROR;
+	default:
+		return IGT_OPT_HANDLER_ERROR;
+	}
+}
+
+static const char *help_str =
+	"  -d DIR\t\tread, write, clear or fault the mapping (default read)\n";
+
+int main(int argc, char **argv)
+{
+	struct mmap_bench b = { .dir = READ };
+	struct timespec start = {};
+	void *buf;
+
+	igt_bench_init(argc, argv, "d:", NULL, help_str, opt_handler, &b);
+	igt_bench_param("dir", "%s", dir_names[b.dir]);
+
+	b.vgem = drm_open_driver(DRIVER_VGEM);
+
+	b.bo.width = 2024;
+	b.bo.height = 2024;
+	b.bo.bpp = 4;
+	vgem_create(b.vgem, &b.bo);
+	b.ptr = vgem_mmap(b.vgem, &b.bo, PROT_WRITE);
+	buf = malloc(b.bo.size);
+
+	if (b.dir == READ) {
+		b.src = b.ptr;
+		b.dst = buf;
+	} else {
+		b.src = buf;
+		b.dst = b.ptr;
 	}
 
-	return 0;
+	/* Repeat the operation enough times to fill a sample */
+	b.loops = 1;
+	igt_nsec_elapsed(&start);
+	once(&b);
+	b.loops = max(igt_bench_sample_time() /
+		      (igt_nsec_elapsed(&start) / 1e9), 1.);
+
+	return igt_bench_run(dir_names[b.dir], "MiB/s", 0, sample, &b);
 }
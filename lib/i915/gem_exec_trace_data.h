@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_EXEC_TRACE_DATA_H
+#define GEM_EXEC_TRACE_DATA_H
+
+/*
+ * File format written by the gem_exec_tracer LD_PRELOAD library and read
+ * back by gem_exec_trace. This header is shared by both and must not pull in
+ * anything but the uapi.
+ *
+ * A trace starts with struct trace_version, followed by records. In version
+ * 1 a record is a command byte followed by its payload. From version 2 on it
+ * starts with struct trace_header instead, giving the thread and time of the
+ * call. Records of different threads are not necessarily stored in time
+ * order, readers have to sort them by timestamp.
+ */
+
+#include <stdint.h>
+
+#include <i915_drm.h>
+
+#define TRACE_MAGIC 0xdeadbeef
+#define TRACE_VERSION 2
+
+enum {
+	TRACE_ADD_BO = 0,
+	TRACE_DEL_BO,
+	TRACE_ADD_CTX,
+	TRACE_DEL_CTX,
+	TRACE_EXEC,
+	TRACE_WAIT,
+	/* version 2 */
+	TRACE_ADD_SYNCOBJ,
+	TRACE_DEL_SYNCOBJ,
+};
+
+struct trace_version {
+	uint32_t magic;
+	uint32_t version;
+} __attribute__((packed));
+
+struct trace_header {
+	uint8_t cmd;
+	/* thread id of the caller */
+	uint32_t tid;
+	/* CLOCK_MONOTONIC at the start of the call, in ns */
+	uint64_t timestamp;
+} __attribute__((packed));
+
+struct trace_add_bo {
+	uint32_t handle;
+	uint64_t size;
+} __attribute__((packed));
+
+struct trace_del_bo {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_add_ctx {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_del_ctx {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_add_syncobj {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_del_syncobj {
+	uint32_t handle;
+} __attribute__((packed));
+
+/*
+ * An exec record is laid out as:
+ * - struct trace_exec
+ * - struct trace_exec_fences (version 2)
+ * - object_count times struct trace_exec_object, each followed by its
+ *   struct drm_i915_gem_relocation_entry array
+ * - fence_count times struct drm_i915_gem_exec_fence (version 2)
+ */
+struct trace_exec {
+	uint32_t object_count;
+	uint64_t flags;
+	uint32_t context;
+} __attribute__((packed));
+
+struct trace_exec_fences {
+	/* sync_file fds in the traced process, or -1 */
+	int32_t fence_in;
+	int32_t fence_out;
+	/* I915_EXEC_FENCE_ARRAY syncobjs */
+	uint32_t fence_count;
+	/* time spent in the execbuf ioctl, in ns */
+	uint64_t duration;
+} __attribute__((packed));
+
+struct trace_exec_object {
+	uint32_t handle;
+	uint32_t relocation_count;
+	uint64_t alignment;
+	uint64_t offset;
+	uint64_t flags;
+	uint64_t rsvd1;
+	uint64_t rsvd2;
+} __attribute__((packed));
+
+struct trace_wait {
+	uint32_t handle;
+} __attribute__((packed));
+
+#endif /* GEM_EXEC_TRACE_DATA_H */
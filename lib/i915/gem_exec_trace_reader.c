@@ -0,0 +1,338 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gem_exec_trace_reader.h"
+
+static bool __attribute__((format(printf, 2, 3)))
+trace_error(struct gem_exec_trace_reader *reader, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(reader->error_msg, sizeof(reader->error_msg), fmt, args);
+	va_end(args);
+
+	return false;
+}
+
+static bool
+append_record(struct gem_exec_trace_reader *reader,
+	      const struct gem_exec_trace_record *record)
+{
+	if (reader->n_records == reader->n_allocated_records) {
+		uint32_t n = reader->n_allocated_records ?
+			2 * reader->n_allocated_records : 4096;
+		void *records = realloc(reader->records, n * sizeof(*record));
+
+		if (!records)
+			return trace_error(reader, "out of memory");
+
+		reader->records = records;
+		reader->n_allocated_records = n;
+	}
+
+	reader->records[reader->n_records++] = *record;
+	return true;
+}
+
+/* Size of an exec payload, or 0 if it doesn't fit in @avail bytes */
+static size_t exec_size(uint32_t version, const uint8_t *data, size_t avail)
+{
+	const struct trace_exec *exec = (const void *)data;
+	uint32_t fence_count = 0;
+	size_t size;
+
+	size = sizeof(*exec);
+	if (version >= 2) {
+		const struct trace_exec_fences *fences =
+			(const void *)(data + size);
+
+		size += sizeof(*fences);
+		if (size > avail)
+			return 0;
+
+		fence_count = fences->fence_count;
+	}
+	if (size > avail)
+		return 0;
+
+	for (uint32_t i = 0; i < exec->object_count; i++) {
+		const struct trace_exec_object *obj =
+			(const void *)(data + size);
+
+		size += sizeof(*obj);
+		if (size > avail)
+			return 0;
+
+		size += (size_t)obj->relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
+		if (size > avail)
+			return 0;
+	}
+
+	size += (size_t)fence_count * sizeof(struct drm_i915_gem_exec_fence);
+	if (size > avail)
+		return 0;
+
+	return size;
+}
+
+static size_t payload_size(uint32_t version, uint8_t cmd,
+			   const uint8_t *data, size_t avail)
+{
+	size_t size;
+
+	switch (cmd) {
+	case TRACE_ADD_BO:
+		size = sizeof(struct trace_add_bo);
+		break;
+	case TRACE_DEL_BO:
+		size = sizeof(struct trace_del_bo);
+		break;
+	case TRACE_ADD_CTX:
+		size = sizeof(struct trace_add_ctx);
+		break;
+	case TRACE_DEL_CTX:
+		size = sizeof(struct trace_del_ctx);
+		break;
+	case TRACE_WAIT:
+		size = sizeof(struct trace_wait);
+		break;
+	case TRACE_EXEC:
+		return exec_size(version, data, avail);
+	case TRACE_ADD_SYNCOBJ:
+		if (version < 2)
+			return 0;
+		size = sizeof(struct trace_add_syncobj);
+		break;
+	case TRACE_DEL_SYNCOBJ:
+		if (version < 2)
+			return 0;
+		size = sizeof(struct trace_del_syncobj);
+		break;
+	default:
+		return 0;
+	}
+
+	return size <= avail ? size : 0;
+}
+
+static int record_cmp(const void *A, const void *B)
+{
+	const struct gem_exec_trace_record *a = A, *b = B;
+
+	if (a->timestamp != b->timestamp)
+		return a->timestamp < b->timestamp ? -1 : 1;
+
+	return (int)(a->index > b->index) - (int)(a->index < b->index);
+}
+
+static bool parse_data(struct gem_exec_trace_reader *reader)
+{
+	const struct trace_version *tv = (const void *)reader->data;
+	uint8_t *ptr = reader->data + sizeof(*tv);
+	uint8_t *end = reader->data + reader->size;
+
+	if (reader->size < sizeof(*tv))
+		return trace_error(reader, "truncated header");
+	if (tv->magic != TRACE_MAGIC)
+		return trace_error(reader, "invalid magic");
+	if (tv->version < 1 || tv->version > TRACE_VERSION)
+		return trace_error(reader, "unhandled version %d", tv->version);
+	reader->version = tv->version;
+
+	while (ptr < end) {
+		struct gem_exec_trace_record record = {
+			.index = reader->n_records,
+		};
+		size_t offset = ptr - reader->data;
+
+		if (reader->version >= 2) {
+			const struct trace_header *header = (const void *)ptr;
+
+			if (end - ptr < sizeof(*header))
+				return trace_error(reader,
+						   "truncated record at %zu",
+						   offset);
+
+			record.cmd = header->cmd;
+			record.tid = header->tid;
+			record.timestamp = header->timestamp;
+			ptr += sizeof(*header);
+		} else {
+			record.cmd = *ptr++;
+		}
+
+		record.data = ptr;
+		record.size = payload_size(reader->version, record.cmd,
+					   ptr, end - ptr);
+		if (!record.size)
+			return trace_error(reader,
+					   "invalid or truncated record (cmd %d) at %zu",
+					   record.cmd, offset);
+		ptr += record.size;
+
+		if (!append_record(reader, &record))
+			return false;
+	}
+
+	/*
+	 * Each thread records into its own buffer, flushed in chunks, so
+	 * only the timestamps give the order of calls across threads.
+	 */
+	if (reader->version >= 2)
+		qsort(reader->records, reader->n_records,
+		      sizeof(*reader->records), record_cmp);
+
+	return true;
+}
+
+/**
+ * gem_exec_trace_reader_init:
+ * @reader: The reader to initialize
+ * @data: The trace data
+ * @size: The size of @data
+ *
+ * Indexes the records of a trace held in memory. Exec records refer to
+ * @data, which must outlive the reader, and their relocations may be
+ * rewritten in place by the replay.
+ *
+ * Returns: true on success, false with reader->error_msg set otherwise.
+ */
+bool gem_exec_trace_reader_init(struct gem_exec_trace_reader *reader,
+				void *data, size_t size)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->data = data;
+	reader->size = size;
+
+	if (!parse_data(reader)) {
+		free(reader->records);
+		reader->records = NULL;
+		reader->n_records = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * gem_exec_trace_reader_open:
+ * @reader: The reader to initialize
+ * @filename: The trace file
+ *
+ * Maps a trace file privately and indexes its records, see
+ * gem_exec_trace_reader_init().
+ *
+ * Returns: true on success, false with reader->error_msg set otherwise.
+ */
+bool gem_exec_trace_reader_open(struct gem_exec_trace_reader *reader,
+				const char *filename)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	memset(reader, 0, sizeof(*reader));
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return trace_error(reader, "cannot open %s", filename);
+
+	if (fstat(fd, &st) < 0 || !st.st_size) {
+		close(fd);
+		return trace_error(reader, "cannot stat %s", filename);
+	}
+
+	data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return trace_error(reader, "cannot map %s", filename);
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	if (!gem_exec_trace_reader_init(reader, data, st.st_size)) {
+		munmap(data, st.st_size);
+		return false;
+	}
+	reader->mapped = true;
+
+	return true;
+}
+
+/**
+ * gem_exec_trace_reader_fini:
+ * @reader: The reader to clean up
+ *
+ * Frees the record index, and unmaps the trace opened with
+ * gem_exec_trace_reader_open().
+ */
+void gem_exec_trace_reader_fini(struct gem_exec_trace_reader *reader)
+{
+	free(reader->records);
+	if (reader->mapped)
+		munmap(reader->data, reader->size);
+	memset(reader, 0, sizeof(*reader));
+}
+
+/**
+ * gem_exec_trace_decode_exec:
+ * @reader: The reader @record belongs to
+ * @record: A TRACE_EXEC record
+ * @exec: Where to store the decoded exec
+ *
+ * Decodes the fixed part of an exec record and locates its objects and
+ * fences, hiding the differences between format versions.
+ */
+void gem_exec_trace_decode_exec(const struct gem_exec_trace_reader *reader,
+				const struct gem_exec_trace_record *record,
+				struct gem_exec_trace_exec *exec)
+{
+	uint8_t *ptr = record->data;
+
+	memcpy(&exec->exec, ptr, sizeof(exec->exec));
+	ptr += sizeof(exec->exec);
+
+	if (reader->version >= 2) {
+		memcpy(&exec->fences, ptr, sizeof(exec->fences));
+		ptr += sizeof(exec->fences);
+	} else {
+		exec->fences.fence_in = -1;
+		exec->fences.fence_out = -1;
+		exec->fences.fence_count = 0;
+		exec->fences.duration = 0;
+	}
+
+	exec->objects = ptr;
+	exec->fence_array = record->data + record->size -
+		exec->fences.fence_count * sizeof(struct drm_i915_gem_exec_fence);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_EXEC_TRACE_READER_H
+#define GEM_EXEC_TRACE_READER_H
+
+/* Helper to read a gem_exec_tracer recording. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gem_exec_trace_data.h"
+
+struct gem_exec_trace_record {
+	uint8_t cmd;
+	uint32_t tid;
+	uint64_t timestamp;
+
+	/* Payload following the command byte or header, in the trace data */
+	uint8_t *data;
+	uint32_t size;
+
+	/* Position in the file, ordering records with the same timestamp */
+	uint32_t index;
+};
+
+struct gem_exec_trace_exec {
+	struct trace_exec exec;
+	/* fence_in, fence_out = -1 and fence_count = 0 before version 2 */
+	struct trace_exec_fences fences;
+
+	/* First struct trace_exec_object, each followed by its relocations */
+	uint8_t *objects;
+	/* fence_count struct drm_i915_gem_exec_fence, unaligned */
+	uint8_t *fence_array;
+};
+
+struct gem_exec_trace_reader {
+	uint32_t version;
+
+	/* Records in time order */
+	struct gem_exec_trace_record *records;
+	uint32_t n_records;
+	uint32_t n_allocated_records;
+
+	char error_msg[256];
+
+	uint8_t *data;
+	size_t size;
+	bool mapped;
+};
+
+bool gem_exec_trace_reader_init(struct gem_exec_trace_reader *reader,
+				void *data, size_t size);
+bool gem_exec_trace_reader_open(struct gem_exec_trace_reader *reader,
+				const char *filename);
+void gem_exec_trace_reader_fini(struct gem_exec_trace_reader *reader);
+
+void gem_exec_trace_decode_exec(const struct gem_exec_trace_reader *reader,
+				const struct gem_exec_trace_record *record,
+				struct gem_exec_trace_exec *exec);
+
+#endif /* GEM_EXEC_TRACE_READER_H */
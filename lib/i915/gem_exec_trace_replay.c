@@ -0,0 +1,917 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "ioctl_wrappers.h"
+#include "sw_sync.h"
+#include "gem_exec_trace_replay.h"
+
+/**
+ * SECTION:gem_exec_trace_replay
+ * @short_description: Replay of gem_exec_tracer recordings
+ * @title: GEM exec trace replay
+ * @include: i915/gem_exec_trace_replay.h
+ *
+ * Replays the requests of a trace read with #gem_exec_trace_reader, either
+ * back to back or following the traced timeline, with one thread per traced
+ * thread. All requests go through a #gem_exec_trace_sink, so the replay
+ * can be exercised without hardware.
+ *
+ * Threads only wait for each other where the trace requires it: a call
+ * waits for every earlier creation or destruction of an object, and a
+ * destruction also waits for every earlier call, so that handles are never
+ * used before they exist nor after they are gone, even when reused.
+ */
+
+struct replay {
+	const struct gem_exec_trace_reader *reader;
+	const struct gem_exec_trace_replay_params *params;
+	const struct gem_exec_trace_sink *sink;
+	double scale;
+
+	/* Traced handles to replayed handles, 0 if unknown */
+	uint32_t *bo, *ctx, *syncobj;
+	uint32_t num_bo, num_ctx, num_syncobj;
+
+	/* Traced out-fence fds to replayed ones, -1 if unknown */
+	pthread_mutex_t fence_lock;
+	int *fences;
+	uint32_t num_fences;
+
+	/*
+	 * Records before deps[i] must be complete before record i is
+	 * replayed, complete is the first record that is not.
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t *deps;
+	uint8_t *done;
+	uint32_t complete;
+	bool ordered;
+
+	uint32_t nop_handle;
+	uint64_t nop_range;
+
+	uint64_t start;
+	uint64_t t0;
+
+	atomic_int error;
+	atomic_uint inflight;
+};
+
+struct lane {
+	struct replay *r;
+	pthread_t thread;
+
+	/* Indices into reader->records, in time order */
+	uint32_t *records;
+	uint32_t count, max_records;
+	uint32_t tid;
+
+	struct drm_i915_gem_exec_object2 *objects;
+	uint32_t max_objects;
+	struct drm_i915_gem_relocation_entry *relocs;
+	uint32_t max_relocs;
+	struct drm_i915_gem_exec_fence *fence_array;
+	uint32_t max_fences;
+
+	/* Out-fences of the requests we submitted, oldest first */
+	int *queue;
+	uint32_t queue_head, queue_tail, queue_size;
+
+	uint32_t seed;
+	uint64_t execs;
+	struct igt_histogram latency, queue_depth, lag;
+};
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts = {
+		.tv_sec = t / 1000000000ull,
+		.tv_nsec = t % 1000000000ull,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static uint32_t hars_petruska_f54_1_random(uint32_t *state)
+{
+#define rol(x,k) ((x << k) | (x >> (32-k)))
+	return *state = (*state ^ rol(*state, 5) ^ rol(*state, 24)) + 0x37798849;
+#undef rol
+}
+
+static int sink_ioctl(struct replay *r, unsigned long request, void *arg)
+{
+	return r->sink->ioctl(r->sink->data, request, arg);
+}
+
+static void sink_fence_close(struct replay *r, int fence)
+{
+	r->sink->fence_close(r->sink->data, fence);
+}
+
+static uint32_t map(const uint32_t *handles, uint32_t count, uint32_t handle)
+{
+	return handle < count ? handles[handle] : 0;
+}
+
+static int create_bo(struct replay *r, uint64_t size, uint32_t *handle)
+{
+	struct drm_i915_gem_create create = { .size = size };
+	int err;
+
+	err = sink_ioctl(r, DRM_IOCTL_I915_GEM_CREATE, &create);
+	*handle = create.handle;
+
+	return err;
+}
+
+static int close_bo(struct replay *r, uint32_t handle)
+{
+	struct drm_gem_close close = { .handle = handle };
+
+	return sink_ioctl(r, DRM_IOCTL_GEM_CLOSE, &close);
+}
+
+static int replay_simple(struct lane *lane,
+			 const struct gem_exec_trace_record *rec)
+{
+	struct replay *r = lane->r;
+
+	switch (rec->cmd) {
+	case TRACE_ADD_BO: {
+		const struct trace_add_bo *t = (const void *)rec->data;
+
+		return create_bo(r, t->size, &r->bo[t->handle]);
+	}
+
+	case TRACE_DEL_BO: {
+		const struct trace_del_bo *t = (const void *)rec->data;
+		uint32_t handle = map(r->bo, r->num_bo, t->handle);
+
+		if (!handle)
+			return -ENOENT;
+
+		r->bo[t->handle] = 0;
+		return close_bo(r, handle);
+	}
+
+	case TRACE_ADD_CTX: {
+		const struct trace_add_ctx *t = (const void *)rec->data;
+		struct drm_i915_gem_context_create create = {};
+		int err;
+
+		err = sink_ioctl(r, DRM_IOCTL_I915_GEM_CONTEXT_CREATE, &create);
+		r->ctx[t->handle] = create.ctx_id;
+		return err;
+	}
+
+	case TRACE_DEL_CTX: {
+		const struct trace_del_ctx *t = (const void *)rec->data;
+		struct drm_i915_gem_context_destroy destroy = {
+			.ctx_id = map(r->ctx, r->num_ctx, t->handle),
+		};
+
+		if (!destroy.ctx_id)
+			return -ENOENT;
+
+		r->ctx[t->handle] = 0;
+		return sink_ioctl(r, DRM_IOCTL_I915_GEM_CONTEXT_DESTROY, &destroy);
+	}
+
+	case TRACE_ADD_SYNCOBJ: {
+		const struct trace_add_syncobj *t = (const void *)rec->data;
+		struct drm_syncobj_create create = {};
+		int err;
+
+		err = sink_ioctl(r, DRM_IOCTL_SYNCOBJ_CREATE, &create);
+		r->syncobj[t->handle] = create.handle;
+		return err;
+	}
+
+	case TRACE_DEL_SYNCOBJ: {
+		const struct trace_del_syncobj *t = (const void *)rec->data;
+		struct drm_syncobj_destroy destroy = {
+			.handle = map(r->syncobj, r->num_syncobj, t->handle),
+		};
+
+		if (!destroy.handle)
+			return -ENOENT;
+
+		r->syncobj[t->handle] = 0;
+		return sink_ioctl(r, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy);
+	}
+
+	case TRACE_WAIT: {
+		const struct trace_wait *t = (const void *)rec->data;
+		struct drm_i915_gem_wait wait = {
+			.bo_handle = map(r->bo, r->num_bo, t->handle),
+			.timeout_ns = -1,
+		};
+
+		return sink_ioctl(r, DRM_IOCTL_I915_GEM_WAIT, &wait);
+	}
+	}
+
+	return -EINVAL;
+}
+
+static void *grow(void *ptr, uint32_t *max, uint32_t count, size_t size)
+{
+	if (count <= *max)
+		return ptr;
+
+	*max = max(ALIGN(count, 64), 2 * *max);
+	ptr = realloc(ptr, *max * size);
+	igt_assert(ptr);
+
+	return ptr;
+}
+
+static void retire_queue(struct lane *lane)
+{
+	struct replay *r = lane->r;
+
+	while (lane->queue_head != lane->queue_tail) {
+		int fence = lane->queue[lane->queue_head];
+
+		if (r->sink->fence_status(r->sink->data, fence) == 0)
+			break;
+
+		sink_fence_close(r, fence);
+		atomic_fetch_sub(&r->inflight, 1);
+		lane->queue_head++;
+	}
+}
+
+static void queue_fence(struct lane *lane, int fence)
+{
+	if (lane->queue_tail == lane->queue_size) {
+		uint32_t count = lane->queue_tail - lane->queue_head;
+
+		if (lane->queue_head) {
+			memmove(lane->queue, lane->queue + lane->queue_head,
+				count * sizeof(*lane->queue));
+			lane->queue_head = 0;
+			lane->queue_tail = count;
+		}
+
+		if (count >= lane->queue_size / 2) {
+			lane->queue_size = lane->queue_size ? 2 * lane->queue_size : 64;
+			lane->queue = realloc(lane->queue,
+					      lane->queue_size * sizeof(*lane->queue));
+			igt_assert(lane->queue);
+		}
+	}
+
+	lane->queue[lane->queue_tail++] = fence;
+	igt_histogram_push(&lane->queue_depth,
+			   atomic_fetch_add(&lane->r->inflight, 1) + 1);
+}
+
+static int replay_exec(struct lane *lane,
+		       const struct gem_exec_trace_record *rec)
+{
+	struct replay *r = lane->r;
+	struct drm_i915_gem_execbuffer2 eb = {};
+	struct gem_exec_trace_exec t;
+	unsigned long request;
+	uint32_t nrelocs = 0;
+	int in_fence = -1;
+	uint64_t start;
+	uint8_t *ptr;
+	int err;
+
+	gem_exec_trace_decode_exec(r->reader, rec, &t);
+
+	/* Relocations are copied, so the trace can be replayed again */
+	ptr = t.objects;
+	for (uint32_t i = 0; i < t.exec.object_count; i++) {
+		const struct trace_exec_object *to = (const void *)ptr;
+
+		nrelocs += to->relocation_count;
+		ptr += sizeof(*to) + to->relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
+	}
+
+	lane->objects = grow(lane->objects, &lane->max_objects,
+			     t.exec.object_count + 1, sizeof(*lane->objects));
+	lane->relocs = grow(lane->relocs, &lane->max_relocs,
+			    nrelocs, sizeof(*lane->relocs));
+
+	eb.buffers_ptr = to_user_pointer(lane->objects);
+	eb.buffer_count = t.exec.object_count;
+	eb.flags = t.exec.flags;
+	eb.rsvd1 = map(r->ctx, r->num_ctx, t.exec.context);
+
+	ptr = t.objects;
+	nrelocs = 0;
+	for (uint32_t i = 0; i < eb.buffer_count; i++) {
+		struct drm_i915_gem_exec_object2 *obj = &lane->objects[i];
+		struct drm_i915_gem_relocation_entry *relocs =
+			&lane->relocs[nrelocs];
+		struct trace_exec_object to;
+
+		memcpy(&to, ptr, sizeof(to));
+		ptr += sizeof(to);
+
+		obj->handle = map(r->bo, r->num_bo, to.handle);
+		obj->alignment = to.alignment;
+		obj->offset = to.offset;
+		obj->flags = to.flags;
+		obj->rsvd1 = to.rsvd1;
+		obj->rsvd2 = to.rsvd2;
+
+		if (to.relocation_count)
+			memcpy(relocs, ptr, to.relocation_count * sizeof(*relocs));
+		ptr += to.relocation_count * sizeof(*relocs);
+		if (!(eb.flags & I915_EXEC_HANDLE_LUT))
+			for (uint32_t j = 0; j < to.relocation_count; j++)
+				relocs[j].target_handle =
+					map(r->bo, r->num_bo,
+					    relocs[j].target_handle);
+
+		obj->relocation_count = to.relocation_count;
+		obj->relocs_ptr = to_user_pointer(relocs);
+		nrelocs += to.relocation_count;
+	}
+
+	memset(&lane->objects[eb.buffer_count], 0, sizeof(*lane->objects));
+	lane->objects[eb.buffer_count++].handle = r->nop_handle;
+	if (r->nop_range) {
+		eb.batch_start_offset = hars_petruska_f54_1_random(&lane->seed);
+		eb.batch_start_offset =
+			((uint64_t)eb.batch_start_offset * r->nop_range) >> 32;
+		eb.batch_start_offset = ALIGN(eb.batch_start_offset, 64);
+	}
+
+	/*
+	 * An in-fence we did not produce ourselves came from outside the
+	 * trace, so cannot be waited on.
+	 */
+	if (eb.flags & I915_EXEC_FENCE_IN) {
+		int in = t.fences.fence_in;
+
+		pthread_mutex_lock(&r->fence_lock);
+		if (in >= 0 && in < r->num_fences && r->fences[in] >= 0)
+			in_fence = r->sink->fence_dup(r->sink->data,
+						      r->fences[in]);
+		pthread_mutex_unlock(&r->fence_lock);
+
+		if (in_fence >= 0)
+			eb.rsvd2 = in_fence;
+		else
+			eb.flags &= ~(uint64_t)I915_EXEC_FENCE_IN;
+	}
+
+	if (eb.flags & I915_EXEC_FENCE_ARRAY) {
+		uint32_t count = 0;
+
+		lane->fence_array = grow(lane->fence_array, &lane->max_fences,
+					 t.fences.fence_count,
+					 sizeof(*lane->fence_array));
+
+		for (uint32_t i = 0; i < t.fences.fence_count; i++) {
+			struct drm_i915_gem_exec_fence f;
+
+			memcpy(&f, t.fence_array + i * sizeof(f), sizeof(f));
+			f.handle = map(r->syncobj, r->num_syncobj, f.handle);
+			if (f.handle)
+				lane->fence_array[count++] = f;
+		}
+
+		if (count) {
+			eb.cliprects_ptr = to_user_pointer(lane->fence_array);
+			eb.num_cliprects = count;
+		} else {
+			eb.flags &= ~(uint64_t)I915_EXEC_FENCE_ARRAY;
+		}
+	}
+
+	if (r->params->track_queue) {
+		retire_queue(lane);
+		eb.flags |= I915_EXEC_FENCE_OUT;
+	}
+
+	request = DRM_IOCTL_I915_GEM_EXECBUFFER2;
+	if (eb.flags & I915_EXEC_FENCE_OUT)
+		request = DRM_IOCTL_I915_GEM_EXECBUFFER2_WR;
+
+	start = now();
+	err = sink_ioctl(r, request, &eb);
+	igt_histogram_push(&lane->latency, now() - start);
+	lane->execs++;
+
+	if (in_fence >= 0)
+		sink_fence_close(r, in_fence);
+	if (err)
+		return err;
+
+	if (eb.flags & I915_EXEC_FENCE_OUT) {
+		int out = t.fences.fence_out;
+		int fence = eb.rsvd2 >> 32;
+
+		if (out >= 0 && out < r->num_fences) {
+			int old, mapped = fence;
+
+			if (r->params->track_queue)
+				mapped = r->sink->fence_dup(r->sink->data, fence);
+
+			pthread_mutex_lock(&r->fence_lock);
+			old = r->fences[out];
+			r->fences[out] = mapped;
+			pthread_mutex_unlock(&r->fence_lock);
+
+			if (old >= 0)
+				sink_fence_close(r, old);
+		}
+
+		if (r->params->track_queue)
+			queue_fence(lane, fence);
+		else if (out < 0 || out >= r->num_fences)
+			sink_fence_close(r, fence);
+	}
+
+	return 0;
+}
+
+static bool is_create(const struct gem_exec_trace_reader *reader,
+		      const struct gem_exec_trace_record *rec)
+{
+	switch (rec->cmd) {
+	case TRACE_ADD_BO:
+	case TRACE_ADD_CTX:
+	case TRACE_ADD_SYNCOBJ:
+		return true;
+	case TRACE_EXEC: {
+		struct gem_exec_trace_exec t;
+
+		gem_exec_trace_decode_exec(reader, rec, &t);
+		return t.fences.fence_out >= 0;
+	}
+	}
+
+	return false;
+}
+
+static bool is_destroy(const struct gem_exec_trace_record *rec)
+{
+	return rec->cmd == TRACE_DEL_BO ||
+		rec->cmd == TRACE_DEL_CTX ||
+		rec->cmd == TRACE_DEL_SYNCOBJ;
+}
+
+static void compute_deps(struct replay *r)
+{
+	const struct gem_exec_trace_reader *reader = r->reader;
+	uint32_t barrier = 0;
+
+	for (uint32_t i = 0; i < reader->n_records; i++) {
+		const struct gem_exec_trace_record *rec = &reader->records[i];
+
+		if (is_destroy(rec)) {
+			r->deps[i] = i;
+			barrier = i + 1;
+		} else {
+			r->deps[i] = barrier;
+			if (is_create(reader, rec))
+				barrier = i + 1;
+		}
+	}
+}
+
+static bool wait_deps(struct replay *r, uint32_t idx)
+{
+	if (!r->ordered)
+		return true;
+
+	pthread_mutex_lock(&r->lock);
+	while (r->complete < r->deps[idx] && !atomic_load(&r->error))
+		pthread_cond_wait(&r->cond, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+
+	return !atomic_load(&r->error);
+}
+
+static void mark_complete(struct replay *r, uint32_t idx)
+{
+	if (!r->ordered)
+		return;
+
+	pthread_mutex_lock(&r->lock);
+	r->done[idx] = 1;
+	if (idx == r->complete) {
+		while (r->complete < r->reader->n_records &&
+		       r->done[r->complete])
+			r->complete++;
+		pthread_cond_broadcast(&r->cond);
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void set_error(struct replay *r, int err)
+{
+	int expected = 0;
+
+	atomic_compare_exchange_strong(&r->error, &expected, err);
+
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static uint64_t exec_duration(const struct gem_exec_trace_reader *reader,
+			      const struct gem_exec_trace_record *rec)
+{
+	struct gem_exec_trace_exec t;
+
+	if (rec->cmd != TRACE_EXEC)
+		return 0;
+
+	gem_exec_trace_decode_exec(reader, rec, &t);
+	return t.fences.duration;
+}
+
+static void *lane_thread(void *data)
+{
+	struct lane *lane = data;
+	struct replay *r = lane->r;
+	const struct gem_exec_trace_reader *reader = r->reader;
+	uint64_t prev_end = r->start, prev_trace_end = r->t0;
+
+	for (uint32_t n = 0; n < lane->count; n++) {
+		uint32_t idx = lane->records[n];
+		const struct gem_exec_trace_record *rec = &reader->records[idx];
+		uint64_t target = 0, issued;
+		int err;
+
+		if (!wait_deps(r, idx))
+			break;
+
+		switch (r->params->mode) {
+		case GEM_EXEC_TRACE_REPLAY_AFAP:
+			break;
+		case GEM_EXEC_TRACE_REPLAY_TIMELINE:
+			target = prev_end;
+			if (rec->timestamp > prev_trace_end)
+				target += (rec->timestamp - prev_trace_end) * r->scale;
+			break;
+		case GEM_EXEC_TRACE_REPLAY_OPEN_LOOP:
+			target = r->start + (rec->timestamp - r->t0) * r->scale;
+			break;
+		}
+
+		issued = now();
+		if (target > issued) {
+			sleep_until(target);
+			issued = now();
+		}
+		if (target)
+			igt_histogram_push(&lane->lag, issued - min(issued, target));
+
+		if (rec->cmd == TRACE_EXEC)
+			err = replay_exec(lane, rec);
+		else
+			err = replay_simple(lane, rec);
+		if (err) {
+			set_error(r, err);
+			break;
+		}
+
+		prev_end = now();
+		prev_trace_end = rec->timestamp + exec_duration(reader, rec);
+		mark_complete(r, idx);
+	}
+
+	while (lane->queue_head != lane->queue_tail) {
+		sink_fence_close(r, lane->queue[lane->queue_head++]);
+		atomic_fetch_sub(&r->inflight, 1);
+	}
+
+	return NULL;
+}
+
+static struct lane *
+build_lanes(struct replay *r, bool single, uint32_t *count)
+{
+	const struct gem_exec_trace_reader *reader = r->reader;
+	struct lane *lanes = NULL;
+	uint32_t n_lanes = 0, last = 0;
+
+	for (uint32_t i = 0; i < reader->n_records; i++) {
+		uint32_t tid = single ? 0 : reader->records[i].tid;
+		struct lane *lane;
+
+		if (!n_lanes || lanes[last].tid != tid) {
+			for (last = 0; last < n_lanes; last++)
+				if (lanes[last].tid == tid)
+					break;
+
+			if (last == n_lanes) {
+				lanes = realloc(lanes, ++n_lanes * sizeof(*lanes));
+				igt_assert(lanes);
+				memset(&lanes[last], 0, sizeof(*lanes));
+				lanes[last].tid = tid;
+			}
+		}
+
+		lane = &lanes[last];
+		lane->records = grow(lane->records, &lane->max_records,
+				     lane->count + 1, sizeof(*lane->records));
+		lane->records[lane->count++] = i;
+	}
+
+	*count = n_lanes;
+	return lanes;
+}
+
+static int create_nop(struct replay *r)
+{
+	const uint32_t bbe = 0xa << 23;
+	const struct gem_exec_trace_replay_params *params = r->params;
+	struct drm_i915_gem_pwrite pwrite = {
+		.size = sizeof(bbe),
+		.data_ptr = to_user_pointer(&bbe),
+	};
+	uint64_t size = 4096;
+	int err;
+
+	if (params->nop > 0) {
+		size = params->nop + params->range;
+		pwrite.offset = size - sizeof(bbe);
+		r->nop_range = 2 * params->range - 64;
+	}
+
+	err = create_bo(r, size, &r->nop_handle);
+	if (err)
+		return err;
+
+	pwrite.handle = r->nop_handle;
+	return sink_ioctl(r, DRM_IOCTL_I915_GEM_PWRITE, &pwrite);
+}
+
+static void size_maps(struct replay *r)
+{
+	const struct gem_exec_trace_reader *reader = r->reader;
+
+	r->num_bo = r->num_ctx = r->num_syncobj = r->num_fences = 1;
+	for (uint32_t i = 0; i < reader->n_records; i++) {
+		const struct gem_exec_trace_record *rec = &reader->records[i];
+		struct gem_exec_trace_exec t;
+		uint32_t handle;
+
+		/* All records adding an object start with its handle */
+		memcpy(&handle, rec->data, sizeof(handle));
+
+		switch (rec->cmd) {
+		case TRACE_ADD_BO:
+			r->num_bo = max(r->num_bo, handle + 1);
+			break;
+		case TRACE_ADD_CTX:
+			r->num_ctx = max(r->num_ctx, handle + 1);
+			break;
+		case TRACE_ADD_SYNCOBJ:
+			r->num_syncobj = max(r->num_syncobj, handle + 1);
+			break;
+		case TRACE_EXEC:
+			gem_exec_trace_decode_exec(reader, rec, &t);
+			if (t.fences.fence_out >= 0)
+				r->num_fences = max(r->num_fences,
+						    (uint32_t)t.fences.fence_out + 1);
+			break;
+		}
+	}
+
+	r->bo = calloc(r->num_bo, sizeof(*r->bo));
+	r->ctx = calloc(r->num_ctx, sizeof(*r->ctx));
+	r->syncobj = calloc(r->num_syncobj, sizeof(*r->syncobj));
+	r->fences = malloc(r->num_fences * sizeof(*r->fences));
+	igt_assert(r->bo && r->ctx && r->syncobj && r->fences);
+	memset(r->fences, -1, r->num_fences * sizeof(*r->fences));
+}
+
+/* Releases what the trace left behind, as closing the fd would */
+static void release_maps(struct replay *r)
+{
+	for (uint32_t i = 0; i < r->num_fences; i++)
+		if (r->fences[i] >= 0)
+			sink_fence_close(r, r->fences[i]);
+
+	for (uint32_t i = 0; i < r->num_syncobj; i++) {
+		struct drm_syncobj_destroy destroy = { .handle = r->syncobj[i] };
+
+		if (destroy.handle)
+			sink_ioctl(r, DRM_IOCTL_SYNCOBJ_DESTROY, &destroy);
+	}
+
+	for (uint32_t i = 0; i < r->num_ctx; i++) {
+		struct drm_i915_gem_context_destroy destroy = { .ctx_id = r->ctx[i] };
+
+		if (destroy.ctx_id)
+			sink_ioctl(r, DRM_IOCTL_I915_GEM_CONTEXT_DESTROY, &destroy);
+	}
+
+	for (uint32_t i = 0; i < r->num_bo; i++)
+		if (r->bo[i])
+			close_bo(r, r->bo[i]);
+
+	if (r->nop_handle)
+		close_bo(r, r->nop_handle);
+
+	free(r->fences);
+	free(r->syncobj);
+	free(r->ctx);
+	free(r->bo);
+}
+
+/**
+ * gem_exec_trace_replay:
+ * @reader: The trace to replay
+ * @params: How to replay it
+ * @sink: Where to send the requests
+ * @results: Filled with the measurements of the replay
+ *
+ * Replays @reader into @sink. Unless @params asks for a single thread,
+ * every traced thread is replayed by its own thread. Objects still alive
+ * at the end of the trace are released once all threads are done.
+ *
+ * @results must be released with gem_exec_trace_replay_results_fini(),
+ * whether the replay succeeded or not.
+ *
+ * Returns: 0 on success, or the error of the first request that failed.
+ */
+int gem_exec_trace_replay(const struct gem_exec_trace_reader *reader,
+			  const struct gem_exec_trace_replay_params *params,
+			  const struct gem_exec_trace_sink *sink,
+			  struct gem_exec_trace_replay_results *results)
+{
+	struct replay r = {
+		.reader = reader,
+		.params = params,
+		.sink = sink,
+		.scale = params->scale > 0 ? params->scale : 1.,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.fence_lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct lane *lanes;
+	uint32_t n_lanes;
+	int err;
+
+	memset(results, 0, sizeof(*results));
+	igt_histogram_init(&results->latency);
+	igt_histogram_init(&results->queue_depth);
+	igt_histogram_init(&results->lag);
+
+	if (!reader->n_records)
+		return 0;
+
+	size_maps(&r);
+	err = create_nop(&r);
+	if (err)
+		goto out;
+
+	lanes = build_lanes(&r, params->single_thread, &n_lanes);
+	r.ordered = n_lanes > 1;
+	if (r.ordered) {
+		r.deps = calloc(reader->n_records, sizeof(*r.deps));
+		r.done = calloc(reader->n_records, sizeof(*r.done));
+		igt_assert(r.deps && r.done);
+		compute_deps(&r);
+	}
+
+	r.t0 = reader->records[0].timestamp;
+	r.start = now();
+	for (uint32_t i = 0; i < n_lanes; i++) {
+		lanes[i].r = &r;
+		lanes[i].seed = 0x12345678 + i;
+		igt_histogram_init(&lanes[i].latency);
+		igt_histogram_init(&lanes[i].queue_depth);
+		igt_histogram_init(&lanes[i].lag);
+		igt_assert_eq(pthread_create(&lanes[i].thread, NULL,
+					     lane_thread, &lanes[i]), 0);
+	}
+
+	for (uint32_t i = 0; i < n_lanes; i++) {
+		struct lane *lane = &lanes[i];
+
+		pthread_join(lane->thread, NULL);
+
+		results->execs += lane->execs;
+		igt_histogram_merge(&results->latency, &lane->latency);
+		igt_histogram_merge(&results->queue_depth, &lane->queue_depth);
+		igt_histogram_merge(&results->lag, &lane->lag);
+
+		igt_histogram_fini(&lane->latency);
+		igt_histogram_fini(&lane->queue_depth);
+		igt_histogram_fini(&lane->lag);
+		free(lane->queue);
+		free(lane->fence_array);
+		free(lane->relocs);
+		free(lane->objects);
+		free(lane->records);
+	}
+	results->elapsed = now() - r.start;
+	err = atomic_load(&r.error);
+
+	free(r.done);
+	free(r.deps);
+	free(lanes);
+out:
+	release_maps(&r);
+	return err;
+}
+
+/**
+ * gem_exec_trace_replay_results_fini:
+ * @results: The results of gem_exec_trace_replay()
+ *
+ * Releases the histograms of @results.
+ */
+void gem_exec_trace_replay_results_fini(struct gem_exec_trace_replay_results *results)
+{
+	igt_histogram_fini(&results->latency);
+	igt_histogram_fini(&results->queue_depth);
+	igt_histogram_fini(&results->lag);
+}
+
+static int i915_sink_ioctl(void *data, unsigned long request, void *arg)
+{
+	int err = 0;
+
+	if (igt_ioctl((intptr_t)data, request, arg))
+		err = -errno;
+	errno = 0;
+
+	return err;
+}
+
+static int i915_sink_fence_status(void *data, int fence)
+{
+	return sync_fence_status(fence);
+}
+
+static int i915_sink_fence_dup(void *data, int fence)
+{
+	return dup(fence);
+}
+
+static void i915_sink_fence_close(void *data, int fence)
+{
+	close(fence);
+}
+
+/**
+ * gem_exec_trace_sink_init_i915:
+ * @sink: The sink to initialize
+ * @fd: Open i915 device
+ *
+ * Initializes a sink sending the replayed requests to @fd.
+ */
+void gem_exec_trace_sink_init_i915(struct gem_exec_trace_sink *sink, int fd)
+{
+	sink->ioctl = i915_sink_ioctl;
+	sink->fence_status = i915_sink_fence_status;
+	sink->fence_dup = i915_sink_fence_dup;
+	sink->fence_close = i915_sink_fence_close;
+	sink->data = (void *)(intptr_t)fd;
+}
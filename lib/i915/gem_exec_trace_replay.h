@@ -0,0 +1,106 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GEM_EXEC_TRACE_REPLAY_H
+#define GEM_EXEC_TRACE_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "igt_stats.h"
+#include "gem_exec_trace_reader.h"
+
+/**
+ * gem_exec_trace_replay_mode:
+ * @GEM_EXEC_TRACE_REPLAY_AFAP: Submit every request as soon as possible.
+ * @GEM_EXEC_TRACE_REPLAY_TIMELINE: Keep the traced delay between the end of
+ *   a call and the start of the next one of the same thread, so a slower
+ *   submission pushes back the rest of the thread (closed loop).
+ * @GEM_EXEC_TRACE_REPLAY_OPEN_LOOP: Issue every call at its traced time
+ *   after the start of the replay, however late the previous ones were.
+ *
+ * The traced delays are multiplied by the replay scale in both timed modes.
+ */
+enum gem_exec_trace_replay_mode {
+	GEM_EXEC_TRACE_REPLAY_AFAP,
+	GEM_EXEC_TRACE_REPLAY_TIMELINE,
+	GEM_EXEC_TRACE_REPLAY_OPEN_LOOP,
+};
+
+/**
+ * gem_exec_trace_sink:
+ * @ioctl: Performs a DRM ioctl, returning 0 or -errno
+ * @fence_status: Returns 1 if the fence has signaled, 0 if it is pending
+ *   and a negative error code otherwise
+ * @fence_dup: Duplicates a fence fd
+ * @fence_close: Closes a fence fd
+ * @data: Passed to all the above
+ *
+ * Where the replay sends its requests, see gem_exec_trace_sink_init_i915().
+ * Tests can provide their own to replay a trace without a device.
+ */
+struct gem_exec_trace_sink {
+	int (*ioctl)(void *data, unsigned long request, void *arg);
+	int (*fence_status)(void *data, int fence);
+	int (*fence_dup)(void *data, int fence);
+	void (*fence_close)(void *data, int fence);
+	void *data;
+};
+
+struct gem_exec_trace_replay_params {
+	enum gem_exec_trace_replay_mode mode;
+	/* Factor applied to the traced delays, 0 is taken as 1 */
+	double scale;
+	/* Replay all threads of the trace from a single one, in time order */
+	bool single_thread;
+	/* Request an out-fence for every exec to sample the queue depth */
+	bool track_queue;
+	/*
+	 * Size of the nop batch appended to every exec and range of its
+	 * random start offset, or 0 for a single MI_BATCH_BUFFER_END.
+	 */
+	long nop;
+	long range;
+};
+
+struct gem_exec_trace_replay_results {
+	/* From the first to the last call, in ns */
+	uint64_t elapsed;
+	uint64_t execs;
+	/* Time spent in the execbuf ioctl, in ns */
+	struct igt_histogram latency;
+	/* Requests submitted and not yet completed, when tracking the queue */
+	struct igt_histogram queue_depth;
+	/* How late each call was issued, in ns, in the timed modes */
+	struct igt_histogram lag;
+};
+
+void gem_exec_trace_sink_init_i915(struct gem_exec_trace_sink *sink, int fd);
+
+int gem_exec_trace_replay(const struct gem_exec_trace_reader *reader,
+			  const struct gem_exec_trace_replay_params *params,
+			  const struct gem_exec_trace_sink *sink,
+			  struct gem_exec_trace_replay_results *results);
+void gem_exec_trace_replay_results_fini(struct gem_exec_trace_replay_results *results);
+
+#endif /* GEM_EXEC_TRACE_REPLAY_H */
@@ -0,0 +1,439 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "guc_log_capture.h"
+
+/**
+ * SECTION:guc_log_capture
+ * @short_description: GuC log relay capture
+ * @title: GuC log capture
+ * @include: guc_log_capture.h
+ *
+ * The GuC log relay file only holds a few sub-buffers, which are dropped
+ * if they are not read in time. The capture moves them to a pipe with
+ * splice(), which takes references to the relay pages instead of copying
+ * them, and from the pipe to the output file, again with splice(). The
+ * pipe is sized to queue several sub-buffers, to ride over disk latency.
+ *
+ * Files that can't be spliced are handled by reading and writing through
+ * page aligned buffers instead, so that the output may use O_DIRECT.
+ *
+ * The output can be limited to a window of the last sub-buffers, with the
+ * oldest ones overwritten in a circular way, see
+ * guc_log_capture_linearize() to put them back in order.
+ */
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -errno;
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t len, off_t offset)
+{
+	while (len) {
+		ssize_t ret = pwrite(fd, buf, len, offset);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			return -EIO;
+
+		buf += ret;
+		len -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/* Reads up to @len bytes, stopping short only at the end of the file */
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		ssize_t ret = read(fd, buf + done, len - done);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return done ?: -errno;
+		if (ret == 0)
+			break;
+
+		done += ret;
+	}
+
+	return done;
+}
+
+/**
+ * guc_log_capture_init:
+ * @capture: The capture to initialize
+ * @relay_fd: The relay file to read from
+ * @out_fd: The output file, written at explicit offsets
+ * @params: The capture parameters
+ *
+ * Sets up the queue between @relay_fd and @out_fd. The queue may hold
+ * fewer sub-buffers than requested, if the pipe size is limited.
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int guc_log_capture_init(struct guc_log_capture *capture,
+			 int relay_fd, int out_fd,
+			 const struct guc_log_capture_params *params)
+{
+	size_t page_size = getpagesize();
+	size_t queue;
+	int ret;
+
+	memset(capture, 0, sizeof(*capture));
+	capture->relay_fd = relay_fd;
+	capture->out_fd = out_fd;
+	capture->pipe[0] = capture->pipe[1] = -1;
+	capture->subbuf_size = params->subbuf_size;
+	capture->copy_in = capture->copy_out = params->copy;
+
+	if (!capture->subbuf_size || capture->subbuf_size % page_size)
+		return -EINVAL;
+
+	/* The window holds whole sub-buffers */
+	if (params->window) {
+		capture->window = params->window -
+			params->window % capture->subbuf_size;
+		if (!capture->window)
+			capture->window = capture->subbuf_size;
+	}
+
+	if (posix_memalign(&capture->pull_buffer, page_size,
+			   capture->subbuf_size) ||
+	    posix_memalign(&capture->flush_buffer, page_size,
+			   capture->subbuf_size)) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	if (pipe2(capture->pipe, O_CLOEXEC)) {
+		ret = -errno;
+		goto err;
+	}
+
+	/*
+	 * Unprivileged pipes are limited to pipe-max-size, so settle for the
+	 * largest queue allowed.
+	 */
+	queue = (size_t)(params->nr_subbufs ?: 1) * capture->subbuf_size;
+	while ((ret = fcntl(capture->pipe[1], F_SETPIPE_SZ, queue)) < 0) {
+		if (errno != EPERM || queue <= capture->subbuf_size)
+			break;
+		queue -= capture->subbuf_size;
+	}
+	if (ret < 0) {
+		ret = -errno;
+		goto err;
+	}
+	capture->queue_size = ret;
+
+	return 0;
+
+err:
+	guc_log_capture_fini(capture);
+	return ret;
+}
+
+/**
+ * guc_log_capture_fini:
+ * @capture: The capture to clean up
+ *
+ * Frees the queue. Data still queued is lost, the relay and output files
+ * are left open.
+ */
+void guc_log_capture_fini(struct guc_log_capture *capture)
+{
+	if (capture->pipe[0] >= 0)
+		close(capture->pipe[0]);
+	if (capture->pipe[1] >= 0)
+		close(capture->pipe[1]);
+	capture->pipe[0] = capture->pipe[1] = -1;
+
+	free(capture->pull_buffer);
+	free(capture->flush_buffer);
+	capture->pull_buffer = capture->flush_buffer = NULL;
+}
+
+static ssize_t pull_copy(struct guc_log_capture *capture, size_t len)
+{
+	ssize_t ret;
+	int err;
+
+	ret = read(capture->relay_fd, capture->pull_buffer, len);
+	if (ret <= 0)
+		return ret;
+
+	err = write_all(capture->pipe[1], capture->pull_buffer, ret);
+	if (err) {
+		errno = -err;
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * guc_log_capture_pull:
+ * @capture: The capture
+ *
+ * Moves one sub-buffer from the relay file to the queue, blocking while
+ * the queue is full.
+ *
+ * Returns: the size of the sub-buffer, 0 if the relay file had no data, or
+ * a negative error code, -EIO for a partial sub-buffer.
+ */
+ssize_t guc_log_capture_pull(struct guc_log_capture *capture)
+{
+	size_t len = capture->subbuf_size;
+	size_t done = 0;
+	int queued;
+
+	/* A full queue stalls the pull, and the relay file may overflow */
+	if (!ioctl(capture->pipe[1], FIONREAD, &queued) &&
+	    queued + len > capture->queue_size)
+		capture->stats.stalls++;
+
+	while (done < len) {
+		ssize_t ret;
+
+		if (capture->copy_in)
+			ret = pull_copy(capture, len - done);
+		else
+			ret = splice(capture->relay_fd, NULL,
+				     capture->pipe[1], NULL,
+				     len - done, SPLICE_F_MOVE);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EINVAL && !capture->copy_in && !done) {
+			capture->copy_in = true;
+			continue;
+		}
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			break;
+
+		done += ret;
+	}
+
+	if (!done) {
+		capture->stats.empty_reads++;
+		return 0;
+	}
+
+	if (done != len)
+		return -EIO;
+
+	capture->stats.subbufs++;
+	return done;
+}
+
+/**
+ * guc_log_capture_close_queue:
+ * @capture: The capture
+ *
+ * Ends the queue once the last sub-buffer has been pulled, so that
+ * guc_log_capture_flush() returns 0 when the queue is empty rather than
+ * waiting for more.
+ */
+void guc_log_capture_close_queue(struct guc_log_capture *capture)
+{
+	if (capture->pipe[1] >= 0)
+		close(capture->pipe[1]);
+	capture->pipe[1] = -1;
+}
+
+static ssize_t flush_copy(struct guc_log_capture *capture,
+			  size_t len, off_t offset)
+{
+	ssize_t ret;
+	int err;
+
+	/* A whole sub-buffer, to keep the write aligned for O_DIRECT */
+	ret = read_full(capture->pipe[0], capture->flush_buffer, len);
+	if (ret <= 0)
+		return ret;
+
+	err = pwrite_all(capture->out_fd, capture->flush_buffer, ret, offset);
+	if (err) {
+		errno = -err;
+		return -1;
+	}
+
+	return ret;
+}
+
+/**
+ * guc_log_capture_flush:
+ * @capture: The capture
+ *
+ * Writes the oldest queued sub-buffer to the output file, blocking until
+ * there is one.
+ *
+ * Returns: the size of the sub-buffer, 0 if the queue has been closed and
+ * is empty, or a negative error code.
+ */
+ssize_t guc_log_capture_flush(struct guc_log_capture *capture)
+{
+	size_t len = capture->subbuf_size;
+	uint64_t offset = capture->offset;
+	size_t done = 0;
+
+	if (capture->window && offset + len > capture->window)
+		offset = 0;
+
+	while (done < len) {
+		loff_t pos = offset + done;
+		ssize_t ret;
+
+		if (capture->copy_out)
+			ret = flush_copy(capture, len - done, pos);
+		else
+			ret = splice(capture->pipe[0], NULL,
+				     capture->out_fd, &pos,
+				     len - done, SPLICE_F_MOVE);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		/* Some files, like O_DIRECT ones on some filesystems */
+		if (ret < 0 && errno == EINVAL && !capture->copy_out) {
+			capture->copy_out = true;
+			continue;
+		}
+		if (ret < 0)
+			return -errno;
+		if (ret == 0)
+			break;
+
+		done += ret;
+	}
+
+	if (!done)
+		return 0;
+
+	if (offset < capture->offset) {
+		capture->wrapped = true;
+		capture->stats.window_wraps++;
+	}
+	if (offset < capture->end)
+		capture->stats.discarded += capture->end - offset < done ?
+			capture->end - offset : done;
+
+	capture->offset = offset + done;
+	if (capture->offset > capture->end)
+		capture->end = capture->offset;
+	capture->stats.bytes_written += done;
+
+	return done == len ? done : -EIO;
+}
+
+static int copy_range(struct guc_log_capture *capture, int dst_fd,
+		      off_t src, off_t dst, size_t len)
+{
+	while (len) {
+		ssize_t ret;
+		int err;
+
+		ret = copy_file_range(capture->out_fd, &src, dst_fd, &dst,
+				      len, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret > 0) {
+			len -= ret;
+			continue;
+		}
+		if (ret == 0)
+			return -EIO;
+		if (errno != EXDEV && errno != EINVAL &&
+		    errno != ENOSYS && errno != EOPNOTSUPP)
+			return -errno;
+
+		/* No in kernel copy between these files, bounce */
+		ret = pread(capture->out_fd, capture->flush_buffer,
+			    len < capture->subbuf_size ? len : capture->subbuf_size,
+			    src);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret ? -errno : -EIO;
+
+		err = pwrite_all(dst_fd, capture->flush_buffer, ret, dst);
+		if (err)
+			return err;
+
+		src += ret;
+		dst += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/**
+ * guc_log_capture_linearize:
+ * @capture: The capture, with no flush in progress
+ * @dst_fd: The file to copy the log to
+ *
+ * Copies the sub-buffers of the output file to @dst_fd from the oldest to
+ * the newest, undoing the wrap around of a windowed capture.
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int guc_log_capture_linearize(struct guc_log_capture *capture, int dst_fd)
+{
+	uint64_t head = capture->wrapped ? capture->offset : 0;
+	int ret;
+
+	ret = copy_range(capture, dst_fd, head, 0, capture->end - head);
+	if (ret || !head)
+		return ret;
+
+	return copy_range(capture, dst_fd, 0, capture->end - head, head);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef GUC_LOG_CAPTURE_H
+#define GUC_LOG_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * guc_log_capture_stats:
+ * @subbufs: Sub-buffers pulled from the relay file
+ * @bytes_written: Bytes written to the output file
+ * @empty_reads: Pulls that found no data, despite poll() reporting some
+ * @stalls: Sub-buffers that found the queue to the disk full, so that the
+ *   relay file was not drained meanwhile and may have dropped data
+ * @window_wraps: Times the on-disk window was wrapped around
+ * @discarded: Bytes of the on-disk window overwritten by newer data
+ */
+struct guc_log_capture_stats {
+	uint64_t subbufs;
+	uint64_t bytes_written;
+	uint64_t empty_reads;
+	uint64_t stalls;
+	uint64_t window_wraps;
+	uint64_t discarded;
+};
+
+struct guc_log_capture_params {
+	/* Size of a relay sub-buffer, a multiple of the page size */
+	size_t subbuf_size;
+	/* Sub-buffers queued between the relay file and the disk */
+	unsigned int nr_subbufs;
+	/* Keep only the last bytes of the log on disk, 0 to keep all */
+	uint64_t window;
+	/* Read and write through memory rather than splice */
+	bool copy;
+};
+
+/**
+ * guc_log_capture:
+ *
+ * Moves sub-buffers from a relay file to an output file through a pipe.
+ * guc_log_capture_pull() fills the pipe and guc_log_capture_flush() drains
+ * it; they may run in two different threads.
+ */
+struct guc_log_capture {
+	int relay_fd, out_fd;
+	int pipe[2];
+	size_t subbuf_size;
+	size_t queue_size;
+	uint64_t window;
+	/* Whether each side falls back to read() and write() */
+	bool copy_in, copy_out;
+
+	/* Next write offset, and end of the data in the output file */
+	uint64_t offset, end;
+	bool wrapped;
+
+	/* Bounce buffers of the copy path, one per side */
+	void *pull_buffer, *flush_buffer;
+
+	struct guc_log_capture_stats stats;
+};
+
+int guc_log_capture_init(struct guc_log_capture *capture,
+			 int relay_fd, int out_fd,
+			 const struct guc_log_capture_params *params);
+void guc_log_capture_fini(struct guc_log_capture *capture);
+
+ssize_t guc_log_capture_pull(struct guc_log_capture *capture);
+void guc_log_capture_close_queue(struct guc_log_capture *capture);
+ssize_t guc_log_capture_flush(struct guc_log_capture *capture);
+
+int guc_log_capture_linearize(struct guc_log_capture *capture, int dst_fd);
+
+#endif /* GUC_LOG_CAPTURE_H */
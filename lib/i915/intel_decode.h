@@ -29,6 +29,11 @@
 
 struct intel_decode;
 
+enum intel_decode_format {
+	INTEL_DECODE_FORMAT_TEXT,
+	INTEL_DECODE_FORMAT_JSON,
+};
+
 struct intel_decode *intel_decode_context_alloc(uint32_t devid);
 void intel_decode_context_free(struct intel_decode *ctx);
 void intel_decode_set_dump_past_end(struct intel_decode *ctx, int dump_past_end);
@@ -37,6 +42,8 @@ void intel_decode_set_batch_pointer(struct intel_decode *ctx,
 void intel_decode_set_head_tail(struct intel_decode *ctx,
 				uint32_t head, uint32_t tail);
 void intel_decode_set_output_file(struct intel_decode *ctx, FILE *output);
+void intel_decode_set_output_format(struct intel_decode *ctx,
+				    enum intel_decode_format format);
 void intel_decode(struct intel_decode *ctx);
 
 #endif /* INTEL_DECODE_H */
@@ -219,6 +219,10 @@ class Gen:
 
         self.hw_vars = hw_vars_mapping
 
+        # When set, maps variables to the locals holding them and makes
+        # reads use hoisted offsets, for the batch evaluation functions.
+        self.locals = None
+
     def emit_fadd(self, tmp_id, args):
         self.c("double tmp{0} = {1} + {2};".format(tmp_id, args[1], args[0]))
         return tmp_id + 1
@@ -246,7 +250,10 @@ class Gen:
 
     def emit_read(self, tmp_id, args):
         type = args[1].lower()
-        self.c("uint64_t tmp{0} = accumulator[metric_set->{1}_offset + {2}];".format(tmp_id, type, args[0]))
+        if self.locals is not None:
+            self.c("uint64_t tmp{0} = accumulator[{1}_offset + {2}];".format(tmp_id, type, args[0]))
+        else:
+            self.c("uint64_t tmp{0} = accumulator[metric_set->{1}_offset + {2}];".format(tmp_id, type, args[0]))
         return tmp_id + 1
 
     def emit_uadd(self, tmp_id, args):
@@ -334,6 +341,8 @@ class Gen:
         return self.brkt(args[1]) + " * " + self.brkt(args[0])
 
     def resolve_variable(self, name, set):
+        if self.locals is not None and name in self.locals:
+            return self.locals[name]
         if name in self.hw_vars:
             return self.hw_vars[name]['c']
         if name in set.counter_vars:
@@ -349,7 +358,9 @@ class Gen:
             return 'intel_perf_devinfo_subslice_available(&perf->devinfo, {0}, {1})'.format(m.group(1), m.group(2))
         return None
 
-    def output_rpn_equation_code(self, set, counter, equation):
+    def output_rpn_equation_code(self, set, counter, equation, result=None):
+        """Emits the code computing equation, returning the value, or
+        assigning it to the result variable if given."""
         self.c("/* RPN equation: " + equation + " */")
         tokens = equation.split()
         stack = []
@@ -389,7 +400,10 @@ class Gen:
                 raise Exception("Failed to resolve variable " + value + " in expression " + expression + " for " + set.name + " :: " + counter_name)
             value = resolved_variable
 
-        self.c("\nreturn " + value + ";")
+        if result:
+            self.c("\n" + result + " = " + value + ";")
+        else:
+            self.c("\nreturn " + value + ";")
 
     def splice_rpn_expression(self, set, counter_name, expression):
         tokens = expression.split()
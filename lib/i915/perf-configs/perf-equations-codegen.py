@@ -23,6 +23,7 @@
 
 import argparse
 import os
+import re
 import sys
 import textwrap
 
@@ -153,6 +154,147 @@ def output_counter_max_definition(gen, set, counter):
         hashed_funcs[counter.max_hash] = counter.max_sym
 
 
+def evaluate_sym(set):
+    return "{0}__{1}__evaluate".format(set.gen.chipset, set.underscore_name)
+
+
+def counter_local(counter):
+    return "c_" + counter.get('underscore_name')
+
+
+def device_variable_local(name):
+    """Returns the local name, C type and value of a device variable."""
+    m = re.search(r'\$GtSlice([0-9]+)(XeCore|DualSubslice)([0-9]+)$', name)
+    if m:
+        return ("slice{0}_subslice{1}_available".format(m.group(1), m.group(3)), "bool",
+                "intel_perf_devinfo_subslice_available(&perf->devinfo, {0}, {1})".format(m.group(1), m.group(3)))
+    m = re.search(r'\$GtSlice([0-9]+)$', name)
+    if m:
+        return ("slice{0}_available".format(m.group(1)), "bool",
+                "intel_perf_devinfo_slice_available(&perf->devinfo, {0})".format(m.group(1)))
+
+    value = codegen.hw_vars_mapping[name]['c']
+    return (value.split('.')[-1], "__typeof__({0})".format(value), value)
+
+
+def output_set_evaluate(gen, set):
+    # Rows are in the order the metric set codegen registers the counters.
+    counters = sorted(set.counters, key=lambda k: k.get('symbol_name'))
+
+    # Counters referring to other counters are computed after them.
+    order = []
+    def visit(counter):
+        if counter in order:
+            return
+        for token in counter.get('equation').split():
+            if token in set.counter_vars:
+                visit(set.counter_vars[token])
+        order.append(counter)
+    for counter in counters:
+        visit(counter)
+
+    # Everything not depending on the accumulator is read once.
+    offsets = []
+    device_vars = {}
+    for counter in counters:
+        tokens = counter.get('equation').split()
+        for i, token in enumerate(tokens):
+            if token == "READ" and tokens[i - 2].lower() not in offsets:
+                offsets.append(tokens[i - 2].lower())
+            elif token[0] == "$" and codegen.is_hw_var(token):
+                device_vars[token] = device_variable_local(token)
+    hoisted = {}
+    for local, ctype, value in device_vars.values():
+        hoisted[local] = (ctype, value)
+
+    sym = evaluate_sym(set)
+
+    c("\n")
+    c("/* {0} */".format(set.name))
+    c("void")
+    c(sym + "(const struct intel_perf *perf,")
+    c.indent(len(sym) + 1)
+    c("const struct intel_perf_metric_set *metric_set,")
+    c("const struct intel_perf_accumulator *accumulators,")
+    c("uint32_t n_accumulators,")
+    c("union intel_perf_counter_value *values)")
+    c.outdent(len(sym) + 1)
+    c("{")
+    c.indent(4)
+
+    for offset in offsets:
+        c("const int {0}_offset = metric_set->{0}_offset;".format(offset))
+    for local in sorted(hoisted):
+        c("const {0} {1} = {2};".format(hoisted[local][0], local, hoisted[local][1]))
+    for i in range(len(counters)):
+        c("union intel_perf_counter_value *row{0} = NULL;".format(i))
+    c("uint32_t row = 0;\n")
+
+    # Rows of the counters the metric set left out are not written.
+    for i, counter in enumerate(counters):
+        availability = counter.get('availability')
+        if availability:
+            c("if ({0})".format(gen.splice_rpn_expression(set, counter.get('name'), availability)))
+            c.indent(4)
+            c("row{0} = &values[row++ * n_accumulators];".format(i))
+            c.outdent(4)
+        else:
+            c("row{0} = &values[row++ * n_accumulators];".format(i))
+
+    c("\nfor (uint32_t i = 0; i < n_accumulators; i++) {")
+    c.indent(4)
+    c("const uint64_t *accumulator = accumulators[i].deltas;")
+    for counter in order:
+        c("{0} {1};".format(data_type_to_ctype(counter.get('data_type')), counter_local(counter)))
+
+    # Device variables take precedence, like in resolve_variable().
+    gen.locals = { name: counter_local(counter) for name, counter in set.counter_vars.items() }
+    for name, var in device_vars.items():
+        gen.locals[name] = var[0]
+
+    for counter in order:
+        c("\n/* {0} */".format(counter.get('name')))
+        c("{")
+        c.indent(4)
+        gen.output_rpn_equation_code(set, counter, counter.get('equation'),
+                                     result=counter_local(counter))
+        c.outdent(4)
+        c("}")
+
+    gen.locals = None
+
+    c("")
+    for i, counter in enumerate(counters):
+        field = "f" if counter.get('data_type') == "float" else "u64"
+        store = "row{0}[i].{1} = {2};".format(i, field, counter_local(counter))
+        if counter.get('availability'):
+            c("if (row{0})".format(i))
+            c.indent(4)
+            c(store)
+            c.outdent(4)
+        else:
+            c(store)
+
+    c.outdent(4)
+    c("}")
+    c.outdent(4)
+    c("}")
+
+
+def output_set_evaluate_definition(gen, set):
+    sym = evaluate_sym(set)
+
+    h("void")
+    h(sym + "(const struct intel_perf *perf,")
+    h.indent(len(sym) + 1)
+    h("const struct intel_perf_metric_set *metric_set,")
+    h("const struct intel_perf_accumulator *accumulators,")
+    h("uint32_t n_accumulators,")
+    h("union intel_perf_counter_value *values);")
+    h.outdent(len(sym) + 1)
+    h("\n")
+
+
 def generate_equations(args, gens):
     global hashed_funcs
 
@@ -197,6 +339,10 @@ def generate_equations(args, gens):
                 output_counter_read(gen, set, counter)
                 output_counter_max(gen, set, counter)
 
+    for gen in gens:
+        for set in gen.sets:
+            output_set_evaluate(gen, set)
+
     hashed_funcs = {}
     h(textwrap.dedent("""\
         #ifndef __%s__
@@ -207,7 +353,9 @@ def generate_equations(args, gens):
         #include <stdbool.h>
 
         struct intel_perf;
+        struct intel_perf_accumulator;
         struct intel_perf_metric_set;
+        union intel_perf_counter_value;
 
         double
         percentage_max_callback_float(const struct intel_perf *perf,
@@ -226,6 +374,7 @@ def generate_equations(args, gens):
             for counter in set.counters:
                 output_counter_read_definition(gen, set, counter)
                 output_counter_max_definition(gen, set, counter)
+            output_set_evaluate_definition(gen, set)
 
     h(textwrap.dedent("""\
 
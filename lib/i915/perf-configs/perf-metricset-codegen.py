@@ -131,6 +131,7 @@ def generate_metric_sets(args, gen):
         c("metric_set->counters = calloc({0}, sizeof(struct intel_perf_logical_counter));\n".format(str(len(counters))))
         c("metric_set->n_counters = 0;\n")
         c("metric_set->perf_oa_metrics_set = 0; // determined at runtime\n")
+        c("metric_set->evaluate = {0}__{1}__evaluate;\n".format(gen.chipset, set.underscore_name))
 
         if gen.chipset == "hsw":
             c(textwrap.dedent("""\
@@ -200,6 +200,12 @@ struct intel_perf_accumulator {
 	uint64_t deltas[INTEL_PERF_MAX_RAW_OA_COUNTERS];
 };
 
+/* Value of a logical counter, depending on its storage. */
+union intel_perf_counter_value {
+	uint64_t u64;
+	double f;
+};
+
 struct intel_perf;
 struct intel_perf_metric_set;
 struct intel_perf_logical_counter {
@@ -268,6 +274,19 @@ struct intel_perf_metric_set {
 	uint32_t n_flex_regs;
 
 	struct igt_list_head link;
+
+	/*
+	 * Computes all the counters of the set for n_accumulators
+	 * accumulators at once, same as calling each counter's read
+	 * function on each accumulator. The values of counters[c] are
+	 * stored in values[c * n_accumulators] to
+	 * values[(c + 1) * n_accumulators - 1].
+	 */
+	void (*evaluate)(const struct intel_perf *perf,
+			 const struct intel_perf_metric_set *metric_set,
+			 const struct intel_perf_accumulator *accumulators,
+			 uint32_t n_accumulators,
+			 union intel_perf_counter_value *values);
 };
 
 /* A tree structure with group having subgroups and counters. */
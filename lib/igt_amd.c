@@ -26,6 +26,7 @@
 #include "igt_amd.h"
 #include "igt.h"
 #include "igt_sysfs.h"
+#include "igt_tile_copy.h"
 #include <amdgpu_drm.h>
 
 #define X0 1
@@ -200,35 +201,52 @@ uint32_t igt_amd_fb_tiled_offset(unsigned int bpp, unsigned int x_input,
     return (uint32_t)addr;
 }
 
+struct amd_tiled_layout {
+	unsigned int bpp, width;
+};
+
+static size_t amd_tiled_layout_offset(const void *data,
+				      unsigned int x, unsigned int y)
+{
+	const struct amd_tiled_layout *t = data;
+
+	return igt_amd_fb_tiled_offset(t->bpp, x, y, t->width);
+}
+
 void igt_amd_fb_to_tiled(struct igt_fb *dst, void *dst_buf, struct igt_fb *src,
 				       void *src_buf, unsigned int plane)
 {
-	uint32_t src_offset, dst_offset;
 	unsigned int bpp = src->plane_bpp[plane];
 	unsigned int width = dst->plane_width[plane];
 	unsigned int height = dst->plane_height[plane];
-	unsigned int x, y;
-
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			src_offset = src->offsets[plane];
-			dst_offset = dst->offsets[plane];
-
-			src_offset += src->strides[plane] * y + x * bpp / 8;
-			dst_offset += igt_amd_fb_tiled_offset(bpp, x, y, width);
-
-			switch (bpp) {
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			case 32:
-				*(uint32_t *)(dst_buf + dst_offset) =
-					*(uint32_t *)(src_buf + src_offset);
-				break;
-			}
-		}
-	}
+	unsigned int tile_width, tile_height;
+	struct amd_tiled_layout t = {
+		.bpp = bpp,
+		.width = width,
+	};
+	struct igt_tile_layout layout = {
+		.width = width,
+		.height = height,
+		.cpp = bpp / 8,
+		/* The swizzle takes each address bit from either x or y */
+		.x_maps = 1,
+		.x_map_height = 1,
+		.offset = amd_tiled_layout_offset,
+		.data = &t,
+	};
+	struct igt_tile_copy copy;
+
+	if (bpp != 16 && bpp != 32)
+		return;
+
+	igt_amd_fb_calculate_tile_dimension(bpp, &tile_width, &tile_height);
+	layout.tile_height = tile_height;
+
+	igt_tile_copy_init(&copy, &layout);
+	igt_tile_copy_to_tiled(&copy, dst_buf + dst->offsets[plane],
+			       src_buf + src->offsets[plane],
+			       src->strides[plane]);
+	igt_tile_copy_fini(&copy);
 }
 
 void igt_amd_fb_convert_plane_to_tiled(struct igt_fb *dst, void *dst_buf,
@@ -0,0 +1,797 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_bench.h"
+#include "igt_core.h"
+#include "igt_stats.h"
+#include "igt_sysfs.h"
+
+/**
+ * SECTION:igt_bench
+ * @short_description: Common harness for benchmarks
+ * @title: Bench
+ * @include: igt_bench.h
+ *
+ * The programs in benchmarks/ use this to share their command line, the
+ * warm-up, the number of samples taken and the output format.
+ *
+ * A benchmark provides a function measuring one sample, and
+ * igt_bench_run() calls it first for the warm-up period, discarding the
+ * values, and then until the 95% confidence interval of the mean is
+ * within the target relative error. The samples are kept and summarized
+ * with #igt_stats_t.
+ *
+ * By default each sample is printed on its own line, the format ezbench
+ * scrapes, with a summary on stderr. With --json a single line JSON
+ * object per run is appended to the output instead, holding the
+ * parameters, the summary and all the samples.
+ *
+ * |[
+ *	static double sample(void *data)
+ *	{
+ *		struct timespec start = {};
+ *		unsigned long count = 0;
+ *
+ *		igt_nsec_elapsed(&start);
+ *		do {
+ *			do_something(data);
+ *			count++;
+ *		} while (igt_nsec_elapsed(&start) < igt_bench_sample_time() * 1e9);
+ *
+ *		return igt_nsec_elapsed(&start) / 1e3 / count;
+ *	}
+ *
+ *	int main(int argc, char **argv)
+ *	{
+ *		igt_bench_init(argc, argv, NULL, NULL, NULL, NULL, NULL);
+ *		return igt_bench_run("something", "us",
+ *				     IGT_BENCH_LOWER_IS_BETTER, sample, NULL);
+ *	}
+ * ]|
+ */
+
+#define MAX_PARAMS 32
+
+enum {
+	OPT_JSON = 0x1000,
+	OPT_WARMUP,
+	OPT_SAMPLE_TIME,
+	OPT_MIN_SAMPLES,
+	OPT_MAX_SAMPLES,
+	OPT_TARGET_ERROR,
+	OPT_MAX_TIME,
+	OPT_CPU,
+	OPT_PERFORMANCE,
+};
+
+static struct {
+	const char *program;
+	FILE *json;
+	double warmup;
+	double sample_time;
+	unsigned int min_samples;
+	unsigned int max_samples;
+	double target_error;
+	double max_time;
+	int cpu;
+	bool performance;
+	char *governor;
+
+	struct {
+		char *key;
+		char *value;
+	} params[MAX_PARAMS];
+	unsigned int n_params;
+} bench;
+
+static struct {
+	double warmup;
+	double sample_time;
+	unsigned int samples;
+} defaults = {
+	.warmup = 0.5,
+	.sample_time = 1,
+};
+
+static const char *common_help =
+	"  --min-samples=N\tTake at least N samples (default 5)\n"
+	"  --max-samples=N\tTake at most N samples (default 100)\n"
+	"  --target-error=PCT\tStop once the 95% confidence interval is\n"
+	"\t\t\twithin PCT percent of the mean (default 1)\n"
+	"  --max-time=SECONDS\tStop sampling after SECONDS (default 60)\n"
+	"  --warmup=SECONDS\tDiscard samples for SECONDS first (default %g)\n"
+	"  --sample-time=SECONDS\tDuration of timed samples (default %g)\n"
+	"  --cpu=N\t\tRun on CPU N only\n"
+	"  --performance\t\tUse the performance cpufreq governor while running\n"
+	"  --json[=FILE]\t\tAppend the results as JSON lines to FILE or stdout\n"
+	"  -h, --help\t\tShow this help\n";
+
+static void usage(const char *help_str)
+{
+	printf("Usage: %s [OPTIONS]\n", bench.program);
+	if (defaults.samples)
+		printf("  -r, --samples=N\tTake exactly N samples (default %u)\n",
+		       defaults.samples);
+	else
+		printf("  -r, --samples=N\tTake exactly N samples\n");
+	printf(common_help, defaults.warmup, defaults.sample_time);
+	if (help_str)
+		printf("%s", help_str);
+}
+
+static double parse_double(const char *arg, const char *name, double min)
+{
+	char *end;
+	double v;
+
+	v = strtod(arg, &end);
+	if (*end || !(v >= min)) {
+		fprintf(stderr, "Invalid %s: %s\n", name, arg);
+		exit(IGT_EXIT_INVALID);
+	}
+
+	return v;
+}
+
+static unsigned int parse_uint(const char *arg, const char *name,
+			       unsigned int min, unsigned int max)
+{
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(arg, &end, 10);
+	if (!isdigit(*arg) || *end || errno || v < min || v > max) {
+		fprintf(stderr, "Invalid %s: %s\n", name, arg);
+		exit(IGT_EXIT_INVALID);
+	}
+
+	return v;
+}
+
+static int cpufreq_dir(void)
+{
+	return open("/sys/devices/system/cpu", O_RDONLY | O_DIRECTORY);
+}
+
+static char *governor_attr(int cpu)
+{
+	char *attr;
+
+	igt_assert(asprintf(&attr, "cpu%d/cpufreq/scaling_governor",
+			    cpu) > 0);
+	return attr;
+}
+
+/* The CPUs the benchmark runs on, all online ones unless pinned */
+static int first_cpu(void)
+{
+	return bench.cpu >= 0 ? bench.cpu : 0;
+}
+
+static int last_cpu(void)
+{
+	return bench.cpu >= 0 ? bench.cpu : sysconf(_SC_NPROCESSORS_ONLN) - 1;
+}
+
+static void set_governor(int dir, const char *governor)
+{
+	for (int cpu = first_cpu(); cpu <= last_cpu(); cpu++) {
+		char *attr = governor_attr(cpu);
+
+		igt_sysfs_set(dir, attr, governor);
+		free(attr);
+	}
+}
+
+static void restore_governor(int sig)
+{
+	int dir = cpufreq_dir();
+
+	if (dir < 0)
+		return;
+
+	set_governor(dir, bench.governor);
+	close(dir);
+}
+
+static char *get_governor(void)
+{
+	char *attr, *governor;
+	int dir;
+
+	dir = cpufreq_dir();
+	if (dir < 0)
+		return NULL;
+
+	attr = governor_attr(first_cpu());
+	governor = igt_sysfs_get(dir, attr);
+	free(attr);
+	close(dir);
+
+	return governor;
+}
+
+static void setup_cpus(void)
+{
+	if (bench.cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(bench.cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			fprintf(stderr, "Unable to run on CPU %d: %s\n",
+				bench.cpu, strerror(errno));
+			exit(IGT_EXIT_INVALID);
+		}
+	}
+
+	if (bench.performance && !bench.governor) {
+		int dir;
+
+		bench.governor = get_governor();
+		dir = cpufreq_dir();
+		if (!bench.governor || dir < 0) {
+			fprintf(stderr, "Unable to change the cpufreq governor\n");
+			exit(IGT_EXIT_INVALID);
+		}
+
+		set_governor(dir, "performance");
+		close(dir);
+		igt_install_exit_handler(restore_governor);
+	}
+}
+
+/**
+ * igt_bench_init:
+ * @argc: argc from the benchmark's main()
+ * @argv: argv from the benchmark's main()
+ * @extra_short_opts: getopt string with the benchmark's own options
+ * @extra_long_opts: long getopt options of the benchmark
+ * @help_str: help text for the benchmark's own options
+ * @extra_opt_handler: handler for the benchmark's own options
+ * @handler_data: user data given to @extra_opt_handler
+ *
+ * Parses the command line like igt_subtest_init_parse_opts() does for
+ * tests, handling the options common to all benchmarks and passing the
+ * others to @extra_opt_handler. This also pins the process to a CPU
+ * and selects the cpufreq governor when asked to, so it should be
+ * called before the benchmark sets anything up.
+ *
+ * -r is one of the common options, setting the number of samples, and
+ * cannot be used in @extra_short_opts.
+ */
+void igt_bench_init(int argc, char **argv,
+		    const char *extra_short_opts,
+		    const struct option *extra_long_opts,
+		    const char *help_str,
+		    igt_opt_handler_t extra_opt_handler,
+		    void *handler_data)
+{
+	static const struct option common_long_opts[] = {
+		{ "samples", required_argument, NULL, 'r' },
+		{ "help", no_argument, NULL, 'h' },
+		{ "json", optional_argument, NULL, OPT_JSON },
+		{ "warmup", required_argument, NULL, OPT_WARMUP },
+		{ "sample-time", required_argument, NULL, OPT_SAMPLE_TIME },
+		{ "min-samples", required_argument, NULL, OPT_MIN_SAMPLES },
+		{ "max-samples", required_argument, NULL, OPT_MAX_SAMPLES },
+		{ "target-error", required_argument, NULL, OPT_TARGET_ERROR },
+		{ "max-time", required_argument, NULL, OPT_MAX_TIME },
+		{ "cpu", required_argument, NULL, OPT_CPU },
+		{ "performance", no_argument, NULL, OPT_PERFORMANCE },
+	};
+	struct option *long_opts;
+	char *short_opts;
+	int n_extra = 0;
+	int c, index;
+
+	igt_assert_f(!extra_short_opts || (!strchr(extra_short_opts, 'r') &&
+					   !strchr(extra_short_opts, 'h')),
+		     "-r and -h are common benchmark options\n");
+
+	bench.program = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+	if (bench.json && bench.json != stdout)
+		fclose(bench.json);
+	bench.json = NULL;
+	bench.warmup = defaults.warmup;
+	bench.sample_time = defaults.sample_time;
+	if (defaults.samples) {
+		bench.min_samples = defaults.samples;
+		bench.max_samples = defaults.samples;
+		bench.target_error = INFINITY;
+		bench.max_time = INFINITY;
+	} else {
+		bench.min_samples = 5;
+		bench.max_samples = 100;
+		bench.target_error = 0.01;
+		bench.max_time = 60;
+	}
+	bench.cpu = -1;
+	bench.performance = false;
+	for (unsigned int i = 0; i < bench.n_params; i++) {
+		free(bench.params[i].key);
+		free(bench.params[i].value);
+	}
+	bench.n_params = 0;
+
+	while (extra_long_opts && extra_long_opts[n_extra].name)
+		n_extra++;
+
+	long_opts = calloc(ARRAY_SIZE(common_long_opts) + n_extra + 1,
+			   sizeof(*long_opts));
+	igt_assert(long_opts);
+	memcpy(long_opts, common_long_opts, sizeof(common_long_opts));
+	if (n_extra)
+		memcpy(long_opts + ARRAY_SIZE(common_long_opts),
+		       extra_long_opts, n_extra * sizeof(*long_opts));
+
+	igt_assert(asprintf(&short_opts, "r:h%s",
+			    extra_short_opts ?: "") > 0);
+
+	optind = 1;
+	while ((c = getopt_long(argc, argv, short_opts, long_opts,
+				&index)) != -1) {
+		switch (c) {
+		case 'r':
+			bench.min_samples = parse_uint(optarg, "sample count", 1, UINT_MAX);
+			bench.max_samples = bench.min_samples;
+			bench.target_error = INFINITY;
+			bench.max_time = INFINITY;
+			break;
+		case 'h':
+			usage(help_str);
+			exit(IGT_EXIT_SUCCESS);
+		case OPT_JSON:
+			if (optarg) {
+				bench.json = fopen(optarg, "a");
+				if (!bench.json) {
+					fprintf(stderr, "Unable to open %s: %s\n",
+						optarg, strerror(errno));
+					exit(IGT_EXIT_INVALID);
+				}
+			} else {
+				bench.json = stdout;
+			}
+			break;
+		case OPT_WARMUP:
+			bench.warmup = parse_double(optarg, "warm-up time", 0);
+			break;
+		case OPT_SAMPLE_TIME:
+			bench.sample_time = parse_double(optarg, "sample time", 0);
+			break;
+		case OPT_MIN_SAMPLES:
+			bench.min_samples = parse_uint(optarg, "sample count", 1, UINT_MAX);
+			break;
+		case OPT_MAX_SAMPLES:
+			bench.max_samples = parse_uint(optarg, "sample count", 1, UINT_MAX);
+			break;
+		case OPT_TARGET_ERROR:
+			bench.target_error =
+				parse_double(optarg, "target error", 0) / 100;
+			break;
+		case OPT_MAX_TIME:
+			bench.max_time = parse_double(optarg, "sampling time", 0);
+			break;
+		case OPT_CPU:
+			bench.cpu = parse_uint(optarg, "CPU", 0,
+					       sysconf(_SC_NPROCESSORS_ONLN) - 1);
+			break;
+		case OPT_PERFORMANCE:
+			bench.performance = true;
+			break;
+		case '?':
+			usage(help_str);
+			exit(IGT_EXIT_INVALID);
+		default:
+			if (!extra_opt_handler ||
+			    extra_opt_handler(c, index, handler_data) ==
+			    IGT_OPT_HANDLER_ERROR) {
+				usage(help_str);
+				exit(IGT_EXIT_INVALID);
+			}
+			break;
+		}
+	}
+
+	free(short_opts);
+	free(long_opts);
+
+	if (bench.max_samples < bench.min_samples)
+		bench.max_samples = bench.min_samples;
+
+	setup_cpus();
+}
+
+/**
+ * igt_bench_set_defaults:
+ * @warmup: default warm-up time, in seconds
+ * @sample_time: default duration of timed samples, in seconds
+ * @samples: default number of samples, or 0 to sample until the target
+ *  error is reached
+ *
+ * Changes the defaults of --warmup, --sample-time and -r, for benchmarks
+ * whose earlier results were taken with other settings and should stay
+ * comparable. The command line still overrides them. Must be called
+ * before igt_bench_init().
+ */
+void igt_bench_set_defaults(double warmup, double sample_time,
+			    unsigned int samples)
+{
+	defaults.warmup = warmup;
+	defaults.sample_time = sample_time;
+	defaults.samples = samples;
+}
+
+/**
+ * igt_bench_sample_time:
+ *
+ * Returns: The time in seconds a sample should run for, for benchmarks
+ * that repeat an operation over a period rather than timing it once.
+ */
+double igt_bench_sample_time(void)
+{
+	return bench.sample_time;
+}
+
+/**
+ * igt_bench_param:
+ * @key: The name of the parameter
+ * @fmt: printf-style format of its value
+ * @...: arguments for @fmt
+ *
+ * Records a parameter of the benchmark, such as the command line
+ * options it was given, to be reported along with the following runs.
+ * Setting a parameter again replaces its value.
+ */
+void igt_bench_param(const char *key, const char *fmt, ...)
+{
+	unsigned int i;
+	va_list args;
+	char *value;
+
+	va_start(args, fmt);
+	igt_assert(vasprintf(&value, fmt, args) >= 0);
+	va_end(args);
+
+	for (i = 0; i < bench.n_params; i++)
+		if (!strcmp(bench.params[i].key, key))
+			break;
+
+	if (i == bench.n_params) {
+		igt_assert(i < MAX_PARAMS);
+		bench.params[i].key = strdup(key);
+		bench.n_params++;
+	} else {
+		free(bench.params[i].value);
+	}
+	bench.params[i].value = value;
+}
+
+/* Two-sided 95% quantiles of Student's t distribution */
+static double t95(unsigned int df)
+{
+	static const double table[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+		2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+		2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+	const double z = 1.959964;
+
+	if (!df)
+		return INFINITY;
+
+	if (df <= ARRAY_SIZE(table))
+		return table[df - 1];
+
+	/* Cornish-Fisher expansion, within 1e-3 past the table */
+	return z + (z * z * z + z) / (4 * df) +
+		(5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96. * df * df);
+}
+
+static void update_result(struct igt_bench_result *result)
+{
+	igt_stats_t *stats = &result->samples;
+	unsigned int n = stats->n_values;
+
+	result->mean = igt_stats_get_mean(stats);
+	result->stddev = n > 1 ? igt_stats_get_std_deviation(stats) : NAN;
+	result->ci95 = n > 1 ? t95(n - 1) * igt_stats_get_std_error(stats) : NAN;
+	result->converged = n > 1 && result->ci95 <=
+		bench.target_error * fabs(result->mean);
+}
+
+/**
+ * igt_bench_measure:
+ * @sample: The function measuring one sample
+ * @data: User data passed to @sample
+ * @result: Where to store the samples and their summary
+ *
+ * Calls @sample for the warm-up period first, then takes samples until
+ * the relative half-width of the 95% confidence interval of their mean
+ * is within the target error, or the maximum number of samples or
+ * sampling time is reached. At least the minimum number of samples is
+ * taken in any case.
+ */
+void igt_bench_measure(igt_bench_sample_t sample, void *data,
+		       struct igt_bench_result *result)
+{
+	struct timespec start = {};
+
+	memset(result, 0, sizeof(*result));
+	igt_stats_init_with_size(&result->samples, bench.min_samples);
+	result->min = INFINITY;
+	result->max = -INFINITY;
+
+	if (bench.warmup > 0) {
+		igt_nsec_elapsed(&start);
+		do
+			sample(data);
+		while (igt_nsec_elapsed(&start) < bench.warmup * 1e9);
+	}
+
+	memset(&start, 0, sizeof(start));
+	igt_nsec_elapsed(&start);
+	do {
+		double v = sample(data);
+
+		igt_stats_push_float(&result->samples, v);
+		result->min = fmin(result->min, v);
+		result->max = fmax(result->max, v);
+
+		if (result->samples.n_values < bench.min_samples)
+			continue;
+
+		update_result(result);
+		if (result->converged ||
+		    result->samples.n_values >= bench.max_samples ||
+		    igt_nsec_elapsed(&start) >= bench.max_time * 1e9)
+			break;
+	} while (true);
+}
+
+/**
+ * igt_bench_result_fini:
+ * @result: The result to release
+ */
+void igt_bench_result_fini(struct igt_bench_result *result)
+{
+	igt_stats_fini(&result->samples);
+}
+
+static void json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+static void json_number(FILE *f, double v)
+{
+	if (isfinite(v))
+		fprintf(f, "%.9g", v);
+	else
+		fprintf(f, "null");
+}
+
+static void json_key(FILE *f, const char *key, bool first)
+{
+	if (!first)
+		fputc(',', f);
+	json_string(f, key);
+	fputc(':', f);
+}
+
+static void json_environment(FILE *f)
+{
+	struct utsname uts;
+	char *governor;
+
+	fputc('{', f);
+	json_key(f, "kernel", true);
+	if (uname(&uts) == 0)
+		json_string(f, uts.release);
+	else
+		fprintf(f, "null");
+
+	json_key(f, "cpu", false);
+	if (bench.cpu >= 0)
+		fprintf(f, "%d", bench.cpu);
+	else
+		fprintf(f, "null");
+
+	json_key(f, "governor", false);
+	governor = get_governor();
+	if (governor)
+		json_string(f, governor);
+	else
+		fprintf(f, "null");
+	free(governor);
+	fputc('}', f);
+}
+
+static void report_json(FILE *f, const char *name, const char *unit,
+			unsigned int flags, struct igt_bench_result *result)
+{
+	igt_stats_t *stats = &result->samples;
+	double q1, q2, q3;
+
+	igt_stats_get_quartiles(stats, &q1, &q2, &q3);
+
+	fputc('{', f);
+	json_key(f, "program", true);
+	json_string(f, bench.program);
+	json_key(f, "name", false);
+	json_string(f, name);
+	json_key(f, "unit", false);
+	json_string(f, unit);
+	json_key(f, "lower_is_better", false);
+	fprintf(f, flags & IGT_BENCH_LOWER_IS_BETTER ? "true" : "false");
+
+	json_key(f, "params", false);
+	fputc('{', f);
+	for (unsigned int i = 0; i < bench.n_params; i++) {
+		json_key(f, bench.params[i].key, i == 0);
+		json_string(f, bench.params[i].value);
+	}
+	fputc('}', f);
+
+	json_key(f, "environment", false);
+	json_environment(f);
+
+	json_key(f, "config", false);
+	fputc('{', f);
+	json_key(f, "warmup", true);
+	json_number(f, bench.warmup);
+	json_key(f, "sample_time", false);
+	json_number(f, bench.sample_time);
+	json_key(f, "min_samples", false);
+	fprintf(f, "%u", bench.min_samples);
+	json_key(f, "max_samples", false);
+	fprintf(f, "%u", bench.max_samples);
+	json_key(f, "target_error", false);
+	json_number(f, bench.target_error);
+	json_key(f, "max_time", false);
+	json_number(f, bench.max_time);
+	fputc('}', f);
+
+	json_key(f, "summary", false);
+	fputc('{', f);
+	json_key(f, "n", true);
+	fprintf(f, "%u", stats->n_values);
+	json_key(f, "converged", false);
+	fprintf(f, result->converged ? "true" : "false");
+	json_key(f, "mean", false);
+	json_number(f, result->mean);
+	json_key(f, "stddev", false);
+	json_number(f, result->stddev);
+	json_key(f, "ci95", false);
+	json_number(f, result->ci95);
+	json_key(f, "min", false);
+	json_number(f, result->min);
+	json_key(f, "q1", false);
+	json_number(f, q1);
+	json_key(f, "median", false);
+	json_number(f, q2);
+	json_key(f, "q3", false);
+	json_number(f, q3);
+	json_key(f, "max", false);
+	json_number(f, result->max);
+	json_key(f, "iqm", false);
+	json_number(f, igt_stats_get_iqm(stats));
+	fputc('}', f);
+
+	json_key(f, "samples", false);
+	fputc('[', f);
+	for (unsigned int i = 0; i < stats->n_values; i++) {
+		if (i)
+			fputc(',', f);
+		json_number(f, stats->values_f[i]);
+	}
+	fputc(']', f);
+
+	fputs("}\n", f);
+	fflush(f);
+}
+
+/**
+ * igt_bench_report:
+ * @name: The name of the measurement
+ * @unit: The unit of the samples
+ * @flags: IGT_BENCH_LOWER_IS_BETTER if smaller values are better
+ * @result: The result of igt_bench_measure()
+ *
+ * Prints @result as selected on the command line, either as one line
+ * per sample followed by a summary on stderr, or as a JSON object.
+ */
+void igt_bench_report(const char *name, const char *unit, unsigned int flags,
+		      struct igt_bench_result *result)
+{
+	igt_stats_t *stats = &result->samples;
+
+	if (bench.json) {
+		report_json(bench.json, name, unit, flags, result);
+		return;
+	}
+
+	for (unsigned int i = 0; i < stats->n_values; i++)
+		printf("%7.3f\n", stats->values_f[i]);
+	fflush(stdout);
+
+	fprintf(stderr, "%s: %.3f ± %.3f %s (%u samples, median %.3f)%s\n",
+		name, result->mean, result->ci95, unit, stats->n_values,
+		igt_stats_get_median(stats),
+		result->converged || bench.max_samples == bench.min_samples ?
+		"" : ", not converged");
+}
+
+/**
+ * igt_bench_run:
+ * @name: The name of the measurement
+ * @unit: The unit of the samples
+ * @flags: IGT_BENCH_LOWER_IS_BETTER if smaller values are better
+ * @sample: The function measuring one sample
+ * @data: User data passed to @sample
+ *
+ * Measures and reports a benchmark with igt_bench_measure() and
+ * igt_bench_report().
+ *
+ * Returns: The exit status for the benchmark.
+ */
+int igt_bench_run(const char *name, const char *unit, unsigned int flags,
+		  igt_bench_sample_t sample, void *data)
+{
+	struct igt_bench_result result;
+
+	igt_bench_measure(sample, data, &result);
+	igt_bench_report(name, unit, flags, &result);
+	igt_bench_result_fini(&result);
+
+	return IGT_EXIT_SUCCESS;
+}
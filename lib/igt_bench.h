@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_BENCH_H__
+#define __IGT_BENCH_H__
+
+#include <stdbool.h>
+
+#include "igt_core.h"
+#include "igt_stats.h"
+
+/**
+ * igt_bench_sample_t:
+ * @data: The data passed to igt_bench_run()
+ *
+ * Measures one sample of a benchmark.
+ *
+ * Returns: The measured value, in the unit given to igt_bench_run().
+ */
+typedef double (*igt_bench_sample_t)(void *data);
+
+/**
+ * IGT_BENCH_LOWER_IS_BETTER:
+ *
+ * Flag for igt_bench_run() marking results where a smaller value is an
+ * improvement, such as latencies.
+ */
+#define IGT_BENCH_LOWER_IS_BETTER (1 << 0)
+
+/**
+ * igt_bench_result:
+ * @samples: The measured samples, in order
+ * @min: The smallest sample
+ * @max: The largest sample
+ * @mean: The mean of the samples
+ * @stddev: The sample standard deviation
+ * @ci95: Half-width of the 95% confidence interval of @mean
+ * @converged: Whether @ci95 reached the target relative error
+ *
+ * The outcome of igt_bench_measure(), to be released with
+ * igt_bench_result_fini().
+ */
+struct igt_bench_result {
+	igt_stats_t samples;
+	double min, max;
+	double mean, stddev, ci95;
+	bool converged;
+};
+
+void igt_bench_set_defaults(double warmup, double sample_time,
+			    unsigned int samples);
+void igt_bench_init(int argc, char **argv,
+		    const char *extra_short_opts,
+		    const struct option *extra_long_opts,
+		    const char *help_str,
+		    igt_opt_handler_t extra_opt_handler,
+		    void *handler_data);
+
+double igt_bench_sample_time(void);
+
+void igt_bench_param(const char *key, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+void igt_bench_measure(igt_bench_sample_t sample, void *data,
+		       struct igt_bench_result *result);
+void igt_bench_report(const char *name, const char *unit, unsigned int flags,
+		      struct igt_bench_result *result);
+void igt_bench_result_fini(struct igt_bench_result *result);
+
+int igt_bench_run(const char *name, const char *unit, unsigned int flags,
+		  igt_bench_sample_t sample, void *data);
+
+#endif /* __IGT_BENCH_H__ */
@@ -30,6 +30,7 @@
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <unistd.h>
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/client.h>
 #include <pthread.h>
@@ -38,6 +39,7 @@
 #include <cairo.h>
 
 #include "igt_chamelium.h"
+#include "igt_chamelium_stream.h"
 #include "igt_core.h"
 #include "igt_aux.h"
 #include "igt_edid.h"
@@ -46,6 +48,7 @@
 #include "igt_kms.h"
 #include "igt_pipe_crc.h"
 #include "igt_rc.h"
+#include "igt_x86.h"
 
 /**
  * SECTION:igt_chamelium
@@ -67,6 +70,7 @@
  * |[<!-- language="plain" -->
  *	[Chamelium]
  *	URL=http://chameleon:9992 # The URL used for connecting to the Chamelium's RPC server
+ *	VideoStream=true # Optional, transfer full screen dumps over the stream server
  *
  *	# The rest of the sections are used for defining connector mappings.
  *	# This is required so any tests using the Chamelium know which connector
@@ -130,15 +134,16 @@ struct chamelium {
 	struct igt_list_head edids;
 	struct chamelium_port ports[CHAMELIUM_MAX_PORTS];
 	int port_count;
+
+	/* Binary stream transport for full screen dumps, if enabled */
+	bool video_stream;
+	struct chamelium_stream *stream;
 };
 
 bool igt_chamelium_allow_fsm_handling = true;
 
 static struct chamelium *cleanup_instance;
 
-static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
-					  igt_crc_t *out);
-
 /**
  * chamelium_get_ports:
  * @chamelium: The Chamelium instance to use
@@ -1304,6 +1309,69 @@ static struct chamelium_frame_dump *frame_from_xml(struct chamelium *chamelium,
 	return ret;
 }
 
+/*
+ * Receive a full screen dump through the stream server, straight into the
+ * buffer of the returned frame dump, rather than as base64 in an XML-RPC
+ * response.
+ */
+static struct chamelium_frame_dump *
+chamelium_port_stream_pixels(struct chamelium *chamelium,
+			     struct chamelium_port *port)
+{
+	struct chamelium_stream_frame stream_frame = {};
+	struct chamelium_frame_dump *frame;
+	int w, h;
+	bool ok;
+
+	if (!chamelium->stream)
+		chamelium->stream = chamelium_stream_init();
+	if (!chamelium->stream) {
+		igt_debug("Stream server unavailable, using XML-RPC dumps\n");
+		chamelium->video_stream = false;
+		return NULL;
+	}
+
+	chamelium_port_get_resolution(chamelium, port, &w, &h);
+	stream_frame.capacity = (size_t) w * h * 3;
+	stream_frame.data = malloc(stream_frame.capacity);
+	igt_assert(stream_frame.data);
+
+	xmlrpc_DECREF(chamelium_rpc(chamelium, port, "StartCapturingVideo",
+				    "(innnn)", port->id));
+	chamelium->capturing_port = port;
+
+	ok = chamelium_stream_config_video(chamelium->stream, w, h) &&
+	     chamelium_stream_dump_realtime_video(chamelium->stream,
+						  CHAMELIUM_STREAM_REALTIME_STOP_WHEN_OVERFLOW);
+	if (ok) {
+		ok = chamelium_stream_receive_realtime_video(chamelium->stream,
+							     &stream_frame);
+		ok &= chamelium_stream_stop_realtime_video(chamelium->stream);
+	}
+
+	xmlrpc_DECREF(chamelium_rpc(chamelium, NULL, "StopCapturingVideo",
+				    "()"));
+
+	if (!ok) {
+		igt_debug("Stream dump failed, using XML-RPC dumps\n");
+		chamelium_stream_deinit(chamelium->stream);
+		chamelium->stream = NULL;
+		chamelium->video_stream = false;
+		free(stream_frame.data);
+		return NULL;
+	}
+
+	frame = malloc(sizeof(*frame));
+	igt_assert(frame);
+	frame->bgr = stream_frame.data;
+	frame->size = stream_frame.size;
+	frame->width = stream_frame.width;
+	frame->height = stream_frame.height;
+	frame->port = port;
+
+	return frame;
+}
+
 /**
  * chamelium_port_dump_pixels:
  * @chamelium: The Chamelium instance to use
@@ -1320,6 +1388,11 @@ static struct chamelium_frame_dump *frame_from_xml(struct chamelium *chamelium,
  * CRCs may not be reliable, this can be used as an alternative for figuring
  * out whether or not the correct images are being displayed on the screen.
  *
+ * When VideoStream is enabled in the Chamelium configuration, full screen
+ * dumps are transferred over the binary stream protocol instead of XML-RPC.
+ * Cropped dumps, CRCs and frames read back with
+ * #chamelium_read_captured_frame still go through XML-RPC.
+ *
  * The frame dump data returned by this function should be freed when the
  * caller is done with it using #chamelium_destroy_frame_dump.
  *
@@ -1342,6 +1415,12 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 	xmlrpc_value *res;
 	struct chamelium_frame_dump *frame;
 
+	if (chamelium->video_stream && !x && !y && !w && !h) {
+		frame = chamelium_port_stream_pixels(chamelium, port);
+		if (frame)
+			return frame;
+	}
+
 	res = chamelium_rpc(chamelium, port, "DumpPixels",
 			    (w && h) ? "(iiiii)" : "(innnn)",
 			    port->id, x, y, w, h);
@@ -1868,12 +1947,12 @@ static void compared_frames_dump(cairo_surface_t *reference,
 	igt_assert(reference && capture);
 
 	if (!reference_crc) {
-		chamelium_do_calculate_fb_crc(reference, &local_reference_crc);
+		chamelium_calculate_surface_crc(reference, &local_reference_crc);
 		reference_crc = &local_reference_crc;
 	}
 
 	if (!capture_crc) {
-		chamelium_do_calculate_fb_crc(reference, &local_capture_crc);
+		chamelium_calculate_surface_crc(reference, &local_capture_crc);
 		capture_crc = &local_capture_crc;
 	}
 
@@ -2045,7 +2124,7 @@ bool chamelium_frame_match_or_dump(struct chamelium *chamelium,
 		igt_assert(reference_crc);
 
 		/* Calculate the reference frame CRC. */
-		chamelium_do_calculate_fb_crc(reference, reference_crc);
+		chamelium_calculate_surface_crc(reference, reference_crc);
 
 		/* Get the captured frame CRC from the Chamelium. */
 		capture_crc = chamelium_get_crc_for_area(chamelium, port, 0, 0,
@@ -2190,53 +2269,194 @@ int chamelium_get_frame_limit(struct chamelium *chamelium,
 	return ret;
 }
 
-static uint32_t chamelium_xrgb_hash16(const unsigned char *buffer, int width,
-				      int height, int k, int m)
+/*
+ * The Chamelium CRC splits the frame into 4 interleaved pixel streams, pixel
+ * i going into stream i % 4 with weight i / 4 + 1, and hashes the weighted
+ * sum of each stream. All four sums are accumulated in a single pass, one
+ * group of 4 consecutive pixels at a time.
+ */
+static inline uint64_t xrgb_value(const unsigned char *pixel)
 {
-	unsigned char r, g, b;
-	uint64_t sum = 0;
-	uint64_t count = 0;
-	uint64_t value;
-	uint32_t hash;
-	int index;
-	int i;
+	return pixel[2] | (pixel[1] << 8) | (pixel[0] << 16);
+}
 
-	for (i=0; i < width * height; i++) {
-		if ((i % m) != k)
-			continue;
+static void xrgb_sum_groups_c(const unsigned char *buffer,
+			      size_t first, size_t last, uint64_t *sum)
+{
+	for (size_t g = first; g < last; g++) {
+		const unsigned char *pixel = buffer + 16 * g;
+
+		for (int k = 0; k < 4; k++)
+			sum[k] += (g + 1) * xrgb_value(pixel + 4 * k);
+	}
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
 
-		index = i * 4;
+#include <immintrin.h>
 
-		r = buffer[index + 2];
-		g = buffer[index + 1];
-		b = buffer[index + 0];
+static void xrgb_sum_groups_avx2(const unsigned char *buffer,
+				 size_t first, size_t last, uint64_t *sum)
+{
+	/* BGRX -> RGB0 in each 32b lane, i.e. xrgb_value() */
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1,
+						 10, 9, 8, -1, 14, 13, 12, -1,
+						 2, 1, 0, -1, 6, 5, 4, -1,
+						 10, 9, 8, -1, 14, 13, 12, -1);
+	const __m256i two = _mm256_set1_epi64x(2);
+	__m256i w0 = _mm256_set1_epi64x(first + 1);
+	__m256i w1 = _mm256_set1_epi64x(first + 2);
+	__m256i acc = _mm256_setzero_si256();
+	uint64_t tmp[4];
+	size_t g;
+
+	/* weights stay below 2^32 as frames are limited to INT_MAX pixels */
+	for (g = first; g + 2 <= last; g += 2) {
+		__m256i px, lo, hi;
+
+		px = _mm256_loadu_si256((const __m256i *)(buffer + 16 * g));
+		px = _mm256_shuffle_epi8(px, shuffle);
+		lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(px));
+		hi = _mm256_cvtepu32_epi64(_mm256_extracti128_si256(px, 1));
 
-		value = r | (g << 8) | (b << 16);
-		sum += ++count * value;
+		acc = _mm256_add_epi64(acc, _mm256_mul_epu32(lo, w0));
+		acc = _mm256_add_epi64(acc, _mm256_mul_epu32(hi, w1));
+
+		w0 = _mm256_add_epi64(w0, two);
+		w1 = _mm256_add_epi64(w1, two);
 	}
 
-	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+	_mm256_storeu_si256((__m256i *)tmp, acc);
+	for (int k = 0; k < 4; k++)
+		sum[k] += tmp[k];
+
+	xrgb_sum_groups_c(buffer, g, last, sum);
+}
+
+#pragma GCC pop_options
+
+static void (*resolve_xrgb_sum_groups(void))(const unsigned char *buffer,
+					       size_t first, size_t last,
+					       uint64_t *sum)
+{
+	if (igt_x86_features() & AVX2)
+		return xrgb_sum_groups_avx2;
+
+	return xrgb_sum_groups_c;
+}
+
+static void xrgb_sum_groups(const unsigned char *buffer,
+			    size_t first, size_t last, uint64_t *sum)
+	__attribute__((ifunc("resolve_xrgb_sum_groups")));
+
+#else
 
-	return hash;
+static void xrgb_sum_groups(const unsigned char *buffer,
+			    size_t first, size_t last, uint64_t *sum)
+{
+	xrgb_sum_groups_c(buffer, first, last, sum);
 }
 
-static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
-					  igt_crc_t *out)
+#endif
+
+/* Smallest band worth a thread of its own, in groups of 4 pixels */
+#define XRGB_BAND_MIN_GROUPS (1 << 16)
+#define XRGB_MAX_BANDS 16
+
+struct xrgb_band {
+	const unsigned char *buffer;
+	size_t first, last;
+	uint64_t sum[4];
+	pthread_t thread;
+	bool threaded;
+};
+
+static void *xrgb_band_work(void *data)
 {
-	unsigned char *buffer;
+	struct xrgb_band *band = data;
+
+	xrgb_sum_groups(band->buffer, band->first, band->last, band->sum);
+
+	return NULL;
+}
+
+static uint32_t xrgb_hash16(uint64_t sum)
+{
+	return ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+}
+
+/**
+ * chamelium_calculate_surface_crc:
+ * @fb_surface: The XRGB8888 image surface to calculate the CRC for
+ * @out: Where to store the calculated CRC
+ *
+ * Calculates the CRC of an image surface using the Chamelium's CRC algorithm.
+ * Large surfaces are split into horizontal bands which are summed up in
+ * parallel.
+ */
+void chamelium_calculate_surface_crc(cairo_surface_t *fb_surface,
+				     igt_crc_t *out)
+{
+	struct xrgb_band bands[XRGB_MAX_BANDS] = {};
+	const unsigned char *buffer;
+	uint64_t sum[4] = {};
+	size_t pixels, groups;
+	long cpus;
 	int n = 4;
-	int w, h;
-	int i, j;
+	int nbands;
+	int i, k;
 
 	buffer = cairo_image_surface_get_data(fb_surface);
-	w = cairo_image_surface_get_width(fb_surface);
-	h = cairo_image_surface_get_height(fb_surface);
+	pixels = (size_t)cairo_image_surface_get_width(fb_surface) *
+		 cairo_image_surface_get_height(fb_surface);
+	groups = pixels / 4;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nbands = groups / XRGB_BAND_MIN_GROUPS;
+	if (nbands > cpus)
+		nbands = cpus;
+	if (nbands > XRGB_MAX_BANDS)
+		nbands = XRGB_MAX_BANDS;
+	if (nbands < 1)
+		nbands = 1;
+
+	for (i = 0; i < nbands; i++) {
+		bands[i].buffer = buffer;
+		bands[i].first = groups * i / nbands;
+		bands[i].last = groups * (i + 1) / nbands;
+
+		if (i)
+			bands[i].threaded =
+				!pthread_create(&bands[i].thread, NULL,
+						xrgb_band_work, &bands[i]);
+	}
+
+	/* The first band is done here, as are bands without a thread */
+	for (i = 0; i < nbands; i++) {
+		if (bands[i].threaded)
+			continue;
 
-	for (i = 0; i < n; i++) {
-		j = n - i - 1;
-		out->crc[i] = chamelium_xrgb_hash16(buffer, w, h, j, n);
+		xrgb_band_work(&bands[i]);
 	}
 
+	/* The sums are linear, so bands simply add up modulo 2^64 */
+	for (i = 0; i < nbands; i++) {
+		if (bands[i].threaded)
+			pthread_join(bands[i].thread, NULL);
+
+		for (k = 0; k < n; k++)
+			sum[k] += bands[i].sum[k];
+	}
+
+	/* Trailing pixels of a partial group */
+	for (k = 0; k < (int)(pixels % 4); k++)
+		sum[k] += (groups + 1) * xrgb_value(buffer + 16 * groups + 4 * k);
+
+	for (i = 0; i < n; i++)
+		out->crc[i] = xrgb_hash16(sum[n - i - 1]);
+
 	out->n_words = n;
 }
 
@@ -2258,7 +2478,7 @@ igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb)
 	/* Get the cairo surface for the framebuffer */
 	fb_surface = igt_get_cairo_surface(fd, fb);
 
-	chamelium_do_calculate_fb_crc(fb_surface, ret);
+	chamelium_calculate_surface_crc(fb_surface, ret);
 
 	cairo_surface_destroy(fb_surface);
 
@@ -2271,7 +2491,7 @@ static void *chamelium_calculate_fb_crc_async_work(void *data)
 
 	fb_crc = (struct chamelium_fb_crc_async_data *) data;
 
-	chamelium_do_calculate_fb_crc(fb_crc->fb_surface, fb_crc->ret);
+	chamelium_calculate_surface_crc(fb_crc->fb_surface, fb_crc->ret);
 
 	return NULL;
 }
@@ -2820,6 +3040,10 @@ static bool chamelium_read_config(struct chamelium *chamelium)
 		return false;
 	}
 
+	chamelium->video_stream = g_key_file_get_boolean(igt_key_file,
+							 "Chamelium",
+							 "VideoStream", NULL);
+
 	return true;
 }
 
@@ -2853,6 +3077,8 @@ static void chamelium_exit_handler(int sig)
  */
 void chamelium_deinit_rpc_only(struct chamelium *chamelium)
 {
+	if (chamelium->stream)
+		chamelium_stream_deinit(chamelium->stream);
 	xmlrpc_env_clean(&chamelium->env);
 	free(chamelium);
 }
@@ -232,6 +232,8 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 							struct chamelium_port *port,
 							int x, int y,
 							int w, int h);
+void chamelium_calculate_surface_crc(cairo_surface_t *fb_surface,
+				     igt_crc_t *out);
 igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb);
 struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int fd,
 									   struct igt_fb *fb);
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include "igt_chamelium_stream.h"
 #include "igt_core.h"
@@ -41,6 +42,12 @@
 #define STREAM_VERSION_MAJOR 1
 #define STREAM_VERSION_MINOR 0
 
+/*
+ * Socket receive buffer used while streaming video, deep enough for the
+ * server to push the next frame while the current one is being processed.
+ */
+#define STREAM_VIDEO_RCVBUF (8 << 20)
+
 enum stream_error {
 	STREAM_ERROR_NONE = 0,
 	STREAM_ERROR_COMMAND = 1,
@@ -414,57 +421,118 @@ bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
 }
 
 /**
- * chamelium_stream_receive_realtime_audio:
- * @page_count: if non-NULL, will be set to the dumped page number
- * @buf: must either point to a dynamically allocated memory region or NULL
- * @buf_len: number of elements of *@buf, for zero if @buf is NULL
- *
- * Receives one audio page from the streaming server.
- *
- * In "best effort" mode, some pages can be dropped. This can be detected via
- * the page count.
- *
- * buf_len will be set to the size of the page. The caller is responsible for
- * calling free(3) on *buf.
+ * Read the header of the next data message of a real-time dump, skipping the
+ * notifications of data dropped after an overflow.
  */
-bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
-					     size_t *page_count,
-					     int32_t **buf, size_t *buf_len)
+static bool chamelium_stream_read_data_header(struct chamelium_stream *client,
+					      enum stream_message_type want,
+					      enum stream_error dropped,
+					      size_t *body_len)
 {
 	enum stream_message_kind kind;
 	enum stream_message_type type;
 	enum stream_error err;
-	size_t body_len;
-	char page_count_buf[4];
-	int32_t *ptr;
 
 	while (true) {
 		if (!chamelium_stream_read_header(client, &kind, &type,
-						  &err, &body_len))
+						  &err, body_len))
 			return false;
 
 		if (kind != STREAM_MESSAGE_DATA) {
 			igt_warn("Expected a data message, got kind %d\n", kind);
 			return false;
 		}
-		if (type != STREAM_MESSAGE_DUMP_REALTIME_AUDIO) {
-			igt_warn("Expected real-time audio dump message, "
-				 "got type %d\n", type);
+		if (type != want) {
+			igt_warn("Expected real-time dump message type %d, "
+				 "got type %d\n", want, type);
 			return false;
 		}
 
 		if (err == STREAM_ERROR_NONE)
-			break;
-		else if (err != STREAM_ERROR_AUDIO_MEM_OVERFLOW_DROP) {
+			return true;
+		else if (err != dropped) {
 			igt_warn("Received error: %s (%d)\n",
 				 stream_error_str(err), err);
 			return false;
 		}
 
-		igt_debug("Dropped an audio page because of an overflow\n");
-		igt_assert(body_len == 0);
+		igt_debug("Overflow: %s\n", stream_error_str(err));
+		igt_assert(*body_len == 0);
+	}
+}
+
+/**
+ * Stop a real-time dump, discarding the data messages still in flight until
+ * the response arrives.
+ */
+static bool chamelium_stream_stop_dump(struct chamelium_stream *client,
+				       enum stream_message_type stop)
+{
+	enum stream_message_kind kind;
+	enum stream_message_type type;
+	enum stream_error err;
+	size_t len;
+
+	if (!chamelium_stream_write_request(client, stop, NULL, 0))
+		return false;
+
+	while (true) {
+		if (!chamelium_stream_read_header(client, &kind, &type,
+						  &err, &len))
+			return false;
+
+		if (kind == STREAM_MESSAGE_RESPONSE)
+			break;
+
+		if (!read_and_discard(client->fd, len))
+			return false;
+	}
+
+	if (type != stop) {
+		igt_warn("Unexpected response type %d\n", type);
+		return false;
+	}
+	if (err != STREAM_ERROR_NONE) {
+		igt_warn("Received error: %s (%d)\n",
+			 stream_error_str(err), err);
+		return false;
+	}
+	if (len != 0) {
+		igt_warn("Expected an empty response, got %zu bytes\n", len);
+		return false;
 	}
 
+	return true;
+}
+
+/**
+ * chamelium_stream_receive_realtime_audio:
+ * @page_count: if non-NULL, will be set to the dumped page number
+ * @buf: must either point to a dynamically allocated memory region or NULL
+ * @buf_len: number of elements of *@buf, for zero if @buf is NULL
+ *
+ * Receives one audio page from the streaming server.
+ *
+ * In "best effort" mode, some pages can be dropped. This can be detected via
+ * the page count.
+ *
+ * buf_len will be set to the size of the page. The caller is responsible for
+ * calling free(3) on *buf.
+ */
+bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
+					     size_t *page_count,
+					     int32_t **buf, size_t *buf_len)
+{
+	size_t body_len;
+	char page_count_buf[4];
+	int32_t *ptr;
+
+	if (!chamelium_stream_read_data_header(client,
+					       STREAM_MESSAGE_DUMP_REALTIME_AUDIO,
+					       STREAM_ERROR_AUDIO_MEM_OVERFLOW_DROP,
+					       &body_len))
+		return false;
+
 	igt_assert(body_len >= sizeof(page_count_buf));
 
 	if (!read_whole(client->fd, page_count_buf, sizeof(page_count_buf)))
@@ -496,60 +564,140 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
  */
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 {
-	enum stream_message_kind kind;
-	enum stream_message_type type;
-	enum stream_error err;
-	size_t len;
-
 	igt_debug("Stopping real-time audio capture\n");
 
-	if (!chamelium_stream_write_request(client,
-					    STREAM_MESSAGE_STOP_DUMP_AUDIO,
-					    NULL, 0))
+	return chamelium_stream_stop_dump(client,
+					  STREAM_MESSAGE_STOP_DUMP_AUDIO);
+}
+
+/**
+ * chamelium_stream_config_video:
+ * @width: The width of the captured screen
+ * @height: The height of the captured screen
+ *
+ * Sets the resolution of the video frames sent by the streaming server. This
+ * has to match the resolution of the captured port.
+ */
+bool chamelium_stream_config_video(struct chamelium_stream *client,
+				   int width, int height)
+{
+	int rcvbuf = STREAM_VIDEO_RCVBUF;
+	char req[4];
+
+	igt_debug("Configuring video stream for %dx%d\n", width, height);
+
+	*(uint16_t *) &req[0] = htons(width);
+	*(uint16_t *) &req[2] = htons(height);
+	if (!chamelium_stream_call(client, STREAM_MESSAGE_VIDEO_STREAM,
+				   req, sizeof(req), NULL, 0))
 		return false;
 
-	while (true) {
-		if (!chamelium_stream_read_header(client, &kind, &type,
-						  &err, &len))
-			return false;
+	/* Best effort, the kernel caps it to net.core.rmem_max anyway */
+	setsockopt(client->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
 
-		if (kind == STREAM_MESSAGE_RESPONSE)
-			break;
+	return true;
+}
 
-		if (!read_and_discard(client->fd, len))
-			return false;
-	}
+/**
+ * chamelium_stream_dump_realtime_video:
+ *
+ * Starts streaming the captured video frames. The caller can then call
+ * #chamelium_stream_receive_realtime_video to receive them. The server keeps
+ * sending frames while the previous ones are being processed, so a caller
+ * going through frames one by one doesn't wait for each of them to be
+ * requested and transferred.
+ */
+bool chamelium_stream_dump_realtime_video(struct chamelium_stream *client,
+					  enum chamelium_stream_realtime_mode mode)
+{
+	char req[2];
 
-	if (type != STREAM_MESSAGE_STOP_DUMP_AUDIO) {
-		igt_warn("Unexpected response type %d\n", type);
-		return false;
-	}
-	if (err != STREAM_ERROR_NONE) {
-		igt_warn("Received error: %s (%d)\n",
-			 stream_error_str(err), err);
+	igt_debug("Starting real-time video capture\n");
+
+	req[0] = 0; /* single channel */
+	req[1] = mode;
+	return chamelium_stream_call(client, STREAM_MESSAGE_DUMP_REALTIME_VIDEO,
+				     req, sizeof(req), NULL, 0);
+}
+
+/**
+ * chamelium_stream_receive_realtime_video:
+ * @frame: The frame to receive into
+ *
+ * Receives one video frame from the streaming server. The pixels are read
+ * from the socket straight into @frame->data, which is only reallocated when
+ * it is smaller than the frame. Preallocating it, or reusing the same @frame
+ * for consecutive frames, avoids any allocation or copy on the way.
+ *
+ * In "best effort" mode, some frames can be dropped. This can be detected via
+ * the frame number.
+ *
+ * The caller is responsible for calling free(3) on @frame->data.
+ */
+bool chamelium_stream_receive_realtime_video(struct chamelium_stream *client,
+					     struct chamelium_stream_frame *frame)
+{
+	size_t body_len;
+	char header[12];
+	unsigned char *ptr;
+
+	if (!chamelium_stream_read_data_header(client,
+					       STREAM_MESSAGE_DUMP_REALTIME_VIDEO,
+					       STREAM_ERROR_VIDEO_MEM_OVERFLOW_DROP,
+					       &body_len))
 		return false;
-	}
-	if (len != 0) {
-		igt_warn("Expected an empty response, got %zu bytes\n", len);
+
+	/*
+	 * The frame header is laid out as follows:
+	 * - u32: frame number
+	 * - u16: width
+	 * - u16: height
+	 * - u8: channel
+	 * - 3 bytes of padding
+	 */
+	igt_assert(body_len >= sizeof(header));
+
+	if (!read_whole(client->fd, header, sizeof(header)))
 		return false;
+	frame->frame_number = ntohl(*(uint32_t *) &header[0]);
+	frame->width = ntohs(*(uint16_t *) &header[4]);
+	frame->height = ntohs(*(uint16_t *) &header[6]);
+	frame->channel = header[8];
+	body_len -= sizeof(header);
+
+	igt_assert(body_len == (size_t) frame->width * frame->height * 3);
+	if (frame->capacity < body_len) {
+		ptr = realloc(frame->data, body_len);
+		if (!ptr) {
+			igt_warn("realloc failed: %s\n", strerror(errno));
+			return false;
+		}
+		frame->data = ptr;
+		frame->capacity = body_len;
 	}
+	frame->size = body_len;
 
-	return true;
+	return read_whole(client->fd, frame->data, body_len);
 }
 
 /**
- * chamelium_stream_init:
+ * chamelium_stream_stop_realtime_video:
  *
- * Connects to the Chamelium streaming server.
+ * Stops real-time video capture. This also drops any frames still in flight.
+ * The caller shouldn't call #chamelium_stream_receive_realtime_video after
+ * stopping video capture.
  */
-struct chamelium_stream *chamelium_stream_init(void)
+bool chamelium_stream_stop_realtime_video(struct chamelium_stream *client)
 {
-	struct chamelium_stream *client;
+	igt_debug("Stopping real-time video capture\n");
 
-	client = calloc(1, sizeof(*client));
+	return chamelium_stream_stop_dump(client,
+					  STREAM_MESSAGE_STOP_DUMP_VIDEO);
+}
 
-	if (!chamelium_stream_read_config(client))
-		goto error_client;
+static struct chamelium_stream *
+chamelium_stream_open(struct chamelium_stream *client)
+{
 	if (!chamelium_stream_connect(client))
 		goto error_client;
 	if (!chamelium_stream_check_version(client))
@@ -560,13 +708,57 @@ struct chamelium_stream *chamelium_stream_init(void)
 error_fd:
 	close(client->fd);
 error_client:
+	free(client->host);
 	free(client);
 	return NULL;
 }
 
+/**
+ * chamelium_stream_init:
+ *
+ * Connects to the Chamelium streaming server.
+ */
+struct chamelium_stream *chamelium_stream_init(void)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+
+	if (!chamelium_stream_read_config(client)) {
+		free(client->host);
+		free(client);
+		return NULL;
+	}
+
+	return chamelium_stream_open(client);
+}
+
+/**
+ * chamelium_stream_init_at:
+ * @host: The host name or address of the streaming server
+ * @port: The TCP port of the streaming server
+ *
+ * Connects to a streaming server at the given address instead of the one of
+ * the configured Chamelium, e.g. to a local server.
+ */
+struct chamelium_stream *chamelium_stream_init_at(const char *host,
+						  unsigned int port)
+{
+	struct chamelium_stream *client;
+
+	client = calloc(1, sizeof(*client));
+	igt_assert(client);
+	client->host = strdup(host);
+	igt_assert(client->host);
+	client->port = port;
+
+	return chamelium_stream_open(client);
+}
+
 void chamelium_stream_deinit(struct chamelium_stream *client)
 {
 	if (close(client->fd) != 0)
 		igt_warn("close failed: %s\n", strerror(errno));
+	free(client->host);
 	free(client);
 }
@@ -28,6 +28,10 @@
 
 #include "config.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 enum chamelium_stream_realtime_mode {
 	CHAMELIUM_STREAM_REALTIME_NONE = 0,
 	/* stop dumping when overflow */
@@ -38,7 +42,21 @@ enum chamelium_stream_realtime_mode {
 
 struct chamelium_stream;
 
+struct chamelium_stream_frame {
+	uint32_t frame_number;
+	int width;
+	int height;
+	int channel;
+
+	/* 24bpp pixels, see chamelium_stream_receive_realtime_video() */
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+};
+
 struct chamelium_stream *chamelium_stream_init(void);
+struct chamelium_stream *chamelium_stream_init_at(const char *host,
+						  unsigned int port);
 void chamelium_stream_deinit(struct chamelium_stream *client);
 bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
 					  enum chamelium_stream_realtime_mode mode);
@@ -46,5 +64,12 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 					     size_t *page_count,
 					     int32_t **buf, size_t *buf_len);
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client);
+bool chamelium_stream_config_video(struct chamelium_stream *client,
+				   int width, int height);
+bool chamelium_stream_dump_realtime_video(struct chamelium_stream *client,
+					  enum chamelium_stream_realtime_mode mode);
+bool chamelium_stream_receive_realtime_video(struct chamelium_stream *client,
+					     struct chamelium_stream_frame *frame);
+bool chamelium_stream_stop_realtime_video(struct chamelium_stream *client);
 
 #endif
@@ -487,38 +487,64 @@ static void igt_device_add_prop(struct igt_device *dev,
 	g_hash_table_insert(dev->props_ht, strdup(key), strdup(value));
 }
 
-static void igt_device_add_attr(struct igt_device *dev,
-				const char *key, const char *value)
+/* Sysattrs are only recorded by name during the scan, the value is left
+ * NULL and resolved on first lookup by get_attr().
+ */
+static void igt_device_add_attr(struct igt_device *dev, const char *key)
 {
-	char linkto[PATH_MAX];
-	const char *v = value;
-
 	if (!key)
 		return;
 
-	/* It's possible we have symlink at key filename, but udev
-	 * library resolves only few of them
-	 */
-	if (!v) {
-		struct stat st;
-		char path[PATH_MAX];
-		int len;
-
-		snprintf(path, sizeof(path), "%s/%s", dev->syspath, key);
-		if (lstat(path, &st) != 0)
-			return;
-
-		len = readlink(path, linkto, sizeof(linkto));
-		if (len <= 0 || len == (ssize_t) sizeof(linkto))
-			return;
-		linkto[len] = '\0';
-		v = strrchr(linkto, '/');
+	g_hash_table_insert(dev->attrs_ht, strdup(key), NULL);
+}
+
+/* Read sysattr value the way udev does - trailing newline is stripped.
+ * It's possible we have symlink at key filename, but udev library resolves
+ * only few of them, so for any symlink we return last path component.
+ */
+static char *read_sysattr(const char *syspath, const char *key)
+{
+	char path[PATH_MAX];
+	char buf[4096];
+	struct stat st;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", syspath, key);
+	if (lstat(path, &st) != 0)
+		return NULL;
+
+	if (S_ISLNK(st.st_mode)) {
+		char *v;
+
+		len = readlink(path, buf, sizeof(buf));
+		if (len <= 0 || len == (ssize_t) sizeof(buf))
+			return NULL;
+		buf[len] = '\0';
+		v = strrchr(buf, '/');
 		if (v == NULL)
-			return;
-		v++;
+			return NULL;
+
+		return strdup(v + 1);
 	}
 
-	g_hash_table_insert(dev->attrs_ht, strdup(key), strdup(v));
+	if (!S_ISREG(st.st_mode))
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len < 0)
+		return NULL;
+
+	while (len > 0 && buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+
+	return strdup(buf);
 }
 
 /* Iterate over udev properties list and rewrite it to igt_device properties
@@ -539,8 +565,8 @@ static void get_props(struct udev_device *dev, struct igt_device *idev)
 	}
 }
 
-/* Same as get_props(), but rewrites sysattrs. Resolves symbolic links
- * not handled by udev get_sysattr_value().
+/* Same as get_props(), but collects sysattr names only. Values are read
+ * lazily in get_attr() as most of them are never looked at.
  * Function skips sysattrs from blacklist ht (acquiring some values can take
  * seconds).
  */
@@ -551,32 +577,68 @@ static void get_attrs(struct udev_device *dev, struct igt_device *idev)
 	entry = udev_device_get_sysattr_list_entry(dev);
 	while (entry) {
 		const char *key = udev_list_entry_get_name(entry);
-		const char *value;
 
-		if (is_on_blacklist(key)) {
-			entry = udev_list_entry_get_next(entry);
-			continue;
-		}
+		if (!is_on_blacklist(key))
+			igt_device_add_attr(idev, key);
 
-		value = udev_device_get_sysattr_value(dev, key);
-		igt_device_add_attr(idev, key, value);
 		entry = udev_list_entry_get_next(entry);
-		DBG("attr: %s, val: %s\n", key, value);
+		DBG("attr: %s\n", key);
+	}
+}
+
+/* Resolve sysattr value on first access. Attributes which cannot be read
+ * are dropped from the hash table, as they would be by the eager scan.
+ */
+static const char *get_attr(struct igt_device *dev, const char *attr)
+{
+	gpointer key, value;
+
+	if (!g_hash_table_lookup_extended(dev->attrs_ht, attr, &key, &value))
+		return NULL;
+
+	if (value)
+		return value;
+
+	value = read_sysattr(dev->syspath, attr);
+	DBG("attr: %s, val: %s\n", attr, (char *) value);
+	if (value)
+		g_hash_table_replace(dev->attrs_ht, strdup(attr), value);
+	else
+		g_hash_table_remove(dev->attrs_ht, attr);
+
+	return value;
+}
+
+static void get_all_attrs(struct igt_device *dev)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, dev->attrs_ht);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (value)
+			continue;
+
+		value = read_sysattr(dev->syspath, key);
+		if (value)
+			g_hash_table_iter_replace(&iter, value);
+		else
+			g_hash_table_iter_remove(&iter);
 	}
 }
 
 #define get_prop(dev, prop) ((char *) g_hash_table_lookup(dev->props_ht, prop))
-#define get_attr(dev, attr) ((char *) g_hash_table_lookup(dev->attrs_ht, attr))
 #define get_prop_subsystem(dev) get_prop(dev, "SUBSYSTEM")
 #define is_drm_subsystem(dev)  (strequal(get_prop_subsystem(dev), "drm"))
 #define is_pci_subsystem(dev)  (strequal(get_prop_subsystem(dev), "pci"))
 
 static void print_ht(GHashTable *ht);
-static void dump_props_and_attrs(const struct igt_device *dev)
+static void dump_props_and_attrs(struct igt_device *dev)
 {
 	printf("\n[properties]\n");
 	print_ht(dev->props_ht);
 	printf("\n[attributes]\n");
+	get_all_attrs(dev);
 	print_ht(dev->attrs_ht);
 	printf("\n");
 }
@@ -631,34 +693,22 @@ static char* strdup_nullsafe(const char* str)
 	return strdup(str);
 }
 
-/* Create new igt_device from udev device.
- * Fills structure with most usable udev device variables, properties
- * and sysattrs.
+/* Fill the fields derived from devnode and properties, common for devices
+ * coming from udev and from the scan cache.
  */
-static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
+static bool igt_device_fill_fields(struct igt_device *idev)
 {
-	struct igt_device *idev = igt_device_new();
-
-	igt_assert(idev);
-	idev->syspath = strdup_nullsafe(udev_device_get_syspath(dev));
-	idev->subsystem = strdup_nullsafe(udev_device_get_subsystem(dev));
-	idev->devnode = strdup_nullsafe(udev_device_get_devnode(dev));
-
 	if (idev->devnode && strstr(idev->devnode, "/dev/dri/card"))
 		idev->drm_card = strdup(idev->devnode);
 	else if (idev->devnode && strstr(idev->devnode, "/dev/dri/render"))
 		idev->drm_render = strdup(idev->devnode);
 
-	get_props(dev, idev);
-	get_attrs(dev, idev);
-
 	if (is_pci_subsystem(idev)) {
 		uint16_t vendor, device;
 
-		if (!set_vendor_device(idev) || !set_pci_slot_name(idev)) {
-			igt_device_free(idev);
-			return NULL;
-		}
+		if (!set_vendor_device(idev) || !set_pci_slot_name(idev))
+			return false;
+
 		get_pci_vendor_device(idev, &vendor, &device);
 		idev->codename = __pci_codename(vendor, device);
 		idev->dev_type = __pci_devtype(vendor, device, idev->pci_slot_name);
@@ -666,6 +716,30 @@ static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
 		igt_assert(idev->driver);
 	}
 
+	return true;
+}
+
+/* Create new igt_device from udev device.
+ * Fills structure with most usable udev device variables, properties
+ * and sysattr names.
+ */
+static struct igt_device *igt_device_new_from_udev(struct udev_device *dev)
+{
+	struct igt_device *idev = igt_device_new();
+
+	igt_assert(idev);
+	idev->syspath = strdup_nullsafe(udev_device_get_syspath(dev));
+	idev->subsystem = strdup_nullsafe(udev_device_get_subsystem(dev));
+	idev->devnode = strdup_nullsafe(udev_device_get_devnode(dev));
+
+	get_props(dev, idev);
+	get_attrs(dev, idev);
+
+	if (!igt_device_fill_fields(idev)) {
+		igt_device_free(idev);
+		return NULL;
+	}
+
 	return idev;
 }
 
@@ -985,6 +1059,20 @@ static void index_pci_devices(void)
 	}
 }
 
+/* Sort devices for predictable search and prepare initial filtered view */
+static void finish_scan(void)
+{
+	struct igt_device *dev;
+
+	sort_all_devices();
+	index_pci_devices();
+
+	igt_list_for_each_entry(dev, &igt_devs.all, link) {
+		struct igt_device *dev_dup = duplicate_device(dev);
+		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
+	}
+}
+
 /* Core scanning function.
  *
  * All scanned devices are kept inside igt_devs.all pointer array.
@@ -1001,7 +1089,6 @@ static void scan_drm_devices(void)
 	struct udev *udev;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices, *dev_list_entry;
-	struct igt_device *dev;
 	int ret;
 
 	udev = udev_new();
@@ -1040,13 +1127,284 @@ static void scan_drm_devices(void)
 	udev_enumerate_unref(enumerate);
 	udev_unref(udev);
 
-	sort_all_devices();
-	index_pci_devices();
+	finish_scan();
+}
 
+/*
+ * Scan cache.
+ *
+ * Text file with one record per line. Devices are written in igt_devs.all
+ * order, drm devices refer to their parent by its index, which may come
+ * after them. Cache stays valid as long as mtimes of all stamped paths
+ * (DRM_DEV_DIR, or /dev when it doesn't exist, and syspath of each device)
+ * match. Only sysattr names are stored, values are still read
+ * lazily from sysfs.
+ *
+ *   igt-device-scan-cache <version>
+ *   stamp <mtime sec> <mtime nsec> <path>
+ *   device <parent index or -1> <subsystem> <syspath>
+ *   devnode <path>
+ *   prop <key>=<value>
+ *   attr <key>
+ */
+#define SCAN_CACHE_MAGIC "igt-device-scan-cache"
+#define SCAN_CACHE_VERSION 1
+#define DRM_DEV_DIR "/dev/dri"
+
+static bool get_mtime(const char *path, struct timespec *ts)
+{
+	struct stat st;
+
+	if (stat(path, &st))
+		return false;
+
+	*ts = st.st_mtim;
+
+	return true;
+}
+
+static bool write_stamp(FILE *f, const char *path)
+{
+	struct timespec ts;
+
+	if (!get_mtime(path, &ts))
+		return false;
+
+	fprintf(f, "stamp %ld %ld %s\n", (long) ts.tv_sec, ts.tv_nsec, path);
+
+	return true;
+}
+
+static bool check_stamp(const char *line)
+{
+	struct timespec ts;
+	long sec, nsec;
+	int pos;
+
+	if (sscanf(line, "%ld %ld %n", &sec, &nsec, &pos) != 2)
+		return false;
+
+	if (!get_mtime(line + pos, &ts))
+		return false;
+
+	return ts.tv_sec == sec && ts.tv_nsec == nsec;
+}
+
+static int device_index(struct igt_device *dev)
+{
+	struct igt_device *iter;
+	int idx = 0;
+
+	igt_list_for_each_entry(iter, &igt_devs.all, link) {
+		if (iter == dev)
+			return idx;
+		idx++;
+	}
+
+	return -1;
+}
+
+static bool has_newline(const char *str)
+{
+	return str && strchr(str, '\n');
+}
+
+static bool write_device(FILE *f, struct igt_device *dev)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (!dev->subsystem || !dev->syspath || has_newline(dev->syspath) ||
+	    has_newline(dev->devnode))
+		return false;
+
+	fprintf(f, "device %d %s %s\n",
+		dev->parent ? device_index(dev->parent) : -1,
+		dev->subsystem, dev->syspath);
+
+	if (dev->devnode)
+		fprintf(f, "devnode %s\n", dev->devnode);
+
+	g_hash_table_iter_init(&iter, dev->props_ht);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (has_newline(key) || has_newline(value))
+			return false;
+		fprintf(f, "prop %s=%s\n", (char *) key, (char *) value);
+	}
+
+	g_hash_table_iter_init(&iter, dev->attrs_ht);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		if (has_newline(key))
+			return false;
+		fprintf(f, "attr %s\n", (char *) key);
+	}
+
+	return true;
+}
+
+/* Write cache atomically, partially written file is never visible */
+static void save_scan_cache(const char *path)
+{
+	struct igt_device *dev;
+	char tmp[PATH_MAX];
+	bool ok = true;
+	FILE *f;
+	int fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int) sizeof(tmp))
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		return;
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	fprintf(f, "%s %d\n", SCAN_CACHE_MAGIC, SCAN_CACHE_VERSION);
+	/* Without DRM_DEV_DIR, its creation shows up in the mtime of /dev */
+	ok = write_stamp(f, DRM_DEV_DIR) || write_stamp(f, "/dev");
 	igt_list_for_each_entry(dev, &igt_devs.all, link) {
-		struct igt_device *dev_dup = duplicate_device(dev);
-		igt_list_add_tail(&dev_dup->link, &igt_devs.filtered);
+		if (!ok)
+			break;
+		ok = write_stamp(f, dev->syspath);
 	}
+
+	igt_list_for_each_entry(dev, &igt_devs.all, link) {
+		if (!ok)
+			break;
+		ok = write_device(f, dev);
+	}
+
+	if (fclose(f))
+		ok = false;
+
+	if (!ok || rename(tmp, path)) {
+		DBG("Cannot write scan cache %s\n", path);
+		unlink(tmp);
+	}
+}
+
+static void drop_cached_devices(struct igt_device **devs, int count)
+{
+	for (int i = 0; i < count; i++) {
+		igt_device_free(devs[i]);
+		free(devs[i]);
+	}
+	free(devs);
+}
+
+static bool load_scan_cache(const char *path)
+{
+	struct igt_device **devs = NULL, *idev = NULL;
+	int *parents = NULL;
+	int count = 0, version;
+	char *line = NULL;
+	size_t linesz = 0;
+	ssize_t len;
+	bool ok;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	ok = getline(&line, &linesz, f) > 0 &&
+	     sscanf(line, SCAN_CACHE_MAGIC " %d", &version) == 1 &&
+	     version == SCAN_CACHE_VERSION;
+
+	while (ok && (len = getline(&line, &linesz, f)) > 0) {
+		char *arg;
+
+		if (line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		arg = strchr(line, ' ');
+		if (!arg) {
+			ok = false;
+			break;
+		}
+		*arg++ = '\0';
+
+		if (!strcmp(line, "stamp")) {
+			ok = check_stamp(arg);
+		} else if (!strcmp(line, "device")) {
+			char subsystem[NAME_MAX + 1];
+			int parent, pos;
+
+			/* Parents may come later, they are resolved below */
+			if (sscanf(arg, "%d %255s %n", &parent, subsystem, &pos) != 2 ||
+			    parent < -1) {
+				ok = false;
+				break;
+			}
+
+			idev = igt_device_new();
+			igt_assert(idev);
+			idev->subsystem = strdup(subsystem);
+			idev->syspath = strdup(arg + pos);
+
+			devs = realloc(devs, (count + 1) * sizeof(*devs));
+			parents = realloc(parents, (count + 1) * sizeof(*parents));
+			igt_assert(devs && parents);
+			devs[count] = idev;
+			parents[count++] = parent;
+		} else if (!idev) {
+			ok = false;
+		} else if (!strcmp(line, "devnode")) {
+			free(idev->devnode);
+			idev->devnode = strdup(arg);
+		} else if (!strcmp(line, "prop")) {
+			char *value = strchr(arg, '=');
+
+			if (!value) {
+				ok = false;
+				break;
+			}
+			*value++ = '\0';
+			igt_device_add_prop(idev, arg, value);
+		} else if (!strcmp(line, "attr")) {
+			igt_device_add_attr(idev, arg);
+		} else {
+			ok = false;
+		}
+	}
+	free(line);
+	fclose(f);
+
+	for (int i = 0; ok && i < count; i++) {
+		ok = igt_device_fill_fields(devs[i]) &&
+		     parents[i] < count && parents[i] != i;
+		if (ok && parents[i] >= 0) {
+			struct igt_device *parent = devs[parents[i]];
+			const char *devname = devs[i]->devnode;
+
+			devs[i]->parent = parent;
+			if (devname && strstr(devname, "/dev/dri/card"))
+				parent->drm_card = strdup(devname);
+			else if (devname && strstr(devname, "/dev/dri/render"))
+				parent->drm_render = strdup(devname);
+		}
+	}
+	free(parents);
+
+	if (!ok || !count) {
+		DBG("Scan cache %s is stale or invalid\n", path);
+		drop_cached_devices(devs, count);
+		return false;
+	}
+
+	for (int i = 0; i < count; i++)
+		igt_list_add_tail(&devs[i]->link, &igt_devs.all);
+	free(devs);
+
+	finish_scan();
+
+	return true;
 }
 
 static void igt_device_free(struct igt_device *dev)
@@ -1090,9 +1448,17 @@ void igt_devices_free(void)
  * called with @force = false. If something changes during the the test
  * or test does some module loading (new drm devices occurs during execution)
  * function must be called again with @force = true to refresh device array.
+ *
+ * If IGT_DEVICE_SCAN_CACHE environment variable points to a file, the result
+ * of the udev scan is stored there and subsequent non-forced scans (also in
+ * other processes) reuse it as long as neither /dev/dri nor any of scanned
+ * device syspaths were modified. Forced scan always goes through udev and
+ * refreshes the cache.
  */
 void igt_devices_scan(bool force)
 {
+	const char *cache = getenv("IGT_DEVICE_SCAN_CACHE");
+
 	if (force && igt_devs.devs_scanned)
 		igt_devices_free();
 
@@ -1100,11 +1466,30 @@ void igt_devices_scan(bool force)
 		return;
 
 	prepare_scan();
-	scan_drm_devices();
+	if (!cache || force || !load_scan_cache(cache)) {
+		scan_drm_devices();
+		if (cache)
+			save_scan_cache(cache);
+	}
 
 	igt_devs.devs_scanned = true;
 }
 
+/**
+ * igt_devices_save_cache
+ *
+ * Writes the scanned devices to the file IGT_DEVICE_SCAN_CACHE points to,
+ * the same way igt_devices_scan() does after going through udev. Does nothing
+ * if the variable is not set or no scan was done yet.
+ */
+void igt_devices_save_cache(void)
+{
+	const char *cache = getenv("IGT_DEVICE_SCAN_CACHE");
+
+	if (cache && igt_devs.devs_scanned)
+		save_scan_cache(cache);
+}
+
 static inline void _pr_simple(const char *k, const char *v)
 {
 	printf("    %-16s: %s\n", k, v);
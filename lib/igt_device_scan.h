@@ -64,6 +64,7 @@ struct igt_device_card {
 };
 
 void igt_devices_scan(bool force);
+void igt_devices_save_cache(void);
 
 void igt_devices_print(const struct igt_devices_print_format *fmt);
 void igt_devices_print_vendors(void);
@@ -31,6 +31,7 @@
 #include <wchar.h>
 #include <inttypes.h>
 #include <pixman.h>
+#include <pthread.h>
 
 #include "drmtest.h"
 #include "i915/gem_create.h"
@@ -42,6 +43,7 @@
 #include "igt_fb.h"
 #include "igt_halffloat.h"
 #include "igt_kms.h"
+#include "igt_list.h"
 #include "igt_matrix.h"
 #include "igt_vc4.h"
 #include "igt_amd.h"
@@ -1062,12 +1064,11 @@ static void memset64(uint64_t *s, uint64_t c, size_t n)
 		s[i] = c;
 }
 
-static void clear_yuv_buffer(struct igt_fb *fb)
+static void __clear_yuv_buffer(struct igt_fb *fb, void *ptr)
 {
 	bool full_range = fb->color_range == IGT_COLOR_YCBCR_FULL_RANGE;
 	int num_planes = lookup_drm_format(fb->drm_format)->num_planes;
 	size_t plane_size[num_planes];
-	void *ptr;
 
 	igt_assert(igt_format_is_yuv(fb->drm_format));
 
@@ -1082,10 +1083,6 @@ static void clear_yuv_buffer(struct igt_fb *fb)
 			ALIGN(fb->plane_height[i], tile_height);
 	}
 
-	/* Ensure the framebuffer is preallocated */
-	ptr = igt_fb_map_buffer(fb->fd, fb);
-	igt_assert(*(uint32_t *)ptr == 0);
-
 	switch (fb->drm_format) {
 	case DRM_FORMAT_NV12:
 		memset(ptr + fb->offsets[0],
@@ -1158,6 +1155,17 @@ static void clear_yuv_buffer(struct igt_fb *fb)
 		       plane_size[2]);
 		break;
 	}
+}
+
+static void clear_yuv_buffer(struct igt_fb *fb)
+{
+	void *ptr;
+
+	/* Ensure the framebuffer is preallocated */
+	ptr = igt_fb_map_buffer(fb->fd, fb);
+	igt_assert(*(uint32_t *)ptr == 0);
+
+	__clear_yuv_buffer(fb, ptr);
 
 	igt_fb_unmap_buffer(fb, ptr);
 }
@@ -2170,6 +2178,9 @@ unsigned int igt_create_fb(int fd, int width, int height, uint32_t format,
  * Compared to igt_create_fb() this function also fills the entire framebuffer
  * with the given color, which is useful for some simple pipe crc based tests.
  *
+ * The contents are painted with igt_fb_fill_cached(), so they are only drawn
+ * once for all the framebuffers of the same size and format.
+ *
  * Returns:
  * The kms id of the created framebuffer on success or a negative error code on
  * failure.
@@ -2180,14 +2191,11 @@ unsigned int igt_create_color_fb(int fd, int width, int height,
 				 struct igt_fb *fb /* out */)
 {
 	unsigned int fb_id;
-	cairo_t *cr;
 
 	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
 	igt_assert(fb_id);
 
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_color(cr, 0, 0, width, height, r, g, b);
-	igt_put_cairo_ctx(cr);
+	igt_fb_fill_cached(fd, fb, IGT_FB_FILL_COLOR, r, g, b);
 
 	return fb_id;
 }
@@ -2208,6 +2216,9 @@ unsigned int igt_create_color_fb(int fd, int width, int height,
  * Compared to igt_create_fb() this function also draws the standard test pattern
  * into the framebuffer.
  *
+ * The contents are painted with igt_fb_fill_cached(), so they are only drawn
+ * once for all the framebuffers of the same size and format.
+ *
  * Returns:
  * The kms id of the created framebuffer on success or a negative error code on
  * failure.
@@ -2217,14 +2228,11 @@ unsigned int igt_create_pattern_fb(int fd, int width, int height,
 				   struct igt_fb *fb /* out */)
 {
 	unsigned int fb_id;
-	cairo_t *cr;
 
 	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
 	igt_assert(fb_id);
 
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_test_pattern(cr, width, height);
-	igt_put_cairo_ctx(cr);
+	igt_fb_fill_cached(fd, fb, IGT_FB_FILL_PATTERN, 0, 0, 0);
 
 	return fb_id;
 }
@@ -2249,6 +2257,9 @@ unsigned int igt_create_pattern_fb(int fd, int width, int height,
  * with the given color, and then draws the standard test pattern into the
  * framebuffer.
  *
+ * The contents are painted with igt_fb_fill_cached(), so they are only drawn
+ * once for all the framebuffers of the same size and format.
+ *
  * Returns:
  * The kms id of the created framebuffer on success or a negative error code on
  * failure.
@@ -2259,15 +2270,11 @@ unsigned int igt_create_color_pattern_fb(int fd, int width, int height,
 					 struct igt_fb *fb /* out */)
 {
 	unsigned int fb_id;
-	cairo_t *cr;
 
 	fb_id = igt_create_fb(fd, width, height, format, modifier, fb);
 	igt_assert(fb_id);
 
-	cr = igt_get_cairo_ctx(fd, fb);
-	igt_paint_color(cr, 0, 0, width, height, r, g, b);
-	igt_paint_test_pattern(cr, width, height);
-	igt_put_cairo_ctx(cr);
+	igt_fb_fill_cached(fd, fb, IGT_FB_FILL_COLOR_PATTERN, r, g, b);
 
 	return fb_id;
 }
@@ -2459,14 +2466,115 @@ struct fb_blit_linear {
 	uint8_t *map;
 };
 
+struct fb_rect {
+	int x, y, w, h;
+};
+
 struct fb_blit_upload {
 	int fd;
 	struct igt_fb *fb;
 	struct fb_blit_linear linear;
 	struct buf_ops *bops;
 	struct intel_bb *ibb;
+	/* The fb is overwritten as a whole, don't copy it to the linear bo */
+	bool discard;
+	/*
+	 * Area of the fb copied to the linear bo and back, in pixels of
+	 * the first plane. All of the fb unless the mapping was set up
+	 * with igt_get_cairo_ctx_rect().
+	 */
+	struct fb_rect damage;
 };
 
+static void fb_full_rect(const struct igt_fb *fb, struct fb_rect *rect)
+{
+	rect->x = 0;
+	rect->y = 0;
+	rect->w = fb->width;
+	rect->h = fb->height;
+}
+
+static bool fb_rect_is_full(const struct igt_fb *fb, const struct fb_rect *rect)
+{
+	return rect->x == 0 && rect->y == 0 &&
+	       rect->w == fb->width && rect->h == fb->height;
+}
+
+static bool fb_rect_contains(const struct fb_rect *a, const struct fb_rect *b)
+{
+	return b->x >= a->x && b->y >= a->y &&
+	       b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h;
+}
+
+static void fb_rect_union(struct fb_rect *a, const struct fb_rect *b)
+{
+	int x2 = max(a->x + a->w, b->x + b->w);
+	int y2 = max(a->y + a->h, b->y + b->h);
+
+	a->x = min(a->x, b->x);
+	a->y = min(a->y, b->y);
+	a->w = x2 - a->x;
+	a->h = y2 - a->y;
+}
+
+/*
+ * Clips @rect to @fb and grows it to whole chroma samples, so that it
+ * covers whole bytes of each plane. Formats packing several pixels in a
+ * byte are always handled as a whole.
+ */
+static void fb_rect_align(const struct igt_fb *fb, struct fb_rect *rect)
+{
+	const struct format_desc_struct *f = lookup_drm_format(fb->drm_format);
+	int hsub = max((int)f->hsub, 1), vsub = max((int)f->vsub, 1);
+	int x2, y2;
+
+	for (int i = 0; i < fb->num_planes; i++) {
+		if (fb->plane_bpp[i] % 8) {
+			fb_full_rect(fb, rect);
+			return;
+		}
+	}
+
+	x2 = min(rect->x + rect->w, (int)fb->width);
+	y2 = min(rect->y + rect->h, (int)fb->height);
+	rect->x = max(rect->x, 0);
+	rect->y = max(rect->y, 0);
+
+	if (x2 <= rect->x || y2 <= rect->y) {
+		memset(rect, 0, sizeof(*rect));
+		return;
+	}
+
+	rect->x = rect->x / hsub * hsub;
+	rect->y = rect->y / vsub * vsub;
+	rect->w = min(ALIGN(x2, hsub), (int)fb->width) - rect->x;
+	rect->h = min(ALIGN(y2, vsub), (int)fb->height) - rect->y;
+}
+
+/* The part of @plane covered by @rect, all of it if @rect is NULL */
+static void fb_plane_rect(const struct igt_fb *fb, int plane,
+			  const struct fb_rect *rect, struct fb_rect *r)
+{
+	const struct format_desc_struct *f = lookup_drm_format(fb->drm_format);
+	int hsub = plane ? max((int)f->hsub, 1) : 1;
+	int vsub = plane ? max((int)f->vsub, 1) : 1;
+
+	if (!rect) {
+		r->x = 0;
+		r->y = 0;
+		r->w = fb->plane_width[plane];
+		r->h = fb->plane_height[plane];
+		return;
+	}
+
+	r->x = rect->x / hsub;
+	r->y = rect->y / vsub;
+	r->w = min(DIV_ROUND_UP(rect->x + rect->w, hsub),
+		   (int)fb->plane_width[plane]) - r->x;
+	r->h = min(DIV_ROUND_UP(rect->y + rect->h, vsub),
+		   (int)fb->plane_height[plane]) - r->y;
+}
+
 static enum blt_tiling_type fb_tile_to_blt_tile(uint64_t tile)
 {
 	switch (igt_fb_mod_to_tiling(tile)) {
@@ -2710,14 +2818,19 @@ static bool use_vebox_copy(const struct igt_fb *src_fb,
  * - For GEN12 media compressed: vebox engine
  * - For uncompressed, pre-GEN12 compressed, GEN12+ render compressed: render engine
  * Note that both GEN12 engine is capable of reading either compression formats.
+ *
+ * The render engine copies only @rect, if given, of single plane surfaces.
+ * Otherwise the whole surface is copied.
  */
 static void copy_with_engine(struct fb_blit_upload *blit,
 			     const struct igt_fb *dst_fb,
-			     const struct igt_fb *src_fb)
+			     const struct igt_fb *src_fb,
+			     const struct fb_rect *rect)
 {
 	struct intel_buf *src, *dst;
 	igt_render_copyfunc_t render_copy = NULL;
 	igt_vebox_copyfunc_t vebox_copy = NULL;
+	struct fb_rect r;
 
 	if (use_vebox_copy(src_fb, dst_fb))
 		vebox_copy = igt_get_vebox_copyfunc(intel_get_drm_devid(blit->fd));
@@ -2729,6 +2842,12 @@ static void copy_with_engine(struct fb_blit_upload *blit,
 	igt_assert_eq(dst_fb->offsets[0], 0);
 	igt_assert_eq(src_fb->offsets[0], 0);
 
+	if (dst_fb->num_planes > 1 ||
+	    is_ccs_modifier(src_fb->modifier) ||
+	    is_ccs_modifier(dst_fb->modifier))
+		rect = NULL;
+	fb_plane_rect(dst_fb, 0, rect, &r);
+
 	src = create_buf(blit, src_fb, "cairo enginecopy src");
 	dst = create_buf(blit, dst_fb, "cairo enginecopy dst");
 
@@ -2739,10 +2858,10 @@ static void copy_with_engine(struct fb_blit_upload *blit,
 	else
 		render_copy(blit->ibb,
 			    src,
-			    0, 0,
-			    dst_fb->plane_width[0], dst_fb->plane_height[0],
+			    r.x, r.y,
+			    r.w, r.h,
 			    dst,
-			    0, 0);
+			    r.x, r.y);
 
 	fini_buf(dst);
 	fini_buf(src);
@@ -2846,8 +2965,14 @@ static uint32_t blt_compression_format(struct blt_copy_data *blt,
 	}
 }
 
+/*
+ * Copies @rect of @src_fb to @dst_fb, or all of it if @rect is NULL. Only
+ * the fast and XY_SRC copies are limited to @rect, compressed surfaces
+ * and block copies always copy whole planes.
+ */
 static void blitcopy(const struct igt_fb *dst_fb,
-		     const struct igt_fb *src_fb)
+		     const struct igt_fb *src_fb,
+		     const struct fb_rect *rect)
 {
 	uint32_t src_tiling, dst_tiling;
 	uint32_t ctx = 0;
@@ -2878,6 +3003,10 @@ static void blitcopy(const struct igt_fb *dst_fb,
 	src_tiling = igt_fb_mod_to_tiling(src_fb->modifier);
 	dst_tiling = igt_fb_mod_to_tiling(dst_fb->modifier);
 
+	if (is_ccs_modifier(src_fb->modifier) ||
+	    is_ccs_modifier(dst_fb->modifier))
+		rect = NULL;
+
 	if (is_i915 && !gem_has_relocations(dst_fb->fd)) {
 		igt_require(gem_has_contexts(dst_fb->fd));
 		mem_region = HAS_FLATCCS(intel_get_drm_devid(src_fb->fd))
@@ -2907,10 +3036,14 @@ static void blitcopy(const struct igt_fb *dst_fb,
 	}
 
 	for (int i = 0; i < dst_fb->num_planes - dst_cc; i++) {
+		struct fb_rect r;
+
 		igt_assert_eq(dst_fb->plane_bpp[i], src_fb->plane_bpp[i]);
 		igt_assert_eq(dst_fb->plane_width[i], src_fb->plane_width[i]);
 		igt_assert_eq(dst_fb->plane_height[i], src_fb->plane_height[i]);
 
+		fb_plane_rect(dst_fb, i, rect, &r);
+
 		if (is_xe) {
 			src = blt_fb_init(src_fb, i, mem_region);
 			dst = blt_fb_init(dst_fb, i, mem_region);
@@ -2947,16 +3080,15 @@ static void blitcopy(const struct igt_fb *dst_fb,
 						   src_fb->offsets[i],
 						   src_fb->strides[i],
 						   src_tiling,
-						   0, 0, /* src_x, src_y */
+						   r.x, r.y,
 						   src_fb->size,
-						   dst_fb->plane_width[i],
-						   dst_fb->plane_height[i],
+						   r.w, r.h,
 						   dst_fb->plane_bpp[i],
 						   dst_fb->gem_handle,
 						   dst_fb->offsets[i],
 						   dst_fb->strides[i],
 						   dst_tiling,
-						   0, 0 /* dst_x, dst_y */,
+						   r.x, r.y,
 						   dst_fb->size);
 		} else if (ahnd && block_copy_ok(src_fb) && block_copy_ok(dst_fb)) {
 			for_each_ctx_engine(src_fb->fd, ictx, e) {
@@ -2995,22 +3127,27 @@ static void blitcopy(const struct igt_fb *dst_fb,
 			blt_destroy_object(src_fb->fd, src);
 			blt_destroy_object(dst_fb->fd, dst);
 		} else {
+			/* 64bpp is copied as twice as many 32bpp pixels */
+			if (dst_fb->plane_bpp[i] == 64) {
+				r.x = 0;
+				r.w = dst_fb->plane_width[i];
+			}
+
 			igt_blitter_src_copy(dst_fb->fd,
 					     ahnd, ctx, NULL,
 					     src_fb->gem_handle,
 					     src_fb->offsets[i],
 					     src_fb->strides[i],
 					     src_tiling,
-					     0, 0, /* src_x, src_y */
+					     r.x, r.y,
 					     src_fb->size,
-					     dst_fb->plane_width[i],
-					     dst_fb->plane_height[i],
+					     r.w, r.h,
 					     dst_fb->plane_bpp[i],
 					     dst_fb->gem_handle,
 					     dst_fb->offsets[i],
 					     dst_fb->strides[i],
 					     dst_tiling,
-					     0, 0 /* dst_x, dst_y */,
+					     r.x, r.y,
 					     dst_fb->size);
 		}
 	}
@@ -3029,6 +3166,48 @@ static void blitcopy(const struct igt_fb *dst_fb,
 	intel_ctx_destroy(src_fb->fd, ictx);
 }
 
+/* True if only the damaged part of the fb is copied to and from the linear bo */
+static bool linear_mapping_has_damage(const struct fb_blit_upload *blit)
+{
+	const struct igt_fb *fb = blit->fb;
+
+	return (is_i915_device(blit->fd) || is_xe_device(blit->fd)) &&
+	       !igt_vc4_is_tiled(fb->modifier) &&
+	       !igt_amd_is_tiled(fb->modifier);
+}
+
+/*
+ * Copies @rect of the linear bo to the fb if @to_fb, or the other way
+ * around, for i915 and xe.
+ */
+static void linear_copy(struct fb_blit_upload *blit, bool to_fb,
+			const struct fb_rect *rect)
+{
+	struct igt_fb *fb = blit->fb, *linear = &blit->linear.fb;
+	struct igt_fb *dst = to_fb ? fb : linear;
+	struct igt_fb *src = to_fb ? linear : fb;
+
+	if (!rect->w || !rect->h)
+		return;
+
+	if (fb_rect_is_full(fb, rect))
+		rect = NULL;
+
+	if (is_xe_device(blit->fd)) {
+		blitcopy(dst, src, rect);
+		return;
+	}
+
+	gem_set_domain(blit->fd, linear->gem_handle, I915_GEM_DOMAIN_GTT, 0);
+
+	if (blit->ibb)
+		copy_with_engine(blit, dst, src, rect);
+	else
+		blitcopy(dst, src, rect);
+
+	gem_sync(blit->fd, linear->gem_handle);
+}
+
 static void free_linear_mapping(struct fb_blit_upload *blit)
 {
 	int fd = blit->fd;
@@ -3050,21 +3229,9 @@ static void free_linear_mapping(struct fb_blit_upload *blit)
 	} else if (is_nouveau_device(fd)) {
 		igt_nouveau_fb_blit(fb, &linear->fb);
 		igt_nouveau_delete_bo(&linear->fb);
-	} else if (is_xe_device(fd)) {
-		gem_munmap(linear->map, linear->fb.size);
-		blitcopy(fb, &linear->fb);
-		gem_close(fd, linear->fb.gem_handle);
 	} else {
 		gem_munmap(linear->map, linear->fb.size);
-		gem_set_domain(fd, linear->fb.gem_handle,
-			I915_GEM_DOMAIN_GTT, 0);
-
-		if (blit->ibb)
-			copy_with_engine(blit, fb, &linear->fb);
-		else
-			blitcopy(fb, &linear->fb);
-
-		gem_sync(fd, linear->fb.gem_handle);
+		linear_copy(blit, true, &blit->damage);
 		gem_close(fd, linear->fb.gem_handle);
 	}
 
@@ -3085,12 +3252,19 @@ static void destroy_cairo_surface__gpu(void *arg)
 	free(blit);
 }
 
+/*
+ * Sets up the linear copy of blit->damage of the fb. Drivers without
+ * partial copies get all of the fb.
+ */
 static void setup_linear_mapping(struct fb_blit_upload *blit)
 {
 	int fd = blit->fd;
 	struct igt_fb *fb = blit->fb;
 	struct fb_blit_linear *linear = &blit->linear;
 
+	if (!linear_mapping_has_damage(blit))
+		fb_full_rect(fb, &blit->damage);
+
 	if (!igt_vc4_is_tiled(fb->modifier) && use_enginecopy(fb)) {
 		blit->bops = buf_ops_create(fd);
 		blit->ibb = intel_bb_create(fd, 4096);
@@ -3117,7 +3291,9 @@ static void setup_linear_mapping(struct fb_blit_upload *blit)
 					      linear->fb.size,
 					      PROT_READ | PROT_WRITE);
 
-		vc4_fb_convert_plane_from_tiled(&linear->fb, &linear->map, fb, map);
+		if (!blit->discard)
+			vc4_fb_convert_plane_from_tiled(&linear->fb, &linear->map,
+							fb, map);
 
 		munmap(map, fb->size);
 	} else if (igt_amd_is_tiled(fb->modifier)) {
@@ -3128,25 +3304,20 @@ static void setup_linear_mapping(struct fb_blit_upload *blit)
 		/* Currently we also blit linear bos instead of mapping them as-is, as mmap() on
 		 * nouveau is quite slow right now
 		 */
-		igt_nouveau_fb_blit(&linear->fb, fb);
+		if (!blit->discard)
+			igt_nouveau_fb_blit(&linear->fb, fb);
 
 		linear->map = igt_nouveau_mmap_bo(&linear->fb, PROT_READ | PROT_WRITE);
 	} else if (is_xe_device(fd)) {
-		blitcopy(&linear->fb, fb);
+		if (!blit->discard)
+			linear_copy(blit, false, &blit->damage);
 
 		linear->map = xe_bo_mmap_ext(fd, linear->fb.gem_handle,
 					     linear->fb.size, PROT_READ | PROT_WRITE);
 	} else {
 		/* Copy fb content to linear BO */
-		gem_set_domain(fd, linear->fb.gem_handle,
-				I915_GEM_DOMAIN_GTT, 0);
-
-		if (blit->ibb)
-			copy_with_engine(blit, &linear->fb, fb);
-		else
-			blitcopy(&linear->fb, fb);
-
-		gem_sync(fd, linear->fb.gem_handle);
+		if (!blit->discard)
+			linear_copy(blit, false, &blit->damage);
 
 		gem_set_domain(fd, linear->fb.gem_handle,
 			I915_GEM_DOMAIN_CPU, I915_GEM_DOMAIN_CPU);
@@ -3157,7 +3328,8 @@ static void setup_linear_mapping(struct fb_blit_upload *blit)
 	}
 }
 
-static void create_cairo_surface__gpu(int fd, struct igt_fb *fb)
+static void create_cairo_surface__gpu(int fd, struct igt_fb *fb,
+				      const struct fb_rect *rect)
 {
 	struct fb_blit_upload *blit;
 	cairo_format_t cairo_format;
@@ -3167,6 +3339,7 @@ static void create_cairo_surface__gpu(int fd, struct igt_fb *fb)
 
 	blit->fd = fd;
 	blit->fb = fb;
+	blit->damage = *rect;
 	setup_linear_mapping(blit);
 
 	cairo_format = drm_format_to_cairo(fb->drm_format);
@@ -3275,6 +3448,7 @@ struct fb_convert_blit_upload {
 
 	struct igt_fb shadow_fb;
 	uint8_t *shadow_ptr;
+	bool slow_reads;
 };
 
 static void *igt_fb_create_cairo_shadow_buffer(int fd,
@@ -4326,23 +4500,74 @@ static void fb_convert(struct fb_convert *cvt)
 		     IGT_FORMAT_ARGS(cvt->dst.fb->drm_format));
 }
 
+/*
+ * Makes @view describe the part of @fb covered by @rect, with *@ptr
+ * moved to its first pixel, so that fb_convert() converts only @rect.
+ */
+static void fb_rect_view(const struct igt_fb *fb, const struct fb_rect *rect,
+			 struct igt_fb *view, void **ptr)
+{
+	uint32_t delta0 = 0;
+
+	*view = *fb;
+
+	for (int i = 0; i < fb->num_planes; i++) {
+		struct fb_rect r;
+		uint32_t delta;
+
+		fb_plane_rect(fb, i, rect, &r);
+		delta = r.y * fb->strides[i] + r.x * fb->plane_bpp[i] / 8;
+		if (i == 0)
+			delta0 = delta;
+
+		view->offsets[i] = fb->offsets[i] + delta - delta0;
+		view->plane_width[i] = r.w;
+		view->plane_height[i] = r.h;
+	}
+
+	view->width = rect->w;
+	view->height = rect->h;
+	view->size = fb->size - delta0;
+	*ptr = (uint8_t *)*ptr + delta0;
+}
+
+/* Converts @rect from the shadow to the fb if @to_fb, or the other way */
+static void convert_rect(struct fb_convert_blit_upload *blit, bool to_fb,
+			 const struct fb_rect *rect)
+{
+	struct igt_fb fb_view, shadow_view;
+	void *fb_ptr = blit->base.linear.map;
+	void *shadow_ptr = blit->shadow_ptr;
+	struct fb_convert cvt = { };
+
+	if (!rect->w || !rect->h)
+		return;
+
+	fb_rect_view(&blit->base.linear.fb, rect, &fb_view, &fb_ptr);
+	fb_rect_view(&blit->shadow_fb, rect, &shadow_view, &shadow_ptr);
+
+	if (to_fb) {
+		cvt.dst.ptr = fb_ptr;
+		cvt.dst.fb = &fb_view;
+		cvt.src.ptr = shadow_ptr;
+		cvt.src.fb = &shadow_view;
+	} else {
+		cvt.dst.ptr = shadow_ptr;
+		cvt.dst.fb = &shadow_view;
+		cvt.src.ptr = fb_ptr;
+		cvt.src.fb = &fb_view;
+		cvt.src.slow_reads = blit->slow_reads;
+	}
+
+	fb_convert(&cvt);
+}
+
 static void destroy_cairo_surface__convert(void *arg)
 {
 	struct fb_convert_blit_upload *blit = arg;
 	struct igt_fb *fb = blit->base.fb;
-	struct fb_convert cvt = {
-		.dst	= {
-			.ptr	= blit->base.linear.map,
-			.fb	= &blit->base.linear.fb,
-		},
-
-		.src	= {
-			.ptr	= blit->shadow_ptr,
-			.fb	= &blit->shadow_fb,
-		},
-	};
 
-	fb_convert(&cvt);
+	convert_rect(blit, true, &blit->base.damage);
 	igt_fb_destroy_cairo_shadow_buffer(&blit->shadow_fb, blit->shadow_ptr);
 
 	if (blit->base.linear.fb.gem_handle)
@@ -4355,10 +4580,10 @@ static void destroy_cairo_surface__convert(void *arg)
 	fb->cairo_surface = NULL;
 }
 
-static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
+static void create_cairo_surface__convert(int fd, struct igt_fb *fb,
+					  const struct fb_rect *rect)
 {
 	struct fb_convert_blit_upload *blit = calloc(1, sizeof(*blit));
-	struct fb_convert cvt = { };
 	const struct format_desc_struct *f = lookup_drm_format(fb->drm_format);
 	unsigned drm_format = cairo_format_to_drm_format(f->cairo_id);
 
@@ -4366,6 +4591,7 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 
 	blit->base.fd = fd;
 	blit->base.fb = fb;
+	blit->base.damage = *rect;
 
 	blit->shadow_ptr = igt_fb_create_cairo_shadow_buffer(fd, drm_format,
 							     fb->width,
@@ -4379,7 +4605,7 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 		setup_linear_mapping(&blit->base);
 
 		/* speed things up by working from a copy in system memory */
-		cvt.src.slow_reads = is_i915_device(fd) && !gem_has_mappable_ggtt(fd);
+		blit->slow_reads = is_i915_device(fd) && !gem_has_mappable_ggtt(fd);
 	} else {
 		blit->base.linear.fb = *fb;
 		blit->base.linear.fb.gem_handle = 0;
@@ -4387,14 +4613,10 @@ static void create_cairo_surface__convert(int fd, struct igt_fb *fb)
 		igt_assert(blit->base.linear.map);
 
 		/* reading via gtt mmap is slow */
-		cvt.src.slow_reads = is_i915_device(fd);
+		blit->slow_reads = is_i915_device(fd);
 	}
 
-	cvt.dst.ptr = blit->shadow_ptr;
-	cvt.dst.fb = &blit->shadow_fb;
-	cvt.src.ptr = blit->base.linear.map;
-	cvt.src.fb = &blit->base.linear.fb;
-	fb_convert(&cvt);
+	convert_rect(blit, false, &blit->base.damage);
 
 	fb->cairo_surface =
 		cairo_image_surface_create_for_data(blit->shadow_ptr,
@@ -4445,35 +4667,113 @@ static bool use_convert(const struct igt_fb *fb)
 	return f->convert;
 }
 
-/**
- * igt_get_cairo_surface:
- * @fd: open drm file descriptor
- * @fb: pointer to an #igt_fb structure
- *
- * This function stores the contents of the supplied framebuffer's plane
- * into a cairo surface and returns it.
- *
- * Returns:
- * A pointer to a cairo surface with the contents of the framebuffer.
+/*
+ * Grows the area of the fb backing the cairo surface of @fb to cover
+ * @rect: the area it covered so far is written back to the fb and the
+ * new one read in again. Surfaces mapping the fb directly cover all of
+ * it already.
  */
-cairo_surface_t *igt_get_cairo_surface(int fd, struct igt_fb *fb)
+static void fb_surface_add_damage(struct igt_fb *fb, const struct fb_rect *rect)
+{
+	struct fb_convert_blit_upload *cvt_blit;
+	struct fb_blit_upload *blit;
+	struct fb_rect damage;
+
+	cvt_blit = cairo_surface_get_user_data(fb->cairo_surface,
+					       (cairo_user_data_key_t *)create_cairo_surface__convert);
+	if (cvt_blit)
+		blit = &cvt_blit->base;
+	else
+		blit = cairo_surface_get_user_data(fb->cairo_surface,
+						   (cairo_user_data_key_t *)create_cairo_surface__gpu);
+
+	if (!blit || !rect->w || !rect->h ||
+	    fb_rect_contains(&blit->damage, rect))
+		return;
+
+	damage = *rect;
+	if (blit->damage.w && blit->damage.h)
+		fb_rect_union(&damage, &blit->damage);
+
+	cairo_surface_flush(fb->cairo_surface);
+
+	if (cvt_blit)
+		convert_rect(cvt_blit, true, &blit->damage);
+
+	if (blit->linear.fb.gem_handle) {
+		linear_copy(blit, true, &blit->damage);
+		linear_copy(blit, false, &damage);
+
+		if (!is_xe_device(blit->fd))
+			gem_set_domain(blit->fd, blit->linear.fb.gem_handle,
+				       I915_GEM_DOMAIN_CPU,
+				       I915_GEM_DOMAIN_CPU);
+	}
+
+	if (cvt_blit)
+		convert_rect(cvt_blit, false, &damage);
+
+	blit->damage = damage;
+
+	cairo_surface_mark_dirty(fb->cairo_surface);
+}
+
+static cairo_surface_t *__igt_get_cairo_surface(int fd, struct igt_fb *fb,
+						const struct fb_rect *rect)
 {
 	if (fb->cairo_surface == NULL) {
 		if (use_convert(fb))
-			create_cairo_surface__convert(fd, fb);
+			create_cairo_surface__convert(fd, fb, rect);
 		else if (use_blitter(fb) || use_enginecopy(fb) ||
 			 igt_vc4_is_tiled(fb->modifier) ||
 			 igt_amd_is_tiled(fb->modifier) ||
 			 is_nouveau_device(fb->fd))
-			create_cairo_surface__gpu(fd, fb);
+			create_cairo_surface__gpu(fd, fb, rect);
 		else
 			create_cairo_surface__gtt(fd, fb);
+	} else {
+		fb_surface_add_damage(fb, rect);
 	}
 
 	igt_assert(cairo_surface_status(fb->cairo_surface) == CAIRO_STATUS_SUCCESS);
 	return fb->cairo_surface;
 }
 
+/**
+ * igt_get_cairo_surface:
+ * @fd: open drm file descriptor
+ * @fb: pointer to an #igt_fb structure
+ *
+ * This function stores the contents of the supplied framebuffer's plane
+ * into a cairo surface and returns it.
+ *
+ * Returns:
+ * A pointer to a cairo surface with the contents of the framebuffer.
+ */
+cairo_surface_t *igt_get_cairo_surface(int fd, struct igt_fb *fb)
+{
+	struct fb_rect rect;
+
+	fb_full_rect(fb, &rect);
+
+	return __igt_get_cairo_surface(fd, fb, &rect);
+}
+
+static cairo_t *create_cairo_ctx(cairo_surface_t *surface)
+{
+	cairo_t *cr;
+
+	cr = cairo_create(surface);
+	cairo_surface_destroy(surface);
+	igt_assert(cairo_status(cr) == CAIRO_STATUS_SUCCESS);
+
+	cairo_select_font_face(cr, "Helvetica", CAIRO_FONT_SLANT_NORMAL,
+			       CAIRO_FONT_WEIGHT_NORMAL);
+	igt_assert(cairo_status(cr) == CAIRO_STATUS_SUCCESS);
+
+	return cr;
+}
+
 /**
  * igt_get_cairo_ctx:
  * @fd: open drm file descriptor
@@ -4489,17 +4789,42 @@ cairo_surface_t *igt_get_cairo_surface(int fd, struct igt_fb *fb)
  */
 cairo_t *igt_get_cairo_ctx(int fd, struct igt_fb *fb)
 {
-	cairo_surface_t *surface;
+	return create_cairo_ctx(igt_get_cairo_surface(fd, fb));
+}
+
+/**
+ * igt_get_cairo_ctx_rect:
+ * @fd: open drm file descriptor
+ * @fb: pointer to an #igt_fb structure
+ * @x: x coordinate of the area to draw to
+ * @y: y coordinate of the area to draw to
+ * @w: width of the area to draw to
+ * @h: height of the area to draw to
+ *
+ * Like igt_get_cairo_ctx(), but for drawing only to the given area of
+ * @fb: the context is clipped to it, and when the surface needs a
+ * conversion or a copy to the fb only that area, rounded up to whole
+ * chroma samples, is read from and written back to the fb. This makes
+ * small updates of large framebuffers much cheaper.
+ *
+ * If the cairo surface of @fb already exists for a smaller area, it is
+ * grown to cover both. igt_get_cairo_ctx() and igt_get_cairo_surface()
+ * grow it to all of @fb.
+ *
+ * Returns:
+ * The created cairo drawing context.
+ */
+cairo_t *igt_get_cairo_ctx_rect(int fd, struct igt_fb *fb,
+				int x, int y, int w, int h)
+{
+	struct fb_rect rect = { .x = x, .y = y, .w = w, .h = h };
 	cairo_t *cr;
 
-	surface = igt_get_cairo_surface(fd, fb);
-	cr = cairo_create(surface);
-	cairo_surface_destroy(surface);
-	igt_assert(cairo_status(cr) == CAIRO_STATUS_SUCCESS);
+	fb_rect_align(fb, &rect);
 
-	cairo_select_font_face(cr, "Helvetica", CAIRO_FONT_SLANT_NORMAL,
-			       CAIRO_FONT_WEIGHT_NORMAL);
-	igt_assert(cairo_status(cr) == CAIRO_STATUS_SUCCESS);
+	cr = create_cairo_ctx(__igt_get_cairo_surface(fd, fb, &rect));
+	cairo_rectangle(cr, x, y, w, h);
+	cairo_clip(cr);
 
 	return cr;
 }
@@ -4520,6 +4845,388 @@ void igt_put_cairo_ctx(cairo_t *cr)
 	cairo_destroy(cr);
 }
 
+/*
+ * Cache of the contents painted by igt_fb_fill_cached(), in the native
+ * format of the fb but without its layout: the visible rows of each
+ * plane are stored back to back, so a hit can be copied into an fb of
+ * any stride or modifier. Entries are kept in LRU order, most recent
+ * first, within a total size limit.
+ */
+#define FB_CACHE_DEFAULT_SIZE (256ull << 20)
+
+struct fb_cache_key {
+	int width, height;
+	uint32_t drm_format;
+	enum igt_color_encoding color_encoding;
+	enum igt_color_range color_range;
+	enum igt_fb_fill fill;
+	double r, g, b;
+};
+
+struct fb_cache_entry {
+	struct igt_list_head link;
+	struct fb_cache_key key;
+	uint32_t hash;
+	int num_planes;
+	size_t row_size[4];
+	unsigned int rows[4];
+	size_t size;
+	uint8_t data[];
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	struct igt_list_head lru;
+	struct igt_fb_cache_stats stats;
+	uint64_t max_size;
+	bool initialized;
+} fb_cache = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Called with the mutex held */
+static void fb_cache_init(void)
+{
+	const char *env;
+
+	if (fb_cache.initialized)
+		return;
+
+	IGT_INIT_LIST_HEAD(&fb_cache.lru);
+	fb_cache.max_size = FB_CACHE_DEFAULT_SIZE;
+
+	env = getenv("IGT_FB_CACHE_SIZE");
+	if (env)
+		fb_cache.max_size = strtoull(env, NULL, 0) << 20;
+
+	fb_cache.initialized = true;
+}
+
+static void fb_cache_evict(uint64_t max_size)
+{
+	struct fb_cache_entry *e, *tmp;
+
+	igt_list_for_each_entry_safe_reverse(e, tmp, &fb_cache.lru, link) {
+		if (fb_cache.stats.size <= max_size)
+			break;
+
+		igt_list_del(&e->link);
+		fb_cache.stats.size -= e->size;
+		fb_cache.stats.entries--;
+		fb_cache.stats.evictions++;
+		free(e);
+	}
+}
+
+static uint32_t fb_cache_hash(const struct fb_cache_key *key)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint32_t hash = 2166136261;
+
+	for (size_t i = 0; i < sizeof(*key); i++)
+		hash = (hash ^ p[i]) * 16777619;
+
+	return hash;
+}
+
+static void paint_fill(cairo_t *cr, const struct fb_cache_key *key)
+{
+	switch (key->fill) {
+	case IGT_FB_FILL_COLOR:
+		igt_paint_color(cr, 0, 0, key->width, key->height,
+				key->r, key->g, key->b);
+		break;
+	case IGT_FB_FILL_PATTERN:
+		igt_paint_test_pattern(cr, key->width, key->height);
+		break;
+	case IGT_FB_FILL_COLOR_PATTERN:
+		igt_paint_color(cr, 0, 0, key->width, key->height,
+				key->r, key->g, key->b);
+		igt_paint_test_pattern(cr, key->width, key->height);
+		break;
+	}
+}
+
+/*
+ * Paints the contents of a new fb described by key in system memory,
+ * starting from the cleared buffer create_bo_for_fb() would provide, and
+ * returns them as a cache entry.
+ */
+static struct fb_cache_entry *
+fb_cache_render(int fd, const struct fb_cache_key *key)
+{
+	const struct format_desc_struct *f = lookup_drm_format(key->drm_format);
+	struct fb_cache_entry *e;
+	cairo_surface_t *surface;
+	struct igt_fb sys, shadow;
+	uint8_t *ptr, *shadow_ptr = NULL;
+	size_t size = 0;
+	cairo_t *cr;
+
+	igt_init_fb(&sys, fd, key->width, key->height, key->drm_format,
+		    DRM_FORMAT_MOD_LINEAR, key->color_encoding,
+		    key->color_range);
+	sys.size = calc_fb_size(&sys);
+
+	ptr = mmap(NULL, sys.size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	igt_assert(ptr != MAP_FAILED);
+
+	if (igt_format_is_yuv(sys.drm_format))
+		__clear_yuv_buffer(&sys, ptr);
+
+	if (use_convert(&sys)) {
+		struct fb_convert cvt = {
+			.dst	= { .fb = &shadow },
+			.src	= { .ptr = ptr, .fb = &sys },
+		};
+
+		shadow_ptr = igt_fb_create_cairo_shadow_buffer(fd,
+							       cairo_format_to_drm_format(f->cairo_id),
+							       sys.width,
+							       sys.height,
+							       &shadow);
+		cvt.dst.ptr = shadow_ptr;
+		fb_convert(&cvt);
+
+		surface = cairo_image_surface_create_for_data(shadow_ptr,
+							      f->cairo_id,
+							      sys.width,
+							      sys.height,
+							      shadow.strides[0]);
+	} else {
+		surface = cairo_image_surface_create_for_data(ptr,
+							      drm_format_to_cairo(sys.drm_format),
+							      sys.width,
+							      sys.height,
+							      sys.strides[0]);
+	}
+	igt_assert(cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+
+	cr = cairo_create(surface);
+	cairo_select_font_face(cr, "Helvetica", CAIRO_FONT_SLANT_NORMAL,
+			       CAIRO_FONT_WEIGHT_NORMAL);
+	paint_fill(cr, key);
+	igt_put_cairo_ctx(cr);
+	cairo_surface_destroy(surface);
+
+	if (shadow_ptr) {
+		struct fb_convert cvt = {
+			.dst	= { .ptr = ptr, .fb = &sys },
+			.src	= { .ptr = shadow_ptr, .fb = &shadow },
+		};
+
+		fb_convert(&cvt);
+		igt_fb_destroy_cairo_shadow_buffer(&shadow, shadow_ptr);
+	}
+
+	for (int i = 0; i < sys.num_planes; i++)
+		size += (size_t)sys.plane_width[i] * sys.plane_bpp[i] / 8 *
+			sys.plane_height[i];
+
+	e = malloc(sizeof(*e) + size);
+	igt_assert(e);
+	e->key = *key;
+	e->hash = fb_cache_hash(key);
+	e->num_planes = sys.num_planes;
+	e->size = sizeof(*e) + size;
+
+	size = 0;
+	for (int i = 0; i < sys.num_planes; i++) {
+		e->row_size[i] = (size_t)sys.plane_width[i] * sys.plane_bpp[i] / 8;
+		e->rows[i] = sys.plane_height[i];
+
+		for (unsigned int y = 0; y < e->rows[i]; y++) {
+			memcpy(e->data + size,
+			       ptr + sys.offsets[i] + (size_t)y * sys.strides[i],
+			       e->row_size[i]);
+			size += e->row_size[i];
+		}
+	}
+
+	munmap(ptr, sys.size);
+
+	return e;
+}
+
+static void fb_cache_copy(struct igt_fb *fb, uint8_t *map,
+			  const struct fb_cache_entry *e)
+{
+	const uint8_t *src = e->data;
+
+	for (int i = 0; i < e->num_planes; i++) {
+		for (unsigned int y = 0; y < e->rows[i]; y++) {
+			memcpy(map + fb->offsets[i] + (size_t)y * fb->strides[i],
+			       src, e->row_size[i]);
+			src += e->row_size[i];
+		}
+	}
+}
+
+/*
+ * Writes the contents of e to fb, through the same linear bo and blit
+ * as a cairo surface of fb would use, without reading fb back first.
+ */
+static void fb_cache_upload(int fd, struct igt_fb *fb,
+			    const struct fb_cache_entry *e)
+{
+	if (use_blitter(fb) || use_enginecopy(fb) ||
+	    igt_vc4_is_tiled(fb->modifier) ||
+	    igt_amd_is_tiled(fb->modifier) ||
+	    is_nouveau_device(fd)) {
+		struct fb_blit_upload blit = {
+			.fd = fd,
+			.fb = fb,
+			.discard = true,
+		};
+
+		fb_full_rect(fb, &blit.damage);
+		setup_linear_mapping(&blit);
+		fb_cache_copy(&blit.linear.fb, blit.linear.map, e);
+		free_linear_mapping(&blit);
+	} else {
+		uint8_t *map = map_bo(fd, fb);
+
+		fb_cache_copy(fb, map, e);
+		unmap_bo(fb, map);
+	}
+
+	fb->domain = I915_GEM_DOMAIN_GTT;
+}
+
+/**
+ * igt_fb_fill_cached:
+ * @fd: open drm file descriptor
+ * @fb: pointer to an #igt_fb structure
+ * @fill: what to paint
+ * @r: red value of the fill color
+ * @g: green value of the fill color
+ * @b: blue value of the fill color
+ *
+ * Paints @fb as igt_create_color_fb(), igt_create_pattern_fb() or
+ * igt_create_color_pattern_fb() would, depending on @fill, replacing its
+ * contents. The color is ignored for #IGT_FB_FILL_PATTERN.
+ *
+ * The painted and converted pixels are kept in a cache keyed by the
+ * size, format, color encoding and range of @fb and by the fill, so
+ * further fbs with the same contents are only uploaded, whatever their
+ * modifier or stride. The cache holds up to 256 MiB by default, which
+ * the IGT_FB_CACHE_SIZE environment variable overrides in MiB, 0
+ * disabling it.
+ */
+void igt_fb_fill_cached(int fd, struct igt_fb *fb, enum igt_fb_fill fill,
+			double r, double g, double b)
+{
+	struct fb_cache_entry *e = NULL, *cur;
+	struct fb_cache_key key;
+	uint32_t hash;
+
+	/* Pending cairo drawing would overwrite the upload */
+	if (fb->cairo_surface) {
+		struct fb_cache_key k = {
+			.width = fb->width, .height = fb->height,
+			.fill = fill, .r = r, .g = g, .b = b,
+		};
+		cairo_t *cr = igt_get_cairo_ctx(fd, fb);
+
+		paint_fill(cr, &k);
+		igt_put_cairo_ctx(cr);
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.width = fb->width;
+	key.height = fb->height;
+	key.drm_format = fb->drm_format;
+	key.color_encoding = fb->color_encoding;
+	key.color_range = fb->color_range;
+	key.fill = fill;
+	if (fill != IGT_FB_FILL_PATTERN) {
+		key.r = r;
+		key.g = g;
+		key.b = b;
+	}
+	hash = fb_cache_hash(&key);
+
+	pthread_mutex_lock(&fb_cache.mutex);
+	fb_cache_init();
+	igt_list_for_each_entry(cur, &fb_cache.lru, link) {
+		if (cur->hash == hash && !memcmp(&cur->key, &key, sizeof(key))) {
+			e = cur;
+			break;
+		}
+	}
+
+	if (e) {
+		fb_cache.stats.hits++;
+		igt_list_move(&e->link, &fb_cache.lru);
+		fb_cache_upload(fd, fb, e);
+		pthread_mutex_unlock(&fb_cache.mutex);
+		return;
+	}
+
+	fb_cache.stats.misses++;
+	pthread_mutex_unlock(&fb_cache.mutex);
+
+	e = fb_cache_render(fd, &key);
+	fb_cache_upload(fd, fb, e);
+
+	pthread_mutex_lock(&fb_cache.mutex);
+	if (e->size > fb_cache.max_size) {
+		free(e);
+	} else {
+		fb_cache_evict(fb_cache.max_size - e->size);
+		igt_list_add(&e->link, &fb_cache.lru);
+		fb_cache.stats.size += e->size;
+		fb_cache.stats.entries++;
+	}
+	pthread_mutex_unlock(&fb_cache.mutex);
+}
+
+/**
+ * igt_fb_cache_get_stats:
+ * @stats: where to store the statistics
+ *
+ * Retrieves the hit and miss counts and the size of the cache used by
+ * igt_fb_fill_cached().
+ */
+void igt_fb_cache_get_stats(struct igt_fb_cache_stats *stats)
+{
+	pthread_mutex_lock(&fb_cache.mutex);
+	*stats = fb_cache.stats;
+	pthread_mutex_unlock(&fb_cache.mutex);
+}
+
+/**
+ * igt_fb_cache_set_size:
+ * @size: maximum size of the cache in bytes, 0 to disable it
+ *
+ * Limits the memory used by the cache of igt_fb_fill_cached(), evicting
+ * the least recently used contents as needed.
+ */
+void igt_fb_cache_set_size(uint64_t size)
+{
+	pthread_mutex_lock(&fb_cache.mutex);
+	fb_cache_init();
+	fb_cache.max_size = size;
+	fb_cache_evict(size);
+	pthread_mutex_unlock(&fb_cache.mutex);
+}
+
+/**
+ * igt_fb_cache_flush:
+ *
+ * Drops all the contents cached by igt_fb_fill_cached(). The statistics
+ * are kept.
+ */
+void igt_fb_cache_flush(void)
+{
+	pthread_mutex_lock(&fb_cache.mutex);
+	fb_cache_init();
+	fb_cache_evict(0);
+	pthread_mutex_unlock(&fb_cache.mutex);
+}
+
 /**
  * igt_remove_fb:
  * @fd: open drm file descriptor
@@ -123,6 +123,39 @@ enum igt_text_align {
 	align_hcenter	= 0x08,
 };
 
+/**
+ * igt_fb_fill:
+ * @IGT_FB_FILL_COLOR: a solid color, as igt_create_color_fb()
+ * @IGT_FB_FILL_PATTERN: the test pattern, as igt_create_pattern_fb()
+ * @IGT_FB_FILL_COLOR_PATTERN: the test pattern over a solid color, as
+ *  igt_create_color_pattern_fb()
+ *
+ * Contents painted by igt_fb_fill_cached().
+ */
+enum igt_fb_fill {
+	IGT_FB_FILL_COLOR,
+	IGT_FB_FILL_PATTERN,
+	IGT_FB_FILL_COLOR_PATTERN,
+};
+
+/**
+ * igt_fb_cache_stats:
+ * @hits: Fills copied from the cache
+ * @misses: Fills painted, and added to the cache if they fit
+ * @evictions: Contents dropped from the cache
+ * @entries: Contents currently cached
+ * @size: Memory currently used by the cache, in bytes
+ *
+ * Statistics of the cache of igt_fb_fill_cached().
+ */
+struct igt_fb_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t entries;
+	uint64_t size;
+};
+
 void igt_get_fb_tile_size(int fd, uint64_t modifier, int fb_bpp,
 			  unsigned *width_ret, unsigned *height_ret);
 void igt_calc_fb_size(int fd, int width, int height, uint32_t format, uint64_t modifier,
@@ -165,6 +198,11 @@ unsigned int igt_fb_convert_with_stride(struct igt_fb *dst, struct igt_fb *src,
 					unsigned int stride);
 unsigned int igt_fb_convert(struct igt_fb *dst, struct igt_fb *src,
 			    uint32_t dst_fourcc, uint64_t dst_modifier);
+void igt_fb_fill_cached(int fd, struct igt_fb *fb, enum igt_fb_fill fill,
+			double r, double g, double b);
+void igt_fb_cache_get_stats(struct igt_fb_cache_stats *stats);
+void igt_fb_cache_set_size(uint64_t size);
+void igt_fb_cache_flush(void);
 void igt_remove_fb(int fd, struct igt_fb *fb);
 int igt_dirty_fb(int fd, struct igt_fb *fb);
 void *igt_fb_map_buffer(int fd, struct igt_fb *fb);
@@ -190,6 +228,8 @@ int igt_fb_ccs_to_main_plane(const struct igt_fb *fb, int ccs_plane);
 cairo_surface_t *igt_get_cairo_surface(int fd, struct igt_fb *fb);
 cairo_surface_t *igt_cairo_image_surface_create_from_png(const char *filename);
 cairo_t *igt_get_cairo_ctx(int fd, struct igt_fb *fb);
+cairo_t *igt_get_cairo_ctx_rect(int fd, struct igt_fb *fb,
+				int x, int y, int w, int h);
 void igt_put_cairo_ctx(cairo_t *cr);
 void igt_paint_color(cairo_t *cr, int x, int y, int w, int h,
 			 double r, double g, double b);
@@ -31,6 +31,7 @@
 #include "igt_aux.h"
 #include "igt_core.h"
 #include "igt_kmod.h"
+#include "igt_kmsg.h"
 #include "igt_ktap.h"
 #include "igt_sysfs.h"
 #include "igt_taints.h"
@@ -645,44 +646,33 @@ igt_amdgpu_driver_unload(void)
 	return IGT_EXIT_SUCCESS;
 }
 
+static void kmsg_warn(const struct igt_kmsg_record *record, void *data)
+{
+	igt_warn("%.*s\n", (int)record->msg_len, record->msg);
+}
+
 static void kmsg_dump(int fd)
 {
-	char record[4096 + 1];
+	struct igt_kmsg kmsg;
+	int err;
 
 	if (fd == -1) {
 		igt_warn("Unable to retrieve kernel log (from /dev/kmsg)\n");
 		return;
 	}
 
-	record[sizeof(record) - 1] = '\0';
-
-	for (;;) {
-		const char *start, *end;
-		ssize_t r;
-
-		r = read(fd, record, sizeof(record) - 1);
-		if (r < 0) {
-			if (errno == EINTR)
-				continue;
-
-			if (errno == EPIPE) {
-				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-				continue;
-			}
-
-			if (errno != EAGAIN)
-				igt_warn("kmsg truncated: unknown error (%m)\n");
+	err = igt_kmsg_init_fd(&kmsg, fd);
+	if (!err)
+		err = igt_kmsg_subscribe(&kmsg, kmsg_warn, NULL);
+	if (!err)
+		err = igt_kmsg_drain(&kmsg);
 
-			break;
-		}
+	if (kmsg.lost)
+		igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
+	if (err < 0)
+		igt_warn("kmsg truncated: unknown error (%s)\n", strerror(-err));
 
-		start = strchr(record, ';');
-		if (start) {
-			start++;
-			end = strchrnul(start, '\n');
-			igt_warn("%.*s\n", (int)(end - start), start);
-		}
-	}
+	igt_kmsg_fini(&kmsg);
 }
 
 static void tests_add(struct igt_kselftest_list *tl, struct igt_list_head *list)
@@ -802,8 +792,7 @@ static void __igt_kunit(struct igt_ktest *tst, const char *opts)
 		igt_skip("Failed to create a modprobe thread\n");
 	}
 
-	while (READ_ONCE(results->still_running) || !igt_list_empty(&results->list))
-	{
+	while (!ktap_results_done(results)) {
 		struct ktap_test_results_element *result;
 
 		if (!pthread_tryjoin_np(modprobe_thread, NULL) && modprobe.err) {
@@ -817,16 +806,9 @@ static void __igt_kunit(struct igt_ktest *tst, const char *opts)
 			break;
 		}
 
-		pthread_mutex_lock(&results->mutex);
-		if (igt_list_empty(&results->list)) {
-			pthread_mutex_unlock(&results->mutex);
+		result = ktap_results_pop(results);
+		if (!result)
 			continue;
-		}
-
-		result = igt_list_first_entry(&results->list, result, link);
-
-		igt_list_del(&result->link);
-		pthread_mutex_unlock(&results->mutex);
 
 		igt_dynamic(result->test_name) {
 			igt_assert(READ_ONCE(result->passed));
@@ -52,6 +52,7 @@
 
 #include "drmtest.h"
 #include "igt_kms.h"
+#include "igt_kms_snapshot.h"
 #include "igt_aux.h"
 #include "igt_edid.h"
 #include "intel_chipset.h"
@@ -683,6 +684,28 @@ igt_plane_rotations(igt_display_t *display, igt_plane_t *plane,
 	return rotations;
 }
 
+/*
+ * Property definitions never change for the lifetime of the device, so serve
+ * them from the display snapshot when there is one.
+ */
+static drmModePropertyPtr
+igt_display_get_property(igt_display_t *display, uint32_t prop_id)
+{
+	drmModePropertyPtr prop;
+
+	if (display->snapshot) {
+		prop = igt_kms_snapshot_get_property(display->snapshot, prop_id);
+		if (prop)
+			return prop;
+	}
+
+	prop = drmModeGetProperty(display->drm_fd, prop_id);
+	if (prop && display->snapshot)
+		igt_kms_snapshot_add_property(display->snapshot, prop);
+
+	return prop;
+}
+
 /*
  * Retrieve all the properies specified in props_name and store them into
  * plane->props.
@@ -701,7 +724,7 @@ igt_fill_plane_props(igt_display_t *display, igt_plane_t *plane,
 
 	for (i = 0; i < props->count_props; i++) {
 		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+			igt_display_get_property(display, props->props[i]);
 
 		for (j = 0; j < num_props; j++) {
 			if (strcmp(prop->name, prop_names[j]) != 0)
@@ -741,7 +764,7 @@ igt_atomic_fill_connector_props(igt_display_t *display, igt_output_t *output,
 
 	for (i = 0; i < props->count_props; i++) {
 		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+			igt_display_get_property(display, props->props[i]);
 
 		for (j = 0; j < num_connector_props; j++) {
 			if (strcmp(prop->name, conn_prop_names[j]) != 0)
@@ -771,7 +794,7 @@ igt_fill_pipe_props(igt_display_t *display, igt_pipe_t *pipe,
 
 	for (i = 0; i < props->count_props; i++) {
 		drmModePropertyPtr prop =
-			drmModeGetProperty(fd, props->props[i]);
+			igt_display_get_property(display, props->props[i]);
 
 		for (j = 0; j < num_crtc_props; j++) {
 			if (strcmp(prop->name, crtc_prop_names[j]) != 0)
@@ -1468,6 +1491,8 @@ static bool force_connector(int drm_fd,
 		return false;
 	}
 
+	igt_kms_snapshot_invalidate();
+
 	igt_debug("Connector %s is now forced %s\n", name, value);
 
 	/* already tracked? */
@@ -1593,6 +1618,8 @@ void kmstest_force_edid(int drm_fd, drmModeConnector *connector,
 			    edid_get_size(edid));
 	close(debugfs_fd);
 
+	igt_kms_snapshot_invalidate();
+
 	/* To allow callers to always use GetConnectorCurrent we need to force a
 	 * redetection here. */
 	temp = drmModeGetConnector(drm_fd, connector->connector_id);
@@ -1780,6 +1807,55 @@ _kmstest_connector_config_find_encoder(int drm_fd, drmModeConnector *connector,
 	return NULL;
 }
 
+/*
+ * Only the result of the probe itself can be replayed. The encoder in use
+ * and the property values change with every modeset, so those are queried
+ * again, which never probes.
+ */
+static drmModeConnector *
+replay_connector(int drm_fd, uint32_t connector_id,
+		 struct igt_kms_snapshot *snap)
+{
+	drmModeConnector *connector, *current;
+
+	connector = igt_kms_snapshot_get_connector(snap, connector_id);
+	if (!connector)
+		return NULL;
+
+	current = drmModeGetConnectorCurrent(drm_fd, connector_id);
+	if (!current) {
+		drmModeFreeConnector(connector);
+		return NULL;
+	}
+
+	connector->encoder_id = current->encoder_id;
+	igt_swap(connector->count_props, current->count_props);
+	igt_swap(connector->props, current->props);
+	igt_swap(connector->prop_values, current->prop_values);
+	drmModeFreeConnector(current);
+
+	return connector;
+}
+
+static drmModeConnector *
+probe_connector(int drm_fd, uint32_t connector_id,
+		struct igt_kms_snapshot *snap)
+{
+	drmModeConnector *connector;
+
+	if (snap) {
+		connector = replay_connector(drm_fd, connector_id, snap);
+		if (connector)
+			return connector;
+	}
+
+	connector = drmModeGetConnector(drm_fd, connector_id);
+	if (connector && snap)
+		igt_kms_snapshot_record_connector(snap, drm_fd, connector);
+
+	return connector;
+}
+
 /**
  * _kmstest_connector_config:
  * @drm_fd: DRM fd
@@ -1787,14 +1863,18 @@ _kmstest_connector_config_find_encoder(int drm_fd, drmModeConnector *connector,
  * @crtc_idx_mask: mask of allowed DRM CRTC indices
  * @config: structure filled with the possible configuration
  * @probe: whether to fully re-probe mode list or not
+ * @snap: snapshot to serve the probe from, or NULL
  *
  * This tries to find a suitable configuration for the given connector and CRTC
- * constraint and fills it into @config.
+ * constraint and fills it into @config. When @probe is set and @snap holds an
+ * entry for the connector, the probe is served from @snap instead of the
+ * kernel.
  */
 static bool _kmstest_connector_config(int drm_fd, uint32_t connector_id,
 				      unsigned long crtc_idx_mask,
 				      struct kmstest_connector_config *config,
-				      bool probe)
+				      bool probe,
+				      struct igt_kms_snapshot *snap)
 {
 	drmModeRes *resources;
 	drmModeConnector *connector;
@@ -1810,7 +1890,7 @@ static bool _kmstest_connector_config(int drm_fd, uint32_t connector_id,
 
 	/* First, find the connector & mode */
 	if (probe)
-		connector = drmModeGetConnector(drm_fd, connector_id);
+		connector = probe_connector(drm_fd, connector_id, snap);
 	else
 		connector = drmModeGetConnectorCurrent(drm_fd, connector_id);
 
@@ -1891,7 +1971,7 @@ bool kmstest_get_connector_config(int drm_fd, uint32_t connector_id,
 				  struct kmstest_connector_config *config)
 {
 	return _kmstest_connector_config(drm_fd, connector_id, crtc_idx_mask,
-					 config, 0);
+					 config, 0, NULL);
 }
 
 drmModePropertyBlobPtr kmstest_get_path_blob(int drm_fd, uint32_t connector_id)
@@ -1926,7 +2006,7 @@ bool kmstest_probe_connector_config(int drm_fd, uint32_t connector_id,
 				    struct kmstest_connector_config *config)
 {
 	return _kmstest_connector_config(drm_fd, connector_id, crtc_idx_mask,
-					 config, 1);
+					 config, 1, NULL);
 }
 
 /**
@@ -2196,7 +2276,8 @@ static void igt_display_log_shift(igt_display_t *display, int shift)
 	igt_assert(display->log_shift >= 0);
 }
 
-void igt_output_refresh(igt_output_t *output)
+static void __igt_output_refresh(igt_output_t *output,
+				 struct igt_kms_snapshot *snap)
 {
 	igt_display_t *display = output->display;
 	unsigned long crtc_idx_mask = 0;
@@ -2207,7 +2288,7 @@ void igt_output_refresh(igt_output_t *output)
 	kmstest_free_connector_config(&output->config);
 
 	_kmstest_connector_config(display->drm_fd, output->id, crtc_idx_mask,
-				  &output->config, output->force_reprobe);
+				  &output->config, output->force_reprobe, snap);
 	output->force_reprobe = false;
 
 	if (!output->name && output->config.connector) {
@@ -2225,6 +2306,11 @@ void igt_output_refresh(igt_output_t *output)
 	    kmstest_pipe_name(output->pending_pipe));
 }
 
+void igt_output_refresh(igt_output_t *output)
+{
+	__igt_output_refresh(output, NULL);
+}
+
 static int
 igt_plane_set_property(igt_plane_t *plane, uint32_t prop_id, uint64_t value)
 {
@@ -2509,14 +2595,7 @@ static void igt_handle_spurious_hpd(igt_display_t *display)
 	dump_forced_connectors();
 }
 
-/**
- * igt_display_require:
- * @display: a pointer to an initialized #igt_display_t structure
- *
- * Initialize @display outputs with their connectors and pipes.
- * This function clears any previously allocated outputs.
- */
-void igt_display_reset_outputs(igt_display_t *display)
+static void __igt_display_reset_outputs(igt_display_t *display)
 {
 	int i;
 	drmModeRes *resources;
@@ -2563,10 +2642,12 @@ void igt_display_reset_outputs(igt_display_t *display)
 		    (!connector->count_modes ||
 		     connector->connection == DRM_MODE_UNKNOWNCONNECTION)) {
 			output->force_reprobe = true;
-			igt_output_refresh(output);
+			__igt_output_refresh(output, display->snapshot);
 		}
 	}
 
+	igt_kms_snapshot_sync();
+
 	/* Set reasonable default values for every object in the
 	 * display. */
 	igt_display_reset(display);
@@ -2611,6 +2692,21 @@ void igt_display_reset_outputs(igt_display_t *display)
 	drmModeFreeResources(resources);
 }
 
+/**
+ * igt_display_reset_outputs:
+ * @display: a pointer to an initialized #igt_display_t structure
+ *
+ * Initialize @display outputs with their connectors and pipes.
+ * This function clears any previously allocated outputs.
+ */
+void igt_display_reset_outputs(igt_display_t *display)
+{
+	/* Revalidate the snapshot, connectors may have changed since */
+	display->snapshot = igt_kms_snapshot_attach(display->drm_fd);
+
+	__igt_display_reset_outputs(display);
+}
+
 /**
  * igt_display_require:
  * @display: a pointer to an #igt_display_t structure
@@ -2660,6 +2756,9 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 	}
 #endif
 
+	/* Attached once, after chamelium had a chance to plug its ports */
+	display->snapshot = igt_kms_snapshot_attach(drm_fd);
+
 	display->n_pipes = IGT_MAX_PIPES;
 	display->pipes = calloc(sizeof(igt_pipe_t), display->n_pipes);
 	igt_assert_f(display->pipes, "Failed to allocate memory for %d pipes\n", display->n_pipes);
@@ -2814,7 +2913,7 @@ void igt_display_require(igt_display_t *display, int drm_fd)
 
 	igt_fill_display_format_mod(display);
 
-	igt_display_reset_outputs(display);
+	__igt_display_reset_outputs(display);
 
 out:
 	LOG_UNINDENT(display);
@@ -2970,6 +3069,14 @@ void igt_modeset_disable_all_outputs(igt_display_t *display)
 
 static void igt_pipe_fini(igt_pipe_t *pipe)
 {
+	for (int i = 0; i < pipe->n_planes; i++) {
+		igt_plane_t *plane = &pipe->planes[i];
+
+		free(plane->formats);
+		free(plane->modifiers);
+		free(plane->format_mod_sorted);
+	}
+
 	free(pipe->planes);
 	pipe->planes = NULL;
 
@@ -3020,6 +3127,14 @@ void igt_display_fini(igt_display_t *display)
 	display->pipes = NULL;
 	free(display->planes);
 	display->planes = NULL;
+
+	free(display->formats);
+	display->formats = NULL;
+	free(display->modifiers);
+	display->modifiers = NULL;
+	free(display->format_mod_sorted);
+	display->format_mod_sorted = NULL;
+	display->format_mod_count = 0;
 }
 
 static void igt_display_refresh(igt_display_t *display)
@@ -5193,9 +5308,14 @@ bool igt_hotplug_detected(struct udev_monitor *mon, int timeout_secs)
 {
 	const char *props[1] = {"HOTPLUG"};
 	int expected_val = 1;
+	bool detected;
 
-	return event_detected(mon, timeout_secs, props, &expected_val,
-			      ARRAY_SIZE(props));
+	detected = event_detected(mon, timeout_secs, props, &expected_val,
+				  ARRAY_SIZE(props));
+	if (detected)
+		igt_kms_snapshot_invalidate();
+
+	return detected;
 }
 
 /**
@@ -5295,6 +5415,118 @@ static int igt_count_plane_format_mod(const struct drm_format_modifier_blob *blo
 	return count;
 }
 
+/*
+ * The (format, modifier) index is an array of positions into the parallel
+ * formats[]/modifiers[] arrays, sorted by format and then modifier. This
+ * keeps the arrays themselves in the order the kernel reported them, while
+ * lookups are a binary search and all modifiers of one format are found
+ * next to each other.
+ */
+struct format_mod_sort {
+	const uint32_t *formats;
+	const uint64_t *modifiers;
+};
+
+static int format_mod_cmp(uint32_t fa, uint64_t ma, uint32_t fb, uint64_t mb)
+{
+	if (fa != fb)
+		return fa < fb ? -1 : 1;
+	if (ma != mb)
+		return ma < mb ? -1 : 1;
+	return 0;
+}
+
+static int format_mod_sort_cmp(const void *a, const void *b, void *data)
+{
+	const struct format_mod_sort *s = data;
+	int ia = *(const int *)a, ib = *(const int *)b;
+
+	return format_mod_cmp(s->formats[ia], s->modifiers[ia],
+			      s->formats[ib], s->modifiers[ib]) ?: ia - ib;
+}
+
+static int *format_mod_index_build(const uint32_t *formats,
+				   const uint64_t *modifiers, int count)
+{
+	struct format_mod_sort s = { formats, modifiers };
+	int *sorted;
+
+	if (!count)
+		return NULL;
+
+	sorted = malloc(count * sizeof(*sorted));
+	igt_assert(sorted);
+
+	for (int i = 0; i < count; i++)
+		sorted[i] = i;
+
+	qsort_r(sorted, count, sizeof(*sorted), format_mod_sort_cmp, &s);
+
+	return sorted;
+}
+
+/* Position in @sorted of the first entry not less than (format, modifier) */
+static int format_mod_index_lower_bound(const uint32_t *formats,
+					const uint64_t *modifiers,
+					const int *sorted, int count,
+					uint32_t format, uint64_t modifier)
+{
+	int lo = 0, hi = count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int i = sorted[mid];
+
+		if (format_mod_cmp(formats[i], modifiers[i], format, modifier) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static bool format_mod_index_find(const uint32_t *formats,
+				  const uint64_t *modifiers,
+				  const int *sorted, int count,
+				  uint32_t format, uint64_t modifier)
+{
+	int pos = format_mod_index_lower_bound(formats, modifiers, sorted,
+					       count, format, modifier);
+	int i;
+
+	if (pos == count)
+		return false;
+
+	i = sorted[pos];
+
+	return formats[i] == format && modifiers[i] == modifier;
+}
+
+static int format_mod_index_first(const uint32_t *formats,
+				  const uint64_t *modifiers,
+				  const int *sorted, int count,
+				  uint32_t format)
+{
+	int pos = format_mod_index_lower_bound(formats, modifiers, sorted,
+					       count, format, 0);
+
+	if (pos == count || formats[sorted[pos]] != format)
+		return -1;
+
+	return pos;
+}
+
+static int format_mod_index_next(const uint32_t *formats,
+				 const int *sorted, int count, int pos)
+{
+	if (pos < 0 || pos + 1 >= count ||
+	    formats[sorted[pos + 1]] != formats[sorted[pos]])
+		return -1;
+
+	return pos + 1;
+}
+
 static void igt_fill_plane_format_mod(igt_display_t *display, igt_plane_t *plane)
 {
 	const struct drm_format_modifier_blob *blob_data;
@@ -5323,14 +5555,28 @@ static void igt_fill_plane_format_mod(igt_display_t *display, igt_plane_t *plane
 			plane->modifiers[i] = DRM_FORMAT_MOD_LINEAR;
 		}
 
+		plane->format_mod_sorted =
+			format_mod_index_build(plane->formats, plane->modifiers,
+					       count);
 		return;
 	}
 
 	blob_id = igt_plane_get_prop(plane, IGT_PLANE_IN_FORMATS);
 
-	blob = drmModeGetPropertyBlob(display->drm_fd, blob_id);
-	if (!blob)
-		return;
+	/* IN_FORMATS is immutable, created along with the plane */
+	if (display->snapshot)
+		blob = igt_kms_snapshot_get_blob(display->snapshot, blob_id);
+	else
+		blob = NULL;
+
+	if (!blob) {
+		blob = drmModeGetPropertyBlob(display->drm_fd, blob_id);
+		if (!blob)
+			return;
+
+		if (display->snapshot)
+			igt_kms_snapshot_add_blob(display->snapshot, blob);
+	}
 
 	blob_data = (const struct drm_format_modifier_blob *) blob->data;
 
@@ -5361,21 +5607,76 @@ static void igt_fill_plane_format_mod(igt_display_t *display, igt_plane_t *plane
 	}
 
 	igt_assert_eq(idx, plane->format_mod_count);
+
+	plane->format_mod_sorted =
+		format_mod_index_build(plane->formats, plane->modifiers, count);
 }
 
+/**
+ * igt_plane_has_format_mod:
+ * @plane: plane
+ * @format: DRM fourcc pixel format
+ * @modifier: DRM format modifier
+ *
+ * Returns: true if @plane supports @format with @modifier. Lookup is
+ * logarithmic in the number of format/modifier pairs of @plane.
+ */
 bool igt_plane_has_format_mod(igt_plane_t *plane, uint32_t format,
 			      uint64_t modifier)
 {
-	int i;
+	return format_mod_index_find(plane->formats, plane->modifiers,
+				     plane->format_mod_sorted,
+				     plane->format_mod_count,
+				     format, modifier);
+}
 
-	for (i = 0; i < plane->format_mod_count; i++) {
-		if (plane->formats[i] == format &&
-		    plane->modifiers[i] == modifier)
-			return true;
+/**
+ * igt_plane_format_mod_first:
+ * @plane: plane
+ * @format: DRM fourcc pixel format
+ *
+ * Starts iteration over modifiers supported by @plane for @format, see
+ * for_each_plane_format_modifier() for the convenient wrapper.
+ *
+ * Returns: an iteration cursor for igt_plane_format_mod_next() and
+ * igt_plane_format_mod_index(), or -1 if @format isn't supported at all.
+ */
+int igt_plane_format_mod_first(igt_plane_t *plane, uint32_t format)
+{
+	return format_mod_index_first(plane->formats, plane->modifiers,
+				      plane->format_mod_sorted,
+				      plane->format_mod_count, format);
+}
 
-	}
+/**
+ * igt_plane_format_mod_next:
+ * @plane: plane
+ * @cursor: cursor returned by igt_plane_format_mod_first() or by a previous
+ * call to this function
+ *
+ * Returns: cursor to the next modifier supported with the same format, in
+ * ascending modifier order, or -1 if there are no more.
+ */
+int igt_plane_format_mod_next(igt_plane_t *plane, int cursor)
+{
+	return format_mod_index_next(plane->formats,
+				     plane->format_mod_sorted,
+				     plane->format_mod_count, cursor);
+}
 
-	return false;
+/**
+ * igt_plane_format_mod_index:
+ * @plane: plane
+ * @cursor: valid iteration cursor
+ *
+ * Returns: the position of the entry pointed by @cursor in the
+ * @plane->formats and @plane->modifiers arrays.
+ */
+int igt_plane_format_mod_index(igt_plane_t *plane, int cursor)
+{
+	igt_assert(cursor >= 0 && cursor < plane->format_mod_count);
+
+	return plane->format_mod_sorted[cursor];
 }
 
 static int igt_count_display_format_mod(igt_display_t *display)
@@ -5394,64 +5695,138 @@ static int igt_count_display_format_mod(igt_display_t *display)
 	return count;
 }
 
-static void
-igt_add_display_format_mod(igt_display_t *display, uint32_t format,
-			   uint64_t modifier)
-{
-	int i;
-
-	for (i = 0; i < display->format_mod_count; i++) {
-		if (display->formats[i] == format &&
-		    display->modifiers[i] == modifier)
-			return;
-
-	}
-
-	display->formats[i] = format;
-	display->modifiers[i] = modifier;
-	display->format_mod_count++;
-}
-
 static void igt_fill_display_format_mod(igt_display_t *display)
 {
 	int count = igt_count_display_format_mod(display);
+	uint32_t *formats;
+	uint64_t *modifiers;
+	int *sorted;
+	bool *keep;
 	enum pipe pipe;
+	int n = 0;
 
 	if (!count)
 		return;
 
-	display->formats = calloc(count, sizeof(display->formats[0]));
-	igt_assert(display->formats);
-	display->modifiers = calloc(count, sizeof(display->modifiers[0]));
-	igt_assert(display->modifiers);
+	formats = calloc(count, sizeof(*formats));
+	igt_assert(formats);
+	modifiers = calloc(count, sizeof(*modifiers));
+	igt_assert(modifiers);
 
 	for_each_pipe(display, pipe) {
 		igt_plane_t *plane;
 
 		for_each_plane_on_pipe(display, pipe, plane) {
 			for (int i = 0; i < plane->format_mod_count; i++) {
-				igt_add_display_format_mod(display,
-							   plane->formats[i],
-							   plane->modifiers[i]);
-				igt_assert_lte(display->format_mod_count, count);
+				formats[n] = plane->formats[i];
+				modifiers[n] = plane->modifiers[i];
+				n++;
 			}
 		}
 	}
+	igt_assert_eq(n, count);
+
+	/*
+	 * Sorting groups duplicates together with the first occurrence
+	 * leading, so we can drop the rest and still keep the display list
+	 * in the order the pairs were first seen on the planes.
+	 */
+	sorted = format_mod_index_build(formats, modifiers, count);
+	keep = calloc(count, sizeof(*keep));
+	igt_assert(keep);
+
+	keep[sorted[0]] = true;
+	for (int i = 1; i < count; i++) {
+		int cur = sorted[i], prev = sorted[i - 1];
+
+		keep[cur] = formats[cur] != formats[prev] ||
+			    modifiers[cur] != modifiers[prev];
+	}
+
+	display->formats = calloc(count, sizeof(display->formats[0]));
+	igt_assert(display->formats);
+	display->modifiers = calloc(count, sizeof(display->modifiers[0]));
+	igt_assert(display->modifiers);
+
+	for (int i = 0; i < count; i++) {
+		if (!keep[i])
+			continue;
+
+		display->formats[display->format_mod_count] = formats[i];
+		display->modifiers[display->format_mod_count] = modifiers[i];
+		display->format_mod_count++;
+	}
+
+	free(keep);
+	free(sorted);
+	free(modifiers);
+	free(formats);
+
+	display->format_mod_sorted =
+		format_mod_index_build(display->formats, display->modifiers,
+				       display->format_mod_count);
 }
 
+/**
+ * igt_display_has_format_mod:
+ * @display: display
+ * @format: DRM fourcc pixel format
+ * @modifier: DRM format modifier
+ *
+ * Returns: true if any plane of @display supports @format with @modifier.
+ */
 bool igt_display_has_format_mod(igt_display_t *display, uint32_t format,
 				uint64_t modifier)
 {
-	int i;
+	return format_mod_index_find(display->formats, display->modifiers,
+				     display->format_mod_sorted,
+				     display->format_mod_count,
+				     format, modifier);
+}
 
-	for (i = 0; i < display->format_mod_count; i++) {
-		if (display->formats[i] == format &&
-		    display->modifiers[i] == modifier)
-			return true;
+/**
+ * igt_display_format_mod_first:
+ * @display: display
+ * @format: DRM fourcc pixel format
+ *
+ * Like igt_plane_format_mod_first(), but for the union of all planes of
+ * @display.
+ */
+int igt_display_format_mod_first(igt_display_t *display, uint32_t format)
+{
+	return format_mod_index_first(display->formats, display->modifiers,
+				      display->format_mod_sorted,
+				      display->format_mod_count, format);
+}
 
-	}
+/**
+ * igt_display_format_mod_next:
+ * @display: display
+ * @cursor: iteration cursor
+ *
+ * Like igt_plane_format_mod_next(), but for the union of all planes of
+ * @display.
+ */
+int igt_display_format_mod_next(igt_display_t *display, int cursor)
+{
+	return format_mod_index_next(display->formats,
+				     display->format_mod_sorted,
+				     display->format_mod_count, cursor);
+}
 
-	return false;
+/**
+ * igt_display_format_mod_index:
+ * @display: display
+ * @cursor: valid iteration cursor
+ *
+ * Returns: the position of the entry pointed by @cursor in the
+ * @display->formats and @display->modifiers arrays.
+ */
+int igt_display_format_mod_index(igt_display_t *display, int cursor)
+{
+	igt_assert(cursor >= 0 && cursor < display->format_mod_count);
+
+	return display->format_mod_sorted[cursor];
 }
 
 /**
@@ -392,6 +392,8 @@ typedef struct igt_plane {
 	uint64_t *modifiers;
 	uint32_t *formats;
 	int format_mod_count;
+	/*< private >*/
+	int *format_mod_sorted;
 } igt_plane_t;
 
 /*
@@ -462,6 +464,9 @@ struct igt_display {
 	uint64_t *modifiers;
 	uint32_t *formats;
 	int format_mod_count;
+	/*< private >*/
+	int *format_mod_sorted;
+	struct igt_kms_snapshot *snapshot;
 };
 
 typedef struct {
@@ -908,6 +913,89 @@ void igt_cleanup_uevents(struct udev_monitor *mon);
 
 bool igt_display_has_format_mod(igt_display_t *display, uint32_t format, uint64_t modifier);
 bool igt_plane_has_format_mod(igt_plane_t *plane, uint32_t format, uint64_t modifier);
+int igt_plane_format_mod_first(igt_plane_t *plane, uint32_t format);
+int igt_plane_format_mod_next(igt_plane_t *plane, int cursor);
+int igt_plane_format_mod_index(igt_plane_t *plane, int cursor);
+int igt_display_format_mod_first(igt_display_t *display, uint32_t format);
+int igt_display_format_mod_next(igt_display_t *display, int cursor);
+int igt_display_format_mod_index(igt_display_t *display, int cursor);
+
+/* Unique iteration cursor, so that the helpers below can be nested */
+#define __fm_iter igt_tokencat(fm__, __LINE__)
+
+/**
+ * for_each_plane_format_mod:
+ * @plane: a pointer to an #igt_plane_t structure
+ * @format: uint32_t variable assigned each supported format
+ * @modifier: uint64_t variable assigned the modifier paired with @format
+ *
+ * Iterates over all format/modifier pairs supported by @plane, in the order
+ * reported by the kernel.
+ */
+#define for_each_plane_format_mod(plane, format, modifier) \
+	for (int __fm_iter = 0; __fm_iter < (plane)->format_mod_count && \
+	     ((format) = (plane)->formats[__fm_iter], \
+	      (modifier) = (plane)->modifiers[__fm_iter], true); \
+	     __fm_iter++)
+
+/**
+ * for_each_plane_format_modifier:
+ * @plane: a pointer to an #igt_plane_t structure
+ * @format: DRM fourcc pixel format
+ * @modifier: uint64_t variable assigned each modifier supported with @format
+ *
+ * Iterates over modifiers @plane supports with @format, in ascending order,
+ * without scanning the other format/modifier pairs of @plane.
+ */
+#define for_each_plane_format_modifier(plane, format, modifier) \
+	for (int __fm_iter = igt_plane_format_mod_first((plane), (format)); \
+	     __fm_iter >= 0 && ((modifier) = (plane)->modifiers[ \
+		igt_plane_format_mod_index((plane), __fm_iter)], true); \
+	     __fm_iter = igt_plane_format_mod_next((plane), __fm_iter))
+
+/**
+ * for_each_display_format_mod:
+ * @display: a pointer to an #igt_display_t structure
+ * @format: uint32_t variable assigned each supported format
+ * @modifier: uint64_t variable assigned the modifier paired with @format
+ *
+ * Iterates over all distinct format/modifier pairs supported by at least one
+ * plane of @display.
+ */
+#define for_each_display_format_mod(display, format, modifier) \
+	for (int __fm_iter = 0; __fm_iter < (display)->format_mod_count && \
+	     ((format) = (display)->formats[__fm_iter], \
+	      (modifier) = (display)->modifiers[__fm_iter], true); \
+	     __fm_iter++)
+
+/**
+ * for_each_display_format_modifier:
+ * @display: a pointer to an #igt_display_t structure
+ * @format: DRM fourcc pixel format
+ * @modifier: uint64_t variable assigned each modifier supported with @format
+ *
+ * Iterates over modifiers supported with @format by at least one plane of
+ * @display, in ascending order.
+ */
+#define for_each_display_format_modifier(display, format, modifier) \
+	for (int __fm_iter = igt_display_format_mod_first((display), (format)); \
+	     __fm_iter >= 0 && ((modifier) = (display)->modifiers[ \
+		igt_display_format_mod_index((display), __fm_iter)], true); \
+	     __fm_iter = igt_display_format_mod_next((display), __fm_iter))
+
+/**
+ * for_each_plane_on_pipe_with_format_mod:
+ * @display: a pointer to an #igt_display_t structure
+ * @pipe: display pipe
+ * @plane: an #igt_plane_t pointer assigned each matching plane
+ * @format: DRM fourcc pixel format
+ * @modifier: DRM format modifier
+ *
+ * Iterates over planes on @pipe which support @format with @modifier.
+ */
+#define for_each_plane_on_pipe_with_format_mod(display, pipe, plane, format, modifier) \
+	for_each_plane_on_pipe(display, pipe, plane) \
+		for_each_if(igt_plane_has_format_mod((plane), (format), (modifier)))
 
 /**
  * igt_vblank_after_eq:
@@ -0,0 +1,1021 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_kms.h"
+#include "igt_kms_snapshot.h"
+#include "igt_map.h"
+#include "igt_sysfs.h"
+
+/**
+ * SECTION:igt_kms_snapshot
+ * @short_description: Cached KMS topology shared between test binaries
+ * @title: KMS snapshot
+ * @include: igt_kms_snapshot.h
+ *
+ * Forcing a probe of a DP or HDMI connector can take hundreds of
+ * milliseconds, and igt_display_require() probes every connector which
+ * reports no modes, i.e. every disconnected one, in every test binary.
+ *
+ * A snapshot records the result of those probes together with the static
+ * parts of the topology (property definitions and immutable blobs such as
+ * IN_FORMATS). When the environment variable IGT_KMS_SNAPSHOT names a
+ * file, igt_display_require() loads the snapshot from it, serves connector
+ * probes and property lookups from it, and writes back anything it had to
+ * query from the kernel. Later binaries of the same run then skip probing
+ * altogether.
+ *
+ * The snapshot is bound to the device node it was taken from, so a driver
+ * reload discards it. Each connector entry is revalidated against the
+ * connector status and EDID in sysfs, which are cheap to read and are
+ * updated by the kernel on hotplug. Hotplug uevents seen through
+ * igt_hotplug_detected(), as well as forcing a connector state or EDID,
+ * drop all connector entries.
+ *
+ * The snapshot may also be built by hand and queried in-process, which
+ * allows exercising the code consuming it without any KMS device.
+ */
+
+#define SNAPSHOT_MAGIC "igt-kms-snapshot 1"
+#define SNAPSHOT_MAX_EDID (256 * 128)
+
+struct igt_kms_snapshot {
+	struct igt_map *connectors;
+	struct igt_map *properties;
+	struct igt_map *blobs;
+
+	struct {
+		uint64_t rdev;
+		uint64_t ino;
+		int64_t ctime_sec;
+		long ctime_nsec;
+	} device;
+
+	bool dirty;
+};
+
+struct snapshot_connector {
+	uint32_t id;
+	drmModeConnector *connector;
+	void *edid;
+	size_t edid_len;
+};
+
+struct snapshot_property {
+	uint32_t id;
+	drmModePropertyRes *prop;
+};
+
+struct snapshot_blob {
+	uint32_t id;
+	drmModePropertyBlobRes *blob;
+};
+
+static struct {
+	struct igt_kms_snapshot *snap;
+	char *path;
+} active;
+
+static void *dup_array(const void *src, size_t count, size_t size)
+{
+	void *dst;
+
+	if (!src || !count)
+		return NULL;
+
+	dst = malloc(count * size);
+	igt_assert(dst);
+	memcpy(dst, src, count * size);
+
+	return dst;
+}
+
+/*
+ * The copies below allocate every member separately so that they can be
+ * released with the matching drmModeFree*() function.
+ */
+static drmModeConnector *dup_connector(const drmModeConnector *c)
+{
+	drmModeConnector *dup;
+
+	dup = malloc(sizeof(*dup));
+	igt_assert(dup);
+
+	*dup = *c;
+	dup->modes = dup_array(c->modes, c->count_modes, sizeof(*c->modes));
+	dup->props = dup_array(c->props, c->count_props, sizeof(*c->props));
+	dup->prop_values = dup_array(c->prop_values, c->count_props,
+				     sizeof(*c->prop_values));
+	dup->encoders = dup_array(c->encoders, c->count_encoders,
+				  sizeof(*c->encoders));
+
+	return dup;
+}
+
+static drmModePropertyRes *dup_property(const drmModePropertyRes *p)
+{
+	drmModePropertyRes *dup;
+
+	dup = malloc(sizeof(*dup));
+	igt_assert(dup);
+
+	*dup = *p;
+	dup->values = dup_array(p->values, p->count_values,
+				sizeof(*p->values));
+	dup->enums = dup_array(p->enums, p->count_enums, sizeof(*p->enums));
+	dup->blob_ids = dup_array(p->blob_ids, p->count_blobs,
+				  sizeof(*p->blob_ids));
+
+	return dup;
+}
+
+static drmModePropertyBlobRes *dup_blob(const drmModePropertyBlobRes *b)
+{
+	drmModePropertyBlobRes *dup;
+
+	dup = malloc(sizeof(*dup));
+	igt_assert(dup);
+
+	*dup = *b;
+	dup->data = dup_array(b->data, b->length, 1);
+
+	return dup;
+}
+
+static void free_connector_entry(struct igt_map_entry *entry)
+{
+	struct snapshot_connector *sc = entry->data;
+
+	drmModeFreeConnector(sc->connector);
+	free(sc->edid);
+	free(sc);
+}
+
+static void free_property_entry(struct igt_map_entry *entry)
+{
+	struct snapshot_property *sp = entry->data;
+
+	drmModeFreeProperty(sp->prop);
+	free(sp);
+}
+
+static void free_blob_entry(struct igt_map_entry *entry)
+{
+	struct snapshot_blob *sb = entry->data;
+
+	drmModeFreePropertyBlob(sb->blob);
+	free(sb);
+}
+
+/**
+ * igt_kms_snapshot_new:
+ *
+ * Creates an empty snapshot, not bound to any device.
+ *
+ * Returns: the new snapshot, to be released with igt_kms_snapshot_free().
+ */
+struct igt_kms_snapshot *igt_kms_snapshot_new(void)
+{
+	struct igt_kms_snapshot *snap;
+
+	snap = calloc(1, sizeof(*snap));
+	igt_assert(snap);
+
+	snap->connectors = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+	snap->properties = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+	snap->blobs = igt_map_create(igt_map_hash_32, igt_map_equal_32);
+
+	return snap;
+}
+
+/**
+ * igt_kms_snapshot_free:
+ * @snap: snapshot to release, may be NULL
+ *
+ * Releases @snap and everything it holds.
+ */
+void igt_kms_snapshot_free(struct igt_kms_snapshot *snap)
+{
+	if (!snap)
+		return;
+
+	igt_map_destroy(snap->connectors, free_connector_entry);
+	igt_map_destroy(snap->properties, free_property_entry);
+	igt_map_destroy(snap->blobs, free_blob_entry);
+	free(snap);
+}
+
+static void remove_entry(struct igt_map *map, const uint32_t *id,
+			 void (*free_entry)(struct igt_map_entry *entry))
+{
+	struct igt_map_entry *entry;
+
+	entry = igt_map_search_entry(map, id);
+	if (!entry)
+		return;
+
+	free_entry(entry);
+	igt_map_remove_entry(map, entry);
+}
+
+static void insert_connector(struct igt_kms_snapshot *snap,
+			     drmModeConnector *connector,
+			     void *edid, size_t edid_len)
+{
+	struct snapshot_connector *sc;
+
+	sc = malloc(sizeof(*sc));
+	igt_assert(sc);
+
+	sc->id = connector->connector_id;
+	sc->connector = connector;
+	sc->edid = edid;
+	sc->edid_len = edid_len;
+
+	remove_entry(snap->connectors, &sc->id, free_connector_entry);
+	igt_map_insert(snap->connectors, &sc->id, sc);
+	snap->dirty = true;
+}
+
+static void insert_property(struct igt_kms_snapshot *snap,
+			    drmModePropertyRes *prop)
+{
+	struct snapshot_property *sp;
+
+	sp = malloc(sizeof(*sp));
+	igt_assert(sp);
+
+	sp->id = prop->prop_id;
+	sp->prop = prop;
+
+	remove_entry(snap->properties, &sp->id, free_property_entry);
+	igt_map_insert(snap->properties, &sp->id, sp);
+	snap->dirty = true;
+}
+
+static void insert_blob(struct igt_kms_snapshot *snap,
+			drmModePropertyBlobRes *blob)
+{
+	struct snapshot_blob *sb;
+
+	sb = malloc(sizeof(*sb));
+	igt_assert(sb);
+
+	sb->id = blob->id;
+	sb->blob = blob;
+
+	remove_entry(snap->blobs, &sb->id, free_blob_entry);
+	igt_map_insert(snap->blobs, &sb->id, sb);
+	snap->dirty = true;
+}
+
+/**
+ * igt_kms_snapshot_add_connector:
+ * @snap: snapshot
+ * @connector: probed connector, as returned by drmModeGetConnector()
+ * @edid: EDID of @connector as exposed in sysfs, may be NULL
+ * @edid_len: size of @edid in bytes
+ *
+ * Records a copy of @connector and its EDID, replacing any previous entry
+ * for the same connector id.
+ */
+void igt_kms_snapshot_add_connector(struct igt_kms_snapshot *snap,
+				    const drmModeConnector *connector,
+				    const void *edid, size_t edid_len)
+{
+	insert_connector(snap, dup_connector(connector),
+			 dup_array(edid, edid_len, 1), edid ? edid_len : 0);
+}
+
+/**
+ * igt_kms_snapshot_add_property:
+ * @snap: snapshot
+ * @prop: property definition, as returned by drmModeGetProperty()
+ *
+ * Records a copy of @prop, replacing any previous entry for the same
+ * property id.
+ */
+void igt_kms_snapshot_add_property(struct igt_kms_snapshot *snap,
+				   const drmModePropertyRes *prop)
+{
+	insert_property(snap, dup_property(prop));
+}
+
+/**
+ * igt_kms_snapshot_add_blob:
+ * @snap: snapshot
+ * @blob: property blob, as returned by drmModeGetPropertyBlob()
+ *
+ * Records a copy of @blob. Only blobs which stay immutable for the lifetime
+ * of the device, like IN_FORMATS, should be recorded.
+ */
+void igt_kms_snapshot_add_blob(struct igt_kms_snapshot *snap,
+			       const drmModePropertyBlobRes *blob)
+{
+	insert_blob(snap, dup_blob(blob));
+}
+
+/**
+ * igt_kms_snapshot_get_connector:
+ * @snap: snapshot
+ * @id: connector id
+ *
+ * Returns: a copy of the recorded connector, to be released with
+ * drmModeFreeConnector(), or NULL if @id is not part of the snapshot.
+ */
+drmModeConnector *
+igt_kms_snapshot_get_connector(struct igt_kms_snapshot *snap, uint32_t id)
+{
+	struct snapshot_connector *sc;
+
+	sc = igt_map_search(snap->connectors, &id);
+	if (!sc)
+		return NULL;
+
+	return dup_connector(sc->connector);
+}
+
+/**
+ * igt_kms_snapshot_get_edid:
+ * @snap: snapshot
+ * @id: connector id
+ * @len: returns the size of the EDID in bytes
+ *
+ * Returns: the EDID recorded for connector @id, owned by @snap, or NULL if
+ * the connector has none or is not part of the snapshot.
+ */
+const void *
+igt_kms_snapshot_get_edid(struct igt_kms_snapshot *snap, uint32_t id,
+			  size_t *len)
+{
+	struct snapshot_connector *sc;
+
+	*len = 0;
+
+	sc = igt_map_search(snap->connectors, &id);
+	if (!sc)
+		return NULL;
+
+	*len = sc->edid_len;
+	return sc->edid;
+}
+
+/**
+ * igt_kms_snapshot_get_property:
+ * @snap: snapshot
+ * @id: property id
+ *
+ * Returns: a copy of the recorded property definition, to be released with
+ * drmModeFreeProperty(), or NULL if @id is not part of the snapshot.
+ */
+drmModePropertyRes *
+igt_kms_snapshot_get_property(struct igt_kms_snapshot *snap, uint32_t id)
+{
+	struct snapshot_property *sp;
+
+	sp = igt_map_search(snap->properties, &id);
+	if (!sp)
+		return NULL;
+
+	return dup_property(sp->prop);
+}
+
+/**
+ * igt_kms_snapshot_get_blob:
+ * @snap: snapshot
+ * @id: blob id
+ *
+ * Returns: a copy of the recorded blob, to be released with
+ * drmModeFreePropertyBlob(), or NULL if @id is not part of the snapshot.
+ */
+drmModePropertyBlobRes *
+igt_kms_snapshot_get_blob(struct igt_kms_snapshot *snap, uint32_t id)
+{
+	struct snapshot_blob *sb;
+
+	sb = igt_map_search(snap->blobs, &id);
+	if (!sb)
+		return NULL;
+
+	return dup_blob(sb->blob);
+}
+
+static void write_hex(FILE *f, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	for (size_t i = 0; i < len; i++)
+		fprintf(f, "%02x", p[i]);
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+static void *parse_hex(const char *s, size_t *len)
+{
+	size_t n = strcspn(s, "\n");
+	uint8_t *data;
+
+	*len = 0;
+	if (!n || n & 1)
+		return NULL;
+
+	data = malloc(n / 2);
+	igt_assert(data);
+
+	for (size_t i = 0; i < n / 2; i++) {
+		int hi = hex_digit(s[2 * i]);
+		int lo = hex_digit(s[2 * i + 1]);
+
+		if (hi < 0 || lo < 0) {
+			free(data);
+			return NULL;
+		}
+		data[i] = hi << 4 | lo;
+	}
+
+	*len = n / 2;
+	return data;
+}
+
+static void copy_name(char *dst, const char *src, size_t size)
+{
+	size_t n = strcspn(src, "\n");
+
+	if (n >= size)
+		n = size - 1;
+	memcpy(dst, src, n);
+	dst[n] = '\0';
+}
+
+/**
+ * igt_kms_snapshot_save:
+ * @snap: snapshot
+ * @path: file to write
+ *
+ * Serializes @snap into @path. The file is replaced atomically, so
+ * concurrent readers see either the old or the new snapshot.
+ *
+ * Returns: 0 on success, a negative errno otherwise.
+ */
+int igt_kms_snapshot_save(const struct igt_kms_snapshot *snap,
+			  const char *path)
+{
+	struct igt_map_entry *pos;
+	char tmp[PATH_MAX];
+	FILE *f;
+	int fd, err = 0;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		return -errno;
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		err = -errno;
+		close(fd);
+		unlink(tmp);
+		return err;
+	}
+
+	fprintf(f, "%s\n", SNAPSHOT_MAGIC);
+	fprintf(f, "device %" PRIu64 " %" PRIu64 " %" PRId64 " %ld\n",
+		snap->device.rdev, snap->device.ino,
+		snap->device.ctime_sec, snap->device.ctime_nsec);
+
+	igt_map_foreach(snap->connectors, pos) {
+		const struct snapshot_connector *sc = pos->data;
+		const drmModeConnector *c = sc->connector;
+
+		fprintf(f, "connector %u %u %u %u %d %u %u %d\n",
+			c->connector_id, c->encoder_id, c->connector_type,
+			c->connector_type_id, c->connection,
+			c->mmWidth, c->mmHeight, c->subpixel);
+		for (int i = 0; i < c->count_encoders; i++)
+			fprintf(f, "encoder %u\n", c->encoders[i]);
+		for (int i = 0; i < c->count_props; i++)
+			fprintf(f, "prop %u %" PRIu64 "\n",
+				c->props[i], c->prop_values[i]);
+		for (int i = 0; i < c->count_modes; i++) {
+			fprintf(f, "mode ");
+			write_hex(f, &c->modes[i], sizeof(c->modes[i]));
+			fprintf(f, "\n");
+		}
+		if (sc->edid_len) {
+			fprintf(f, "edid ");
+			write_hex(f, sc->edid, sc->edid_len);
+			fprintf(f, "\n");
+		}
+	}
+
+	igt_map_foreach(snap->properties, pos) {
+		const drmModePropertyRes *p =
+			((const struct snapshot_property *)pos->data)->prop;
+
+		fprintf(f, "property %u %u %s\n", p->prop_id, p->flags, p->name);
+		for (int i = 0; i < p->count_values; i++)
+			fprintf(f, "value %" PRIu64 "\n", p->values[i]);
+		for (int i = 0; i < p->count_enums; i++)
+			fprintf(f, "enum %" PRIu64 " %s\n",
+				(uint64_t)p->enums[i].value, p->enums[i].name);
+		for (int i = 0; i < p->count_blobs; i++)
+			fprintf(f, "blobid %u\n", p->blob_ids[i]);
+	}
+
+	igt_map_foreach(snap->blobs, pos) {
+		const drmModePropertyBlobRes *b =
+			((const struct snapshot_blob *)pos->data)->blob;
+
+		fprintf(f, "blob %u ", b->id);
+		write_hex(f, b->data, b->length);
+		fprintf(f, "\n");
+	}
+
+	if (ferror(f))
+		err = -EIO;
+	if (fclose(f) && !err)
+		err = -errno;
+
+	if (!err && rename(tmp, path))
+		err = -errno;
+	if (err)
+		unlink(tmp);
+
+	return err;
+}
+
+#define APPEND(array, count, value) do { \
+	(array) = realloc((array), ((count) + 1) * sizeof(*(array))); \
+	igt_assert(array); \
+	(array)[(count)++] = (value); \
+} while (0)
+
+struct snapshot_parser {
+	struct igt_kms_snapshot *snap;
+	drmModeConnector *connector;
+	void *edid;
+	size_t edid_len;
+	drmModePropertyRes *prop;
+};
+
+static void parser_flush(struct snapshot_parser *p)
+{
+	if (p->connector)
+		insert_connector(p->snap, p->connector, p->edid, p->edid_len);
+	if (p->prop)
+		insert_property(p->snap, p->prop);
+
+	p->connector = NULL;
+	p->edid = NULL;
+	p->edid_len = 0;
+	p->prop = NULL;
+}
+
+static bool parse_line(struct snapshot_parser *p, const char *line)
+{
+	drmModeModeInfo *mode;
+	uint64_t value;
+	uint32_t id, flags;
+	size_t len;
+	void *data;
+	int n = 0;
+
+	if (!strncmp(line, "connector ", 10)) {
+		drmModeConnector *c;
+		int connection, subpixel;
+
+		parser_flush(p);
+
+		c = calloc(1, sizeof(*c));
+		igt_assert(c);
+		p->connector = c;
+
+		if (sscanf(line, "connector %u %u %u %u %d %u %u %d",
+			   &c->connector_id, &c->encoder_id,
+			   &c->connector_type, &c->connector_type_id,
+			   &connection, &c->mmWidth, &c->mmHeight,
+			   &subpixel) != 8)
+			return false;
+
+		c->connection = connection;
+		c->subpixel = subpixel;
+
+		return true;
+	}
+
+	if (!strncmp(line, "property ", 9)) {
+		drmModePropertyRes *prop;
+
+		parser_flush(p);
+
+		if (sscanf(line, "property %u %u %n", &id, &flags, &n) != 2 || !n)
+			return false;
+
+		prop = calloc(1, sizeof(*prop));
+		igt_assert(prop);
+		prop->prop_id = id;
+		prop->flags = flags;
+		copy_name(prop->name, line + n, sizeof(prop->name));
+		p->prop = prop;
+
+		return true;
+	}
+
+	if (!strncmp(line, "blob ", 5)) {
+		drmModePropertyBlobRes *blob;
+
+		parser_flush(p);
+
+		if (sscanf(line, "blob %u %n", &id, &n) != 1 || !n)
+			return false;
+
+		data = parse_hex(line + n, &len);
+		if (!data)
+			return false;
+
+		blob = malloc(sizeof(*blob));
+		igt_assert(blob);
+		blob->id = id;
+		blob->length = len;
+		blob->data = data;
+		insert_blob(p->snap, blob);
+
+		return true;
+	}
+
+	if (p->connector) {
+		drmModeConnector *c = p->connector;
+
+		if (sscanf(line, "encoder %u", &id) == 1) {
+			APPEND(c->encoders, c->count_encoders, id);
+			return true;
+		}
+
+		if (sscanf(line, "prop %u %" SCNu64, &id, &value) == 2) {
+			c->prop_values = realloc(c->prop_values,
+						 (c->count_props + 1) *
+						 sizeof(*c->prop_values));
+			igt_assert(c->prop_values);
+			c->prop_values[c->count_props] = value;
+			APPEND(c->props, c->count_props, id);
+			return true;
+		}
+
+		if (!strncmp(line, "mode ", 5)) {
+			mode = parse_hex(line + 5, &len);
+			if (!mode || len != sizeof(*mode)) {
+				free(mode);
+				return false;
+			}
+
+			APPEND(c->modes, c->count_modes, *mode);
+			free(mode);
+			return true;
+		}
+
+		if (!strncmp(line, "edid ", 5) && !p->edid) {
+			p->edid = parse_hex(line + 5, &p->edid_len);
+			return p->edid;
+		}
+	}
+
+	if (p->prop) {
+		drmModePropertyRes *prop = p->prop;
+		struct drm_mode_property_enum e = {};
+
+		if (sscanf(line, "value %" SCNu64, &value) == 1) {
+			APPEND(prop->values, prop->count_values, value);
+			return true;
+		}
+
+		if (sscanf(line, "enum %" SCNu64 " %n", &value, &n) == 1 && n) {
+			e.value = value;
+			copy_name(e.name, line + n, sizeof(e.name));
+			APPEND(prop->enums, prop->count_enums, e);
+			return true;
+		}
+
+		if (sscanf(line, "blobid %u", &id) == 1) {
+			APPEND(prop->blob_ids, prop->count_blobs, id);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * igt_kms_snapshot_load:
+ * @path: file written by igt_kms_snapshot_save()
+ *
+ * Deserializes a snapshot. A missing file, a snapshot written by a
+ * different version or any malformed line makes the whole file rejected.
+ *
+ * Returns: the snapshot, to be released with igt_kms_snapshot_free(), or
+ * NULL.
+ */
+struct igt_kms_snapshot *igt_kms_snapshot_load(const char *path)
+{
+	struct snapshot_parser p = {};
+	char *line = NULL;
+	size_t linesz = 0;
+	bool ok;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+
+	ok = getline(&line, &linesz, f) > 0 &&
+		!strncmp(line, SNAPSHOT_MAGIC "\n", sizeof(SNAPSHOT_MAGIC));
+
+	p.snap = igt_kms_snapshot_new();
+
+	if (ok)
+		ok = getline(&line, &linesz, f) > 0 &&
+			sscanf(line, "device %" SCNu64 " %" SCNu64 " %" SCNd64 " %ld",
+			       &p.snap->device.rdev, &p.snap->device.ino,
+			       &p.snap->device.ctime_sec,
+			       &p.snap->device.ctime_nsec) == 4;
+
+	while (ok && getline(&line, &linesz, f) > 0)
+		ok = parse_line(&p, line);
+
+	parser_flush(&p);
+	free(line);
+	fclose(f);
+
+	if (!ok) {
+		igt_debug("Ignoring malformed KMS snapshot %s\n", path);
+		igt_kms_snapshot_free(p.snap);
+		return NULL;
+	}
+
+	p.snap->dirty = false;
+	return p.snap;
+}
+
+static void set_device(struct igt_kms_snapshot *snap, const struct stat *st)
+{
+	snap->device.rdev = st->st_rdev;
+	snap->device.ino = st->st_ino;
+	snap->device.ctime_sec = st->st_ctim.tv_sec;
+	snap->device.ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+static bool same_device(const struct igt_kms_snapshot *snap,
+			const struct stat *st)
+{
+	/* A driver reload recreates the device node */
+	return snap->device.rdev == st->st_rdev &&
+		snap->device.ino == st->st_ino &&
+		snap->device.ctime_sec == st->st_ctim.tv_sec &&
+		snap->device.ctime_nsec == st->st_ctim.tv_nsec;
+}
+
+static const char *connection_str(drmModeConnection connection)
+{
+	switch (connection) {
+	case DRM_MODE_CONNECTED:
+		return "connected";
+	case DRM_MODE_DISCONNECTED:
+		return "disconnected";
+	default:
+		return "unknown";
+	}
+}
+
+/* Returns the sysfs EDID of @connector, or NULL if it has none */
+static void *read_sysfs_edid(int dir, size_t *len)
+{
+	void *edid;
+	int ret;
+
+	*len = 0;
+
+	edid = malloc(SNAPSHOT_MAX_EDID);
+	igt_assert(edid);
+
+	ret = igt_sysfs_read(dir, "edid", edid, SNAPSHOT_MAX_EDID);
+	if (ret <= 0) {
+		free(edid);
+		return NULL;
+	}
+
+	*len = ret;
+	return edid;
+}
+
+/*
+ * The connector status and EDID in sysfs reflect the last detection done
+ * by the kernel, including the ones triggered by hotplug interrupts, and
+ * reading them never probes the connector.
+ */
+static bool connector_is_current(int drm_fd,
+				 const struct snapshot_connector *sc)
+{
+	size_t edid_len;
+	char *status;
+	void *edid;
+	bool ret;
+	int dir;
+
+	dir = igt_connector_sysfs_open(drm_fd, sc->connector);
+	if (dir < 0)
+		return false;
+
+	status = igt_sysfs_get(dir, "status");
+	edid = read_sysfs_edid(dir, &edid_len);
+	close(dir);
+
+	ret = status &&
+		!strcmp(status, connection_str(sc->connector->connection)) &&
+		edid_len == sc->edid_len &&
+		(!edid_len || !memcmp(edid, sc->edid, edid_len));
+
+	free(status);
+	free(edid);
+
+	return ret;
+}
+
+static void drop_stale_connectors(struct igt_kms_snapshot *snap, int drm_fd)
+{
+	struct igt_map_entry *pos;
+
+	igt_map_foreach(snap->connectors, pos) {
+		struct snapshot_connector *sc = pos->data;
+
+		if (connector_is_current(drm_fd, sc))
+			continue;
+
+		igt_debug("KMS snapshot: connector %u changed, dropping it\n",
+			  sc->id);
+		free_connector_entry(pos);
+		igt_map_remove_entry(snap->connectors, pos);
+		snap->dirty = true;
+	}
+}
+
+/**
+ * igt_kms_snapshot_attach:
+ * @drm_fd: KMS device
+ *
+ * Returns the process wide snapshot for @drm_fd, loading it from the file
+ * named by the IGT_KMS_SNAPSHOT environment variable on first use. Connector
+ * entries no longer matching the state exposed in sysfs are dropped.
+ *
+ * Returns: the snapshot, owned by the library, or NULL if snapshots are not
+ * enabled.
+ */
+struct igt_kms_snapshot *igt_kms_snapshot_attach(int drm_fd)
+{
+	const char *path = getenv("IGT_KMS_SNAPSHOT");
+	struct stat st;
+
+	if (!path || !*path || fstat(drm_fd, &st))
+		return NULL;
+
+	if (active.snap &&
+	    (strcmp(active.path, path) || !same_device(active.snap, &st))) {
+		igt_kms_snapshot_sync();
+		igt_kms_snapshot_free(active.snap);
+		free(active.path);
+		active.snap = NULL;
+		active.path = NULL;
+	}
+
+	if (!active.snap) {
+		active.snap = igt_kms_snapshot_load(path);
+		if (active.snap && !same_device(active.snap, &st)) {
+			igt_debug("KMS snapshot %s is from another device\n",
+				  path);
+			igt_kms_snapshot_free(active.snap);
+			active.snap = NULL;
+		}
+
+		if (!active.snap) {
+			active.snap = igt_kms_snapshot_new();
+			set_device(active.snap, &st);
+		}
+
+		active.path = strdup(path);
+		igt_assert(active.path);
+	}
+
+	drop_stale_connectors(active.snap, drm_fd);
+
+	return active.snap;
+}
+
+/**
+ * igt_kms_snapshot_record_connector:
+ * @snap: snapshot returned by igt_kms_snapshot_attach()
+ * @drm_fd: KMS device
+ * @connector: freshly probed connector
+ *
+ * Records @connector along with its current sysfs EDID. Connectors which
+ * cannot be revalidated through sysfs are not recorded.
+ */
+void igt_kms_snapshot_record_connector(struct igt_kms_snapshot *snap,
+				       int drm_fd,
+				       const drmModeConnector *connector)
+{
+	size_t edid_len;
+	void *edid;
+	int dir;
+
+	dir = igt_connector_sysfs_open(drm_fd, (drmModeConnector *)connector);
+	if (dir < 0)
+		return;
+
+	edid = read_sysfs_edid(dir, &edid_len);
+	close(dir);
+
+	insert_connector(snap, dup_connector(connector), edid, edid_len);
+}
+
+/**
+ * igt_kms_snapshot_sync:
+ *
+ * Writes the process wide snapshot back to its file if anything was added
+ * or dropped since it was loaded.
+ */
+void igt_kms_snapshot_sync(void)
+{
+	int err;
+
+	if (!active.snap || !active.snap->dirty)
+		return;
+
+	err = igt_kms_snapshot_save(active.snap, active.path);
+	if (err)
+		igt_debug("Failed to write KMS snapshot %s: %s\n",
+			  active.path, strerror(-err));
+	else
+		active.snap->dirty = false;
+}
+
+/**
+ * igt_kms_snapshot_invalidate:
+ *
+ * Drops every connector entry from the process wide snapshot and from the
+ * snapshot file, so that the next igt_display_require(), in this or any
+ * later binary, probes all connectors again. Called whenever a hotplug is
+ * detected or the connector state is forced.
+ */
+void igt_kms_snapshot_invalidate(void)
+{
+	const char *path = getenv("IGT_KMS_SNAPSHOT");
+	struct igt_map_entry *pos;
+
+	if (active.snap) {
+		igt_map_foreach(active.snap->connectors, pos) {
+			free_connector_entry(pos);
+			igt_map_remove_entry(active.snap->connectors, pos);
+		}
+		active.snap->dirty = true;
+		igt_kms_snapshot_sync();
+	} else if (path && *path) {
+		unlink(path);
+	}
+}
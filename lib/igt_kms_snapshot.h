@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef IGT_KMS_SNAPSHOT_H
+#define IGT_KMS_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xf86drmMode.h>
+
+struct igt_kms_snapshot;
+
+struct igt_kms_snapshot *igt_kms_snapshot_new(void);
+void igt_kms_snapshot_free(struct igt_kms_snapshot *snap);
+
+void igt_kms_snapshot_add_connector(struct igt_kms_snapshot *snap,
+				    const drmModeConnector *connector,
+				    const void *edid, size_t edid_len);
+void igt_kms_snapshot_add_property(struct igt_kms_snapshot *snap,
+				   const drmModePropertyRes *prop);
+void igt_kms_snapshot_add_blob(struct igt_kms_snapshot *snap,
+			       const drmModePropertyBlobRes *blob);
+
+drmModeConnector *
+igt_kms_snapshot_get_connector(struct igt_kms_snapshot *snap, uint32_t id);
+const void *
+igt_kms_snapshot_get_edid(struct igt_kms_snapshot *snap, uint32_t id,
+			  size_t *len);
+drmModePropertyRes *
+igt_kms_snapshot_get_property(struct igt_kms_snapshot *snap, uint32_t id);
+drmModePropertyBlobRes *
+igt_kms_snapshot_get_blob(struct igt_kms_snapshot *snap, uint32_t id);
+
+int igt_kms_snapshot_save(const struct igt_kms_snapshot *snap,
+			  const char *path);
+struct igt_kms_snapshot *igt_kms_snapshot_load(const char *path);
+
+struct igt_kms_snapshot *igt_kms_snapshot_attach(int drm_fd);
+void igt_kms_snapshot_record_connector(struct igt_kms_snapshot *snap,
+				       int drm_fd,
+				       const drmModeConnector *connector);
+void igt_kms_snapshot_sync(void);
+void igt_kms_snapshot_invalidate(void);
+
+#endif /* IGT_KMS_SNAPSHOT_H */
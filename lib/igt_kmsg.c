@@ -0,0 +1,683 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "igt_kmsg.h"
+
+/**
+ * SECTION:igt_kmsg
+ * @short_description: Kernel log reader
+ * @title: kmsg
+ * @include: igt_kmsg.h
+ *
+ * Reads kernel log records, from /dev/kmsg or from a log recorded from it
+ * like the dmesg.txt files of igt_runner, and splits them into a header
+ * (`level,seq,timestamp,flags;message`) and the dictionary lines that
+ * follow it.
+ *
+ * The records available are drained into a single buffer and indexed by
+ * sequence number, then handed to every subscriber in turn, so that
+ * several consumers of the log share one reader and parse each record
+ * once. /dev/kmsg returns one record per read(), recorded logs are read
+ * in large chunks and may be mapped instead, see igt_kmsg_map().
+ *
+ * |[<!-- language="c" -->
+ *	struct igt_kmsg kmsg;
+ *
+ *	igt_kmsg_open(&kmsg);
+ *	igt_kmsg_subscribe(&kmsg, print_record, NULL);
+ *	...
+ *	igt_kmsg_drain(&kmsg);
+ *	igt_kmsg_discard(&kmsg);
+ *	...
+ *	igt_kmsg_fini(&kmsg);
+ * ]|
+ */
+
+static void kmsg_init(struct igt_kmsg *k)
+{
+	memset(k, 0, sizeof(*k));
+	k->fd = -1;
+	k->cmpfd = -1;
+}
+
+static const char *line_end(const char *ptr, const char *end, bool final)
+{
+	const char *nl = memchr(ptr, '\n', end - ptr);
+
+	if (nl)
+		return nl + 1;
+
+	return final ? end : NULL;
+}
+
+/* Parses "level,seq,timestamp,flags[,...];", returns the message */
+static const char *parse_header(const char *ptr, const char *end,
+				struct igt_kmsg_entry *e)
+{
+	uint64_t v[3];
+
+	for (int i = 0; i < 3; i++) {
+		if (ptr == end || *ptr < '0' || *ptr > '9')
+			return NULL;
+
+		v[i] = 0;
+		while (ptr < end && *ptr >= '0' && *ptr <= '9')
+			v[i] = v[i] * 10 + *ptr++ - '0';
+
+		if (ptr == end || *ptr++ != ',')
+			return NULL;
+	}
+
+	if (ptr == end)
+		return NULL;
+
+	e->cont = *ptr;
+
+	/* newer kernels may add fields, such as the caller id */
+	ptr = memchr(ptr, ';', end - ptr);
+	if (!ptr)
+		return NULL;
+
+	e->level = v[0] & 7;
+	e->facility = v[0] >> 3;
+	e->seq = v[1];
+	e->ts_usec = v[2];
+
+	return ptr + 1;
+}
+
+static int add_entry(struct igt_kmsg *k, const struct igt_kmsg_entry *e)
+{
+	if (k->count == k->index_allocated) {
+		size_t n = k->index_allocated ? 2 * k->index_allocated : 256;
+		void *index = realloc(k->index, n * sizeof(*k->index));
+
+		if (!index)
+			return -ENOMEM;
+
+		k->index = index;
+		k->index_allocated = n;
+	}
+
+	k->index[k->count++] = *e;
+	return 0;
+}
+
+/*
+ * Indexes the records between the parsed part of the buffer and @end. A
+ * record is a header line followed by any number of dictionary lines,
+ * which start with a space, so unless @final the last record is only
+ * complete once the next one starts.
+ */
+static int parse_records(struct igt_kmsg *k, size_t end, bool final)
+{
+	const char *stop = k->buf + end;
+
+	while (k->parsed < end) {
+		const char *start = k->buf + k->parsed;
+		const char *eol, *next, *msg;
+		struct igt_kmsg_entry e;
+
+		eol = line_end(start, stop, final);
+		if (!eol)
+			break;
+
+		for (next = eol; next < stop && *next == ' ';) {
+			next = line_end(next, stop, final);
+			if (!next)
+				return 0;
+		}
+
+		if (next == stop && !final)
+			break;
+
+		k->parsed = next - k->buf;
+
+		/* dictionary lines of a record that was cut off */
+		if (*start == ' ')
+			continue;
+
+		msg = parse_header(start, eol, &e);
+		if (!msg) {
+			k->malformed++;
+			continue;
+		}
+
+		e.offset = start - k->buf;
+		e.raw_len = next - start;
+		e.msg_offset = msg - start;
+		e.msg_len = eol - msg;
+		if (e.msg_len && msg[e.msg_len - 1] == '\n')
+			e.msg_len--;
+
+		if (add_entry(k, &e))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int reserve(struct igt_kmsg *k, size_t size)
+{
+	size_t n;
+	char *buf;
+
+	if (k->allocated - k->len >= size)
+		return 0;
+
+	n = 2 * k->allocated;
+	if (n < k->len + size)
+		n = k->len + size;
+
+	buf = realloc(k->buf, n);
+	if (!buf)
+		return -ENOMEM;
+
+	k->buf = buf;
+	k->allocated = n;
+
+	return 0;
+}
+
+static bool readable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	return poll(&pfd, 1, 0) > 0;
+}
+
+/* Records read between checks for the end of the drain */
+#define KMSG_CMP_INTERVAL 64
+
+static int drain_device(struct igt_kmsg *k)
+{
+	bool nonblock = fcntl(k->fd, F_GETFL) & O_NONBLOCK;
+	uint64_t last = UINT64_MAX;
+	unsigned int n = 0;
+	ssize_t r;
+
+	/*
+	 * Stop at the first record logged after we started, or we might
+	 * never catch up with a busy log. /dev/kmsg can't seek back from
+	 * its end, so that record is read from a second fd positioned at
+	 * the end now. It stays the same however late we read it, so it is
+	 * only looked at from time to time.
+	 */
+	if (k->cmpfd < 0)
+		k->cmpfd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (k->cmpfd >= 0)
+		lseek(k->cmpfd, 0, SEEK_END);
+
+	for (;;) {
+		if (reserve(k, IGT_KMSG_RECORD_MAX))
+			return -ENOMEM;
+
+		if (k->cmpfd >= 0 && last == UINT64_MAX &&
+		    !(n++ % KMSG_CMP_INTERVAL)) {
+			r = read(k->cmpfd, k->buf + k->len, IGT_KMSG_RECORD_MAX);
+			if (r > 0) {
+				const char *ptr = k->buf + k->len;
+				struct igt_kmsg_entry e;
+
+				if (parse_header(ptr, line_end(ptr, ptr + r, true), &e))
+					last = e.seq;
+			}
+		}
+
+		if (!nonblock && !readable(k->fd))
+			return 0;
+
+		/*
+		 * A record too large for the buffer fails with EINVAL without
+		 * being consumed, and /dev/kmsg can't seek past it, so that
+		 * is an error like any other.
+		 */
+		r = read(k->fd, k->buf + k->len, IGT_KMSG_RECORD_MAX);
+		if (r < 0) {
+			switch (errno) {
+			case EPIPE: /* overrun, the oldest records were lost */
+				k->lost++;
+				/* fall through */
+			case EINTR:
+				continue;
+			case EAGAIN:
+				return 0;
+			default:
+				return -errno;
+			}
+		}
+
+		if (!r) {
+			k->eof = true;
+			return 0;
+		}
+
+		/* each read returns exactly one record */
+		k->len += r;
+		if (parse_records(k, k->len, true))
+			return -ENOMEM;
+
+		if (k->count && k->index[k->count - 1].seq >= last)
+			return 0;
+	}
+}
+
+static int drain_stream(struct igt_kmsg *k)
+{
+	bool nonblock = fcntl(k->fd, F_GETFL) & O_NONBLOCK;
+	ssize_t r;
+
+	for (;;) {
+		if (!nonblock && !readable(k->fd))
+			break;
+
+		if (reserve(k, IGT_KMSG_RECORD_MAX))
+			return -ENOMEM;
+
+		r = read(k->fd, k->buf + k->len, k->allocated - k->len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			return -errno;
+		}
+
+		if (!r) {
+			k->eof = true;
+			break;
+		}
+
+		k->len += r;
+		if (parse_records(k, k->len, false))
+			return -ENOMEM;
+	}
+
+	return k->eof ? parse_records(k, k->len, true) : 0;
+}
+
+/**
+ * igt_kmsg_init_fd:
+ * @k: The reader to initialize
+ * @fd: /dev/kmsg, or a recorded log to read
+ *
+ * Sets up a reader of @fd, which stays owned by the caller. A /dev/kmsg
+ * fd is read from its current position, one record per read(), anything
+ * else is read in chunks as a stream of records until its end.
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int igt_kmsg_init_fd(struct igt_kmsg *k, int fd)
+{
+	struct stat st;
+
+	kmsg_init(k);
+
+	if (fstat(fd, &st))
+		return -errno;
+
+	k->fd = fd;
+	/* /dev/kmsg is the memory device 1:11 */
+	k->device = S_ISCHR(st.st_mode) &&
+		major(st.st_rdev) == 1 && minor(st.st_rdev) == 11;
+
+	return 0;
+}
+
+/**
+ * igt_kmsg_open:
+ * @k: The reader to initialize
+ *
+ * Opens /dev/kmsg, non-blocking and positioned past the last record
+ * logged so far, see igt_kmsg_init_fd().
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int igt_kmsg_open(struct igt_kmsg *k)
+{
+	int fd, err;
+
+	kmsg_init(k);
+
+	fd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	lseek(fd, 0, SEEK_END);
+
+	err = igt_kmsg_init_fd(k, fd);
+	if (err) {
+		close(fd);
+		return err;
+	}
+	k->close_fd = true;
+
+	return 0;
+}
+
+/**
+ * igt_kmsg_init_buffer:
+ * @k: The reader to initialize
+ * @data: A recorded log
+ * @size: The size of @data
+ *
+ * Indexes the records of a log held in memory, which must outlive the
+ * reader. They are handed to subscribers on the first igt_kmsg_drain().
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int igt_kmsg_init_buffer(struct igt_kmsg *k, const void *data, size_t size)
+{
+	kmsg_init(k);
+
+	k->buf = (char *)data;
+	k->len = k->allocated = size;
+	k->static_buf = true;
+	k->eof = true;
+
+	return parse_records(k, size, true);
+}
+
+/**
+ * igt_kmsg_map:
+ * @k: The reader to initialize
+ * @fd: A recorded log
+ *
+ * Maps the whole of @fd and indexes its records, see
+ * igt_kmsg_init_buffer(). @fd may be closed afterwards.
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int igt_kmsg_map(struct igt_kmsg *k, int fd)
+{
+	struct stat st;
+	void *data;
+	int err;
+
+	kmsg_init(k);
+
+	if (fstat(fd, &st))
+		return -errno;
+
+	if (!st.st_size)
+		return igt_kmsg_init_buffer(k, NULL, 0);
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return -errno;
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	err = igt_kmsg_init_buffer(k, data, st.st_size);
+	k->mapped = true;
+	if (err)
+		igt_kmsg_fini(k);
+
+	return err;
+}
+
+/**
+ * igt_kmsg_fini:
+ * @k: The reader to clean up
+ *
+ * Releases the buffers of @k, and closes /dev/kmsg if it was opened with
+ * igt_kmsg_open().
+ */
+void igt_kmsg_fini(struct igt_kmsg *k)
+{
+	if (k->close_fd)
+		close(k->fd);
+	if (k->cmpfd >= 0)
+		close(k->cmpfd);
+
+	if (k->mapped)
+		munmap(k->buf, k->len);
+	else if (!k->static_buf)
+		free(k->buf);
+
+	free(k->index);
+	free(k->subscribers);
+
+	kmsg_init(k);
+}
+
+/**
+ * igt_kmsg_subscribe:
+ * @k: The reader
+ * @fn: Function to call for each record
+ * @data: Passed to @fn
+ *
+ * Adds a consumer of the records read by @k. The subscribers are called
+ * in the order they subscribed, for every record, by igt_kmsg_drain(),
+ * and must not subscribe or unsubscribe from within @fn.
+ *
+ * Returns: 0 on success, a negative error code otherwise.
+ */
+int igt_kmsg_subscribe(struct igt_kmsg *k, igt_kmsg_fn_t fn, void *data)
+{
+	struct igt_kmsg_subscriber *s;
+
+	s = realloc(k->subscribers,
+		    (k->subscriber_count + 1) * sizeof(*s));
+	if (!s)
+		return -ENOMEM;
+
+	s[k->subscriber_count].fn = fn;
+	s[k->subscriber_count].data = data;
+	k->subscribers = s;
+	k->subscriber_count++;
+
+	return 0;
+}
+
+/**
+ * igt_kmsg_unsubscribe:
+ * @k: The reader
+ * @fn: The function passed to igt_kmsg_subscribe()
+ * @data: The data passed to igt_kmsg_subscribe()
+ *
+ * Removes a consumer added with igt_kmsg_subscribe().
+ */
+void igt_kmsg_unsubscribe(struct igt_kmsg *k, igt_kmsg_fn_t fn, void *data)
+{
+	for (unsigned int i = 0; i < k->subscriber_count; i++) {
+		if (k->subscribers[i].fn != fn || k->subscribers[i].data != data)
+			continue;
+
+		memmove(&k->subscribers[i], &k->subscribers[i + 1],
+			(k->subscriber_count - i - 1) * sizeof(*k->subscribers));
+		k->subscriber_count--;
+		return;
+	}
+}
+
+/**
+ * igt_kmsg_wait:
+ * @k: The reader
+ * @timeout_ms: Timeout as for poll(), -1 to wait forever
+ *
+ * Waits for records to read, or for the end of a recorded log.
+ *
+ * Returns: a positive value if igt_kmsg_drain() has something to do, 0 on
+ * timeout, or a negative error code.
+ */
+int igt_kmsg_wait(struct igt_kmsg *k, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = k->fd, .events = POLLIN };
+	int ret;
+
+	if (k->fd < 0 || k->eof)
+		return 1;
+
+	do {
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -errno : ret;
+}
+
+/**
+ * igt_kmsg_drain:
+ * @k: The reader
+ *
+ * Reads the records available without blocking, up to the first record
+ * logged after the call for /dev/kmsg, and hands every record not seen
+ * yet to the subscribers. Records lost to a log buffer overrun are
+ * counted in @k->lost.
+ *
+ * The records stay buffered, and can be looked up, until
+ * igt_kmsg_discard().
+ *
+ * Returns: the number of new records, or a negative error code. Records
+ * read before an error are still handed to the subscribers.
+ */
+int igt_kmsg_drain(struct igt_kmsg *k)
+{
+	size_t first = k->dispatched;
+	struct igt_kmsg_record record;
+	int err = 0;
+
+	if (k->device)
+		err = drain_device(k);
+	else if (k->fd >= 0 && !k->eof)
+		err = drain_stream(k);
+
+	for (; k->dispatched < k->count; k->dispatched++) {
+		igt_kmsg_get(k, k->dispatched, &record);
+
+		for (unsigned int i = 0; i < k->subscriber_count; i++)
+			k->subscribers[i].fn(&record, k->subscribers[i].data);
+	}
+
+	return err ?: k->dispatched - first;
+}
+
+/**
+ * igt_kmsg_discard:
+ * @k: The reader
+ *
+ * Drops the records buffered so far. Reading continues where it stopped.
+ */
+void igt_kmsg_discard(struct igt_kmsg *k)
+{
+	if (k->static_buf) {
+		k->base = k->parsed;
+	} else {
+		/* keep the start of a record split across reads */
+		memmove(k->buf, k->buf + k->parsed, k->len - k->parsed);
+		k->len -= k->parsed;
+		k->parsed = 0;
+	}
+
+	k->count = 0;
+	k->dispatched = 0;
+}
+
+/**
+ * igt_kmsg_get:
+ * @k: The reader
+ * @idx: Index of the record, counting from the oldest one buffered
+ * @record: Where to store the record
+ *
+ * Returns: true if @idx is below igt_kmsg_count().
+ */
+bool igt_kmsg_get(const struct igt_kmsg *k, size_t idx,
+		  struct igt_kmsg_record *record)
+{
+	const struct igt_kmsg_entry *e;
+
+	if (idx >= k->count)
+		return false;
+
+	e = &k->index[idx];
+	record->seq = e->seq;
+	record->ts_usec = e->ts_usec;
+	record->level = e->level;
+	record->facility = e->facility;
+	record->cont = e->cont;
+	record->raw = k->buf + e->offset;
+	record->raw_len = e->raw_len;
+	record->msg = record->raw + e->msg_offset;
+	record->msg_len = e->msg_len;
+
+	return true;
+}
+
+/**
+ * igt_kmsg_find:
+ * @k: The reader
+ * @seq: Sequence number of the record
+ * @record: Where to store the record
+ *
+ * Looks a buffered record up by its sequence number. Sequence numbers only
+ * increase within a boot, so a log spanning several boots has to be
+ * looked up through igt_kmsg_get().
+ *
+ * Returns: true if the record was found.
+ */
+bool igt_kmsg_find(const struct igt_kmsg *k, uint64_t seq,
+		   struct igt_kmsg_record *record)
+{
+	size_t lo = 0, hi = k->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (k->index[mid].seq < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == k->count || k->index[lo].seq != seq)
+		return false;
+
+	return igt_kmsg_get(k, lo, record);
+}
+
+/**
+ * igt_kmsg_raw:
+ * @k: The reader
+ * @data: Where to store the start of the buffered records
+ *
+ * Gives the buffered records as read, for instance to save them as a
+ * whole. Lines skipped while parsing are included.
+ *
+ * Returns: the size of the buffered records.
+ */
+size_t igt_kmsg_raw(const struct igt_kmsg *k, const char **data)
+{
+	*data = k->buf + k->base;
+
+	return k->parsed - k->base;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef IGT_KMSG_H
+#define IGT_KMSG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest record /dev/kmsg may return, see CONSOLE_EXT_LOG_MAX */
+#define IGT_KMSG_RECORD_MAX 8192
+
+/**
+ * igt_kmsg_record:
+ * @seq: Sequence number of the record
+ * @ts_usec: Timestamp in microseconds since boot
+ * @level: Syslog priority, from 0 (emergency) to 7 (debug)
+ * @facility: Syslog facility
+ * @cont: '-', or 'c' for a fragment of a continued line
+ * @msg: Message text, not NUL terminated
+ * @msg_len: Length of @msg, without the newline
+ * @raw: The whole record as read, header and dictionary lines included
+ * @raw_len: Length of @raw
+ *
+ * A kernel log record, pointing into the buffer of the reader. It stays
+ * valid until the next igt_kmsg_drain() or igt_kmsg_discard().
+ */
+struct igt_kmsg_record {
+	uint64_t seq;
+	uint64_t ts_usec;
+	unsigned int level;
+	unsigned int facility;
+	char cont;
+	const char *msg;
+	size_t msg_len;
+	const char *raw;
+	size_t raw_len;
+};
+
+typedef void (*igt_kmsg_fn_t)(const struct igt_kmsg_record *record,
+			      void *data);
+
+struct igt_kmsg_entry {
+	uint64_t seq;
+	uint64_t ts_usec;
+	size_t offset;
+	uint32_t raw_len;
+	uint32_t msg_offset;
+	uint32_t msg_len;
+	uint8_t level;
+	uint8_t facility;
+	char cont;
+};
+
+struct igt_kmsg_subscriber {
+	igt_kmsg_fn_t fn;
+	void *data;
+};
+
+/**
+ * igt_kmsg:
+ * @fd: The file read, or -1 for a log held in memory
+ * @eof: Whether the end of a recorded log was reached
+ * @lost: Number of times records were lost to a log buffer overrun
+ * @malformed: Number of lines skipped for lacking a valid header
+ *
+ * A kernel log reader, see igt_kmsg_open().
+ */
+struct igt_kmsg {
+	int fd;
+	bool eof;
+	uint64_t lost;
+	uint64_t malformed;
+
+	/*< private >*/
+	int cmpfd;
+	bool device;
+	bool close_fd;
+	bool mapped;
+	bool static_buf;
+	char *buf;
+	size_t base;
+	size_t parsed;
+	size_t len;
+	size_t allocated;
+	struct igt_kmsg_entry *index;
+	size_t count;
+	size_t dispatched;
+	size_t index_allocated;
+	struct igt_kmsg_subscriber *subscribers;
+	unsigned int subscriber_count;
+};
+
+int igt_kmsg_open(struct igt_kmsg *k);
+int igt_kmsg_init_fd(struct igt_kmsg *k, int fd);
+int igt_kmsg_init_buffer(struct igt_kmsg *k, const void *data, size_t size);
+int igt_kmsg_map(struct igt_kmsg *k, int fd);
+void igt_kmsg_fini(struct igt_kmsg *k);
+
+int igt_kmsg_subscribe(struct igt_kmsg *k, igt_kmsg_fn_t fn, void *data);
+void igt_kmsg_unsubscribe(struct igt_kmsg *k, igt_kmsg_fn_t fn, void *data);
+
+int igt_kmsg_wait(struct igt_kmsg *k, int timeout_ms);
+int igt_kmsg_drain(struct igt_kmsg *k);
+void igt_kmsg_discard(struct igt_kmsg *k);
+
+/**
+ * igt_kmsg_count:
+ * @k: The reader
+ *
+ * Returns: the number of records buffered by @k.
+ */
+static inline size_t igt_kmsg_count(const struct igt_kmsg *k)
+{
+	return k->count;
+}
+
+bool igt_kmsg_get(const struct igt_kmsg *k, size_t idx,
+		  struct igt_kmsg_record *record);
+bool igt_kmsg_find(const struct igt_kmsg *k, uint64_t seq,
+		   struct igt_kmsg_record *record);
+size_t igt_kmsg_raw(const struct igt_kmsg *k, const char **data);
+
+#endif /* IGT_KMSG_H */
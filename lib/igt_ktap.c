@@ -9,13 +9,16 @@
 #include <libkmod.h>
 #include <pthread.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "drmtest.h"
 #include "igt_aux.h"
 #include "igt_core.h"
+#include "igt_kmsg.h"
 #include "igt_ktap.h"
 #include "igt_list.h"
 
@@ -31,73 +34,370 @@ enum ktap_phase {
 	SUITE_RESULT,
 };
 
+/* Plan and numbering of the tests at one nesting level of a KTAP report */
+struct ktap_level {
+	unsigned int count;
+	unsigned int last;
+};
+
 struct igt_ktap_results {
 	enum ktap_phase expect;
-	unsigned int suite_count;
-	unsigned int suite_last;
 	char *suite_name;
-	unsigned int case_count;
-	unsigned int case_last;
 	char *case_name;
-	unsigned int sub_last;
+	/*
+	 * Stack of the nesting levels, indexed by indent / 4: test suites of
+	 * the report, test cases of a suite, results of a parametrized test
+	 * case, then whatever those nest below them. depth is the number of
+	 * levels currently open.
+	 */
+	struct ktap_level *levels;
+	unsigned int depth;
+	unsigned int allocated;
 	struct igt_list_head *results;
 };
 
-/**
- * igt_ktap_parse:
- *
- * This function parses a line of text for KTAP report data
- * and passes results back to IGT kunit layer.
+enum ktap_line_type {
+	KTAP_LINE_OTHER,
+	KTAP_LINE_VERSION,
+	KTAP_LINE_PLAN,
+	KTAP_LINE_BAD_PLAN,
+	KTAP_LINE_SUBTEST,
+	KTAP_LINE_RESULT,
+};
+
+/* A KTAP line split into its fields, pointing into the parsed buffer */
+struct ktap_line {
+	enum ktap_line_type type;
+	unsigned int indent;
+	unsigned int n;
+	bool not_ok;
+	unsigned int not_spaces;
+	const char *desc;
+	const char *name;
+	size_t name_len;
+	const char *rest;
+};
+
+static unsigned int ktap_spaces(const char **p)
+{
+	const char *s = *p;
+
+	while (**p == ' ')
+		(*p)++;
+
+	return *p - s;
+}
+
+static bool ktap_blank(const char *p)
+{
+	while (isspace(*p))
+		p++;
+
+	return !*p;
+}
+
+static bool __ktap_keyword(const char **p, const char *keyword, size_t len)
+{
+	if (strncmp(*p, keyword, len))
+		return false;
+
+	*p += len;
+	return true;
+}
+
+#define ktap_keyword(p, k) __ktap_keyword(p, k, sizeof(k) - 1)
+
+static bool ktap_uint(const char **p, unsigned int *n)
+{
+	char *end;
+
+	if (!isdigit(**p))
+		return false;
+
+	*n = strtoul(*p, &end, 10);
+	*p = end;
+
+	return true;
+}
+
+static const char *ktap_token(const char **p, size_t *len)
+{
+	const char *s = *p;
+
+	while (**p && !isspace(**p))
+		(*p)++;
+
+	*len = *p - s;
+	return *len ? s : NULL;
+}
+
+/*
+ * Classify a line in a single pass. Whether a result line is well formed
+ * depends on its nesting level, which is left to the caller.
  */
-int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
+static void ktap_tokenize(const char *buf, struct ktap_line *l)
 {
-	char *suite_name = NULL, *case_name = NULL, *msg = NULL;
+	const char *p = buf;
+
+	memset(l, 0, sizeof(*l));
+	l->indent = ktap_spaces(&p);
+
+	if (ktap_keyword(&p, "KTAP")) {
+		if (ktap_spaces(&p) && ktap_keyword(&p, "version") &&
+		    ktap_spaces(&p) && ktap_uint(&p, &l->n) && ktap_blank(p))
+			l->type = KTAP_LINE_VERSION;
+
+	} else if (ktap_keyword(&p, "1..")) {
+		if (*p == ' ')
+			l->type = KTAP_LINE_BAD_PLAN;
+		else if (ktap_uint(&p, &l->n) && ktap_blank(p))
+			l->type = KTAP_LINE_PLAN;
+
+	} else if (ktap_keyword(&p, "#")) {
+		if (ktap_spaces(&p) && ktap_keyword(&p, "Subtest:") &&
+		    ktap_spaces(&p) &&
+		    (l->name = ktap_token(&p, &l->name_len)) && ktap_blank(p))
+			l->type = KTAP_LINE_SUBTEST;
+
+	} else {
+		if (ktap_keyword(&p, "not")) {
+			l->not_ok = true;
+			l->not_spaces = ktap_spaces(&p);
+			if (!l->not_spaces)
+				return;
+		}
+
+		if (ktap_keyword(&p, "ok") && ktap_spaces(&p) &&
+		    ktap_uint(&p, &l->n) && ktap_spaces(&p)) {
+			l->desc = p;
+			l->name = ktap_token(&p, &l->name_len);
+			l->rest = p;
+			if (l->name)
+				l->type = KTAP_LINE_RESULT;
+		}
+	}
+}
+
+/*
+ * Result of a test case: "[not ]ok N name", optionally followed by
+ * "# SKIP [message]" or "# message".
+ */
+static bool ktap_case_result(const struct ktap_line *l, int *code, char **msg)
+{
+	const char *p = l->rest;
+	size_t len;
+
+	*msg = NULL;
+
+	if (l->not_ok && l->not_spaces != 1)
+		return false;
+
+	*code = l->not_ok ? IGT_EXIT_FAILURE : IGT_EXIT_SUCCESS;
+	if (ktap_blank(p))
+		return true;
+
+	if (!ktap_spaces(&p) || !ktap_keyword(&p, "#") || !ktap_spaces(&p))
+		return false;
+
+	if (!l->not_ok && !strncmp(p, "SKIP", 4)) {
+		const char *s = p + 4;
+
+		if (ktap_blank(s)) {
+			*code = IGT_EXIT_SKIP;
+			return true;
+		}
+
+		if (ktap_spaces(&s) && *s != '\n' && *s) {
+			*code = IGT_EXIT_SKIP;
+			p = s;
+		}
+	}
+
+	len = strcspn(p, "\n");
+	if (!len)
+		return false;
+
+	*msg = strndup(p, len);
+	return true;
+}
+
+/* Result of a parametrized subtest, only counted */
+static bool ktap_sub_result(const struct ktap_line *l)
+{
+	size_t len = strcspn(l->desc, "#\n");
+
+	if (l->not_ok && l->not_spaces != 1)
+		return false;
+
+	return len && l->desc[len];
+}
+
+/* Result of a test suite: "[not ]ok N name [# ...]" */
+static bool ktap_suite_result(const struct ktap_line *l)
+{
+	const char *p = l->rest;
+
+	return ktap_blank(p) || (ktap_spaces(&p) && *p == '#');
+}
+
+static int ktap_reserve(struct igt_ktap_results *ktap, unsigned int depth)
+{
+	struct ktap_level *levels;
+	unsigned int allocated;
+
+	if (depth < ktap->allocated)
+		return 0;
+
+	allocated = max(depth + 1, 2 * ktap->allocated);
+	levels = realloc(ktap->levels, allocated * sizeof(*levels));
+	if (!levels)
+		return -ENOMEM;
+
+	memset(levels + ktap->allocated, 0,
+	       (allocated - ktap->allocated) * sizeof(*levels));
+	ktap->levels = levels;
+	ktap->allocated = allocated;
+
+	return 0;
+}
+
+/* Reports a test case result, or the start of a parametrized test case */
+static int ktap_add_result(struct igt_ktap_results *ktap,
+			   const struct ktap_line *l, unsigned int n,
+			   int code, char *msg)
+{
+	struct ktap_level *cases = &ktap->levels[1];
 	struct igt_ktap_result *result;
-	int code = IGT_EXIT_INVALID;
-	unsigned int n, len;
-	char s[2];
+	char *case_name;
+
+	if (igt_debug_on(ktap->expect == SUB_RESULT &&
+			 code != IGT_EXIT_INVALID) ||
+	    igt_debug_on(code != IGT_EXIT_INVALID &&
+			 ktap->expect != CASE_RESULT) ||
+	    igt_debug_on(!ktap->suite_name) ||
+	    igt_debug_on(ktap->expect == CASE_RESULT && ktap->case_name &&
+			 (strlen(ktap->case_name) != l->name_len ||
+			  strncmp(l->name, ktap->case_name, l->name_len))) ||
+	    igt_debug_on(n > cases->count) ||
+	    igt_debug_on(n != (ktap->expect == SUB_RESULT ?
+			       cases->last + 1: ++cases->last))) {
+		free(msg);
+		return -EPROTO;
+	}
+
+	case_name = strndup(l->name, l->name_len);
+	if (igt_debug_on(!case_name)) {
+		free(msg);
+		return -ENOMEM;
+	}
+
+	if (ktap->expect == SUB_RESULT) {
+		/* KTAP parametrized test case name */
+		ktap->case_name = case_name;
+
+	} else {
+		/* KTAP test case result */
+		ktap->case_name = NULL;
+
+		/* last test case in a suite */
+		if (n == cases->count)
+			ktap->expect = SUITE_RESULT;
+	}
+
+	if (igt_debug_on((result = calloc(1, sizeof(*result)), !result))) {
+		if (ktap->case_name != case_name)
+			free(case_name);
+		free(msg);
+		return -ENOMEM;
+	}
+
+	result->suite_name = ktap->suite_name;
+	result->case_name = case_name;
+	result->code = code;
+	result->msg = msg;
+	igt_list_add_tail(&result->link, ktap->results);
+
+	return -EINPROGRESS;
+}
+
+/* Lines of the KTAP report itself, the list of test suites */
+static int ktap_parse_report(struct igt_ktap_results *ktap,
+			     const struct ktap_line *l)
+{
+	struct ktap_level *suites = &ktap->levels[0];
 
+	switch (l->type) {
 	/* KTAP report header */
-	if (igt_debug_on(sscanf(buf, "KTAP%*[ ]version%*[ ]%u %n",
-				&n, &len) == 1 && len == strlen(buf))) {
+	case KTAP_LINE_VERSION:
 		if (igt_debug_on(ktap->expect != KTAP_START))
 			return -EPROTO;
 
-		ktap->suite_count = 0;
+		suites->count = 0;
+		ktap->depth = 1;
 		ktap->expect = SUITE_COUNT;
-
-	/* malformed TAP test plan? */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf, " 1..%1[ ]", s) == 1)) {
 		return -EINPROGRESS;
 
-	/* valid test plan of a KTAP report */
-	} else if (igt_debug_on(sscanf(buf, "1..%u %n", &n, &len) == 1 &&
-				len == strlen(buf))) {
+	/* test plan of a KTAP report */
+	case KTAP_LINE_PLAN:
 		if (igt_debug_on(ktap->expect != SUITE_COUNT))
 			return -EPROTO;
 
-		if (!n)
+		if (!l->n)
+			return 0;
+
+		suites->count = l->n;
+		suites->last = 0;
+		ktap->suite_name = NULL;
+		ktap->expect = SUITE_START;
+		return -EINPROGRESS;
+
+	/* KTAP test suite result */
+	case KTAP_LINE_RESULT:
+		if (!ktap_suite_result(l))
+			return -EINPROGRESS;
+
+		if (igt_debug_on(ktap->expect != SUITE_RESULT) ||
+		    igt_debug_on(!ktap->suite_name) ||
+		    igt_debug_on(strlen(ktap->suite_name) != l->name_len ||
+				 strncmp(l->name, ktap->suite_name, l->name_len)) ||
+		    igt_debug_on(l->n != ++suites->last) ||
+		    igt_debug_on(l->n > suites->count))
+			return -EPROTO;
+
+		ktap->depth = 1;
+
+		/* last test suite? */
+		if (l->n == suites->count)
 			return 0;
 
-		ktap->suite_count = n;
-		ktap->suite_last = 0;
 		ktap->suite_name = NULL;
 		ktap->expect = SUITE_START;
+		return -EINPROGRESS;
+
+	default:
+		return -EINPROGRESS;
+	}
+}
 
+/* Lines of a test suite, the list of its test cases */
+static int ktap_parse_suite(struct igt_ktap_results *ktap,
+			    const struct ktap_line *l)
+{
+	struct ktap_level *cases = &ktap->levels[1];
+	int code = IGT_EXIT_INVALID;
+	char *msg;
+
+	switch (l->type) {
 	/* KTAP test suite header */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]KTAP%*[ ]version%*[ ]%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	case KTAP_LINE_VERSION:
 		/*
 		 * TODO: drop the following workaround as soon as
 		 * kernel side issue of missing lines with top level
 		 * KTAP version and test suite plan is fixed.
 		 */
 		if (ktap->expect == KTAP_START) {
-			ktap->suite_count = 1;
-			ktap->suite_last = 0;
+			ktap->levels[0].count = 1;
+			ktap->levels[0].last = 0;
 			ktap->suite_name = NULL;
 			ktap->expect = SUITE_START;
 		}
@@ -105,194 +405,176 @@ int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
 		if (igt_debug_on(ktap->expect != SUITE_START))
 			return -EPROTO;
 
+		ktap->depth = 2;
 		ktap->expect = SUITE_NAME;
+		return -EINPROGRESS;
 
 	/* KTAP test suite name */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]#%*[ ]Subtest:%*[ ]%ms %n",
-				       &suite_name, &len) == 1 && len == strlen(buf))) {
+	case KTAP_LINE_SUBTEST:
 		if (igt_debug_on(ktap->expect != SUITE_NAME))
 			return -EPROTO;
 
-		ktap->suite_name = suite_name;
-		suite_name = NULL;
-		ktap->case_count = 0;
+		ktap->suite_name = strndup(l->name, l->name_len);
+		if (igt_debug_on(!ktap->suite_name))
+			return -ENOMEM;
+
+		cases->count = 0;
 		ktap->expect = CASE_COUNT;
+		return -EINPROGRESS;
 
-	/* valid test plan of a KTAP test suite */
-	} else if (len = 0, free(suite_name), suite_name = NULL,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]1..%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	/* test plan of a KTAP test suite */
+	case KTAP_LINE_PLAN:
 		if (igt_debug_on(ktap->expect != CASE_COUNT))
 			return -EPROTO;
 
-		if (n) {
-			ktap->case_count = n;
-			ktap->case_last = 0;
+		if (l->n) {
+			cases->count = l->n;
+			cases->last = 0;
 			ktap->case_name = NULL;
 			ktap->expect = CASE_RESULT;
 		} else {
 			ktap->expect = SUITE_RESULT;
 		}
+		return -EINPROGRESS;
+
+	/* KTAP test case result */
+	case KTAP_LINE_RESULT:
+		if (!ktap_case_result(l, &code, &msg))
+			return -EINPROGRESS;
+
+		ktap->depth = 2;
+		return ktap_add_result(ktap, l, l->n, code, msg);
 
+	default:
+		return -EINPROGRESS;
+	}
+}
+
+/* Lines of a parametrized test case, the list of its parameters */
+static int ktap_parse_case(struct igt_ktap_results *ktap,
+			   const struct ktap_line *l)
+{
+	struct ktap_level *params = &ktap->levels[2];
+
+	switch (l->type) {
 	/* KTAP parametrized test case header */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]KTAP%*[ ]version%*[ ]%u %n",
-				       &n, &len) == 1 && len == strlen(buf))) {
+	case KTAP_LINE_VERSION:
 		if (igt_debug_on(ktap->expect != CASE_RESULT))
 			return -EPROTO;
 
-		ktap->sub_last = 0;
+		params->last = 0;
+		ktap->depth = 3;
 		ktap->expect = CASE_NAME;
+		return -EINPROGRESS;
 
 	/* KTAP parametrized test case name */
-	} else if (len = 0,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]#%*[ ]Subtest:%*[ ]%ms %n",
-				       &case_name, &len) == 1 && len == strlen(buf))) {
+	case KTAP_LINE_SUBTEST:
 		if (igt_debug_on(ktap->expect != CASE_NAME))
 			return -EPROTO;
 
-		n = ktap->case_last + 1;
 		ktap->expect = SUB_RESULT;
+		return ktap_add_result(ktap, l, ktap->levels[1].last + 1,
+				       IGT_EXIT_INVALID, NULL);
 
 	/* KTAP parametrized subtest result */
-	} else if (len = 0, free(case_name), case_name = NULL,
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%*[^#\n]%1[#\n]",
-				       &n, s) == 2) ||
-		   igt_debug_on(sscanf(buf,
-				       "%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%*[^#\n]%1[#\n]",
-				       &n, s) == 2)) {
-		/* at lease one result of a parametrised subtest expected */
+	case KTAP_LINE_RESULT:
+		if (!ktap_sub_result(l))
+			return -EINPROGRESS;
+
+		/* at least one result of a parametrised subtest expected */
 		if (igt_debug_on(ktap->expect == SUB_RESULT &&
-				 ktap->sub_last == 0))
+				 params->last == 0))
 			ktap->expect = CASE_RESULT;
 
 		if (igt_debug_on(ktap->expect != CASE_RESULT) ||
-		    igt_debug_on(n != ++ktap->sub_last))
+		    igt_debug_on(l->n != ++params->last))
 			return -EPROTO;
 
-	/* KTAP test case skip result */
-	} else if ((igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]SKIP %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]SKIP%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_SKIP;
-
-	/* KTAP test case pass result */
-	} else if ((free(case_name), case_name = NULL, free(msg), msg = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_SUCCESS;
-
-	/* KTAP test case fail result */
-	} else if ((free(case_name), case_name = NULL, free(msg), msg = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &case_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(case_name), case_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"%*1[ ]%*1[ ]%*1[ ]%*1[ ]not%*1[ ]ok%*[ ]%u%*[ ]%ms%*[ ]#%*[ ]%m[^\n]",
-					&n, &case_name, &msg) == 3))) {
-		code = IGT_EXIT_FAILURE;
+		ktap->depth = 3;
+		return -EINPROGRESS;
 
-	/* KTAP test suite result */
-	} else if ((free(case_name), free(msg),
-		    igt_debug_on(sscanf(buf, "ok%*[ ]%u%*[ ]%ms %n",
-					&n, &suite_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf, "ok%*[ ]%u%*[ ]%ms%*[ ]%1[#]",
-					&n, &suite_name, s) == 3)) ||
-		   (free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"not%*[ ]ok%*[ ]%u%*[ ]%ms %n",
-					&n, &suite_name, &len) == 2 &&
-				 len == strlen(buf))) ||
-		   (len = 0, free(suite_name), suite_name = NULL,
-		    igt_debug_on(sscanf(buf,
-					"not%*[ ]ok%*[ ]%u%*[ ]%ms%*[ ]%1[#]",
-					&n, &suite_name, s) == 3))) {
-		if (igt_debug_on(ktap->expect != SUITE_RESULT) ||
-		    igt_debug_on(strcmp(suite_name, ktap->suite_name)) ||
-		    igt_debug_on(n != ++ktap->suite_last) ||
-		    igt_debug_on(n > ktap->suite_count)) {
-			free(suite_name);
+	default:
+		return -EINPROGRESS;
+	}
+}
+
+/*
+ * Lines nested below a parameter of a test case. There is nothing to
+ * report about those, only their plan and numbering are checked.
+ */
+static int ktap_parse_nested(struct igt_ktap_results *ktap,
+			     const struct ktap_line *l, unsigned int depth)
+{
+	struct ktap_level *level = &ktap->levels[depth];
+
+	switch (l->type) {
+	case KTAP_LINE_VERSION:
+		if (igt_debug_on(ktap->depth < depth))
 			return -EPROTO;
-		}
-		free(suite_name);
 
-		/* last test suite? */
-		if (igt_debug_on(n == ktap->suite_count))
-			return 0;
+		level->count = 0;
+		level->last = 0;
+		ktap->depth = depth + 1;
+		return -EINPROGRESS;
 
-		ktap->suite_name = NULL;
-		ktap->expect = SUITE_START;
+	case KTAP_LINE_PLAN:
+		if (igt_debug_on(ktap->depth != depth + 1))
+			return -EPROTO;
 
-	} else {
+		level->count = l->n;
 		return -EINPROGRESS;
-	}
 
-	/* neither a test case name nor result */
-	if (ktap->expect != SUB_RESULT && code == IGT_EXIT_INVALID)
+	case KTAP_LINE_RESULT:
+		if (igt_debug_on(ktap->depth <= depth) ||
+		    igt_debug_on(l->n != ++level->last) ||
+		    igt_debug_on(level->count && l->n > level->count))
+			return -EPROTO;
+
+		ktap->depth = depth + 1;
 		return -EINPROGRESS;
 
-	if (igt_debug_on(ktap->expect == SUB_RESULT &&
-			 code != IGT_EXIT_INVALID) ||
-	    igt_debug_on(code != IGT_EXIT_INVALID &&
-			 ktap->expect != CASE_RESULT) ||
-	    igt_debug_on(!ktap->suite_name) || igt_debug_on(!case_name) ||
-	    igt_debug_on(ktap->expect == CASE_RESULT && ktap->case_name &&
-			 strcmp(case_name, ktap->case_name)) ||
-	    igt_debug_on(n > ktap->case_count) ||
-	    igt_debug_on(n != (ktap->expect == SUB_RESULT ?
-			       ktap->case_last + 1: ++ktap->case_last))) {
-		free(case_name);
-		free(msg);
-		return -EPROTO;
+	default:
+		return -EINPROGRESS;
 	}
+}
 
-	if (ktap->expect == SUB_RESULT) {
-		/* KTAP parametrized test case name */
-		ktap->case_name = case_name;
+static int (* const ktap_parse_level[])(struct igt_ktap_results *ktap,
+					const struct ktap_line *l) = {
+	ktap_parse_report,
+	ktap_parse_suite,
+	ktap_parse_case,
+};
 
-	} else {
-		/* KTAP test case result */
-		ktap->case_name = NULL;
+/**
+ * igt_ktap_parse:
+ *
+ * This function parses a line of text for KTAP report data
+ * and passes results back to IGT kunit layer.
+ *
+ * Each line is tokenized once and then run through the state machine of
+ * the report, so the cost of parsing does not depend on how far down the
+ * list of possible line formats the current line is. Nesting levels are
+ * kept on a stack indexed by indentation, so any depth is accepted.
+ */
+int igt_ktap_parse(const char *buf, struct igt_ktap_results *ktap)
+{
+	struct ktap_line l;
+	unsigned int depth;
 
-		/* last test case in a suite */
-		if (n == ktap->case_count)
-			ktap->expect = SUITE_RESULT;
-	}
+	ktap_tokenize(buf, &l);
 
-	if (igt_debug_on((result = calloc(1, sizeof(*result)), !result))) {
-		free(case_name);
-		free(msg);
+	if (l.type == KTAP_LINE_OTHER || l.type == KTAP_LINE_BAD_PLAN ||
+	    l.indent % 4)
+		return -EINPROGRESS;
+
+	depth = l.indent / 4;
+	if (igt_debug_on(ktap_reserve(ktap, depth)))
 		return -ENOMEM;
-	}
 
-	result->suite_name = ktap->suite_name;
-	result->case_name = case_name;
-	result->code = code;
-	result->msg = msg;
-	igt_list_add_tail(&result->link, ktap->results);
+	if (depth < ARRAY_SIZE(ktap_parse_level))
+		return ktap_parse_level[depth](ktap, &l);
 
-	return -EINPROGRESS;
+	return ktap_parse_nested(ktap, &l, depth);
 }
 
 struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results)
@@ -302,6 +584,11 @@ struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results)
 	if (!ktap)
 		return NULL;
 
+	if (ktap_reserve(ktap, ARRAY_SIZE(ktap_parse_level) - 1)) {
+		free(ktap);
+		return NULL;
+	}
+
 	ktap->expect = KTAP_START;
 	ktap->results = results;
 
@@ -310,11 +597,10 @@ struct igt_ktap_results *igt_ktap_alloc(struct igt_list_head *results)
 
 void igt_ktap_free(struct igt_ktap_results *ktap)
 {
+	free(ktap->levels);
 	free(ktap);
 }
 
-#define DELIMITER "-"
-
 struct ktap_parser_args {
 	int fd;
 	bool is_builtin;
@@ -323,527 +609,248 @@ struct ktap_parser_args {
 
 static struct ktap_test_results results;
 
-static int log_to_end(enum igt_log_level level, int fd,
-		      char *record, const char *format, ...) __attribute__((format(printf, 4, 5)));
+/* Maximum number of results handed over to the consumer at once */
+#define KTAP_BATCH 64
+
+struct ktap_parser_state {
+	struct igt_ktap_results *ktap;
+	struct igt_list_head list;
+	/* results not published yet, newest first */
+	struct ktap_test_results_element *first, *last;
+	unsigned int batch;
+	char *suite_name, *case_name;
+	/* -EINPROGRESS until the end of the report or an error */
+	int err;
+	char line[IGT_KMSG_RECORD_MAX + 2];
+};
 
-/**
- * log_to_end:
- * @level: #igt_log_level
- * @record: record to store the read data
- * @format: format string
- * @...: optional arguments used in the format string
- *
- * This is an altered version of the generic structured logging helper function
- * igt_log capable of reading to the end of a given line.
- *
- * Returns: 0 for success, or -2 if there's an error reading from the file
+/*
+ * Hands a batch of results, linked newest first from @first to @last, over
+ * to the consumer with a single atomic operation.
  */
-static int log_to_end(enum igt_log_level level, int fd,
-		      char *record, const char *format, ...)
+static void ktap_results_publish(struct ktap_test_results_element *first,
+				 struct ktap_test_results_element *last)
 {
-	va_list args;
-	const char *lend;
-
-	/* Cutoff after newline character, in order to not display garbage */
-	char *cutoff = strchr(record, '\n');
-	if (cutoff) {
-		if (cutoff - record < BUF_LEN)
-			cutoff[1] = '\0';
-	}
-
-	va_start(args, format);
-	igt_vlog(IGT_LOG_DOMAIN, level, format, args);
-	va_end(args);
+	struct ktap_test_results_element *head;
 
-	lend = strchrnul(record, '\n');
-	while (*lend == '\0') {
-		igt_log(IGT_LOG_DOMAIN, level, "%s", record);
+	if (!first)
+		return;
 
-		if (read(fd, record, BUF_LEN) < 0) {
-			if (errno == EPIPE)
-				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-			else
-				igt_warn("an error occurred while reading kmsg: %m\n");
-
-			return -2;
-		}
-
-		lend = strchrnul(record, '\n');
-	}
-	return 0;
+	head = atomic_load(&results.pending);
+	do {
+		last->next = head;
+	} while (!atomic_compare_exchange_weak(&results.pending, &head, first));
 }
 
 /**
- * lookup_value:
- * @haystack: the string to search in
- * @needle: the string to search for
+ * ktap_results_pop:
+ * @r: results of a running parser, as returned by ktap_parser_start()
+ *
+ * Takes the oldest result published by the parser thread. Must only be
+ * called from a single consumer thread.
  *
- * Returns: the value of the needle in the haystack, or -1 if not found.
+ * Returns: the result, to be released with free(), or NULL if none is
+ * available yet.
  */
-static long lookup_value(const char *haystack, const char *needle)
+struct ktap_test_results_element *ktap_results_pop(struct ktap_test_results *r)
 {
-	const char *needle_rptr;
-	char *needle_end;
-	long num;
-
-	needle_rptr = strcasestr(haystack, needle);
+	struct ktap_test_results_element *result;
 
-	if (needle_rptr == NULL)
-		return -1;
+	if (igt_list_empty(&r->list)) {
+		result = atomic_exchange(&r->pending, NULL);
 
-	/* Skip search string and whitespaces after it */
-	needle_rptr += strlen(needle);
+		/* published newest first, reverse into our FIFO */
+		while (result) {
+			struct ktap_test_results_element *next = result->next;
 
-	num = strtol(needle_rptr, &needle_end, 10);
+			igt_list_add(&result->link, &r->list);
+			result = next;
+		}
 
-	if (needle_rptr == needle_end)
-		return -1;
+		if (igt_list_empty(&r->list))
+			return NULL;
+	}
 
-	if (num == LONG_MIN || num == LONG_MAX)
-		return 0;
+	result = igt_list_first_entry(&r->list, result, link);
+	igt_list_del(&result->link);
 
-	return num > 0 ? num : 0;
+	return result;
 }
 
 /**
- * tap_version_present:
- * @record: buffer with tap data
- * @print_info: whether tap version should be printed or not
+ * ktap_results_done:
+ * @r: results of a parser, as returned by ktap_parser_start()
  *
- * Returns:
- * 0 if not found
- * 1 if found
+ * Returns: true once the parser thread has finished and all its results have
+ * been taken with ktap_results_pop().
  */
-static int tap_version_present(char* record, bool print_info)
+bool ktap_results_done(struct ktap_test_results *r)
 {
-	/*
-	 * "(K)TAP version XX" should be the first line on all (sub)tests as per
-	 * https://kernel.org/doc/html/latest/dev-tools/ktap.html#version-lines
-	 *
-	 * but actually isn't, as it currently depends on the KUnit module
-	 * being built-in, so we can't rely on it every time
-	 */
-	const char *version_rptr = strcasestr(record, "TAP version ");
-	char *cutoff;
-
-	if (version_rptr == NULL)
-		return 0;
+	/* the parser publishes its last batch before it stops running */
+	if (atomic_load(&r->still_running))
+		return false;
 
-	/* Cutoff after newline character, in order to not display garbage */
-	cutoff = strchr(version_rptr, '\n');
-	if (cutoff)
-		cutoff[0] = '\0';
-
-	if (print_info)
-		igt_info("%s\n", version_rptr);
-
-	return 1;
+	return igt_list_empty(&r->list) && !atomic_load(&r->pending);
 }
 
-/**
- * find_next_tap_subtest:
- * @fd: file descriptor
- * @record: buffer used to read fd
- * @is_builtin: whether KUnit is built-in or not
- *
- * Returns:
- * 0 if there's missing information
- * -1 if not found
- * -2 if there are problems while reading the file.
- * any other value corresponds to the amount of cases of the next (sub)test
- */
-static int find_next_tap_subtest(int fd, char *record, char *test_name, bool is_builtin)
+static void ktap_parser_publish(struct ktap_parser_state *s)
 {
-	const char *test_lookup_str, *subtest_lookup_str, *name_rptr;
-	long test_count;
-	char *cutoff;
-
-	test_name[0] = '\0';
-	test_name[BUF_LEN] = '\0';
-
-	test_lookup_str = " subtest: ";
-	subtest_lookup_str = " test: ";
-
-	if (!tap_version_present(record, true))
-		return -1;
-
-	if (is_builtin) {
-		if (read(fd, record, BUF_LEN) < 0) {
-			if (errno == EPIPE)
-				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-			else
-				igt_warn("an error occurred while reading kmsg: %m\n");
-
-			return -2;
-		}
-	}
-
-	name_rptr = strcasestr(record, test_lookup_str);
-	if (name_rptr != NULL) {
-		name_rptr += strlen(test_lookup_str);
-	} else {
-		name_rptr = strcasestr(record, subtest_lookup_str);
-		if (name_rptr != NULL)
-			name_rptr += strlen(subtest_lookup_str);
-	}
-
-	if (name_rptr == NULL) {
-		if (!is_builtin)
-			/* We've probably found nothing */
-			return -1;
-		igt_info("Missing test name\n");
-	} else {
-		strncpy(test_name, name_rptr, BUF_LEN);
-		/* Cutoff after newline character, in order to not display garbage */
-		cutoff = strchr(test_name, '\n');
-		if (cutoff)
-			cutoff[0] = '\0';
-
-		if (read(fd, record, BUF_LEN) < 0) {
-			if (errno == EPIPE)
-				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-			else
-				igt_warn("unknown error reading kmsg (%m)\n");
-
-			return -2;
-		}
-
-		/* Now we can be sure we found tests */
-		if (!is_builtin)
-			igt_info("KUnit is not built-in, skipping version check...\n");
-	}
-
-	/*
-	 * Total test count will almost always appear as 0..N at the beginning
-	 * of a run, so we use it to reliably identify a new run
-	 */
-	test_count = lookup_value(record, "..");
-
-	if (test_count <= 0) {
-		igt_info("Missing test count\n");
-		if (test_name[0] == '\0')
-			return 0;
-		if (log_to_end(IGT_LOG_INFO, fd, record,
-				"Running some tests in: %s\n",
-				test_name) < 0)
-			return -2;
-		return 0;
-	} else if (test_name[0] == '\0') {
-		igt_info("Running %ld tests...\n", test_count);
-		return 0;
-	}
-
-	if (log_to_end(IGT_LOG_INFO, fd, record,
-			"Executing %ld tests in: %s\n",
-			test_count, test_name) < 0)
-		return -2;
-
-	return test_count;
+	ktap_results_publish(s->first, s->last);
+	s->first = s->last = NULL;
+	s->batch = 0;
 }
 
-/**
- * parse_kmsg_for_tap:
- * @fd: file descriptor
- * @record: buffer used to read fd
- * @test_name: buffer to store the test name
- *
- * Returns:
- * 1 if no results were found
- * 0 if a test succeded
- * -1 if a test failed
- * -2 if there are problems reading the file
- */
-static int parse_kmsg_for_tap(int fd, char *record, char *test_name)
+/* kmsg subscriber, runs every record through the KTAP parser */
+static void ktap_parse_record(const struct igt_kmsg_record *record, void *data)
 {
-	const char *lstart, *ok_lookup_str, *nok_lookup_str,
-	      *ok_rptr, *nok_rptr, *comment_start, *value_parse_start;
-	char *test_name_end;
-
-	ok_lookup_str = "ok ";
-	nok_lookup_str = "not ok ";
-
-	lstart = strchrnul(record, ';');
-
-	if (*lstart == '\0') {
-		igt_warn("kmsg truncated: output malformed (%m)\n");
-		return -2;
-	}
+	struct ktap_parser_state *s = data;
+	struct igt_ktap_result *r, *rn;
+	size_t len = record->msg_len;
+	int err;
 
-	lstart++;
-	while (isspace(*lstart))
-		lstart++;
-
-	nok_rptr = strstr(lstart, nok_lookup_str);
-	if (nok_rptr != NULL) {
-		nok_rptr += strlen(nok_lookup_str);
-		while (isdigit(*nok_rptr) || isspace(*nok_rptr) || *nok_rptr == '-')
-			nok_rptr++;
-		test_name_end = strncpy(test_name, nok_rptr, BUF_LEN);
-		while (!isspace(*test_name_end))
-			test_name_end++;
-		*test_name_end = '\0';
-		if (log_to_end(IGT_LOG_WARN, fd, record,
-			       "%s", lstart) < 0)
-			return -2;
-		return -1;
-	}
+	if (s->err != -EINPROGRESS)
+		return;
 
-	comment_start = strchrnul(lstart, '#');
+	if (len > sizeof(s->line) - 2)
+		len = sizeof(s->line) - 2;
+	memcpy(s->line, record->msg, len);
+	s->line[len] = '\n';
+	s->line[len + 1] = '\0';
 
-	/* Check if we're still in a subtest */
-	if (*comment_start != '\0') {
-		comment_start++;
-		value_parse_start = comment_start;
+	err = igt_ktap_parse(s->line, s->ktap);
 
-		if (lookup_value(value_parse_start, "fail: ") > 0) {
-			if (log_to_end(IGT_LOG_WARN, fd, record,
-				       "%s", lstart) < 0)
-				return -2;
-			return -1;
-		}
+	/* parsing error */
+	if (err && err != -EINPROGRESS) {
+		s->err = err;
+		return;
 	}
 
-	ok_rptr = strstr(lstart, ok_lookup_str);
-	if (ok_rptr != NULL) {
-		ok_rptr += strlen(ok_lookup_str);
-		while (isdigit(*ok_rptr) || isspace(*ok_rptr) || *ok_rptr == '-')
-			ok_rptr++;
-		test_name_end = strncpy(test_name, ok_rptr, BUF_LEN);
-		while (!isspace(*test_name_end))
-			test_name_end++;
-		*test_name_end = '\0';
-		return 0;
-	}
+	igt_list_for_each_entry_safe(r, rn, &s->list, link) {
+		struct ktap_test_results_element *result = NULL;
+		int code = r->code;
 
-	return 1;
-}
+		if (code != IGT_EXIT_INVALID)
+			result = calloc(1, sizeof(*result));
 
-/**
- * parse_tap_level:
- * @fd: file descriptor
- * @base_test_name: test_name from upper recursion level
- * @test_count: test_count of this level
- * @failed_tests: top level failed_tests pointer
- * @found_tests: top level found_tests pointer
- * @is_builtin: whether the KUnit module is built-in or not
- *
- * Returns:
- * 0 if succeded
- * -1 if error occurred
- */
-__maybe_unused
-static int parse_tap_level(int fd, char *base_test_name, int test_count, bool *failed_tests,
-			   bool *found_tests, bool is_builtin)
-{
-	char record[BUF_LEN + 1];
-	struct ktap_test_results_element *r;
-	int internal_test_count;
-	char test_name[BUF_LEN + 1];
-	char base_test_name_for_next_level[BUF_LEN + 1];
-
-	for (int i = 0; i < test_count; i++) {
-		if (read(fd, record, BUF_LEN) < 0) {
-			if (errno == EPIPE)
-				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-			else
-				igt_warn("error reading kmsg (%m)\n");
+		if (result) {
+			snprintf(result->test_name, sizeof(result->test_name),
+				 "%s-%s", r->suite_name, r->case_name);
 
-			return -1;
+			if (code == IGT_EXIT_SUCCESS)
+				result->passed = true;
 		}
 
-		/* Sublevel found */
-		if (tap_version_present(record, false))
-		{
-			internal_test_count = find_next_tap_subtest(fd, record, test_name,
-								    is_builtin);
-			switch (internal_test_count) {
-			case -2:
-				/* No more data to read */
-				return -1;
-			case -1:
-				/* No test found */
-				return -1;
-			case 0:
-				/* Tests found, but they're missing info */
-				*found_tests = true;
-				return -1;
-			default:
-				*found_tests = true;
-
-				memcpy(base_test_name_for_next_level, base_test_name, BUF_LEN);
-				if (strlen(base_test_name_for_next_level) < BUF_LEN - 1 &&
-				    base_test_name_for_next_level[0])
-					strncat(base_test_name_for_next_level, DELIMITER,
-						BUF_LEN - strlen(base_test_name_for_next_level));
-				memcpy(base_test_name_for_next_level + strlen(base_test_name_for_next_level),
-				       test_name, BUF_LEN - strlen(base_test_name_for_next_level));
-
-				if (parse_tap_level(fd, base_test_name_for_next_level,
-						    internal_test_count, failed_tests, found_tests,
-						    is_builtin) == -1)
-					return -1;
-				break;
-			}
+		igt_list_del(&r->link);
+		if (r->suite_name != s->suite_name) {
+			free(s->suite_name);
+			s->suite_name = r->suite_name;
 		}
+		if (r->case_name != s->case_name) {
+			free(s->case_name);
+			s->case_name = r->case_name;
+		}
+		free(r->msg);
+		free(r);
 
-		switch (parse_kmsg_for_tap(fd, record, test_name)) {
-		case -2:
-			return -1;
-		case -1:
-			*failed_tests = true;
-
-			r = malloc(sizeof(*r));
-
-			memcpy(r->test_name, base_test_name, BUF_LEN);
-			if (strlen(r->test_name) < BUF_LEN - 1)
-				if (r->test_name[0])
-					strncat(r->test_name, DELIMITER,
-						BUF_LEN - strlen(r->test_name));
-			memcpy(r->test_name + strlen(r->test_name), test_name,
-			       BUF_LEN - strlen(r->test_name));
-			r->test_name[BUF_LEN] = '\0';
-
-			r->passed = false;
-
-			pthread_mutex_lock(&results.mutex);
-			igt_list_add_tail(&r->link, &results.list);
-			pthread_mutex_unlock(&results.mutex);
-
-			test_name[0] = '\0';
-			break;
-		case 0:
-			r = malloc(sizeof(*r));
+		/*
+		 * no extra result record expected on start
+		 * of parametrized test case -- skip it
+		 */
+		if (code == IGT_EXIT_INVALID)
+			continue;
 
-			memcpy(r->test_name, base_test_name, BUF_LEN);
-			if (strlen(r->test_name) < BUF_LEN - 1)
-				if (r->test_name[0])
-					strncat(r->test_name, DELIMITER,
-						BUF_LEN - strlen(r->test_name));
-			memcpy(r->test_name + strlen(r->test_name), test_name,
-			       BUF_LEN - strlen(r->test_name));
-			r->test_name[BUF_LEN] = '\0';
+		if (!result) {
+			s->err = -ENOMEM;
+			return;
+		}
 
-			r->passed = true;
+		result->next = s->first;
+		s->first = result;
+		if (!s->last)
+			s->last = result;
+		s->batch++;
+	}
 
-			pthread_mutex_lock(&results.mutex);
-			igt_list_add_tail(&r->link, &results.list);
-			pthread_mutex_unlock(&results.mutex);
+	/* 0 at the end of KTAP report */
+	s->err = err;
 
-			test_name[0] = '\0';
-			break;
-		default:
-			break;
-		}
-	}
-	return 0;
+	if (s->batch >= KTAP_BATCH)
+		ktap_parser_publish(s);
 }
 
 /**
  * igt_ktap_parser:
  *
  * This function parses the output of a ktap script and passes it to main thread.
+ * Records are drained from kmsg as they come and results are handed over in
+ * batches whenever the input runs dry.
  */
 void *igt_ktap_parser(void *unused)
 {
-	char record[BUF_LEN + 1], *buf, *suite_name = NULL, *case_name = NULL;
-	struct igt_ktap_results *ktap = NULL;
-	int fd = ktap_args.fd;
-	IGT_LIST_HEAD(list);
-	int err;
+	struct ktap_parser_state *s;
+	struct igt_kmsg kmsg;
+	int err = -ENOMEM;
 
-	ktap = igt_ktap_alloc(&list);
-	if (igt_debug_on(!ktap))
+	s = calloc(1, sizeof(*s));
+	if (igt_debug_on(!s))
 		goto igt_ktap_parser_end;
 
-	while (err = read(fd, record, BUF_LEN), err > 0) {
-		struct igt_ktap_result *r, *rn;
+	IGT_INIT_LIST_HEAD(&s->list);
+	s->err = -EINPROGRESS;
 
-		/* skip kmsg continuation lines */
-		if (igt_debug_on(*record == ' '))
-			continue;
+	s->ktap = igt_ktap_alloc(&s->list);
+	if (igt_debug_on(!s->ktap))
+		goto igt_ktap_parser_end;
 
-		/* NULL-terminate the record */
-		record[err] = '\0';
+	err = igt_kmsg_init_fd(&kmsg, ktap_args.fd);
+	if (!err)
+		err = igt_kmsg_subscribe(&kmsg, ktap_parse_record, s);
+	if (err) {
+		igt_warn("error reading kmsg (%s)\n", strerror(-err));
+		igt_kmsg_fini(&kmsg);
+		goto igt_ktap_parser_end;
+	}
 
-		/* detect start of log message, continue if not found */
-		buf = strchrnul(record, ';');
-		if (igt_debug_on(*buf == '\0'))
-			continue;
-		buf++;
-
-		err = igt_ktap_parse(buf, ktap);
-
-		/* parsing error */
-		if (err && err != -EINPROGRESS)
-			goto igt_ktap_parser_end;
-
-		igt_list_for_each_entry_safe(r, rn, &list, link) {
-			struct ktap_test_results_element *result = NULL;
-			int code = r->code;
-
-			if (code != IGT_EXIT_INVALID)
-				result = calloc(1, sizeof(*result));
-
-			if (result) {
-				snprintf(result->test_name, sizeof(result->test_name),
-					 "%s-%s", r->suite_name, r->case_name);
-
-				if (code == IGT_EXIT_SUCCESS)
-					result->passed = true;
-			}
-
-			igt_list_del(&r->link);
-			if (r->suite_name != suite_name) {
-				free(suite_name);
-				suite_name = r->suite_name;
-			}
-			if (r->case_name != case_name) {
-				free(case_name);
-				case_name = r->case_name;
-			}
-			free(r->msg);
-			free(r);
-
-			/*
-			 * no extra result record expected on start
-			 * of parametrized test case -- skip it
-			 */
-			if (code == IGT_EXIT_INVALID)
-				continue;
-
-			if (!result) {
-				err = -ENOMEM;
-				goto igt_ktap_parser_end;
-			}
-
-			pthread_mutex_lock(&results.mutex);
-			igt_list_add_tail(&result->link, &results.list);
-			pthread_mutex_unlock(&results.mutex);
+	while (s->err == -EINPROGRESS && !kmsg.eof) {
+		err = igt_kmsg_wait(&kmsg, -1);
+		if (err >= 0)
+			err = igt_kmsg_drain(&kmsg);
+		if (err >= 0 && kmsg.lost)
+			err = -EPIPE;
+
+		if (err < 0) {
+			if (err == -EPIPE)
+				igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
+			else
+				igt_warn("error reading kmsg (%s)\n", strerror(-err));
+			break;
 		}
 
-		/* end of KTAP report */
-		if (!err)
-			goto igt_ktap_parser_end;
+		ktap_parser_publish(s);
+		igt_kmsg_discard(&kmsg);
 	}
 
-	if (err < 0) {
-		if (errno == EPIPE)
-			igt_warn("kmsg truncated: too many messages. You may want to increase log_buf_len in kmcdline\n");
-		else
-			igt_warn("error reading kmsg (%m)\n");
-	}
+	igt_kmsg_fini(&kmsg);
+
+	/* a log ending before the report does is not an error */
+	if (err >= 0)
+		err = s->err == -EINPROGRESS ? 0 : s->err;
 
 igt_ktap_parser_end:
-	free(suite_name);
-	free(case_name);
+	if (s) {
+		ktap_parser_publish(s);
+
+		free(s->suite_name);
+		free(s->case_name);
+		if (s->ktap)
+			igt_ktap_free(s->ktap);
+		free(s);
+	}
 
 	if (!err)
 		ktap_args.ret = IGT_EXIT_SUCCESS;
 
-	results.still_running = false;
-
-	if (ktap)
-		igt_ktap_free(ktap);
+	atomic_store(&results.still_running, false);
 
 	return NULL;
 }
@@ -853,8 +860,8 @@ static pthread_t ktap_parser_thread;
 struct ktap_test_results *ktap_parser_start(int fd, bool is_builtin)
 {
 	IGT_INIT_LIST_HEAD(&results.list);
-	pthread_mutex_init(&results.mutex, NULL);
-	results.still_running = true;
+	atomic_init(&results.pending, NULL);
+	atomic_init(&results.still_running, true);
 
 	ktap_args.fd = fd;
 	ktap_args.is_builtin = is_builtin;
@@ -28,6 +28,8 @@
 #define BUF_LEN 4096
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 
 #include "igt_list.h"
 
@@ -51,17 +53,20 @@ typedef struct ktap_test_results_element {
 	char test_name[BUF_LEN + 1];
 	bool passed;
 	struct igt_list_head link;
+	struct ktap_test_results_element *next;
 } ktap_test_results_element;
 
 struct ktap_test_results {
+	/* published by the parser thread, newest first */
+	struct ktap_test_results_element *_Atomic pending;
+	/* taken over by the consumer, oldest first */
 	struct igt_list_head list;
-	pthread_mutex_t mutex;
-	bool still_running;
+	atomic_bool still_running;
 };
 
-
-
 struct ktap_test_results *ktap_parser_start(int fd, bool is_builtin);
+struct ktap_test_results_element *ktap_results_pop(struct ktap_test_results *r);
+bool ktap_results_done(struct ktap_test_results *r);
 void ktap_parser_cancel(void);
 int ktap_parser_stop(void);
 
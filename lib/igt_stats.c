@@ -671,3 +671,240 @@ double igt_mean_get_variance(struct igt_mean *m)
 	return m->sq / m->count;
 }
 
+
+/*
+ * Values below 2^precision get a bucket each, above that every power of two
+ * range is split into 2^precision equal buckets. The relative error of any
+ * reported value is therefore bounded by 2^-precision, regardless of the
+ * number of samples pushed.
+ */
+#define IGT_HISTOGRAM_DEFAULT_PRECISION 7
+
+static unsigned int histogram_index(const struct igt_histogram *h,
+				    uint64_t value)
+{
+	const uint64_t sub = 1ull << h->precision;
+	unsigned int shift;
+
+	if (value < sub)
+		return value;
+
+	shift = 63 - __builtin_clzll(value) - h->precision;
+
+	return (shift + 1) * sub + ((value >> shift) - sub);
+}
+
+static uint64_t histogram_lowest(const struct igt_histogram *h,
+				 unsigned int idx)
+{
+	const uint64_t sub = 1ull << h->precision;
+	unsigned int shift;
+
+	if (idx < sub)
+		return idx;
+
+	shift = idx / sub - 1;
+
+	return (sub + idx % sub) << shift;
+}
+
+/**
+ * igt_histogram_init_with_precision:
+ * @h: histogram
+ * @precision: number of significant bits kept for each value
+ *
+ * Like igt_histogram_init() but allows to trade memory for accuracy. Reported
+ * percentiles are within a relative error of 2^-@precision, @h takes
+ * (65 - @precision) * 2^@precision buckets.
+ *
+ * igt_histogram_fini() must be called once finished with @h.
+ */
+void igt_histogram_init_with_precision(struct igt_histogram *h,
+				       unsigned int precision)
+{
+	igt_assert(precision >= 1 && precision <= 16);
+
+	memset(h, 0, sizeof(*h));
+	h->precision = precision;
+	h->n_buckets = (65 - precision) << precision;
+	h->buckets = calloc(h->n_buckets, sizeof(*h->buckets));
+	igt_assert(h->buckets);
+
+	h->min = U64_MAX;
+}
+
+/**
+ * igt_histogram_init:
+ * @h: histogram
+ *
+ * Initializes @h for accumulating samples, the memory used is independent
+ * from the number of samples pushed. igt_histogram_fini() must be called
+ * once finished with @h.
+ */
+void igt_histogram_init(struct igt_histogram *h)
+{
+	igt_histogram_init_with_precision(h, IGT_HISTOGRAM_DEFAULT_PRECISION);
+}
+
+/**
+ * igt_histogram_fini:
+ * @h: histogram
+ *
+ * Frees resources allocated in igt_histogram_init().
+ */
+void igt_histogram_fini(struct igt_histogram *h)
+{
+	free(h->buckets);
+	h->buckets = NULL;
+}
+
+/**
+ * igt_histogram_reset:
+ * @h: histogram
+ *
+ * Drops all samples from @h, keeping its precision.
+ */
+void igt_histogram_reset(struct igt_histogram *h)
+{
+	memset(h->buckets, 0, h->n_buckets * sizeof(*h->buckets));
+	h->count = 0;
+	h->sum = 0;
+	h->min = U64_MAX;
+	h->max = 0;
+}
+
+/**
+ * igt_histogram_push:
+ * @h: histogram
+ * @value: sample
+ *
+ * Adds a new sample @value to @h in constant time.
+ */
+void igt_histogram_push(struct igt_histogram *h, uint64_t value)
+{
+	h->buckets[histogram_index(h, value)]++;
+	h->count++;
+	h->sum += value;
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+/**
+ * igt_histogram_merge:
+ * @dst: histogram to accumulate into
+ * @src: histogram to add
+ *
+ * Adds all samples from @src to @dst, e.g. to combine histograms filled by
+ * different threads. Both must have been initialized with the same precision.
+ */
+void igt_histogram_merge(struct igt_histogram *dst,
+			 const struct igt_histogram *src)
+{
+	igt_assert_eq(dst->precision, src->precision);
+
+	for (unsigned int i = 0; i < dst->n_buckets; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/**
+ * igt_histogram_get_count:
+ * @h: histogram
+ *
+ * Retrieves the number of samples pushed into @h.
+ */
+uint64_t igt_histogram_get_count(const struct igt_histogram *h)
+{
+	return h->count;
+}
+
+/**
+ * igt_histogram_get_min:
+ * @h: histogram
+ *
+ * Retrieves the exact minimal value pushed into @h.
+ */
+uint64_t igt_histogram_get_min(const struct igt_histogram *h)
+{
+	return h->count ? h->min : 0;
+}
+
+/**
+ * igt_histogram_get_max:
+ * @h: histogram
+ *
+ * Retrieves the exact maximal value pushed into @h.
+ */
+uint64_t igt_histogram_get_max(const struct igt_histogram *h)
+{
+	return h->max;
+}
+
+/**
+ * igt_histogram_get_mean:
+ * @h: histogram
+ *
+ * Retrieves the exact mean of all samples pushed into @h.
+ */
+double igt_histogram_get_mean(const struct igt_histogram *h)
+{
+	return h->count ? h->sum / h->count : 0.;
+}
+
+/**
+ * igt_histogram_get_percentile:
+ * @h: histogram
+ * @percentile: percentile to query, from 0 to 100
+ *
+ * Retrieves the value below or at which @percentile percent of the samples
+ * lie, e.g. 50 for the median, 99.9 for the tail latency. The result is
+ * exact for the minimum, maximum and values below 2^precision, otherwise it
+ * is within the relative error given by the precision of @h.
+ */
+uint64_t igt_histogram_get_percentile(const struct igt_histogram *h,
+				      double percentile)
+{
+	uint64_t rank, seen = 0;
+
+	if (!h->count)
+		return 0;
+
+	if (percentile <= 0.)
+		return h->min;
+
+	if (percentile >= 100.)
+		return h->max;
+
+	rank = ceil(percentile / 100. * h->count);
+	if (rank < 1)
+		rank = 1;
+
+	for (unsigned int i = 0; i < h->n_buckets; i++) {
+		uint64_t lo, hi;
+
+		seen += h->buckets[i];
+		if (seen < rank)
+			continue;
+
+		/* report the middle of the bucket, clamped to what we saw */
+		lo = histogram_lowest(h, i);
+		hi = i + 1 < h->n_buckets ? histogram_lowest(h, i + 1) - 1 : U64_MAX;
+		lo += (hi - lo) / 2;
+		if (lo < h->min)
+			lo = h->min;
+		if (lo > h->max)
+			lo = h->max;
+
+		return lo;
+	}
+
+	return h->max;
+}
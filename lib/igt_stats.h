@@ -101,4 +101,36 @@ void igt_mean_add(struct igt_mean *m, double v);
 double igt_mean_get(struct igt_mean *m);
 double igt_mean_get_variance(struct igt_mean *m);
 
+/**
+ * igt_histogram:
+ *
+ * Constant memory log-linear histogram for long running latency
+ * measurements. Needs to be initialized with igt_histogram_init() and
+ * released with igt_histogram_fini(). Instances can be combined with
+ * igt_histogram_merge(), so each thread should keep its own.
+ */
+struct igt_histogram {
+	/*< private >*/
+	uint64_t *buckets;
+	unsigned int precision;
+	unsigned int n_buckets;
+	uint64_t count, min, max;
+	double sum;
+};
+
+void igt_histogram_init(struct igt_histogram *h);
+void igt_histogram_init_with_precision(struct igt_histogram *h,
+				       unsigned int precision);
+void igt_histogram_fini(struct igt_histogram *h);
+void igt_histogram_reset(struct igt_histogram *h);
+void igt_histogram_push(struct igt_histogram *h, uint64_t value);
+void igt_histogram_merge(struct igt_histogram *dst,
+			 const struct igt_histogram *src);
+uint64_t igt_histogram_get_count(const struct igt_histogram *h);
+uint64_t igt_histogram_get_min(const struct igt_histogram *h);
+uint64_t igt_histogram_get_max(const struct igt_histogram *h);
+double igt_histogram_get_mean(const struct igt_histogram *h);
+uint64_t igt_histogram_get_percentile(const struct igt_histogram *h,
+				      double percentile);
+
 #endif /* __IGT_STATS_H__ */
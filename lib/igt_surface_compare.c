@@ -0,0 +1,397 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_surface_compare.h"
+#include "igt_x86.h"
+
+/**
+ * SECTION:igt_surface_compare
+ * @short_description: Block-wise surface comparison
+ * @title: Surface compare
+ * @include: igt_surface_compare.h
+ *
+ * Compares two surfaces and counts the differing pixels of each block of
+ * a given size in a single pass, for corruption maps and statistics
+ * instead of a plain equal/not equal answer.
+ *
+ * Rows are compared with memcmp() first, so identical rows cost little
+ * more than reading them, and only the blocks of differing rows are
+ * counted, a vector of pixels at a time. Large surfaces are split across
+ * threads by block rows.
+ */
+
+static unsigned int count_diff_c(const uint8_t *a, const uint8_t *b,
+				 unsigned int count, unsigned int cpp)
+{
+	unsigned int diff = 0, i;
+
+	/* Fixed size loads for the common sizes, these vectorize */
+	switch (cpp) {
+	case 1:
+		for (i = 0; i < count; i++)
+			diff += a[i] != b[i];
+		return diff;
+	case 2:
+		for (i = 0; i < count; i++) {
+			uint16_t pa, pb;
+
+			memcpy(&pa, a + 2 * i, 2);
+			memcpy(&pb, b + 2 * i, 2);
+			diff += pa != pb;
+		}
+		return diff;
+	case 4:
+		for (i = 0; i < count; i++) {
+			uint32_t pa, pb;
+
+			memcpy(&pa, a + 4 * i, 4);
+			memcpy(&pb, b + 4 * i, 4);
+			diff += pa != pb;
+		}
+		return diff;
+	case 8:
+		for (i = 0; i < count; i++) {
+			uint64_t pa, pb;
+
+			memcpy(&pa, a + 8 * i, 8);
+			memcpy(&pb, b + 8 * i, 8);
+			diff += pa != pb;
+		}
+		return diff;
+	}
+
+	for (i = 0; i < count; i++)
+		diff += memcmp(a + i * cpp, b + i * cpp, cpp) != 0;
+
+	return diff;
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+
+#include <immintrin.h>
+
+/* Number of pixels with a differing byte in a mask of differing bytes */
+static inline unsigned int mask_pixels(uint32_t mask, unsigned int cpp)
+{
+	/* First byte of each pixel, for cpp 1, 2, 4, 8 and 16 */
+	static const uint32_t first[] = {
+		0xffffffff, 0x55555555, 0x11111111, 0x01010101, 0x00010001,
+	};
+	unsigned int shift = __builtin_ctz(cpp);
+
+	/* Fold the bytes of each pixel into its first byte */
+	for (unsigned int s = 1; s < cpp; s <<= 1)
+		mask |= mask >> s;
+
+	return __builtin_popcount(mask & first[shift]);
+}
+
+static unsigned int count_diff_avx2(const uint8_t *a, const uint8_t *b,
+				    unsigned int count, unsigned int cpp)
+{
+	size_t size = (size_t)count * cpp, i;
+	unsigned int diff = 0;
+
+	/* 32 bytes must hold whole pixels */
+	if (cpp > 16 || (cpp & (cpp - 1)))
+		return count_diff_c(a, b, count, cpp);
+
+	for (i = 0; i + 32 <= size; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		uint32_t ne = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+		if (ne)
+			diff += mask_pixels(ne, cpp);
+	}
+
+	return diff + count_diff_c(a + i, b + i, (size - i) / cpp, cpp);
+}
+
+#pragma GCC pop_options
+
+static unsigned int (*resolve_count_diff(void))(const uint8_t *a,
+						 const uint8_t *b,
+						 unsigned int count,
+						 unsigned int cpp)
+{
+	if (igt_x86_features() & AVX2)
+		return count_diff_avx2;
+
+	return count_diff_c;
+}
+
+static unsigned int count_diff(const uint8_t *a, const uint8_t *b,
+			       unsigned int count, unsigned int cpp)
+	__attribute__((ifunc("resolve_count_diff")));
+
+#else
+
+static unsigned int count_diff(const uint8_t *a, const uint8_t *b,
+			       unsigned int count, unsigned int cpp)
+{
+	return count_diff_c(a, b, count, cpp);
+}
+
+#endif
+
+struct compare_band {
+	const struct igt_surface_view *a, *b;
+	struct igt_surface_diff *diff;
+	unsigned int first, last;
+	uint64_t pixels, blocks;
+	pthread_t thread;
+	bool threaded;
+};
+
+static void *compare_band_work(void *data)
+{
+	struct compare_band *band = data;
+	const struct igt_surface_view *a = band->a, *b = band->b;
+	struct igt_surface_diff *diff = band->diff;
+	unsigned int cpp = a->bpp / 8;
+	size_t row_size = (size_t)a->width * cpp;
+	size_t block_size = (size_t)diff->block_width * cpp;
+	unsigned int bx, by, y;
+
+	for (by = band->first; by < band->last; by++) {
+		uint32_t *counts = diff->counts + (size_t)by * diff->blocks_x;
+		uint64_t *bitmap = diff->bitmap + (size_t)by * diff->bitmap_stride;
+		unsigned int y0 = by * diff->block_height;
+		unsigned int y1 = min(y0 + diff->block_height, a->height);
+
+		for (y = y0; y < y1; y++) {
+			const uint8_t *ra = (const uint8_t *)a->ptr + a->stride * y;
+			const uint8_t *rb = (const uint8_t *)b->ptr + b->stride * y;
+
+			if (!memcmp(ra, rb, row_size))
+				continue;
+
+			for (bx = 0; bx < diff->blocks_x; bx++) {
+				size_t x = bx * block_size;
+				size_t size = min(block_size, row_size - x);
+
+				if (memcmp(ra + x, rb + x, size))
+					counts[bx] += count_diff(ra + x, rb + x,
+								 size / cpp, cpp);
+			}
+		}
+
+		for (bx = 0; bx < diff->blocks_x; bx++) {
+			if (!counts[bx])
+				continue;
+
+			bitmap[bx / 64] |= 1ull << (bx % 64);
+			band->pixels += counts[bx];
+			band->blocks++;
+		}
+	}
+
+	return NULL;
+}
+
+/* Smallest band worth a thread of its own, in pixels */
+#define COMPARE_BAND_MIN_PIXELS (1 << 20)
+#define COMPARE_MAX_BANDS 16
+
+/**
+ * igt_surface_compare:
+ * @a: The first surface
+ * @b: The second surface
+ * @block_width: Width of the blocks in pixels
+ * @block_height: Height of the blocks in pixels
+ * @diff: Where to store the result, free with igt_surface_diff_fini()
+ *
+ * Counts the pixels differing between @a and @b in each block of
+ * @block_width x @block_height pixels. Both surfaces must have the same
+ * size and bpp. Blocks at the right and bottom edges are partial if the
+ * size of the surfaces isn't a multiple of the block size.
+ *
+ * Returns: true if the surfaces are identical.
+ */
+bool igt_surface_compare(const struct igt_surface_view *a,
+			 const struct igt_surface_view *b,
+			 unsigned int block_width, unsigned int block_height,
+			 struct igt_surface_diff *diff)
+{
+	struct compare_band bands[COMPARE_MAX_BANDS] = {};
+	unsigned int nbands, i;
+	size_t pixels;
+	long cpus;
+
+	igt_assert(a->width == b->width && a->height == b->height);
+	igt_assert(a->bpp == b->bpp && a->bpp && a->bpp % 8 == 0);
+	igt_assert(block_width && block_height);
+
+	memset(diff, 0, sizeof(*diff));
+	diff->block_width = block_width;
+	diff->block_height = block_height;
+
+	if (!a->width || !a->height)
+		return true;
+
+	diff->blocks_x = DIV_ROUND_UP(a->width, block_width);
+	diff->blocks_y = DIV_ROUND_UP(a->height, block_height);
+	diff->bitmap_stride = DIV_ROUND_UP(diff->blocks_x, 64);
+	diff->counts = calloc((size_t)diff->blocks_x * diff->blocks_y,
+			      sizeof(*diff->counts));
+	diff->bitmap = calloc((size_t)diff->bitmap_stride * diff->blocks_y,
+			      sizeof(*diff->bitmap));
+	igt_assert(diff->counts && diff->bitmap);
+
+	pixels = (size_t)a->width * a->height;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nbands = pixels / COMPARE_BAND_MIN_PIXELS;
+	if (nbands > cpus)
+		nbands = cpus;
+	if (nbands > diff->blocks_y)
+		nbands = diff->blocks_y;
+	if (nbands > COMPARE_MAX_BANDS)
+		nbands = COMPARE_MAX_BANDS;
+	if (nbands < 1)
+		nbands = 1;
+
+	/* Bands are whole block rows, so no two threads share a count */
+	for (i = 0; i < nbands; i++) {
+		bands[i].a = a;
+		bands[i].b = b;
+		bands[i].diff = diff;
+		bands[i].first = diff->blocks_y * i / nbands;
+		bands[i].last = diff->blocks_y * (i + 1) / nbands;
+
+		if (i)
+			bands[i].threaded =
+				!pthread_create(&bands[i].thread, NULL,
+						compare_band_work, &bands[i]);
+	}
+
+	/* The first band is done here, as are bands without a thread */
+	for (i = 0; i < nbands; i++) {
+		if (!bands[i].threaded)
+			compare_band_work(&bands[i]);
+	}
+
+	for (i = 0; i < nbands; i++) {
+		if (bands[i].threaded)
+			pthread_join(bands[i].thread, NULL);
+
+		diff->pixels += bands[i].pixels;
+		diff->blocks += bands[i].blocks;
+	}
+
+	return !diff->pixels;
+}
+
+/**
+ * igt_surface_diff_fini:
+ * @diff: The comparison result to free
+ */
+void igt_surface_diff_fini(struct igt_surface_diff *diff)
+{
+	free(diff->counts);
+	free(diff->bitmap);
+	memset(diff, 0, sizeof(*diff));
+}
+
+/**
+ * igt_surface_diff_dump:
+ * @diff: The comparison result
+ *
+ * Prints an ascii map of the differences with igt_info(), a line per
+ * block row. Blocks without differences are printed as '.', others as
+ * '0' plus the number of differing pixels, or '#' past 'z'.
+ */
+void igt_surface_diff_dump(const struct igt_surface_diff *diff)
+{
+	char *line = malloc(diff->blocks_x + 1);
+	unsigned int bx, by;
+
+	igt_assert(line);
+
+	for (by = 0; by < diff->blocks_y; by++) {
+		const uint32_t *counts = diff->counts + (size_t)by * diff->blocks_x;
+
+		for (bx = 0; bx < diff->blocks_x; bx++) {
+			if (!counts[bx])
+				line[bx] = '.';
+			else if (counts[bx] <= 'z' - '0')
+				line[bx] = '0' + counts[bx];
+			else
+				line[bx] = '#';
+		}
+		line[bx] = '\0';
+
+		igt_info("%s\n", line);
+	}
+
+	free(line);
+}
+
+/**
+ * igt_surface_view_from_tiled:
+ * @view: The view to initialize
+ * @copy: The tiling of the surface and its size
+ * @tiled: The tiled surface
+ *
+ * Initializes @view with a linear copy of a tiled surface, to compare
+ * surfaces of any tiling supported by #igt_tile_copy. The copy is freed
+ * with igt_surface_view_fini().
+ */
+void igt_surface_view_from_tiled(struct igt_surface_view *view,
+				 const struct igt_tile_copy *copy,
+				 const void *tiled)
+{
+	memset(view, 0, sizeof(*view));
+	view->width = copy->width;
+	view->height = copy->height;
+	view->bpp = copy->cpp * 8;
+	view->stride = (size_t)copy->width * copy->cpp;
+
+	view->linear = malloc(view->stride * view->height ?: 1);
+	igt_assert(view->linear);
+
+	igt_tile_copy_from_tiled(copy, view->linear, view->stride, tiled);
+	view->ptr = view->linear;
+}
+
+/**
+ * igt_surface_view_fini:
+ * @view: The view to clean up
+ *
+ * Frees the linear copy made by igt_surface_view_from_tiled(), if any.
+ */
+void igt_surface_view_fini(struct igt_surface_view *view)
+{
+	free(view->linear);
+	memset(view, 0, sizeof(*view));
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef IGT_SURFACE_COMPARE_H
+#define IGT_SURFACE_COMPARE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "igt_tile_copy.h"
+
+/**
+ * igt_surface_view:
+ * @ptr: First pixel of the surface
+ * @stride: Bytes between the starts of two rows
+ * @width: Width in pixels
+ * @height: Height in pixels
+ * @bpp: Bits per pixel, a multiple of 8
+ *
+ * A linear view of a surface. Tiled surfaces are compared through a
+ * linear copy, see igt_surface_view_from_tiled().
+ */
+struct igt_surface_view {
+	const void *ptr;
+	size_t stride;
+	unsigned int width, height;
+	unsigned int bpp;
+
+	/*< private >*/
+	void *linear;
+};
+
+/**
+ * igt_surface_diff:
+ * @block_width: Width of a block in pixels
+ * @block_height: Height of a block in pixels
+ * @blocks_x: Number of block columns, the last one may be partial
+ * @blocks_y: Number of block rows, the last one may be partial
+ * @counts: Number of differing pixels of each block, in row major order
+ * @bitmap: One bit per block with differing pixels, each block row
+ *          starting at a new word
+ * @bitmap_stride: Number of words per block row in @bitmap
+ * @pixels: Total number of differing pixels
+ * @blocks: Total number of blocks with differing pixels
+ *
+ * The result of igt_surface_compare().
+ */
+struct igt_surface_diff {
+	unsigned int block_width, block_height;
+	unsigned int blocks_x, blocks_y;
+	uint32_t *counts;
+	uint64_t *bitmap;
+	unsigned int bitmap_stride;
+	uint64_t pixels;
+	uint64_t blocks;
+};
+
+void igt_surface_view_from_tiled(struct igt_surface_view *view,
+				 const struct igt_tile_copy *copy,
+				 const void *tiled);
+void igt_surface_view_fini(struct igt_surface_view *view);
+
+bool igt_surface_compare(const struct igt_surface_view *a,
+			 const struct igt_surface_view *b,
+			 unsigned int block_width, unsigned int block_height,
+			 struct igt_surface_diff *diff);
+void igt_surface_diff_fini(struct igt_surface_diff *diff);
+void igt_surface_diff_dump(const struct igt_surface_diff *diff);
+
+/**
+ * igt_surface_diff_block:
+ * @diff: The comparison result
+ * @bx: Block column
+ * @by: Block row
+ *
+ * Returns: whether block (@bx, @by) has differing pixels.
+ */
+static inline bool igt_surface_diff_block(const struct igt_surface_diff *diff,
+					  unsigned int bx, unsigned int by)
+{
+	const uint64_t *row = diff->bitmap + (size_t)by * diff->bitmap_stride;
+
+	return row[bx / 64] & (1ull << (bx % 64));
+}
+
+#endif /* IGT_SURFACE_COMPARE_H */
@@ -28,6 +28,7 @@
 #include <sys/sysmacros.h>
 #endif
 #include <sys/mount.h>
+#include <poll.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -565,6 +566,40 @@ int igt_sysfs_printf(int dir, const char *attr, const char *fmt, ...)
 	return ret;
 }
 
+/* Parses a decimal attribute value without allocating */
+static bool parse_u64(const char *buf, uint64_t max, uint64_t *value)
+{
+	unsigned long long v;
+	char *end;
+
+	/* strtoull() would wrap negative values around */
+	buf += strspn(buf, " \t\n");
+	if (*buf == '-')
+		return false;
+
+	errno = 0;
+	v = strtoull(buf, &end, 10);
+	if (end == buf || errno || v > max)
+		return false;
+
+	*value = v;
+	return true;
+}
+
+static bool __igt_sysfs_get_uint(int dir, const char *attr,
+				 uint64_t max, uint64_t *value)
+{
+	char buf[32];
+	int len;
+
+	len = igt_sysfs_read(dir, attr, buf, sizeof(buf) - 1);
+	if (len < 0)
+		return false;
+	buf[len] = '\0';
+
+	return parse_u64(buf, max, value);
+}
+
 /**
  * __igt_sysfs_get_u32:
  * @dir: directory corresponding to attribute
@@ -578,9 +613,12 @@ int igt_sysfs_printf(int dir, const char *attr, const char *fmt, ...)
  */
 bool __igt_sysfs_get_u32(int dir, const char *attr, uint32_t *value)
 {
-	if (igt_debug_on(igt_sysfs_scanf(dir, attr, "%u", value) != 1))
+	uint64_t v;
+
+	if (igt_debug_on(!__igt_sysfs_get_uint(dir, attr, UINT32_MAX, &v)))
 		return false;
 
+	*value = v;
 	return true;
 }
 
@@ -649,7 +687,7 @@ void igt_sysfs_set_u32(int dir, const char *attr, uint32_t value)
  */
 bool __igt_sysfs_get_u64(int dir, const char *attr, uint64_t *value)
 {
-	if (igt_debug_on(igt_sysfs_scanf(dir, attr, "%"PRIu64, value) != 1))
+	if (igt_debug_on(!__igt_sysfs_get_uint(dir, attr, UINT64_MAX, value)))
 		return false;
 
 	return true;
@@ -795,6 +833,275 @@ void igt_sysfs_set_boolean(int dir, const char *attr, bool value)
 		     "Failed to write %u to %s attribute (%s)\n", value, attr, strerror(errno));
 }
 
+/**
+ * igt_sysfs_attr_open:
+ * @attr: the handle to initialize
+ * @dir: directory corresponding to attribute
+ * @name: name of the sysfs node
+ *
+ * Opens a handle to an attribute that is read or written many times,
+ * like the frequency and residency counters polled by power tests. The
+ * file is kept open, and each access is a single pread() or pwrite()
+ * at offset 0 instead of an open, read and close. Read-only attributes
+ * get a read-only handle.
+ *
+ * The handle must be closed with igt_sysfs_attr_close(), even when
+ * opening fails.
+ *
+ * Returns:
+ * True if the attribute was opened, false otherwise.
+ */
+bool igt_sysfs_attr_open(struct igt_sysfs_attr *attr, int dir, const char *name)
+{
+	attr->name = strdup(name);
+	attr->fd = openat(dir, name, O_RDWR);
+	if (attr->fd < 0 && errno == EACCES)
+		attr->fd = openat(dir, name, O_RDONLY);
+
+	return !igt_debug_on(attr->fd < 0);
+}
+
+/**
+ * igt_sysfs_attr_close:
+ * @attr: the handle to close
+ */
+void igt_sysfs_attr_close(struct igt_sysfs_attr *attr)
+{
+	if (attr->fd >= 0)
+		close(attr->fd);
+	free(attr->name);
+
+	attr->fd = -1;
+	attr->name = NULL;
+}
+
+/**
+ * igt_sysfs_attr_read:
+ * @attr: the attribute handle
+ * @buf: the buffer to read into
+ * @len: the size of @buf
+ *
+ * Reads the current value of the attribute into @buf, as a nul-terminated
+ * string without trailing newlines. Values longer than @len - 1 bytes are
+ * truncated.
+ *
+ * Returns:
+ * The length of the string, -errno on failure.
+ */
+int igt_sysfs_attr_read(const struct igt_sysfs_attr *attr, char *buf, int len)
+{
+	int offset = 0;
+
+	if (attr->fd < 0)
+		return -EBADF;
+
+	/* sysfs regenerates the contents when read from offset 0 */
+	while (offset < len - 1) {
+		ssize_t ret = pread(attr->fd, buf + offset,
+				    len - 1 - offset, offset);
+
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		if (!ret)
+			break;
+
+		offset += ret;
+	}
+
+	buf[offset] = '\0';
+	while (offset > 0 && buf[offset - 1] == '\n')
+		buf[--offset] = '\0';
+
+	return offset;
+}
+
+/**
+ * igt_sysfs_attr_write:
+ * @attr: the attribute handle
+ * @data: the block to write
+ * @len: the length to write
+ *
+ * Writes @len bytes of @data to the attribute.
+ *
+ * Returns:
+ * The length written, -errno on failure.
+ */
+int igt_sysfs_attr_write(const struct igt_sysfs_attr *attr,
+			 const void *data, int len)
+{
+	ssize_t ret;
+
+	if (attr->fd < 0)
+		return -EBADF;
+
+	do {
+		ret = pwrite(attr->fd, data, len, 0);
+	} while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+	return ret < 0 ? -errno : ret;
+}
+
+/**
+ * __igt_sysfs_attr_get_u64:
+ * @attr: the attribute handle
+ * @value: pointer for storing read value
+ *
+ * Reads an unsigned 64bit integer from the attribute, without allocating.
+ *
+ * Returns:
+ * True if value successfully read, false otherwise.
+ */
+bool __igt_sysfs_attr_get_u64(const struct igt_sysfs_attr *attr,
+			      uint64_t *value)
+{
+	char buf[32];
+
+	if (igt_sysfs_attr_read(attr, buf, sizeof(buf)) < 0)
+		return false;
+
+	return parse_u64(buf, UINT64_MAX, value);
+}
+
+/**
+ * igt_sysfs_attr_get_u64:
+ * @attr: the attribute handle
+ *
+ * Like __igt_sysfs_attr_get_u64(), but asserts on failure.
+ *
+ * Returns:
+ * Read value.
+ */
+uint64_t igt_sysfs_attr_get_u64(const struct igt_sysfs_attr *attr)
+{
+	uint64_t value;
+
+	igt_assert_f(__igt_sysfs_attr_get_u64(attr, &value),
+		     "Failed to read %s attribute\n", attr->name);
+
+	return value;
+}
+
+/**
+ * __igt_sysfs_attr_get_u32:
+ * @attr: the attribute handle
+ * @value: pointer for storing read value
+ *
+ * Reads an unsigned 32bit integer from the attribute, without allocating.
+ *
+ * Returns:
+ * True if value successfully read, false otherwise.
+ */
+bool __igt_sysfs_attr_get_u32(const struct igt_sysfs_attr *attr,
+			      uint32_t *value)
+{
+	uint64_t v;
+	char buf[32];
+
+	if (igt_sysfs_attr_read(attr, buf, sizeof(buf)) < 0 ||
+	    !parse_u64(buf, UINT32_MAX, &v))
+		return false;
+
+	*value = v;
+	return true;
+}
+
+/**
+ * igt_sysfs_attr_get_u32:
+ * @attr: the attribute handle
+ *
+ * Like __igt_sysfs_attr_get_u32(), but asserts on failure.
+ *
+ * Returns:
+ * Read value.
+ */
+uint32_t igt_sysfs_attr_get_u32(const struct igt_sysfs_attr *attr)
+{
+	uint32_t value;
+
+	igt_assert_f(__igt_sysfs_attr_get_u32(attr, &value),
+		     "Failed to read %s attribute\n", attr->name);
+
+	return value;
+}
+
+/**
+ * igt_sysfs_attr_set_u64:
+ * @attr: the attribute handle
+ * @value: value to set
+ *
+ * Writes an unsigned 64bit integer to the attribute.
+ *
+ * Returns:
+ * True if successfully written, false otherwise.
+ */
+bool igt_sysfs_attr_set_u64(const struct igt_sysfs_attr *attr, uint64_t value)
+{
+	char buf[32];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%"PRIu64, value);
+
+	return igt_sysfs_attr_write(attr, buf, len) == len;
+}
+
+/**
+ * igt_sysfs_attr_get_u64_batch:
+ * @attrs: pointers to the attribute handles
+ * @count: the number of handles in @attrs
+ * @values: array of @count values to store the results
+ *
+ * Reads @count integer attributes back to back, for sampling several
+ * counters as close together as possible. Values of attributes that
+ * can't be read are left untouched.
+ *
+ * Returns:
+ * The number of attributes successfully read.
+ */
+int igt_sysfs_attr_get_u64_batch(const struct igt_sysfs_attr * const *attrs,
+				 int count, uint64_t *values)
+{
+	int ok = 0;
+
+	for (int i = 0; i < count; i++)
+		ok += __igt_sysfs_attr_get_u64(attrs[i], &values[i]);
+
+	return ok;
+}
+
+/**
+ * igt_sysfs_attr_wait:
+ * @attr: the attribute handle
+ * @timeout_ms: the maximum time to wait, negative to wait forever
+ *
+ * Waits for the kernel to notify a change of the attribute, with
+ * sysfs_notify(). The attribute must have been read since the last
+ * notification, with igt_sysfs_attr_read() or one of the getters.
+ * Attributes the kernel never notifies only return on timeout.
+ *
+ * Returns:
+ * 1 if the attribute changed, 0 on timeout, -errno on failure.
+ */
+int igt_sysfs_attr_wait(const struct igt_sysfs_attr *attr, int timeout_ms)
+{
+	struct pollfd pfd = {
+		.fd = attr->fd,
+		.events = POLLPRI,
+	};
+	int ret;
+
+	if (attr->fd < 0)
+		return -EBADF;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0)
+		return -errno;
+
+	return !!(pfd.revents & (POLLPRI | POLLERR));
+}
+
 static void bind_con(const char *name, bool enable)
 {
 	const char *path = "/sys/class/vtconsole";
@@ -27,6 +27,7 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #define for_each_sysfs_gt_path(i915__, path__, pathlen__) \
 	for (int gt__ = 0; \
@@ -134,6 +135,37 @@ bool igt_sysfs_get_boolean(int dir, const char *attr);
 bool __igt_sysfs_set_boolean(int dir, const char *attr, bool value);
 void igt_sysfs_set_boolean(int dir, const char *attr, bool value);
 
+/**
+ * igt_sysfs_attr:
+ * @fd: the open attribute, -1 if it couldn't be opened
+ * @name: name of the attribute, for messages
+ *
+ * Handle to an attribute kept open for repeated access, see
+ * igt_sysfs_attr_open().
+ */
+struct igt_sysfs_attr {
+	int fd;
+	char *name;
+};
+
+bool igt_sysfs_attr_open(struct igt_sysfs_attr *attr, int dir, const char *name);
+void igt_sysfs_attr_close(struct igt_sysfs_attr *attr);
+int igt_sysfs_attr_read(const struct igt_sysfs_attr *attr, char *buf, int len);
+int igt_sysfs_attr_write(const struct igt_sysfs_attr *attr,
+			 const void *data, int len);
+
+bool __igt_sysfs_attr_get_u32(const struct igt_sysfs_attr *attr,
+			      uint32_t *value);
+uint32_t igt_sysfs_attr_get_u32(const struct igt_sysfs_attr *attr);
+bool __igt_sysfs_attr_get_u64(const struct igt_sysfs_attr *attr,
+			      uint64_t *value);
+uint64_t igt_sysfs_attr_get_u64(const struct igt_sysfs_attr *attr);
+bool igt_sysfs_attr_set_u64(const struct igt_sysfs_attr *attr, uint64_t value);
+
+int igt_sysfs_attr_get_u64_batch(const struct igt_sysfs_attr * const *attrs,
+				 int count, uint64_t *values);
+int igt_sysfs_attr_wait(const struct igt_sysfs_attr *attr, int timeout_ms);
+
 void bind_fbcon(bool enable);
 void kick_snd_hda_intel(void);
 void fbcon_blink_enable(bool enable);
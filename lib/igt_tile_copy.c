@@ -0,0 +1,268 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_tile_copy.h"
+
+/**
+ * SECTION:igt_tile_copy
+ * @short_description: Linear to tiled framebuffer copies
+ * @title: Tile copy
+ * @include: igt_tile_copy.h
+ *
+ * Converting a framebuffer through a per-pixel offset function spends most
+ * of its time recomputing tile coordinates. This library evaluates such a
+ * function once per column and once per row instead, then copies each run
+ * of pixels that is contiguous in the tiled buffer with a single memcpy,
+ * splitting the tile rows of large buffers across threads.
+ */
+
+/**
+ * igt_tile_copy_init:
+ * @copy: The tables to initialize
+ * @layout: The tiling to build them for
+ *
+ * Builds the offset tables of @layout. The result is bit-exact with
+ * @layout->offset for every pixel, as long as the tiling is separable as
+ * described in #igt_tile_layout.
+ */
+void igt_tile_copy_init(struct igt_tile_copy *copy,
+			const struct igt_tile_layout *layout)
+{
+	unsigned int m, x, y;
+
+	igt_assert(layout->x_maps && layout->x_map_height);
+	igt_assert(layout->tile_height);
+
+	memset(copy, 0, sizeof(*copy));
+	copy->width = layout->width;
+	copy->height = layout->height;
+	copy->cpp = layout->cpp;
+	copy->tile_height = layout->tile_height;
+	copy->x_maps = layout->x_maps;
+	copy->x_map_height = layout->x_map_height;
+
+	if (!copy->width || !copy->height)
+		return;
+
+	copy->x_offsets = calloc((size_t)copy->x_maps * copy->width,
+				 sizeof(*copy->x_offsets));
+	copy->x_runs = calloc((size_t)copy->x_maps * copy->width,
+			      sizeof(*copy->x_runs));
+	copy->y_offsets = calloc(copy->height, sizeof(*copy->y_offsets));
+	igt_assert(copy->x_offsets && copy->x_runs && copy->y_offsets);
+
+	for (m = 0; m < copy->x_maps; m++) {
+		size_t *offsets = copy->x_offsets + (size_t)m * copy->width;
+		uint32_t *runs = copy->x_runs + (size_t)m * copy->width;
+		unsigned int y0 = m * copy->x_map_height;
+
+		for (x = 0; x < copy->width; x++)
+			offsets[x] = layout->offset(layout->data, x, y0);
+
+		runs[copy->width - 1] = 1;
+		for (x = copy->width - 1; x--; ) {
+			if (offsets[x + 1] == offsets[x] + copy->cpp)
+				runs[x] = runs[x + 1] + 1;
+			else
+				runs[x] = 1;
+		}
+	}
+
+	/* Unsigned wrap around keeps the sums right for any y0 */
+	for (y = 0; y < copy->height; y++) {
+		m = (y / copy->x_map_height) % copy->x_maps;
+		copy->y_offsets[y] = layout->offset(layout->data, 0, y) -
+			copy->x_offsets[(size_t)m * copy->width];
+	}
+}
+
+/**
+ * igt_tile_copy_fini:
+ * @copy: The tables to free
+ */
+void igt_tile_copy_fini(struct igt_tile_copy *copy)
+{
+	free(copy->x_offsets);
+	free(copy->x_runs);
+	free(copy->y_offsets);
+	memset(copy, 0, sizeof(*copy));
+}
+
+static inline void copy_pixels(void *dst, const void *src,
+			       unsigned int count, unsigned int cpp)
+{
+	/* Constant sizes for the common single pixel runs */
+	if (count == 1) {
+		switch (cpp) {
+		case 1:
+			memcpy(dst, src, 1);
+			return;
+		case 2:
+			memcpy(dst, src, 2);
+			return;
+		case 4:
+			memcpy(dst, src, 4);
+			return;
+		case 8:
+			memcpy(dst, src, 8);
+			return;
+		}
+	}
+
+	memcpy(dst, src, (size_t)count * cpp);
+}
+
+struct tile_band {
+	const struct igt_tile_copy *copy;
+	uint8_t *tiled;
+	uint8_t *linear;
+	size_t stride;
+	bool to_tiled;
+	unsigned int first, last;
+	pthread_t thread;
+	bool threaded;
+};
+
+static void *tile_band_work(void *data)
+{
+	const struct tile_band *band = data;
+	const struct igt_tile_copy *copy = band->copy;
+	unsigned int cpp = copy->cpp;
+	unsigned int x, y;
+
+	for (y = band->first; y < band->last; y++) {
+		unsigned int m = (y / copy->x_map_height) % copy->x_maps;
+		const size_t *offsets = copy->x_offsets + (size_t)m * copy->width;
+		const uint32_t *runs = copy->x_runs + (size_t)m * copy->width;
+		uint8_t *tiled = band->tiled + copy->y_offsets[y];
+		uint8_t *linear = band->linear + band->stride * y;
+
+		for (x = 0; x < copy->width; x += runs[x]) {
+			if (band->to_tiled)
+				copy_pixels(tiled + offsets[x], linear + x * cpp,
+					    runs[x], cpp);
+			else
+				copy_pixels(linear + x * cpp, tiled + offsets[x],
+					    runs[x], cpp);
+		}
+	}
+
+	return NULL;
+}
+
+/* Smallest band worth a thread of its own, in pixels */
+#define TILE_BAND_MIN_PIXELS (1 << 18)
+#define TILE_MAX_BANDS 16
+
+static void tile_copy(const struct igt_tile_copy *copy, uint8_t *tiled,
+		      uint8_t *linear, size_t stride, bool to_tiled)
+{
+	struct tile_band bands[TILE_MAX_BANDS] = {};
+	unsigned int tile_rows, nbands, i;
+	size_t pixels;
+	long cpus;
+
+	if (!copy->width || !copy->height)
+		return;
+
+	tile_rows = DIV_ROUND_UP(copy->height, copy->tile_height);
+	pixels = (size_t)copy->width * copy->height;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nbands = pixels / TILE_BAND_MIN_PIXELS;
+	if (nbands > cpus)
+		nbands = cpus;
+	if (nbands > tile_rows)
+		nbands = tile_rows;
+	if (nbands > TILE_MAX_BANDS)
+		nbands = TILE_MAX_BANDS;
+	if (nbands < 1)
+		nbands = 1;
+
+	/* Bands are whole tile rows, so no two threads share a tile */
+	for (i = 0; i < nbands; i++) {
+		bands[i].copy = copy;
+		bands[i].tiled = tiled;
+		bands[i].linear = linear;
+		bands[i].stride = stride;
+		bands[i].to_tiled = to_tiled;
+		bands[i].first = min(tile_rows * i / nbands * copy->tile_height,
+				     copy->height);
+		bands[i].last = min(tile_rows * (i + 1) / nbands * copy->tile_height,
+				    copy->height);
+
+		if (i)
+			bands[i].threaded =
+				!pthread_create(&bands[i].thread, NULL,
+						tile_band_work, &bands[i]);
+	}
+
+	/* The first band is done here, as are bands without a thread */
+	for (i = 0; i < nbands; i++) {
+		if (!bands[i].threaded)
+			tile_band_work(&bands[i]);
+	}
+
+	for (i = 0; i < nbands; i++) {
+		if (bands[i].threaded)
+			pthread_join(bands[i].thread, NULL);
+	}
+}
+
+/**
+ * igt_tile_copy_to_tiled:
+ * @copy: The tables of the tiling
+ * @tiled: The tiled destination
+ * @linear: The linear source
+ * @stride: The stride of @linear in bytes
+ *
+ * Copies a linear buffer to a tiled one, in tile row order.
+ */
+void igt_tile_copy_to_tiled(const struct igt_tile_copy *copy, void *tiled,
+			    const void *linear, size_t stride)
+{
+	tile_copy(copy, tiled, (void *)linear, stride, true);
+}
+
+/**
+ * igt_tile_copy_from_tiled:
+ * @copy: The tables of the tiling
+ * @linear: The linear destination
+ * @stride: The stride of @linear in bytes
+ * @tiled: The tiled source
+ *
+ * Copies a tiled buffer to a linear one, in tile row order.
+ */
+void igt_tile_copy_from_tiled(const struct igt_tile_copy *copy, void *linear,
+			      size_t stride, const void *tiled)
+{
+	tile_copy(copy, (void *)tiled, linear, stride, false);
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef IGT_TILE_COPY_H
+#define IGT_TILE_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * igt_tile_offset_t:
+ * @data: The layout parameters, see #igt_tile_layout
+ * @x: Pixel column
+ * @y: Pixel row
+ *
+ * Returns: the byte offset of pixel (@x, @y) in a tiled buffer.
+ */
+typedef size_t (*igt_tile_offset_t)(const void *data,
+				    unsigned int x, unsigned int y);
+
+/**
+ * igt_tile_layout:
+ * @width: Width of the copied area in pixels
+ * @height: Height of the copied area in pixels
+ * @cpp: Bytes per pixel
+ * @tile_height: Rows of a tile row, the unit of work split across threads
+ * @x_maps: Number of distinct column layouts, see below
+ * @x_map_height: Rows sharing a column layout
+ * @offset: Reference per-pixel offset function
+ * @data: Passed to @offset
+ *
+ * Describes a tiling whose offsets are separable into a column and a row
+ * part: offset(x, y) = offset(x, y0) + offset(0, y) - offset(0, y0), with
+ * y0 the first row of the rows sharing the column layout of y. Row y uses
+ * column layout (y / @x_map_height) % @x_maps, which lets tilings that
+ * reorder tiles between tile rows (like VC4 T-tiling) be described.
+ */
+struct igt_tile_layout {
+	unsigned int width, height;
+	unsigned int cpp;
+	unsigned int tile_height;
+	unsigned int x_maps, x_map_height;
+	igt_tile_offset_t offset;
+	const void *data;
+};
+
+/**
+ * igt_tile_copy:
+ *
+ * The column and row offset tables of a layout. The runs hold the number
+ * of pixels from each column on that are contiguous in the tiled buffer,
+ * and are copied with a single memcpy.
+ */
+struct igt_tile_copy {
+	unsigned int width, height;
+	unsigned int cpp;
+	unsigned int tile_height;
+	unsigned int x_maps, x_map_height;
+	size_t *x_offsets;
+	uint32_t *x_runs;
+	size_t *y_offsets;
+};
+
+void igt_tile_copy_init(struct igt_tile_copy *copy,
+			const struct igt_tile_layout *layout);
+void igt_tile_copy_fini(struct igt_tile_copy *copy);
+
+void igt_tile_copy_to_tiled(const struct igt_tile_copy *copy, void *tiled,
+			    const void *linear, size_t stride);
+void igt_tile_copy_from_tiled(const struct igt_tile_copy *copy, void *linear,
+			      size_t stride, const void *tiled);
+
+#endif /* IGT_TILE_COPY_H */
@@ -24,6 +24,7 @@
 #include "drmtest.h"
 #include "igt_aux.h"
 #include "igt_fb.h"
+#include "igt_tile_copy.h"
 #include "igt_vc4.h"
 #include "ioctl_wrappers.h"
 #include "vc4_packet.h"
@@ -242,8 +243,18 @@ void igt_vc4_perfmon_destroy(int fd, uint32_t id)
 /* Calculate the t-tile width so that size = width * height * bpp / 8. */
 #define VC4_T_TILE_W(size, height, bpp) ((size) / (height) / ((bpp) / 8))
 
-static size_t igt_vc4_t_tiled_offset(size_t stride, size_t height, size_t bpp,
-				     size_t x, size_t y)
+/**
+ * igt_vc4_t_tiled_offset:
+ * @stride: The stride of the T-tiled buffer in bytes
+ * @height: The height of the buffer
+ * @bpp: Bits per pixel, 16 or 32
+ * @x: Pixel column
+ * @y: Pixel row
+ *
+ * Returns: the byte offset of pixel (@x, @y) in a T-tiled buffer.
+ */
+size_t igt_vc4_t_tiled_offset(size_t stride, size_t height, size_t bpp,
+			      size_t x, size_t y)
 {
 	const size_t t1k_map_even[] = { 0, 3, 1, 2 };
 	const size_t t1k_map_odd[] = { 2, 1, 3, 0 };
@@ -317,70 +328,88 @@ static size_t igt_vc4_t_tiled_offset(size_t stride, size_t height, size_t bpp,
 	return offset;
 }
 
+struct vc4_t_tiled_layout {
+	size_t stride, height, bpp;
+};
+
+static size_t vc4_t_tiled_layout_offset(const void *data,
+					unsigned int x, unsigned int y)
+{
+	const struct vc4_t_tiled_layout *t = data;
+
+	return igt_vc4_t_tiled_offset(t->stride, t->height, t->bpp, x, y);
+}
+
+static void vc4_t_tiled_copy_init(struct igt_tile_copy *copy,
+				  const struct vc4_t_tiled_layout *t,
+				  unsigned int width, unsigned int height)
+{
+	struct igt_tile_layout layout = {
+		.width = width,
+		.height = height,
+		.cpp = t->bpp / 8,
+		.tile_height = 32,
+		/*
+		 * 1K tiles are ordered differently in the upper and lower
+		 * half of the 4K tiles, and 4K tile rows alternate direction.
+		 */
+		.x_maps = 4,
+		.x_map_height = 16,
+		.offset = vc4_t_tiled_layout_offset,
+		.data = t,
+	};
+
+	igt_tile_copy_init(copy, &layout);
+}
+
 static void vc4_fb_convert_plane_to_t_tiled(struct igt_fb *dst, void *dst_buf,
 					    struct igt_fb *src, void *src_buf,
 					    unsigned int plane)
 {
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	for (i = 0; i < src->height; i++) {
-		for (j = 0; j < src->width; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += src->strides[plane] * i + j * bpp / 8;
-			dst_offset += igt_vc4_t_tiled_offset(dst->strides[plane],
-							     dst->height,
-							     bpp, j, i);
-
-			switch (bpp) {
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			case 32:
-				*(uint32_t *)(dst_buf + dst_offset) =
-					*(uint32_t *)(src_buf + src_offset);
-				break;
-			}
-		}
-	}
+	struct vc4_t_tiled_layout t = {
+		.stride = dst->strides[plane],
+		.height = dst->height,
+		.bpp = src->plane_bpp[plane],
+	};
+	struct igt_tile_copy copy;
+
+	vc4_t_tiled_copy_init(&copy, &t, src->width, src->height);
+	igt_tile_copy_to_tiled(&copy, dst_buf + dst->offsets[plane],
+			       src_buf + src->offsets[plane],
+			       src->strides[plane]);
+	igt_tile_copy_fini(&copy);
 }
 
 static void vc4_fb_convert_plane_from_t_tiled(struct igt_fb *dst, void *dst_buf,
 					      struct igt_fb *src, void *src_buf,
 					      unsigned int plane)
 {
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	for (i = 0; i < src->height; i++) {
-		for (j = 0; j < src->width; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += igt_vc4_t_tiled_offset(src->strides[plane],
-							     src->height,
-							     bpp, j, i);
-			src_offset += dst->strides[plane] * i + j * bpp / 8;
-
-			switch (bpp) {
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			case 32:
-				*(uint32_t *)(dst_buf + dst_offset) =
-					*(uint32_t *)(src_buf + src_offset);
-				break;
-			}
-		}
-	}
+	struct vc4_t_tiled_layout t = {
+		.stride = src->strides[plane],
+		.height = src->height,
+		.bpp = src->plane_bpp[plane],
+	};
+	struct igt_tile_copy copy;
+
+	vc4_t_tiled_copy_init(&copy, &t, src->width, src->height);
+	igt_tile_copy_from_tiled(&copy, dst_buf + dst->offsets[plane],
+				 dst->strides[plane],
+				 src_buf + src->offsets[plane]);
+	igt_tile_copy_fini(&copy);
 }
 
-static size_t vc4_sand_tiled_offset(size_t column_width, size_t column_size, size_t x,
-				    size_t y, size_t bpp)
+/**
+ * igt_vc4_sand_tiled_offset:
+ * @column_width: The width of a column in pixels
+ * @column_size: The size of a column in bytes
+ * @x: Pixel column
+ * @y: Pixel row
+ * @bpp: Bits per pixel
+ *
+ * Returns: the byte offset of pixel (@x, @y) in a SAND tiled plane.
+ */
+size_t igt_vc4_sand_tiled_offset(size_t column_width, size_t column_size,
+				 size_t x, size_t y, size_t bpp)
 {
 	size_t offset = 0;
 	size_t cols_x;
@@ -397,15 +426,38 @@ static size_t vc4_sand_tiled_offset(size_t column_width, size_t column_size, siz
 	return offset;
 }
 
-static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf,
-					       struct igt_fb *src, void *src_buf,
-					       unsigned int plane)
+struct vc4_sand_layout {
+	size_t column_width, column_size, bpp;
+};
+
+static size_t vc4_sand_layout_offset(const void *data,
+				     unsigned int x, unsigned int y)
 {
-	uint64_t modifier_base = fourcc_mod_broadcom_mod(dst->modifier);
-	uint32_t column_height = fourcc_mod_broadcom_param(dst->modifier);
-	uint32_t column_width_bytes, column_width, column_size;
-	size_t bpp = dst->plane_bpp[plane];
-	unsigned int i, j;
+	const struct vc4_sand_layout *s = data;
+
+	return igt_vc4_sand_tiled_offset(s->column_width, s->column_size,
+					 x, y, s->bpp);
+}
+
+static void vc4_sand_copy_init(struct igt_tile_copy *copy,
+			       struct vc4_sand_layout *s,
+			       struct igt_fb *fb, unsigned int plane,
+			       unsigned int width, unsigned int height)
+{
+	uint64_t modifier_base = fourcc_mod_broadcom_mod(fb->modifier);
+	uint32_t column_height = fourcc_mod_broadcom_param(fb->modifier);
+	uint32_t column_width_bytes;
+	struct igt_tile_layout layout = {
+		.width = width,
+		.height = height,
+		.cpp = fb->plane_bpp[plane] / 8,
+		/* Each row of a column is contiguous */
+		.tile_height = 1,
+		.x_maps = 1,
+		.x_map_height = 1,
+		.offset = vc4_sand_layout_offset,
+		.data = s,
+	};
 
 	switch (modifier_base) {
 	case DRM_FORMAT_MOD_BROADCOM_SAND32:
@@ -424,89 +476,43 @@ static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf
 		igt_assert(false);
 	}
 
-	column_width = column_width_bytes * dst->plane_width[plane] / dst->width;
-	column_size = column_width_bytes * column_height;
-
-	for (i = 0; i < dst->plane_height[plane]; i++) {
-		for (j = 0; j < src->plane_width[plane]; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += src->strides[plane] * i + j * bpp / 8;
-			dst_offset += vc4_sand_tiled_offset(column_width,
-							    column_size, j, i,
-							    bpp);
-
-			switch (bpp) {
-			case 8:
-				*(uint8_t *)(dst_buf + dst_offset) =
-					*(uint8_t *)(src_buf + src_offset);
-				break;
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			default:
-				igt_assert(false);
-			}
-		}
-	}
+	igt_assert(fb->plane_bpp[plane] == 8 || fb->plane_bpp[plane] == 16);
+
+	s->column_width = column_width_bytes * fb->plane_width[plane] / fb->width;
+	s->column_size = column_width_bytes * column_height;
+	s->bpp = fb->plane_bpp[plane];
+
+	igt_tile_copy_init(copy, &layout);
+}
+
+static void vc4_fb_convert_plane_to_sand_tiled(struct igt_fb *dst, void *dst_buf,
+					       struct igt_fb *src, void *src_buf,
+					       unsigned int plane)
+{
+	struct vc4_sand_layout s;
+	struct igt_tile_copy copy;
+
+	vc4_sand_copy_init(&copy, &s, dst, plane, src->plane_width[plane],
+			   dst->plane_height[plane]);
+	igt_tile_copy_to_tiled(&copy, dst_buf + dst->offsets[plane],
+			       src_buf + src->offsets[plane],
+			       src->strides[plane]);
+	igt_tile_copy_fini(&copy);
 }
 
 static void vc4_fb_convert_plane_from_sand_tiled(struct igt_fb *dst, void *dst_buf,
 						 struct igt_fb *src, void *src_buf,
 						 unsigned int plane)
 {
-	uint64_t modifier_base = fourcc_mod_broadcom_mod(src->modifier);
-	uint32_t column_height = fourcc_mod_broadcom_param(src->modifier);
-	uint32_t column_width_bytes, column_width, column_size;
-	size_t bpp = src->plane_bpp[plane];
-	unsigned int i, j;
-
-	switch (modifier_base) {
-	case DRM_FORMAT_MOD_BROADCOM_SAND32:
-		column_width_bytes = 32;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND64:
-		column_width_bytes = 64;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND128:
-		column_width_bytes = 128;
-		break;
-	case DRM_FORMAT_MOD_BROADCOM_SAND256:
-		column_width_bytes = 256;
-		break;
-	default:
-		igt_assert(false);
-	}
-
-	column_width = column_width_bytes * src->plane_width[plane] / src->width;
-	column_size = column_width_bytes * column_height;
-
-	for (i = 0; i < dst->plane_height[plane]; i++) {
-		for (j = 0; j < src->plane_width[plane]; j++) {
-			size_t src_offset = src->offsets[plane];
-			size_t dst_offset = dst->offsets[plane];
-
-			src_offset += vc4_sand_tiled_offset(column_width,
-							    column_size, j, i,
-							    bpp);
-			dst_offset += dst->strides[plane] * i + j * bpp / 8;
-
-			switch (bpp) {
-			case 8:
-				*(uint8_t *)(dst_buf + dst_offset) =
-					*(uint8_t *)(src_buf + src_offset);
-				break;
-			case 16:
-				*(uint16_t *)(dst_buf + dst_offset) =
-					*(uint16_t *)(src_buf + src_offset);
-				break;
-			default:
-				igt_assert(false);
-			}
-		}
-	}
+	struct vc4_sand_layout s;
+	struct igt_tile_copy copy;
+
+	vc4_sand_copy_init(&copy, &s, src, plane, src->plane_width[plane],
+			   dst->plane_height[plane]);
+	igt_tile_copy_from_tiled(&copy, dst_buf + dst->offsets[plane],
+				 dst->strides[plane],
+				 src_buf + src->offsets[plane]);
+	igt_tile_copy_fini(&copy);
 }
 
 void vc4_fb_convert_plane_to_tiled(struct igt_fb *dst, void *dst_buf,
@@ -681,6 +681,34 @@ igt_render_copyfunc_t igt_get_render_copyfunc(int devid)
 	return copy;
 }
 
+/**
+ * igt_get_render_copy_rectsfunc:
+ * @devid: pci device id
+ *
+ * Returns:
+ *
+ * The platform-specific multi-rectangle render copy function pointer for the
+ * device specified with @devid. Will return NULL when no such function is
+ * implemented, callers then have to fall back to igt_get_render_copyfunc().
+ */
+igt_render_copy_rectsfunc_t igt_get_render_copy_rectsfunc(int devid)
+{
+	igt_render_copy_rectsfunc_t copy = NULL;
+
+	if (IS_GEN9(devid) || IS_GEN10(devid))
+		copy = gen9_render_copy_rectsfunc;
+	else if (IS_GEN11(devid))
+		copy = gen11_render_copy_rectsfunc;
+	else if (HAS_FLATCCS(devid))
+		copy = gen12p71_render_copy_rectsfunc;
+	else if (IS_METEORLAKE(devid))
+		copy = mtl_render_copy_rectsfunc;
+	else if (IS_GEN12(devid))
+		copy = gen12_render_copy_rectsfunc;
+
+	return copy;
+}
+
 igt_vebox_copyfunc_t igt_get_vebox_copyfunc(int devid)
 {
 	igt_vebox_copyfunc_t copy = NULL;
@@ -144,6 +144,46 @@ typedef void (*igt_render_copyfunc_t)(struct intel_bb *ibb,
 
 igt_render_copyfunc_t igt_get_render_copyfunc(int devid);
 
+/**
+ * igt_render_copy_rect:
+ * @src_x: source pixel x-coordination
+ * @src_y: source pixel y-coordination
+ * @dst_x: destination pixel x-coordination
+ * @dst_y: destination pixel y-coordination
+ * @width: width of the copied rectangle
+ * @height: height of the copied rectangle
+ *
+ * A rectangle copied by an #igt_render_copy_rectsfunc_t.
+ */
+struct igt_render_copy_rect {
+	uint32_t src_x, src_y;
+	uint32_t dst_x, dst_y;
+	uint32_t width, height;
+};
+
+/**
+ * igt_render_copy_rectsfunc_t:
+ * @ibb: batchbuffer
+ * @src: intel_buf source object
+ * @dst: intel_buf destination object
+ * @rects: rectangles to copy
+ * @count: number of @rects
+ *
+ * This is the type of the per-platform render copy functions copying many
+ * rectangles between the same pair of buffers. The platform-specific
+ * implementation can be obtained by calling igt_get_render_copy_rectsfunc().
+ *
+ * The rectangles are drawn by a single primitive, with as few batches as
+ * fit them, instead of a batch per rectangle.
+ */
+typedef void (*igt_render_copy_rectsfunc_t)(struct intel_bb *ibb,
+					    struct intel_buf *src,
+					    struct intel_buf *dst,
+					    const struct igt_render_copy_rect *rects,
+					    unsigned int count);
+
+igt_render_copy_rectsfunc_t igt_get_render_copy_rectsfunc(int devid);
+
 
 /**
  * igt_vebox_copyfunc_t:
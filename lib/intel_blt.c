@@ -11,6 +11,7 @@
 #include "drm.h"
 #include "i915/gem_create.h"
 #include "igt.h"
+#include "igt_surface_compare.h"
 #include "igt_syncobj.h"
 #include "intel_blt.h"
 #include "xe/xe_ioctl.h"
@@ -1811,26 +1812,78 @@ void blt_surface_to_png(int fd, uint32_t run_id, const char *fileid,
 		munmap(map, obj->size);
 }
 
-static int compare_nxn(const struct blt_copy_object *surf1,
-		       const struct blt_copy_object *surf2,
-		       int xsize, int ysize, int bx, int by)
+struct blt_tile_layout {
+	size_t stride;
+	unsigned int cpp;
+	enum blt_tiling_type tiling;
+};
+
+static size_t blt_tile_offset(const void *data, unsigned int x, unsigned int y)
+{
+	const struct blt_tile_layout *t = data;
+	size_t xb = (size_t)x * t->cpp;
+	unsigned int sx, sy, subtile;
+
+	switch (t->tiling) {
+	case T_XMAJOR:
+		return y / 8 * t->stride * 8 + xb / 512 * 4096 +
+		       y % 8 * 512 + xb % 512;
+	case T_YMAJOR:
+		return y / 32 * t->stride * 32 + xb / 128 * 4096 +
+		       xb % 128 / 16 * 512 + y % 32 * 16 + xb % 16;
+	case T_TILE4:
+		/* 64B subtiles of 4 rows, swizzled within the 4K tile */
+		sx = xb % 128 / 16;
+		sy = y % 32 / 4;
+		subtile = ((sy >> 1) << 4) + ((sy & 1) << 2) +
+			  (sx & 3) + ((sx & 4) << 1);
+
+		return y / 32 * t->stride * 32 + xb / 128 * 4096 +
+		       subtile * 64 + y % 4 * 16 + xb % 16;
+	default:
+		return y * t->stride + xb;
+	}
+}
+
+/*
+ * Linear view of the first @width x @height 32bpp pixels of @obj. X, Y
+ * and Tile4 surfaces are detiled, the others are viewed in memory order.
+ */
+static void blt_surface_view(const struct blt_copy_object *obj,
+			     unsigned int width, unsigned int height,
+			     struct igt_surface_view *view)
 {
-	int x, y, corrupted;
-	uint32_t pos, px1, px2;
-
-	corrupted = 0;
-	for (y = 0; y < ysize; y++) {
-		for (x = 0; x < xsize; x++) {
-			pos = bx * xsize + by * ysize * surf1->pitch / 4;
-			pos += x + y * surf1->pitch / 4;
-			px1 = surf1->ptr[pos];
-			px2 = surf2->ptr[pos];
-			if (px1 != px2)
-				corrupted++;
-		}
+	struct blt_tile_layout t = {
+		.stride = obj->tiling == T_LINEAR ? obj->pitch : obj->pitch * 4,
+		.cpp = 4,
+		.tiling = obj->tiling,
+	};
+	struct igt_tile_layout layout = {
+		.width = width,
+		.height = height,
+		.cpp = t.cpp,
+		.tile_height = obj->tiling == T_XMAJOR ? 8 : 32,
+		.x_maps = 1,
+		.x_map_height = 1,
+		.offset = blt_tile_offset,
+		.data = &t,
+	};
+	struct igt_tile_copy copy;
+
+	if (obj->tiling != T_XMAJOR && obj->tiling != T_YMAJOR &&
+	    obj->tiling != T_TILE4) {
+		memset(view, 0, sizeof(*view));
+		view->ptr = obj->ptr;
+		view->stride = t.stride;
+		view->width = width;
+		view->height = height;
+		view->bpp = t.cpp * 8;
+		return;
 	}
 
-	return corrupted;
+	igt_tile_copy_init(&copy, &layout);
+	igt_surface_view_from_tiled(view, &copy, obj->ptr);
+	igt_tile_copy_fini(&copy);
 }
 
 /**
@@ -1848,29 +1901,31 @@ static int compare_nxn(const struct blt_copy_object *surf1,
  * two surfaces without generating difference image.
  *
  * Currently function assumes both @surf1 and @surf2 are 32-bit color surfaces.
+ * X, Y and Tile4 surfaces are compared in pixel order, other tilings in
+ * memory order.
  */
 void blt_dump_corruption_info_32b(const struct blt_copy_object *surf1,
 				  const struct blt_copy_object *surf2)
 {
 	const int xsize = 8, ysize = 8;
-	int w, h, bx, by, corrupted;
+	struct igt_surface_view view1, view2;
+	struct igt_surface_diff diff;
 
 	igt_assert(surf1->x1 == surf2->x1 && surf1->x2 == surf2->x2);
 	igt_assert(surf1->y1 == surf2->y1 && surf1->y2 == surf2->y2);
-	w = surf1->x2;
-	h = surf1->y2;
 
 	igt_info("dump corruption - width: %d, height: %d, sizex: %x, sizey: %x\n",
 		 surf1->x2, surf1->y2, xsize, ysize);
 
-	for (by = 0; by < h / ysize; by++) {
-		for (bx = 0; bx < w / xsize; bx++) {
-			corrupted = compare_nxn(surf1, surf2, xsize, ysize, bx, by);
-			if (corrupted == 0)
-				igt_info(".");
-			else
-				igt_info("%c", '0' + corrupted);
-		}
-		igt_info("\n");
-	}
+	blt_surface_view(surf1, surf1->x2, surf1->y2, &view1);
+	blt_surface_view(surf2, surf2->x2, surf2->y2, &view2);
+
+	igt_surface_compare(&view1, &view2, xsize, ysize, &diff);
+	igt_surface_diff_dump(&diff);
+	igt_info("corrupted pixels: %" PRIu64 ", blocks: %" PRIu64 "\n",
+		 diff.pixels, diff.blocks);
+
+	igt_surface_diff_fini(&diff);
+	igt_surface_view_fini(&view2);
+	igt_surface_view_fini(&view1);
 }
@@ -23,6 +23,34 @@ static inline void emit_vertex_normalized(struct intel_bb *ibb,
 	intel_bb_out(ibb, u.ui);
 }
 
+void gen9_render_set_templates(bool enable);
+unsigned int gen9_render_copy_emit(struct intel_bb *ibb,
+				   struct intel_buf *src,
+				   struct intel_buf *dst,
+				   const struct igt_render_copy_rect *rects,
+				   unsigned int count);
+
+void mtl_render_copy_rectsfunc(struct intel_bb *ibb,
+			       struct intel_buf *src, struct intel_buf *dst,
+			       const struct igt_render_copy_rect *rects,
+			       unsigned int count);
+void gen12p71_render_copy_rectsfunc(struct intel_bb *ibb,
+				    struct intel_buf *src, struct intel_buf *dst,
+				    const struct igt_render_copy_rect *rects,
+				    unsigned int count);
+void gen12_render_copy_rectsfunc(struct intel_bb *ibb,
+				 struct intel_buf *src, struct intel_buf *dst,
+				 const struct igt_render_copy_rect *rects,
+				 unsigned int count);
+void gen11_render_copy_rectsfunc(struct intel_bb *ibb,
+				 struct intel_buf *src, struct intel_buf *dst,
+				 const struct igt_render_copy_rect *rects,
+				 unsigned int count);
+void gen9_render_copy_rectsfunc(struct intel_bb *ibb,
+				struct intel_buf *src, struct intel_buf *dst,
+				const struct igt_render_copy_rect *rects,
+				unsigned int count);
+
 void mtl_render_clearfunc(struct intel_bb *ibb,
 			  struct intel_buf *dst, unsigned int dst_x, unsigned int dst_y,
 			  unsigned int width, unsigned int height,
@@ -10,6 +10,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <drm.h>
 #include <i915_drm.h>
@@ -321,55 +322,60 @@ gen8_fill_ps(struct intel_bb *ibb,
 /*
  * gen7_fill_vertex_buffer_data populate vertex buffer with data.
  *
- * The vertex buffer consists of 3 vertices to construct a RECTLIST. The 4th
- * vertex is implied (automatically derived by the HW). Each element has the
- * destination offset, and the normalized texture offset (src). The rectangle
- * itself will span the entire subsurface to be copied.
+ * The vertex buffer consists of 3 vertices per rectangle to construct a
+ * RECTLIST. The 4th vertex is implied (automatically derived by the HW). Each
+ * element has the destination offset, and the normalized texture offset (src).
+ * Each rectangle spans the subsurface to be copied.
  *
  * see gen6_emit_vertex_elements
  */
 static uint32_t
 gen7_fill_vertex_buffer_data(struct intel_bb *ibb,
 			     const struct intel_buf *src,
-			     uint32_t src_x, uint32_t src_y,
-			     uint32_t dst_x, uint32_t dst_y,
-			     uint32_t width, uint32_t height)
+			     const struct igt_render_copy_rect *rects,
+			     unsigned int count)
 {
 	uint32_t offset;
 
 	intel_bb_ptr_align(ibb, 8);
 	offset = intel_bb_offset(ibb);
 
-	if (src != NULL) {
-		emit_vertex_2s(ibb, dst_x + width, dst_y + height);
+	for (unsigned int i = 0; i < count; i++) {
+		uint32_t src_x = rects[i].src_x, src_y = rects[i].src_y;
+		uint32_t dst_x = rects[i].dst_x, dst_y = rects[i].dst_y;
+		uint32_t width = rects[i].width, height = rects[i].height;
 
-		emit_vertex_normalized(ibb, src_x + width, intel_buf_width(src));
-		emit_vertex_normalized(ibb, src_y + height, intel_buf_height(src));
+		if (src != NULL) {
+			emit_vertex_2s(ibb, dst_x + width, dst_y + height);
 
-		emit_vertex_2s(ibb, dst_x, dst_y + height);
+			emit_vertex_normalized(ibb, src_x + width, intel_buf_width(src));
+			emit_vertex_normalized(ibb, src_y + height, intel_buf_height(src));
 
-		emit_vertex_normalized(ibb, src_x, intel_buf_width(src));
-		emit_vertex_normalized(ibb, src_y + height, intel_buf_height(src));
+			emit_vertex_2s(ibb, dst_x, dst_y + height);
 
-		emit_vertex_2s(ibb, dst_x, dst_y);
+			emit_vertex_normalized(ibb, src_x, intel_buf_width(src));
+			emit_vertex_normalized(ibb, src_y + height, intel_buf_height(src));
 
-		emit_vertex_normalized(ibb, src_x, intel_buf_width(src));
-		emit_vertex_normalized(ibb, src_y, intel_buf_height(src));
-	} else {
-		emit_vertex_2s(ibb, DIV_ROUND_UP(dst_x + width, 64), DIV_ROUND_UP(dst_y + height, 16));
+			emit_vertex_2s(ibb, dst_x, dst_y);
+
+			emit_vertex_normalized(ibb, src_x, intel_buf_width(src));
+			emit_vertex_normalized(ibb, src_y, intel_buf_height(src));
+		} else {
+			emit_vertex_2s(ibb, DIV_ROUND_UP(dst_x + width, 64), DIV_ROUND_UP(dst_y + height, 16));
 
-		emit_vertex_normalized(ibb, 0, 0);
-		emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
 
-		emit_vertex_2s(ibb, dst_x/64, DIV_ROUND_UP(dst_y + height, 16));
+			emit_vertex_2s(ibb, dst_x/64, DIV_ROUND_UP(dst_y + height, 16));
 
-		emit_vertex_normalized(ibb, 0, 0);
-		emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
 
-		emit_vertex_2s(ibb, dst_x/64, dst_y/16);
+			emit_vertex_2s(ibb, dst_x/64, dst_y/16);
 
-		emit_vertex_normalized(ibb, 0, 0);
-		emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
+			emit_vertex_normalized(ibb, 0, 0);
+		}
 	}
 
 	return offset;
@@ -437,8 +443,10 @@ gen6_emit_vertex_elements(struct intel_bb *ibb) {
  *
  * @batch
  * @offset - bytw offset within the @batch where the vertex buffer starts.
+ * @count - number of rectangles in the vertex buffer.
  */
-static void gen7_emit_vertex_buffer(struct intel_bb *ibb, uint32_t offset)
+static void gen7_emit_vertex_buffer(struct intel_bb *ibb, uint32_t offset,
+				    unsigned int count)
 {
 	intel_bb_out(ibb, GEN4_3DSTATE_VERTEX_BUFFERS | (1 + (4 * 1) - 2));
 	intel_bb_out(ibb, 0 << GEN6_VB0_BUFFER_INDEX_SHIFT | /* VB 0th index */
@@ -447,7 +455,7 @@ static void gen7_emit_vertex_buffer(struct intel_bb *ibb, uint32_t offset)
 	intel_bb_emit_reloc(ibb, ibb->handle,
 			    I915_GEM_DOMAIN_VERTEX, 0,
 			    offset, ibb->batch_offset);
-	intel_bb_out(ibb, 3 * VERTEX_SIZE);
+	intel_bb_out(ibb, count * 3 * VERTEX_SIZE);
 }
 
 static uint32_t
@@ -924,7 +932,8 @@ static void gen8_emit_vf_topology(struct intel_bb *ibb)
 }
 
 /* Vertex elements MUST be defined before this according to spec */
-static void gen8_emit_primitive(struct intel_bb *ibb, uint32_t offset)
+static void gen8_emit_primitive(struct intel_bb *ibb, uint32_t offset,
+				unsigned int count)
 {
 	intel_bb_out(ibb, GEN8_3DSTATE_VF | (2 - 2));
 	intel_bb_out(ibb, 0);
@@ -935,7 +944,7 @@ static void gen8_emit_primitive(struct intel_bb *ibb, uint32_t offset)
 
 	intel_bb_out(ibb, GEN4_3DPRIMITIVE | (7-2));
 	intel_bb_out(ibb, 0);	/* gen8+ ignore the topology type field */
-	intel_bb_out(ibb, 3);	/* vertex count */
+	intel_bb_out(ibb, count * 3);	/* vertex count */
 	intel_bb_out(ibb, 0);	/*  We're specifying this instead with offset in GEN6_3DSTATE_VERTEX_BUFFERS */
 	intel_bb_out(ibb, 1);	/* single instance */
 	intel_bb_out(ibb, 0);	/* start instance location */
@@ -997,10 +1006,13 @@ static void gen12_emit_pxp_state(struct intel_bb *ibb, bool enable,
  * +---------------+ <---- 4096
  * |       ^       |
  * |       |       |
- * |    various    |
+ * |   vertices    |
+ * |  surfaces     |
+ * |_______|_______| <---- binding table
+ * |       ^       |
+ * |   invariant   |
  * |      state    |
- * |       |       |
- * |_______|_______| <---- 2048 + ?
+ * |_______|_______| <---- 2048
  * |       ^       |
  * |       |       |
  * |   batch       |
@@ -1014,55 +1026,194 @@ static void gen12_emit_pxp_state(struct intel_bb *ibb, bool enable,
  * in that order. This means too many batch commands can delete state if not
  * careful.
  *
+ * The state which doesn't depend on the buffers or rectangles comes first,
+ * so that it always lands at the same offsets. See struct gen9_render_template.
  */
 
 #define BATCH_STATE_SPLIT 2048
 
-static
-void _gen9_render_op(struct intel_bb *ibb,
-		     struct intel_buf *src,
-		     unsigned int src_x, unsigned int src_y,
-		     unsigned int width, unsigned int height,
-		     struct intel_buf *dst,
-		     unsigned int dst_x, unsigned int dst_y,
-		     struct intel_buf *aux_pgtable_buf,
-		     const float clear_color[4],
-		     const uint32_t ps_kernel[][4],
-		     uint32_t ps_kernel_size)
+/* Room for the pxp post sync writes after the vertices */
+#define PXP_SCRATCH_SIZE 16
+
+#define MAX_RENDER_TEMPLATES 16
+
+/*
+ * Only the binding table, surface states, vertices and a few commands
+ * around them depend on the buffers and rectangles. The rest of the state
+ * area, from the sampler to the scissor rect, and the commands from the
+ * viewport pointers to the clear params only depend on the platform, the
+ * kernel and whether it's a fast clear, so the first batch built for these
+ * is recorded and copied as is into the later ones.
+ */
+struct gen9_render_template {
+	uint16_t devid;
+	const uint32_t (*ps_kernel)[4];
+	bool fast_clear;
+
+	void *state;
+	uint32_t state_size;
+	void *cmds;
+	uint32_t cmds_size;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	bool disabled;
+	unsigned int count;
+	struct gen9_render_template templates[MAX_RENDER_TEMPLATES];
+} render_templates = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static const struct gen9_render_template *
+find_render_template(uint16_t devid, const uint32_t ps_kernel[][4],
+		     bool fast_clear)
+{
+	const struct gen9_render_template *found = NULL;
+
+	pthread_mutex_lock(&render_templates.mutex);
+	for (unsigned int i = 0; i < render_templates.count; i++) {
+		const struct gen9_render_template *t =
+			&render_templates.templates[i];
+
+		if (t->devid == devid && t->ps_kernel == ps_kernel &&
+		    t->fast_clear == fast_clear) {
+			found = t;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&render_templates.mutex);
+
+	return found;
+}
+
+static void
+add_render_template(struct intel_bb *ibb, const uint32_t ps_kernel[][4],
+		    bool fast_clear, uint32_t state_end,
+		    uint32_t cmds_start, uint32_t cmds_end)
+{
+	struct gen9_render_template *t;
+	uint8_t *batch = (uint8_t *) ibb->batch;
+
+	pthread_mutex_lock(&render_templates.mutex);
+
+	if (render_templates.disabled ||
+	    render_templates.count == MAX_RENDER_TEMPLATES)
+		goto out;
+
+	/* Another thread may have got there first */
+	for (unsigned int i = 0; i < render_templates.count; i++) {
+		t = &render_templates.templates[i];
+		if (t->devid == ibb->devid && t->ps_kernel == ps_kernel &&
+		    t->fast_clear == fast_clear)
+			goto out;
+	}
+
+	t = &render_templates.templates[render_templates.count];
+	t->devid = ibb->devid;
+	t->ps_kernel = ps_kernel;
+	t->fast_clear = fast_clear;
+
+	t->state_size = state_end - BATCH_STATE_SPLIT;
+	t->state = malloc(t->state_size);
+	igt_assert(t->state);
+	memcpy(t->state, batch + BATCH_STATE_SPLIT, t->state_size);
+
+	t->cmds_size = cmds_end - cmds_start;
+	t->cmds = malloc(t->cmds_size);
+	igt_assert(t->cmds);
+	memcpy(t->cmds, batch + cmds_start, t->cmds_size);
+
+	render_templates.count++;
+out:
+	pthread_mutex_unlock(&render_templates.mutex);
+}
+
+/**
+ * gen9_render_set_templates:
+ * @enable: whether to record and replay pipeline state templates
+ *
+ * Pipeline state templates are enabled by default. Disabling them drops the
+ * recorded ones, so that every batch is built from scratch, as when comparing
+ * the replayed batches against freshly built ones. Must not be called while
+ * render copies are running in other threads.
+ */
+void gen9_render_set_templates(bool enable)
 {
-	uint32_t ps_sampler_state, ps_kernel_off, ps_binding_table;
-	uint32_t scissor_state;
+	pthread_mutex_lock(&render_templates.mutex);
+
+	for (unsigned int i = 0; i < render_templates.count; i++) {
+		free(render_templates.templates[i].state);
+		free(render_templates.templates[i].cmds);
+	}
+	render_templates.count = 0;
+	render_templates.disabled = !enable;
+
+	pthread_mutex_unlock(&render_templates.mutex);
+}
+
+/*
+ * Builds the batch for as many of @rects as fit in it, without executing it.
+ * Returns the number of rectangles emitted.
+ */
+static unsigned int
+gen9_render_emit(struct intel_bb *ibb,
+		 struct intel_buf *src,
+		 struct intel_buf *dst,
+		 const struct igt_render_copy_rect *rects,
+		 unsigned int count,
+		 struct intel_buf *aux_pgtable_buf,
+		 const float clear_color[4],
+		 const uint32_t ps_kernel[][4],
+		 uint32_t ps_kernel_size)
+{
+	const struct gen9_render_template *tmpl = NULL;
+	uint32_t ps_sampler_state = 0, ps_kernel_off = 0, ps_binding_table;
+	uint32_t scissor_state = 0;
 	uint32_t vertex_buffer;
 	uint32_t aux_pgtable_state;
+	uint32_t state_end, cmds_start, max_rects;
 	bool fast_clear = !src;
 	uint32_t pxp_scratch_offset;
 
 	if (!fast_clear)
 		igt_assert(src->bpp == dst->bpp);
 
-	intel_bb_flush_render(ibb);
-
 	intel_bb_add_intel_buf(ibb, dst, true);
 
 	if (!fast_clear)
 		intel_bb_add_intel_buf(ibb, src, false);
 
+	tmpl = find_render_template(ibb->devid, ps_kernel, fast_clear);
+
 	intel_bb_ptr_set(ibb, BATCH_STATE_SPLIT);
 
+	if (tmpl) {
+		memcpy(intel_bb_ptr(ibb), tmpl->state, tmpl->state_size);
+		intel_bb_ptr_add(ibb, tmpl->state_size);
+	} else {
+		ps_sampler_state  = gen8_create_sampler(ibb);
+		ps_kernel_off = gen8_fill_ps(ibb, ps_kernel, ps_kernel_size);
+		cc.cc_state = gen6_create_cc_state(ibb);
+		cc.blend_state = gen8_create_blend_state(ibb);
+		viewport.cc_state = gen6_create_cc_viewport(ibb);
+		viewport.sf_clip_state = gen7_create_sf_clip_viewport(ibb);
+		scissor_state = gen6_create_scissor_rect(ibb);
+	}
+	state_end = intel_bb_offset(ibb);
+
 	ps_binding_table  = gen8_bind_surfaces(ibb, src, dst);
-	ps_sampler_state  = gen8_create_sampler(ibb);
-	ps_kernel_off = gen8_fill_ps(ibb, ps_kernel, ps_kernel_size);
-	vertex_buffer = gen7_fill_vertex_buffer_data(ibb, src,
-						     src_x, src_y,
-						     dst_x, dst_y,
-						     width, height);
-	cc.cc_state = gen6_create_cc_state(ibb);
-	cc.blend_state = gen8_create_blend_state(ibb);
-	viewport.cc_state = gen6_create_cc_viewport(ibb);
-	viewport.sf_clip_state = gen7_create_sf_clip_viewport(ibb);
-	scissor_state = gen6_create_scissor_rect(ibb);
 	aux_pgtable_state = gen12_create_aux_pgtable_state(ibb, aux_pgtable_buf);
 
+	intel_bb_ptr_align(ibb, 8);
+	igt_assert(intel_bb_offset(ibb) + PXP_SCRATCH_SIZE < ibb->size);
+	max_rects = (ibb->size - intel_bb_offset(ibb) - PXP_SCRATCH_SIZE) /
+		    (3 * VERTEX_SIZE);
+	igt_assert(max_rects);
+	count = min(count, max_rects);
+
+	vertex_buffer = gen7_fill_vertex_buffer_data(ibb, src, rects, count);
+
 	/* TODO: there is other state which isn't setup */
 	pxp_scratch_offset = intel_bb_offset(ibb);
 	intel_bb_ptr_set(ibb, 0);
@@ -1103,60 +1254,203 @@ void _gen9_render_op(struct intel_bb *ibb,
 		intel_bb_out(ibb, 1 << 12);
 	}
 
-	intel_bb_out(ibb, GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_CC);
-	intel_bb_out(ibb, viewport.cc_state);
-	intel_bb_out(ibb, GEN8_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP);
-	intel_bb_out(ibb, viewport.sf_clip_state);
+	cmds_start = intel_bb_offset(ibb);
 
-	gen7_emit_urb(ibb);
+	if (tmpl) {
+		memcpy(intel_bb_ptr(ibb), tmpl->cmds, tmpl->cmds_size);
+		intel_bb_ptr_add(ibb, tmpl->cmds_size);
+	} else {
+		intel_bb_out(ibb, GEN7_3DSTATE_VIEWPORT_STATE_POINTERS_CC);
+		intel_bb_out(ibb, viewport.cc_state);
+		intel_bb_out(ibb, GEN8_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP);
+		intel_bb_out(ibb, viewport.sf_clip_state);
 
-	gen8_emit_cc(ibb);
+		gen7_emit_urb(ibb);
 
-	gen8_emit_multisample(ibb);
+		gen8_emit_cc(ibb);
 
-	gen8_emit_null_state(ibb);
+		gen8_emit_multisample(ibb);
 
-	intel_bb_out(ibb, GEN7_3DSTATE_STREAMOUT | (5 - 2));
-	intel_bb_out(ibb, 0);
-	intel_bb_out(ibb, 0);
-	intel_bb_out(ibb, 0);
-	intel_bb_out(ibb, 0);
+		gen8_emit_null_state(ibb);
 
-	gen7_emit_clip(ibb);
+		intel_bb_out(ibb, GEN7_3DSTATE_STREAMOUT | (5 - 2));
+		intel_bb_out(ibb, 0);
+		intel_bb_out(ibb, 0);
+		intel_bb_out(ibb, 0);
+		intel_bb_out(ibb, 0);
 
-	gen8_emit_sf(ibb);
+		gen7_emit_clip(ibb);
 
-	gen8_emit_ps(ibb, ps_kernel_off, fast_clear);
+		gen8_emit_sf(ibb);
 
-	intel_bb_out(ibb, GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS);
-	intel_bb_out(ibb, ps_binding_table);
+		gen8_emit_ps(ibb, ps_kernel_off, fast_clear);
 
-	intel_bb_out(ibb, GEN7_3DSTATE_SAMPLER_STATE_POINTERS_PS);
-	intel_bb_out(ibb, ps_sampler_state);
+		intel_bb_out(ibb, GEN7_3DSTATE_BINDING_TABLE_POINTERS_PS);
+		intel_bb_out(ibb, ps_binding_table);
 
-	intel_bb_out(ibb, GEN8_3DSTATE_SCISSOR_STATE_POINTERS);
-	intel_bb_out(ibb, scissor_state);
+		intel_bb_out(ibb, GEN7_3DSTATE_SAMPLER_STATE_POINTERS_PS);
+		intel_bb_out(ibb, ps_sampler_state);
 
-	gen9_emit_depth(ibb);
+		intel_bb_out(ibb, GEN8_3DSTATE_SCISSOR_STATE_POINTERS);
+		intel_bb_out(ibb, scissor_state);
 
-	gen7_emit_clear(ibb);
+		gen9_emit_depth(ibb);
+
+		gen7_emit_clear(ibb);
+
+		add_render_template(ibb, ps_kernel, fast_clear, state_end,
+				    cmds_start, intel_bb_offset(ibb));
+	}
 
 	gen6_emit_drawing_rectangle(ibb, dst);
 
-	gen7_emit_vertex_buffer(ibb, vertex_buffer);
+	gen7_emit_vertex_buffer(ibb, vertex_buffer, count);
 	gen6_emit_vertex_elements(ibb);
 
 	gen8_emit_vf_topology(ibb);
-	gen8_emit_primitive(ibb, vertex_buffer);
+	gen8_emit_primitive(ibb, vertex_buffer, count);
 
 	if (intel_bb_pxp_enabled(ibb))
 		gen12_emit_pxp_state(ibb, false, pxp_scratch_offset);
 
 	intel_bb_emit_bbe(ibb);
-	intel_bb_exec(ibb, intel_bb_offset(ibb),
-		      I915_EXEC_RENDER | I915_EXEC_NO_RELOC, false);
-	dump_batch(ibb);
-	intel_bb_reset(ibb, false);
+
+	return count;
+}
+
+static void
+select_ps_kernel(uint16_t devid, const uint32_t (**ps_kernel)[4],
+		 uint32_t *ps_kernel_size)
+{
+	if (IS_GEN9(devid) || IS_GEN10(devid)) {
+		*ps_kernel = ps_kernel_gen9;
+		*ps_kernel_size = sizeof(ps_kernel_gen9);
+	} else if (IS_GEN11(devid)) {
+		*ps_kernel = ps_kernel_gen11;
+		*ps_kernel_size = sizeof(ps_kernel_gen11);
+	} else if (HAS_FLATCCS(devid) || IS_METEORLAKE(devid)) {
+		*ps_kernel = gen12p71_render_copy;
+		*ps_kernel_size = sizeof(gen12p71_render_copy);
+	} else {
+		*ps_kernel = gen12_render_copy;
+		*ps_kernel_size = sizeof(gen12_render_copy);
+	}
+}
+
+/**
+ * gen9_render_copy_emit:
+ * @ibb: batchbuffer
+ * @src: intel_buf source object
+ * @dst: intel_buf destination object
+ * @rects: rectangles to copy
+ * @count: number of @rects
+ *
+ * Builds the render copy batch the platform's render copy function would
+ * execute, without the aux pagetable, and leaves it in @ibb unexecuted, for
+ * inspecting the emitted commands. The batch is expected to be zeroed.
+ *
+ * Returns: the number of @rects which fit in the batch.
+ */
+unsigned int gen9_render_copy_emit(struct intel_bb *ibb,
+				   struct intel_buf *src,
+				   struct intel_buf *dst,
+				   const struct igt_render_copy_rect *rects,
+				   unsigned int count)
+{
+	const uint32_t (*ps_kernel)[4];
+	uint32_t ps_kernel_size;
+
+	select_ps_kernel(ibb->devid, &ps_kernel, &ps_kernel_size);
+
+	return gen9_render_emit(ibb, src, dst, rects, count, NULL, NULL,
+				ps_kernel, ps_kernel_size);
+}
+
+static
+void _gen9_render_op(struct intel_bb *ibb,
+		     struct intel_buf *src,
+		     struct intel_buf *dst,
+		     const struct igt_render_copy_rect *rects,
+		     unsigned int count,
+		     bool aux_pgtable,
+		     const float clear_color[4],
+		     const uint32_t ps_kernel[][4],
+		     uint32_t ps_kernel_size)
+{
+	intel_bb_flush_render(ibb);
+
+	while (count) {
+		struct aux_pgtable_info pgtable_info = { };
+		unsigned int n;
+
+		if (aux_pgtable)
+			gen12_aux_pgtable_init(&pgtable_info, ibb, src, dst);
+
+		n = gen9_render_emit(ibb, src, dst, rects, count,
+				     pgtable_info.pgtable_buf, clear_color,
+				     ps_kernel, ps_kernel_size);
+
+		intel_bb_exec(ibb, intel_bb_offset(ibb),
+			      I915_EXEC_RENDER | I915_EXEC_NO_RELOC, false);
+		dump_batch(ibb);
+		intel_bb_reset(ibb, false);
+
+		if (aux_pgtable)
+			gen12_aux_pgtable_cleanup(ibb, &pgtable_info);
+
+		rects += n;
+		count -= n;
+	}
+}
+
+void gen9_render_copy_rectsfunc(struct intel_bb *ibb,
+				struct intel_buf *src,
+				struct intel_buf *dst,
+				const struct igt_render_copy_rect *rects,
+				unsigned int count)
+{
+	_gen9_render_op(ibb, src, dst, rects, count, false, NULL,
+			ps_kernel_gen9, sizeof(ps_kernel_gen9));
+}
+
+void gen11_render_copy_rectsfunc(struct intel_bb *ibb,
+				 struct intel_buf *src,
+				 struct intel_buf *dst,
+				 const struct igt_render_copy_rect *rects,
+				 unsigned int count)
+{
+	_gen9_render_op(ibb, src, dst, rects, count, false, NULL,
+			ps_kernel_gen11, sizeof(ps_kernel_gen11));
+}
+
+void gen12_render_copy_rectsfunc(struct intel_bb *ibb,
+				 struct intel_buf *src,
+				 struct intel_buf *dst,
+				 const struct igt_render_copy_rect *rects,
+				 unsigned int count)
+{
+	_gen9_render_op(ibb, src, dst, rects, count, true, NULL,
+			gen12_render_copy, sizeof(gen12_render_copy));
+}
+
+void gen12p71_render_copy_rectsfunc(struct intel_bb *ibb,
+				    struct intel_buf *src,
+				    struct intel_buf *dst,
+				    const struct igt_render_copy_rect *rects,
+				    unsigned int count)
+{
+	_gen9_render_op(ibb, src, dst, rects, count, false, NULL,
+			gen12p71_render_copy, sizeof(gen12p71_render_copy));
+}
+
+void mtl_render_copy_rectsfunc(struct intel_bb *ibb,
+			       struct intel_buf *src,
+			       struct intel_buf *dst,
+			       const struct igt_render_copy_rect *rects,
+			       unsigned int count)
+{
+	_gen9_render_op(ibb, src, dst, rects, count, true, NULL,
+			gen12p71_render_copy, sizeof(gen12p71_render_copy));
 }
 
 void gen9_render_copyfunc(struct intel_bb *ibb,
@@ -1167,9 +1461,11 @@ void gen9_render_copyfunc(struct intel_bb *ibb,
 			  unsigned int dst_x, unsigned int dst_y)
 
 {
-	_gen9_render_op(ibb, src, src_x, src_y,
-		        width, height, dst, dst_x, dst_y, NULL, NULL,
-		        ps_kernel_gen9, sizeof(ps_kernel_gen9));
+	struct igt_render_copy_rect rect = {
+		src_x, src_y, dst_x, dst_y, width, height
+	};
+
+	gen9_render_copy_rectsfunc(ibb, src, dst, &rect, 1);
 }
 
 void gen11_render_copyfunc(struct intel_bb *ibb,
@@ -1179,9 +1475,11 @@ void gen11_render_copyfunc(struct intel_bb *ibb,
 			   struct intel_buf *dst,
 			   unsigned int dst_x, unsigned int dst_y)
 {
-	_gen9_render_op(ibb, src, src_x, src_y,
-		        width, height, dst, dst_x, dst_y, NULL, NULL,
-		        ps_kernel_gen11, sizeof(ps_kernel_gen11));
+	struct igt_render_copy_rect rect = {
+		src_x, src_y, dst_x, dst_y, width, height
+	};
+
+	gen11_render_copy_rectsfunc(ibb, src, dst, &rect, 1);
 }
 
 void gen12_render_copyfunc(struct intel_bb *ibb,
@@ -1191,18 +1489,11 @@ void gen12_render_copyfunc(struct intel_bb *ibb,
 			   struct intel_buf *dst,
 			   unsigned int dst_x, unsigned int dst_y)
 {
-	struct aux_pgtable_info pgtable_info = { };
+	struct igt_render_copy_rect rect = {
+		src_x, src_y, dst_x, dst_y, width, height
+	};
 
-	gen12_aux_pgtable_init(&pgtable_info, ibb, src, dst);
-
-	_gen9_render_op(ibb, src, src_x, src_y,
-		        width, height, dst, dst_x, dst_y,
-		        pgtable_info.pgtable_buf,
-		        NULL,
-		        gen12_render_copy,
-		        sizeof(gen12_render_copy));
-
-	gen12_aux_pgtable_cleanup(ibb, &pgtable_info);
+	gen12_render_copy_rectsfunc(ibb, src, dst, &rect, 1);
 }
 
 void gen12p71_render_copyfunc(struct intel_bb *ibb,
@@ -1212,12 +1503,11 @@ void gen12p71_render_copyfunc(struct intel_bb *ibb,
 			      struct intel_buf *dst,
 			      unsigned int dst_x, unsigned int dst_y)
 {
-	_gen9_render_op(ibb, src, src_x, src_y,
-			width, height, dst, dst_x, dst_y,
-			NULL,
-			NULL,
-			gen12p71_render_copy,
-			sizeof(gen12p71_render_copy));
+	struct igt_render_copy_rect rect = {
+		src_x, src_y, dst_x, dst_y, width, height
+	};
+
+	gen12p71_render_copy_rectsfunc(ibb, src, dst, &rect, 1);
 }
 
 void mtl_render_copyfunc(struct intel_bb *ibb,
@@ -1227,18 +1517,11 @@ void mtl_render_copyfunc(struct intel_bb *ibb,
 			 struct intel_buf *dst,
 			 unsigned int dst_x, unsigned int dst_y)
 {
-	struct aux_pgtable_info pgtable_info = { };
-
-	gen12_aux_pgtable_init(&pgtable_info, ibb, src, dst);
+	struct igt_render_copy_rect rect = {
+		src_x, src_y, dst_x, dst_y, width, height
+	};
 
-	_gen9_render_op(ibb, src, src_x, src_y,
-			width, height, dst, dst_x, dst_y,
-			pgtable_info.pgtable_buf,
-			NULL,
-			gen12p71_render_copy,
-			sizeof(gen12p71_render_copy));
-
-	gen12_aux_pgtable_cleanup(ibb, &pgtable_info);
+	mtl_render_copy_rectsfunc(ibb, src, dst, &rect, 1);
 }
 
 void gen12_render_clearfunc(struct intel_bb *ibb,
@@ -1247,17 +1530,12 @@ void gen12_render_clearfunc(struct intel_bb *ibb,
 			    unsigned int width, unsigned int height,
 			    const float clear_color[4])
 {
-	struct aux_pgtable_info pgtable_info = { };
-
-	gen12_aux_pgtable_init(&pgtable_info, ibb, NULL, dst);
+	struct igt_render_copy_rect rect = {
+		0, 0, dst_x, dst_y, width, height
+	};
 
-	_gen9_render_op(ibb, NULL, 0, 0,
-			width, height, dst, dst_x, dst_y,
-			pgtable_info.pgtable_buf,
-			clear_color,
-			gen12_render_copy,
-			sizeof(gen12_render_copy));
-	gen12_aux_pgtable_cleanup(ibb, &pgtable_info);
+	_gen9_render_op(ibb, NULL, dst, &rect, 1, true, clear_color,
+			gen12_render_copy, sizeof(gen12_render_copy));
 }
 
 void gen12p71_render_clearfunc(struct intel_bb *ibb,
@@ -1266,12 +1544,12 @@ void gen12p71_render_clearfunc(struct intel_bb *ibb,
 			       unsigned int width, unsigned int height,
 			       const float clear_color[4])
 {
-	_gen9_render_op(ibb, NULL, 0, 0,
-			width, height, dst, dst_x, dst_y,
-			NULL,
-			clear_color,
-			gen12p71_render_copy,
-			sizeof(gen12p71_render_copy));
+	struct igt_render_copy_rect rect = {
+		0, 0, dst_x, dst_y, width, height
+	};
+
+	_gen9_render_op(ibb, NULL, dst, &rect, 1, false, clear_color,
+			gen12p71_render_copy, sizeof(gen12p71_render_copy));
 }
 
 void mtl_render_clearfunc(struct intel_bb *ibb,
@@ -1280,15 +1558,10 @@ void mtl_render_clearfunc(struct intel_bb *ibb,
 			  unsigned int width, unsigned int height,
 			  const float clear_color[4])
 {
-	struct aux_pgtable_info pgtable_info = { };
-
-	gen12_aux_pgtable_init(&pgtable_info, ibb, NULL, dst);
+	struct igt_render_copy_rect rect = {
+		0, 0, dst_x, dst_y, width, height
+	};
 
-	_gen9_render_op(ibb, NULL, 0, 0,
-			width, height, dst, dst_x, dst_y,
-			pgtable_info.pgtable_buf,
-			clear_color,
-			gen12p71_render_copy,
-			sizeof(gen12p71_render_copy));
-	gen12_aux_pgtable_cleanup(ibb, &pgtable_info);
+	_gen9_render_op(ibb, NULL, dst, &rect, 1, true, clear_color,
+			gen12p71_render_copy, sizeof(gen12p71_render_copy));
 }
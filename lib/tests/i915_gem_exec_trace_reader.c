@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <string.h>
+
+#include "igt_core.h"
+
+#include "i915/gem_exec_trace_reader.h"
+
+struct buf {
+	uint8_t data[4096];
+	size_t len;
+};
+
+static void put(struct buf *b, const void *data, size_t len)
+{
+	igt_assert(b->len + len <= sizeof(b->data));
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void put_version(struct buf *b, uint32_t version)
+{
+	struct trace_version tv = { TRACE_MAGIC, version };
+
+	put(b, &tv, sizeof(tv));
+}
+
+static void put_header(struct buf *b, uint8_t cmd, uint32_t tid, uint64_t ts)
+{
+	struct trace_header h = { cmd, tid, ts };
+
+	put(b, &h, sizeof(h));
+}
+
+/* An exec of two objects, the first with @nreloc relocations */
+static void put_exec(struct buf *b, uint32_t version, uint32_t nreloc,
+		     const struct trace_exec_fences *fences)
+{
+	struct trace_exec e = { .object_count = 2, .flags = 0x1234, .context = 7 };
+	struct trace_exec_object obj = {};
+	struct drm_i915_gem_relocation_entry reloc = {};
+
+	put(b, &e, sizeof(e));
+	if (version >= 2)
+		put(b, fences, sizeof(*fences));
+
+	obj.handle = 1;
+	obj.relocation_count = nreloc;
+	put(b, &obj, sizeof(obj));
+	for (uint32_t i = 0; i < nreloc; i++) {
+		reloc.target_handle = 2;
+		reloc.offset = 64 * i;
+		put(b, &reloc, sizeof(reloc));
+	}
+
+	obj.handle = 2;
+	obj.relocation_count = 0;
+	put(b, &obj, sizeof(obj));
+
+	if (version >= 2) {
+		for (uint32_t i = 0; i < fences->fence_count; i++) {
+			struct drm_i915_gem_exec_fence f = {
+				.handle = 10 + i,
+				.flags = I915_EXEC_FENCE_WAIT,
+			};
+
+			put(b, &f, sizeof(f));
+		}
+	}
+}
+
+static void check_exec(struct gem_exec_trace_reader *reader,
+		       const struct gem_exec_trace_record *rec,
+		       uint32_t nreloc)
+{
+	struct drm_i915_gem_relocation_entry reloc;
+	struct trace_exec_object obj;
+	struct gem_exec_trace_exec exec;
+
+	igt_assert_eq(rec->cmd, TRACE_EXEC);
+	gem_exec_trace_decode_exec(reader, rec, &exec);
+	igt_assert_eq(exec.exec.object_count, 2);
+	igt_assert_eq(exec.exec.flags, 0x1234);
+	igt_assert_eq(exec.exec.context, 7);
+
+	memcpy(&obj, exec.objects, sizeof(obj));
+	igt_assert_eq(obj.handle, 1);
+	igt_assert_eq(obj.relocation_count, nreloc);
+	memcpy(&reloc, exec.objects + sizeof(obj) +
+	       (nreloc - 1) * sizeof(reloc), sizeof(reloc));
+	igt_assert_eq(reloc.offset, 64 * (nreloc - 1));
+
+	memcpy(&obj, exec.objects + sizeof(obj) + nreloc * sizeof(reloc),
+	       sizeof(obj));
+	igt_assert_eq(obj.handle, 2);
+}
+
+igt_main
+{
+	struct gem_exec_trace_reader reader;
+	struct buf b;
+
+	igt_subtest("version-1") {
+		struct trace_add_bo add = { 1, 4096 };
+		struct trace_wait wait = { 1 };
+		struct gem_exec_trace_exec exec;
+		uint8_t cmd;
+
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 1);
+		cmd = TRACE_ADD_BO;
+		put(&b, &cmd, 1);
+		put(&b, &add, sizeof(add));
+		cmd = TRACE_EXEC;
+		put(&b, &cmd, 1);
+		put_exec(&b, 1, 3, NULL);
+		cmd = TRACE_WAIT;
+		put(&b, &cmd, 1);
+		put(&b, &wait, sizeof(wait));
+
+		igt_assert_f(gem_exec_trace_reader_init(&reader, b.data, b.len),
+			     "%s\n", reader.error_msg);
+		igt_assert_eq(reader.version, 1);
+		igt_assert_eq(reader.n_records, 3);
+		igt_assert_eq(reader.records[0].cmd, TRACE_ADD_BO);
+		igt_assert_eq(reader.records[1].cmd, TRACE_EXEC);
+		igt_assert_eq(reader.records[2].cmd, TRACE_WAIT);
+
+		check_exec(&reader, &reader.records[1], 3);
+		gem_exec_trace_decode_exec(&reader, &reader.records[1], &exec);
+		igt_assert_eq(exec.fences.fence_in, -1);
+		igt_assert_eq(exec.fences.fence_out, -1);
+		igt_assert_eq(exec.fences.fence_count, 0);
+
+		gem_exec_trace_reader_fini(&reader);
+	}
+
+	igt_subtest("version-2") {
+		struct trace_exec_fences fences = {
+			.fence_in = 5,
+			.fence_out = 6,
+			.fence_count = 2,
+			.duration = 1000,
+		};
+		struct trace_add_syncobj syncobj = { 10 };
+		struct trace_add_bo add = { 1, 4096 };
+		struct drm_i915_gem_exec_fence f;
+		struct gem_exec_trace_exec exec;
+
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 2);
+		/* Two threads, each flushed in turn */
+		put_header(&b, TRACE_ADD_BO, 100, 10);
+		put(&b, &add, sizeof(add));
+		put_header(&b, TRACE_EXEC, 100, 30);
+		put_exec(&b, 2, 1, &fences);
+		put_header(&b, TRACE_ADD_SYNCOBJ, 200, 20);
+		put(&b, &syncobj, sizeof(syncobj));
+		put_header(&b, TRACE_DEL_SYNCOBJ, 200, 30);
+		put(&b, &syncobj, sizeof(syncobj));
+
+		igt_assert_f(gem_exec_trace_reader_init(&reader, b.data, b.len),
+			     "%s\n", reader.error_msg);
+		igt_assert_eq(reader.version, 2);
+		igt_assert_eq(reader.n_records, 4);
+
+		/* Sorted by time, ties in file order */
+		igt_assert_eq(reader.records[0].cmd, TRACE_ADD_BO);
+		igt_assert_eq(reader.records[1].cmd, TRACE_ADD_SYNCOBJ);
+		igt_assert_eq(reader.records[1].tid, 200);
+		igt_assert_eq(reader.records[2].cmd, TRACE_EXEC);
+		igt_assert_eq(reader.records[2].tid, 100);
+		igt_assert_eq(reader.records[3].cmd, TRACE_DEL_SYNCOBJ);
+
+		check_exec(&reader, &reader.records[2], 1);
+		gem_exec_trace_decode_exec(&reader, &reader.records[2], &exec);
+		igt_assert_eq(exec.fences.fence_in, 5);
+		igt_assert_eq(exec.fences.fence_out, 6);
+		igt_assert_eq(exec.fences.fence_count, 2);
+		igt_assert_eq(exec.fences.duration, 1000);
+		memcpy(&f, exec.fence_array + sizeof(f), sizeof(f));
+		igt_assert_eq(f.handle, 11);
+		igt_assert_eq(f.flags, I915_EXEC_FENCE_WAIT);
+
+		gem_exec_trace_reader_fini(&reader);
+	}
+
+	igt_subtest("invalid") {
+		struct trace_exec_fences fences = { -1, -1, 1, 0 };
+		struct trace_add_bo add = { 1, 4096 };
+		size_t len;
+
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 3);
+		igt_assert(!gem_exec_trace_reader_init(&reader, b.data, b.len));
+
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 1);
+		b.data[0] ^= 1;
+		igt_assert(!gem_exec_trace_reader_init(&reader, b.data, b.len));
+
+		/* Syncobjs did not exist in version 1 */
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 1);
+		b.data[b.len++] = TRACE_ADD_SYNCOBJ;
+		put(&b, &add, sizeof(add));
+		igt_assert(!gem_exec_trace_reader_init(&reader, b.data, b.len));
+
+		memset(&b, 0, sizeof(b));
+		put_version(&b, 2);
+		put_header(&b, TRACE_ADD_BO, 1, 1);
+		put(&b, &add, sizeof(add));
+		put_header(&b, TRACE_EXEC, 1, 2);
+		put_exec(&b, 2, 4, &fences);
+		len = b.len;
+
+		igt_assert(gem_exec_trace_reader_init(&reader, b.data, len));
+		igt_assert_eq(reader.n_records, 2);
+		gem_exec_trace_reader_fini(&reader);
+
+		/* Every truncation must be caught, none read out of bounds */
+		for (size_t i = sizeof(struct trace_version) + 1; i < len; i++) {
+			if (i == sizeof(struct trace_version) +
+			    sizeof(struct trace_header) + sizeof(add))
+				continue;
+
+			igt_assert_f(!gem_exec_trace_reader_init(&reader, b.data, i),
+				     "truncated trace of %zu bytes accepted\n", i);
+			igt_assert(strlen(reader.error_msg));
+		}
+	}
+}
@@ -0,0 +1,510 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "ioctl_wrappers.h"
+
+#include "i915/gem_exec_trace_replay.h"
+
+#define MAX_HANDLES 256
+#define MAX_EXECS 64
+#define MS 1000000ull
+
+/*
+ * Trace builder, records are written per thread in turn like the tracer
+ * does, the reader puts them back in time order.
+ */
+struct trace {
+	uint8_t *data;
+	size_t len, size;
+};
+
+static void put(struct trace *t, const void *data, size_t len)
+{
+	if (t->len + len > t->size) {
+		t->size = 2 * (t->len + len);
+		t->data = realloc(t->data, t->size);
+		igt_assert(t->data);
+	}
+
+	memcpy(t->data + t->len, data, len);
+	t->len += len;
+}
+
+static void trace_init(struct trace *t)
+{
+	struct trace_version tv = { TRACE_MAGIC, TRACE_VERSION };
+
+	memset(t, 0, sizeof(*t));
+	put(t, &tv, sizeof(tv));
+}
+
+static void put_simple(struct trace *t, uint8_t cmd, uint32_t tid,
+		       uint64_t ts, uint32_t handle, uint64_t size)
+{
+	struct trace_header h = { cmd, tid, ts };
+	struct trace_add_bo add = { handle, size };
+
+	put(t, &h, sizeof(h));
+	if (cmd == TRACE_ADD_BO)
+		put(t, &add, sizeof(add));
+	else
+		put(t, &handle, sizeof(handle));
+}
+
+static void put_exec(struct trace *t, uint32_t tid, uint64_t ts,
+		     uint32_t handle, uint64_t flags, int fence_in,
+		     int fence_out, uint32_t syncobj)
+{
+	struct trace_header h = { TRACE_EXEC, tid, ts };
+	struct trace_exec e = { .object_count = 1, .flags = flags };
+	struct trace_exec_fences f = {
+		.fence_in = fence_in,
+		.fence_out = fence_out,
+		.fence_count = !!syncobj,
+	};
+	struct trace_exec_object obj = { .handle = handle };
+	struct drm_i915_gem_exec_fence sf = {
+		.handle = syncobj,
+		.flags = I915_EXEC_FENCE_WAIT,
+	};
+
+	put(t, &h, sizeof(h));
+	put(t, &e, sizeof(e));
+	put(t, &f, sizeof(f));
+	put(t, &obj, sizeof(obj));
+	if (syncobj)
+		put(t, &sf, sizeof(sf));
+}
+
+/* Mock device, checking that every handle is used while it exists */
+struct mock {
+	pthread_mutex_t lock;
+	uint32_t next_handle;
+	bool bo[MAX_HANDLES], ctx[MAX_HANDLES], syncobj[MAX_HANDLES];
+	int live_bo, live_ctx, live_syncobj;
+
+	int next_fence, live_fences;
+
+	/* Time of the first request, which is before the replay starts */
+	uint64_t first;
+	uint64_t exec_delay;
+	int execs;
+	struct {
+		uint64_t time;
+		uint64_t flags;
+		uint32_t handle;
+		int in_fence, out_fence;
+		uint32_t syncobj;
+		pthread_t thread;
+	} exec[MAX_EXECS];
+};
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int mock_exec(struct mock *m, struct drm_i915_gem_execbuffer2 *eb)
+{
+	struct drm_i915_gem_exec_object2 *obj = from_user_pointer(eb->buffers_ptr);
+	int idx = m->execs++;
+
+	igt_assert(idx < MAX_EXECS);
+	m->exec[idx].time = now();
+	m->exec[idx].flags = eb->flags;
+	m->exec[idx].handle = obj[0].handle;
+	m->exec[idx].in_fence = -1;
+	m->exec[idx].out_fence = -1;
+	m->exec[idx].thread = pthread_self();
+
+	/* The nop batch is appended last */
+	for (uint32_t i = 0; i < eb->buffer_count; i++)
+		if (obj[i].handle >= MAX_HANDLES || !m->bo[obj[i].handle])
+			return -ENOENT;
+
+	if (eb->flags & I915_EXEC_FENCE_IN)
+		m->exec[idx].in_fence = (int)eb->rsvd2;
+
+	if (eb->flags & I915_EXEC_FENCE_ARRAY) {
+		struct drm_i915_gem_exec_fence *f =
+			from_user_pointer(eb->cliprects_ptr);
+
+		igt_assert_eq(eb->num_cliprects, 1);
+		if (!m->syncobj[f->handle])
+			return -ENOENT;
+		m->exec[idx].syncobj = f->handle;
+	}
+
+	if (eb->flags & I915_EXEC_FENCE_OUT) {
+		m->exec[idx].out_fence = m->next_fence++;
+		m->live_fences++;
+		eb->rsvd2 |= (uint64_t)m->exec[idx].out_fence << 32;
+	}
+
+	return 0;
+}
+
+static int mock_ioctl(void *data, unsigned long request, void *arg)
+{
+	struct mock *m = data;
+	int err = 0;
+
+	pthread_mutex_lock(&m->lock);
+	if (!m->first)
+		m->first = now();
+
+	switch (request) {
+	case DRM_IOCTL_I915_GEM_CREATE: {
+		struct drm_i915_gem_create *create = arg;
+
+		create->handle = m->next_handle++;
+		igt_assert(create->handle < MAX_HANDLES);
+		m->bo[create->handle] = true;
+		m->live_bo++;
+		break;
+	}
+	case DRM_IOCTL_GEM_CLOSE: {
+		struct drm_gem_close *close = arg;
+
+		if (!m->bo[close->handle]) {
+			err = -ENOENT;
+			break;
+		}
+		m->bo[close->handle] = false;
+		m->live_bo--;
+		break;
+	}
+	case DRM_IOCTL_I915_GEM_PWRITE:
+		break;
+	case DRM_IOCTL_I915_GEM_WAIT: {
+		struct drm_i915_gem_wait *wait = arg;
+
+		if (!m->bo[wait->bo_handle])
+			err = -ENOENT;
+		break;
+	}
+	case DRM_IOCTL_I915_GEM_CONTEXT_CREATE: {
+		struct drm_i915_gem_context_create *create = arg;
+
+		create->ctx_id = m->next_handle++;
+		m->ctx[create->ctx_id] = true;
+		m->live_ctx++;
+		break;
+	}
+	case DRM_IOCTL_I915_GEM_CONTEXT_DESTROY: {
+		struct drm_i915_gem_context_destroy *destroy = arg;
+
+		if (!m->ctx[destroy->ctx_id]) {
+			err = -ENOENT;
+			break;
+		}
+		m->ctx[destroy->ctx_id] = false;
+		m->live_ctx--;
+		break;
+	}
+	case DRM_IOCTL_SYNCOBJ_CREATE: {
+		struct drm_syncobj_create *create = arg;
+
+		create->handle = m->next_handle++;
+		m->syncobj[create->handle] = true;
+		m->live_syncobj++;
+		break;
+	}
+	case DRM_IOCTL_SYNCOBJ_DESTROY: {
+		struct drm_syncobj_destroy *destroy = arg;
+
+		if (!m->syncobj[destroy->handle]) {
+			err = -ENOENT;
+			break;
+		}
+		m->syncobj[destroy->handle] = false;
+		m->live_syncobj--;
+		break;
+	}
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2:
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR:
+		err = mock_exec(m, arg);
+		break;
+	default:
+		err = -EINVAL;
+		break;
+	}
+	pthread_mutex_unlock(&m->lock);
+
+	if (m->exec_delay && (request == DRM_IOCTL_I915_GEM_EXECBUFFER2 ||
+			      request == DRM_IOCTL_I915_GEM_EXECBUFFER2_WR))
+		usleep(m->exec_delay / 1000);
+
+	return err;
+}
+
+static int mock_fence_status(void *data, int fence)
+{
+	/* Every other request is still running */
+	return fence & 1;
+}
+
+static int mock_fence_dup(void *data, int fence)
+{
+	struct mock *m = data;
+	int ret;
+
+	pthread_mutex_lock(&m->lock);
+	ret = m->next_fence++;
+	m->live_fences++;
+	pthread_mutex_unlock(&m->lock);
+
+	return ret;
+}
+
+static void mock_fence_close(void *data, int fence)
+{
+	struct mock *m = data;
+
+	pthread_mutex_lock(&m->lock);
+	m->live_fences--;
+	pthread_mutex_unlock(&m->lock);
+}
+
+static void mock_init(struct mock *m, struct gem_exec_trace_sink *sink)
+{
+	memset(m, 0, sizeof(*m));
+	pthread_mutex_init(&m->lock, NULL);
+	m->next_handle = 1;
+	m->next_fence = 100;
+
+	sink->ioctl = mock_ioctl;
+	sink->fence_status = mock_fence_status;
+	sink->fence_dup = mock_fence_dup;
+	sink->fence_close = mock_fence_close;
+	sink->data = m;
+}
+
+static void mock_assert_released(struct mock *m)
+{
+	igt_assert_eq(m->live_bo, 0);
+	igt_assert_eq(m->live_ctx, 0);
+	igt_assert_eq(m->live_syncobj, 0);
+	igt_assert_eq(m->live_fences, 0);
+}
+
+static int replay(struct trace *t, struct gem_exec_trace_replay_params *params,
+		  struct mock *m, struct gem_exec_trace_replay_results *results)
+{
+	struct gem_exec_trace_reader reader;
+	struct gem_exec_trace_sink sink;
+	int err;
+
+	igt_assert_f(gem_exec_trace_reader_init(&reader, t->data, t->len),
+		     "%s\n", reader.error_msg);
+
+	mock_init(m, &sink);
+	err = gem_exec_trace_replay(&reader, params, &sink, results);
+	mock_assert_released(m);
+
+	gem_exec_trace_reader_fini(&reader);
+	return err;
+}
+
+/* Several threads sharing objects, with handles reused across threads */
+static void build_threads(struct trace *t)
+{
+	trace_init(t);
+
+	put_simple(t, TRACE_ADD_BO, 1, 0, 1, 4096);
+	put_exec(t, 1, 10, 1, 0, -1, -1, 0);
+	put_simple(t, TRACE_DEL_BO, 1, 20, 1, 0);
+	put_simple(t, TRACE_ADD_BO, 1, 50, 2, 4096);
+	put_exec(t, 1, 80, 2, 0, -1, -1, 0);
+
+	put_exec(t, 2, 5, 1, 0, -1, -1, 0);
+	put_simple(t, TRACE_ADD_BO, 2, 30, 1, 8192);
+	put_exec(t, 2, 60, 2, 0, -1, -1, 0);
+
+	put_exec(t, 3, 40, 1, 0, -1, -1, 0);
+	put_simple(t, TRACE_WAIT, 3, 45, 1, 0);
+	put_simple(t, TRACE_ADD_CTX, 3, 46, 1, 0);
+	put_exec(t, 3, 70, 2, 0, -1, -1, 0);
+	put_simple(t, TRACE_DEL_BO, 3, 90, 1, 0);
+}
+
+/* Execs every @gap ns on a single thread */
+static void build_periodic(struct trace *t, int count, uint64_t gap)
+{
+	trace_init(t);
+
+	put_simple(t, TRACE_ADD_BO, 1, 0, 1, 4096);
+	for (int i = 0; i < count; i++)
+		put_exec(t, 1, (i + 1) * gap, 1, 0, -1, -1, 0);
+}
+
+static int count_threads(struct mock *m)
+{
+	int count = 0;
+
+	for (int i = 0; i < m->execs; i++) {
+		int j;
+
+		for (j = 0; j < i; j++)
+			if (pthread_equal(m->exec[i].thread, m->exec[j].thread))
+				break;
+		count += j == i;
+	}
+
+	return count;
+}
+
+igt_main
+{
+	struct gem_exec_trace_replay_params params = {};
+	struct gem_exec_trace_replay_results results;
+	struct mock m;
+	struct trace t;
+
+	igt_subtest("threads") {
+		build_threads(&t);
+
+		for (int pass = 0; pass < 20; pass++) {
+			params.single_thread = pass & 1;
+			igt_assert_eq(replay(&t, &params, &m, &results), 0);
+			igt_assert_eq(results.execs, 6);
+			igt_assert_eq(m.execs, 6);
+			igt_assert_eq(igt_histogram_get_count(&results.latency), 6);
+			igt_assert_eq(count_threads(&m), pass & 1 ? 1 : 3);
+			gem_exec_trace_replay_results_fini(&results);
+		}
+
+		free(t.data);
+	}
+
+	igt_subtest("fences") {
+		trace_init(&t);
+		put_simple(&t, TRACE_ADD_BO, 1, 0, 1, 4096);
+		put_simple(&t, TRACE_ADD_SYNCOBJ, 1, 1, 3, 0);
+		put_exec(&t, 1, 10, 1, I915_EXEC_FENCE_OUT, -1, 7, 0);
+		/* Waits on the fence from the other thread */
+		put_exec(&t, 2, 20, 1, I915_EXEC_FENCE_IN, 7, -1, 0);
+		/* A fence from outside the trace is dropped */
+		put_exec(&t, 2, 30, 1, I915_EXEC_FENCE_IN, 9, -1, 0);
+		put_exec(&t, 2, 40, 1, I915_EXEC_FENCE_ARRAY, -1, -1, 3);
+
+		for (int track = 0; track < 2; track++) {
+			params.track_queue = track;
+			igt_assert_eq(replay(&t, &params, &m, &results), 0);
+			igt_assert_eq(m.execs, 4);
+
+			igt_assert(m.exec[0].out_fence >= 0);
+			igt_assert(m.exec[1].flags & I915_EXEC_FENCE_IN);
+			igt_assert(m.exec[1].in_fence >= 0);
+			igt_assert(!(m.exec[2].flags & I915_EXEC_FENCE_IN));
+			igt_assert(m.exec[3].flags & I915_EXEC_FENCE_ARRAY);
+			igt_assert(m.exec[3].syncobj);
+
+			igt_assert_eq(igt_histogram_get_count(&results.queue_depth),
+				      track ? 4 : 0);
+			if (track)
+				igt_assert(igt_histogram_get_max(&results.queue_depth) >= 2);
+			else
+				igt_assert(!(m.exec[1].flags & I915_EXEC_FENCE_OUT));
+			gem_exec_trace_replay_results_fini(&results);
+		}
+
+		free(t.data);
+	}
+
+	igt_subtest("afap") {
+		build_periodic(&t, 10, 100 * MS);
+
+		params.mode = GEM_EXEC_TRACE_REPLAY_AFAP;
+		igt_assert_eq(replay(&t, &params, &m, &results), 0);
+		igt_assert_eq(m.execs, 10);
+		igt_assert(results.elapsed < 500 * MS);
+		igt_assert_eq(igt_histogram_get_count(&results.lag), 0);
+		gem_exec_trace_replay_results_fini(&results);
+
+		free(t.data);
+	}
+
+	igt_subtest("open-loop") {
+		build_periodic(&t, 10, 4 * MS);
+
+		params.mode = GEM_EXEC_TRACE_REPLAY_OPEN_LOOP;
+		for (int i = 0; i < 2; i++) {
+			params.scale = i ? 0.5 : 1;
+			igt_assert_eq(replay(&t, &params, &m, &results), 0);
+			igt_assert_eq(m.execs, 10);
+
+			for (int n = 0; n < 10; n++) {
+				uint64_t expected = (n + 1) * 4 * MS * params.scale;
+
+				igt_assert_f(m.exec[n].time - m.first >= expected,
+					     "exec %d issued early\n", n);
+			}
+			gem_exec_trace_replay_results_fini(&results);
+		}
+
+		free(t.data);
+	}
+
+	igt_subtest("timeline") {
+		struct gem_exec_trace_reader reader;
+		struct gem_exec_trace_sink sink;
+		uint64_t open_loop;
+
+		build_periodic(&t, 10, 2 * MS);
+		igt_assert(gem_exec_trace_reader_init(&reader, t.data, t.len));
+
+		/* Each exec takes 3ms, where it took no time when traced */
+		params.mode = GEM_EXEC_TRACE_REPLAY_OPEN_LOOP;
+		params.scale = 1;
+		mock_init(&m, &sink);
+		m.exec_delay = 3 * MS;
+		igt_assert_eq(gem_exec_trace_replay(&reader, &params, &sink, &results), 0);
+		open_loop = m.exec[9].time - m.exec[0].time;
+		igt_assert(igt_histogram_get_max(&results.lag) >= 2 * MS);
+		gem_exec_trace_replay_results_fini(&results);
+
+		/* The closed loop keeps the 2ms between requests */
+		params.mode = GEM_EXEC_TRACE_REPLAY_TIMELINE;
+		mock_init(&m, &sink);
+		m.exec_delay = 3 * MS;
+		igt_assert_eq(gem_exec_trace_replay(&reader, &params, &sink, &results), 0);
+		igt_assert(m.exec[9].time - m.exec[0].time >= 9 * 5 * MS);
+		igt_assert(m.exec[9].time - m.exec[0].time > open_loop);
+		gem_exec_trace_replay_results_fini(&results);
+
+		gem_exec_trace_reader_fini(&reader);
+		free(t.data);
+	}
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+
+#include "i915/guc_log_capture.h"
+
+/*
+ * The relay file is faked with a pipe holding the sub-buffers, each filled
+ * with its index, and closed so that reading past them returns no data
+ * like an empty relay file does.
+ */
+static int fake_relay(size_t subbuf_size, int count, size_t tail)
+{
+	uint8_t *buf = malloc(subbuf_size);
+	int fds[2];
+
+	igt_assert(buf);
+	igt_assert_eq(pipe(fds), 0);
+	igt_assert(fcntl(fds[1], F_SETPIPE_SZ,
+			 (count + 1) * subbuf_size) >= 0);
+
+	for (int i = 0; i < count; i++) {
+		memset(buf, i, subbuf_size);
+		igt_assert_eq(write(fds[1], buf, subbuf_size), subbuf_size);
+	}
+	if (tail) {
+		memset(buf, count, tail);
+		igt_assert_eq(write(fds[1], buf, tail), tail);
+	}
+
+	close(fds[1]);
+	free(buf);
+
+	return fds[0];
+}
+
+static int output_file(void)
+{
+	int fd = memfd_create("guc_log", 0);
+
+	igt_assert(fd >= 0);
+	return fd;
+}
+
+static void check_file(int fd, size_t subbuf_size, int first, int count)
+{
+	uint8_t *buf = malloc(subbuf_size);
+
+	igt_assert(buf);
+	igt_assert_eq(lseek(fd, 0, SEEK_END), count * subbuf_size);
+
+	for (int i = 0; i < count; i++) {
+		igt_assert_eq(pread(fd, buf, subbuf_size, i * subbuf_size),
+			      subbuf_size);
+		for (size_t j = 0; j < subbuf_size; j++)
+			igt_assert_eq(buf[j], (uint8_t)(first + i));
+	}
+
+	free(buf);
+}
+
+static void capture_all(struct guc_log_capture *capture)
+{
+	while (guc_log_capture_pull(capture) > 0)
+		igt_assert(guc_log_capture_flush(capture) > 0);
+
+	guc_log_capture_close_queue(capture);
+	igt_assert_eq(guc_log_capture_flush(capture), 0);
+}
+
+static void test_capture(bool copy)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = 2 * getpagesize(),
+		.nr_subbufs = 4,
+		.copy = copy,
+	};
+	struct guc_log_capture capture;
+	int relay = fake_relay(params.subbuf_size, 10, 0);
+	int out = output_file();
+
+	igt_assert_eq(guc_log_capture_init(&capture, relay, out, &params), 0);
+	capture_all(&capture);
+
+	check_file(out, params.subbuf_size, 0, 10);
+	igt_assert_eq(capture.copy_in, copy);
+	igt_assert_eq(capture.copy_out, copy);
+	igt_assert_eq(capture.stats.subbufs, 10);
+	igt_assert_eq(capture.stats.bytes_written, 10 * params.subbuf_size);
+	igt_assert_eq(capture.stats.empty_reads, 1);
+	igt_assert_eq(capture.stats.stalls, 0);
+	igt_assert_eq(capture.stats.window_wraps, 0);
+	igt_assert_eq(capture.stats.discarded, 0);
+
+	guc_log_capture_fini(&capture);
+	close(out);
+	close(relay);
+}
+
+static void test_window(void)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = getpagesize(),
+		.nr_subbufs = 4,
+		/* Rounded down to 4 sub-buffers */
+		.window = 4 * getpagesize() + 100,
+	};
+	struct guc_log_capture capture;
+	int relay = fake_relay(params.subbuf_size, 10, 0);
+	int out = output_file();
+	int linear = output_file();
+
+	igt_assert_eq(guc_log_capture_init(&capture, relay, out, &params), 0);
+	capture_all(&capture);
+
+	igt_assert_eq(lseek(out, 0, SEEK_END), 4 * params.subbuf_size);
+	igt_assert_eq(capture.stats.subbufs, 10);
+	igt_assert_eq(capture.stats.window_wraps, 2);
+	igt_assert_eq(capture.stats.discarded, 6 * params.subbuf_size);
+
+	/* The last 4 sub-buffers, oldest first */
+	igt_assert_eq(guc_log_capture_linearize(&capture, linear), 0);
+	check_file(linear, params.subbuf_size, 6, 4);
+
+	guc_log_capture_fini(&capture);
+	close(linear);
+	close(out);
+	close(relay);
+}
+
+static void *delayed_flush(void *data)
+{
+	struct guc_log_capture *capture = data;
+
+	usleep(100 * 1000);
+	igt_assert(guc_log_capture_flush(capture) > 0);
+
+	return NULL;
+}
+
+static void test_stall(void)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = getpagesize(),
+		.nr_subbufs = 2,
+	};
+	struct guc_log_capture capture;
+	int relay = fake_relay(params.subbuf_size, 3, 0);
+	int out = output_file();
+	pthread_t thread;
+
+	igt_assert_eq(guc_log_capture_init(&capture, relay, out, &params), 0);
+	igt_assert_eq(capture.queue_size, 2 * params.subbuf_size);
+
+	igt_assert(guc_log_capture_pull(&capture) > 0);
+	igt_assert(guc_log_capture_pull(&capture) > 0);
+	igt_assert_eq(capture.stats.stalls, 0);
+
+	/* The queue is full until the flush makes room */
+	pthread_create(&thread, NULL, delayed_flush, &capture);
+	igt_assert(guc_log_capture_pull(&capture) > 0);
+	igt_assert_eq(capture.stats.stalls, 1);
+	pthread_join(thread, NULL);
+
+	guc_log_capture_close_queue(&capture);
+	while (guc_log_capture_flush(&capture) > 0)
+		;
+	check_file(out, params.subbuf_size, 0, 3);
+
+	guc_log_capture_fini(&capture);
+	close(out);
+	close(relay);
+}
+
+static void test_partial(void)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = getpagesize(),
+		.nr_subbufs = 4,
+	};
+	struct guc_log_capture capture;
+	int relay = fake_relay(params.subbuf_size, 1, 100);
+	int out = output_file();
+
+	igt_assert_eq(guc_log_capture_init(&capture, relay, out, &params), 0);
+	igt_assert_eq(guc_log_capture_pull(&capture), params.subbuf_size);
+	igt_assert_eq(guc_log_capture_pull(&capture), -EIO);
+
+	guc_log_capture_fini(&capture);
+	close(out);
+	close(relay);
+}
+
+igt_main
+{
+	igt_subtest("splice")
+		test_capture(false);
+
+	igt_subtest("copy")
+		test_capture(true);
+
+	igt_subtest("window")
+		test_window();
+
+	igt_subtest("stall")
+		test_stall();
+
+	igt_subtest("partial")
+		test_partial();
+}
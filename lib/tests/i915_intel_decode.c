@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+
+#include "i915/intel_decode.h"
+
+#define IVB_GT2 0x0162
+
+/* MI_NOOP, a gen7 PIPE_CONTROL, MI_BATCH_BUFFER_END */
+static uint32_t batch[] = {
+	0x00000000,
+	0x7a000002, 0x00100000, 0x00000000, 0x00000000,
+	0x05000000,
+};
+
+static char *decode(struct intel_decode *ctx, uint32_t *data, int count)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&buf, &size);
+
+	igt_assert(out);
+	intel_decode_set_output_file(ctx, out);
+	intel_decode_set_batch_pointer(ctx, data, 0x1000, count);
+	intel_decode(ctx);
+	fclose(out);
+
+	return buf;
+}
+
+static int count_lines(const char *str)
+{
+	int lines = 0;
+
+	while ((str = strchr(str, '\n'))) {
+		lines++;
+		str++;
+	}
+
+	return lines;
+}
+
+struct thread_data {
+	struct intel_decode *ctx;
+	uint32_t *data;
+	int count;
+	char *out;
+};
+
+static void *decode_thread(void *arg)
+{
+	struct thread_data *t = arg;
+
+	t->out = decode(t->ctx, t->data, t->count);
+	return NULL;
+}
+
+igt_main
+{
+	struct intel_decode *ctx;
+
+	igt_fixture {
+		ctx = intel_decode_context_alloc(IVB_GT2);
+		igt_assert(ctx);
+	}
+
+	igt_subtest("text") {
+		char *out;
+
+		intel_decode_set_head_tail(ctx, 0x1004, 0xffffffff);
+		out = decode(ctx, batch, ARRAY_SIZE(batch));
+		igt_assert(strstr(out, "0x00001000:      0x00000000: MI_NOOP\n"));
+		igt_assert(strstr(out, "0x00001004: HEAD 0x7a000002: PIPE_CONTROL"));
+		igt_assert(strstr(out, "MI_BATCH_BUFFER_END\n"));
+		igt_assert_eq(count_lines(out), ARRAY_SIZE(batch));
+		free(out);
+	}
+
+	igt_subtest("json") {
+		char *out, *line;
+
+		intel_decode_set_head_tail(ctx, 0x1004, 0xffffffff);
+		intel_decode_set_output_format(ctx, INTEL_DECODE_FORMAT_JSON);
+		out = decode(ctx, batch, ARRAY_SIZE(batch));
+		intel_decode_set_output_format(ctx, INTEL_DECODE_FORMAT_TEXT);
+
+		/* One object per packet */
+		igt_assert_eq(count_lines(out), 3);
+		for (line = out; *line; line = strchr(line, '\n') + 1)
+			igt_assert(!strncmp(line, "{\"offset\":", 10));
+
+		igt_assert(strstr(out, "{\"offset\":4096,\"lines\":[{\"offset\":4096,\"dword\":0,\"text\":\"MI_NOOP\"}],\"length\":1}\n"));
+		igt_assert(strstr(out, "{\"offset\":4100,\"dword\":2046820354,\"mark\":\"HEAD\",\"text\":\"PIPE_CONTROL"));
+		igt_assert(strstr(out, "\"length\":4}\n"));
+		free(out);
+	}
+
+	igt_subtest("threads") {
+		struct thread_data t[4];
+		uint32_t *data;
+		char *ref;
+		int count = 4096;
+
+		/* Arbitrary packets, decoding garbage must be deterministic too */
+		data = malloc(count * sizeof(*data));
+		igt_assert(data);
+		srandom(0x1234);
+		for (int i = 0; i < count; i++)
+			data[i] = random() & 0xffff00ff;
+
+		intel_decode_set_head_tail(ctx, 0xffffffff, 0xffffffff);
+		ref = decode(ctx, data, count);
+
+		for (int i = 0; i < ARRAY_SIZE(t); i++) {
+			t[i].ctx = intel_decode_context_alloc(IVB_GT2);
+			igt_assert(t[i].ctx);
+			t[i].data = data;
+			t[i].count = count;
+		}
+
+		{
+			pthread_t threads[ARRAY_SIZE(t)];
+
+			for (int i = 0; i < ARRAY_SIZE(t); i++)
+				igt_assert_eq(pthread_create(&threads[i], NULL,
+							     decode_thread, &t[i]), 0);
+			for (int i = 0; i < ARRAY_SIZE(t); i++)
+				pthread_join(threads[i], NULL);
+		}
+
+		for (int i = 0; i < ARRAY_SIZE(t); i++) {
+			igt_assert(!strcmp(t[i].out, ref));
+			free(t[i].out);
+			intel_decode_context_free(t[i].ctx);
+		}
+
+		free(ref);
+		free(data);
+	}
+
+	igt_fixture
+		intel_decode_context_free(ctx);
+}
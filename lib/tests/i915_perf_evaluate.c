@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <i915_drm.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "i915/perf.h"
+
+/*
+ * Checks the batch evaluation functions generated for the metric sets
+ * against the per-counter read functions, on deltas accumulated from a
+ * sequence of OA reports like a recording would contain.
+ */
+
+#define N_RECORDS 64
+#define RECORD_SIZE (sizeof(struct drm_i915_perf_record_header) + 256)
+
+static const struct {
+	const char *name;
+	uint32_t devid;
+} devices[] = {
+	{ "hsw", 0x0412 },
+	{ "bdw", 0x1616 },
+	{ "skl", 0x1912 },
+	{ "tgl", 0x9a49 },
+	{ "dg1", 0x4905 },
+};
+
+static struct drm_i915_query_topology_info *topology_gt2(void)
+{
+	const int n_slices = 1, n_subslices = 6, eu_stride = 2;
+	struct drm_i915_query_topology_info *topo;
+
+	topo = calloc(1, sizeof(*topo) + 2 + n_subslices * eu_stride);
+	igt_assert(topo);
+
+	topo->max_slices = n_slices;
+	topo->max_subslices = n_subslices;
+	topo->max_eus_per_subslice = 8 * eu_stride;
+	topo->subslice_offset = 1;
+	topo->subslice_stride = 1;
+	topo->eu_offset = 2;
+	topo->eu_stride = eu_stride;
+
+	topo->data[0] = 0x1;
+	topo->data[1] = (1 << n_subslices) - 1;
+	memset(&topo->data[topo->eu_offset], 0xff, n_subslices * eu_stride);
+
+	return topo;
+}
+
+/* Reports with counters going up by random amounts, sometimes wrapping */
+static uint8_t *generate_records(void)
+{
+	uint8_t *records = calloc(N_RECORDS, RECORD_SIZE);
+	uint32_t counters[64] = {};
+
+	igt_assert(records);
+
+	for (int r = 0; r < N_RECORDS; r++) {
+		struct drm_i915_perf_record_header *header =
+			(void *)(records + r * RECORD_SIZE);
+		uint32_t *report = (uint32_t *)(header + 1);
+
+		header->type = DRM_I915_PERF_RECORD_SAMPLE;
+		header->size = RECORD_SIZE;
+
+		for (int i = 0; i < 64; i++) {
+			/* Every so often an idle period */
+			if (r % 8)
+				counters[i] += (uint32_t)random() >> (i % 24);
+			report[i] = counters[i];
+		}
+	}
+
+	return records;
+}
+
+static void check_metric_set(const struct intel_perf *perf,
+			     const struct intel_perf_metric_set *metric_set,
+			     const uint8_t *records)
+{
+	struct intel_perf_accumulator *accumulators;
+	union intel_perf_counter_value *values;
+	const int n = N_RECORDS - 1;
+
+	igt_assert(metric_set->evaluate);
+
+	accumulators = calloc(n, sizeof(*accumulators));
+	values = calloc(n * metric_set->n_counters, sizeof(*values));
+	igt_assert(accumulators && values);
+
+	for (int i = 0; i < n; i++)
+		intel_perf_accumulate_reports(&accumulators[i], perf, metric_set,
+					      (const void *)(records + i * RECORD_SIZE),
+					      (const void *)(records + (i + 1) * RECORD_SIZE));
+
+	metric_set->evaluate(perf, metric_set, accumulators, n, values);
+
+	for (int c = 0; c < metric_set->n_counters; c++) {
+		const struct intel_perf_logical_counter *counter =
+			&metric_set->counters[c];
+
+		for (int i = 0; i < n; i++) {
+			const union intel_perf_counter_value *value =
+				&values[c * n + i];
+
+			switch (counter->storage) {
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
+				igt_assert_f(value->u64 ==
+					     counter->read_uint64(perf, metric_set,
+								  accumulators[i].deltas),
+					     "%s/%s, accumulator %d\n",
+					     metric_set->symbol_name,
+					     counter->symbol_name, i);
+				break;
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
+			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT: {
+				double expected =
+					counter->read_float(perf, metric_set,
+							    accumulators[i].deltas);
+
+				/* Bit for bit, not within an epsilon */
+				igt_assert_f(!memcmp(&value->f, &expected,
+						     sizeof(expected)),
+					     "%s/%s, accumulator %d: %g != %g\n",
+					     metric_set->symbol_name,
+					     counter->symbol_name, i,
+					     value->f, expected);
+				break;
+			}
+			}
+		}
+	}
+
+	free(values);
+	free(accumulators);
+}
+
+igt_main
+{
+	struct drm_i915_query_topology_info *topology;
+	uint8_t *records;
+
+	igt_fixture {
+		srandom(0x5eed);
+		topology = topology_gt2();
+		records = generate_records();
+	}
+
+	igt_subtest_with_dynamic("bit-exact") {
+		for (int d = 0; d < ARRAY_SIZE(devices); d++) {
+			igt_dynamic(devices[d].name) {
+				struct intel_perf_metric_set *metric_set;
+				struct intel_perf *perf;
+
+				perf = intel_perf_for_devinfo(devices[d].devid, 0,
+							      12000000,
+							      300000000,
+							      1100000000,
+							      topology);
+				igt_assert(perf);
+
+				igt_list_for_each_entry(metric_set,
+							&perf->metric_sets, link)
+					check_metric_set(perf, metric_set, records);
+
+				intel_perf_free(perf);
+			}
+		}
+	}
+
+	igt_fixture {
+		free(records);
+		free(topology);
+	}
+}
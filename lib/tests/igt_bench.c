@@ -0,0 +1,217 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_bench.h"
+#include "igt_core.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
+
+struct sampler {
+	unsigned int calls;
+	const double *values;
+	unsigned int n_values;
+};
+
+static double sample(void *data)
+{
+	struct sampler *s = data;
+
+	return s->values[s->calls++ % s->n_values];
+}
+
+#define bench_init(...) do { \
+	char *argv[] = { "igt_bench", __VA_ARGS__, NULL }; \
+	igt_bench_init(ARRAY_SIZE(argv) - 1, argv, \
+		       NULL, NULL, NULL, NULL, NULL); \
+} while (0)
+
+static void test_converged(void)
+{
+	static const double values[] = { 10 };
+	struct sampler s = { .values = values, .n_values = 1 };
+	struct igt_bench_result result;
+
+	bench_init("--warmup=0", "--min-samples=4");
+	igt_bench_measure(sample, &s, &result);
+
+	igt_assert_eq(s.calls, 4);
+	igt_assert_eq(result.samples.n_values, 4);
+	igt_assert(result.converged);
+	igt_assert_eq_double(result.mean, 10);
+	igt_assert_eq_double(result.ci95, 0);
+	igt_bench_result_fini(&result);
+}
+
+static void test_max_samples(void)
+{
+	static const double values[] = { 1, 100 };
+	struct sampler s = { .values = values, .n_values = 2 };
+	struct igt_bench_result result;
+
+	bench_init("--warmup=0", "--max-samples=20");
+	igt_bench_measure(sample, &s, &result);
+
+	igt_assert_eq(result.samples.n_values, 20);
+	igt_assert(!result.converged);
+	igt_assert_eq_double(result.min, 1);
+	igt_assert_eq_double(result.max, 100);
+	igt_assert_eq_double(result.mean, 50.5);
+	igt_bench_result_fini(&result);
+}
+
+static void test_target_error(void)
+{
+	static const double values[] = { 99, 101 };
+	struct sampler s = { .values = values, .n_values = 2 };
+	struct igt_bench_result result;
+
+	/* stddev ~1, so a 1% error needs t(n-1) / sqrt(n) < 1 */
+	bench_init("--warmup=0", "--min-samples=2", "--target-error=1");
+	igt_bench_measure(sample, &s, &result);
+
+	igt_assert(result.converged);
+	igt_assert_eq(result.samples.n_values, 7);
+	igt_assert(result.ci95 <= 0.01 * result.mean);
+	igt_bench_result_fini(&result);
+}
+
+static void test_fixed_samples(void)
+{
+	static const double values[] = { 1, 100 };
+	struct sampler s = { .values = values, .n_values = 2 };
+	struct igt_bench_result result;
+
+	bench_init("--warmup=0", "-r", "3");
+	igt_bench_measure(sample, &s, &result);
+
+	igt_assert_eq(s.calls, 3);
+	igt_assert_eq(result.samples.n_values, 3);
+	igt_bench_result_fini(&result);
+}
+
+static void test_warmup(void)
+{
+	static const double values[] = { 1 };
+	struct sampler s = { .values = values, .n_values = 1 };
+	struct igt_bench_result result;
+
+	bench_init("--warmup=0.01", "-r", "3");
+	igt_bench_measure(sample, &s, &result);
+
+	igt_assert_lt(3, s.calls);
+	igt_assert_eq(result.samples.n_values, 3);
+	igt_bench_result_fini(&result);
+}
+
+static void test_defaults(void)
+{
+	static const double values[] = { 1, 100 };
+	struct sampler s = { .values = values, .n_values = 2 };
+	struct igt_bench_result result;
+
+	igt_bench_set_defaults(0, 2, 2);
+
+	bench_init("--max-time=60");
+	igt_assert_eq_double(igt_bench_sample_time(), 2);
+	igt_bench_measure(sample, &s, &result);
+	igt_assert_eq(s.calls, 2);
+	igt_bench_result_fini(&result);
+
+	/* The command line still wins */
+	s.calls = 0;
+	bench_init("-r", "4", "--sample-time=0.5");
+	igt_assert_eq_double(igt_bench_sample_time(), 0.5);
+	igt_bench_measure(sample, &s, &result);
+	igt_assert_eq(s.calls, 4);
+	igt_bench_result_fini(&result);
+
+	igt_bench_set_defaults(0.5, 1, 0);
+}
+
+static void test_json(void)
+{
+	static const double values[] = { 1, 2, 3 };
+	struct sampler s = { .values = values, .n_values = 3 };
+	char path[] = "/tmp/igt_bench.XXXXXX";
+	char *arg, line[4096];
+	FILE *f;
+	int fd;
+
+	fd = mkstemp(path);
+	igt_assert_lte(0, fd);
+	close(fd);
+
+	igt_assert(asprintf(&arg, "--json=%s", path) > 0);
+	bench_init("--warmup=0", "-r", "3", arg);
+	free(arg);
+
+	igt_bench_param("mode", "a \"quoted\"\tvalue");
+	igt_bench_run("first", "us", IGT_BENCH_LOWER_IS_BETTER, sample, &s);
+	igt_bench_run("second", "MiB/s", 0, sample, &s);
+	bench_init("--warmup=0");
+
+	f = fopen(path, "r");
+	igt_assert(f);
+
+	igt_assert(fgets(line, sizeof(line), f));
+	igt_assert(strstr(line, "\"name\":\"first\""));
+	igt_assert(strstr(line, "\"lower_is_better\":true"));
+	igt_assert(strstr(line, "\"params\":{\"mode\":\"a \\\"quoted\\\"\\u0009value\"}"));
+	igt_assert(strstr(line, "\"samples\":[1,2,3]"));
+	igt_assert(strstr(line, "\"n\":3"));
+	igt_assert(strstr(line, "\"mean\":2,"));
+	igt_assert(strstr(line, "\"median\":2,"));
+
+	igt_assert(fgets(line, sizeof(line), f));
+	igt_assert(strstr(line, "\"name\":\"second\""));
+	igt_assert(strstr(line, "\"lower_is_better\":false"));
+	igt_assert(strstr(line, "\"samples\":[1,2,3]"));
+
+	igt_assert(!fgets(line, sizeof(line), f));
+
+	fclose(f);
+	unlink(path);
+}
+
+igt_main
+{
+	igt_subtest("converged")
+		test_converged();
+	igt_subtest("max-samples")
+		test_max_samples();
+	igt_subtest("target-error")
+		test_target_error();
+	igt_subtest("fixed-samples")
+		test_fixed_samples();
+	igt_subtest("warmup")
+		test_warmup();
+	igt_subtest("defaults")
+		test_defaults();
+	igt_subtest("json")
+		test_json();
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <cairo.h>
+
+#include "igt_core.h"
+#include "igt_chamelium.h"
+
+/* The original one stream per pass implementation of the Chamelium CRC */
+static uint32_t reference_xrgb_hash16(const unsigned char *buffer, int width,
+				      int height, int k, int m)
+{
+	unsigned char r, g, b;
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	uint64_t value;
+	int index;
+	int i;
+
+	for (i = 0; i < width * height; i++) {
+		if ((i % m) != k)
+			continue;
+
+		index = i * 4;
+
+		r = buffer[index + 2];
+		g = buffer[index + 1];
+		b = buffer[index + 0];
+
+		value = r | (g << 8) | (b << 16);
+		sum += ++count * value;
+	}
+
+	return ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+}
+
+static void check_crc(int width, int height, bool random_fill)
+{
+	cairo_surface_t *surface;
+	unsigned char *buffer;
+	igt_crc_t crc = {};
+	int i;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	igt_assert(cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+	igt_assert_eq(cairo_image_surface_get_stride(surface), width * 4);
+
+	buffer = cairo_image_surface_get_data(surface);
+	for (i = 0; i < width * height * 4; i++)
+		buffer[i] = random_fill ? random() : 0xff;
+
+	chamelium_calculate_surface_crc(surface, &crc);
+
+	igt_assert_eq(crc.n_words, 4);
+	for (i = 0; i < 4; i++)
+		igt_assert_f(crc.crc[i] ==
+			     reference_xrgb_hash16(buffer, width, height,
+						   3 - i, 4),
+			     "%dx%d: crc word %d mismatch\n",
+			     width, height, i);
+
+	cairo_surface_destroy(surface);
+}
+
+igt_main
+{
+	igt_fixture
+		srandom(0xc4a3);
+
+	igt_subtest("small") {
+		/* Partial and single groups of 4 pixels */
+		for (int w = 1; w <= 9; w++)
+			for (int h = 1; h <= 3; h++)
+				check_crc(w, h, true);
+	}
+
+	igt_subtest("odd-sizes") {
+		check_crc(641, 479, true);
+		check_crc(1023, 769, true);
+		check_crc(1366, 768, true);
+	}
+
+	igt_subtest("large") {
+		/* Big enough to be split into bands */
+		check_crc(1920, 1080, true);
+		check_crc(3840, 2160, true);
+		check_crc(4095, 2161, true);
+	}
+
+	igt_subtest("saturated")
+		check_crc(3840, 2160, false);
+}
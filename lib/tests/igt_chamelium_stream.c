@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_chamelium_stream.h"
+
+/*
+ * A fake Chamelium stream server, speaking just enough of the protocol to
+ * exercise the client: version, real-time audio and real-time video dumps.
+ */
+
+#define MSG_GET_VERSION 1
+#define MSG_VIDEO_STREAM 2
+#define MSG_DUMP_REALTIME_VIDEO 5
+#define MSG_STOP_DUMP_VIDEO 6
+#define MSG_DUMP_REALTIME_AUDIO 7
+#define MSG_STOP_DUMP_AUDIO 8
+
+#define KIND_RESPONSE 1
+#define KIND_DATA 2
+
+#define ERR_VIDEO_DROP 5
+#define ERR_AUDIO_DROP 7
+
+/* Frames or pages sent per dump, with one drop notification after the first */
+#define FAKE_DUMP_COUNT 6
+#define FAKE_AUDIO_SAMPLES 512
+
+struct fake_server {
+	int listen_fd;
+	unsigned int port;
+	uint8_t major, minor;
+	pthread_t thread;
+};
+
+static bool fake_read(int fd, void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret <= 0)
+			return false;
+		buf = (char *) buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static void fake_write(int fd, const void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+
+		igt_assert(ret > 0);
+		buf = (const char *) buf + ret;
+		len -= ret;
+	}
+}
+
+static void fake_send(int fd, int kind, int type, int err,
+		      const void *body, size_t len)
+{
+	uint16_t header[4];
+
+	header[0] = htons(kind << 8 | type);
+	header[1] = htons(err);
+	*(uint32_t *) &header[2] = htonl(len);
+
+	fake_write(fd, header, sizeof(header));
+	if (len)
+		fake_write(fd, body, len);
+}
+
+static uint8_t fake_pixel(uint32_t frame, size_t i)
+{
+	return (frame * 31 + i * 7) & 0xff;
+}
+
+static void fake_send_frames(int fd, int width, int height)
+{
+	size_t size = 12 + (size_t) width * height * 3;
+	uint8_t *body = malloc(size);
+
+	igt_assert(body);
+
+	for (uint32_t n = 0; n < FAKE_DUMP_COUNT; n++) {
+		memset(body, 0, 12);
+		*(uint32_t *) &body[0] = htonl(n);
+		*(uint16_t *) &body[4] = htons(width);
+		*(uint16_t *) &body[6] = htons(height);
+		for (size_t i = 12; i < size; i++)
+			body[i] = fake_pixel(n, i - 12);
+
+		fake_send(fd, KIND_DATA, MSG_DUMP_REALTIME_VIDEO, 0,
+			  body, size);
+		if (n == 0)
+			fake_send(fd, KIND_DATA, MSG_DUMP_REALTIME_VIDEO,
+				  ERR_VIDEO_DROP, NULL, 0);
+	}
+
+	free(body);
+}
+
+static void fake_send_pages(int fd)
+{
+	uint32_t body[1 + FAKE_AUDIO_SAMPLES];
+
+	for (uint32_t n = 0; n < FAKE_DUMP_COUNT; n++) {
+		body[0] = htonl(n);
+		for (int i = 0; i < FAKE_AUDIO_SAMPLES; i++)
+			body[1 + i] = n * FAKE_AUDIO_SAMPLES + i;
+
+		fake_send(fd, KIND_DATA, MSG_DUMP_REALTIME_AUDIO, 0,
+			  body, sizeof(body));
+		if (n == 0)
+			fake_send(fd, KIND_DATA, MSG_DUMP_REALTIME_AUDIO,
+				  ERR_AUDIO_DROP, NULL, 0);
+	}
+}
+
+static void *fake_server_thread(void *data)
+{
+	struct fake_server *server = data;
+	int width = 0, height = 0;
+	uint16_t header[4];
+	uint8_t body[16];
+	int fd;
+
+	fd = accept(server->listen_fd, NULL, NULL);
+	igt_assert(fd >= 0);
+
+	while (fake_read(fd, header, sizeof(header))) {
+		int type = ntohs(header[0]) & 0xff;
+		size_t len = ntohl(*(uint32_t *) &header[2]);
+
+		igt_assert(len <= sizeof(body));
+		igt_assert(fake_read(fd, body, len));
+
+		switch (type) {
+		case MSG_GET_VERSION:
+			body[0] = server->major;
+			body[1] = server->minor;
+			fake_send(fd, KIND_RESPONSE, type, 0, body, 2);
+			break;
+		case MSG_VIDEO_STREAM:
+			igt_assert_eq(len, 4);
+			width = ntohs(*(uint16_t *) &body[0]);
+			height = ntohs(*(uint16_t *) &body[2]);
+			fake_send(fd, KIND_RESPONSE, type, 0, NULL, 0);
+			break;
+		case MSG_DUMP_REALTIME_VIDEO:
+			igt_assert_eq(len, 2);
+			fake_send(fd, KIND_RESPONSE, type, 0, NULL, 0);
+			fake_send_frames(fd, width, height);
+			break;
+		case MSG_DUMP_REALTIME_AUDIO:
+			igt_assert_eq(len, 1);
+			fake_send(fd, KIND_RESPONSE, type, 0, NULL, 0);
+			fake_send_pages(fd);
+			break;
+		case MSG_STOP_DUMP_VIDEO:
+		case MSG_STOP_DUMP_AUDIO:
+			fake_send(fd, KIND_RESPONSE, type, 0, NULL, 0);
+			break;
+		default:
+			fake_send(fd, KIND_RESPONSE, type, 1, NULL, 0);
+			break;
+		}
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void fake_server_start(struct fake_server *server,
+			      uint8_t major, uint8_t minor)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t addr_len = sizeof(addr);
+
+	server->major = major;
+	server->minor = minor;
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	igt_assert(server->listen_fd >= 0);
+	igt_assert_eq(bind(server->listen_fd, (struct sockaddr *) &addr,
+			   sizeof(addr)), 0);
+	igt_assert_eq(listen(server->listen_fd, 1), 0);
+	igt_assert_eq(getsockname(server->listen_fd, (struct sockaddr *) &addr,
+				  &addr_len), 0);
+	server->port = ntohs(addr.sin_port);
+
+	igt_assert_eq(pthread_create(&server->thread, NULL,
+				     fake_server_thread, server), 0);
+}
+
+static void fake_server_stop(struct fake_server *server)
+{
+	pthread_join(server->thread, NULL);
+	close(server->listen_fd);
+}
+
+static void test_video(int width, int height)
+{
+	struct chamelium_stream_frame frame = {};
+	struct chamelium_stream *client;
+	struct fake_server server;
+	unsigned char *data;
+
+	fake_server_start(&server, 1, 0);
+	client = chamelium_stream_init_at("127.0.0.1", server.port);
+	igt_assert(client);
+
+	/* Preallocated for the whole dump, received into in place */
+	frame.capacity = (size_t) width * height * 3;
+	frame.data = data = malloc(frame.capacity);
+	igt_assert(data);
+
+	igt_assert(chamelium_stream_config_video(client, width, height));
+	igt_assert(chamelium_stream_dump_realtime_video(client,
+							CHAMELIUM_STREAM_REALTIME_BEST_EFFORT));
+
+	/* Leave some frames in flight, to be dropped on stop */
+	for (uint32_t n = 0; n < FAKE_DUMP_COUNT / 2; n++) {
+		igt_assert(chamelium_stream_receive_realtime_video(client,
+								   &frame));
+		igt_assert_eq(frame.frame_number, n);
+		igt_assert_eq(frame.width, width);
+		igt_assert_eq(frame.height, height);
+		igt_assert_eq(frame.size, frame.capacity);
+		igt_assert(frame.data == data);
+
+		for (size_t i = 0; i < frame.size; i++)
+			igt_assert_eq(frame.data[i], fake_pixel(n, i));
+	}
+
+	igt_assert(chamelium_stream_stop_realtime_video(client));
+
+	chamelium_stream_deinit(client);
+	fake_server_stop(&server);
+	free(frame.data);
+}
+
+static void test_audio(void)
+{
+	struct chamelium_stream *client;
+	struct fake_server server;
+	int32_t *buf = NULL;
+	size_t buf_len = 0;
+	size_t page_count;
+
+	fake_server_start(&server, 1, 0);
+	client = chamelium_stream_init_at("127.0.0.1", server.port);
+	igt_assert(client);
+
+	igt_assert(chamelium_stream_dump_realtime_audio(client,
+							CHAMELIUM_STREAM_REALTIME_BEST_EFFORT));
+
+	for (size_t n = 0; n < FAKE_DUMP_COUNT / 2; n++) {
+		igt_assert(chamelium_stream_receive_realtime_audio(client,
+								   &page_count,
+								   &buf,
+								   &buf_len));
+		igt_assert_eq(page_count, n);
+		igt_assert_eq(buf_len, FAKE_AUDIO_SAMPLES);
+		for (int i = 0; i < FAKE_AUDIO_SAMPLES; i++)
+			igt_assert_eq(buf[i], n * FAKE_AUDIO_SAMPLES + i);
+	}
+
+	igt_assert(chamelium_stream_stop_realtime_audio(client));
+
+	chamelium_stream_deinit(client);
+	fake_server_stop(&server);
+	free(buf);
+}
+
+igt_main
+{
+	igt_subtest("video-small")
+		test_video(64, 48);
+
+	igt_subtest("video-large")
+		test_video(1920, 1080);
+
+	igt_subtest("audio")
+		test_audio();
+
+	igt_subtest("version-mismatch") {
+		struct fake_server server;
+
+		fake_server_start(&server, 2, 0);
+		igt_assert(!chamelium_stream_init_at("127.0.0.1", server.port));
+		fake_server_stop(&server);
+	}
+}
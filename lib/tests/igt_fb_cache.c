@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_fb.h"
+#include "igt_kms.h"
+
+#define WIDTH 256
+#define HEIGHT 128
+
+static const uint32_t formats[] = {
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_ARGB8888,
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_XRGB2101010,
+	DRM_FORMAT_YUYV,
+	DRM_FORMAT_NV12,
+	DRM_FORMAT_P010,
+};
+
+static const uint64_t modifiers[] = {
+	DRM_FORMAT_MOD_LINEAR,
+	I915_FORMAT_MOD_X_TILED,
+	I915_FORMAT_MOD_Y_TILED,
+	I915_FORMAT_MOD_4_TILED,
+};
+
+static const struct {
+	const char *name;
+	enum igt_fb_fill fill;
+	double r, g, b;
+} fills[] = {
+	{ "color", IGT_FB_FILL_COLOR, 0.25, 0.5, 1.0 },
+	{ "pattern", IGT_FB_FILL_PATTERN },
+	{ "color-pattern", IGT_FB_FILL_COLOR_PATTERN, 1.0, 0.0, 0.5 },
+};
+
+/* What igt_create_color_fb() and friends drew before the cache */
+static void fill_uncached(int fd, struct igt_fb *fb, enum igt_fb_fill fill,
+			  double r, double g, double b)
+{
+	cairo_t *cr = igt_get_cairo_ctx(fd, fb);
+
+	if (fill != IGT_FB_FILL_PATTERN)
+		igt_paint_color(cr, 0, 0, fb->width, fb->height, r, g, b);
+	if (fill != IGT_FB_FILL_COLOR)
+		igt_paint_test_pattern(cr, fb->width, fb->height);
+
+	igt_put_cairo_ctx(cr);
+}
+
+static void assert_fb_equal(int fd, struct igt_fb *a, struct igt_fb *b)
+{
+	void *map_a, *map_b;
+
+	igt_assert_eq(a->num_planes, b->num_planes);
+	for (int i = 0; i < a->num_planes; i++) {
+		igt_assert_eq_u32(a->offsets[i], b->offsets[i]);
+		igt_assert_eq_u32(a->strides[i], b->strides[i]);
+	}
+	igt_assert_eq_u64(a->size, b->size);
+
+	/* Same layout, so the bos match byte for byte if the pixels do */
+	map_a = igt_fb_map_buffer(fd, a);
+	map_b = igt_fb_map_buffer(fd, b);
+	igt_assert(!memcmp(map_a, map_b, a->size));
+	igt_fb_unmap_buffer(b, map_b);
+	igt_fb_unmap_buffer(a, map_a);
+}
+
+static void test_identical(int fd, uint32_t format, uint64_t modifier)
+{
+	struct igt_fb cached, uncached;
+
+	for (int i = 0; i < ARRAY_SIZE(fills); i++) {
+		igt_create_fb(fd, WIDTH, HEIGHT, format, modifier, &uncached);
+		fill_uncached(fd, &uncached, fills[i].fill,
+			      fills[i].r, fills[i].g, fills[i].b);
+
+		/* Once painted into the cache, then copied from it */
+		for (int pass = 0; pass < 2; pass++) {
+			igt_create_fb(fd, WIDTH, HEIGHT, format, modifier,
+				      &cached);
+			igt_fb_fill_cached(fd, &cached, fills[i].fill,
+					   fills[i].r, fills[i].g, fills[i].b);
+
+			igt_debug("%s, pass %d\n", fills[i].name, pass);
+			assert_fb_equal(fd, &cached, &uncached);
+			igt_remove_fb(fd, &cached);
+		}
+
+		igt_remove_fb(fd, &uncached);
+	}
+}
+
+static void fill_color(int fd, double r, uint64_t modifier)
+{
+	struct igt_fb fb;
+
+	igt_create_fb(fd, WIDTH, HEIGHT, DRM_FORMAT_XRGB8888, modifier, &fb);
+	igt_fb_fill_cached(fd, &fb, IGT_FB_FILL_COLOR, r, 0.0, 0.0);
+	igt_remove_fb(fd, &fb);
+}
+
+static void test_stats(int fd, igt_display_t *display)
+{
+	struct igt_fb_cache_stats start, stats;
+	uint64_t entry_size;
+
+	igt_fb_cache_set_size(64ull << 20);
+	igt_fb_cache_flush();
+	igt_fb_cache_get_stats(&start);
+	igt_assert_eq_u64(start.entries, 0);
+	igt_assert_eq_u64(start.size, 0);
+
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.misses, start.misses + 1);
+	igt_assert_eq_u64(stats.hits, start.hits);
+	igt_assert_eq_u64(stats.entries, 1);
+	entry_size = stats.size;
+	igt_assert(entry_size >= WIDTH * HEIGHT * 4);
+
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.hits, start.hits + 1);
+	igt_assert_eq_u64(stats.entries, 1);
+
+	/* The contents are cached without the layout of the fb */
+	if (igt_display_has_format_mod(display, DRM_FORMAT_XRGB8888,
+				       I915_FORMAT_MOD_X_TILED)) {
+		fill_color(fd, 1.0, I915_FORMAT_MOD_X_TILED);
+		igt_fb_cache_get_stats(&stats);
+		igt_assert_eq_u64(stats.hits, start.hits + 2);
+	}
+
+	/* Room for a single entry, the least recently used one goes */
+	igt_fb_cache_set_size(entry_size);
+	fill_color(fd, 0.5, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.misses, start.misses + 2);
+	igt_assert_eq_u64(stats.evictions, start.evictions + 1);
+	igt_assert_eq_u64(stats.entries, 1);
+	igt_assert_eq_u64(stats.size, entry_size);
+
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.misses, start.misses + 3);
+	igt_assert_eq_u64(stats.evictions, start.evictions + 2);
+	igt_fb_cache_get_stats(&start);
+
+	/* Flushing drops everything but keeps the statistics */
+	igt_fb_cache_set_size(64ull << 20);
+	fill_color(fd, 0.5, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.entries, 2);
+
+	igt_fb_cache_flush();
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.entries, 0);
+	igt_assert_eq_u64(stats.size, 0);
+	igt_assert_eq_u64(stats.evictions, start.evictions + 2);
+	igt_assert_eq_u64(stats.misses, start.misses + 1);
+	igt_assert_eq_u64(stats.hits, start.hits);
+}
+
+static void test_disabled(int fd)
+{
+	struct igt_fb_cache_stats start, stats;
+
+	igt_fb_cache_set_size(64ull << 20);
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&start);
+	igt_assert_lt_u64(0, start.entries);
+
+	/* A size of 0 evicts everything and caches nothing from then on */
+	igt_fb_cache_set_size(0);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.entries, 0);
+	igt_assert_eq_u64(stats.size, 0);
+	igt_assert_eq_u64(stats.evictions, start.evictions + start.entries);
+
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	fill_color(fd, 1.0, DRM_FORMAT_MOD_LINEAR);
+	igt_fb_cache_get_stats(&stats);
+	igt_assert_eq_u64(stats.misses, start.misses + 2);
+	igt_assert_eq_u64(stats.hits, start.hits);
+	igt_assert_eq_u64(stats.entries, 0);
+	igt_assert_eq_u64(stats.size, 0);
+
+	igt_fb_cache_set_size(64ull << 20);
+}
+
+igt_main
+{
+	igt_display_t display;
+	int fd = -1;
+
+	igt_fixture {
+		fd = drm_open_driver_master(DRIVER_ANY);
+		igt_display_require(&display, fd);
+	}
+
+	igt_subtest_with_dynamic("identical") {
+		for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+			if (!igt_fb_supported_format(formats[i]))
+				continue;
+
+			for (int j = 0; j < ARRAY_SIZE(modifiers); j++) {
+				if (!igt_display_has_format_mod(&display,
+								formats[i],
+								modifiers[j]))
+					continue;
+
+				igt_dynamic_f("%s-%s",
+					      igt_format_str(formats[i]),
+					      igt_fb_modifier_name(modifiers[j]))
+					test_identical(fd, formats[i],
+						       modifiers[j]);
+			}
+		}
+	}
+
+	igt_subtest("stats")
+		test_stats(fd, &display);
+
+	igt_subtest("disabled")
+		test_disabled(fd);
+
+	igt_fixture {
+		igt_display_fini(&display);
+		drm_close_driver(fd);
+	}
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_kms.h"
+#include "igt_kms_snapshot.h"
+
+static drmModeModeInfo test_modes[] = {
+	{ .clock = 148500, .hdisplay = 1920, .hsync_start = 2008,
+	  .hsync_end = 2052, .htotal = 2200, .vdisplay = 1080,
+	  .vsync_start = 1084, .vsync_end = 1089, .vtotal = 1125,
+	  .vrefresh = 60, .type = DRM_MODE_TYPE_PREFERRED,
+	  .name = "1920x1080" },
+	{ .clock = 25175, .hdisplay = 640, .hsync_start = 656,
+	  .hsync_end = 752, .htotal = 800, .vdisplay = 480,
+	  .vsync_start = 490, .vsync_end = 492, .vtotal = 525,
+	  .vrefresh = 60, .name = "640x480" },
+};
+
+static uint32_t test_props[] = { 1, 2, 21 };
+static uint64_t test_prop_values[] = { 42, 0, 0xffff };
+static uint32_t test_encoders[] = { 61, 62 };
+
+static drmModeConnector test_connector = {
+	.connector_id = 71,
+	.encoder_id = 61,
+	.connector_type = DRM_MODE_CONNECTOR_HDMIA,
+	.connector_type_id = 1,
+	.connection = DRM_MODE_CONNECTED,
+	.mmWidth = 520,
+	.mmHeight = 320,
+	.subpixel = DRM_MODE_SUBPIXEL_UNKNOWN,
+	.count_modes = 2,
+	.modes = test_modes,
+	.count_props = 3,
+	.props = test_props,
+	.prop_values = test_prop_values,
+	.count_encoders = 2,
+	.encoders = test_encoders,
+};
+
+static drmModeConnector test_disconnected = {
+	.connector_id = 72,
+	.connector_type = DRM_MODE_CONNECTOR_DisplayPort,
+	.connector_type_id = 2,
+	.connection = DRM_MODE_DISCONNECTED,
+	.subpixel = DRM_MODE_SUBPIXEL_UNKNOWN,
+};
+
+static struct drm_mode_property_enum test_enums[] = {
+	{ .value = 0, .name = "Automatic" },
+	{ .value = 1, .name = "Full" },
+	{ .value = 2, .name = "Limited 16:235" },
+};
+
+static uint64_t test_enum_values[] = { 0, 1, 2 };
+
+static drmModePropertyRes test_enum_prop = {
+	.prop_id = 21,
+	.flags = DRM_MODE_PROP_ENUM,
+	.name = "Broadcast RGB",
+	.count_values = 3,
+	.values = test_enum_values,
+	.count_enums = 3,
+	.enums = test_enums,
+};
+
+static uint64_t test_range_values[] = { 0, 0xffff };
+
+static drmModePropertyRes test_range_prop = {
+	.prop_id = 2,
+	.flags = DRM_MODE_PROP_RANGE,
+	.name = "alpha",
+	.count_values = 2,
+	.values = test_range_values,
+};
+
+static void check_connector(const drmModeConnector *a,
+			    const drmModeConnector *b)
+{
+	igt_assert(a);
+	igt_assert_eq_u32(a->connector_id, b->connector_id);
+	igt_assert_eq_u32(a->encoder_id, b->encoder_id);
+	igt_assert_eq_u32(a->connector_type, b->connector_type);
+	igt_assert_eq_u32(a->connector_type_id, b->connector_type_id);
+	igt_assert_eq(a->connection, b->connection);
+	igt_assert_eq_u32(a->mmWidth, b->mmWidth);
+	igt_assert_eq_u32(a->mmHeight, b->mmHeight);
+	igt_assert_eq(a->subpixel, b->subpixel);
+
+	igt_assert_eq(a->count_modes, b->count_modes);
+	for (int i = 0; i < a->count_modes; i++)
+		igt_assert(!memcmp(&a->modes[i], &b->modes[i],
+				   sizeof(a->modes[i])));
+
+	igt_assert_eq(a->count_props, b->count_props);
+	for (int i = 0; i < a->count_props; i++) {
+		igt_assert_eq_u32(a->props[i], b->props[i]);
+		igt_assert_eq_u64(a->prop_values[i], b->prop_values[i]);
+	}
+
+	igt_assert_eq(a->count_encoders, b->count_encoders);
+	for (int i = 0; i < a->count_encoders; i++)
+		igt_assert_eq_u32(a->encoders[i], b->encoders[i]);
+}
+
+static void check_property(const drmModePropertyRes *a,
+			   const drmModePropertyRes *b)
+{
+	igt_assert(a);
+	igt_assert_eq_u32(a->prop_id, b->prop_id);
+	igt_assert_eq_u32(a->flags, b->flags);
+	igt_assert(!strcmp(a->name, b->name));
+
+	igt_assert_eq(a->count_values, b->count_values);
+	for (int i = 0; i < a->count_values; i++)
+		igt_assert_eq_u64(a->values[i], b->values[i]);
+
+	igt_assert_eq(a->count_enums, b->count_enums);
+	for (int i = 0; i < a->count_enums; i++) {
+		igt_assert_eq_u64(a->enums[i].value, b->enums[i].value);
+		igt_assert(!strcmp(a->enums[i].name, b->enums[i].name));
+	}
+
+	igt_assert_eq(a->count_blobs, b->count_blobs);
+}
+
+static void check_snapshot(struct igt_kms_snapshot *snap,
+			   const void *edid, size_t edid_len,
+			   const drmModePropertyBlobRes *blob)
+{
+	drmModePropertyBlobRes *b;
+	drmModePropertyRes *prop;
+	drmModeConnector *c;
+	const void *e;
+	size_t len;
+
+	c = igt_kms_snapshot_get_connector(snap, test_connector.connector_id);
+	check_connector(c, &test_connector);
+	drmModeFreeConnector(c);
+
+	c = igt_kms_snapshot_get_connector(snap, test_disconnected.connector_id);
+	check_connector(c, &test_disconnected);
+	drmModeFreeConnector(c);
+
+	igt_assert(!igt_kms_snapshot_get_connector(snap, 73));
+
+	e = igt_kms_snapshot_get_edid(snap, test_connector.connector_id, &len);
+	igt_assert_eq(len, edid_len);
+	igt_assert(!memcmp(e, edid, len));
+
+	e = igt_kms_snapshot_get_edid(snap, test_disconnected.connector_id,
+				      &len);
+	igt_assert(!e);
+	igt_assert_eq(len, 0);
+
+	prop = igt_kms_snapshot_get_property(snap, test_enum_prop.prop_id);
+	check_property(prop, &test_enum_prop);
+	drmModeFreeProperty(prop);
+
+	prop = igt_kms_snapshot_get_property(snap, test_range_prop.prop_id);
+	check_property(prop, &test_range_prop);
+	drmModeFreeProperty(prop);
+
+	igt_assert(!igt_kms_snapshot_get_property(snap, 1));
+
+	b = igt_kms_snapshot_get_blob(snap, blob->id);
+	igt_assert(b);
+	igt_assert_eq_u32(b->length, blob->length);
+	igt_assert(!memcmp(b->data, blob->data, b->length));
+	drmModeFreePropertyBlob(b);
+}
+
+static void write_file(const char *path, const char *contents)
+{
+	FILE *f = fopen(path, "w");
+
+	igt_assert(f);
+	fputs(contents, f);
+	fclose(f);
+}
+
+igt_simple_main
+{
+	char path[] = "/tmp/igt_kms_snapshot.XXXXXX";
+	struct igt_kms_snapshot *snap, *loaded;
+	drmModePropertyBlobRes blob;
+	uint8_t edid[256], data[1000];
+	drmModeConnector *c;
+	int fd;
+
+	for (int i = 0; i < sizeof(edid); i++)
+		edid[i] = i * 7;
+	for (int i = 0; i < sizeof(data); i++)
+		data[i] = i ^ 0x5a;
+
+	blob.id = 81;
+	blob.length = sizeof(data);
+	blob.data = data;
+
+	snap = igt_kms_snapshot_new();
+	igt_kms_snapshot_add_connector(snap, &test_disconnected, NULL, 0);
+	igt_kms_snapshot_add_connector(snap, &test_connector, edid,
+				       sizeof(edid));
+	igt_kms_snapshot_add_property(snap, &test_enum_prop);
+	igt_kms_snapshot_add_property(snap, &test_range_prop);
+	igt_kms_snapshot_add_blob(snap, &blob);
+
+	/* In-process replay */
+	check_snapshot(snap, edid, sizeof(edid), &blob);
+
+	/* Round trip through a file */
+	fd = mkstemp(path);
+	igt_assert(fd >= 0);
+	close(fd);
+
+	igt_assert_eq(igt_kms_snapshot_save(snap, path), 0);
+	loaded = igt_kms_snapshot_load(path);
+	igt_assert(loaded);
+	check_snapshot(loaded, edid, sizeof(edid), &blob);
+
+	/* Newer entries replace older ones */
+	test_connector.count_modes = 1;
+	igt_kms_snapshot_add_connector(loaded, &test_connector, edid,
+				       sizeof(edid));
+	c = igt_kms_snapshot_get_connector(loaded, test_connector.connector_id);
+	check_connector(c, &test_connector);
+	drmModeFreeConnector(c);
+	test_connector.count_modes = ARRAY_SIZE(test_modes);
+
+	igt_kms_snapshot_free(loaded);
+	igt_kms_snapshot_free(snap);
+
+	/* Malformed and foreign snapshots are rejected as a whole */
+	write_file(path, "igt-kms-snapshot 0\ndevice 0 0 0 0\n");
+	igt_assert(!igt_kms_snapshot_load(path));
+
+	write_file(path, "igt-kms-snapshot 1\ndevice 0 0 0 0\n"
+		   "connector 1 0 11 1 1 0 0 1\nmode 0123\n");
+	igt_assert(!igt_kms_snapshot_load(path));
+
+	write_file(path, "igt-kms-snapshot 1\ndevice 0 0 0 0\n"
+		   "encoder 1\n");
+	igt_assert(!igt_kms_snapshot_load(path));
+
+	unlink(path);
+	igt_assert(!igt_kms_snapshot_load(path));
+}
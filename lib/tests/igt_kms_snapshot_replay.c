@@ -0,0 +1,407 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_kms.h"
+#include "igt_kms_snapshot.h"
+#include "igt_sysfs.h"
+
+/*
+ * A KMS device with two CRTCs, each fed by its own encoder. libigt calls
+ * into libdrm, and from the snapshot code into igt_connector_sysfs_open(),
+ * through the dynamic linker, so the definitions below take precedence and
+ * no hardware is needed. As after boot, the kernel reports no modes for a
+ * connector until it has been probed, and only probes are counted.
+ */
+static uint32_t test_crtcs[] = { 31, 32 };
+static uint32_t test_encoders[] = { 61, 62 };
+static uint32_t test_connectors[] = { 71, 72, 73 };
+
+static uint32_t test_props[] = { 91 };
+static uint64_t test_values[][1] = { { 0 }, { 0 }, { 0 } };
+
+static drmModeModeInfo test_modes[] = {
+	{ .clock = 25175, .hdisplay = 640, .hsync_start = 656,
+	  .hsync_end = 752, .htotal = 800, .vdisplay = 480,
+	  .vsync_start = 490, .vsync_end = 492, .vtotal = 525,
+	  .vrefresh = 60, .name = "640x480" },
+	{ .clock = 148500, .hdisplay = 1920, .hsync_start = 2008,
+	  .hsync_end = 2052, .htotal = 2200, .vdisplay = 1080,
+	  .vsync_start = 1084, .vsync_end = 1089, .vtotal = 1125,
+	  .vrefresh = 60, .type = DRM_MODE_TYPE_PREFERRED,
+	  .name = "1920x1080" },
+};
+
+static drmModeConnector test_kernel[] = {
+	{
+		.connector_id = 71,
+		.encoder_id = 61,
+		.connector_type = DRM_MODE_CONNECTOR_HDMIA,
+		.connector_type_id = 1,
+		.connection = DRM_MODE_CONNECTED,
+		.subpixel = DRM_MODE_SUBPIXEL_UNKNOWN,
+		.count_modes = 2,
+		.modes = test_modes,
+		.count_props = 1,
+		.props = test_props,
+		.prop_values = test_values[0],
+		.count_encoders = 2,
+		.encoders = test_encoders,
+	},
+	{
+		.connector_id = 72,
+		.connector_type = DRM_MODE_CONNECTOR_DisplayPort,
+		.connector_type_id = 1,
+		.connection = DRM_MODE_DISCONNECTED,
+		.subpixel = DRM_MODE_SUBPIXEL_UNKNOWN,
+		.count_props = 1,
+		.props = test_props,
+		.prop_values = test_values[1],
+		.count_encoders = 1,
+		.encoders = &test_encoders[1],
+	},
+	/* Has no sysfs directory, so it is never recorded */
+	{
+		.connector_id = 73,
+		.connector_type = DRM_MODE_CONNECTOR_DisplayPort,
+		.connector_type_id = 2,
+		.connection = DRM_MODE_CONNECTED,
+		.subpixel = DRM_MODE_SUBPIXEL_UNKNOWN,
+		.count_modes = 1,
+		.modes = test_modes,
+		.count_props = 1,
+		.props = test_props,
+		.prop_values = test_values[2],
+		.count_encoders = 1,
+		.encoders = &test_encoders[1],
+	},
+};
+
+static unsigned int probed;
+static int probes;
+static int sysfs = -1;
+
+static void *dup_array(const void *src, size_t count, size_t size)
+{
+	void *dst;
+
+	if (!count)
+		return NULL;
+
+	dst = malloc(count * size);
+	igt_assert(dst);
+	memcpy(dst, src, count * size);
+
+	return dst;
+}
+
+static int kernel_index(uint32_t connector_id)
+{
+	for (int i = 0; i < ARRAY_SIZE(test_kernel); i++)
+		if (test_kernel[i].connector_id == connector_id)
+			return i;
+
+	return -1;
+}
+
+static drmModeConnector *get_connector(int i)
+{
+	const drmModeConnector *c = &test_kernel[i];
+	drmModeConnector *dup;
+
+	dup = malloc(sizeof(*dup));
+	igt_assert(dup);
+	*dup = *c;
+	if (!(probed & 1 << i))
+		dup->count_modes = 0;
+	dup->modes = dup_array(c->modes, dup->count_modes, sizeof(*c->modes));
+	dup->props = dup_array(c->props, c->count_props, sizeof(*c->props));
+	dup->prop_values = dup_array(c->prop_values, c->count_props,
+				     sizeof(*c->prop_values));
+	dup->encoders = dup_array(c->encoders, c->count_encoders,
+				  sizeof(*c->encoders));
+
+	return dup;
+}
+
+drmModeResPtr drmModeGetResources(int fd)
+{
+	drmModeRes *res = calloc(1, sizeof(*res));
+
+	igt_assert(res);
+	res->count_crtcs = ARRAY_SIZE(test_crtcs);
+	res->crtcs = dup_array(test_crtcs, res->count_crtcs,
+			       sizeof(*test_crtcs));
+	res->count_encoders = ARRAY_SIZE(test_encoders);
+	res->encoders = dup_array(test_encoders, res->count_encoders,
+				  sizeof(*test_encoders));
+	res->count_connectors = ARRAY_SIZE(test_connectors);
+	res->connectors = dup_array(test_connectors, res->count_connectors,
+				    sizeof(*test_connectors));
+	res->max_width = res->max_height = 8192;
+
+	return res;
+}
+
+drmModeConnectorPtr drmModeGetConnector(int fd, uint32_t connector_id)
+{
+	int i = kernel_index(connector_id);
+
+	if (i < 0)
+		return NULL;
+
+	probes++;
+	probed |= 1 << i;
+
+	return get_connector(i);
+}
+
+drmModeConnectorPtr drmModeGetConnectorCurrent(int fd, uint32_t connector_id)
+{
+	int i = kernel_index(connector_id);
+
+	return i < 0 ? NULL : get_connector(i);
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int fd, uint32_t encoder_id)
+{
+	drmModeEncoder *encoder = calloc(1, sizeof(*encoder));
+
+	igt_assert(encoder);
+	encoder->encoder_id = encoder_id;
+	encoder->encoder_type = DRM_MODE_ENCODER_TMDS;
+	encoder->possible_crtcs = encoder_id == test_encoders[0] ? 0x1 : 0x2;
+
+	return encoder;
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int fd, uint32_t crtc_id)
+{
+	drmModeCrtc *crtc = calloc(1, sizeof(*crtc));
+
+	igt_assert(crtc);
+	crtc->crtc_id = crtc_id;
+
+	return crtc;
+}
+
+/* No atomic properties, and no PATH, so no MST branch either */
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd,
+						      uint32_t object_id,
+						      uint32_t object_type)
+{
+	drmModeObjectProperties *props = calloc(1, sizeof(*props));
+
+	igt_assert(props);
+
+	return props;
+}
+
+int igt_connector_sysfs_open(int drm_fd, drmModeConnector *connector)
+{
+	char name[16];
+
+	snprintf(name, sizeof(name), "%u", connector->connector_id);
+
+	return openat(sysfs, name, O_RDONLY);
+}
+
+static void set_status(uint32_t connector_id, const char *status)
+{
+	char name[16];
+	int dir;
+
+	snprintf(name, sizeof(name), "%u", connector_id);
+	igt_assert(!mkdirat(sysfs, name, 0700) || errno == EEXIST);
+	dir = openat(sysfs, name, O_RDONLY);
+	igt_assert(dir >= 0);
+	igt_assert(igt_sysfs_set(dir, "status", status));
+	close(dir);
+}
+
+static void remove_sysfs(const char *path)
+{
+	for (int i = 0; i < ARRAY_SIZE(test_kernel); i++) {
+		char name[16];
+		int dir;
+
+		snprintf(name, sizeof(name), "%u", test_kernel[i].connector_id);
+		dir = openat(sysfs, name, O_RDONLY);
+		if (dir < 0)
+			continue;
+
+		unlinkat(dir, "status", 0);
+		close(dir);
+		unlinkat(sysfs, name, AT_REMOVEDIR);
+	}
+
+	close(sysfs);
+	rmdir(path);
+}
+
+/* Starts over as a new test binary would, with the connectors unprobed */
+static void reset_outputs(igt_display_t *display)
+{
+	for (int i = 0; i < display->n_outputs; i++)
+		free(display->outputs[i].name);
+
+	probed = 0;
+	probes = 0;
+
+	igt_display_reset_outputs(display);
+	igt_assert_eq(display->n_outputs, ARRAY_SIZE(test_kernel));
+}
+
+static void free_outputs(igt_display_t *display)
+{
+	for (int i = 0; i < display->n_outputs; i++) {
+		igt_output_t *output = &display->outputs[i];
+
+		kmstest_free_connector_config(&output->config);
+		free(output->config.connector_path);
+		free(output->name);
+	}
+
+	free(display->outputs);
+	display->outputs = NULL;
+	display->n_outputs = 0;
+}
+
+static bool is_recorded(struct igt_kms_snapshot *snap, uint32_t id)
+{
+	drmModeConnector *connector = igt_kms_snapshot_get_connector(snap, id);
+	bool ret = connector;
+
+	drmModeFreeConnector(connector);
+
+	return ret;
+}
+
+static void check_output(igt_output_t *output, const drmModeConnector *expected)
+{
+	const drmModeConnector *c = output->config.connector;
+
+	igt_assert(c);
+	igt_assert_eq_u32(c->connector_id, expected->connector_id);
+	igt_assert_eq(c->connection, expected->connection);
+	igt_assert_eq(c->count_modes, expected->count_modes);
+	for (int i = 0; i < expected->count_modes; i++)
+		igt_assert(!memcmp(&c->modes[i], &expected->modes[i],
+				   sizeof(expected->modes[i])));
+
+	/* Never replayed, these come from the kernel */
+	igt_assert_eq_u32(c->encoder_id, expected->encoder_id);
+	igt_assert_eq(c->count_props, expected->count_props);
+	for (int i = 0; i < expected->count_props; i++) {
+		igt_assert_eq_u32(c->props[i], expected->props[i]);
+		igt_assert_eq_u64(c->prop_values[i], expected->prop_values[i]);
+	}
+}
+
+igt_main
+{
+	char path[] = "/tmp/igt_kms_snapshot_replay.XXXXXX";
+	char sysfs_path[] = "/tmp/igt_kms_snapshot_sysfs.XXXXXX";
+	igt_display_t display = {};
+
+	igt_fixture {
+		int tmp = mkstemp(path);
+
+		igt_assert(tmp >= 0);
+		close(tmp);
+		unlink(path);
+		setenv("IGT_KMS_SNAPSHOT", path, 1);
+
+		igt_assert(mkdtemp(sysfs_path));
+		sysfs = open(sysfs_path, O_RDONLY);
+		igt_assert(sysfs >= 0);
+		set_status(71, "connected");
+		set_status(72, "disconnected");
+
+		/* Any character device, nothing is ever submitted to it */
+		display.drm_fd = open("/dev/null", O_RDWR);
+		igt_require(display.drm_fd >= 0);
+		display.pipes = calloc(IGT_MAX_PIPES, sizeof(*display.pipes));
+		igt_assert(display.pipes);
+	}
+
+	igt_subtest("record") {
+		struct igt_kms_snapshot *snap;
+
+		/* The connectors reporting no modes are probed */
+		reset_outputs(&display);
+		igt_assert_eq(probes, 3);
+		for (int i = 0; i < ARRAY_SIZE(test_kernel); i++)
+			check_output(&display.outputs[i], &test_kernel[i]);
+
+		snap = igt_kms_snapshot_load(path);
+		igt_assert(snap);
+		igt_assert(is_recorded(snap, 71));
+		igt_assert(is_recorded(snap, 72));
+		igt_assert(!is_recorded(snap, 73));
+		igt_kms_snapshot_free(snap);
+	}
+
+	igt_subtest("replay") {
+		/* An earlier test left the connectors in another state */
+		test_kernel[0].encoder_id = 62;
+		test_values[0][0] = 1;
+		test_values[1][0] = 2;
+
+		reset_outputs(&display);
+		igt_assert_eq(probes, 1);
+		for (int i = 0; i < ARRAY_SIZE(test_kernel); i++)
+			check_output(&display.outputs[i], &test_kernel[i]);
+		igt_assert_eq(display.outputs[0].config.default_mode.hdisplay,
+			      1920);
+	}
+
+	igt_subtest("hotplug") {
+		/* The sysfs status no longer matches, so 72 is probed again */
+		test_kernel[1].connection = DRM_MODE_CONNECTED;
+		test_kernel[1].count_modes = 1;
+		test_kernel[1].modes = test_modes;
+		set_status(72, "connected");
+
+		reset_outputs(&display);
+		igt_assert_eq(probes, 2);
+		for (int i = 0; i < ARRAY_SIZE(test_kernel); i++)
+			check_output(&display.outputs[i], &test_kernel[i]);
+	}
+
+	igt_fixture {
+		free_outputs(&display);
+		free(display.pipes);
+		close(display.drm_fd);
+		remove_sysfs(sysfs_path);
+		unlink(path);
+	}
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_kmsg.h"
+
+/* A recorded log, with the oddities found in dmesg.txt files */
+static const char recorded_log[] =
+	"6,1001,5000,-;first message\n"
+	" SUBSYSTEM=drm\n"
+	" DEVICE=c226:0\n"
+	"4,1002,5001,c;continued\n"
+	"not a record\n"
+	"30,1003,5002,-,caller=T42;from a daemon\n"
+	"3,1005,1234567,-;after a gap\n"
+	"7,1006,1234568,-;no newline at the end";
+
+static const struct {
+	uint64_t seq, ts_usec;
+	unsigned int level, facility;
+	char cont;
+	const char *msg;
+} expected[] = {
+	{ 1001, 5000, 6, 0, '-', "first message" },
+	{ 1002, 5001, 4, 0, 'c', "continued" },
+	{ 1003, 5002, 6, 3, '-', "from a daemon" },
+	{ 1005, 1234567, 3, 0, '-', "after a gap" },
+	{ 1006, 1234568, 7, 0, '-', "no newline at the end" },
+};
+
+#define EXPECTED (sizeof(expected) / sizeof(expected[0]))
+
+static void check_record(const struct igt_kmsg_record *r, int idx)
+{
+	igt_assert_lt(idx, EXPECTED);
+	igt_assert_eq_u64(r->seq, expected[idx].seq);
+	igt_assert_eq_u64(r->ts_usec, expected[idx].ts_usec);
+	igt_assert_eq(r->level, expected[idx].level);
+	igt_assert_eq(r->facility, expected[idx].facility);
+	igt_assert_eq(r->cont, expected[idx].cont);
+	igt_assert_eq(r->msg_len, strlen(expected[idx].msg));
+	igt_assert(!memcmp(r->msg, expected[idx].msg, r->msg_len));
+}
+
+struct collector {
+	int count;
+	uint64_t last_seq;
+};
+
+static void collect(const struct igt_kmsg_record *r, void *data)
+{
+	struct collector *c = data;
+
+	check_record(r, c->count++);
+	c->last_seq = r->seq;
+}
+
+struct log_writer {
+	int fd;
+	size_t chunk;
+};
+
+static void *log_writer(void *data)
+{
+	struct log_writer *w = data;
+	size_t len = strlen(recorded_log);
+
+	/* odd sized writes, so that records get split across reads */
+	for (size_t pos = 0; pos < len; pos += w->chunk) {
+		size_t n = len - pos < w->chunk ? len - pos : w->chunk;
+
+		igt_assert_eq(write(w->fd, recorded_log + pos, n), n);
+		usleep(100);
+	}
+	close(w->fd);
+
+	return NULL;
+}
+
+igt_main
+{
+	igt_subtest("parse") {
+		struct igt_kmsg_record r;
+		struct igt_kmsg kmsg;
+		const char *raw;
+
+		igt_assert_eq(igt_kmsg_init_buffer(&kmsg, recorded_log, strlen(recorded_log)), 0);
+		igt_assert_eq(igt_kmsg_count(&kmsg), EXPECTED);
+		igt_assert_eq_u64(kmsg.malformed, 1);
+
+		for (int i = 0; igt_kmsg_get(&kmsg, i, &r); i++)
+			check_record(&r, i);
+
+		/* Dictionary lines belong to the record */
+		igt_assert(igt_kmsg_get(&kmsg, 0, &r));
+		igt_assert_eq(r.raw_len, strlen("6,1001,5000,-;first message\n"
+						" SUBSYSTEM=drm\n"
+						" DEVICE=c226:0\n"));
+		igt_assert(r.raw == recorded_log);
+
+		igt_assert_eq(igt_kmsg_raw(&kmsg, &raw), strlen(recorded_log));
+		igt_assert(raw == recorded_log);
+
+		igt_kmsg_fini(&kmsg);
+	}
+
+	igt_subtest("find") {
+		struct igt_kmsg_record r;
+		struct igt_kmsg kmsg;
+
+		igt_assert_eq(igt_kmsg_init_buffer(&kmsg, recorded_log, strlen(recorded_log)), 0);
+
+		for (int i = 0; i < EXPECTED; i++) {
+			igt_assert(igt_kmsg_find(&kmsg, expected[i].seq, &r));
+			check_record(&r, i);
+		}
+
+		igt_assert(!igt_kmsg_find(&kmsg, 1000, &r));
+		igt_assert(!igt_kmsg_find(&kmsg, 1004, &r));
+		igt_assert(!igt_kmsg_find(&kmsg, 1007, &r));
+
+		igt_kmsg_fini(&kmsg);
+	}
+
+	igt_subtest("subscribers") {
+		struct collector a = {}, b = {};
+		struct igt_kmsg kmsg;
+
+		igt_assert_eq(igt_kmsg_init_buffer(&kmsg, recorded_log, strlen(recorded_log)), 0);
+		igt_assert_eq(igt_kmsg_subscribe(&kmsg, collect, &a), 0);
+		igt_assert_eq(igt_kmsg_subscribe(&kmsg, collect, &b), 0);
+
+		/* Every subscriber sees every record once */
+		igt_assert_eq(igt_kmsg_drain(&kmsg), EXPECTED);
+		igt_assert_eq(igt_kmsg_drain(&kmsg), 0);
+		igt_assert_eq(a.count, EXPECTED);
+		igt_assert_eq(b.count, EXPECTED);
+
+		igt_kmsg_unsubscribe(&kmsg, collect, &a);
+		igt_kmsg_fini(&kmsg);
+	}
+
+	igt_subtest("map") {
+		struct collector c = {};
+		struct igt_kmsg kmsg;
+		int fd;
+
+		fd = memfd_create("igt_kmsg", 0);
+		igt_require(fd >= 0);
+
+		/* An empty log */
+		igt_assert_eq(igt_kmsg_map(&kmsg, fd), 0);
+		igt_assert_eq(igt_kmsg_count(&kmsg), 0);
+		igt_assert_eq(igt_kmsg_drain(&kmsg), 0);
+		igt_kmsg_fini(&kmsg);
+
+		igt_assert_eq(write(fd, recorded_log, strlen(recorded_log)), strlen(recorded_log));
+		igt_assert_eq(igt_kmsg_map(&kmsg, fd), 0);
+		close(fd);
+
+		igt_assert_eq(igt_kmsg_subscribe(&kmsg, collect, &c), 0);
+		igt_assert_eq(igt_kmsg_drain(&kmsg), EXPECTED);
+		igt_assert_eq(c.count, EXPECTED);
+
+		igt_kmsg_fini(&kmsg);
+	}
+
+	igt_subtest("stream") {
+		for (size_t chunk = 1; chunk <= 64; chunk *= 4) {
+			struct collector c = {};
+			struct log_writer w;
+			struct igt_kmsg kmsg;
+			pthread_t writer;
+			int fds[2];
+
+			igt_assert_eq(pipe(fds), 0);
+
+			w.fd = fds[1];
+			w.chunk = chunk;
+			igt_assert_eq(pthread_create(&writer, NULL, log_writer, &w), 0);
+
+			igt_assert_eq(igt_kmsg_init_fd(&kmsg, fds[0]), 0);
+			igt_assert_eq(igt_kmsg_subscribe(&kmsg, collect, &c), 0);
+
+			/*
+			 * Records split across reads are only handed out
+			 * once complete, and discarding keeps their start.
+			 */
+			while (!kmsg.eof) {
+				igt_assert_lt(0, igt_kmsg_wait(&kmsg, -1));
+				igt_assert_lte(0, igt_kmsg_drain(&kmsg));
+				igt_kmsg_discard(&kmsg);
+			}
+
+			igt_assert_eq(c.count, EXPECTED);
+			igt_assert_eq_u64(c.last_seq, 1006);
+			igt_assert_eq_u64(kmsg.malformed, 1);
+
+			pthread_join(writer, NULL);
+			igt_kmsg_fini(&kmsg);
+			close(fds[0]);
+		}
+	}
+}
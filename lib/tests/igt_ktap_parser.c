@@ -4,9 +4,11 @@
 */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "igt_core.h"
 #include "igt_ktap.h"
@@ -230,6 +232,222 @@ static void ktap_top_version(void)
 	igt_ktap_free(ktap);
 }
 
+static void ktap_nested(void)
+{
+	struct igt_ktap_result *result, *rn;
+	struct igt_ktap_results *ktap;
+	IGT_LIST_HEAD(results);
+
+	ktap = igt_ktap_alloc(&results);
+	igt_require(ktap);
+
+	igt_assert_eq(igt_ktap_parse("KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("1..1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    # Subtest: test_suite\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    1..2\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        # Subtest: test_case\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            1..2\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("                KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("                1..1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("                ok 1 leaf\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            ok 1 inner 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            ok 2 inner 2\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        ok 1 parameter 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            ok 1 inner 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        ok 2 parameter 2\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    ok 1 test_case\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    ok 2 another_case\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("ok 1 test_suite\n", ktap), 0);
+
+	igt_ktap_free(ktap);
+
+	/* only test cases are reported, whatever is nested below them */
+	igt_assert_eq(igt_list_length(&results), 3);
+
+	result = igt_list_last_entry(&results, result, link);
+	igt_assert_eq(strcmp(result->case_name, "another_case"), 0);
+	igt_assert_eq(result->code, IGT_EXIT_SUCCESS);
+
+	igt_list_for_each_entry_safe(result, rn, &results, link) {
+		igt_list_del(&result->link);
+		free(result->case_name);
+		free(result->msg);
+		if (igt_list_empty(&results))
+			free(result->suite_name);
+		free(result);
+	}
+
+	/* a nested result out of order is still a protocol error */
+	ktap = igt_ktap_alloc(&results);
+	igt_require(ktap);
+
+	igt_assert_eq(igt_ktap_parse("KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("1..1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    # Subtest: test_suite\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("    1..1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("        # Subtest: test_case\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            KTAP version 1\n", ktap), -EINPROGRESS);
+	igt_assert_eq(igt_ktap_parse("            ok 2 inner 2\n", ktap), -EPROTO);
+
+	igt_ktap_free(ktap);
+
+	igt_list_for_each_entry_safe(result, rn, &results, link) {
+		igt_list_del(&result->link);
+		free(result->case_name);
+		free(result->suite_name);
+		free(result);
+	}
+}
+
+struct log_writer {
+	int fd;
+	const char *log;
+	size_t chunk;
+};
+
+static void *log_writer(void *data)
+{
+	struct log_writer *w = data;
+	size_t len = strlen(w->log);
+
+	/* odd sized writes, so that records get split across reads */
+	for (size_t pos = 0; pos < len; pos += w->chunk) {
+		size_t n = len - pos < w->chunk ? len - pos : w->chunk;
+
+		igt_assert_eq(write(w->fd, w->log + pos, n), n);
+	}
+	close(w->fd);
+
+	return NULL;
+}
+
+/* Runs a captured kmsg log through the parser thread */
+static int ktap_stream(const char *log, size_t chunk,
+		       void (*check)(struct ktap_test_results_element *r,
+				     int idx, void *data),
+		       void *data)
+{
+	struct ktap_test_results_element *r;
+	struct ktap_test_results *results;
+	struct log_writer w;
+	pthread_t writer;
+	int fds[2], count = 0;
+
+	igt_assert_eq(pipe(fds), 0);
+
+	w.fd = fds[1];
+	w.log = log;
+	w.chunk = chunk;
+	igt_assert_eq(pthread_create(&writer, NULL, log_writer, &w), 0);
+
+	results = ktap_parser_start(fds[0], false);
+	while (!ktap_results_done(results)) {
+		r = ktap_results_pop(results);
+		if (!r)
+			continue;
+
+		check(r, count++, data);
+		free(r);
+	}
+
+	igt_assert_eq(ktap_parser_stop(), IGT_EXIT_SUCCESS);
+	pthread_join(writer, NULL);
+	close(fds[0]);
+
+	return count;
+}
+
+static void check_captured(struct ktap_test_results_element *r, int idx,
+			   void *data)
+{
+	static const struct {
+		const char *name;
+		bool passed;
+	} expected[] = {
+		{ "suite_a-case_1", true },
+		{ "suite_a-case_2", false },
+		{ "suite_b-case_3", true },
+	};
+
+	igt_assert_lt(idx, sizeof(expected) / sizeof(expected[0]));
+	igt_assert_eq(strcmp(r->test_name, expected[idx].name), 0);
+	igt_assert_eq(r->passed, expected[idx].passed);
+}
+
+static void ktap_captured(void)
+{
+	static const char log[] =
+		"6,1001,5000,-;KTAP version 1\n"
+		"6,1002,5001,-;1..2\n"
+		"6,1003,5002,-;    KTAP version 1\n"
+		"6,1004,5003,-;    # Subtest: suite_a\n"
+		" SUBSYSTEM=kunit\n"
+		"6,1005,5004,-;    1..2\n"
+		"4,1006,5005,-;some unrelated message\n"
+		"6,1007,5006,-;    ok 1 case_1\n"
+		"3,1008,5007,-;    not ok 2 case_2 # failure message\n"
+		"6,1009,5008,-;not ok 1 suite_a\n"
+		"6,1010,5009,-;    KTAP version 1\n"
+		"6,1011,5010,-;    # Subtest: suite_b\n"
+		"6,1012,5011,-;    1..1\n"
+		"6,1013,5012,-;        KTAP version 1\n"
+		"6,1014,5013,-;        # Subtest: case_3\n"
+		"6,1015,5014,-;        ok 1 param 1\n"
+		"6,1016,5015,-;        ok 2 param 2\n"
+		"6,1017,5016,-;    ok 1 case_3\n"
+		"6,1018,5017,-;ok 2 suite_b\n";
+
+	igt_assert_eq(ktap_stream(log, 7, check_captured, NULL), 3);
+	igt_assert_eq(ktap_stream(log, sizeof(log), check_captured, NULL), 3);
+}
+
+#define STREAM_SUITES 50
+#define STREAM_CASES 200
+
+static void check_ordered(struct ktap_test_results_element *r, int idx,
+			  void *data)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "suite_%d-case_%d",
+		 idx / STREAM_CASES + 1, idx % STREAM_CASES + 1);
+	igt_assert_eq(strcmp(r->test_name, name), 0);
+	igt_assert_eq(r->passed, !(idx % 3 == 0));
+}
+
+static void ktap_ordering(void)
+{
+	size_t size = 64 * (STREAM_SUITES * (STREAM_CASES + 4) + 2);
+	char *log = malloc(size), *p = log;
+	int seq = 0;
+
+	igt_assert(log);
+
+	p += sprintf(p, "6,%d,0,-;KTAP version 1\n", seq++);
+	p += sprintf(p, "6,%d,0,-;1..%d\n", seq++, STREAM_SUITES);
+	for (int s = 1; s <= STREAM_SUITES; s++) {
+		p += sprintf(p, "6,%d,0,-;    KTAP version 1\n", seq++);
+		p += sprintf(p, "6,%d,0,-;    # Subtest: suite_%d\n", seq++, s);
+		p += sprintf(p, "6,%d,0,-;    1..%d\n", seq++, STREAM_CASES);
+		for (int c = 1; c <= STREAM_CASES; c++)
+			p += sprintf(p, "6,%d,0,-;    %sok %d case_%d\n", seq++,
+				     ((s - 1) * STREAM_CASES + c - 1) % 3 ? "" : "not ",
+				     c, c);
+		p += sprintf(p, "6,%d,0,-;ok %d suite_%d\n", seq++, s, s);
+	}
+	igt_assert(p < log + size);
+
+	igt_assert_eq(ktap_stream(log, 4093, check_ordered, NULL),
+		      STREAM_SUITES * STREAM_CASES);
+	free(log);
+}
+
 igt_main
 {
 	igt_subtest("list")
@@ -243,4 +461,13 @@ igt_main
 
 	igt_subtest("top-ktap-version")
 		ktap_top_version();
+
+	igt_subtest("nested")
+		ktap_nested();
+
+	igt_subtest("captured-log")
+		ktap_captured();
+
+	igt_subtest("result-ordering")
+		ktap_ordering();
 }
@@ -228,6 +228,85 @@ static void test_reallocation(void)
 	igt_stats_fini(&stats);
 }
 
+static void test_histogram_exact(void)
+{
+	struct igt_histogram h;
+	uint64_t i;
+
+	igt_histogram_init(&h);
+
+	/* small values get a bucket each */
+	for (i = 1; i <= 100; i++)
+		igt_histogram_push(&h, i);
+
+	igt_assert_eq_u64(igt_histogram_get_count(&h), 100);
+	igt_assert_eq_u64(igt_histogram_get_min(&h), 1);
+	igt_assert_eq_u64(igt_histogram_get_max(&h), 100);
+	igt_assert_eq_double(igt_histogram_get_mean(&h), 50.5);
+	igt_assert_eq_u64(igt_histogram_get_percentile(&h, 0), 1);
+	igt_assert_eq_u64(igt_histogram_get_percentile(&h, 50), 50);
+	igt_assert_eq_u64(igt_histogram_get_percentile(&h, 99), 99);
+	igt_assert_eq_u64(igt_histogram_get_percentile(&h, 100), 100);
+
+	igt_histogram_fini(&h);
+}
+
+static void test_histogram_error(void)
+{
+	const double percentiles[] = { 1, 25, 50, 90, 99, 99.9 };
+	const unsigned int n = 1000000;
+	struct igt_histogram h;
+	unsigned int i;
+
+	igt_histogram_init_with_precision(&h, 7);
+
+	for (i = 1; i <= n; i++)
+		igt_histogram_push(&h, i);
+
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+		double expect = percentiles[i] * n / 100;
+		double value = igt_histogram_get_percentile(&h, percentiles[i]);
+
+		igt_assert_f(fabs(value - expect) <= expect / 128,
+			     "p%g = %.0f, expected %.0f\n",
+			     percentiles[i], value, expect);
+	}
+	igt_assert_eq_u64(igt_histogram_get_max(&h), n);
+
+	igt_histogram_fini(&h);
+}
+
+static void test_histogram_merge(void)
+{
+	struct igt_histogram even, odd, all;
+	uint64_t i;
+
+	igt_histogram_init(&even);
+	igt_histogram_init(&odd);
+	igt_histogram_init(&all);
+
+	for (i = 0; i < 100000; i++) {
+		uint64_t v = i * i;
+
+		igt_histogram_push(i & 1 ? &odd : &even, v);
+		igt_histogram_push(&all, v);
+	}
+
+	igt_histogram_merge(&even, &odd);
+	igt_assert_eq_u64(igt_histogram_get_count(&even),
+		      igt_histogram_get_count(&all));
+	igt_assert_eq_u64(igt_histogram_get_min(&even), 0);
+	igt_assert_eq_u64(igt_histogram_get_max(&even),
+		      igt_histogram_get_max(&all));
+	for (i = 0; i <= 1000; i++)
+		igt_assert_eq_u64(igt_histogram_get_percentile(&even, i / 10.),
+			      igt_histogram_get_percentile(&all, i / 10.));
+
+	igt_histogram_fini(&all);
+	igt_histogram_fini(&odd);
+	igt_histogram_fini(&even);
+}
+
 igt_simple_main
 {
 	test_init_zero();
@@ -240,4 +319,7 @@ igt_simple_main
 	test_invalidate_mean();
 	test_std_deviation();
 	test_reallocation();
+	test_histogram_exact();
+	test_histogram_error();
+	test_histogram_merge();
 }
@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_surface_compare.h"
+
+/*
+ * Checks the block counts against a per-pixel reference comparison, for
+ * sizes that aren't multiples of the blocks or of the vector width.
+ */
+
+static uint8_t *random_surface(size_t size)
+{
+	uint8_t *ptr = malloc(size);
+
+	igt_assert(ptr);
+	for (size_t i = 0; i < size; i++)
+		ptr[i] = rand();
+
+	return ptr;
+}
+
+static void check_diff(const struct igt_surface_view *a,
+		       const struct igt_surface_view *b,
+		       unsigned int bw, unsigned int bh)
+{
+	unsigned int cpp = a->bpp / 8, blocks_x, blocks_y;
+	struct igt_surface_diff diff;
+	uint64_t pixels = 0, blocks = 0;
+	uint32_t *counts;
+	bool same;
+
+	blocks_x = DIV_ROUND_UP(a->width, bw);
+	blocks_y = DIV_ROUND_UP(a->height, bh);
+	counts = calloc((size_t)blocks_x * blocks_y, sizeof(*counts));
+	igt_assert(counts);
+
+	for (unsigned int y = 0; y < a->height; y++) {
+		for (unsigned int x = 0; x < a->width; x++) {
+			const uint8_t *pa = (const uint8_t *)a->ptr +
+				a->stride * y + x * cpp;
+			const uint8_t *pb = (const uint8_t *)b->ptr +
+				b->stride * y + x * cpp;
+
+			if (memcmp(pa, pb, cpp)) {
+				counts[y / bh * blocks_x + x / bw]++;
+				pixels++;
+			}
+		}
+	}
+
+	same = igt_surface_compare(a, b, bw, bh, &diff);
+
+	igt_assert_eq(same, !pixels);
+	igt_assert_eq(diff.blocks_x, blocks_x);
+	igt_assert_eq(diff.blocks_y, blocks_y);
+	igt_assert_eq_u64(diff.pixels, pixels);
+
+	for (unsigned int by = 0; by < blocks_y; by++) {
+		for (unsigned int bx = 0; bx < blocks_x; bx++) {
+			uint32_t count = counts[by * blocks_x + bx];
+
+			igt_assert_eq_u32(diff.counts[by * blocks_x + bx], count);
+			igt_assert_eq(igt_surface_diff_block(&diff, bx, by),
+				      count != 0);
+			blocks += count != 0;
+		}
+	}
+	igt_assert_eq_u64(diff.blocks, blocks);
+
+	igt_surface_diff_fini(&diff);
+	free(counts);
+}
+
+static void test_bpp(unsigned int bpp, unsigned int width,
+		     unsigned int height, unsigned int changes)
+{
+	unsigned int cpp = bpp / 8;
+	size_t stride = width * cpp + 24;
+	struct igt_surface_view a = {
+		.stride = stride, .width = width, .height = height, .bpp = bpp,
+	};
+	struct igt_surface_view b = a;
+	uint8_t *pa = random_surface(stride * height);
+	uint8_t *pb = malloc(stride * height);
+
+	igt_assert(pb);
+	memcpy(pb, pa, stride * height);
+	a.ptr = pa;
+	b.ptr = pb;
+
+	check_diff(&a, &b, 8, 8);
+
+	/* Changes to the padding past the width don't count */
+	for (unsigned int y = 0; y < height; y++)
+		pb[stride * y + width * cpp] ^= 0xff;
+	check_diff(&a, &b, 8, 8);
+
+	for (unsigned int i = 0; i < changes; i++) {
+		unsigned int x = rand() % width, y = rand() % height;
+
+		pb[stride * y + x * cpp + rand() % cpp] ^= 1 + rand() % 255;
+	}
+
+	check_diff(&a, &b, 8, 8);
+	check_diff(&a, &b, 13, 5);
+	check_diff(&a, &b, width, 1);
+
+	free(pa);
+	free(pb);
+}
+
+static size_t xtile_offset(const void *data, unsigned int x, unsigned int y)
+{
+	const size_t *stride = data;
+
+	x *= 4;
+
+	return (y / 8) * *stride * 8 + (x / 512) * 4096 +
+	       (y % 8) * 512 + x % 512;
+}
+
+static void test_tiled(void)
+{
+	const unsigned int width = 300, height = 70;
+	size_t stride = 512 * 3, size = stride * 72;
+	struct igt_tile_layout layout = {
+		.width = width,
+		.height = height,
+		.cpp = 4,
+		.tile_height = 8,
+		.x_maps = 1,
+		.x_map_height = 8,
+		.offset = xtile_offset,
+		.data = &stride,
+	};
+	struct igt_surface_view linear = {
+		.stride = width * 4, .width = width, .height = height, .bpp = 32,
+	};
+	struct igt_surface_view view;
+	struct igt_surface_diff diff;
+	struct igt_tile_copy copy;
+	uint8_t *pixels = random_surface(linear.stride * height);
+	uint8_t *tiled = calloc(1, size);
+
+	igt_assert(tiled);
+	linear.ptr = pixels;
+
+	igt_tile_copy_init(&copy, &layout);
+	igt_tile_copy_to_tiled(&copy, tiled, pixels, linear.stride);
+
+	igt_surface_view_from_tiled(&view, &copy, tiled);
+	igt_assert(igt_surface_compare(&linear, &view, 8, 8, &diff));
+	igt_surface_diff_fini(&diff);
+	igt_surface_view_fini(&view);
+
+	tiled[xtile_offset(&stride, 123, 45)] ^= 1;
+
+	igt_surface_view_from_tiled(&view, &copy, tiled);
+	igt_assert(!igt_surface_compare(&linear, &view, 8, 8, &diff));
+	igt_assert_eq_u64(diff.pixels, 1);
+	igt_assert_eq_u64(diff.blocks, 1);
+	igt_assert(igt_surface_diff_block(&diff, 123 / 8, 45 / 8));
+	igt_surface_diff_fini(&diff);
+	igt_surface_view_fini(&view);
+
+	igt_tile_copy_fini(&copy);
+	free(tiled);
+	free(pixels);
+}
+
+igt_main
+{
+	const unsigned int bpps[] = { 8, 16, 24, 32, 64, 96, 128 };
+
+	srand(0xdeadbeef);
+
+	igt_subtest("bpp") {
+		for (int i = 0; i < ARRAY_SIZE(bpps); i++) {
+			test_bpp(bpps[i], 203, 77, 0);
+			test_bpp(bpps[i], 203, 77, 1);
+			test_bpp(bpps[i], 203, 77, 500);
+		}
+	}
+
+	igt_subtest("dense")
+		test_bpp(32, 67, 19, 100000);
+
+	/* Large enough to be split across threads */
+	igt_subtest("large")
+		test_bpp(32, 2048, 1500, 2000);
+
+	igt_subtest("tiled")
+		test_tiled();
+}
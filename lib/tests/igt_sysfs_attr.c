@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_sysfs.h"
+
+/*
+ * Attribute handles on a fake sysfs directory of regular files. These
+ * don't regenerate their contents like sysfs does, so the updates are
+ * done by rewriting the files in place.
+ */
+
+static char dirname[] = "/tmp/igt_sysfs_attr.XXXXXX";
+static int dir = -1;
+
+static void set_file(const char *name, const char *value)
+{
+	int fd = openat(dir, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	igt_assert(fd >= 0);
+	igt_assert_eq(write(fd, value, strlen(value)), strlen(value));
+	close(fd);
+}
+
+static void remove_dir(int sig)
+{
+	unlinkat(dir, "freq", 0);
+	unlinkat(dir, "residency", 0);
+	unlinkat(dir, "name", 0);
+	unlinkat(dir, "bad", 0);
+	close(dir);
+	rmdir(dirname);
+}
+
+igt_main
+{
+	struct igt_sysfs_attr freq, residency, name, bad;
+
+	igt_fixture {
+		igt_assert(mkdtemp(dirname));
+		dir = open(dirname, O_RDONLY | O_DIRECTORY);
+		igt_assert(dir >= 0);
+		igt_install_exit_handler(remove_dir);
+
+		set_file("freq", "300\n");
+		set_file("residency", "12345678901\n");
+		set_file("name", "rcs0\n\n");
+		set_file("bad", "-1\n");
+
+		igt_assert(igt_sysfs_attr_open(&freq, dir, "freq"));
+		igt_assert(igt_sysfs_attr_open(&residency, dir, "residency"));
+		igt_assert(igt_sysfs_attr_open(&name, dir, "name"));
+		igt_assert(igt_sysfs_attr_open(&bad, dir, "bad"));
+	}
+
+	igt_subtest("read") {
+		char buf[8];
+
+		igt_assert_eq(igt_sysfs_attr_read(&name, buf, sizeof(buf)), 4);
+		igt_assert(!strcmp(buf, "rcs0"));
+
+		/* Truncated to the buffer */
+		igt_assert_eq(igt_sysfs_attr_read(&residency, buf, 4), 3);
+		igt_assert(!strcmp(buf, "123"));
+	}
+
+	igt_subtest("integers") {
+		uint32_t v32;
+		uint64_t v64;
+
+		igt_assert_eq_u32(igt_sysfs_attr_get_u32(&freq), 300);
+		igt_assert_eq_u64(igt_sysfs_attr_get_u64(&residency),
+				  12345678901ull);
+
+		/* Out of range or negative values are rejected */
+		igt_assert(!__igt_sysfs_attr_get_u32(&residency, &v32));
+		igt_assert(!__igt_sysfs_attr_get_u64(&bad, &v64));
+		igt_assert(!__igt_sysfs_attr_get_u64(&name, &v64));
+
+		/* The directory based helpers parse the same way */
+		igt_assert(__igt_sysfs_get_u32(dir, "freq", &v32));
+		igt_assert_eq_u32(v32, 300);
+		igt_assert(!__igt_sysfs_get_u32(dir, "bad", &v32));
+		igt_assert(!__igt_sysfs_get_u32(dir, "missing", &v32));
+	}
+
+	igt_subtest("reread") {
+		/* The handle reads the current contents each time */
+		set_file("freq", "450\n");
+		igt_assert_eq_u32(igt_sysfs_attr_get_u32(&freq), 450);
+
+		igt_assert(igt_sysfs_attr_set_u64(&freq, 1200));
+		igt_assert_eq_u32(igt_sysfs_attr_get_u32(&freq), 1200);
+
+		set_file("freq", "300\n");
+	}
+
+	igt_subtest("batch") {
+		struct igt_sysfs_attr missing;
+		const struct igt_sysfs_attr *attrs[4] = {
+			&freq, &residency, &bad, &missing
+		};
+		uint64_t values[4] = { 0, 0, 7, 7 };
+
+		igt_assert(!igt_sysfs_attr_open(&missing, dir, "missing"));
+		igt_assert_eq(missing.fd, -1);
+
+		igt_assert_eq(igt_sysfs_attr_get_u64_batch(attrs, 4, values), 2);
+		igt_assert_eq_u64(values[0], 300);
+		igt_assert_eq_u64(values[1], 12345678901ull);
+		igt_assert_eq_u64(values[2], 7);
+		igt_assert_eq_u64(values[3], 7);
+
+		igt_sysfs_attr_close(&missing);
+	}
+
+	igt_subtest("wait") {
+		/* Regular files never notify */
+		igt_assert_eq(igt_sysfs_attr_wait(&freq, 0), 0);
+	}
+
+	igt_fixture {
+		igt_sysfs_attr_close(&freq);
+		igt_sysfs_attr_close(&residency);
+		igt_sysfs_attr_close(&name);
+		igt_sysfs_attr_close(&bad);
+		igt_assert_eq(freq.fd, -1);
+	}
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_amd.h"
+#include "igt_core.h"
+#include "igt_fb.h"
+#include "igt_vc4.h"
+
+/*
+ * Checks the tile copies against a copy through the per-pixel offset
+ * functions, which are the reference implementation of each tiling.
+ */
+
+typedef size_t (*offset_fn)(struct igt_fb *tiled, unsigned int plane,
+			    unsigned int x, unsigned int y);
+typedef void (*convert_fn)(struct igt_fb *dst, void *dst_buf,
+			   struct igt_fb *src, void *src_buf);
+
+static size_t t_tiled_offset(struct igt_fb *tiled, unsigned int plane,
+			     unsigned int x, unsigned int y)
+{
+	return igt_vc4_t_tiled_offset(tiled->strides[plane], tiled->height,
+				      tiled->plane_bpp[plane], x, y);
+}
+
+static size_t sand_offset(struct igt_fb *tiled, unsigned int plane,
+			  unsigned int x, unsigned int y)
+{
+	uint64_t modifier_base = fourcc_mod_broadcom_mod(tiled->modifier);
+	uint32_t column_height = fourcc_mod_broadcom_param(tiled->modifier);
+	uint32_t column_width_bytes;
+
+	if (modifier_base == DRM_FORMAT_MOD_BROADCOM_SAND32)
+		column_width_bytes = 32;
+	else if (modifier_base == DRM_FORMAT_MOD_BROADCOM_SAND64)
+		column_width_bytes = 64;
+	else if (modifier_base == DRM_FORMAT_MOD_BROADCOM_SAND128)
+		column_width_bytes = 128;
+	else
+		column_width_bytes = 256;
+
+	return igt_vc4_sand_tiled_offset(column_width_bytes *
+					 tiled->plane_width[plane] / tiled->width,
+					 column_width_bytes * column_height,
+					 x, y, tiled->plane_bpp[plane]);
+}
+
+static size_t amd_offset(struct igt_fb *tiled, unsigned int plane,
+			 unsigned int x, unsigned int y)
+{
+	return igt_amd_fb_tiled_offset(tiled->plane_bpp[plane], x, y,
+				       tiled->plane_width[plane]);
+}
+
+static size_t init_linear(struct igt_fb *linear, const struct igt_fb *tiled)
+{
+	size_t size = 0;
+	unsigned int i;
+
+	*linear = *tiled;
+	linear->modifier = DRM_FORMAT_MOD_LINEAR;
+	for (i = 0; i < linear->num_planes; i++) {
+		/* Padded, to catch copies using the wrong stride */
+		linear->strides[i] = linear->plane_width[i] *
+			linear->plane_bpp[i] / 8 + 24;
+		linear->offsets[i] = size;
+		size += (size_t)linear->strides[i] * linear->plane_height[i];
+	}
+
+	return size;
+}
+
+static void *random_buffer(size_t size)
+{
+	uint8_t *buf = malloc(size);
+
+	igt_assert(buf);
+	for (size_t i = 0; i < size; i++)
+		buf[i] = random();
+
+	return buf;
+}
+
+static void check_convert(struct igt_fb *tiled, size_t tiled_size,
+			  offset_fn offset, convert_fn to_tiled,
+			  convert_fn from_tiled)
+{
+	struct igt_fb linear;
+	size_t linear_size = init_linear(&linear, tiled);
+	uint8_t *src = random_buffer(linear_size);
+	uint8_t *dst = calloc(1, tiled_size);
+	uint8_t *ref = calloc(1, tiled_size);
+	unsigned int i, x, y;
+
+	igt_assert(dst && ref);
+
+	for (i = 0; i < tiled->num_planes; i++) {
+		unsigned int cpp = tiled->plane_bpp[i] / 8;
+
+		for (y = 0; y < tiled->plane_height[i]; y++) {
+			for (x = 0; x < tiled->plane_width[i]; x++) {
+				size_t o = offset(tiled, i, x, y);
+
+				igt_assert(tiled->offsets[i] + o + cpp <= tiled_size);
+				memcpy(ref + tiled->offsets[i] + o,
+				       src + linear.offsets[i] +
+				       (size_t)linear.strides[i] * y + x * cpp,
+				       cpp);
+			}
+		}
+	}
+
+	to_tiled(tiled, dst, &linear, src);
+	igt_assert_f(!memcmp(dst, ref, tiled_size),
+		     "%ux%u: tiled buffer mismatch\n",
+		     tiled->width, tiled->height);
+
+	if (from_tiled) {
+		uint8_t *back = calloc(1, linear_size);
+
+		igt_assert(back);
+		from_tiled(&linear, back, tiled, dst);
+
+		for (i = 0; i < tiled->num_planes; i++) {
+			size_t row = tiled->plane_width[i] * tiled->plane_bpp[i] / 8;
+
+			for (y = 0; y < tiled->plane_height[i]; y++) {
+				size_t o = linear.offsets[i] +
+					(size_t)linear.strides[i] * y;
+
+				igt_assert_f(!memcmp(back + o, src + o, row),
+					     "%ux%u: plane %u row %u mismatch\n",
+					     tiled->width, tiled->height, i, y);
+			}
+		}
+
+		free(back);
+	}
+
+	free(ref);
+	free(dst);
+	free(src);
+}
+
+static void check_t_tiled(unsigned int width, unsigned int height,
+			  unsigned int bpp)
+{
+	struct igt_fb tiled = {
+		.width = width,
+		.height = height,
+		.modifier = DRM_FORMAT_MOD_BROADCOM_VC4_T_TILED,
+		.num_planes = 1,
+		.strides = { ALIGN(width * bpp / 8, 128) },
+		.plane_bpp = { bpp },
+		.plane_width = { width },
+		.plane_height = { height },
+	};
+
+	check_convert(&tiled, (size_t)tiled.strides[0] * ALIGN(height, 32),
+		      t_tiled_offset, vc4_fb_convert_plane_to_tiled,
+		      vc4_fb_convert_plane_from_tiled);
+}
+
+static void check_sand(unsigned int width, unsigned int height,
+		       uint64_t modifier, unsigned int column_width_bytes)
+{
+	/* NV12, with the chroma columns following the luma ones */
+	unsigned int columns = DIV_ROUND_UP(width, column_width_bytes);
+	unsigned int column_height = ALIGN(height, 16);
+	struct igt_fb tiled = {
+		.width = width,
+		.height = height,
+		.modifier = modifier | fourcc_mod_broadcom_code(0, column_height),
+		.num_planes = 2,
+		.offsets = { 0, columns * column_width_bytes * column_height },
+		.plane_bpp = { 8, 16 },
+		.plane_width = { width, width / 2 },
+		.plane_height = { height, height / 2 },
+	};
+
+	check_convert(&tiled, 2 * tiled.offsets[1], sand_offset,
+		      vc4_fb_convert_plane_to_tiled,
+		      vc4_fb_convert_plane_from_tiled);
+}
+
+static void check_amd(unsigned int width, unsigned int height,
+		      unsigned int bpp)
+{
+	unsigned int tile_width, tile_height;
+	struct igt_fb tiled = {
+		.width = width,
+		.height = height,
+		.modifier = AMD_FMT_MOD |
+			AMD_FMT_MOD_SET(TILE, AMD_FMT_MOD_TILE_GFX9_64K_S) |
+			AMD_FMT_MOD_SET(TILE_VERSION, AMD_FMT_MOD_TILE_VER_GFX9),
+		.num_planes = 1,
+		.plane_bpp = { bpp },
+		.plane_width = { width },
+		.plane_height = { height },
+	};
+
+	igt_amd_fb_calculate_tile_dimension(bpp, &tile_width, &tile_height);
+
+	/* No conversion back from AMD tiling */
+	check_convert(&tiled, (size_t)ALIGN(width, tile_width) *
+		      ALIGN(height, tile_height) * bpp / 8, amd_offset,
+		      igt_amd_fb_convert_plane_to_tiled, NULL);
+}
+
+igt_main
+{
+	igt_fixture
+		srandom(0x7113);
+
+	igt_subtest("vc4-t-tiled") {
+		for (unsigned int bpp = 16; bpp <= 32; bpp += 16) {
+			check_t_tiled(1, 1, bpp);
+			check_t_tiled(7, 5, bpp);
+			check_t_tiled(33, 65, bpp);
+			check_t_tiled(257, 97, bpp);
+			check_t_tiled(640, 480, bpp);
+		}
+	}
+
+	igt_subtest("vc4-sand") {
+		check_sand(64, 32, DRM_FORMAT_MOD_BROADCOM_SAND32, 32);
+		check_sand(130, 66, DRM_FORMAT_MOD_BROADCOM_SAND64, 64);
+		check_sand(320, 240, DRM_FORMAT_MOD_BROADCOM_SAND128, 128);
+		check_sand(642, 482, DRM_FORMAT_MOD_BROADCOM_SAND256, 256);
+	}
+
+	igt_subtest("amd-64k-s") {
+		for (unsigned int bpp = 16; bpp <= 32; bpp += 16) {
+			check_amd(1, 1, bpp);
+			check_amd(65, 33, bpp);
+			check_amd(641, 479, bpp);
+		}
+	}
+
+	igt_subtest("large") {
+		/* Big enough to be split across threads */
+		check_t_tiled(1920, 1080, 32);
+		check_t_tiled(3840, 2160, 16);
+		check_sand(1920, 1080, DRM_FORMAT_MOD_BROADCOM_SAND128, 128);
+		check_amd(1920, 1080, 32);
+		check_amd(3840, 2160, 16);
+	}
+}
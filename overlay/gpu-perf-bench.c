@@ -0,0 +1,213 @@
+/*
+ * Copyright © 2023 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures how fast the overlay drains its perf rings, using synthetic
+ * rings and tracepoint layouts instead of the i915 tracepoints.
+ *
+ * Every update, each of the -c rings is filled with request_add,
+ * ring_sync, ctx_switch and flip_complete samples from a few live pids,
+ * starting close to the end of the ring so that records wrap around.
+ */
+
+#include <time.h>
+
+#include "gpu-perf.c"
+
+#define ARRAY_SIZE(x) ((int)(sizeof(x) / sizeof((x)[0])))
+
+#define RAW_SIZE 28
+#define RECORD_SIZE (sizeof(struct sample_event) + RAW_SIZE)
+
+static const int bench_tp[] = {
+	TP_GEM_REQUEST_ADD,
+	TP_GEM_RING_SYNC_TO,
+	TP_GEM_RING_SWITCH_CONTEXT,
+	TP_FLIP_COMPLETE,
+};
+
+static void set_field(struct tracepoint *tp, int *field,
+		      const char *name, int offset, int size)
+{
+	*field = tp->n_fields;
+	snprintf(tp->fields[tp->n_fields].name,
+		 sizeof(tp->fields[tp->n_fields].name), "%s", name);
+	tp->fields[tp->n_fields].offset = offset;
+	tp->fields[tp->n_fields].size = size;
+	tp->n_fields++;
+}
+
+static int bench_init(struct gpu_perf *gp, int nr_cpus)
+{
+	int (*func[])(struct gpu_perf *, const void *) = {
+		request_add, ring_sync, ctx_switch, flip_complete,
+	};
+	int size = (1 + N_PAGES) * getpagesize();
+	uint64_t id = 1000;
+	int n, i;
+
+	memset(gp, 0, sizeof(*gp));
+	gp->nr_cpus = nr_cpus;
+	gp->page_size = getpagesize();
+	gp->nr_events = ARRAY_SIZE(bench_tp);
+
+	/* The same raw layout for all, after the 8 bytes of common fields */
+	for (n = 0; n < ARRAY_SIZE(bench_tp); n++) {
+		struct tracepoint *tp = &tracepoints[bench_tp[n]];
+
+		tp->event_id = n + 1;
+		set_field(tp, &tp->device_field, "device", 8, 4);
+		set_field(tp, &tp->class_field, "class", 12, 2);
+		set_field(tp, &tp->instance_field, "instance", 14, 2);
+		set_field(tp, &tp->ctx_field, "ctx", 16, 4);
+		set_field(tp, &tp->seqno_field, "seqno", 20, 4);
+		set_field(tp, &tp->plane_field, "plane", 24, 4);
+	}
+
+	gp->sample = calloc(gp->nr_events * nr_cpus, sizeof(*gp->sample));
+	gp->map = calloc(nr_cpus, sizeof(void *));
+	gp->batch = calloc(1, sizeof(*gp->batch));
+	if (!gp->sample || !gp->map || !gp->batch)
+		return ENOMEM;
+
+	for (n = 0; n < gp->nr_events; n++) {
+		for (i = 0; i < nr_cpus; i++) {
+			gp->sample[n * nr_cpus + i].id = id++;
+			gp->sample[n * nr_cpus + i].func = func[n];
+		}
+	}
+	if (build_sample_index(gp))
+		return ENOMEM;
+
+	for (i = 0; i < nr_cpus; i++) {
+		gp->map[i] = aligned_alloc(gp->page_size, size);
+		if (!gp->map[i])
+			return ENOMEM;
+		memset(gp->map[i], 0, size);
+	}
+
+	return 0;
+}
+
+static uint64_t fill_ring(struct gpu_perf *gp, int cpu, const pid_t *pids,
+			  int nr_pids, uint64_t *seed)
+{
+	struct perf_event_mmap_page *mmap = gp->map[cpu];
+	const uint64_t size = N_PAGES * gp->page_size;
+	uint8_t *data = (uint8_t *)mmap + gp->page_size;
+	uint64_t head = mmap->data_head;
+	uint64_t count = 0;
+
+	/* Start just short of the end, to wrap records around it */
+	if (!head)
+		head = mmap->data_tail = size - RECORD_SIZE / 2 - 4;
+
+	while (head + RECORD_SIZE - mmap->data_tail <= size) {
+		uint8_t record[RECORD_SIZE] = {};
+		struct sample_event *sample = (void *)record;
+		uint16_t class = 0, instance = 0;
+		uint32_t plane = 0;
+		int tp;
+
+		*seed = *seed * 6364136223846793005ull + 1442695040888963407ull;
+		tp = (*seed >> 33) % gp->nr_events;
+
+		sample->header.type = PERF_RECORD_SAMPLE;
+		sample->header.size = RECORD_SIZE;
+		sample->pid = sample->tid = pids[(*seed >> 40) % nr_pids];
+		sample->time = head;
+		sample->id = gp->sample[tp * gp->nr_cpus + cpu].id;
+		sample->raw_size = RAW_SIZE;
+		memcpy(sample->tracepoint_data + 12, &class, sizeof(class));
+		memcpy(sample->tracepoint_data + 14, &instance, sizeof(instance));
+		memcpy(sample->tracepoint_data + 24, &plane, sizeof(plane));
+
+		for (size_t i = 0; i < RECORD_SIZE; i++)
+			data[(head + i) & (size - 1)] = record[i];
+
+		head += RECORD_SIZE;
+		count++;
+	}
+
+	mmap->data_head = head;
+	return count;
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+	pid_t pids[] = { getpid(), getppid(), 1 };
+	int nr_cpus = 8, reps = 1000, c;
+	uint64_t records = 0, seed = 1;
+	struct timespec start, end;
+	struct gpu_perf gp;
+	double t = 0;
+	int update = 0;
+
+	while ((c = getopt(argc, argv, "c:r:")) != -1) {
+		switch (c) {
+		case 'c':
+			nr_cpus = atoi(optarg);
+			if (nr_cpus < 1)
+				nr_cpus = 1;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			if (reps < 1)
+				reps = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (bench_init(&gp, nr_cpus)) {
+		fprintf(stderr, "Failed to set up the synthetic rings\n");
+		return 1;
+	}
+
+	for (int n = 0; n < reps; n++) {
+		for (int i = 0; i < nr_cpus; i++)
+			records += fill_ring(&gp, i, pids, ARRAY_SIZE(pids),
+					     &seed);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		update += gpu_perf_update(&gp);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		t += elapsed(&start, &end);
+	}
+
+	printf("%llu records, %d updates: %.3f ms, %.1f ns/record\n",
+	       (unsigned long long)records, update, 1e3 * t, 1e9 * t / records);
+
+	return 0;
+}
@@ -22,6 +22,7 @@
  *
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/types.h>
@@ -174,15 +175,65 @@ tracepoint_id(int tp_id)
 	return tp->event_id;
 }
 
+/*
+ * A sample record in a perf ring. Records are not copied out of the ring,
+ * so the fields of one that wraps around the end of the ring are read in
+ * two pieces.
+ */
+struct sample_view {
+	const uint8_t *data;
+	uint64_t mask;
+	uint64_t pos;
+
+	uint32_t pid;
+	uint64_t time;
+	uint64_t id;
+};
+
+static inline void ring_read(const uint8_t *data, uint64_t mask,
+			     uint64_t pos, void *dst, size_t len)
+{
+	size_t offset = pos & mask;
+
+	if (offset + len <= mask + 1) {
+		memcpy(dst, data + offset, len);
+	} else {
+		size_t before = mask + 1 - offset;
+
+		memcpy(dst, data + offset, before);
+		memcpy((uint8_t *)dst + before, data, len - before);
+	}
+}
+
+static inline uint32_t read_tp_u32(const struct sample_view *sample, int offset)
+{
+	uint32_t value;
+
+	ring_read(sample->data, sample->mask,
+		  sample->pos + offsetof(struct sample_event, tracepoint_data) + offset,
+		  &value, sizeof(value));
+
+	return value;
+}
+
+static inline uint16_t read_tp_u16(const struct sample_view *sample, int offset)
+{
+	uint16_t value;
+
+	ring_read(sample->data, sample->mask,
+		  sample->pos + offsetof(struct sample_event, tracepoint_data) + offset,
+		  &value, sizeof(value));
+
+	return value;
+}
+
 #define READ_TP_FIELD_U32(sample, tp_id, field_name)			\
-	(*(const uint32_t *)((sample)->tracepoint_data +		\
-			     tracepoints[tp_id].fields[			\
-				     tracepoints[tp_id].field_name##_field].offset))
+	read_tp_u32(sample, tracepoints[tp_id].fields[			\
+		    tracepoints[tp_id].field_name##_field].offset)
 
 #define READ_TP_FIELD_U16(sample, tp_id, field_name)			\
-	(*(const uint16_t *)((sample)->tracepoint_data +		\
-			     tracepoints[tp_id].fields[			\
-				     tracepoints[tp_id].field_name##_field].offset))
+	read_tp_u16(sample, tracepoints[tp_id].fields[			\
+		    tracepoints[tp_id].field_name##_field].offset)
 
 #define GET_RING_ID(sample, tp_id) \
 ({ \
@@ -271,7 +322,7 @@ static int perf_mmap(struct gpu_perf *gp)
 	return 0;
 
 err:
-	while (--j > 0)
+	while (--j >= 0)
 		munmap(gp->map[j], size);
 	free(gp->map);
 	gp->map = NULL;
@@ -328,22 +379,87 @@ lookup_comm(struct gpu_perf *gp, pid_t pid)
 	return comm;
 }
 
+/*
+ * Request and sync counts are gathered per pid over a whole drain of the
+ * rings, and only then added to the comms, so that a busy client costs
+ * one comm lookup per update rather than one per request.
+ */
+#define BATCH_SIZE 64
+
+struct gpu_perf_batch {
+	struct batch_comm {
+		pid_t pid;
+		int nr_requests[MAX_RINGS];
+		uint32_t nr_sema;
+		int nr_samples;
+	} comm[BATCH_SIZE];
+	int count;
+	int update;
+};
+
+static void flush_batch(struct gpu_perf *gp)
+{
+	struct gpu_perf_batch *batch = gp->batch;
+	int n, m;
+
+	for (n = 0; n < BATCH_SIZE && batch->count; n++) {
+		struct batch_comm *bc = &batch->comm[n];
+		struct gpu_perf_comm *comm;
+
+		if (bc->pid == 0)
+			continue;
+
+		comm = lookup_comm(gp, bc->pid);
+		if (comm) {
+			for (m = 0; m < MAX_RINGS; m++)
+				comm->nr_requests[m] += bc->nr_requests[m];
+			comm->nr_sema += bc->nr_sema;
+			batch->update += bc->nr_samples;
+		}
+
+		memset(bc, 0, sizeof(*bc));
+		batch->count--;
+	}
+}
+
+static struct batch_comm *batch_comm(struct gpu_perf *gp, pid_t pid)
+{
+	struct gpu_perf_batch *batch = gp->batch;
+	unsigned int n;
+
+	if (pid == 0)
+		return NULL;
+
+	if (batch->count > 3 * BATCH_SIZE / 4)
+		flush_batch(gp);
+
+	for (n = pid % BATCH_SIZE; batch->comm[n].pid; n = (n + 1) % BATCH_SIZE) {
+		if (batch->comm[n].pid == pid)
+			return &batch->comm[n];
+	}
+
+	batch->comm[n].pid = pid;
+	batch->count++;
+	return &batch->comm[n];
+}
+
 static int request_add(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
-	struct gpu_perf_comm *comm;
+	const struct sample_view *sample = event;
+	struct batch_comm *comm;
 
-	comm = lookup_comm(gp, sample->pid);
+	comm = batch_comm(gp, sample->pid);
 	if (comm == NULL)
 		return 0;
 
 	comm->nr_requests[GET_RING_ID(sample, TP_GEM_REQUEST_ADD)]++;
-	return 1;
+	comm->nr_samples++;
+	return 0;
 }
 
 static int flip_complete(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
+	const struct sample_view *sample = event;
 
 	gp->flip_complete[READ_TP_FIELD_U32(sample, TP_FLIP_COMPLETE, plane)]++;
 	return 1;
@@ -351,7 +467,7 @@ static int flip_complete(struct gpu_perf *gp, const void *event)
 
 static int ctx_switch(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
+	const struct sample_view *sample = event;
 
 	gp->ctx_switch[GET_RING_ID(sample, TP_GEM_RING_SWITCH_CONTEXT)]++;
 	return 1;
@@ -359,20 +475,21 @@ static int ctx_switch(struct gpu_perf *gp, const void *event)
 
 static int ring_sync(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
-	struct gpu_perf_comm *comm;
+	const struct sample_view *sample = event;
+	struct batch_comm *comm;
 
-	comm = lookup_comm(gp, sample->pid);
+	comm = batch_comm(gp, sample->pid);
 	if (comm == NULL)
 		return 0;
 
 	comm->nr_sema++;
-	return 1;
+	comm->nr_samples++;
+	return 0;
 }
 
 static int wait_begin(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
+	const struct sample_view *sample = event;
 	struct gpu_perf_comm *comm;
 	struct gpu_perf_time *wait;
 
@@ -399,7 +516,7 @@ static int wait_begin(struct gpu_perf *gp, const void *event)
 
 static int wait_end(struct gpu_perf *gp, const void *event)
 {
-	const struct sample_event *sample = event;
+	const struct sample_view *sample = event;
 	struct gpu_perf_time *wait, **prev;
 	uint32_t engine = GET_RING_ID(sample, TP_GEM_REQUEST_WAIT_END);
 	uint32_t context = READ_TP_FIELD_U32(sample, TP_GEM_REQUEST_WAIT_END, ctx);
@@ -420,8 +537,39 @@ static int wait_end(struct gpu_perf *gp, const void *event)
 	return 0;
 }
 
+/*
+ * Sample ids are handed out sequentially by the kernel, so masking them
+ * indexes a table twice the number of events almost without collisions.
+ */
+static int build_sample_index(struct gpu_perf *gp)
+{
+	int n = gp->nr_events * gp->nr_cpus;
+	unsigned int size = 16;
+	int i;
+
+	while (size < 2 * n)
+		size <<= 1;
+
+	gp->sample_index = calloc(size, sizeof(*gp->sample_index));
+	if (gp->sample_index == NULL)
+		return ENOMEM;
+	gp->sample_mask = size - 1;
+
+	for (i = 0; i < n; i++) {
+		unsigned int slot = gp->sample[i].id & gp->sample_mask;
+
+		while (gp->sample_index[slot])
+			slot = (slot + 1) & gp->sample_mask;
+		gp->sample_index[slot] = &gp->sample[i];
+	}
+
+	return 0;
+}
+
 void gpu_perf_init(struct gpu_perf *gp, unsigned flags)
 {
+	int n;
+
 	memset(gp, 0, sizeof(*gp));
 	gp->nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
 	gp->page_size = getpagesize();
@@ -438,35 +586,55 @@ void gpu_perf_init(struct gpu_perf *gp, unsigned flags)
 		return;
 	}
 
-	if (perf_mmap(gp))
-		return;
-}
+	gp->batch = calloc(1, sizeof(*gp->batch));
+	if (gp->batch == NULL || build_sample_index(gp) || perf_mmap(gp))
+		goto err;
 
-static int process_sample(struct gpu_perf *gp, int cpu,
-			  const struct perf_event_header *header)
-{
-	const struct sample_event *sample = (const struct sample_event *)header;
-	int n, update = 0;
+	return;
 
-	/* hash me! */
-	for (n = 0; n < gp->nr_events; n++) {
-		int m = n * gp->nr_cpus + cpu;
-		if (gp->sample[m].id != sample->id)
-			continue;
+err:
+	for (n = 0; n < gp->nr_events * gp->nr_cpus; n++)
+		close(gp->fd[n]);
+	free(gp->fd);
+	free(gp->sample);
+	free(gp->sample_index);
+	free(gp->batch);
+	gp->fd = NULL;
+	gp->sample = NULL;
+	gp->sample_index = NULL;
+	gp->batch = NULL;
+	gp->nr_events = 0;
+	gp->error = "failed to map i915.ko tracepoints";
+}
 
-		update = gp->sample[m].func(gp, sample);
-		break;
+static int process_sample(struct gpu_perf *gp, struct sample_view *sample)
+{
+	const struct gpu_perf_sample *s;
+	unsigned int slot;
+
+	ring_read(sample->data, sample->mask,
+		  sample->pos + offsetof(struct sample_event, pid),
+		  &sample->pid, sizeof(sample->pid));
+	ring_read(sample->data, sample->mask,
+		  sample->pos + offsetof(struct sample_event, time),
+		  &sample->time, sizeof(sample->time));
+	ring_read(sample->data, sample->mask,
+		  sample->pos + offsetof(struct sample_event, id),
+		  &sample->id, sizeof(sample->id));
+
+	for (slot = sample->id & gp->sample_mask;
+	     (s = gp->sample_index[slot]) != NULL;
+	     slot = (slot + 1) & gp->sample_mask) {
+		if (s->id == sample->id)
+			return s->func(gp, sample);
 	}
 
-	return update;
+	return 0;
 }
 
 int gpu_perf_update(struct gpu_perf *gp)
 {
-	const int size = N_PAGES * gp->page_size;
-	const int mask = size - 1;
-	uint8_t *buffer = NULL;
-	int buffer_size = 0;
+	const uint64_t size = N_PAGES * gp->page_size;
 	int n, update = 0;
 
 	if (gp->map == NULL)
@@ -474,61 +642,40 @@ int gpu_perf_update(struct gpu_perf *gp)
 
 	for (n = 0; n < gp->nr_cpus; n++) {
 		struct perf_event_mmap_page *mmap = gp->map[n];
-		const uint8_t *data;
+		struct sample_view sample = {
+			.data = (uint8_t *)mmap + gp->page_size,
+			.mask = size - 1,
+		};
 		uint64_t head, tail;
-		int wrap = 0;
 
+		/* Both are free running, only masked to access the ring */
 		tail = mmap->data_tail;
 		head = mmap->data_head;
 		rmb();
 
-		if (head < tail) {
-			wrap = 1;
-			tail &= mask;
-			head &= mask;
-			head += size;
-		}
-
-		data = (uint8_t *)mmap + gp->page_size;
 		while (head - tail >= sizeof (struct perf_event_header)) {
-			const struct perf_event_header *header;
+			struct perf_event_header header;
 
-			header = (const struct perf_event_header *)(data + (tail & mask));
-			assert(header->size > 0);
-			if (header->size > head - tail)
+			ring_read(sample.data, sample.mask, tail,
+				  &header, sizeof(header));
+			assert(header.size > 0);
+			if (header.size > head - tail)
 				break;
 
-			if ((const uint8_t *)header + header->size > data + size) {
-				int before;
-
-				if (header->size > buffer_size) {
-					uint8_t *b = realloc(buffer, header->size);
-					if (b == NULL)
-						break;
-
-					buffer = b;
-					buffer_size = header->size;
-				}
-
-				before = data + size - (const uint8_t *)header;
-
-				memcpy(buffer, header, before);
-				memcpy(buffer + before, data, header->size - before);
-
-				header = (struct perf_event_header *)buffer;
+			if (header.type == PERF_RECORD_SAMPLE) {
+				sample.pos = tail;
+				update += process_sample(gp, &sample);
 			}
-
-			if (header->type == PERF_RECORD_SAMPLE)
-				update += process_sample(gp, n, header);
-			tail += header->size;
+			tail += header.size;
 		}
 
-		if (wrap)
-			tail &= mask;
 		mmap->data_tail = tail;
 		wmb();
 	}
 
-	free(buffer);
+	flush_batch(gp);
+	update += gp->batch->update;
+	gp->batch->update = 0;
+
 	return update;
 }
@@ -30,6 +30,8 @@
 
 #define MAX_RINGS 16
 
+struct gpu_perf_batch;
+
 struct gpu_perf {
 	const char *error;
 	int page_size;
@@ -40,7 +42,9 @@ struct gpu_perf {
 	struct gpu_perf_sample {
 		uint64_t id;
 		int (*func)(struct gpu_perf *, const void *);
-	} *sample;
+	} *sample, **sample_index;
+	unsigned sample_mask;
+	struct gpu_perf_batch *batch;
 
 	unsigned flip_complete[MAX_RINGS];
 	unsigned ctx_switch[MAX_RINGS];
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <glib.h>
+#include <inttypes.h>
 #ifdef __linux__
 #include <linux/watchdog.h>
 #endif
@@ -30,9 +31,12 @@
 
 #include "igt_aux.h"
 #include "igt_core.h"
+#include "igt_kmsg.h"
 #include "igt_taints.h"
 #include "executor.h"
 #include "output_strings.h"
+#include "resources.h"
+#include "result_store.h"
 #include "runnercomms.h"
 
 #define KMSG_HEADER "[IGT] "
@@ -44,6 +48,12 @@ static struct {
 	size_t num_dogs;
 } watchdogs;
 
+/*
+ * With settings->result_store the outputs of all jobs go to the store
+ * of the run, and the output fds of a job are left unused (-1).
+ */
+static struct result_store *result_store;
+
 __attribute__((format(printf, 2, 3)))
 static void __logf__(FILE *stream, const char *fmt, ...)
 {
@@ -424,8 +434,10 @@ static bool prune_from_journal(struct job_list_entry *entry, int fd)
 	 */
 
 	f = fdopen(fd, "r");
-	if (!f)
+	if (!f) {
+		close(fd);
 		return false;
+	}
 
 	while (fscanf(f, "%ms", &subtest) == 1) {
 		if (!strncmp(subtest, EXECUTOR_EXIT, strlen(EXECUTOR_EXIT))) {
@@ -531,6 +543,7 @@ static const char *filenames[_F_LAST] = {
 	[_F_ERR] = "err.txt",
 	[_F_DMESG] = "dmesg.txt",
 	[_F_SOCKET] = "comms",
+	[_F_RESOURCES] = "resources.txt",
 };
 
 static int open_at_end(int dirfd, const char *name)
@@ -562,8 +575,13 @@ bool open_output_files(int dirfd, int *fds, bool write)
 
 	for (i = 0; i < _F_LAST; i++) {
 		if ((fds[i] = openfunc(dirfd, filenames[i])) < 0) {
-			/* Ignore failure to open socket comms for reading */
-			if (i == _F_SOCKET && !write) continue;
+			/*
+			 * Ignore failure to open socket comms and
+			 * resource usage for reading, older results
+			 * don't have them
+			 */
+			if ((i == _F_SOCKET || i == _F_RESOURCES) && !write)
+				continue;
 
 			while (--i >= 0)
 				close(fds[i]);
@@ -583,90 +601,96 @@ void close_outputs(int *fds)
 	}
 }
 
-/* Returns the number of bytes written to disk, or a negative number on error */
-static long dump_dmesg(int kmsgfd, int outfd)
+static void output_write(int *outputs, int stream, const void *buf, size_t len)
 {
-	/*
-	 * Write kernel messages to the log file until we reach
-	 * 'now'. Unfortunately, /dev/kmsg doesn't support seeking to
-	 * -1 from SEEK_END so we need to use a second fd to read a
-	 * message to match against, or stop when we reach EAGAIN.
-	 */
+	if (result_store)
+		result_store_write(result_store, stream, buf, len);
+	else
+		write(outputs[stream], buf, len);
+}
 
-	int comparefd;
-	unsigned flags;
-	unsigned long long seq, cmpseq, usec;
-	bool underflow_once = false;
-	char cont;
-	char buf[2048];
-	ssize_t r;
-	long written = 0;
+static void __attribute__((format(printf, 3, 4)))
+output_printf(int *outputs, int stream, const char *fmt, ...)
+{
+	va_list ap;
+	char *str;
+	int len;
 
-	if (kmsgfd < 0)
-		return 0;
+	va_start(ap, fmt);
+	len = vasprintf(&str, fmt, ap);
+	va_end(ap);
 
-	comparefd = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
-	if (comparefd < 0) {
-		errf("Error opening another fd for /dev/kmsg\n");
-		return -1;
-	}
-	lseek(comparefd, 0, SEEK_END);
+	if (len < 0)
+		return;
 
-	while (1) {
-		if (comparefd >= 0) {
-			r = read(comparefd, buf, sizeof(buf) - 1);
-			if (r < 0) {
-				if (errno != EAGAIN && errno != EPIPE) {
-					errf("Warning: Error reading kmsg comparison record: %m\n");
-					close(comparefd);
-					return 0;
-				}
-			} else {
-				buf[r] = '\0';
-				if (sscanf(buf, "%u,%llu,%llu,%c;",
-					   &flags, &cmpseq, &usec, &cont) == 4) {
-					/* Reading comparison record done. */
-					close(comparefd);
-					comparefd = -1;
-				}
-			}
-		}
+	output_write(outputs, stream, str, len);
+	free(str);
+}
 
-		r = read(kmsgfd, buf, sizeof(buf));
-		if (r < 0) {
-			if (errno == EPIPE) {
-				if (!underflow_once) {
-					errf("Warning: kernel log ringbuffer underflow, some records lost.\n");
-					underflow_once = true;
-				}
-				continue;
-			} else if (errno == EINVAL) {
-				errf("Warning: Buffer too small for kernel log record, record lost.\n");
-				continue;
-			} else if (errno != EAGAIN) {
-				errf("Error reading from kmsg: %m\n");
-				return -errno;
-			}
+static void output_sync(int *outputs, int stream)
+{
+	if (result_store)
+		result_store_sync(result_store);
+	else
+		fdatasync(outputs[stream]);
+}
 
-			/* EAGAIN, so we're done dumping */
-			close(comparefd);
-			return written;
-		}
+static void write_subtest_resources(struct resource_monitor *resources,
+				    int *outputs, const char *name, size_t len)
+{
+	struct resource_usage usage;
+	char buf[1024];
 
-		write(outfd, buf, r);
-		written += r;
+	if (!resource_monitor_end_subtest(resources, &usage))
+		return;
 
-		if (comparefd < 0 && sscanf(buf, "%u,%llu,%llu,%c;",
-					    &flags, &seq, &usec, &cont) == 4) {
-			/*
-			 * Comparison record has been read, compare
-			 * the sequence number to see if we have read
-			 * enough.
-			 */
-			if (seq >= cmpseq)
-				return written;
-		}
+	resource_usage_format(&usage, buf, sizeof(buf));
+	output_printf(outputs, _F_RESOURCES, "%s%.*s %s\n",
+		      RESOURCES_SUBTEST, (int)len, name, buf);
+}
+
+static void write_exit_resources(struct resource_monitor *resources,
+				 int *outputs, const struct rusage *ru)
+{
+	struct resource_usage usage;
+	char buf[1024];
+
+	resource_monitor_exit(resources, ru, &usage);
+	resource_usage_format(&usage, buf, sizeof(buf));
+	output_printf(outputs, _F_RESOURCES, "%s%s\n", RESOURCES_EXIT, buf);
+}
+
+/* Returns the number of bytes written to disk, or a negative number on error */
+static long dump_dmesg(struct igt_kmsg *kmsg, int *outputs)
+{
+	uint64_t lost = kmsg->lost;
+	const char *data;
+	size_t len;
+	int r;
+
+	if (kmsg->fd < 0)
+		return 0;
+
+	/*
+	 * Write kernel messages to the log file until we reach
+	 * 'now'. The records are drained into one buffer and written
+	 * out as they were read, with a single write.
+	 */
+	r = igt_kmsg_drain(kmsg);
+	if (kmsg->lost != lost)
+		errf("Warning: kernel log ringbuffer underflow, some records lost.\n");
+
+	len = igt_kmsg_raw(kmsg, &data);
+	if (len)
+		output_write(outputs, _F_DMESG, data, len);
+	igt_kmsg_discard(kmsg);
+
+	if (r < 0) {
+		errf("Error reading from kmsg: %s\n", strerror(-r));
+		return r;
 	}
+
+	return len;
 }
 
 static bool kill_child(int sig, pid_t child)
@@ -850,6 +874,21 @@ static void write_packet_with_canary(int fd, struct runnerpacket *packet, bool s
 {
 	uint32_t canary = socket_dump_canary();
 
+	if (result_store) {
+		char *buf = malloc(sizeof(canary) + packet->size);
+
+		if (buf) {
+			memcpy(buf, &canary, sizeof(canary));
+			memcpy(buf + sizeof(canary), packet, packet->size);
+			result_store_write(result_store, _F_SOCKET,
+					   buf, sizeof(canary) + packet->size);
+			free(buf);
+		}
+		if (sync)
+			result_store_sync(result_store);
+		return;
+	}
+
 	write(fd, &canary, sizeof(canary));
 	write(fd, packet, packet->size);
 	if (sync)
@@ -867,7 +906,8 @@ static void write_packet_with_canary(int fd, struct runnerpacket *packet, bool s
  */
 static int monitor_output(pid_t child,
 			  int outfd, int errfd, int socketfd,
-			  int kmsgfd, int sigfd,
+			  struct igt_kmsg *kmsg, int sigfd,
+			  struct resource_monitor *resources,
 			  int *outputs,
 			  double *time_spent,
 			  struct settings *settings,
@@ -901,8 +941,8 @@ static int monitor_output(pid_t child,
 		nfds = errfd;
 	if (socketfd > nfds)
 		nfds = socketfd;
-	if (kmsgfd > nfds)
-		nfds = kmsgfd;
+	if (kmsg->fd > nfds)
+		nfds = kmsg->fd;
 	if (sigfd > nfds)
 		nfds = sigfd;
 	nfds++;
@@ -944,8 +984,8 @@ static int monitor_output(pid_t child,
 			FD_SET(errfd, &set);
 		if (socketfd >= 0)
 			FD_SET(socketfd, &set);
-		if (kmsgfd >= 0)
-			FD_SET(kmsgfd, &set);
+		if (kmsg->fd >= 0)
+			FD_SET(kmsg->fd, &set);
 		if (sigfd >= 0)
 			FD_SET(sigfd, &set);
 
@@ -958,6 +998,7 @@ static int monitor_output(pid_t child,
 		}
 
 		igt_gettime(&time_now);
+		resource_monitor_poll(resources);
 
 		/* TODO: Refactor these handlers to their own functions */
 		if (outfd >= 0 && FD_ISSET(outfd, &set)) {
@@ -976,10 +1017,10 @@ static int monitor_output(pid_t child,
 				goto out_end;
 			}
 
-			write(outputs[_F_OUT], buf, s);
+			output_write(outputs, _F_OUT, buf, s);
 			disk_usage += s;
 			if (settings->sync) {
-				fdatasync(outputs[_F_OUT]);
+				output_sync(outputs, _F_OUT);
 			}
 
 			outbuf = realloc(outbuf, outbufsize + s);
@@ -991,14 +1032,19 @@ static int monitor_output(pid_t child,
 
 				if (linelen > strlen(STARTING_SUBTEST) &&
 				    !memcmp(outbuf, STARTING_SUBTEST, strlen(STARTING_SUBTEST))) {
-					write(outputs[_F_JOURNAL], outbuf + strlen(STARTING_SUBTEST),
-					      linelen - strlen(STARTING_SUBTEST));
+					output_write(outputs, _F_JOURNAL,
+						     outbuf + strlen(STARTING_SUBTEST),
+						     linelen - strlen(STARTING_SUBTEST));
 					if (settings->sync) {
-						fdatasync(outputs[_F_JOURNAL]);
+						output_sync(outputs, _F_JOURNAL);
 					}
 					memcpy(current_subtest, outbuf + strlen(STARTING_SUBTEST),
 					       linelen - strlen(STARTING_SUBTEST));
 					current_subtest[linelen - strlen(STARTING_SUBTEST)] = '\0';
+					if (result_store)
+						result_store_begin_subtest(result_store,
+									   current_subtest);
+					resource_monitor_begin_subtest(resources);
 
 					time_last_subtest = time_now;
 					disk_usage = s;
@@ -1013,15 +1059,19 @@ static int monitor_output(pid_t child,
 
 					if (delim != NULL) {
 						size_t subtestlen = delim - outbuf - strlen(SUBTEST_RESULT);
+
+						write_subtest_resources(resources, outputs,
+									outbuf + strlen(SUBTEST_RESULT),
+									subtestlen);
 						if (memcmp(current_subtest, outbuf + strlen(SUBTEST_RESULT),
 							   subtestlen)) {
 							/* Result for a test that didn't ever start */
-							write(outputs[_F_JOURNAL],
-							      outbuf + strlen(SUBTEST_RESULT),
-							      subtestlen);
-							write(outputs[_F_JOURNAL], "\n", 1);
+							output_write(outputs, _F_JOURNAL,
+								     outbuf + strlen(SUBTEST_RESULT),
+								     subtestlen);
+							output_write(outputs, _F_JOURNAL, "\n", 1);
 							if (settings->sync) {
-								fdatasync(outputs[_F_JOURNAL]);
+								output_sync(outputs, _F_JOURNAL);
 							}
 							current_subtest[0] = '\0';
 						}
@@ -1068,10 +1118,10 @@ static int monitor_output(pid_t child,
 				close(errfd);
 				errfd = -1;
 			} else {
-				write(outputs[_F_ERR], buf, s);
+				output_write(outputs, _F_ERR, buf, s);
 				disk_usage += s;
 				if (settings->sync) {
-					fdatasync(outputs[_F_ERR]);
+					output_sync(outputs, _F_ERR);
 				}
 			}
 		}
@@ -1159,9 +1209,32 @@ static int monitor_output(pid_t child,
 					}
 				}
 
+				if (result_store &&
+				    packet->type == PACKETTYPE_SUBTEST_START) {
+					runnerpacket_read_helper helper = read_runnerpacket(packet);
+
+					if (helper.type == PACKETTYPE_SUBTEST_START &&
+					    helper.subteststart.name)
+						result_store_begin_subtest(result_store,
+									   helper.subteststart.name);
+				}
+
+				if (packet->type == PACKETTYPE_SUBTEST_START)
+					resource_monitor_begin_subtest(resources);
+
 				write_packet_with_canary(outputs[_F_SOCKET], packet, settings->sync);
 				disk_usage += packet->size;
 
+				if (packet->type == PACKETTYPE_SUBTEST_RESULT) {
+					runnerpacket_read_helper helper = read_runnerpacket(packet);
+
+					if (helper.type == PACKETTYPE_SUBTEST_RESULT &&
+					    helper.subtestresult.name)
+						write_subtest_resources(resources, outputs,
+									helper.subtestresult.name,
+									strlen(helper.subtestresult.name));
+				}
+
 				if (packet->type == PACKETTYPE_SUBTEST_RESULT ||
 				    packet->type == PACKETTYPE_DYNAMIC_SUBTEST_RESULT)
 					results_received = true;
@@ -1215,21 +1288,19 @@ static int monitor_output(pid_t child,
 		}
 	socket_end:
 
-		if (kmsgfd >= 0 && FD_ISSET(kmsgfd, &set)) {
+		if (kmsg->fd >= 0 && FD_ISSET(kmsg->fd, &set)) {
 			long dmesgwritten;
 
 			time_last_activity = time_now;
 
-			dmesgwritten = dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+			dmesgwritten = dump_dmesg(kmsg, outputs);
 			if (settings->sync)
-				fdatasync(outputs[_F_DMESG]);
+				output_sync(outputs, _F_DMESG);
 
-			if (dmesgwritten < 0) {
-				close(kmsgfd);
-				kmsgfd = -1;
-			} else {
+			if (dmesgwritten < 0)
+				igt_kmsg_fini(kmsg);
+			else
 				disk_usage += dmesgwritten;
-			}
 		}
 
 		if (sigfd >= 0 && FD_ISSET(sigfd, &set)) {
@@ -1240,18 +1311,26 @@ static int monitor_output(pid_t child,
 				errf("Error reading from signalfd: %m\n");
 				continue;
 			} else if (siginfo.ssi_signo == SIGCHLD) {
-				if (child != waitpid(child, &status, WNOHANG)) {
+				struct rusage ru;
+
+				if (child != wait4(child, &status, WNOHANG, &ru)) {
 					errf("Failed to reap child\n");
 					status = 9999;
-				} else if (WIFEXITED(status)) {
-					status = WEXITSTATUS(status);
-					if (status >= 128) {
-						status = 128 - status;
-					}
-				} else if (WIFSIGNALED(status)) {
-					status = -WTERMSIG(status);
 				} else {
-					status = 9999;
+					write_exit_resources(resources, outputs, &ru);
+					if (settings->sync)
+						output_sync(outputs, _F_RESOURCES);
+
+					if (WIFEXITED(status)) {
+						status = WEXITSTATUS(status);
+						if (status >= 128) {
+							status = 128 - status;
+						}
+					} else if (WIFSIGNALED(status)) {
+						status = -WTERMSIG(status);
+					} else {
+						status = 9999;
+					}
 				}
 			} else {
 				/* We're dying, so we're taking them with us */
@@ -1295,11 +1374,12 @@ static int monitor_output(pid_t child,
 						write_packet_with_canary(outputs[_F_SOCKET], override, settings->sync);
 						free(override);
 					} else {
-						dprintf(outputs[_F_JOURNAL], "%s%d (0.000s)\n",
-							EXECUTOR_EXIT,
-							GRACEFUL_EXITCODE);
+						output_printf(outputs, _F_JOURNAL,
+							      "%s%d (0.000s)\n",
+							      EXECUTOR_EXIT,
+							      GRACEFUL_EXITCODE);
 						if (settings->sync)
-							fdatasync(outputs[_F_JOURNAL]);
+							output_sync(outputs, _F_JOURNAL);
 					}
 				}
 
@@ -1357,11 +1437,11 @@ static int monitor_output(pid_t child,
 						write_packet_with_canary(outputs[_F_SOCKET], message, settings->sync);
 						free(message);
 					} else {
-						dprintf(outputs[_F_OUT],
-							"\nrunner: This test was killed due to a kernel taint (0x%lx).\n",
-							taints);
+						output_printf(outputs, _F_OUT,
+							      "\nrunner: This test was killed due to a kernel taint (0x%lx).\n",
+							      taints);
 						if (settings->sync)
-							fdatasync(outputs[_F_OUT]);
+							output_sync(outputs, _F_OUT);
 					}
 				}
 
@@ -1385,13 +1465,13 @@ static int monitor_output(pid_t child,
 						write_packet_with_canary(outputs[_F_SOCKET], message, settings->sync);
 						free(message);
 					} else {
-						dprintf(outputs[_F_OUT],
-							"\nrunner: This test was killed due to exceeding disk usage limit. "
-							"(Used %zd bytes, limit %zd)\n",
-							disk_usage,
-							settings->disk_usage_limit);
+						output_printf(outputs, _F_OUT,
+							      "\nrunner: This test was killed due to exceeding disk usage limit. "
+							      "(Used %zd bytes, limit %zd)\n",
+							      disk_usage,
+							      settings->disk_usage_limit);
 						if (settings->sync)
-							fdatasync(outputs[_F_OUT]);
+							output_sync(outputs, _F_OUT);
 					}
 				}
 
@@ -1416,11 +1496,12 @@ static int monitor_output(pid_t child,
 					const char *exitline;
 
 					exitline = timeoutresult ? EXECUTOR_TIMEOUT : EXECUTOR_EXIT;
-					dprintf(outputs[_F_JOURNAL], "%s%d (%.3fs)\n",
-						exitline,
-						status, time);
+					output_printf(outputs, _F_JOURNAL,
+						      "%s%d (%.3fs)\n",
+						      exitline,
+						      status, time);
 					if (settings->sync) {
-						fdatasync(outputs[_F_JOURNAL]);
+						output_sync(outputs, _F_JOURNAL);
 					}
 				}
 
@@ -1458,9 +1539,9 @@ static int monitor_output(pid_t child,
 					asprintf(abortreason, "Child refuses to die, tainted 0x%lx.", taints);
 				}
 
-				dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+				dump_dmesg(kmsg, outputs);
 				if (settings->sync)
-					fdatasync(outputs[_F_DMESG]);
+					output_sync(outputs, _F_DMESG);
 
 				close_watchdogs(settings);
 				free(buf);
@@ -1468,7 +1549,6 @@ static int monitor_output(pid_t child,
 				close(outfd);
 				close(errfd);
 				close(socketfd);
-				close(kmsgfd);
 				return -1;
 			}
 
@@ -1484,16 +1564,15 @@ static int monitor_output(pid_t child,
 		}
 	}
 
-	dump_dmesg(kmsgfd, outputs[_F_DMESG]);
+	dump_dmesg(kmsg, outputs);
 	if (settings->sync)
-		fdatasync(outputs[_F_DMESG]);
+		output_sync(outputs, _F_DMESG);
 
 	free(buf);
 	free(outbuf);
 	close(outfd);
 	close(errfd);
 	close(socketfd);
-	close(kmsgfd);
 
 	if (aborting)
 		return -1;
@@ -1638,9 +1717,10 @@ static int execute_next_entry(struct execute_state *state,
 			      char **abortreason,
 			      bool *abort_already_written)
 {
-	int dirfd;
+	int dirfd = -1;
 	int outputs[_F_LAST];
-	int kmsgfd;
+	struct igt_kmsg kmsg;
+	struct resource_monitor resources;
 	int outpipe[2] = { -1, -1 };
 	int errpipe[2] = { -1, -1 };
 	int socket[2] = { -1, -1 };
@@ -1649,23 +1729,35 @@ static int execute_next_entry(struct execute_state *state,
 	pid_t child;
 	int result;
 	size_t idx = state->next;
+	int i;
 
-	snprintf(name, sizeof(name), "%zd", idx);
-	mkdirat(resdirfd, name, 0777);
-	if ((dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY | O_CLOEXEC)) < 0) {
-		errf("Error accessing individual test result directory\n");
-		return -1;
-	}
+	/* Unused with the result store, but closed all the same */
+	for (i = 0; i < _F_LAST; i++)
+		outputs[i] = -1;
 
-	if (!open_output_files(dirfd, outputs, true)) {
-		errf("Error opening output files\n");
-		result = -1;
-		goto out_dirfd;
-	}
+	if (result_store) {
+		if (!result_store_begin_job(result_store, idx)) {
+			errf("Error writing to the result store: %m\n");
+			return -1;
+		}
+	} else {
+		snprintf(name, sizeof(name), "%zd", idx);
+		mkdirat(resdirfd, name, 0777);
+		if ((dirfd = openat(resdirfd, name, O_DIRECTORY | O_RDONLY | O_CLOEXEC)) < 0) {
+			errf("Error accessing individual test result directory\n");
+			return -1;
+		}
 
-	if (settings->sync) {
-		fsync(dirfd);
-		fsync(resdirfd);
+		if (!open_output_files(dirfd, outputs, true)) {
+			errf("Error opening output files\n");
+			result = -1;
+			goto out_dirfd;
+		}
+
+		if (settings->sync) {
+			fsync(dirfd);
+			fsync(resdirfd);
+		}
 	}
 
 	if (pipe(outpipe) || pipe(errpipe)) {
@@ -1680,12 +1772,13 @@ static int execute_next_entry(struct execute_state *state,
 		goto out_pipe;
 	}
 
-	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0) {
+	/* TODO: Checking of abort conditions in pre-execute dmesg */
+	if (igt_kmsg_open(&kmsg))
 		errf("Warning: Cannot open /dev/kmsg\n");
-	} else {
-		/* TODO: Checking of abort conditions in pre-execute dmesg */
-		lseek(kmsgfd, 0, SEEK_END);
-	}
+
+	if (!resource_monitor_init(&resources, settings, idx))
+		errf("Warning: Cannot create a cgroup for the test in %s: %m\n",
+		     settings->cgroup);
 
 
 	if (settings->log_level >= LOG_LEVEL_NORMAL) {
@@ -1718,7 +1811,7 @@ static int execute_next_entry(struct execute_state *state,
 	if (child < 0) {
 		errf("Failed to fork: %m\n");
 		result = -1;
-		goto out_kmsgfd;
+		goto out_kmsg;
 	} else if (child == 0) {
 		char envstring[16];
 
@@ -1737,6 +1830,7 @@ static int execute_next_entry(struct execute_state *state,
 		}
 		setenv("IGT_SENTINEL_ON_STDERR", "1", 1);
 
+		resource_monitor_join(&resources);
 		execute_test_process(outfd, errfd, socketfd, settings, entry);
 		/* unreachable */
 	}
@@ -1749,13 +1843,15 @@ static int execute_next_entry(struct execute_state *state,
 	close(socket[1]);
 	outpipe[1] = errpipe[1] = socket[1] = -1;
 
+	resource_monitor_start(&resources, child);
 	result = monitor_output(child, outfd, errfd, socketfd,
-				kmsgfd, sigfd,
+				&kmsg, sigfd, &resources,
 				outputs, time_spent, settings,
 				abortreason, abort_already_written);
 
-out_kmsgfd:
-	close(kmsgfd);
+out_kmsg:
+	resource_monitor_fini(&resources);
+	igt_kmsg_fini(&kmsg);
 out_pipe:
 	close_outputs(outputs);
 	close(outpipe[0]);
@@ -1769,6 +1865,26 @@ out_dirfd:
 	return result;
 }
 
+static void fill_result_store_with_notruns(struct job_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->size; i++) {
+		if (result_store_has_job(result_store, i))
+			continue;
+
+		if (!result_store_begin_job(result_store, i)) {
+			errf("Error writing to the result store: %m\n");
+			return;
+		}
+
+		output_printf(NULL, _F_OUT, "Forced notrun result because of abort condition on bootup\n");
+		output_printf(NULL, _F_JOURNAL, "%s%d (0.000s)\n", EXECUTOR_EXIT, GRACEFUL_EXITCODE);
+	}
+
+	result_store_sync(result_store);
+}
+
 static void fill_results_directory_with_notruns(struct job_list *list,
 						int resdirfd)
 {
@@ -1777,6 +1893,11 @@ static void fill_results_directory_with_notruns(struct job_list *list,
 	int dirfd;
 	size_t i;
 
+	if (result_store) {
+		fill_result_store_with_notruns(list);
+		return;
+	}
+
 	for (i = 0; i < list->size; i++) {
 		snprintf(name, sizeof(name), "%zd", i);
 
@@ -1796,8 +1917,8 @@ static void fill_results_directory_with_notruns(struct job_list *list,
 			return;
 		}
 
-		dprintf(outputs[_F_OUT], "Forced notrun result because of abort condition on bootup\n");
-		dprintf(outputs[_F_JOURNAL], "%s%d (0.000s)\n", EXECUTOR_EXIT, GRACEFUL_EXITCODE);
+		output_printf(outputs, _F_OUT, "Forced notrun result because of abort condition on bootup\n");
+		output_printf(outputs, _F_JOURNAL, "%s%d (0.000s)\n", EXECUTOR_EXIT, GRACEFUL_EXITCODE);
 
 		close_outputs(outputs);
 		close(dirfd);
@@ -1843,6 +1964,7 @@ static bool clear_old_results(char *path)
 	}
 
 	if (remove_file(dirfd, "uname.txt") ||
+	    remove_file(dirfd, RESULT_STORE_FILENAME) ||
 	    remove_file(dirfd, "starttime.txt") ||
 	    remove_file(dirfd, "endtime.txt") ||
 	    remove_file(dirfd, "aborted.txt")) {
@@ -1918,13 +2040,85 @@ static void init_time_left(struct execute_state *state,
 		state->time_left = settings->overall_timeout;
 }
 
+/*
+ * Prunes the already started subtests of job i, the last one that was
+ * executed, from the job list, or skips it when it's done. Takes
+ * ownership of the fds of its comms and journal, which can be -1.
+ */
+static void resume_job(struct execute_state *state,
+		       struct job_list *list, size_t i,
+		       int commsfd, int journalfd)
+{
+	struct job_list_entry *entry = &list->entries[i];
+
+	state->next = i;
+
+	if (commsfd >= 0) {
+		if (!prune_from_comms(entry, commsfd)) {
+			/*
+			 * No subtests, or incomplete before the first
+			 * subtest. Not suitable to re-run.
+			 */
+			state->next = i + 1;
+		} else if (entry->binary[0] == '\0') {
+			/* Full completed */
+			state->next = i + 1;
+		}
+
+		close(commsfd);
+	}
+
+	if (journalfd >= 0) {
+		/* prune_from_journal() closes the fd */
+		if (!prune_from_journal(entry, journalfd)) {
+			/*
+			 * The test does not have subtests, or
+			 * incompleted before the first subtest
+			 * began. Either way, not suitable to
+			 * re-run.
+			 */
+			state->next = i + 1;
+		} else if (entry->binary[0] == '\0') {
+			/* This test is fully completed */
+			state->next = i + 1;
+		}
+	}
+}
+
+static bool resume_from_result_store(int dirfd,
+				     struct execute_state *state,
+				     struct job_list *list)
+{
+	struct result_store store;
+	size_t i;
+
+	if (!result_store_exists(dirfd))
+		/* Nothing has been executed yet, state is fine as is */
+		return true;
+
+	if (!result_store_open(&store, dirfd, false, false))
+		return false;
+
+	for (i = list->size; i > 0; i--) {
+		if (result_store_has_job(&store, i - 1))
+			break;
+	}
+
+	if (i > 0)
+		resume_job(state, list, i - 1,
+			   result_store_stream_fd(&store, i - 1, _F_SOCKET),
+			   result_store_stream_fd(&store, i - 1, _F_JOURNAL));
+
+	result_store_close(&store);
+	return true;
+}
+
 bool initialize_execute_state_from_resume(int dirfd,
 					  struct execute_state *state,
 					  struct settings *settings,
 					  struct job_list *list)
 {
-	struct job_list_entry *entry;
-	int resdirfd, fd, i;
+	int resdirfd, i;
 
 	clear_settings(settings);
 	free_job_list(list);
@@ -1944,6 +2138,17 @@ bool initialize_execute_state_from_resume(int dirfd,
 
 	init_time_left(state, settings);
 
+	if (settings->result_store) {
+		if (!resume_from_result_store(dirfd, state, list)) {
+			close(dirfd);
+			fprintf(stderr, "Failure reading the result store\n");
+			return false;
+		}
+
+		close(dirfd);
+		return true;
+	}
+
 	for (i = list->size; i >= 0; i--) {
 		char name[32];
 
@@ -1956,40 +2161,9 @@ bool initialize_execute_state_from_resume(int dirfd,
 		/* Nothing has been executed yet, state is fine as is */
 		goto success;
 
-	entry = &list->entries[i];
-	state->next = i;
-
-	if ((fd = openat(resdirfd, filenames[_F_SOCKET], O_RDONLY)) >= 0) {
-		if (!prune_from_comms(entry, fd)) {
-			/*
-			 * No subtests, or incomplete before the first
-			 * subtest. Not suitable to re-run.
-			 */
-			state->next = i + 1;
-		} else if (entry->binary[0] == '\0') {
-			/* Full completed */
-			state->next = i + 1;
-		}
-
-		close (fd);
-	}
-
-	if ((fd = openat(resdirfd, filenames[_F_JOURNAL], O_RDONLY)) >= 0) {
-		if (!prune_from_journal(entry, fd)) {
-			/*
-			 * The test does not have subtests, or
-			 * incompleted before the first subtest
-			 * began. Either way, not suitable to
-			 * re-run.
-			 */
-			state->next = i + 1;
-		} else if (entry->binary[0] == '\0') {
-			/* This test is fully completed */
-			state->next = i + 1;
-		}
-
-		close(fd);
-	}
+	resume_job(state, list, i,
+		   openat(resdirfd, filenames[_F_SOCKET], O_RDONLY),
+		   openat(resdirfd, filenames[_F_JOURNAL], O_RDONLY));
 
  success:
 	close(resdirfd);
@@ -2250,6 +2424,50 @@ static void code_coverage_stop(struct settings *settings, const char *job_name,
 	run_as_root(argv, sigfd, abortreason);
 }
 
+static bool open_result_store(int resdirfd, struct settings *settings)
+{
+	result_store = malloc(sizeof(*result_store));
+	if (!result_store)
+		return false;
+
+	if (!result_store_open(result_store, resdirfd, true, settings->sync)) {
+		free(result_store);
+		result_store = NULL;
+		return false;
+	}
+
+	if (result_store->discarded)
+		errf("Warning: Dropped %"PRIu64" bytes of a partially written record from the result store\n",
+		     result_store->discarded);
+
+	return true;
+}
+
+static void close_result_store(void)
+{
+	if (!result_store)
+		return;
+
+	result_store_sync(result_store);
+	result_store_close(result_store);
+	free(result_store);
+	result_store = NULL;
+}
+
+/* Whether the test stored in the result store used socket comms */
+static bool result_store_comms_valid(size_t testidx)
+{
+	struct comms_visitor emptyvisitor = {};
+	int commsfd;
+	bool valid;
+
+	commsfd = result_store_stream_fd(result_store, testidx, _F_SOCKET);
+	valid = comms_read_dump(commsfd, &emptyvisitor) == COMMSPARSE_SUCCESS;
+	close(commsfd);
+
+	return valid;
+}
+
 /* Open the comms file if the test used socket comms */
 static int open_comms_if_valid(int resdirfd, size_t testidx)
 {
@@ -2348,6 +2566,13 @@ bool execute(struct execute_state *state,
 		close(timefd);
 	}
 
+	if (settings->result_store && !open_result_store(resdirfd, settings)) {
+		errf("Error: Failure opening the result store: %m\n");
+		close(testdirfd);
+		close(resdirfd);
+		return false;
+	}
+
 	oom_immortal();
 
 	sigemptyset(&sigmask);
@@ -2450,16 +2675,32 @@ bool execute(struct execute_state *state,
 				      strdup("nothing"));
 
 			if (!already_written) {
-				int commsfd;
+				int commsfd = -1;
+				bool comms;
+
+				/*
+				 * With the result store, packets go to the
+				 * store instead of commsfd. The reason may
+				 * come from before the job was started, so
+				 * direct them to it explicitly.
+				 */
+				if (result_store) {
+					comms = result_store_comms_valid(state->next) &&
+						result_store_begin_job(result_store, state->next);
+				} else {
+					commsfd = open_comms_if_valid(resdirfd, state->next);
+					comms = commsfd >= 0;
+				}
 
-				commsfd = open_comms_if_valid(resdirfd, state->next);
-				if (commsfd >= 0) {
-					lseek(commsfd, 0, SEEK_END);
+				if (comms) {
+					if (!result_store)
+						lseek(commsfd, 0, SEEK_END);
 					write_packet_with_canary(commsfd, runnerpacket_log(STDOUT_FILENO, "\nThis test caused an abort condition: "), false);
 					write_packet_with_canary(commsfd, runnerpacket_log(STDOUT_FILENO, reason), false);
 					write_packet_with_canary(commsfd, runnerpacket_resultoverride("abort"), settings->sync);
 
-					close(commsfd);
+					if (!result_store)
+						close(commsfd);
 				} else {
 					write_abort_file(resdirfd, reason, prev, next);
 				}
@@ -2499,6 +2740,7 @@ bool execute(struct execute_state *state,
 			}
 			close(sigfd);
 			close(testdirfd);
+			close_result_store();
 			if (!initialize_execute_state_from_resume(resdirfd, state, settings, job_list))
 				return false;
 			state->time_left = time_left;
@@ -2529,6 +2771,7 @@ bool execute(struct execute_state *state,
 	if (should_die_because_signal(sigfd))
 		status = false;
  end_post_signal_restore:
+	close_result_store();
 	close(sigfd);
 	close(testdirfd);
 	close(resdirfd);
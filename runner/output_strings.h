@@ -79,4 +79,22 @@ static const char EXECUTOR_EXIT[] = "exit:";
  */
 static const char EXECUTOR_TIMEOUT[] = "timeout:";
 
+/*
+ * Output by the executor in resources.txt when a subtest has ended.
+ * Is followed by the subtest name and its resource usage.
+ *
+ * Example:
+ * subtest subtestname cpu-user=0.120 cpu-system=0.030 max-rss=10240 io-read=0 io-write=4096
+ */
+static const char RESOURCES_SUBTEST[] = "subtest ";
+
+/*
+ * Output by the executor in resources.txt when the test process has
+ * exited. Is followed by the resource usage of the whole test.
+ *
+ * Example:
+ * exit cpu-user=0.250 cpu-system=0.040 max-rss=10240 io-read=0 io-write=4096 gpu-render=1500000
+ */
+static const char RESOURCES_EXIT[] = "exit ";
+
 #endif
@@ -0,0 +1,537 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_drm_fdinfo.h"
+#include "resources.h"
+
+struct resource_client {
+	char pdev[128];
+	unsigned long id;
+	uint64_t busy[RESOURCE_MAX_ENGINES];
+};
+
+static ssize_t read_file_at(int dirfd, const char *name, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+
+	buf[len] = '\0';
+	return len;
+}
+
+static bool write_file_at(int dirfd, const char *name, const char *str)
+{
+	bool ok;
+	int fd;
+
+	fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	ok = write(fd, str, strlen(str)) == strlen(str);
+	close(fd);
+
+	return ok;
+}
+
+/* Finds the value of key in "key value" or "key: value" lines */
+static bool find_value(const char *buf, const char *key, uint64_t *value)
+{
+	size_t len = strlen(key);
+	const char *p = buf;
+
+	while ((p = strstr(p, key)) != NULL) {
+		if ((p == buf || p[-1] == '\n') &&
+		    (p[len] == ' ' || p[len] == ':' || p[len] == '\t')) {
+			p += len + 1;
+			while (*p == ' ' || *p == '\t')
+				p++;
+			*value = strtoull(p, NULL, 10);
+			return true;
+		}
+		p += len;
+	}
+
+	return false;
+}
+
+/* Sums the values of key=value pairs, as found in io.stat */
+static uint64_t sum_values(const char *buf, const char *key)
+{
+	size_t len = strlen(key);
+	const char *p = buf;
+	uint64_t sum = 0;
+
+	while ((p = strstr(p, key)) != NULL) {
+		if (p > buf && p[-1] == ' ' && p[len] == '=')
+			sum += strtoull(p + len + 1, NULL, 10);
+		p += len;
+	}
+
+	return sum;
+}
+
+/* Samples the test process and the children it waited for from procfs */
+static void sample_process(struct resource_monitor *monitor,
+			   struct resource_usage *usage)
+{
+	unsigned long long utime, stime;
+	long long cutime, cstime;
+	long ticks = sysconf(_SC_CLK_TCK);
+	uint64_t value;
+	char buf[4096];
+	char *p;
+
+	if (monitor->procfd < 0)
+		return;
+
+	if (read_file_at(monitor->procfd, "stat", buf, sizeof(buf)) > 0 &&
+	    (p = strrchr(buf, ')')) != NULL &&
+	    sscanf(p + 1,
+		   " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld",
+		   &utime, &stime, &cutime, &cstime) == 4 &&
+	    ticks > 0) {
+		usage->cpu_user = (double)(utime + cutime) / ticks;
+		usage->cpu_system = (double)(stime + cstime) / ticks;
+	}
+
+	if (read_file_at(monitor->procfd, "status", buf, sizeof(buf)) > 0 &&
+	    find_value(buf, "VmHWM", &value))
+		usage->max_rss = value;
+
+	if (read_file_at(monitor->procfd, "io", buf, sizeof(buf)) > 0) {
+		if (find_value(buf, "read_bytes", &value))
+			usage->io_read = value;
+		if (find_value(buf, "write_bytes", &value))
+			usage->io_write = value;
+	}
+}
+
+/* Samples all processes of the test cgroup, setting only what's available */
+static void sample_cgroup(struct resource_monitor *monitor,
+			  struct resource_usage *usage)
+{
+	uint64_t value;
+	char buf[4096];
+
+	if (read_file_at(monitor->cgroupfd, "cpu.stat", buf, sizeof(buf)) > 0) {
+		if (find_value(buf, "user_usec", &value))
+			usage->cpu_user = value / 1e6;
+		if (find_value(buf, "system_usec", &value))
+			usage->cpu_system = value / 1e6;
+	}
+
+	if (read_file_at(monitor->cgroupfd, "memory.peak", buf, sizeof(buf)) > 0)
+		usage->max_rss = strtoull(buf, NULL, 10) / 1024;
+
+	if (read_file_at(monitor->cgroupfd, "io.stat", buf, sizeof(buf)) >= 0) {
+		usage->io_read = sum_values(buf, "rbytes");
+		usage->io_write = sum_values(buf, "wbytes");
+	}
+}
+
+static int find_engine(struct resource_usage *usage, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < usage->engine_count; i++) {
+		if (!strcmp(usage->engines[i], name))
+			return i;
+	}
+
+	if (usage->engine_count == RESOURCE_MAX_ENGINES)
+		return -1;
+
+	snprintf(usage->engines[i], sizeof(usage->engines[i]), "%s", name);
+	usage->gpu_busy[i] = 0;
+	usage->engine_count++;
+
+	return i;
+}
+
+static struct resource_client *
+find_client(struct resource_monitor *monitor,
+	    const struct drm_client_fdinfo *info)
+{
+	struct resource_client *client;
+	size_t i;
+
+	for (i = 0; i < monitor->client_count; i++) {
+		client = &monitor->clients[i];
+		if (client->id == info->id && !strcmp(client->pdev, info->pdev))
+			return client;
+	}
+
+	client = realloc(monitor->clients,
+			 (monitor->client_count + 1) * sizeof(*client));
+	if (!client)
+		return NULL;
+	monitor->clients = client;
+
+	client = &monitor->clients[monitor->client_count++];
+	memset(client, 0, sizeof(*client));
+	snprintf(client->pdev, sizeof(client->pdev), "%s", info->pdev);
+	client->id = info->id;
+
+	return client;
+}
+
+static void update_client(struct resource_monitor *monitor,
+			  const struct drm_client_fdinfo *info)
+{
+	struct resource_client *client = find_client(monitor, info);
+	unsigned int i;
+
+	if (!client)
+		return;
+
+	for (i = 0; i <= info->last_engine_index; i++) {
+		int engine;
+
+		if (!info->capacity[i])
+			continue;
+
+		engine = find_engine(&monitor->gpu, info->names[i]);
+		if (engine < 0)
+			continue;
+
+		/* The same client can be seen through several fds */
+		if (info->busy[i] > client->busy[engine]) {
+			monitor->gpu.gpu_busy[engine] +=
+				info->busy[i] - client->busy[engine];
+			client->busy[engine] = info->busy[i];
+		}
+	}
+}
+
+static void scan_process(struct resource_monitor *monitor, const char *pid,
+			 struct drm_client_fdinfo *info)
+{
+	struct dirent *dirent;
+	char path[64];
+	DIR *dir;
+	int dirfd;
+
+	snprintf(path, sizeof(path), "/proc/%s/fdinfo", pid);
+	dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0)
+		return;
+
+	dir = fdopendir(dirfd);
+	if (!dir) {
+		close(dirfd);
+		return;
+	}
+
+	while ((dirent = readdir(dir)) != NULL) {
+		if (dirent->d_name[0] == '.')
+			continue;
+
+		memset(info, 0, sizeof(*info));
+		if (__igt_parse_drm_fdinfo(dirfd, dirent->d_name, info,
+					   NULL, 0, NULL, 0))
+			update_client(monitor, info);
+	}
+
+	closedir(dir);
+}
+
+static void sample_gpu(struct resource_monitor *monitor)
+{
+	struct drm_client_fdinfo *info;
+	char pid[16];
+
+	if (!monitor->gpu_stats || monitor->pid <= 0)
+		return;
+
+	info = malloc(sizeof(*info));
+	if (!info)
+		return;
+
+	if (monitor->cgroupfd >= 0) {
+		FILE *f;
+		int fd;
+
+		fd = openat(monitor->cgroupfd, "cgroup.procs",
+			    O_RDONLY | O_CLOEXEC);
+		f = fd >= 0 ? fdopen(fd, "r") : NULL;
+		if (f) {
+			while (fscanf(f, "%15s", pid) == 1)
+				scan_process(monitor, pid, info);
+			fclose(f);
+		} else if (fd >= 0) {
+			close(fd);
+		}
+	} else {
+		snprintf(pid, sizeof(pid), "%d", monitor->pid);
+		scan_process(monitor, pid, info);
+	}
+
+	free(info);
+	igt_gettime(&monitor->last_poll);
+}
+
+static void copy_gpu_usage(const struct resource_monitor *monitor,
+			   struct resource_usage *usage)
+{
+	usage->engine_count = monitor->gpu.engine_count;
+	memcpy(usage->engines, monitor->gpu.engines, sizeof(usage->engines));
+	memcpy(usage->gpu_busy, monitor->gpu.gpu_busy, sizeof(usage->gpu_busy));
+}
+
+static void sample(struct resource_monitor *monitor,
+		   struct resource_usage *usage)
+{
+	memset(usage, 0, sizeof(*usage));
+
+	if (monitor->cgroupfd >= 0)
+		sample_cgroup(monitor, usage);
+	else
+		sample_process(monitor, usage);
+
+	sample_gpu(monitor);
+	copy_gpu_usage(monitor, usage);
+}
+
+bool resource_monitor_init(struct resource_monitor *monitor,
+			   const struct settings *settings, size_t job)
+{
+	int parentfd;
+
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->procfd = -1;
+	monitor->cgroupfd = -1;
+	monitor->gpu_stats = settings->gpu_stats;
+
+	if (!settings->cgroup)
+		return true;
+
+	parentfd = open(settings->cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (parentfd < 0)
+		return false;
+
+	/*
+	 * cpu.stat is always there, memory and io stats need their
+	 * controllers enabled for the children. That fails if they're
+	 * not available, which leaves those figures at zero.
+	 */
+	write_file_at(parentfd, "cgroup.subtree_control", "+memory");
+	write_file_at(parentfd, "cgroup.subtree_control", "+io");
+
+	if (asprintf(&monitor->cgroup, "%s/igt-runner-%d-%zd",
+		     settings->cgroup, getpid(), job) < 0) {
+		monitor->cgroup = NULL;
+		close(parentfd);
+		return false;
+	}
+
+	if (mkdir(monitor->cgroup, 0755) && errno != EEXIST) {
+		free(monitor->cgroup);
+		monitor->cgroup = NULL;
+		close(parentfd);
+		return false;
+	}
+	close(parentfd);
+
+	monitor->cgroupfd = open(monitor->cgroup,
+				 O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (monitor->cgroupfd < 0) {
+		rmdir(monitor->cgroup);
+		free(monitor->cgroup);
+		monitor->cgroup = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void resource_monitor_fini(struct resource_monitor *monitor)
+{
+	if (monitor->procfd >= 0)
+		close(monitor->procfd);
+	if (monitor->cgroupfd >= 0)
+		close(monitor->cgroupfd);
+
+	/* Fails if something the test started is still running */
+	if (monitor->cgroup)
+		rmdir(monitor->cgroup);
+
+	free(monitor->cgroup);
+	free(monitor->clients);
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->procfd = -1;
+	monitor->cgroupfd = -1;
+}
+
+void resource_monitor_join(struct resource_monitor *monitor)
+{
+	if (monitor->cgroupfd >= 0)
+		write_file_at(monitor->cgroupfd, "cgroup.procs", "0");
+}
+
+void resource_monitor_start(struct resource_monitor *monitor, pid_t pid)
+{
+	char path[32];
+
+	monitor->pid = pid;
+	snprintf(path, sizeof(path), "/proc/%d", pid);
+	monitor->procfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	igt_gettime(&monitor->last_poll);
+}
+
+void resource_monitor_poll(struct resource_monitor *monitor)
+{
+	struct timespec now;
+
+	if (!monitor->gpu_stats)
+		return;
+
+	igt_gettime(&now);
+	if (igt_time_elapsed(&monitor->last_poll, &now) >= 1.0)
+		sample_gpu(monitor);
+}
+
+void resource_monitor_begin_subtest(struct resource_monitor *monitor)
+{
+	if (monitor->in_subtest)
+		return;
+
+	sample(monitor, &monitor->start);
+	monitor->in_subtest = true;
+}
+
+bool resource_monitor_end_subtest(struct resource_monitor *monitor,
+				  struct resource_usage *usage)
+{
+	const struct resource_usage *start = &monitor->start;
+	unsigned int i;
+
+	if (!monitor->in_subtest)
+		return false;
+
+	monitor->in_subtest = false;
+	sample(monitor, usage);
+
+	usage->cpu_user -= start->cpu_user;
+	usage->cpu_system -= start->cpu_system;
+	if (usage->io_read >= start->io_read)
+		usage->io_read -= start->io_read;
+	if (usage->io_write >= start->io_write)
+		usage->io_write -= start->io_write;
+
+	/* Engines only ever get added, at the end of the list */
+	for (i = 0; i < start->engine_count; i++)
+		usage->gpu_busy[i] -= start->gpu_busy[i];
+
+	return true;
+}
+
+void resource_monitor_exit(struct resource_monitor *monitor,
+			   const struct rusage *ru,
+			   struct resource_usage *usage)
+{
+	memset(usage, 0, sizeof(*usage));
+
+	usage->cpu_user = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+	usage->cpu_system = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+	usage->max_rss = ru->ru_maxrss;
+	usage->io_read = (uint64_t)ru->ru_inblock * 512;
+	usage->io_write = (uint64_t)ru->ru_oublock * 512;
+
+	if (monitor->cgroupfd >= 0)
+		sample_cgroup(monitor, usage);
+
+	/* The fdinfo of the test is gone by now, use the last sample */
+	copy_gpu_usage(monitor, usage);
+	monitor->in_subtest = false;
+}
+
+int resource_usage_format(const struct resource_usage *usage,
+			  char *buf, size_t size)
+{
+	unsigned int i;
+	int len;
+
+	len = snprintf(buf, size,
+		       "cpu-user=%.3f cpu-system=%.3f max-rss=%"PRIu64
+		       " io-read=%"PRIu64" io-write=%"PRIu64,
+		       usage->cpu_user, usage->cpu_system, usage->max_rss,
+		       usage->io_read, usage->io_write);
+
+	for (i = 0; i < usage->engine_count; i++)
+		len += snprintf(buf + len, size > len ? size - len : 0,
+				" gpu-%s=%"PRIu64,
+				usage->engines[i], usage->gpu_busy[i]);
+
+	return len;
+}
+
+bool resource_usage_parse(const char *str, struct resource_usage *usage)
+{
+	bool found = false;
+
+	memset(usage, 0, sizeof(*usage));
+
+	while (*str && *str != '\n') {
+		const char *eq, *end;
+		size_t keylen;
+
+		while (*str == ' ')
+			str++;
+
+		end = str + strcspn(str, " \n");
+		eq = memchr(str, '=', end - str);
+		if (!eq) {
+			str = end;
+			continue;
+		}
+		keylen = eq - str;
+
+#define KEY_IS(k) (keylen == strlen(k) && !memcmp(str, k, keylen))
+		if (KEY_IS("cpu-user")) {
+			usage->cpu_user = strtod(eq + 1, NULL);
+		} else if (KEY_IS("cpu-system")) {
+			usage->cpu_system = strtod(eq + 1, NULL);
+		} else if (KEY_IS("max-rss")) {
+			usage->max_rss = strtoull(eq + 1, NULL, 10);
+		} else if (KEY_IS("io-read")) {
+			usage->io_read = strtoull(eq + 1, NULL, 10);
+		} else if (KEY_IS("io-write")) {
+			usage->io_write = strtoull(eq + 1, NULL, 10);
+		} else if (keylen > 4 && !memcmp(str, "gpu-", 4) &&
+			   keylen - 4 < sizeof(usage->engines[0]) &&
+			   usage->engine_count < RESOURCE_MAX_ENGINES) {
+			unsigned int i = usage->engine_count++;
+
+			memcpy(usage->engines[i], str + 4, keylen - 4);
+			usage->engines[i][keylen - 4] = '\0';
+			usage->gpu_busy[i] = strtoull(eq + 1, NULL, 10);
+		} else {
+			str = end;
+			continue;
+		}
+#undef KEY_IS
+
+		found = true;
+		str = end;
+	}
+
+	return found;
+}
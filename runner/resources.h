@@ -0,0 +1,114 @@
+#ifndef RUNNER_RESOURCES_H
+#define RUNNER_RESOURCES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "settings.h"
+
+/*
+ * Resource accounting of test processes.
+ *
+ * The executor samples the resources used by a test when each of its
+ * subtests starts and ends, and takes the totals from wait4() when the
+ * test exits, or from a cgroup of its own with --cgroup. They end up in
+ * the resources.txt stream of the test, one line each:
+ *
+ *   subtest <name> <usage>
+ *   exit <usage>
+ *
+ * where <usage> is written by resource_usage_format().
+ */
+
+#define RESOURCE_MAX_ENGINES 16
+
+struct resource_usage {
+	/* CPU time in seconds */
+	double cpu_user;
+	double cpu_system;
+	/* Peak resident set size in KiB */
+	uint64_t max_rss;
+	/* Bytes read from and written to storage */
+	uint64_t io_read;
+	uint64_t io_write;
+	/* Busy time of each GPU engine class in ns, with --gpu-stats */
+	unsigned int engine_count;
+	char engines[RESOURCE_MAX_ENGINES][32];
+	uint64_t gpu_busy[RESOURCE_MAX_ENGINES];
+};
+
+struct resource_client;
+
+struct resource_monitor {
+	pid_t pid;
+	/* /proc/<pid> of the test */
+	int procfd;
+	/* The cgroup of the test, or -1 */
+	int cgroupfd;
+	char *cgroup;
+	bool gpu_stats;
+	bool in_subtest;
+	struct resource_usage start;
+	/*
+	 * GPU busyness summed over the DRM clients of the test, only the
+	 * engine fields are used. Clients are remembered with their last
+	 * busyness seen, so that closing one doesn't lose its usage.
+	 */
+	struct resource_usage gpu;
+	struct resource_client *clients;
+	size_t client_count;
+	struct timespec last_poll;
+};
+
+/*
+ * Prepares to monitor the test of job. With settings->cgroup a child
+ * cgroup is created for it, which fails if the cgroup doesn't exist or
+ * isn't writable. The monitor is usable without the cgroup even then.
+ */
+bool resource_monitor_init(struct resource_monitor *monitor,
+			   const struct settings *settings, size_t job);
+/* Frees the monitor, removing the cgroup of the test */
+void resource_monitor_fini(struct resource_monitor *monitor);
+
+/* Moves the calling process to the cgroup of the test, in the child */
+void resource_monitor_join(struct resource_monitor *monitor);
+
+/* Starts monitoring the test process pid */
+void resource_monitor_start(struct resource_monitor *monitor, pid_t pid);
+
+/* Samples the GPU usage of the test, at most once a second */
+void resource_monitor_poll(struct resource_monitor *monitor);
+
+/*
+ * Marks the start and end of a subtest. Starting a subtest when one is
+ * already running is ignored, and ending one returns false if none was.
+ * The usage of the subtest is the difference of the samples taken,
+ * except for max_rss, which is the peak of the test so far.
+ */
+void resource_monitor_begin_subtest(struct resource_monitor *monitor);
+bool resource_monitor_end_subtest(struct resource_monitor *monitor,
+				  struct resource_usage *usage);
+
+/*
+ * Gets the total usage of the test after it was reaped, ru being what
+ * wait4() returned.
+ */
+void resource_monitor_exit(struct resource_monitor *monitor,
+			   const struct rusage *ru,
+			   struct resource_usage *usage);
+
+/*
+ * Formats usage as space separated key=value pairs, with the same
+ * keys the usage has in results.json. Returns the length like
+ * snprintf().
+ */
+int resource_usage_format(const struct resource_usage *usage,
+			  char *buf, size_t size);
+/* Parses a line formatted with resource_usage_format() */
+bool resource_usage_parse(const char *str, struct resource_usage *usage);
+
+#endif
@@ -0,0 +1,619 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "result_store.h"
+
+#define RESULT_STORE_MAGIC "igt-rslt"
+#define RESULT_STORE_VERSION 1
+#define RECORD_MAGIC 0x52535452 /* "RTSR" */
+
+/* Space is reserved for the store this much at a time */
+#define RESERVE_CHUNK (1 << 20)
+
+struct file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct record_header {
+	uint32_t magic;
+	/* crc32 of the header, with crc 0, followed by the data */
+	uint32_t crc;
+	uint32_t job;
+	uint32_t subtest;
+	uint16_t stream;
+	uint16_t reserved;
+	uint32_t size;
+} __attribute__((packed));
+
+static uint32_t record_crc(const struct record_header *header,
+			   const void *data)
+{
+	struct record_header h = *header;
+	uLong crc;
+
+	h.crc = 0;
+	crc = crc32(0, (const Bytef *)&h, sizeof(h));
+	if (header->size) /* crc32() of a NULL buffer is 0, not crc */
+		crc = crc32(crc, data, header->size);
+
+	return crc;
+}
+
+static struct result_store_job *get_job(struct result_store *store, size_t job)
+{
+	if (job >= store->job_count) {
+		size_t count = store->job_count ? store->job_count : 64;
+		struct result_store_job *jobs;
+
+		while (count <= job)
+			count *= 2;
+
+		jobs = realloc(store->jobs, count * sizeof(*jobs));
+		if (!jobs)
+			return NULL;
+
+		memset(jobs + store->job_count, 0,
+		       (count - store->job_count) * sizeof(*jobs));
+		store->jobs = jobs;
+		store->job_count = count;
+	}
+
+	return &store->jobs[job];
+}
+
+static bool index_record(struct result_store *store,
+			 const struct record_header *header,
+			 uint64_t offset, const char *data)
+{
+	struct result_store_job *job = get_job(store, header->job);
+	struct result_store_record *record;
+
+	if (!job)
+		return false;
+
+	switch (header->stream) {
+	case RESULT_STORE_BEGIN_JOB:
+		job->started = true;
+		return true;
+	case RESULT_STORE_BEGIN_SUBTEST: {
+		char **subtests;
+
+		subtests = realloc(job->subtests,
+				   (job->subtest_count + 1) * sizeof(*subtests));
+		if (!subtests)
+			return false;
+
+		job->subtests = subtests;
+		job->subtests[job->subtest_count] = strndup(data, header->size);
+		if (!job->subtests[job->subtest_count])
+			return false;
+		job->subtest_count++;
+		return true;
+	}
+	default:
+		if (header->stream >= _F_LAST)
+			return true;
+		break;
+	}
+
+	if (job->record_count == job->allocated) {
+		size_t count = job->allocated ? 2 * job->allocated : 16;
+
+		record = realloc(job->records, count * sizeof(*record));
+		if (!record)
+			return false;
+
+		job->records = record;
+		job->allocated = count;
+	}
+
+	record = &job->records[job->record_count++];
+	record->offset = offset;
+	record->size = header->size;
+	record->subtest = header->subtest;
+	record->stream = header->stream;
+
+	if (header->size)
+		job->last[header->stream] = data[header->size - 1];
+
+	return true;
+}
+
+/* Indexes the intact records, returns the offset past the last one */
+static uint64_t scan_records(struct result_store *store, uint64_t size)
+{
+	uint64_t offset = sizeof(struct file_header);
+	char *map;
+
+	if (size <= offset)
+		return offset;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, store->fd, 0);
+	if (map == MAP_FAILED)
+		return offset;
+
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	while (size - offset >= sizeof(struct record_header)) {
+		struct record_header header;
+		const char *data;
+
+		memcpy(&header, map + offset, sizeof(header));
+		data = map + offset + sizeof(header);
+
+		if (header.magic != RECORD_MAGIC ||
+		    header.size > size - offset - sizeof(header) ||
+		    header.crc != record_crc(&header, data))
+			break;
+
+		if (!index_record(store, &header, offset + sizeof(header), data))
+			break;
+
+		offset += sizeof(header) + header.size;
+	}
+
+	munmap(map, size);
+	return offset;
+}
+
+bool result_store_exists(int dirfd)
+{
+	return faccessat(dirfd, RESULT_STORE_FILENAME, F_OK, 0) == 0;
+}
+
+bool result_store_open(struct result_store *store, int dirfd,
+		       bool write, bool sync)
+{
+	struct file_header header = {
+		.magic = RESULT_STORE_MAGIC,
+		.version = RESULT_STORE_VERSION,
+	};
+	struct file_header old;
+	struct stat st;
+
+	memset(store, 0, sizeof(*store));
+	store->write = write;
+	store->sync = sync;
+
+	store->fd = openat(dirfd, RESULT_STORE_FILENAME,
+			   write ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC,
+			   0666);
+	if (store->fd < 0)
+		return false;
+
+	if (fstat(store->fd, &st))
+		goto err;
+
+	if (pread(store->fd, &old, sizeof(old), 0) == sizeof(old)) {
+		if (memcmp(old.magic, header.magic, sizeof(header.magic)) ||
+		    old.version != RESULT_STORE_VERSION) {
+			fprintf(stderr, "%s: Not a result store, or an unsupported version\n",
+				RESULT_STORE_FILENAME);
+			goto err;
+		}
+	} else if (!write ||
+		   pwrite(store->fd, &header, sizeof(header), 0) != sizeof(header)) {
+		goto err;
+	} else {
+		st.st_size = sizeof(header);
+	}
+
+	store->end = scan_records(store, st.st_size);
+	store->discarded = st.st_size - store->end;
+	store->reserved = store->end;
+
+	if (write && store->discarded &&
+	    ftruncate(store->fd, store->end))
+		goto err;
+
+	return true;
+
+err:
+	result_store_close(store);
+	return false;
+}
+
+void result_store_close(struct result_store *store)
+{
+	size_t i, k;
+
+	for (i = 0; i < store->job_count; i++) {
+		struct result_store_job *job = &store->jobs[i];
+
+		for (k = 0; k < job->subtest_count; k++)
+			free(job->subtests[k]);
+		free(job->subtests);
+		free(job->records);
+	}
+	free(store->jobs);
+
+	if (store->fd >= 0)
+		close(store->fd);
+
+	memset(store, 0, sizeof(*store));
+	store->fd = -1;
+}
+
+static void reserve(struct result_store *store, uint64_t size)
+{
+	uint64_t end = store->end + size;
+	uint64_t len;
+
+	if (end <= store->reserved)
+		return;
+
+	len = (end - store->reserved + RESERVE_CHUNK - 1) & ~(uint64_t)(RESERVE_CHUNK - 1);
+
+	/*
+	 * Keep the size, the end of the file is the end of the
+	 * records. Not every filesystem supports this, in which case
+	 * the file grows on every write as it did without the store.
+	 */
+	if (fallocate(store->fd, FALLOC_FL_KEEP_SIZE, store->reserved, len) == 0)
+		store->reserved += len;
+	else
+		store->reserved = UINT64_MAX;
+}
+
+static bool append_record(struct result_store *store, int stream,
+			  const void *data, size_t size)
+{
+	struct record_header header = {
+		.magic = RECORD_MAGIC,
+		.job = store->current,
+		.stream = stream,
+		.size = size,
+	};
+	struct iovec iov[2] = {
+		{ .iov_base = &header, .iov_len = sizeof(header) },
+		{ .iov_base = (void *)data, .iov_len = size },
+	};
+	ssize_t ret;
+
+	if (!store->write || size > UINT32_MAX)
+		return false;
+
+	header.subtest = store->jobs[store->current].subtest_count;
+	if (stream == RESULT_STORE_BEGIN_SUBTEST)
+		header.subtest++;
+	header.crc = record_crc(&header, data);
+
+	reserve(store, sizeof(header) + size);
+
+	ret = pwritev(store->fd, iov, 2, store->end);
+	if (ret != sizeof(header) + size) {
+		/* Don't leave a torn record for the next one to follow */
+		if (ret > 0 && ftruncate(store->fd, store->end))
+			fprintf(stderr, "%s: Cannot drop a partial record: %m\n",
+				RESULT_STORE_FILENAME);
+		return false;
+	}
+
+	if (!index_record(store, &header, store->end + sizeof(header), data))
+		return false;
+
+	store->end += ret;
+	return true;
+}
+
+bool result_store_begin_job(struct result_store *store, size_t job)
+{
+	struct result_store_job *j = get_job(store, job);
+	int i;
+
+	if (!j)
+		return false;
+
+	store->current = job;
+
+	for (i = 0; i < _F_LAST; i++) {
+		if (i == _F_SOCKET)
+			continue;
+
+		if (j->last[i] && j->last[i] != '\n' &&
+		    !result_store_write(store, i, "\n", 1))
+			return false;
+	}
+
+	if (!append_record(store, RESULT_STORE_BEGIN_JOB, NULL, 0))
+		return false;
+
+	if (store->sync)
+		result_store_sync(store);
+
+	return true;
+}
+
+bool result_store_begin_subtest(struct result_store *store, const char *name)
+{
+	struct result_store_job *job = &store->jobs[store->current];
+	size_t len = strlen(name);
+
+	while (len && name[len - 1] == '\n')
+		len--;
+
+	if (job->subtest_count &&
+	    strlen(job->subtests[job->subtest_count - 1]) == len &&
+	    !memcmp(job->subtests[job->subtest_count - 1], name, len))
+		return true;
+
+	if (!append_record(store, RESULT_STORE_BEGIN_SUBTEST, name, len))
+		return false;
+
+	if (store->sync)
+		result_store_sync(store);
+
+	return true;
+}
+
+bool result_store_write(struct result_store *store, int stream,
+			const void *data, size_t size)
+{
+	if (!size)
+		return true;
+
+	return append_record(store, stream, data, size);
+}
+
+void result_store_sync(struct result_store *store)
+{
+	fdatasync(store->fd);
+}
+
+bool result_store_has_job(const struct result_store *store, size_t job)
+{
+	return job < store->job_count && store->jobs[job].started;
+}
+
+int result_store_find_subtest(const struct result_store *store,
+			      size_t job, const char *name)
+{
+	const struct result_store_job *j;
+	size_t i;
+
+	if (job >= store->job_count)
+		return -1;
+
+	j = &store->jobs[job];
+	for (i = j->subtest_count; i > 0; i--) {
+		if (!strcmp(j->subtests[i - 1], name))
+			return i;
+	}
+
+	return -1;
+}
+
+static bool record_matches(const struct result_store_record *record,
+			   int stream, int subtest)
+{
+	return record->stream == stream &&
+		(subtest < 0 || record->subtest == subtest);
+}
+
+ssize_t result_store_read(const struct result_store *store, size_t job,
+			  int stream, int subtest, char **data)
+{
+	const struct result_store_job *j;
+	size_t i, size = 0;
+	char *buf, *p;
+
+	*data = NULL;
+
+	if (job >= store->job_count)
+		return 0;
+
+	j = &store->jobs[job];
+	for (i = 0; i < j->record_count; i++) {
+		if (record_matches(&j->records[i], stream, subtest))
+			size += j->records[i].size;
+	}
+
+	if (!size)
+		return 0;
+
+	buf = p = malloc(size);
+	if (!buf)
+		return -1;
+
+	for (i = 0; i < j->record_count; i++) {
+		const struct result_store_record *record = &j->records[i];
+
+		if (!record_matches(record, stream, subtest))
+			continue;
+
+		if (pread(store->fd, p, record->size, record->offset) != record->size) {
+			free(buf);
+			return -1;
+		}
+		p += record->size;
+	}
+
+	*data = buf;
+	return size;
+}
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+	while (size) {
+		ssize_t ret = write(fd, data, size);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		data += ret;
+		size -= ret;
+	}
+
+	return true;
+}
+
+int result_store_stream_fd(const struct result_store *store, size_t job,
+			   int stream)
+{
+	static const char *names[_F_LAST] = {
+		[_F_JOURNAL] = "journal.txt",
+		[_F_OUT] = "out.txt",
+		[_F_ERR] = "err.txt",
+		[_F_DMESG] = "dmesg.txt",
+		[_F_SOCKET] = "comms",
+		[_F_RESOURCES] = "resources.txt",
+	};
+	ssize_t size;
+	char *data;
+	int fd;
+
+	size = result_store_read(store, job, stream, -1, &data);
+	if (size < 0)
+		return -1;
+
+	fd = memfd_create(names[stream], MFD_CLOEXEC);
+	if (fd >= 0 &&
+	    (!write_all(fd, data, size) || lseek(fd, 0, SEEK_SET))) {
+		close(fd);
+		fd = -1;
+	}
+
+	free(data);
+	return fd;
+}
+
+bool result_store_open_outputs(const struct result_store *store, size_t job,
+			       int *fds)
+{
+	int i;
+
+	for (i = 0; i < _F_LAST; i++) {
+		if ((fds[i] = result_store_stream_fd(store, job, i)) < 0) {
+			while (--i >= 0)
+				close(fds[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool result_store_unpack(const struct result_store *store, int dirfd)
+{
+	int outputs[_F_LAST];
+	char name[32];
+	size_t job;
+	int i;
+
+	for (job = 0; job < store->job_count; job++) {
+		bool ok = true;
+		int jobdirfd;
+
+		if (!result_store_has_job(store, job))
+			continue;
+
+		snprintf(name, sizeof(name), "%zd", job);
+		mkdirat(dirfd, name, 0777);
+		jobdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY);
+		if (jobdirfd < 0)
+			return false;
+
+		if (!open_output_files(jobdirfd, outputs, true)) {
+			close(jobdirfd);
+			return false;
+		}
+
+		for (i = 0; i < _F_LAST && ok; i++) {
+			ssize_t size;
+			char *data;
+
+			size = result_store_read(store, job, i, -1, &data);
+			ok = size >= 0 && write_all(outputs[i], data, size);
+			free(data);
+		}
+
+		close_outputs(outputs);
+		close(jobdirfd);
+
+		if (!ok)
+			return false;
+	}
+
+	return true;
+}
+
+static bool pack_file(struct result_store *store, int stream, int fd)
+{
+	struct stat st;
+	bool ok = true;
+	char *data;
+
+	if (fd < 0 || fstat(fd, &st) || !st.st_size)
+		return true;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	ok = result_store_write(store, stream, data, st.st_size);
+	munmap(data, st.st_size);
+
+	return ok;
+}
+
+bool result_store_pack(int srcdirfd, int dirfd, size_t job_count)
+{
+	struct result_store store;
+	int outputs[_F_LAST];
+	char name[32];
+	size_t job;
+	int i;
+
+	if (unlinkat(dirfd, RESULT_STORE_FILENAME, 0) && errno != ENOENT)
+		return false;
+
+	if (!result_store_open(&store, dirfd, true, false))
+		return false;
+
+	for (job = 0; job < job_count; job++) {
+		bool ok = true;
+		int jobdirfd;
+
+		snprintf(name, sizeof(name), "%zd", job);
+		jobdirfd = openat(srcdirfd, name, O_DIRECTORY | O_RDONLY);
+		if (jobdirfd < 0)
+			continue;
+
+		ok = open_output_files(jobdirfd, outputs, false);
+		close(jobdirfd);
+
+		if (ok) {
+			ok = result_store_begin_job(&store, job);
+
+			for (i = 0; i < _F_LAST && ok; i++)
+				ok = pack_file(&store, i, outputs[i]);
+
+			for (i = 0; i < _F_LAST; i++) {
+				if (outputs[i] >= 0)
+					close(outputs[i]);
+			}
+		}
+
+		if (!ok) {
+			result_store_close(&store);
+			return false;
+		}
+	}
+
+	result_store_sync(&store);
+	result_store_close(&store);
+	return true;
+}
@@ -0,0 +1,148 @@
+#ifndef RUNNER_RESULT_STORE_H
+#define RUNNER_RESULT_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "executor.h"
+
+/*
+ * Result store: all outputs of a run in a single append-only file in
+ * the results directory, instead of a directory with a file per
+ * stream for each job.
+ *
+ * Every write the executor does to a job's journal, out, err, dmesg or
+ * comms stream becomes one record, tagged with the job and the subtest
+ * running at the time. Records carry a checksum, and a store cut short
+ * by a crash is recovered by dropping the records after the last
+ * intact one. Space is reserved for the file in chunks, to avoid
+ * growing its allocation on every write.
+ *
+ * The store is indexed by job and subtest when opened. Readers get a
+ * job's streams as anonymous files with the same contents the per-job
+ * files would have had.
+ */
+
+#define RESULT_STORE_FILENAME "results.bin"
+
+enum {
+	/* Records carrying no test output, numbered past the _F_ streams */
+	RESULT_STORE_BEGIN_JOB = 0x100,
+	RESULT_STORE_BEGIN_SUBTEST,
+};
+
+struct result_store_record {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t subtest;
+	uint16_t stream;
+};
+
+struct result_store_job {
+	struct result_store_record *records;
+	size_t record_count;
+	size_t allocated;
+	/* Names of the started subtests, subtest n is subtests[n - 1] */
+	char **subtests;
+	size_t subtest_count;
+	/* Last byte written to each stream, 0 if nothing was written */
+	char last[_F_LAST];
+	bool started;
+};
+
+struct result_store {
+	int fd;
+	bool write;
+	bool sync;
+	uint64_t end;
+	uint64_t reserved;
+	/* Bytes of a torn record dropped when opening */
+	uint64_t discarded;
+	struct result_store_job *jobs;
+	size_t job_count;
+	size_t current;
+};
+
+/*
+ * Opens the result store of the results directory dirfd, for reading,
+ * or for appending, creating it if needed. The records are checked and
+ * indexed. When opened for appending a torn record at the end is
+ * discarded, for reading it's merely ignored.
+ *
+ * If sync is true, records are synced to disk when a job or subtest
+ * begins, see result_store_sync() for the rest.
+ */
+bool result_store_open(struct result_store *store, int dirfd,
+		       bool write, bool sync);
+void result_store_close(struct result_store *store);
+
+/* Returns whether dirfd has a result store */
+bool result_store_exists(int dirfd);
+
+/*
+ * Directs the following writes to job. Beginning a job that already
+ * has records, when resuming, terminates its text streams with a
+ * newline like the per-job files are when reopened.
+ */
+bool result_store_begin_job(struct result_store *store, size_t job);
+
+/*
+ * Marks the start of a subtest of the current job. Beginning the
+ * subtest already running is ignored, so that both the journal and
+ * socket comms can report it.
+ */
+bool result_store_begin_subtest(struct result_store *store, const char *name);
+
+/* Appends a record of size bytes to a stream of the current job */
+bool result_store_write(struct result_store *store, int stream,
+			const void *data, size_t size);
+void result_store_sync(struct result_store *store);
+
+bool result_store_has_job(const struct result_store *store, size_t job);
+
+/*
+ * Returns the number of the last subtest of job called name, counting
+ * from 1, or -1 if it never started. Subtest 0 stands for the output
+ * before the first subtest.
+ */
+int result_store_find_subtest(const struct result_store *store,
+			      size_t job, const char *name);
+
+/*
+ * Reads a stream of job into a newly allocated buffer, the output of
+ * the given subtest only, or all of it if subtest is negative.
+ *
+ * Returns the size read, or -1 on failure.
+ */
+ssize_t result_store_read(const struct result_store *store, size_t job,
+			  int stream, int subtest, char **data);
+
+/*
+ * Returns an anonymous file with the contents of a stream of job, or
+ * -1 on failure.
+ */
+int result_store_stream_fd(const struct result_store *store, size_t job,
+			   int stream);
+
+/*
+ * Fills fds with the streams of job like open_output_files() does for
+ * a job directory.
+ */
+bool result_store_open_outputs(const struct result_store *store, size_t job,
+			       int *fds);
+
+/*
+ * Writes the store out as per-job result directories into dirfd, for
+ * tools that only know the directory layout.
+ */
+bool result_store_unpack(const struct result_store *store, int dirfd);
+
+/*
+ * Collects the per-job result directories of the first job_count jobs
+ * in srcdirfd into a new store in dirfd, one record per stream. Files
+ * carry no subtest boundaries, so the output isn't indexed by subtest.
+ */
+bool result_store_pack(int srcdirfd, int dirfd, size_t job_count);
+
+#endif
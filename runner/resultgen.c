@@ -13,11 +13,14 @@
 
 #include "igt_aux.h"
 #include "igt_core.h"
+#include "igt_kmsg.h"
 #include "runnercomms.h"
 #include "resultgen.h"
 #include "settings.h"
 #include "executor.h"
 #include "output_strings.h"
+#include "resources.h"
+#include "result_store.h"
 
 #define INCOMPLETE_EXITCODE -1234
 #define GRACEFUL_EXITCODE -SIGHUP
@@ -846,35 +849,6 @@ static bool init_regex_whitelist(struct settings* settings, GRegex **re)
 	return true;
 }
 
-static bool parse_dmesg_line(char* line,
-			     unsigned *flags, unsigned long long *ts_usec,
-			     char *continuation, char **message)
-{
-	unsigned long long seq;
-	int s;
-
-	s = sscanf(line, "%u,%llu,%llu,%c;", flags, &seq, ts_usec, continuation);
-	if (s != 4) {
-		/*
-		 * Machine readable key/value pairs begin with
-		 * a space. We ignore them.
-		 */
-		if (line[0] != ' ') {
-			fprintf(stderr, "Cannot parse kmsg record: %s\n", line);
-		}
-		return false;
-	}
-
-	*message = strchr(line, ';');
-	if (*message == NULL) {
-		fprintf(stderr, "No ; found in kmsg record, this shouldn't happen\n");
-		return false;
-	}
-	(*message)++;
-
-	return true;
-}
-
 static void generate_formatted_dmesg_line(char *message,
 					  unsigned flags,
 					  unsigned long long ts_usec,
@@ -966,40 +940,47 @@ static bool fill_from_dmesg(int fd,
 			    struct subtest_list *subtests,
 			    struct json_object *tests)
 {
-	char *line = NULL;
+	char *message = NULL;
 	char *warnings = NULL, *dynamic_warnings = NULL;
 	char *dmesg = NULL, *dynamic_dmesg = NULL;
-	size_t linelen = 0;
+	size_t messagelen = 0;
 	size_t warningslen = 0, dynamic_warnings_len = 0;
 	size_t dmesglen = 0, dynamic_dmesg_len = 0;
 	struct json_object *current_test = NULL;
 	struct json_object *current_dynamic_test = NULL;
-	FILE *f = fdopen(fd, "r");
+	struct igt_kmsg_record record;
+	struct igt_kmsg kmsg;
 	char piglit_name[256];
 	char dynamic_piglit_name[256];
-	size_t i;
+	size_t i, n;
 	GRegex *re;
 
-	if (!f) {
+	if (igt_kmsg_map(&kmsg, fd))
 		return false;
-	}
+
+	if (kmsg.malformed)
+		fprintf(stderr, "Cannot parse %"PRIu64" kmsg records\n",
+			kmsg.malformed);
 
 	if (!init_regex_whitelist(settings, &re)) {
-		fclose(f);
+		igt_kmsg_fini(&kmsg);
 		return false;
 	}
 
-	while (getline(&line, &linelen, f) > 0) {
+	for (n = 0; igt_kmsg_get(&kmsg, n, &record); n++) {
 		char *formatted;
-		unsigned flags;
-		unsigned long long ts_usec;
-		char continuation;
-		char *message, *subtest, *dynamic_subtest;
+		char *subtest, *dynamic_subtest;
 
-		if (!parse_dmesg_line(line, &flags, &ts_usec, &continuation, &message))
-			continue;
+		/* The message as a line of its own */
+		if (messagelen < record.msg_len + 2) {
+			messagelen = record.msg_len + 2;
+			message = realloc(message, messagelen);
+		}
+		memcpy(message, record.msg, record.msg_len);
+		message[record.msg_len] = '\n';
+		message[record.msg_len + 1] = '\0';
 
-		generate_formatted_dmesg_line(message, flags, ts_usec, &formatted);
+		generate_formatted_dmesg_line(message, record.level, record.ts_usec, &formatted);
 
 		if ((subtest = strstr(message, STARTING_SUBTEST_DMESG)) != NULL) {
 			if (current_test != NULL) {
@@ -1044,14 +1025,14 @@ static bool fill_from_dmesg(int fd,
 		}
 
 		if (settings->piglit_style_dmesg) {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
+			if (record.level <= settings->dmesg_warn_level && record.cont != 'c' &&
 			    g_regex_match(re, message, 0, NULL)) {
 				append_line(&warnings, &warningslen, formatted);
 				if (current_test != NULL)
 					append_line(&dynamic_warnings, &dynamic_warnings_len, formatted);
 			}
 		} else {
-			if ((flags & 0x07) <= settings->dmesg_warn_level && continuation != 'c' &&
+			if (record.level <= settings->dmesg_warn_level && record.cont != 'c' &&
 			    !g_regex_match(re, message, 0, NULL)) {
 				append_line(&warnings, &warningslen, formatted);
 				if (current_test != NULL)
@@ -1062,7 +1043,7 @@ static bool fill_from_dmesg(int fd,
 		append_line(&dynamic_dmesg, &dynamic_dmesg_len, formatted);
 		free(formatted);
 	}
-	free(line);
+	free(message);
 
 	if (current_test != NULL) {
 		add_dmesg(current_test, dmesg, dmesglen, warnings, warningslen);
@@ -1100,7 +1081,7 @@ static bool fill_from_dmesg(int fd,
 	free(warnings);
 	free(dynamic_warnings);
 	g_regex_unref(re);
-	fclose(f);
+	igt_kmsg_fini(&kmsg);
 	return true;
 }
 
@@ -1230,6 +1211,127 @@ static void fill_from_journal(int fd,
 	fclose(f);
 }
 
+static struct json_object *
+new_resources_object(const struct resource_usage *usage)
+{
+	struct json_object *obj = json_object_new_object();
+	unsigned int i;
+
+	json_object_object_add(obj, "cpu-user",
+			       json_object_new_double(usage->cpu_user));
+	json_object_object_add(obj, "cpu-system",
+			       json_object_new_double(usage->cpu_system));
+	json_object_object_add(obj, "max-rss",
+			       json_object_new_int64(usage->max_rss));
+	json_object_object_add(obj, "io-read",
+			       json_object_new_int64(usage->io_read));
+	json_object_object_add(obj, "io-write",
+			       json_object_new_int64(usage->io_write));
+
+	if (usage->engine_count) {
+		struct json_object *gpu = json_object_new_object();
+
+		for (i = 0; i < usage->engine_count; i++)
+			json_object_object_add(gpu, usage->engines[i],
+					       json_object_new_int64(usage->gpu_busy[i]));
+		json_object_object_add(obj, "gpu", gpu);
+	}
+
+	return obj;
+}
+
+/* Adds up the usage of the runs of a test, when it was resumed */
+static void add_usage(struct resource_usage *total,
+		      const struct resource_usage *usage)
+{
+	unsigned int i, j;
+
+	total->cpu_user += usage->cpu_user;
+	total->cpu_system += usage->cpu_system;
+	if (usage->max_rss > total->max_rss)
+		total->max_rss = usage->max_rss;
+	total->io_read += usage->io_read;
+	total->io_write += usage->io_write;
+
+	for (i = 0; i < usage->engine_count; i++) {
+		for (j = 0; j < total->engine_count; j++) {
+			if (!strcmp(total->engines[j], usage->engines[i]))
+				break;
+		}
+
+		if (j == total->engine_count) {
+			if (j == RESOURCE_MAX_ENGINES)
+				continue;
+			strcpy(total->engines[j], usage->engines[i]);
+			total->engine_count++;
+		}
+
+		total->gpu_busy[j] += usage->gpu_busy[i];
+	}
+}
+
+static void fill_from_resources(int fd,
+				struct job_list_entry *entry,
+				struct subtest_list *subtests,
+				struct results *results)
+{
+	struct resource_usage usage, total = {};
+	struct json_object *obj;
+	char piglit_name[256];
+	bool exited = false;
+	char *line = NULL;
+	size_t linelen = 0;
+	FILE *f;
+
+	/* Older results have no resource usage */
+	if (fd < 0 || (fd = dup(fd)) < 0)
+		return;
+
+	f = fdopen(fd, "r");
+	if (!f) {
+		close(fd);
+		return;
+	}
+
+	while (getline(&line, &linelen, f) > 0) {
+		if (!strncmp(line, RESOURCES_SUBTEST, strlen(RESOURCES_SUBTEST))) {
+			char *name = line + strlen(RESOURCES_SUBTEST);
+			char *end = strchr(name, ' ');
+
+			if (!end || !resource_usage_parse(end + 1, &usage))
+				continue;
+			*end = '\0';
+
+			generate_piglit_name(entry->binary, name,
+					     piglit_name, sizeof(piglit_name));
+			if (json_object_object_get_ex(results->tests, piglit_name, &obj))
+				json_object_object_add(obj, "resources",
+						       new_resources_object(&usage));
+		} else if (!strncmp(line, RESOURCES_EXIT, strlen(RESOURCES_EXIT))) {
+			if (!resource_usage_parse(line + strlen(RESOURCES_EXIT), &usage))
+				continue;
+
+			add_usage(&total, &usage);
+			exited = true;
+		}
+	}
+
+	free(line);
+	fclose(f);
+
+	if (!exited)
+		return;
+
+	generate_piglit_name(entry->binary, NULL, piglit_name, sizeof(piglit_name));
+	obj = get_or_create_json_object(results->runtimes, piglit_name);
+	json_object_object_add(obj, "resources", new_resources_object(&total));
+
+	/* Like the runtime, a test without subtests gets the totals */
+	if (subtests->size == 0 &&
+	    json_object_object_get_ex(results->tests, piglit_name, &obj))
+		json_object_object_add(obj, "resources", new_resources_object(&total));
+}
+
 typedef enum comms_state {
 	STATE_INITIAL = 0,
 	STATE_AFTER_EXEC,
@@ -2110,21 +2212,16 @@ static void add_to_totals(const char *binary,
 	}
 }
 
-static bool parse_test_directory(int dirfd,
-				 struct job_list_entry *entry,
-				 struct settings *settings,
-				 struct results *results)
+/* Parses the outputs of a job, and closes fds */
+static bool parse_test_outputs(int *fds,
+			       struct job_list_entry *entry,
+			       struct settings *settings,
+			       struct results *results)
 {
-	int fds[_F_LAST];
 	struct subtest_list subtests = {};
 	bool status = true;
 	int commsparsed;
 
-	if (!open_output_files(dirfd, fds, false)) {
-		fprintf(stderr, "Error opening output files\n");
-		return false;
-	}
-
 	/*
 	 * Get test output from socket comms if it exists, otherwise
 	 * parse stdout/stderr
@@ -2157,6 +2254,8 @@ static bool parse_test_directory(int dirfd,
 		goto parse_output_end;
 	}
 
+	fill_from_resources(fds[_F_RESOURCES], entry, &subtests, results);
+
 	override_results(entry->binary, &subtests, results->tests);
 	prune_subtests(settings, entry, &subtests, results->tests);
 
@@ -2169,6 +2268,36 @@ static bool parse_test_directory(int dirfd,
 	return status;
 }
 
+static bool parse_test_directory(int dirfd,
+				 struct job_list_entry *entry,
+				 struct settings *settings,
+				 struct results *results)
+{
+	int fds[_F_LAST];
+
+	if (!open_output_files(dirfd, fds, false)) {
+		fprintf(stderr, "Error opening output files\n");
+		return false;
+	}
+
+	return parse_test_outputs(fds, entry, settings, results);
+}
+
+static bool parse_test_from_store(const struct result_store *store, size_t i,
+				  struct job_list_entry *entry,
+				  struct settings *settings,
+				  struct results *results)
+{
+	int fds[_F_LAST];
+
+	if (!result_store_open_outputs(store, i, fds)) {
+		fprintf(stderr, "Error reading outputs from the result store\n");
+		return false;
+	}
+
+	return parse_test_outputs(fds, entry, settings, results);
+}
+
 static void try_add_notrun_results(const struct job_list_entry *entry,
 				   const struct settings *settings,
 				   struct results *results)
@@ -2224,6 +2353,8 @@ struct json_object *generate_results_json(int dirfd)
 	struct job_list job_list;
 	struct json_object *obj, *elapsed;
 	struct results results;
+	struct result_store store;
+	bool use_store;
 	int testdirfd, fd;
 	size_t i;
 
@@ -2240,6 +2371,17 @@ struct json_object *generate_results_json(int dirfd)
 		return NULL;
 	}
 
+	/*
+	 * The store takes precedence over job directories whenever
+	 * present, regardless of settings. igt_results --unpack
+	 * removes it once unpacked.
+	 */
+	use_store = result_store_exists(dirfd);
+	if (use_store && !result_store_open(&store, dirfd, false, false)) {
+		fprintf(stderr, "resultgen: Cannot open the result store\n");
+		return NULL;
+	}
+
 	obj = json_object_new_object();
 	json_object_object_add(obj, "__type__", json_object_new_string("TestrunResult"));
 	json_object_object_add(obj, "results_version", json_object_new_int(10));
@@ -2294,6 +2436,19 @@ struct json_object *generate_results_json(int dirfd)
 	for (i = 0; i < job_list.size; i++) {
 		char name[16];
 
+		if (use_store) {
+			if (!result_store_has_job(&store, i)) {
+				try_add_notrun_results(&job_list.entries[i], &settings, &results);
+				continue;
+			}
+
+			if (!parse_test_from_store(&store, i, &job_list.entries[i], &settings, &results)) {
+				result_store_close(&store);
+				return NULL;
+			}
+			continue;
+		}
+
 		snprintf(name, 16, "%zd", i);
 		if ((testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
 			try_add_notrun_results(&job_list.entries[i], &settings, &results);
@@ -2333,13 +2488,110 @@ struct json_object *generate_results_json(int dirfd)
 		close(fd);
 	}
 
+	if (use_store)
+		result_store_close(&store);
+
 	clear_settings(&settings);
 	free_job_list(&job_list);
 
 	return obj;
 }
 
+struct resource_entry
+{
+	const char *name;
+	double cpu;
+	struct json_object *resources;
+};
+
+static int resource_entry_cmp(const void *a, const void *b)
+{
+	const struct resource_entry *x = a, *y = b;
+
+	return (x->cpu < y->cpu) - (x->cpu > y->cpu);
+}
+
+static int64_t get_int64_field(struct json_object *obj, const char *key)
+{
+	struct json_object *val;
+
+	if (!json_object_object_get_ex(obj, key, &val))
+		return 0;
+
+	return json_object_get_int64(val);
+}
+
+static double get_double_field(struct json_object *obj, const char *key)
+{
+	struct json_object *val;
+
+	if (!json_object_object_get_ex(obj, key, &val))
+		return 0.0;
+
+	return json_object_get_double(val);
+}
+
+static void print_resource_report(struct json_object *obj, size_t top)
+{
+	struct resource_entry *entries = NULL;
+	struct json_object *tests;
+	json_object_iter iter;
+	size_t count = 0, i;
+
+	if (!json_object_object_get_ex(obj, "tests", &tests))
+		return;
+
+	json_object_object_foreachC(tests, iter) {
+		struct json_object *resources;
+
+		if (!json_object_object_get_ex(iter.val, "resources", &resources))
+			continue;
+
+		entries = realloc(entries, (count + 1) * sizeof(*entries));
+		entries[count].name = iter.key;
+		entries[count].cpu = get_double_field(resources, "cpu-user") +
+			get_double_field(resources, "cpu-system");
+		entries[count].resources = resources;
+		count++;
+	}
+
+	qsort(entries, count, sizeof(*entries), resource_entry_cmp);
+	if (count > top)
+		count = top;
+
+	printf("%10s %10s %10s %12s %12s %12s %10s  %s\n",
+	       "CPU (s)", "user", "system", "max RSS KiB",
+	       "I/O read", "I/O write", "GPU (s)", "test");
+
+	for (i = 0; i < count; i++) {
+		struct json_object *resources = entries[i].resources;
+		struct json_object *gpu;
+		double gpu_time = 0.0;
+
+		if (json_object_object_get_ex(resources, "gpu", &gpu)) {
+			json_object_object_foreachC(gpu, iter)
+				gpu_time += json_object_get_int64(iter.val) / 1e9;
+		}
+
+		printf("%10.3f %10.3f %10.3f %12"PRId64" %12"PRId64" %12"PRId64" %10.3f  %s\n",
+		       entries[i].cpu,
+		       get_double_field(resources, "cpu-user"),
+		       get_double_field(resources, "cpu-system"),
+		       get_int64_field(resources, "max-rss"),
+		       get_int64_field(resources, "io-read"),
+		       get_int64_field(resources, "io-write"),
+		       gpu_time, entries[i].name);
+	}
+
+	free(entries);
+}
+
 bool generate_results(int dirfd)
+{
+	return generate_results_report(dirfd, 0);
+}
+
+bool generate_results_report(int dirfd, size_t top)
 {
 	struct json_object *obj = generate_results_json(dirfd);
 	const char *json_string;
@@ -2370,6 +2622,10 @@ bool generate_results(int dirfd)
 
 	write(resultsfd, json_string, strlen(json_string));
 	close(resultsfd);
+
+	if (top)
+		print_resource_report(obj, top);
+
 	return true;
 }
 
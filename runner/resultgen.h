@@ -2,8 +2,14 @@
 #define RUNNER_RESULTGEN_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 bool generate_results(int dirfd);
+/*
+ * Like generate_results(), also printing the top tests using the most
+ * CPU time with the rest of their resource usage, if top isn't 0.
+ */
+bool generate_results_report(int dirfd, size_t top);
 bool generate_results_path(char *resultspath);
 
 struct json_object *generate_results_json(int dirfd);
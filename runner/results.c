@@ -1,15 +1,49 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include "result_store.h"
 #include "resultgen.h"
 
+/* Converts a result store to the per-test result directories */
+static bool unpack_result_store(int dirfd)
+{
+	struct result_store store;
+	bool ok;
+
+	if (!result_store_open(&store, dirfd, false, false))
+		return false;
+
+	ok = result_store_unpack(&store, dirfd);
+	result_store_close(&store);
+
+	return ok && unlinkat(dirfd, RESULT_STORE_FILENAME, 0) == 0;
+}
+
 int main(int argc, char **argv)
 {
+	bool unpack = false;
+	size_t top = 0;
 	int dirfd;
 
+	while (argc > 2) {
+		if (!strcmp(argv[1], "--unpack")) {
+			unpack = true;
+			argc--;
+			argv++;
+		} else if (argc > 3 && !strcmp(argv[1], "--top")) {
+			top = strtoul(argv[2], NULL, 10);
+			argc -= 2;
+			argv += 2;
+		} else {
+			break;
+		}
+	}
+
 	if (argc < 2)
 		exit(1);
 
@@ -17,7 +51,15 @@ int main(int argc, char **argv)
 	if (dirfd < 0)
 		exit(1);
 
-	if (generate_results(dirfd)) {
+	if (unpack && result_store_exists(dirfd)) {
+		if (!unpack_result_store(dirfd)) {
+			fprintf(stderr, "Failed to unpack the result store\n");
+			exit(1);
+		}
+		printf("Result store unpacked\n");
+	}
+
+	if (generate_results_report(dirfd, top)) {
 		printf("Results generated\n");
 		exit(0);
 	}
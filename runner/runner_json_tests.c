@@ -1,11 +1,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <ftw.h>
 
 #include <json.h>
 
 #include "igt.h"
+#include "job_list.h"
 #include "resultgen.h"
+#include "result_store.h"
 
 static char testdatadir[] = JSON_TESTS_DIRECTORY;
 
@@ -123,18 +127,14 @@ static void compare(struct json_object *one,
 	}
 }
 
-static void run_results_and_compare(int dirfd, const char *dirname)
+static void compare_results(int resultsdirfd, int testdirfd)
 {
-	int testdirfd = openat(dirfd, dirname, O_RDONLY | O_DIRECTORY);
 	int reference;
 	struct json_object *resultsobj, *referenceobj;
 
-	igt_assert_fd(testdirfd);
-
-	igt_assert((resultsobj = generate_results_json(testdirfd)) != NULL);
+	igt_assert((resultsobj = generate_results_json(resultsdirfd)) != NULL);
 
 	reference = openat(testdirfd, "reference.json", O_RDONLY);
-	close(testdirfd);
 
 	igt_assert_fd(reference);
 	referenceobj = read_json(reference);
@@ -147,6 +147,82 @@ static void run_results_and_compare(int dirfd, const char *dirname)
 	igt_assert_eq(json_object_put(referenceobj), 1);
 }
 
+static void run_results_and_compare(int dirfd, const char *dirname)
+{
+	int testdirfd = openat(dirfd, dirname, O_RDONLY | O_DIRECTORY);
+
+	igt_assert_fd(testdirfd);
+
+	compare_results(testdirfd, testdirfd);
+	close(testdirfd);
+}
+
+/* Links the files of the run in path, but not the job directories */
+static void link_run_files(const char *path, int dstfd)
+{
+	struct dirent *dirent;
+	char name[PATH_MAX];
+	DIR *d;
+
+	igt_assert((d = opendir(path)) != NULL);
+
+	while ((dirent = readdir(d)) != NULL) {
+		if (dirent->d_type != DT_REG)
+			continue;
+
+		snprintf(name, sizeof(name), "%s/%s", path, dirent->d_name);
+		igt_assert_eq(symlinkat(name, dstfd, dirent->d_name), 0);
+	}
+
+	closedir(d);
+}
+
+static int remove_entry(const char *path, const struct stat *st,
+			int type, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/*
+ * Packs the job directories into a result store, which has to give the
+ * same results, and unpacks it back to job directories.
+ */
+static void run_results_from_store_and_compare(int dirfd, const char *dirname)
+{
+	char tmpname[] = "tmpdirXXXXXX";
+	char path[PATH_MAX];
+	struct result_store store;
+	struct job_list list;
+	int testdirfd, tmpfd;
+
+	testdirfd = openat(dirfd, dirname, O_RDONLY | O_DIRECTORY);
+	igt_assert_fd(testdirfd);
+
+	init_job_list(&list);
+	igt_assert(read_job_list(&list, testdirfd));
+
+	igt_assert(mkdtemp(tmpname) != NULL);
+	tmpfd = open(tmpname, O_RDONLY | O_DIRECTORY);
+	igt_assert_fd(tmpfd);
+
+	snprintf(path, sizeof(path), "%s/%s", testdatadir, dirname);
+	link_run_files(path, tmpfd);
+
+	igt_assert(result_store_pack(testdirfd, tmpfd, list.size));
+	compare_results(tmpfd, testdirfd);
+
+	igt_assert(result_store_open(&store, tmpfd, false, false));
+	igt_assert(result_store_unpack(&store, tmpfd));
+	result_store_close(&store);
+	igt_assert_eq(unlinkat(tmpfd, RESULT_STORE_FILENAME, 0), 0);
+	compare_results(tmpfd, testdirfd);
+
+	free_job_list(&list);
+	close(tmpfd);
+	close(testdirfd);
+	nftw(tmpname, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+}
+
 static const char *dirnames[] = {
 	"normal-run",
 	"warnings",
@@ -183,5 +259,9 @@ igt_main
 		igt_subtest(dirnames[i]) {
 			run_results_and_compare(dirfd, dirnames[i]);
 		}
+
+		igt_subtest_f("%s-result-store", dirnames[i]) {
+			run_results_from_store_and_compare(dirfd, dirnames[i]);
+		}
 	}
 }
@@ -13,6 +13,7 @@
 #include "job_list.h"
 #include "executor.h"
 #include "resultgen.h"
+#include "result_store.h"
 
 /*
  * NOTE: this test is using a lot of variables that are changed in igt_fixture,
@@ -202,6 +203,9 @@ static void assert_settings_equal(struct settings *one, struct settings *two)
 	igt_assert_eq(one->piglit_style_dmesg, two->piglit_style_dmesg);
 	igt_assert_eq(one->dmesg_warn_level, two->dmesg_warn_level);
 	igt_assert_eq(one->prune_mode, two->prune_mode);
+	igt_assert_eq(one->result_store, two->result_store);
+	igt_assert_eqstr(one->cgroup, two->cgroup);
+	igt_assert_eq(one->gpu_stats, two->gpu_stats);
 }
 
 static void assert_job_list_equal(struct job_list *one, struct job_list *two)
@@ -302,6 +306,9 @@ igt_main
 		igt_assert_eq(settings->overall_timeout, 0);
 		igt_assert(!settings->use_watchdog);
 		igt_assert_eq(settings->prune_mode, 0);
+		igt_assert(!settings->result_store);
+		igt_assert(!settings->cgroup);
+		igt_assert(!settings->gpu_stats);
 		igt_assert(strstr(settings->test_root, "test-root-dir") != NULL);
 		igt_assert(strstr(settings->results_path, "path-to-results") != NULL);
 
@@ -465,6 +472,9 @@ igt_main
 				       "--coverage-per-test",
 				       "--collect-script", "/usr/bin/true",
 				       "--prune-mode=keep-subtests",
+				       "--result-store",
+				       "--cgroup", "/sys/fs/cgroup/igt",
+				       "--gpu-stats",
 				       "test-root-dir",
 				       "path-to-results",
 		};
@@ -512,6 +522,9 @@ igt_main
 		igt_assert_eq(settings->overall_timeout, 360);
 		igt_assert(settings->use_watchdog);
 		igt_assert_eq(settings->prune_mode, PRUNE_KEEP_SUBTESTS);
+		igt_assert(settings->result_store);
+		igt_assert_eqstr(settings->cgroup, "/sys/fs/cgroup/igt");
+		igt_assert(settings->gpu_stats);
 		igt_assert(strstr(settings->test_root, "test-root-dir") != NULL);
 		igt_assert(strstr(settings->results_path, "path-to-results") != NULL);
 
@@ -961,6 +974,8 @@ igt_main
 					       "--use-watchdog",
 					       "--piglit-style-dmesg",
 					       "--prune-mode=keep-all",
+					       "--cgroup", "/sys/fs/cgroup/igt",
+					       "--gpu-stats",
 					       testdatadir,
 					       dirname,
 			};
@@ -1594,6 +1609,195 @@ igt_main
 			free(list);
 	}
 
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1;
+		struct result_store store = { .fd = -1 };
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+		}
+
+		igt_subtest("execute-initialize-subtest-started-result-store") {
+			struct execute_state state;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--multiple-mode",
+					       "--result-store",
+					       "-t", "successtest",
+					       testdatadir,
+					       dirname,
+			};
+			const char journaltext[] = "first-subtest\n";
+			const char excludestring[] = "!first-subtest";
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(list->size == 1);
+			igt_assert(list->entries[0].subtest_count == 0);
+
+			igt_assert(serialize_settings(settings));
+			igt_assert(serialize_job_list(list, settings));
+
+			igt_assert((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0);
+			igt_assert(result_store_open(&store, dirfd, true, false));
+			igt_assert(result_store_begin_job(&store, 0));
+			igt_assert(result_store_begin_subtest(&store, "first-subtest"));
+			igt_assert(result_store_write(&store, _F_JOURNAL, journaltext, strlen(journaltext)));
+			result_store_close(&store);
+
+			free_job_list(list);
+			clear_settings(settings);
+			igt_assert(initialize_execute_state_from_resume(dup(dirfd), &state, settings, list));
+
+			igt_assert_eq(state.next, 0);
+			igt_assert_eq(list->size, 1);
+			igt_assert_eq(list->entries[0].subtest_count, 2);
+			igt_assert_eqstr(list->entries[0].subtests[0], "*");
+			igt_assert_eqstr(list->entries[0].subtests[1], excludestring);
+		}
+
+		igt_fixture {
+			result_store_close(&store);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1;
+		struct result_store store = { .fd = -1 };
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+		}
+
+		igt_subtest("execute-subtests-result-store") {
+			struct execute_state state;
+			struct json_object *results, *tests;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "--result-store",
+					       "-t", "successtest.*-subtest",
+					       testdatadir,
+					       dirname,
+			};
+			char *out;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+			igt_assert_f((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) < 0,
+				     "Execute created a result directory with the result store\n");
+
+			igt_assert(result_store_open(&store, dirfd, false, false));
+			igt_assert(result_store_has_job(&store, 0));
+			igt_assert(result_store_has_job(&store, 1));
+			igt_assert(!result_store_has_job(&store, 2));
+			igt_assert_eq(result_store_find_subtest(&store, 0, "first-subtest"), 1);
+			igt_assert_eq(result_store_find_subtest(&store, 1, "second-subtest"), 1);
+			igt_assert_eq(result_store_find_subtest(&store, 0, "second-subtest"), -1);
+			/* The subtest start packet is the first record of the subtest */
+			igt_assert(result_store_read(&store, 0, _F_SOCKET, 1, &out) > 0);
+			free(out);
+			result_store_close(&store);
+
+			igt_assert_f((results = generate_results_json(dirfd)) != NULL,
+				     "Results parsing failed\n");
+			igt_assert(json_object_object_get_ex(results, "tests", &tests));
+			igt_assert_eqstr(igt_get_result(tests, "igt@successtest@first-subtest"), "pass");
+			igt_assert_eqstr(igt_get_result(tests, "igt@successtest@second-subtest"), "pass");
+			igt_assert_eq(json_object_put(results), 1);
+		}
+
+		igt_fixture {
+			result_store_close(&store);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
+	igt_subtest_group {
+		char dirname[] = "tmpdirXXXXXX";
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1;
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+		}
+
+		igt_subtest("execute-resource-usage") {
+			struct execute_state state;
+			struct json_object *results, *tests, *runtimes, *obj, *resources;
+			const char *argv[] = { "runner",
+					       "--allow-non-root",
+					       "-t", "successtest.*-subtest",
+					       testdatadir,
+					       dirname,
+			};
+			char buf[1024] = {};
+			int fd;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+			igt_assert_f((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create result directory '0'\n");
+
+			igt_assert((fd = openat(subdirfd, "resources.txt", O_RDONLY)) >= 0);
+			igt_assert(read(fd, buf, sizeof(buf) - 1) > 0);
+			close(fd);
+			igt_assert_f(!strncmp(buf, "subtest first-subtest cpu-user=", 31),
+				     "Unexpected resources.txt:\n%s", buf);
+			igt_assert_f(strstr(buf, "\nexit cpu-user="),
+				     "No exit line in resources.txt:\n%s", buf);
+
+			igt_assert_f((results = generate_results_json(dirfd)) != NULL,
+				     "Results parsing failed\n");
+			igt_assert(json_object_object_get_ex(results, "tests", &tests));
+			igt_assert(json_object_object_get_ex(tests, "igt@successtest@first-subtest", &obj));
+			igt_assert(json_object_object_get_ex(obj, "resources", &resources));
+			igt_assert(json_object_object_get_ex(resources, "cpu-user", &obj));
+			igt_assert(json_object_object_get_ex(resources, "max-rss", &obj));
+			igt_assert(json_object_get_int64(obj) > 0);
+
+			igt_assert(json_object_object_get_ex(results, "runtimes", &runtimes));
+			igt_assert(json_object_object_get_ex(runtimes, "igt@successtest", &obj));
+			igt_assert(json_object_object_get_ex(obj, "resources", &resources));
+			igt_assert(json_object_object_get_ex(resources, "io-write", &obj));
+			igt_assert_eq(json_object_put(results), 1);
+		}
+
+		igt_fixture {
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
 	igt_subtest_group {
 		igt_subtest("metadata-read-old-style-infer-dmesg-warn-piglit-style") {
 			char metadata[] = "piglit_style_dmesg : 1\n";
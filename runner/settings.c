@@ -30,6 +30,9 @@ enum {
 	OPT_COV_RESULTS_PER_TEST,
 	OPT_VERSION,
 	OPT_PRUNE_MODE,
+	OPT_RESULT_STORE,
+	OPT_CGROUP,
+	OPT_GPU_STATS,
 	OPT_HELP = 'h',
 	OPT_NAME = 'n',
 	OPT_DRY_RUN = 'd',
@@ -283,6 +286,17 @@ static const char *usage_str =
 	"                                                  not in the requested test set.\n"
 	"                                                  Useful when you have a hand-written\n"
 	"                                                  testlist.\n"
+	"  --result-store        Store the outputs of all tests in a single file in the\n"
+	"                        results directory, instead of a directory of files per\n"
+	"                        test. igt_results reads it directly, and converts it\n"
+	"                        to the directory layout with --unpack.\n"
+	"  --cgroup <path>       Run each test in a cgroup of its own, created below the\n"
+	"                        given cgroup v2 directory, and record the CPU, memory\n"
+	"                        and I/O usage of all of its processes. Without it, only\n"
+	"                        the test process and the children it waited for are\n"
+	"                        accounted for.\n"
+	"  --gpu-stats           Record the GPU engine busyness of the DRM clients of\n"
+	"                        each test, from their fdinfo.\n"
 	"  -b, --blacklist FILENAME\n"
 	"                        Exclude all test matching to regexes from FILENAME\n"
 	"                        (can be used more than once)\n"
@@ -621,6 +635,7 @@ void clear_settings(struct settings *settings)
 	free(settings->name);
 	free(settings->test_root);
 	free(settings->results_path);
+	free(settings->cgroup);
 
 	free_regexes(&settings->include_regexes);
 	free_regexes(&settings->exclude_regexes);
@@ -662,6 +677,9 @@ bool parse_options(int argc, char **argv,
 		{"piglit-style-dmesg", no_argument, NULL, OPT_PIGLIT_DMESG},
 		{"dmesg-warn-level", required_argument, NULL, OPT_DMESG_WARN_LEVEL},
 		{"prune-mode", required_argument, NULL, OPT_PRUNE_MODE},
+		{"result-store", no_argument, NULL, OPT_RESULT_STORE},
+		{"cgroup", required_argument, NULL, OPT_CGROUP},
+		{"gpu-stats", no_argument, NULL, OPT_GPU_STATS},
 		{"blacklist", required_argument, NULL, OPT_BLACKLIST},
 		{"list-all", no_argument, NULL, OPT_LIST_ALL},
 		{ 0, 0, 0, 0},
@@ -770,6 +788,16 @@ bool parse_options(int argc, char **argv,
 				goto error;
 			}
 			break;
+		case OPT_RESULT_STORE:
+			settings->result_store = true;
+			break;
+		case OPT_CGROUP:
+			free(settings->cgroup);
+			settings->cgroup = absolute_path(optarg);
+			break;
+		case OPT_GPU_STATS:
+			settings->gpu_stats = true;
+			break;
 		case OPT_BLACKLIST:
 			if (!parse_blacklist(&settings->exclude_regexes,
 					     absolute_path(optarg)))
@@ -1034,6 +1062,10 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, piglit_style_dmesg, "%d");
 	SERIALIZE_LINE(f, settings, dmesg_warn_level, "%d");
 	SERIALIZE_LINE(f, settings, prune_mode, "%d");
+	SERIALIZE_LINE(f, settings, result_store, "%d");
+	if (settings->cgroup)
+		SERIALIZE_LINE(f, settings, cgroup, "%s");
+	SERIALIZE_LINE(f, settings, gpu_stats, "%d");
 	SERIALIZE_LINE(f, settings, test_root, "%s");
 	SERIALIZE_LINE(f, settings, results_path, "%s");
 	SERIALIZE_LINE(f, settings, enable_code_coverage, "%d");
@@ -1097,6 +1129,9 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		PARSE_LINE(settings, name, val, piglit_style_dmesg, numval);
 		PARSE_LINE(settings, name, val, dmesg_warn_level, numval);
 		PARSE_LINE(settings, name, val, prune_mode, numval);
+		PARSE_LINE(settings, name, val, result_store, numval);
+		PARSE_LINE(settings, name, val, cgroup, val ? strdup(val) : NULL);
+		PARSE_LINE(settings, name, val, gpu_stats, numval);
 		PARSE_LINE(settings, name, val, test_root, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, results_path, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, enable_code_coverage, numval);
@@ -68,6 +68,9 @@ struct settings {
 	bool piglit_style_dmesg;
 	int dmesg_warn_level;
 	int prune_mode;
+	bool result_store;
+	char *cgroup;
+	bool gpu_stats;
 	bool list_all;
 	char *code_coverage_script;
 	bool enable_code_coverage;
@@ -40,7 +40,9 @@
 #include "intel_bufops.h"
 #include "i915/gem_vm.h"
 #include "i915/i915_crc.h"
+#include "i915/intel_decode.h"
 #include "intel_blt.h"
+#include "igt_surface_compare.h"
 /**
  * TEST: api intel bb
  * Description: intel_bb API check.
@@ -214,6 +216,16 @@
  * SUBTEST: render-ccs
  * Feature: igt_core
  *
+ * SUBTEST: render-rects
+ * Description: Copy a buffer as a grid of rectangles in a single render copy
+ * Feature: igt_core
+ *
+ * SUBTEST: render-template
+ * Description:
+ *   Compare render copy batches replayed from pipeline state templates
+ *   against batches built from scratch
+ * Feature: igt_core
+ *
  * SUBTEST: reset-bb
  * Category: Infrastructure
  * Description:
@@ -1066,28 +1078,33 @@ static void scratch_buf_draw_pattern(struct buf_ops *bops,
 static int compare_detail(const uint32_t *ptr1, uint32_t *ptr2,
 			  uint32_t size)
 {
-	int i, ok = 0, fail = 0;
-	int groups = size / GROUP_SIZE;
-	int *hist = calloc(GROUP_SIZE, groups);
+	/* A row per group, so that each block counts the fails of a group */
+	struct igt_surface_view view1 = {
+		.ptr = ptr1,
+		.stride = GROUP_SIZE,
+		.width = GROUP_SIZE / sizeof(uint32_t),
+		.height = size / GROUP_SIZE,
+		.bpp = 32,
+	};
+	struct igt_surface_view view2 = view1;
+	struct igt_surface_diff diff;
+	int i, ok, fail;
 
 	igt_debug("size: %d, group_size: %d, groups: %d\n",
-		  size, GROUP_SIZE, groups);
-
-	for (i = 0; i < size / sizeof(uint32_t); i++) {
-		if (ptr1[i] == ptr2[i]) {
-			ok++;
-		} else {
-			fail++;
-			hist[i * sizeof(uint32_t) / GROUP_SIZE]++;
-		}
-	}
+		  size, GROUP_SIZE, view1.height);
 
-	for (i = 0; i < groups; i++) {
-		if (hist[i]) {
-			igt_debug("[group %4x]: %d\n", i, hist[i]);
+	view2.ptr = ptr2;
+	igt_surface_compare(&view1, &view2, view1.width, 1, &diff);
+
+	for (i = 0; i < diff.blocks_y; i++) {
+		if (diff.counts[i]) {
+			igt_debug("[group %4x]: %d\n", i, diff.counts[i]);
 		}
 	}
-	free(hist);
+
+	fail = diff.pixels;
+	ok = size / sizeof(uint32_t) - fail;
+	igt_surface_diff_fini(&diff);
 
 	igt_debug("ok: %d, fail: %d\n", ok, fail);
 
@@ -1591,6 +1608,119 @@ static int render(struct buf_ops *bops, uint32_t tiling, bool do_reloc,
 	return fails;
 }
 
+static void render_rects(struct buf_ops *bops, uint32_t tiling)
+{
+	struct igt_render_copy_rect rects[64];
+	const uint32_t width = 512, height = 512, tile = width / 8;
+	struct intel_bb *ibb;
+	struct intel_buf src, dst;
+	int i915 = buf_ops_get_fd(bops);
+	uint32_t devid = intel_get_drm_devid(i915);
+	igt_render_copy_rectsfunc_t render_copy_rects;
+	int i, fails;
+
+	render_copy_rects = igt_get_render_copy_rectsfunc(devid);
+	igt_require(render_copy_rects);
+
+	ibb = intel_bb_create(i915, PAGE_SIZE);
+
+	scratch_buf_init(bops, &src, width, height, I915_TILING_NONE,
+			 I915_COMPRESSION_NONE);
+	scratch_buf_init(bops, &dst, width, height, tiling,
+			 I915_COMPRESSION_NONE);
+	scratch_buf_draw_pattern(bops, &src,
+				 0, 0, width, height,
+				 0, 0, width, height, 0);
+
+	/* More rectangles than fit in a single page batch */
+	for (i = 0; i < ARRAY_SIZE(rects); i++) {
+		rects[i].src_x = rects[i].dst_x = (i % 8) * tile;
+		rects[i].src_y = rects[i].dst_y = (i / 8) * tile;
+		rects[i].width = tile;
+		rects[i].height = tile;
+	}
+
+	render_copy_rects(ibb, &src, &dst, rects, ARRAY_SIZE(rects));
+	intel_bb_sync(ibb);
+	intel_bb_destroy(ibb);
+
+	fails = compare_bufs(&src, &dst, true);
+
+	intel_buf_close(bops, &src);
+	intel_buf_close(bops, &dst);
+
+	igt_assert_f(fails == 0, "%s: (tiling: %d) fails: %d\n",
+		     __func__, tiling, fails);
+}
+
+/* Returns the size of the commands, which end with the batch buffer end */
+static uint32_t emit_render_copy(struct intel_bb *ibb,
+				 struct intel_buf *src, struct intel_buf *dst,
+				 const struct igt_render_copy_rect *rects,
+				 unsigned int count, void *out)
+{
+	memset(ibb->batch, 0, ibb->size);
+	igt_assert_eq(gen9_render_copy_emit(ibb, src, dst, rects, count), count);
+	memcpy(out, ibb->batch, ibb->size);
+
+	return intel_bb_offset(ibb);
+}
+
+static void render_template(struct buf_ops *bops)
+{
+	const struct igt_render_copy_rect rects[] = {
+		{ 0, 0, 0, 0, 64, 64 },
+		{ 64, 0, 128, 32, 32, 96 },
+	};
+	struct intel_bb *ibb;
+	struct intel_buf src, dst;
+	int i915 = buf_ops_get_fd(bops);
+	void *fresh, *recorded, *replayed;
+	uint32_t len;
+
+	igt_require(intel_gen(intel_get_drm_devid(i915)) >= 9);
+
+	/* Batches are built but never executed, so the offsets don't move */
+	ibb = intel_bb_create(i915, PAGE_SIZE);
+
+	scratch_buf_init(bops, &src, 256, 256, I915_TILING_NONE,
+			 I915_COMPRESSION_NONE);
+	scratch_buf_init(bops, &dst, 256, 256, I915_TILING_NONE,
+			 I915_COMPRESSION_NONE);
+
+	fresh = malloc(ibb->size);
+	recorded = malloc(ibb->size);
+	replayed = malloc(ibb->size);
+	igt_assert(fresh && recorded && replayed);
+
+	gen9_render_set_templates(false);
+	emit_render_copy(ibb, &src, &dst, rects, ARRAY_SIZE(rects), fresh);
+
+	gen9_render_set_templates(true);
+	emit_render_copy(ibb, &src, &dst, rects, ARRAY_SIZE(rects), recorded);
+	len = emit_render_copy(ibb, &src, &dst, rects, ARRAY_SIZE(rects),
+			       replayed);
+
+	if (debug_bb) {
+		struct intel_decode *ctx = intel_decode_context_alloc(ibb->devid);
+
+		intel_decode_set_batch_pointer(ctx, replayed, 0, len / 4);
+		intel_decode(ctx);
+		intel_decode_context_free(ctx);
+	}
+
+	igt_assert(memcmp(fresh, recorded, ibb->size) == 0);
+	igt_assert(memcmp(fresh, replayed, ibb->size) == 0);
+
+	free(fresh);
+	free(recorded);
+	free(replayed);
+	intel_buf_close(bops, &src);
+	intel_buf_close(bops, &dst);
+	intel_bb_reset(ibb, true);
+	intel_bb_destroy(ibb);
+}
+
 static uint32_t count_compressed(int gen, struct intel_buf *buf)
 {
 	int i915 = buf_ops_get_fd(buf->bops);
@@ -1890,6 +2020,19 @@ igt_main_args("dpibc:", NULL, help_str, opt_handler, NULL)
 	igt_subtest("render-ccs")
 		render_ccs(bops);
 
+	igt_subtest_with_dynamic("render-rects") {
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			const struct test *t = &tests[i];
+
+			igt_dynamic_f("render-rects-%s", t->tiling_name)
+				render_rects(bops, t->tiling);
+		}
+	}
+
+	igt_describe("Compare replayed render copy batches against fresh ones");
+	igt_subtest("render-template")
+		render_template(bops);
+
 	igt_describe("Compare cpu and gpu crc32 sums on input object");
 	igt_subtest_with_dynamic_f("crc32") {
 		const intel_ctx_t *ctx;
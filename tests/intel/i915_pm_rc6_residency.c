@@ -65,6 +65,24 @@
 
 static int sysfs;
 
+enum {
+	RC6,
+	MEDIA_RC6,
+	RC6P,
+	RC6PP,
+	NUM_RESIDENCIES,
+};
+
+static const char * const residency_names[NUM_RESIDENCIES] = {
+	[RC6] = "power/rc6_residency_ms",
+	[MEDIA_RC6] = "power/media_rc6_residency_ms",
+	[RC6P] = "power/rc6p_residency_ms",
+	[RC6PP] = "power/rc6pp_residency_ms",
+};
+
+/* Kept open, as the residencies are sampled in tight loops */
+static struct igt_sysfs_attr residency_attrs[NUM_RESIDENCIES];
+
 struct residencies {
 	int rc6;
 	int media_rc6;
@@ -82,24 +100,16 @@ static unsigned long get_rc6_enabled_mask(void)
 	return enabled;
 }
 
-static bool has_rc6_residency(const char *name)
+static bool has_rc6_residency(int id)
 {
-	unsigned long residency;
-	char path[128];
+	uint64_t residency;
 
-	sprintf(path, "power/%s_residency_ms", name);
-	return igt_sysfs_scanf(sysfs, path, "%lu", &residency) == 1;
+	return __igt_sysfs_attr_get_u64(&residency_attrs[id], &residency);
 }
 
-static unsigned long read_rc6_residency(const char *name)
+static unsigned long read_rc6_residency(int id)
 {
-	unsigned long residency;
-	char path[128];
-
-	residency = 0;
-	sprintf(path, "power/%s_residency_ms", name);
-	igt_assert(igt_sysfs_scanf(sysfs, path, "%lu", &residency) == 1);
-	return residency;
+	return igt_sysfs_attr_get_u64(&residency_attrs[id]);
 }
 
 static void residency_accuracy(unsigned int diff,
@@ -128,22 +138,38 @@ static unsigned long gettime_ms(void)
 static void read_residencies(int devid, unsigned int mask,
 			     struct residencies *res)
 {
-	res->duration = gettime_ms();
-
-	if (mask & RC6_ENABLED)
-		res->rc6 = read_rc6_residency("rc6");
+	const struct igt_sysfs_attr *attrs[NUM_RESIDENCIES];
+	uint64_t values[NUM_RESIDENCIES];
+	int *results[NUM_RESIDENCIES];
+	int count = 0;
+
+	if (mask & RC6_ENABLED) {
+		attrs[count] = &residency_attrs[RC6];
+		results[count++] = &res->rc6;
+	}
 
 	if ((mask & RC6_ENABLED) &&
-	    (IS_VALLEYVIEW(devid) || IS_CHERRYVIEW(devid)))
-		res->media_rc6 = read_rc6_residency("media_rc6");
+	    (IS_VALLEYVIEW(devid) || IS_CHERRYVIEW(devid))) {
+		attrs[count] = &residency_attrs[MEDIA_RC6];
+		results[count++] = &res->media_rc6;
+	}
 
-	if (mask & RC6P_ENABLED)
-		res->rc6p = read_rc6_residency("rc6p");
+	if (mask & RC6P_ENABLED) {
+		attrs[count] = &residency_attrs[RC6P];
+		results[count++] = &res->rc6p;
+	}
 
-	if (mask & RC6PP_ENABLED)
-		res->rc6pp = read_rc6_residency("rc6pp");
+	if (mask & RC6PP_ENABLED) {
+		attrs[count] = &residency_attrs[RC6PP];
+		results[count++] = &res->rc6pp;
+	}
 
+	res->duration = gettime_ms();
+	igt_assert_eq(igt_sysfs_attr_get_u64_batch(attrs, count, values), count);
 	res->duration += (gettime_ms() - res->duration) / 2;
+
+	for (int i = 0; i < count; i++)
+		*results[i] = values[i];
 }
 
 static void measure_residencies(int devid, unsigned int mask,
@@ -205,11 +231,11 @@ static bool wait_for_rc6(void)
 	usleep(160 * 1000);
 
 	/* Then poll for RC6 to start ticking */
-	now = read_rc6_residency("rc6");
+	now = read_rc6_residency(RC6);
 	do {
 		start = now;
 		usleep(5000);
-		now = read_rc6_residency("rc6");
+		now = read_rc6_residency(RC6);
 		if (now - start > 1)
 			return true;
 	} while (!igt_seconds_elapsed(&tv));
@@ -594,8 +620,11 @@ igt_main
 		igt_fixture {
 			devid = intel_get_drm_devid(i915);
 			sysfs = igt_sysfs_open(i915);
+			for (int i = 0; i < NUM_RESIDENCIES; i++)
+				igt_sysfs_attr_open(&residency_attrs[i], sysfs,
+						    residency_names[i]);
 
-			igt_require(has_rc6_residency("rc6"));
+			igt_require(has_rc6_residency(RC6));
 
 			/* Make sure rc6 counters are running */
 			igt_drop_caches_set(i915, DROP_IDLE);
@@ -621,8 +650,11 @@ igt_main
 			residency_accuracy(res.media_rc6, res.duration, "media_rc6");
 		}
 
-		igt_fixture
+		igt_fixture {
+			for (int i = 0; i < NUM_RESIDENCIES; i++)
+				igt_sysfs_attr_close(&residency_attrs[i]);
 			close(sysfs);
+		}
 	}
 
 	igt_fixture {
@@ -206,6 +206,7 @@ igt_main
 
 		for_each_pipe_with_valid_output(&data.display, pipe, output) {
 			igt_plane_t *plane;
+			uint64_t modifier[2];
 
 			igt_display_reset(&data.display);
 			pipe_crc_free(&data);
@@ -216,19 +217,8 @@ igt_main
 
 			plane = igt_output_get_plane_type(output, DRM_PLANE_TYPE_PRIMARY);
 
-			for (int i = 0; i < plane->format_mod_count; i++) {
-				if (plane->formats[i] != data.testformat)
-					continue;
-
-				for (int j = 0; j < plane->format_mod_count; j++) {
-					uint64_t modifier[2] = {
-						plane->modifiers[i],
-						plane->modifiers[j],
-					};
-
-					if (plane->formats[j] != data.testformat)
-						continue;
-
+			for_each_plane_format_modifier(plane, data.testformat, modifier[0]) {
+				for_each_plane_format_modifier(plane, data.testformat, modifier[1]) {
 					igt_dynamic_f("pipe-%s-%s-%s-to-%s",
 						      kmstest_pipe_name(pipe),
 						      igt_output_name(output),
@@ -633,12 +633,9 @@ static void run_test_with_modifiers(data_t *data, void (*test)(data_t *))
 	for_each_pipe_with_valid_output(&data->display, data->pipe, data->output) {
 		test_init(data);
 
-		for (int i = 0; i < data->plane->format_mod_count; i++) {
-			if (data->plane->formats[i] != DRM_FORMAT_XRGB8888)
-				continue;
-
+		for_each_plane_format_modifier(data->plane, DRM_FORMAT_XRGB8888,
+					       data->modifier) {
 			data->allow_fail = true;
-			data->modifier = data->plane->modifiers[i];
 
 			igt_dynamic_f("pipe-%s-%s-%s", kmstest_pipe_name(data->pipe),
 				      data->output->name,
@@ -188,9 +188,22 @@ static bool cursor_visible(data_t *data, int x, int y)
 
 static void restore_image(data_t *data, uint32_t buffer, cursorarea *cursor)
 {
+	cursorarea area = data->oldcursorarea[buffer];
 	cairo_t *cr;
 
-	cr = igt_get_cairo_ctx(data->drm_fd, &data->primary_fb[buffer]);
+	/* Only the old and new cursor areas need to be written back */
+	if (cursor) {
+		int x2 = max(area.x + area.width, cursor->x + cursor->width);
+		int y2 = max(area.y + area.height, cursor->y + cursor->height);
+
+		area.x = min(area.x, cursor->x);
+		area.y = min(area.y, cursor->y);
+		area.width = x2 - area.x;
+		area.height = y2 - area.y;
+	}
+
+	cr = igt_get_cairo_ctx_rect(data->drm_fd, &data->primary_fb[buffer],
+				    area.x, area.y, area.width, area.height);
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_surface(cr, data->surface, 0, 0);
 	cairo_rectangle(cr, data->oldcursorarea[buffer].x,
@@ -167,41 +167,91 @@ get_logical_counters(struct intel_perf_metric_set *metric_set,
 }
 
 static void
-print_report_deltas(const struct intel_perf_data_reader *reader,
-		    const struct drm_i915_perf_record_header *i915_report0,
-		    const struct drm_i915_perf_record_header *i915_report1,
-		    struct intel_perf_logical_counter **counters,
-		    uint32_t n_counters)
+print_counters(const struct intel_perf_metric_set *metric_set,
+	       const union intel_perf_counter_value *values,
+	       uint32_t n_accumulators, uint32_t accumulator,
+	       struct intel_perf_logical_counter **counters,
+	       uint32_t n_counters)
 {
-	struct intel_perf_accumulator accu;
-
-	intel_perf_accumulate_reports(&accu,
-				      reader->perf, reader->metric_set,
-				      i915_report0, i915_report1);
-
 	for (uint32_t c = 0; c < n_counters; c++) {
 		struct intel_perf_logical_counter *counter = counters[c];
+		const union intel_perf_counter_value *value =
+			&values[(counter - metric_set->counters) * n_accumulators +
+				accumulator];
 
 		switch (counter->storage) {
 		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
 		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
 		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
 			fprintf(stdout, "   %s: %" PRIu64 "\n",
-				counter->symbol_name, counter->read_uint64(reader->perf,
-									   reader->metric_set,
-									   accu.deltas));
+				counter->symbol_name, value->u64);
 			break;
 		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
 		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
 			fprintf(stdout, "   %s: %f\n",
-				counter->symbol_name, counter->read_float(reader->perf,
-									  reader->metric_set,
-									  accu.deltas));
+				counter->symbol_name, value->f);
 			break;
 		}
 	}
 }
 
+/*
+ * Prints the counters over a timeline item, and optionally for each of its
+ * reports. The deltas are all accumulated first, so that the counters of the
+ * whole item are evaluated in one go.
+ */
+static void
+print_timeline_deltas(const struct intel_perf_data_reader *reader,
+		      const struct intel_perf_timeline_item *item,
+		      bool print_reports,
+		      struct intel_perf_logical_counter **counters,
+		      uint32_t n_counters)
+{
+	const struct intel_perf_metric_set *metric_set = reader->metric_set;
+	uint32_t n_reports = print_reports ?
+		item->record_end - item->record_start : 0;
+	uint32_t n_accumulators = 1 + n_reports;
+	struct intel_perf_accumulator *accumulators;
+	union intel_perf_counter_value *values = NULL;
+
+	if (n_counters) {
+		accumulators = malloc(sizeof(*accumulators) * n_accumulators);
+		values = malloc(sizeof(*values) * n_accumulators *
+				metric_set->n_counters);
+		assert(accumulators && values);
+
+		intel_perf_accumulate_reports(&accumulators[0],
+					      reader->perf, metric_set,
+					      reader->records[item->record_start],
+					      reader->records[item->record_end]);
+		for (uint32_t r = 0; r < n_reports; r++) {
+			uint32_t record = item->record_start + r;
+
+			intel_perf_accumulate_reports(&accumulators[1 + r],
+						      reader->perf, metric_set,
+						      reader->records[record],
+						      reader->records[record + 1]);
+		}
+
+		metric_set->evaluate(reader->perf, metric_set,
+				     accumulators, n_accumulators, values);
+		free(accumulators);
+
+		print_counters(metric_set, values, n_accumulators, 0,
+			       counters, n_counters);
+	}
+
+	for (uint32_t r = 0; r < n_reports; r++) {
+		fprintf(stdout, " report%i = %s\n", r,
+			intel_perf_read_report_reason(reader->perf,
+						      reader->records[item->record_start + r]));
+		print_counters(metric_set, values, n_accumulators, 1 + r,
+			       counters, n_counters);
+	}
+
+	free(values);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -318,22 +368,8 @@ main(int argc, char *argv[])
 		fprintf(stdout, "hw_id=0x%x %s\n",
 			item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
 
-		print_report_deltas(&reader,
-				    reader.records[item->record_start],
-				    reader.records[item->record_end],
-				    counters, n_counters);
-
-		if (print_reports) {
-			for (uint32_t r = item->record_start; r < item->record_end; r++) {
-				fprintf(stdout, " report%i = %s\n",
-					r - item->record_start,
-					intel_perf_read_report_reason(reader.perf, reader.records[r]));
-				print_report_deltas(&reader,
-						    reader.records[r],
-						    reader.records[r + 1],
-						    counters, n_counters);
-			}
-		}
+		print_timeline_deltas(&reader, item, print_reports,
+				      counters, n_counters);
 	}
 
  exit:
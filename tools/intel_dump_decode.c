@@ -37,6 +37,7 @@
 #include "i915/intel_decode.h"
 
 struct intel_decode *ctx;
+int json;
 
 static void
 read_bin_file(const char * filename)
@@ -92,7 +93,8 @@ read_data_file(const char * filename)
 
 	matched = sscanf (line, "%08x : %08x", &offset, &value);
 	if (matched != 2) {
-	    printf("ignoring line %s", line);
+	    /* keep the JSON output parseable */
+	    fprintf(json ? stderr : stdout, "ignoring line %s", line);
 
 	    continue;
 	}
@@ -166,12 +168,13 @@ main (int argc, char *argv[])
 		{"devid", 1, 0, 'd'},
 		{"ascii", 0, 0, 'a'},
 		{"binary", 0, 0, 'b'},
+		{"json", 0, 0, 'j'},
 		{ 0 }
 	};
 
 	devid_str = getenv("INTEL_DEVID_OVERRIDE");
 
-	while((c = getopt_long(argc, argv, "ad:b",
+	while((c = getopt_long(argc, argv, "ad:bj",
 			       long_options, &option_index)) != -1) {
 		switch(c) {
 		case 'd':
@@ -183,6 +186,9 @@ main (int argc, char *argv[])
 		case 'a':
 			binary = 0;
 			break;
+		case 'j':
+			json = 1;
+			break;
 		default:
 			printf("unkown command options\n");
 			break;
@@ -193,6 +199,8 @@ main (int argc, char *argv[])
 		devid = strtoul(devid_str, NULL, 0);
 
 	ctx = intel_decode_context_alloc(devid);
+	if (json)
+		intel_decode_set_output_format(ctx, INTEL_DECODE_FORMAT_JSON);
 
 	if (optind == argc) {
 		fprintf(stderr, "no input file given\n");
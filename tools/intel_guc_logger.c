@@ -41,6 +41,7 @@
 #include <pthread.h>
 
 #include "igt.h"
+#include "i915/guc_log_capture.h"
 
 #define MB(x) ((uint64_t)(x) * 1024 * 1024)
 #ifndef PAGE_SIZE
@@ -60,19 +61,21 @@
 #define DEFAULT_OUTPUT_FILE_NAME  "guc_log_dump.dat"
 #define CONTROL_FILE_NAME "i915_guc_log_control"
 
-char *read_buffer;
 char *out_filename;
 int poll_timeout = 2; /* by default 2ms timeout */
-pthread_mutex_t mutex;
 pthread_t flush_thread;
 int verbosity_level = 3; /* by default capture logs at max verbosity */
-uint32_t produced, consumed;
-uint64_t total_bytes_written;
 int num_buffers = NUM_SUBBUFS;
 int relay_fd, outfile_fd = -1;
-uint32_t test_duration, max_filesize;
-pthread_cond_t underflow_cond, overflow_cond;
-bool stop_logging, discard_oldlogs, capturing_stopped;
+uint32_t test_duration, max_filesize, window_size;
+bool stop_logging, discard_oldlogs;
+struct guc_log_capture capture;
+
+/* Log drops as counted by i915, see read_guc_log_drops() */
+struct guc_log_drops {
+	uint64_t relay_full;
+	uint64_t overflows;
+} drops_before, drops_after;
 
 static void guc_log_control(bool enable, uint32_t log_level)
 {
@@ -105,6 +108,46 @@ static void guc_log_control(bool enable, uint32_t log_level)
 	close(control_fd);
 }
 
+/*
+ * i915 counts the sub-buffers it couldn't hand to relay because the
+ * logger was late ("Relay full count"), and the GuC the times its own log
+ * buffer overflowed before i915 copied it out ("overflow count", per log
+ * buffer type).
+ */
+static void read_guc_log_drops(struct guc_log_drops *drops)
+{
+	const char *files[] = { "i915_guc_info", "gt/uc/guc_info" };
+	char *line = NULL;
+	size_t len = 0;
+	FILE *file = NULL;
+	int fd, i;
+
+	memset(drops, 0, sizeof(*drops));
+
+	for (i = 0; i < ARRAY_SIZE(files) && !file; i++) {
+		fd = igt_debugfs_open(-1, files[i], O_RDONLY);
+		if (fd >= 0)
+			file = fdopen(fd, "r");
+	}
+	if (!file)
+		return;
+
+	while (getline(&line, &len, file) > 0) {
+		unsigned int val;
+		char *s;
+
+		if ((s = strstr(line, "Relay full count:")) &&
+		    sscanf(s, "Relay full count: %u", &val) == 1)
+			drops->relay_full += val;
+		else if ((s = strstr(line, "overflow count")) &&
+			 sscanf(s, "overflow count %u", &val) == 1)
+			drops->overflows += val;
+	}
+
+	free(line);
+	fclose(file);
+}
+
 static void int_sig_handler(int sig)
 {
 	igt_info("received signal %d\n", sig);
@@ -112,14 +155,18 @@ static void int_sig_handler(int sig)
 	stop_logging = true;
 }
 
-static void pull_leftover_data(void)
+static void discard_old_logs(void)
 {
 	unsigned int bytes_read = 0;
+	char *buffer;
 	int ret;
 
+	buffer = malloc(SUBBUF_SIZE);
+	igt_assert_f(buffer, "couldn't allocate the read buffer\n");
+
 	do {
 		/* Read the logs from relay buffer */
-		ret = read(relay_fd, read_buffer, SUBBUF_SIZE);
+		ret = read(relay_fd, buffer, SUBBUF_SIZE);
 		if (!ret)
 			break;
 
@@ -127,51 +174,22 @@ static void pull_leftover_data(void)
 		igt_assert_f(ret == SUBBUF_SIZE, "invalid read from relay file\n");
 
 		bytes_read += ret;
-
-		if (outfile_fd >= 0) {
-			ret = write(outfile_fd, read_buffer, SUBBUF_SIZE);
-			igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-			total_bytes_written += ret;
-		}
 	} while(1);
 
-	igt_debug("%u bytes flushed\n", bytes_read);
-}
-
-static int num_filled_bufs(void)
-{
-	return (produced - consumed);
+	free(buffer);
+	igt_debug("%u bytes discarded\n", bytes_read);
 }
 
 static void pull_data(void)
 {
-	char *ptr;
-	int ret;
-
-	pthread_mutex_lock(&mutex);
-	while (num_filled_bufs() >= num_buffers) {
-		igt_debug("overflow, will wait, produced %u, consumed %u\n", produced, consumed);
-		/* Stall the main thread in case of overflow, as there are no
-		 * buffers available to store the new logs, otherwise there
-		 * could be corruption if both threads work on the same buffer.
-		 */
-		pthread_cond_wait(&overflow_cond, &mutex);
-	};
-	pthread_mutex_unlock(&mutex);
+	ssize_t ret;
 
-	ptr = read_buffer + (produced % num_buffers) * SUBBUF_SIZE;
+	/* Blocks while all the queued buffers are still to be written out */
+	ret = guc_log_capture_pull(&capture);
+	igt_assert_f(ret >= 0, "failed to read from the guc log file: %s\n",
+		     strerror(-ret));
 
-	/* Read the logs from relay buffer */
-	ret = read(relay_fd, ptr, SUBBUF_SIZE);
-	igt_assert_f(ret >= 0, "failed to read from the guc log file\n");
-	igt_assert_f(!ret || ret == SUBBUF_SIZE, "invalid read from relay file\n");
-
-	if (ret) {
-		pthread_mutex_lock(&mutex);
-		produced++;
-		pthread_cond_signal(&underflow_cond);
-		pthread_mutex_unlock(&mutex);
-	} else {
+	if (!ret) {
 		/* Occasionally (very rare) read from the relay file returns no
 		 * data, albeit the polling done prior to read call indicated
 		 * availability of data.
@@ -180,47 +198,38 @@ static void pull_data(void)
 	}
 }
 
+static void pull_leftover_data(void)
+{
+	uint64_t subbufs = capture.stats.subbufs;
+
+	while (guc_log_capture_pull(&capture) > 0)
+		;
+
+	igt_debug("%" PRIu64 " bytes flushed\n",
+		  (capture.stats.subbufs - subbufs) * SUBBUF_SIZE);
+}
+
 static void *flusher(void *arg)
 {
-	char *ptr;
-	int ret;
+	ssize_t ret;
 
 	igt_debug("execution started of flusher thread\n");
 
-	do {
-		pthread_mutex_lock(&mutex);
-		while (!num_filled_bufs()) {
-			/* Exit only after completing the flush of all the filled
-			 * buffers as User would expect that all logs captured up
-			 * till the point of interruption/exit are written out to
-			 * the disk file.
-			 */
-			if (capturing_stopped) {
-				igt_debug("flusher to exit now\n");
-				pthread_mutex_unlock(&mutex);
-				return NULL;
-			}
-			pthread_cond_wait(&underflow_cond, &mutex);
-		};
-		pthread_mutex_unlock(&mutex);
-
-		ptr = read_buffer + (consumed % num_buffers) * SUBBUF_SIZE;
-
-		ret = write(outfile_fd, ptr, SUBBUF_SIZE);
-		igt_assert_f(ret == SUBBUF_SIZE, "couldn't dump the logs in a file\n");
-
-		total_bytes_written += ret;
-		if (max_filesize && (total_bytes_written > MB(max_filesize))) {
+	/* Exit only after completing the flush of all the queued buffers,
+	 * as User would expect that all logs captured up till the point of
+	 * interruption/exit are written out to the disk file.
+	 */
+	while ((ret = guc_log_capture_flush(&capture)) > 0) {
+		if (max_filesize &&
+		    capture.stats.bytes_written > MB(max_filesize)) {
 			igt_debug("reached the target of %" PRIu64 " bytes\n", MB(max_filesize));
 			stop_logging = true;
 		}
+	}
+	igt_assert_f(ret == 0, "couldn't dump the logs in a file: %s\n",
+		     strerror(-ret));
 
-		pthread_mutex_lock(&mutex);
-		consumed++;
-		pthread_cond_signal(&overflow_cond);
-		pthread_mutex_unlock(&mutex);
-	} while(1);
-
+	igt_debug("flusher to exit now\n");
 	return NULL;
 }
 
@@ -230,10 +239,6 @@ static void init_flusher_thread(void)
 	pthread_attr_t		p_attr;
 	int ret;
 
-	pthread_cond_init(&underflow_cond, NULL);
-	pthread_cond_init(&overflow_cond, NULL);
-	pthread_mutex_init(&mutex, NULL);
-
 	ret = pthread_attr_init(&p_attr);
 	igt_assert_f(ret == 0, "error obtaining default thread attributes\n");
 
@@ -244,8 +249,8 @@ static void init_flusher_thread(void)
 	igt_assert_f(ret == 0, "couldn't set thread scheduling policy\n");
 
 	/* Keep the flusher task also at rt priority, so that it doesn't get
-	 * too late in flushing the collected logs in local buffers to the disk,
-	 * and so main thread always have spare buffers to collect the logs.
+	 * too late in flushing the queued logs to the disk, and so main
+	 * thread always has room in the queue to collect the logs.
 	 */
 	thread_sched.sched_priority = 5;
 	ret = pthread_attr_setschedparam(&p_attr, &thread_sched);
@@ -271,7 +276,7 @@ static void open_relay_file(void)
 	 * a different shell.
 	 */
 	if (discard_oldlogs)
-		pull_leftover_data();
+		discard_old_logs();
 }
 
 static void open_output_file(void)
@@ -286,8 +291,60 @@ static void open_output_file(void)
 			  O_CREAT | O_WRONLY | O_TRUNC | O_DIRECT,
 			  0440);
 	igt_assert_f(outfile_fd >= 0, "couldn't open the output file\n");
+}
 
-	free(out_filename);
+/*
+ * The window is written circularly, rewrite the file with the oldest
+ * logs first.
+ */
+static void linearize_output_file(void)
+{
+	const char *name = out_filename ? : DEFAULT_OUTPUT_FILE_NAME;
+	char *tmp;
+	int fd, ret;
+
+	if (!capture.wrapped)
+		return;
+
+	ret = asprintf(&tmp, "%s.tmp", name);
+	igt_assert_f(ret > 0, "couldn't allocate the temporary filename\n");
+
+	/* The window was opened write only, for O_DIRECT */
+	close(outfile_fd);
+	outfile_fd = open(name, O_RDONLY);
+	igt_assert_f(outfile_fd >= 0, "couldn't reopen the output file\n");
+	capture.out_fd = outfile_fd;
+
+	fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0440);
+	igt_assert_f(fd >= 0, "couldn't open %s\n", tmp);
+
+	ret = guc_log_capture_linearize(&capture, fd);
+	igt_assert_f(ret == 0, "couldn't reorder the logs: %s\n",
+		     strerror(-ret));
+	close(fd);
+
+	ret = rename(tmp, name);
+	igt_assert_f(ret == 0, "couldn't rename %s\n", tmp);
+
+	free(tmp);
+}
+
+static void init_capture(void)
+{
+	struct guc_log_capture_params params = {
+		.subbuf_size = SUBBUF_SIZE,
+		.nr_subbufs = num_buffers,
+		.window = MB(window_size),
+	};
+	int ret;
+
+	ret = guc_log_capture_init(&capture, relay_fd, outfile_fd, &params);
+	igt_assert_f(ret == 0, "couldn't set up the capture: %s\n",
+		     strerror(-ret));
+
+	if (capture.queue_size < num_buffers * SUBBUF_SIZE)
+		igt_info("queueing %zu buffers instead of %d, see /proc/sys/fs/pipe-max-size\n",
+			 capture.queue_size / SUBBUF_SIZE, num_buffers);
 }
 
 static void init_main_thread(void)
@@ -310,14 +367,6 @@ static void init_main_thread(void)
 	if (signal(SIGALRM, int_sig_handler) == SIG_ERR)
 		igt_assert_f(0, "SIGALRM handler registration failed\n");
 
-	/* Need an aligned pointer for direct IO */
-	ret = posix_memalign((void **)&read_buffer, PAGE_SIZE, num_buffers * SUBBUF_SIZE);
-	igt_assert_f(ret == 0, "couldn't allocate the read buffer\n");
-
-	/* Keep the pages locked in RAM, avoid page fault overhead */
-	ret = mlock(read_buffer, num_buffers * SUBBUF_SIZE);
-	igt_assert_f(ret == 0, "failed to lock memory\n");
-
 	/* Enable the logging, it may not have been enabled from boot and so
 	 * the relay file also wouldn't have been created.
 	 */
@@ -325,6 +374,9 @@ static void init_main_thread(void)
 
 	open_relay_file();
 	open_output_file();
+	init_capture();
+
+	read_guc_log_drops(&drops_before);
 }
 
 static int parse_options(int opt, int opt_index, void *data)
@@ -363,6 +415,11 @@ static int parse_options(int opt, int opt_index, void *data)
 		igt_assert_f(max_filesize > 0, "invalid input for -s option\n");
 		igt_debug("max allowed size of the output file is %d MB\n", max_filesize);
 		break;
+	case 'w':
+		window_size = atoi(optarg);
+		igt_assert_f(window_size > 0, "invalid input for -w option\n");
+		igt_debug("only the last %d MB of logs to be kept\n", window_size);
+		break;
 	case 'd':
 		discard_oldlogs = true;
 		igt_debug("old/boot-time logs will be discarded\n");
@@ -381,6 +438,7 @@ static void process_command_line(int argc, char **argv)
 		{"testduration", required_argument, 0, 't'},
 		{"polltimeout", required_argument, 0, 'p'},
 		{"size", required_argument, 0, 's'},
+		{"window", required_argument, 0, 'w'},
 		{"discard", no_argument, 0, 'd'},
 		{ 0, 0, 0, 0 }
 	};
@@ -392,9 +450,10 @@ static void process_command_line(int argc, char **argv)
 		"  -t --testduration=sec  max duration in seconds for which the logger should run\n"
 		"  -p --polltimeout=ms    polling timeout in ms, -1 == indefinite wait for the new data\n"
 		"  -s --size=MB           max size of output file in MBs after which logging will be stopped\n"
+		"  -w --window=MB         keep only the last MBs of logs, overwriting the older ones\n"
 		"  -d --discard           discard the old/boot-time logs before entering into the capture loop\n";
 
-	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:d", long_options,
+	igt_simple_init_parse_opts(&argc, argv, "v:o:b:t:p:s:w:d", long_options,
 				   help, parse_options, NULL);
 }
 
@@ -409,8 +468,8 @@ int main(int argc, char **argv)
 	init_main_thread();
 
 	/* Use a separate thread for flushing the logs to a file on disk.
-	 * Main thread will buffer the data from relay file in its pool of
-	 * buffers and other thread will flush the data to disk in background.
+	 * Main thread will queue the data from relay file, spliced into a
+	 * pipe, and other thread will flush the data to disk in background.
 	 * This is needed, albeit by default data is written out to disk in
 	 * async mode, as when there are too many dirty pages in the RAM,
 	 * (/proc/sys/vm/dirty_ratio), kernel starts blocking the processes
@@ -455,15 +514,29 @@ int main(int argc, char **argv)
 	/* Pause logging on the GuC side */
 	guc_log_control(false, 0);
 
-	/* Signal flusher thread to make an exit */
-	capturing_stopped = 1;
-	pthread_cond_signal(&underflow_cond);
-	pthread_join(flush_thread, NULL);
-
+	/* Queue the leftover logs, and let the flusher thread exit once
+	 * it has written out everything queued.
+	 */
 	pull_leftover_data();
-	igt_info("total bytes written %" PRIu64 "\n", total_bytes_written);
+	guc_log_capture_close_queue(&capture);
+	pthread_join(flush_thread, NULL);
 
-	free(read_buffer);
+	linearize_output_file();
+
+	read_guc_log_drops(&drops_after);
+	igt_info("total bytes written %" PRIu64 "\n", capture.stats.bytes_written);
+	igt_info("buffers captured %" PRIu64 ", stalled on a full queue %" PRIu64 ", empty reads %" PRIu64 "\n",
+		 capture.stats.subbufs, capture.stats.stalls,
+		 capture.stats.empty_reads);
+	igt_info("dropped by i915: relay full %" PRIu64 ", GuC buffer overflows %" PRIu64 "\n",
+		 drops_after.relay_full - drops_before.relay_full,
+		 drops_after.overflows - drops_before.overflows);
+	if (capture.window)
+		igt_info("window wrapped %" PRIu64 " times, %" PRIu64 " bytes overwritten\n",
+			 capture.stats.window_wraps, capture.stats.discarded);
+
+	guc_log_capture_fini(&capture);
+	free(out_filename);
 	close(relay_fd);
 	close(outfile_fd);
 	igt_exit();
@@ -22,12 +22,14 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -82,6 +84,7 @@ struct config {
 
 	struct reg *regs;
 	ssize_t regcount;
+	struct reg_index index;
 
 	int verbosity;
 };
@@ -90,28 +93,22 @@ struct config {
 static int set_reg_by_addr(struct config *config, struct reg *reg,
 			   uint32_t addr)
 {
-	int i;
+	const struct reg *r;
 
 	reg->addr = addr;
 	if (reg->name)
 		free(reg->name);
 	reg->name = NULL;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		/* ->mmio_offset should be 0 for non-MMIO ports. */
-		if (addr + reg->mmio_offset == r->addr + r->mmio_offset) {
-			/* Always output the "normalized" offset+addr. */
-			reg->mmio_offset = r->mmio_offset;
-			reg->addr = r->addr;
+	/* ->mmio_offset should be 0 for non-MMIO ports. */
+	r = intel_reg_index_find_addr(&config->index, reg->port_desc.port,
+				      addr + reg->mmio_offset);
+	if (r) {
+		/* Always output the "normalized" offset+addr. */
+		reg->mmio_offset = r->mmio_offset;
+		reg->addr = r->addr;
 
-			reg->name = r->name ? strdup(r->name) : NULL;
-			break;
-		}
+		reg->name = r->name ? strdup(r->name) : NULL;
 	}
 
 	return 0;
@@ -121,32 +118,22 @@ static int set_reg_by_addr(struct config *config, struct reg *reg,
 static int set_reg_by_name(struct config *config, struct reg *reg,
 			   const char *name)
 {
-	int i;
+	const struct reg *r;
 
 	reg->name = strdup(name);
 	reg->addr = 0;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		if (!r->name)
-			continue;
-
-		if (strcasecmp(name, r->name) == 0) {
-			reg->addr = r->addr;
+	r = intel_reg_index_find_name(&config->index, reg->port_desc.port, name);
+	if (!r)
+		return -1;
 
-			/* Also get MMIO offset if not already specified. */
-			if (!reg->mmio_offset && r->mmio_offset)
-				reg->mmio_offset = r->mmio_offset;
+	reg->addr = r->addr;
 
-			return 0;
-		}
-	}
+	/* Also get MMIO offset if not already specified. */
+	if (!reg->mmio_offset && r->mmio_offset)
+		reg->mmio_offset = r->mmio_offset;
 
-	return -1;
+	return 0;
 }
 
 static void to_binary(char *buf, size_t buflen, uint32_t val)
@@ -864,27 +851,203 @@ static int intel_reg_write(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
+/* A saved MMIO bar, see intel_reg_snapshot() */
+struct snapshot {
+	const uint8_t *data;
+	size_t size;
+};
+
+static int snapshot_open(struct snapshot *snap, const char *filename)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "open '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "stat '%s': %s\n", filename, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "mmap '%s': %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	snap->data = data;
+	snap->size = st.st_size;
+
+	return 0;
+}
+
+static void snapshot_close(struct snapshot *snap)
+{
+	munmap((void *)snap->data, snap->size);
+}
+
+/* Only MMIO registers within the snapshot can be read */
+static bool snapshot_read(const struct snapshot *snap, const struct reg *reg,
+			  uint32_t *valp)
+{
+	uint32_t offset = reg->mmio_offset + reg->addr;
+	uint32_t val32;
+	uint16_t val16;
+
+	if (reg->engine)
+		return false;
+
+	switch (reg->port_desc.port) {
+	case PORT_MCHBAR_32:
+	case PORT_MMIO_32:
+		if (offset + sizeof(val32) > snap->size)
+			return false;
+		memcpy(&val32, snap->data + offset, sizeof(val32));
+		*valp = val32;
+		return true;
+	case PORT_MCHBAR_16:
+	case PORT_MMIO_16:
+		if (offset + sizeof(val16) > snap->size)
+			return false;
+		memcpy(&val16, snap->data + offset, sizeof(val16));
+		*valp = val16;
+		return true;
+	case PORT_MCHBAR_8:
+	case PORT_MMIO_8:
+		if (offset >= snap->size)
+			return false;
+		*valp = snap->data[offset];
+		return true;
+	default:
+		return false;
+	}
+}
+
 static int intel_reg_dump(struct config *config, int argc, char *argv[])
 {
+	struct snapshot snap;
 	struct reg *reg;
+	uint32_t val;
 	int i;
 
-	if (config->mmiofile)
-		intel_mmio_use_dump_file(&config->mmio_data, config->mmiofile);
+	/* can't dump sideband with mmiofile */
+	if (config->mmiofile) {
+		if (snapshot_open(&snap, config->mmiofile))
+			return EXIT_FAILURE;
+
+		for (i = 0; i < config->regcount; i++) {
+			reg = &config->regs[i];
+
+			if (snapshot_read(&snap, reg, &val))
+				dump_decode(config, reg, val);
+		}
+
+		snapshot_close(&snap);
+
+		return EXIT_SUCCESS;
+	}
+
+	intel_register_access_init(&config->mmio_data, config->pci_dev, 0, -1);
+
+	for (i = 0; i < config->regcount; i++)
+		dump_register(config, &config->regs[i]);
+
+	intel_register_access_fini(&config->mmio_data);
+
+	return EXIT_SUCCESS;
+}
+
+static void print_diff_decode(const char *prefix, char *decode)
+{
+	char *line, *save;
+
+	for (line = strtok_r(decode, "\n", &save); line;
+	     line = strtok_r(NULL, "\n", &save))
+		printf("%37s %s\n", prefix, line);
+}
+
+static void diff_decode(struct config *config, struct reg *reg,
+			uint32_t old, uint32_t new)
+{
+	uint32_t devid = config->all_platforms ? 0 : config->devid;
+	char tmp[1024];
+	char bin[200];
+
+	if (reg->mmio_offset)
+		printf("%24s (0x%08x:0x%08x): 0x%08x -> 0x%08x\n",
+		       reg->name ?: "", reg->mmio_offset, reg->addr, old, new);
 	else
-		intel_register_access_init(&config->mmio_data, config->pci_dev, 0, -1);
+		printf("%35s (0x%08x): 0x%08x -> 0x%08x\n",
+		       reg->name ?: "", reg->addr, old, new);
+
+	intel_reg_spec_decode(tmp, sizeof(tmp), reg, old, devid);
+	print_diff_decode("-", tmp);
+	intel_reg_spec_decode(tmp, sizeof(tmp), reg, new, devid);
+	print_diff_decode("+", tmp);
+
+	if (config->binary) {
+		to_binary(bin, sizeof(bin), old ^ new);
+		printf("changed bits:\n%s", bin);
+	}
+}
+
+static int intel_reg_diff(struct config *config, int argc, char *argv[])
+{
+	struct snapshot old, new;
+	uint32_t a, b, offset;
+	int i;
+
+	if (!config->mmiofile || argc != 2) {
+		fprintf(stderr, "diff: compares --mmio=FILE to one other snapshot\n");
+		return EXIT_FAILURE;
+	}
+
+	if (snapshot_open(&old, config->mmiofile))
+		return EXIT_FAILURE;
+
+	if (snapshot_open(&new, argv[1])) {
+		snapshot_close(&old);
+		return EXIT_FAILURE;
+	}
+
+	if (old.size != new.size && config->verbosity >= 0)
+		fprintf(stderr, "Warning: snapshot sizes differ, %zu vs. %zu bytes\n",
+			old.size, new.size);
 
 	for (i = 0; i < config->regcount; i++) {
-		reg = &config->regs[i];
+		struct reg *reg = &config->regs[i];
 
-		/* can't dump sideband with mmiofile */
-		if (config->mmiofile && !port_is_mmio(reg->port_desc.port))
-			continue;
+		if (snapshot_read(&old, reg, &a) &&
+		    snapshot_read(&new, reg, &b) && a != b)
+			diff_decode(config, reg, a, b);
+	}
 
-		dump_register(config, &config->regs[i]);
+	/* Also show changes outside the register spec, a dword at a time */
+	if (config->verbosity > 0) {
+		for (offset = 0;
+		     offset + sizeof(a) <= min(old.size, new.size);
+		     offset += sizeof(a)) {
+			memcpy(&a, old.data + offset, sizeof(a));
+			memcpy(&b, new.data + offset, sizeof(b));
+			if (a == b ||
+			    intel_reg_index_find_addr(&config->index,
+						      PORT_MMIO_32, offset))
+				continue;
+
+			printf("%35s (0x%08x): 0x%08x -> 0x%08x\n",
+			       "", offset, a, b);
+		}
 	}
 
-	intel_register_access_fini(&config->mmio_data);
+	snapshot_close(&new);
+	snapshot_close(&old);
 
 	return EXIT_SUCCESS;
 }
@@ -996,6 +1159,12 @@ static const struct command commands[] = {
 		.function = intel_reg_snapshot,
 		.description = "create a snapshot of the MMIO bar to stdout",
 	},
+	{
+		.name = "diff",
+		.function = intel_reg_diff,
+		.synopsis = "--mmio=FILE SNAPSHOT",
+		.description = "show the registers that differ between two MMIO snapshots",
+	},
 	{
 		.name = "list",
 		.function = intel_reg_list,
@@ -1282,6 +1451,11 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (intel_reg_index_init(&config.index, config.regs, config.regcount)) {
+		fprintf(stderr, "Error: %s\n", strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(commands); i++) {
 		if (strcmp(argv[0], commands[i].name) == 0) {
 			command = &commands[i];
@@ -1296,6 +1470,7 @@ int main(int argc, char *argv[])
 
 	ret = command->function(&config, argc, argv);
 
+	intel_reg_index_fini(&config.index);
 	free(config.mmiofile);
 
 	if (config.fd >= 0)
@@ -2673,6 +2673,97 @@ static struct {
 };
 #undef DECLARE_REGS
 
+/*
+ * known_registers[] entries sorted by address, keeping the table order for
+ * registers decoded by several tables.
+ */
+struct decode_entry {
+	uint32_t addr;
+	uint16_t table;
+	uint16_t index;
+};
+
+static struct {
+	struct decode_entry *entries;
+	int count;
+
+	/* Tables matching devid */
+	uint32_t devid;
+	bool match[ARRAY_SIZE(known_registers)];
+} decode_index;
+
+static int decode_entry_cmp(const void *A, const void *B)
+{
+	const struct decode_entry *a = A, *b = B;
+
+	if (a->addr != b->addr)
+		return a->addr < b->addr ? -1 : 1;
+	if (a->table != b->table)
+		return a->table < b->table ? -1 : 1;
+
+	return (int)a->index - (int)b->index;
+}
+
+static bool build_decode_index(void)
+{
+	int i, j, n = 0;
+
+	if (decode_index.entries)
+		return true;
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++)
+		n += known_registers[i].count;
+
+	decode_index.entries = calloc(n, sizeof(*decode_index.entries));
+	if (!decode_index.entries)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++) {
+		for (j = 0; j < known_registers[i].count; j++) {
+			struct decode_entry *e = &decode_index.entries[decode_index.count++];
+
+			e->addr = known_registers[i].regs[j].reg;
+			e->table = i;
+			e->index = j;
+		}
+	}
+
+	qsort(decode_index.entries, decode_index.count,
+	      sizeof(*decode_index.entries), decode_entry_cmp);
+
+	return true;
+}
+
+static void match_decode_tables(uint32_t devid)
+{
+	int i;
+
+	if (decode_index.devid == devid)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++)
+		decode_index.match[i] = !known_registers[i].match ||
+			known_registers[i].match(devid, 0);
+	decode_index.devid = devid;
+}
+
+/* First entry for addr, or the end of the index */
+static int decode_lookup(uint32_t addr)
+{
+	int lo = 0, hi = decode_index.count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (decode_index.entries[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
 /*
  * Decode register value into buffer for devid.
  *
@@ -2683,47 +2774,47 @@ int intel_reg_spec_decode(char *buf, size_t bufsize, const struct reg *reg,
 			  uint32_t val, uint32_t devid)
 {
 	char tmp[1024];
-	int i, j;
+	int i;
 
 	if (!bufsize)
 		return -1;
 
 	*buf = 0;
 
-	for (i = 0; i < ARRAY_SIZE(known_registers); i++) {
-		const struct reg_debug *regs = known_registers[i].regs;
+	if (!build_decode_index())
+		return -1;
 
-		if (devid) {
-			if (known_registers[i].match &&
-			    !known_registers[i].match(devid, 0))
-				continue;
-		}
+	if (devid)
+		match_decode_tables(devid);
 
-		for (j = 0; j < known_registers[i].count; j++) {
-			const struct reg_debug *r = &regs[j];
-			if (reg->addr != r->reg)
-				continue;
+	for (i = decode_lookup(reg->addr);
+	     i < decode_index.count && decode_index.entries[i].addr == reg->addr;
+	     i++) {
+		const struct decode_entry *e = &decode_index.entries[i];
+		const struct reg_debug *r = &known_registers[e->table].regs[e->index];
 
-			if (r->debug_output) {
-				if (r->debug_output(tmp, sizeof(tmp), r->reg,
-						    val, devid) == 0)
-					continue;
-			} else if (devid) {
-				return 0;
-			} else {
-				continue;
-			}
+		if (devid && !decode_index.match[e->table])
+			continue;
 
-			if (devid) {
-				strncpy(buf, tmp, bufsize);
-				return 0;
-			}
+		if (r->debug_output) {
+			if (r->debug_output(tmp, sizeof(tmp), r->reg,
+					    val, devid) == 0)
+				continue;
+		} else if (devid) {
+			return 0;
+		} else {
+			continue;
+		}
 
-			strncat(buf, known_registers[i].description, bufsize);
-			strncat(buf, "\t", bufsize);
-			strncat(buf, tmp, bufsize);
-			strncat(buf, "\n", bufsize);
+		if (devid) {
+			strncpy(buf, tmp, bufsize);
+			return 0;
 		}
+
+		strncat(buf, known_registers[e->table].description, bufsize);
+		strncat(buf, "\t", bufsize);
+		strncat(buf, tmp, bufsize);
+		strncat(buf, "\n", bufsize);
 	}
 
 	return 0;
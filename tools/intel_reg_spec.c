@@ -29,6 +29,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "intel_reg_spec.h"
 
@@ -409,3 +410,135 @@ void intel_reg_spec_print_ports(void)
 	for (i = 0; i < ARRAY_SIZE(port_descs); i++)
 		printf("%s%s", i == 0 ? "" : ", ", port_descs[i].name);
 }
+
+static int index_addr_cmp(const void *A, const void *B)
+{
+	const struct reg *a = *(const struct reg **)A;
+	const struct reg *b = *(const struct reg **)B;
+	uint32_t addr_a = a->addr + a->mmio_offset;
+	uint32_t addr_b = b->addr + b->mmio_offset;
+
+	if (a->port_desc.port != b->port_desc.port)
+		return a->port_desc.port < b->port_desc.port ? -1 : 1;
+	if (addr_a != addr_b)
+		return addr_a < addr_b ? -1 : 1;
+
+	/* First definition wins, as with a linear search */
+	return a < b ? -1 : a > b;
+}
+
+static int index_name_cmp(const void *A, const void *B)
+{
+	const struct reg *a = *(const struct reg **)A;
+	const struct reg *b = *(const struct reg **)B;
+	int r;
+
+	if (a->port_desc.port != b->port_desc.port)
+		return a->port_desc.port < b->port_desc.port ? -1 : 1;
+
+	r = strcasecmp(a->name, b->name);
+	if (r)
+		return r;
+
+	return a < b ? -1 : a > b;
+}
+
+/*
+ * Index register definitions by address and by name, to look them up in
+ * logarithmic time. The definitions must outlive the index.
+ */
+int intel_reg_index_init(struct reg_index *index,
+			 const struct reg *regs, size_t n)
+{
+	size_t i;
+
+	memset(index, 0, sizeof(*index));
+
+	index->by_addr = calloc(n ?: 1, sizeof(*index->by_addr));
+	index->by_name = calloc(n ?: 1, sizeof(*index->by_name));
+	if (!index->by_addr || !index->by_name) {
+		intel_reg_index_fini(index);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		index->by_addr[index->naddr++] = &regs[i];
+		if (regs[i].name)
+			index->by_name[index->nname++] = &regs[i];
+	}
+
+	qsort(index->by_addr, index->naddr, sizeof(*index->by_addr),
+	      index_addr_cmp);
+	qsort(index->by_name, index->nname, sizeof(*index->by_name),
+	      index_name_cmp);
+
+	return 0;
+}
+
+void intel_reg_index_fini(struct reg_index *index)
+{
+	free(index->by_addr);
+	free(index->by_name);
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+ * Find the first definition for port at addr, with addr including the MMIO
+ * offset of the definition.
+ */
+const struct reg *intel_reg_index_find_addr(const struct reg_index *index,
+					    enum port_addr port, uint32_t addr)
+{
+	size_t lo = 0, hi = index->naddr;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct reg *r = index->by_addr[mid];
+
+		if (r->port_desc.port < port ||
+		    (r->port_desc.port == port &&
+		     r->addr + r->mmio_offset < addr))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < index->naddr) {
+		const struct reg *r = index->by_addr[lo];
+
+		if (r->port_desc.port == port && r->addr + r->mmio_offset == addr)
+			return r;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the first definition for port named name, ignoring case.
+ */
+const struct reg *intel_reg_index_find_name(const struct reg_index *index,
+					    enum port_addr port,
+					    const char *name)
+{
+	size_t lo = 0, hi = index->nname;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct reg *r = index->by_name[mid];
+
+		if (r->port_desc.port < port ||
+		    (r->port_desc.port == port && strcasecmp(r->name, name) < 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < index->nname) {
+		const struct reg *r = index->by_name[lo];
+
+		if (r->port_desc.port == port && strcasecmp(r->name, name) == 0)
+			return r;
+	}
+
+	return NULL;
+}
@@ -77,6 +77,13 @@ struct reg {
 	char *name;
 };
 
+/* Definitions sorted by port and address, and by port and name */
+struct reg_index {
+	const struct reg **by_addr;
+	const struct reg **by_name;
+	size_t naddr, nname;
+};
+
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 #endif
@@ -94,4 +101,13 @@ int intel_reg_spec_decode(char *buf, size_t bufsize, const struct reg *reg,
 			  uint32_t val, uint32_t devid);
 void intel_reg_spec_print_ports(void);
 
+int intel_reg_index_init(struct reg_index *index,
+			 const struct reg *regs, size_t n);
+void intel_reg_index_fini(struct reg_index *index);
+const struct reg *intel_reg_index_find_addr(const struct reg_index *index,
+					    enum port_addr port, uint32_t addr);
+const struct reg *intel_reg_index_find_name(const struct reg_index *index,
+					    enum port_addr port,
+					    const char *name);
+
 #endif /* __INTEL_REG_SPEC_H__ */